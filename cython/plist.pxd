@@ -11,6 +11,8 @@ cdef class Node:
     cpdef object __deepcopy__(self, memo=*)
     cpdef unicode to_xml(self)
     cpdef bytes to_bin(self)
+    cpdef object to_xml_view(self)
+    cpdef object to_bin_view(self)
     cpdef object copy(self)
 
 cdef class Bool(Node):
@@ -42,6 +44,7 @@ cdef class Date(Node):
     cpdef object get_value(self)
 
 cdef class Data(Node):
+    cdef int _exports
     cpdef set_value(self, object value)
     cpdef bytes get_value(self)
 
@@ -67,7 +70,9 @@ cdef class Array(Node):
     cpdef append(self, object item)
 
 cpdef object from_xml(xml)
-cpdef object from_bin(bytes bin)
+cpdef object from_bin(bin)
+cpdef object loads(data)
 
 cdef object plist_t_to_node(plist_t c_plist, bint managed=*)
 cdef plist_t native_to_plist_t(object native)
+cdef object plist_t_to_native(plist_t c_plist)
@@ -1,10 +1,8 @@
 cimport cpython
-cimport libc.stdlib
+from cpython.buffer cimport PyBuffer_FillInfo, PyObject_GetBuffer, PyBuffer_Release, PyBUF_SIMPLE
+from cpython.bytes cimport PyBytes_FromStringAndSize
 from libc.stdint cimport *
-
-# https://groups.google.com/forum/#!topic/cython-users/xoKNFTRagvk
-cdef _from_string_and_size(char *s, size_t length):
-    return s[:length].encode('utf-8')
+from libc.string cimport strlen
 
 cdef extern from *:
     ctypedef enum plist_type:
@@ -60,6 +58,7 @@ cdef extern from *:
 
     void plist_dict_new_iter(plist_t node, plist_dict_iter *iter)
     void plist_dict_next_item(plist_t node, plist_dict_iter iter, char **key, plist_t *val)
+    void plist_dict_next_item_ptr(plist_t node, plist_dict_iter iter, const char **key, plist_t *val)
 
     plist_t plist_new_array()
     uint32_t plist_array_get_size(plist_t node)
@@ -71,6 +70,7 @@ cdef extern from *:
     void plist_array_remove_item(plist_t node, uint32_t n)
 
     void plist_free(plist_t plist)
+    void plist_mem_free(void *ptr)
     plist_t plist_copy(plist_t plist)
     void plist_to_xml(plist_t plist, char **plist_xml, uint32_t *length)
     void plist_to_bin(plist_t plist, char **plist_bin, uint32_t *length)
@@ -78,8 +78,44 @@ cdef extern from *:
     plist_t plist_get_parent(plist_t node)
     plist_type plist_get_node_type(plist_t node)
 
+    const char* plist_get_key_ptr(plist_t node, uint64_t *length)
+    const char* plist_get_string_ptr(plist_t node, uint64_t *length)
+    const char* plist_get_data_ptr(plist_t node, uint64_t *length)
+
+    ctypedef enum plist_parse_options_t:
+        PLIST_PARSE_DEFAULT,
+        PLIST_PARSE_BORROW
+
     void plist_from_xml(char *plist_xml, uint32_t length, plist_t * plist)
     void plist_from_bin(char *plist_bin, uint32_t length, plist_t * plist)
+    void plist_from_bin_ex(char *plist_bin, uint32_t length, uint32_t options, plist_t * plist)
+    int plist_is_binary(char *plist_data, uint32_t length)
+
+# A read-only buffer owning memory returned by libplist, exposed through
+# the buffer protocol so the output of to_xml_view()/to_bin_view() is not
+# copied into a bytes object.
+cdef class _Buffer:
+    cdef char* _data
+    cdef Py_ssize_t _length
+
+    def __dealloc__(self):
+        if self._data != NULL:
+            plist_mem_free(self._data)
+
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
+        PyBuffer_FillInfo(buffer, self, self._data, self._length, 1, flags)
+
+    def __releasebuffer__(self, Py_buffer *buffer):
+        pass
+
+    def __len__(self):
+        return self._length
+
+cdef object _buffer_view(char* data, Py_ssize_t length):
+    cdef _Buffer b = _Buffer.__new__(_Buffer)
+    b._data = data
+    b._length = length
+    return memoryview(b)
 
 cdef class Node:
     def __init__(self, *args, **kwargs):
@@ -107,7 +143,7 @@ cdef class Node:
             return cpython.PyUnicode_DecodeUTF8(out, length, 'strict')
         finally:
             if out != NULL:
-                libc.stdlib.free(out)
+                plist_mem_free(out)
 
     cpdef bytes to_bin(self):
         cdef:
@@ -116,10 +152,24 @@ cdef class Node:
         plist_to_bin(self._c_node, &out, &length)
 
         try:
-            return _from_string_and_size(out, length)
+            return PyBytes_FromStringAndSize(out, length)
         finally:
             if out != NULL:
-                libc.stdlib.free(out)
+                plist_mem_free(out)
+
+    cpdef object to_xml_view(self):
+        cdef:
+            char* out = NULL
+            uint32_t length = 0
+        plist_to_xml(self._c_node, &out, &length)
+        return _buffer_view(out, length)
+
+    cpdef object to_bin_view(self):
+        cdef:
+            char* out = NULL
+            uint32_t length = 0
+        plist_to_bin(self._c_node, &out, &length)
+        return _buffer_view(out, length)
 
     property parent:
         def __get__(self):
@@ -380,7 +430,7 @@ cdef class Key(Node):
         try:
             return cpython.PyUnicode_DecodeUTF8(c_value, len(c_value), 'strict')
         finally:
-            libc.stdlib.free(c_value)
+            plist_mem_free(c_value)
 
 cdef Key Key_factory(plist_t c_node, bint managed=True):
     cdef Key instance = Key.__new__(Key)
@@ -449,7 +499,7 @@ cdef class String(Node):
         try:
             return cpython.PyUnicode_DecodeUTF8(c_value, len(c_value), 'strict')
         finally:
-            libc.stdlib.free(c_value)
+            plist_mem_free(c_value)
 
 cdef String String_factory(plist_t c_node, bint managed=True):
     cdef String instance = String.__new__(String)
@@ -543,20 +593,31 @@ cdef class Data(Node):
         if op == 5:
             return d >= other
 
-    cpdef bytes get_value(self):
+    # memoryview(data) exposes the payload without copying it. The value
+    # can't be changed while such a view exists.
+    def __getbuffer__(self, Py_buffer *buffer, int flags):
         cdef:
-            char* val = NULL
+            const char* val = NULL
             uint64_t length = 0
-        plist_get_data_val(self._c_node, &val, &length)
+        val = plist_get_data_ptr(self._c_node, &length)
+        PyBuffer_FillInfo(buffer, self, <void*>val, length, 1, flags)
+        self._exports += 1
 
-        try:
-            return _from_string_and_size(val, length)
-        finally:
-            libc.stdlib.free(val)
+    def __releasebuffer__(self, Py_buffer *buffer):
+        self._exports -= 1
+
+    cpdef bytes get_value(self):
+        cdef:
+            const char* val = NULL
+            uint64_t length = 0
+        val = plist_get_data_ptr(self._c_node, &length)
+        return PyBytes_FromStringAndSize(val, length)
 
     cpdef set_value(self, object value):
         cdef:
             bytes py_val = value
+        if self._exports > 0:
+            raise BufferError("Data value is exported through a buffer")
         plist_set_data_val(self._c_node, py_val, len(value))
 
 cdef Data Data_factory(plist_t c_node, bint managed=True):
@@ -587,13 +648,13 @@ cdef class Dict(Node):
 
     cdef void _init(self):
         cdef plist_dict_iter it = NULL
-        cdef char* key = NULL
+        cdef const char* key = NULL
         cdef plist_t subnode = NULL
 
         self._map = cpython.PyDict_New()
 
         plist_dict_new_iter(self._c_node, &it);
-        plist_dict_next_item(self._c_node, it, &key, &subnode);
+        plist_dict_next_item_ptr(self._c_node, it, &key, &subnode);
 
         while subnode is not NULL:
             py_key = key
@@ -603,10 +664,9 @@ cdef class Dict(Node):
 
             cpython.PyDict_SetItem(self._map, py_key, plist_t_to_node(subnode, False))
             subnode = NULL
-            libc.stdlib.free(key)
             key = NULL
-            plist_dict_next_item(self._c_node, it, &key, &subnode);
-        libc.stdlib.free(it)
+            plist_dict_next_item_ptr(self._c_node, it, &key, &subnode);
+        plist_mem_free(it)
 
     def __dealloc__(self):
         self._map = None
@@ -794,15 +854,120 @@ cdef Array Array_factory(plist_t c_node, bint managed=True):
     instance._init()
     return instance
 
-cpdef object from_xml(xml):
+# parses data, which is bytes or any object supporting the buffer protocol,
+# directly from its memory. With borrow set, data nodes of binary plists
+# reference data, so the tree must be freed before the buffer is released.
+cdef plist_t _parse_buffer(object data, int binary, bint borrow) except? NULL:
+    cdef Py_buffer view
     cdef plist_t c_node = NULL
-    plist_from_xml(xml, len(xml), &c_node)
-    return plist_t_to_node(c_node)
+    if isinstance(data, unicode):
+        data = (<unicode>data).encode('utf-8')
+    PyObject_GetBuffer(data, &view, PyBUF_SIMPLE)
+    try:
+        if view.len > 0xFFFFFFFF:
+            raise ValueError("plist data too large")
+        if binary < 0:
+            binary = plist_is_binary(<char*>view.buf, <uint32_t>view.len)
+        if binary:
+            plist_from_bin_ex(<char*>view.buf, <uint32_t>view.len, PLIST_PARSE_BORROW if borrow else PLIST_PARSE_DEFAULT, &c_node)
+        else:
+            plist_from_xml(<char*>view.buf, <uint32_t>view.len, &c_node)
+    finally:
+        PyBuffer_Release(&view)
+    return c_node
+
+cpdef object from_xml(xml):
+    return plist_t_to_node(_parse_buffer(xml, 0, False))
 
-cpdef object from_bin(bytes bin):
+cpdef object from_bin(bin):
+    return plist_t_to_node(_parse_buffer(bin, 1, False))
+
+cpdef object loads(data):
+    """Parse a binary or XML plist from bytes or any buffer and return it as
+    native Python objects (dict, list, unicode, bytes, int, float, bool and
+    datetime), like get_value() of the parsed node, but without creating a
+    Node wrapper for every item."""
+    cdef Py_buffer view
     cdef plist_t c_node = NULL
-    plist_from_bin(bin, len(bin), &c_node)
-    return plist_t_to_node(c_node)
+    if isinstance(data, unicode):
+        data = (<unicode>data).encode('utf-8')
+    # the tree borrows the data payloads from the buffer
+    PyObject_GetBuffer(data, &view, PyBUF_SIMPLE)
+    try:
+        c_node = _parse_buffer(data, -1, True)
+        if c_node == NULL:
+            raise ValueError("Invalid plist data")
+        try:
+            return plist_t_to_native(c_node)
+        finally:
+            plist_free(c_node)
+    finally:
+        PyBuffer_Release(&view)
+
+cdef object plist_t_to_native(plist_t c_plist):
+    cdef plist_type t = plist_get_node_type(c_plist)
+    cdef plist_dict_iter it = NULL
+    cdef const char* key = NULL
+    cdef const char* val = NULL
+    cdef plist_t subnode = NULL
+    cdef uint64_t length = 0
+    cdef uint64_t u = 0
+    cdef uint8_t b = 0
+    cdef double d = 0
+    cdef int32_t secs = 0
+    cdef int32_t usecs = 0
+    cdef uint32_t i = 0
+    cdef uint32_t size = 0
+    cdef dict result_dict
+    cdef list result_list
+    if t == PLIST_DICT:
+        result_dict = {}
+        plist_dict_new_iter(c_plist, &it)
+        try:
+            plist_dict_next_item_ptr(c_plist, it, &key, &subnode)
+            while subnode is not NULL:
+                if PY_MAJOR_VERSION >= 3:
+                    py_key = cpython.PyUnicode_DecodeUTF8(key, strlen(key), 'strict')
+                else:
+                    py_key = <bytes>key
+                result_dict[py_key] = plist_t_to_native(subnode)
+                subnode = NULL
+                key = NULL
+                plist_dict_next_item_ptr(c_plist, it, &key, &subnode)
+        finally:
+            plist_mem_free(it)
+        return result_dict
+    if t == PLIST_ARRAY:
+        size = plist_array_get_size(c_plist)
+        result_list = []
+        for i in range(size):
+            result_list.append(plist_t_to_native(plist_array_get_item(c_plist, i)))
+        return result_list
+    if t == PLIST_STRING:
+        val = plist_get_string_ptr(c_plist, &length)
+        return cpython.PyUnicode_DecodeUTF8(val, length, 'strict')
+    if t == PLIST_KEY:
+        val = plist_get_key_ptr(c_plist, &length)
+        return cpython.PyUnicode_DecodeUTF8(val, length, 'strict')
+    if t == PLIST_DATA:
+        val = plist_get_data_ptr(c_plist, &length)
+        return PyBytes_FromStringAndSize(val, length)
+    if t == PLIST_BOOLEAN:
+        plist_get_bool_val(c_plist, &b)
+        return bool(b)
+    if t == PLIST_UINT:
+        plist_get_uint_val(c_plist, &u)
+        return u
+    if t == PLIST_REAL:
+        plist_get_real_val(c_plist, &d)
+        return d
+    if t == PLIST_DATE:
+        plist_get_date_val(c_plist, &secs, &usecs)
+        return ints_to_datetime(secs, usecs)
+    if t == PLIST_UID:
+        plist_get_uid_val(c_plist, &u)
+        return u
+    return None
 
 cdef plist_t native_to_plist_t(object native):
     cdef plist_t c_node
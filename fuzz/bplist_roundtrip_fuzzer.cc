@@ -0,0 +1,32 @@
+/*
+ * bplist_roundtrip_fuzzer.cc
+ * binary plist fuzz target for libFuzzer that reports inputs whose parse,
+ * write and access round trip exceeds the time budget for their size
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "roundtrip.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const unsigned char* data, size_t size)
+{
+	/* libFuzzer stores the input as a crash; move it to bplist-slow/ once
+	 * it is fixed so the test suite keeps replaying it */
+	if (roundtrip_check(reinterpret_cast<const char*>(data), size, ROUNDTRIP_BIN, NULL)) {
+		abort();
+	}
+
+	return 0;
+}
@@ -5,7 +5,7 @@ FUZZDIR=`dirname $0`
 
 cd ${FUZZDIR}
 
-if ! test -x xplist_fuzzer || ! test -x bplist_fuzzer; then
+if ! test -x xplist_fuzzer || ! test -x bplist_fuzzer || ! test -x xplist_roundtrip_fuzzer || ! test -x bplist_roundtrip_fuzzer; then
 	echo "ERROR: you need to build the fuzzers first."
 	cd ${CURDIR}
 	exit 1
@@ -14,10 +14,12 @@ fi
 mkdir -p xplist-input
 cp ../test/data/*.plist xplist-input/
 ./xplist_fuzzer -merge=1 xplist-input xplist-crashes xplist-leaks -dict=xplist.dict
+./xplist_roundtrip_fuzzer -merge=1 xplist-input xplist-slow -dict=xplist.dict
 
 mkdir -p bplist-input
 cp ../test/data/*.bplist bplist-input/
 ./bplist_fuzzer -merge=1 bplist-input bplist-crashes bplist-leaks -dict=bplist.dict
+./bplist_roundtrip_fuzzer -merge=1 bplist-input bplist-slow -dict=bplist.dict
 
 cd ${CURDIR}
 exit 0
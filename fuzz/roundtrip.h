@@ -0,0 +1,186 @@
+/*
+ * roundtrip.h
+ * timed parse, write and access round trips with a cost budget per input
+ * byte, shared by the roundtrip fuzz targets and the slow input test
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef ROUNDTRIP_H
+#define ROUNDTRIP_H
+
+#include <plist/plist.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+/*
+ * An input may take ROUNDTRIP_BASE_NS plus ROUNDTRIP_NS_PER_BYTE for each
+ * of its bytes. Both are far above what linear code needs even with
+ * sanitizers, so only superlinear behaviour exceeds them. They can be
+ * changed with the PLIST_ROUNDTRIP_BASE_NS and PLIST_ROUNDTRIP_NS_PER_BYTE
+ * environment variables.
+ */
+#define ROUNDTRIP_BASE_NS 10000000ULL
+#define ROUNDTRIP_NS_PER_BYTE 5000ULL
+
+/* a slow run is repeated this many times before the input counts as slow */
+#define ROUNDTRIP_ATTEMPTS 3
+
+enum roundtrip_format {
+	ROUNDTRIP_BIN,
+	ROUNDTRIP_XML
+};
+
+static uint64_t roundtrip_now_ns(void)
+{
+#ifdef WIN32
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (uint64_t)((double)count.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t roundtrip_env(const char *name, uint64_t def)
+{
+	const char *val = getenv(name);
+	return (val && *val) ? strtoull(val, NULL, 10) : def;
+}
+
+static uint64_t roundtrip_budget_ns(size_t size)
+{
+	return roundtrip_env("PLIST_ROUNDTRIP_BASE_NS", ROUNDTRIP_BASE_NS)
+		+ roundtrip_env("PLIST_ROUNDTRIP_NS_PER_BYTE", ROUNDTRIP_NS_PER_BYTE) * size;
+}
+
+/* reads every node the way a caller would: array items by index, dict
+ * items by key, and the value of everything else */
+static void roundtrip_access(plist_t node)
+{
+	uint32_t i = 0;
+	uint32_t count = 0;
+	uint64_t length = 0;
+
+	switch (plist_get_node_type(node)) {
+	case PLIST_ARRAY:
+		count = plist_array_get_size(node);
+		for (i = 0; i < count; i++) {
+			roundtrip_access(plist_array_get_item(node, i));
+		}
+		break;
+	case PLIST_DICT: {
+		plist_dict_iter it = NULL;
+		plist_t val = NULL;
+		plist_dict_new_iter(node, &it);
+		do {
+			char *key = NULL;
+			val = NULL;
+			plist_dict_next_item(node, it, &key, &val);
+			if (key) {
+				roundtrip_access(plist_dict_get_item(node, key));
+				free(key);
+			}
+		} while (val);
+		plist_mem_free(it);
+		break;
+	}
+	case PLIST_STRING:
+		plist_get_string_ptr(node, &length);
+		break;
+	case PLIST_DATA:
+		plist_get_data_ptr(node, &length);
+		break;
+	default:
+		break;
+	}
+}
+
+/* parses data, writes the result in both formats, parses that again and
+ * accesses every node of it */
+static void roundtrip_run(const char *data, size_t size, enum roundtrip_format format)
+{
+	plist_t root = NULL;
+	plist_t copy = NULL;
+	char *out = NULL;
+	uint32_t length = 0;
+
+	if (format == ROUNDTRIP_BIN) {
+		plist_from_bin(data, (uint32_t)size, &root);
+	} else {
+		plist_from_xml(data, (uint32_t)size, &root);
+	}
+	if (!root) {
+		return;
+	}
+	roundtrip_access(root);
+
+	plist_to_bin(root, &out, &length);
+	if (out) {
+		plist_from_bin(out, length, &copy);
+		free(out);
+		out = NULL;
+		roundtrip_access(copy);
+		plist_free(copy);
+		copy = NULL;
+	}
+
+	plist_to_xml(root, &out, &length);
+	if (out) {
+		plist_from_xml(out, length, &copy);
+		free(out);
+		roundtrip_access(copy);
+		plist_free(copy);
+	}
+
+	plist_free(root);
+}
+
+/*
+ * Runs the round trip for data and returns 0 if it stayed within the
+ * budget. Otherwise the time it took is printed and 1 is returned.
+ */
+static int roundtrip_check(const char *data, size_t size, enum roundtrip_format format, const char *name)
+{
+	uint64_t budget = roundtrip_budget_ns(size);
+	uint64_t best = 0;
+	int i = 0;
+
+	for (i = 0; i < ROUNDTRIP_ATTEMPTS; i++) {
+		uint64_t start = roundtrip_now_ns();
+		uint64_t elapsed = 0;
+		roundtrip_run(data, size, format);
+		elapsed = roundtrip_now_ns() - start;
+		if (i == 0 || elapsed < best) {
+			best = elapsed;
+		}
+		if (best <= budget) {
+			return 0;
+		}
+	}
+	fprintf(stderr, "%s: round trip of %lu bytes took %llu ns, the budget is %llu ns\n",
+		name ? name : "input", (unsigned long)size, (unsigned long long)best, (unsigned long long)budget);
+	return 1;
+}
+
+#endif
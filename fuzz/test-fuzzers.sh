@@ -5,7 +5,7 @@ FUZZDIR=`dirname $0`
 
 cd ${FUZZDIR}
 
-if ! test -x xplist_fuzzer || ! test -x bplist_fuzzer; then
+if ! test -x xplist_fuzzer || ! test -x bplist_fuzzer || ! test -x xplist_roundtrip_fuzzer || ! test -x bplist_roundtrip_fuzzer; then
 	echo "ERROR: you need to build the fuzzers first."
 	cd ${CURDIR}
 	exit 1
@@ -29,5 +29,17 @@ if ! ./bplist_fuzzer bplist-input -dict=bplist.dict -max_len=4096 -runs=10000; t
 	exit 1
 fi
 
+echo "### TESTING xplist_roundtrip_fuzzer ###"
+if ! ./xplist_roundtrip_fuzzer xplist-slow/* || ! ./xplist_roundtrip_fuzzer xplist-input -dict=xplist.dict -max_len=65536 -runs=10000; then
+	cd ${CURDIR}
+	exit 1
+fi
+
+echo "### TESTING bplist_roundtrip_fuzzer ###"
+if ! ./bplist_roundtrip_fuzzer bplist-slow/* || ! ./bplist_roundtrip_fuzzer bplist-input -dict=bplist.dict -max_len=4096 -runs=10000; then
+	cd ${CURDIR}
+	exit 1
+fi
+
 cd ${CURDIR}
 exit 0
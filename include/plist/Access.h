@@ -0,0 +1,413 @@
+/*
+ * Access.h
+ * Typed accessors for plist nodes for C++ binding
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef PLIST_ACCESS_H
+#define PLIST_ACCESS_H
+
+#include <plist/plist.h>
+#include <plist/View.h>
+#include <string>
+#include <ctime>
+#include <sys/time.h>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+/*
+ * The functions in this header read plist_t nodes directly through the C
+ * API. They are inline templates, so there are no virtual calls and no
+ * wrapper objects are allocated:
+ *
+ *   uint64_t n = PList::get<uint64_t>(node);
+ *   if (PList::get(node, name)) ...
+ *   PList::visit(node, PList::overloaded{
+ *       [](uint64_t v) { ... },
+ *       [](PList::StringRef s) { ... },
+ *       [](auto) { ... } });
+ *
+ * The pointer types (const char*, StringRef, DataRef, std::string_view)
+ * point into the node and are only valid as long as it is not changed or
+ * freed.
+ */
+namespace PList
+{
+
+// passed to visit() for NULL and for nodes of type PLIST_NONE
+struct None
+{
+};
+
+// the contents of a string or key node, not 0-terminated copies
+struct StringRef
+{
+    const char* data;
+    uint64_t size;
+
+    std::string str() const
+    {
+        return std::string(data, size);
+    }
+#if __cplusplus >= 201703L
+    operator std::string_view() const
+    {
+        return std::string_view(data, size);
+    }
+#endif
+};
+
+// the name of a key node, passed to visit() for PLIST_KEY
+struct KeyRef : public StringRef
+{
+};
+
+// the contents of a data node
+struct DataRef
+{
+    const char* data;
+    uint64_t size;
+};
+
+// the value of a UID node, separate from uint64_t so both can be visited
+struct UidValue
+{
+    uint64_t value;
+};
+
+namespace detail
+{
+
+inline bool has_type(plist_t node, plist_type type)
+{
+    return node && plist_get_node_type(node) == type;
+}
+
+// one specialization for each type that get() supports
+template<typename T> struct Accessor;
+
+template<> struct Accessor<bool>
+{
+    static const plist_type type = PLIST_BOOLEAN;
+
+    static bool read(plist_t node, bool& out)
+    {
+        uint8_t val = 0;
+        if (!has_type(node, PLIST_BOOLEAN))
+        {
+            return false;
+        }
+        plist_get_bool_val(node, &val);
+        out = (val != 0);
+        return true;
+    }
+};
+
+template<> struct Accessor<uint64_t>
+{
+    static const plist_type type = PLIST_UINT;
+
+    static bool read(plist_t node, uint64_t& out)
+    {
+        if (!has_type(node, PLIST_UINT))
+        {
+            return false;
+        }
+        plist_get_uint_val(node, &out);
+        return true;
+    }
+};
+
+// integer nodes store negative values in two's complement
+template<> struct Accessor<int64_t>
+{
+    static const plist_type type = PLIST_UINT;
+
+    static bool read(plist_t node, int64_t& out)
+    {
+        uint64_t val = 0;
+        if (!Accessor<uint64_t>::read(node, val))
+        {
+            return false;
+        }
+        out = (int64_t)val;
+        return true;
+    }
+};
+
+template<> struct Accessor<double>
+{
+    static const plist_type type = PLIST_REAL;
+
+    static bool read(plist_t node, double& out)
+    {
+        if (!has_type(node, PLIST_REAL))
+        {
+            return false;
+        }
+        plist_get_real_val(node, &out);
+        return true;
+    }
+};
+
+template<> struct Accessor<StringRef>
+{
+    static const plist_type type = PLIST_STRING;
+
+    static bool read(plist_t node, StringRef& out)
+    {
+        uint64_t length = 0;
+        const char* s = has_type(node, PLIST_STRING) ? plist_get_string_ptr(node, &length) : NULL;
+        if (!s)
+        {
+            return false;
+        }
+        out.data = s;
+        out.size = length;
+        return true;
+    }
+};
+
+template<> struct Accessor<KeyRef>
+{
+    static const plist_type type = PLIST_KEY;
+
+    static bool read(plist_t node, KeyRef& out)
+    {
+        uint64_t length = 0;
+        const char* s = has_type(node, PLIST_KEY) ? plist_get_key_ptr(node, &length) : NULL;
+        if (!s)
+        {
+            return false;
+        }
+        out.data = s;
+        out.size = length;
+        return true;
+    }
+};
+
+template<> struct Accessor<const char*>
+{
+    static const plist_type type = PLIST_STRING;
+
+    static bool read(plist_t node, const char*& out)
+    {
+        StringRef s;
+        if (!Accessor<StringRef>::read(node, s))
+        {
+            return false;
+        }
+        out = s.data;
+        return true;
+    }
+};
+
+template<> struct Accessor<std::string>
+{
+    static const plist_type type = PLIST_STRING;
+
+    static bool read(plist_t node, std::string& out)
+    {
+        StringRef s;
+        if (!Accessor<StringRef>::read(node, s))
+        {
+            return false;
+        }
+        out.assign(s.data, s.size);
+        return true;
+    }
+};
+
+#if __cplusplus >= 201703L
+template<> struct Accessor<std::string_view>
+{
+    static const plist_type type = PLIST_STRING;
+
+    static bool read(plist_t node, std::string_view& out)
+    {
+        StringRef s;
+        if (!Accessor<StringRef>::read(node, s))
+        {
+            return false;
+        }
+        out = s;
+        return true;
+    }
+};
+#endif
+
+template<> struct Accessor<DataRef>
+{
+    static const plist_type type = PLIST_DATA;
+
+    static bool read(plist_t node, DataRef& out)
+    {
+        uint64_t length = 0;
+        const char* data = has_type(node, PLIST_DATA) ? plist_get_data_ptr(node, &length) : NULL;
+        if (!data)
+        {
+            return false;
+        }
+        out.data = data;
+        out.size = length;
+        return true;
+    }
+};
+
+template<> struct Accessor<timeval>
+{
+    static const plist_type type = PLIST_DATE;
+
+    static bool read(plist_t node, timeval& out)
+    {
+        int32_t tv_sec = 0;
+        int32_t tv_usec = 0;
+        if (!has_type(node, PLIST_DATE))
+        {
+            return false;
+        }
+        plist_get_date_val(node, &tv_sec, &tv_usec);
+        out.tv_sec = tv_sec;
+        out.tv_usec = tv_usec;
+        return true;
+    }
+};
+
+template<> struct Accessor<UidValue>
+{
+    static const plist_type type = PLIST_UID;
+
+    static bool read(plist_t node, UidValue& out)
+    {
+        if (!has_type(node, PLIST_UID))
+        {
+            return false;
+        }
+        plist_get_uid_val(node, &out.value);
+        return true;
+    }
+};
+
+template<> struct Accessor<ArrayView>
+{
+    static const plist_type type = PLIST_ARRAY;
+
+    static bool read(plist_t node, ArrayView& out)
+    {
+        if (!has_type(node, PLIST_ARRAY))
+        {
+            return false;
+        }
+        out = ArrayView(node);
+        return true;
+    }
+};
+
+template<> struct Accessor<DictView>
+{
+    static const plist_type type = PLIST_DICT;
+
+    static bool read(plist_t node, DictView& out)
+    {
+        if (!has_type(node, PLIST_DICT))
+        {
+            return false;
+        }
+        out = DictView(node);
+        return true;
+    }
+};
+
+};
+
+/*
+ * Stores the value of node in out if node has the matching type and
+ * returns true, otherwise out is left unchanged and false is returned.
+ */
+template<typename T> inline bool get(plist_t node, T& out)
+{
+    return detail::Accessor<T>::read(node, out);
+}
+
+/*
+ * Returns the value of node, or a value initialized T if node is NULL or
+ * has another type.
+ */
+template<typename T> inline T get(plist_t node)
+{
+    T out = T();
+    detail::Accessor<T>::read(node, out);
+    return out;
+}
+
+// returns true if get<T>() would succeed for node
+template<typename T> inline bool is(plist_t node)
+{
+    return detail::has_type(node, detail::Accessor<T>::type);
+}
+
+/*
+ * Calls f with the value of node depending on its type: bool, uint64_t,
+ * double, StringRef, KeyRef, DataRef, timeval, UidValue, ArrayView or
+ * DictView, and None for NULL. f has to accept all of them and the result
+ * of f is returned; an overload set built with overloaded, or a generic
+ * lambda, is the simplest way to write it. Strings are passed as
+ * StringRef in every language version, so an overload for them has to
+ * take StringRef: next to a generic lambda one for std::string_view would
+ * not be chosen.
+ */
+template<typename F> inline auto visit(plist_t node, F&& f) -> decltype(f(None()))
+{
+    switch (node ? plist_get_node_type(node) : PLIST_NONE)
+    {
+    case PLIST_BOOLEAN:
+        return f(get<bool>(node));
+    case PLIST_UINT:
+        return f(get<uint64_t>(node));
+    case PLIST_REAL:
+        return f(get<double>(node));
+    case PLIST_STRING:
+        return f(get<StringRef>(node));
+    case PLIST_KEY:
+        return f(get<KeyRef>(node));
+    case PLIST_DATA:
+        return f(get<DataRef>(node));
+    case PLIST_DATE:
+        return f(get<timeval>(node));
+    case PLIST_UID:
+        return f(get<UidValue>(node));
+    case PLIST_ARRAY:
+        return f(ArrayView(node));
+    case PLIST_DICT:
+        return f(DictView(node));
+    default:
+        return f(None());
+    }
+}
+
+#if __cplusplus >= 201703L
+// combines several lambdas into one overload set for visit()
+template<typename... Ts> struct overloaded : Ts...
+{
+    using Ts::operator()...;
+};
+template<typename... Ts> overloaded(Ts...) -> overloaded<Ts...>;
+#endif
+
+};
+
+#endif // PLIST_ACCESS_H
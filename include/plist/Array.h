@@ -35,6 +35,10 @@ public :
     Array(plist_t node, Node* parent = NULL);
     Array(const Array& a);
     Array& operator=(Array& a);
+#if __cplusplus >= 201103L
+    Array(Array&& a);
+    Array& operator=(Array&& a);
+#endif
     virtual ~Array();
 
     Node* Clone() const;
@@ -42,11 +46,19 @@ public :
     Node* operator[](unsigned int index);
     void Append(Node* node);
     void Insert(Node* node, unsigned int pos);
+#if __cplusplus >= 201103L
+    void Append(std::unique_ptr<Node> node);
+    void Insert(std::unique_ptr<Node> node, unsigned int pos);
+#endif
     void Remove(Node* node);
     void Remove(unsigned int pos);
     unsigned int GetNodeIndex(Node* node) const;
 
 private :
+    void BuildArray();
+#if __cplusplus >= 201103L
+    void MoveArray(Array& a);
+#endif
     std::vector<Node*> _array;
 };
 
@@ -34,6 +34,10 @@ public :
     Boolean(plist_t node, Node* parent = NULL);
     Boolean(const Boolean& b);
     Boolean& operator=(Boolean& b);
+#if __cplusplus >= 201103L
+    Boolean(Boolean&& b);
+    Boolean& operator=(Boolean&& b);
+#endif
     Boolean(bool b);
     virtual ~Boolean();
 
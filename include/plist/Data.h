@@ -35,6 +35,10 @@ public :
     Data(plist_t node, Node* parent = NULL);
     Data(const Data& d);
     Data& operator=(Data& d);
+#if __cplusplus >= 201103L
+    Data(Data&& d);
+    Data& operator=(Data&& d);
+#endif
     Data(const std::vector<char>& buff);
     virtual ~Data();
 
@@ -42,6 +46,7 @@ public :
 
     void SetValue(const std::vector<char>& buff);
     std::vector<char> GetValue() const;
+    const char* GetValuePtr(uint64_t* length = NULL) const;
 };
 
 };
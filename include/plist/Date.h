@@ -36,6 +36,10 @@ public :
     Date(plist_t node, Node* parent = NULL);
     Date(const Date& d);
     Date& operator=(Date& d);
+#if __cplusplus >= 201103L
+    Date(Date&& d);
+    Date& operator=(Date&& d);
+#endif
     Date(timeval t);
     virtual ~Date();
 
@@ -36,6 +36,10 @@ public :
     Dictionary(plist_t node, Node* parent = NULL);
     Dictionary(const Dictionary& d);
     Dictionary& operator=(Dictionary& d);
+#if __cplusplus >= 201103L
+    Dictionary(Dictionary&& d);
+    Dictionary& operator=(Dictionary&& d);
+#endif
     virtual ~Dictionary();
 
     Node* Clone() const;
@@ -48,12 +52,20 @@ public :
     iterator Find(const std::string& key);
     iterator Set(const std::string& key, const Node* node);
     iterator Set(const std::string& key, const Node& node);
+#if __cplusplus >= 201103L
+    iterator Set(const std::string& key, std::unique_ptr<Node> node);
+#endif
     iterator Insert(const std::string& key, Node* node) PLIST_WARN_DEPRECATED("use Set() instead");
     void Remove(Node* node);
     void Remove(const std::string& key);
     std::string GetNodeKey(Node* key);
 
 private :
+    void BuildMap();
+    iterator StoreNode(const std::string& key, Node* node);
+#if __cplusplus >= 201103L
+    void MoveMap(Dictionary& d);
+#endif
     std::map<std::string,Node*> _map;
 
 
@@ -34,6 +34,10 @@ public :
     Integer(plist_t node, Node* parent = NULL);
     Integer(const Integer& i);
     Integer& operator=(Integer& i);
+#if __cplusplus >= 201103L
+    Integer(Integer&& i);
+    Integer& operator=(Integer&& i);
+#endif
     Integer(uint64_t i);
     virtual ~Integer();
 
@@ -35,6 +35,10 @@ public :
     Key(plist_t node, Node* parent = NULL);
     Key(const Key& s);
     Key& operator=(Key& s);
+#if __cplusplus >= 201103L
+    Key(Key&& k);
+    Key& operator=(Key&& k);
+#endif
     Key(const std::string& s);
     virtual ~Key();
 
@@ -42,6 +46,7 @@ public :
 
     void SetValue(const std::string& s);
     std::string GetValue() const;
+    const char* GetValuePtr(uint64_t* length = NULL) const;
 };
 
 };
@@ -24,6 +24,10 @@
 
 #include <plist/plist.h>
 #include <cstddef>
+#if __cplusplus >= 201103L
+#include <memory>
+#include <utility>
+#endif
 
 namespace PList
 {
@@ -45,6 +49,10 @@ protected:
     Node(Node* parent = NULL);
     Node(plist_t node, Node* parent = NULL);
     Node(plist_type type, Node* parent = NULL);
+#if __cplusplus >= 201103L
+    Node(Node&& node);
+    plist_t TakePlist();
+#endif
     plist_t _node;
 
 private:
@@ -34,6 +34,10 @@ public :
     Real(plist_t node, Node* parent = NULL);
     Real(const Real& d);
     Real& operator=(Real& d);
+#if __cplusplus >= 201103L
+    Real(Real&& d);
+    Real& operator=(Real&& d);
+#endif
     Real(double d);
     virtual ~Real();
 
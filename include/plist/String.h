@@ -35,6 +35,10 @@ public :
     String(plist_t node, Node* parent = NULL);
     String(const String& s);
     String& operator=(String& s);
+#if __cplusplus >= 201103L
+    String(String&& s);
+    String& operator=(String&& s);
+#endif
     String(const std::string& s);
     virtual ~String();
 
@@ -42,6 +46,7 @@ public :
 
     void SetValue(const std::string& s);
     std::string GetValue() const;
+    const char* GetValuePtr(uint64_t* length = NULL) const;
 };
 
 };
@@ -47,7 +47,11 @@ public :
 protected:
     Structure(Node* parent = NULL);
     Structure(plist_type type, Node* parent = NULL);
+#if __cplusplus >= 201103L
+    Structure(Structure&& s);
+#endif
     void UpdateNodeParent(Node* node);
+    void AdoptNode(Node* node);
 
 private:
     Structure(Structure& s);
@@ -34,6 +34,10 @@ public :
     Uid(plist_t node, Node* parent = NULL);
     Uid(const Uid& i);
     Uid& operator=(Uid& i);
+#if __cplusplus >= 201103L
+    Uid(Uid&& i);
+    Uid& operator=(Uid&& i);
+#endif
     Uid(uint64_t i);
     virtual ~Uid();
 
@@ -0,0 +1,129 @@
+/*
+ * View.h
+ * Non-owning views of plist nodes for C++ binding
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef PLIST_VIEW_H
+#define PLIST_VIEW_H
+
+#include <plist/Node.h>
+#include <string>
+#include <vector>
+#include <ctime>
+#include <sys/time.h>
+
+namespace PList
+{
+
+class DictView;
+class ArrayView;
+
+/*
+ * A View refers to a plist_t without owning it and without creating
+ * wrapper objects for the children, so it is cheap to create and copy.
+ * It is only valid as long as the node it refers to exists. A View of
+ * NULL or of a missing item is invalid and returns default values.
+ */
+class View
+{
+public :
+    View(plist_t node = NULL);
+    View(const Node& node);
+
+    bool IsValid() const;
+    plist_t GetPlist() const;
+    plist_type GetType() const;
+    View GetParent() const;
+
+    bool GetBool() const;
+    uint64_t GetUInt() const;
+    double GetReal() const;
+    timeval GetDate() const;
+    uint64_t GetUid() const;
+    std::string GetString() const;
+    const char* GetStringPtr(uint64_t* length = NULL) const;
+    std::string GetKey() const;
+    const char* GetKeyPtr(uint64_t* length = NULL) const;
+    std::vector<char> GetData() const;
+    const char* GetDataPtr(uint64_t* length = NULL) const;
+
+    DictView AsDict() const;
+    ArrayView AsArray() const;
+
+    // creates an owning wrapper for a copy of the node
+    Node* Clone() const;
+
+protected:
+    plist_t _node;
+};
+
+class ArrayView : public View
+{
+public :
+    class iterator
+    {
+    public :
+        iterator(plist_t item = NULL);
+        View operator*() const;
+        iterator& operator++();
+        bool operator==(const iterator& it) const;
+        bool operator!=(const iterator& it) const;
+    private:
+        plist_t _item;
+    };
+
+    ArrayView(plist_t node = NULL);
+
+    uint32_t GetSize() const;
+    View operator[](unsigned int index) const;
+    iterator Begin() const;
+    iterator End() const;
+    iterator begin() const;
+    iterator end() const;
+};
+
+class DictView : public View
+{
+public :
+    class iterator
+    {
+    public :
+        iterator(plist_t key = NULL);
+        const char* GetKey(uint64_t* length = NULL) const;
+        View GetValue() const;
+        const iterator& operator*() const;
+        iterator& operator++();
+        bool operator==(const iterator& it) const;
+        bool operator!=(const iterator& it) const;
+    private:
+        plist_t _key;
+    };
+
+    DictView(plist_t node = NULL);
+
+    uint32_t GetSize() const;
+    View operator[](const std::string& key) const;
+    View operator[](const char* key) const;
+    iterator Begin() const;
+    iterator End() const;
+    iterator begin() const;
+    iterator end() const;
+};
+
+};
+
+#endif // PLIST_VIEW_H
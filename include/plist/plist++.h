@@ -35,5 +35,7 @@
 #include "Uid.h"
 #include "String.h"
 #include "Structure.h"
+#include "View.h"
+#include "Access.h"
 
 #endif
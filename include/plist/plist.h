@@ -73,10 +73,37 @@ extern "C"
 #endif
 
 #include <sys/types.h>
+#include <stddef.h>
 #include <stdarg.h>
+#include <stdio.h>
 
     /**
      * \mainpage libplist : A library to handle Apple Property Lists
+     *
+     * \section threads Thread safety
+     * The parsers and writers keep all their state per call, so different
+     * trees can be created, parsed, modified, written and freed on
+     * different threads at the same time without locking.
+     *
+     * A tree that no thread modifies can be read by any number of threads
+     * at once. This includes all getters, #plist_dict_get_item and the
+     * other lookups (also on dictionaries with a key index), iterating
+     * with an iterator per thread, #plist_copy, #plist_compare_node_value,
+     * #plist_equal_deep and writing the tree with any of the plist_to_*
+     * functions. Everything that changes a tree, including #plist_free and
+     * #plist_hash, which caches the hashes in the tree, needs exclusive
+     * access to it. Trees parsed with #PLIST_PARSE_LAZY are the exception: reading
+     * them parses the children on demand, so they must not be accessed by
+     * more than one thread at a time.
+     *
+     * An arena must only be used by one thread at a time while trees are
+     * parsed into or created in it. The finished trees can be read
+     * concurrently like any other tree.
+     *
+     * Settings that apply to the whole process, like #plist_set_max_depth
+     * and #plist_set_dict_index_threshold, should be changed before other
+     * threads start using the library.
+     *
      * \defgroup PublicAPI Public libplist API
      */
     /*@{*/
@@ -92,6 +119,48 @@ extern "C"
      */
     typedef void *plist_dict_iter;
 
+    /**
+     * The plist arena, owning the memory of trees parsed into it.
+     */
+    typedef void *plist_arena_t;
+
+    /**
+     * An input file mapped into memory, see #plist_read_from_file_ex.
+     */
+    typedef void *plist_mapping_t;
+
+    /**
+     * A cursor over a binary plist, see #plist_bin_reader_open.
+     */
+    typedef void *plist_bin_reader_t;
+
+    /**
+     * A read-only copy of a tree in a single block, see #plist_freeze.
+     */
+    typedef void *plist_frozen_t;
+
+    /**
+     * A compiled path query, see #plist_path_compile.
+     */
+    typedef void *plist_path_t;
+
+    /**
+     * An incremental binary plist writer, see #plist_bin_writer_new.
+     */
+    typedef void *plist_bin_writer_t;
+
+    /**
+     * Reusable scratch state of the binary parser and writer, see
+     * #plist_context_new.
+     */
+    typedef void *plist_context_t;
+
+    /**
+     * A shared dictionary for compressed binary plists, see
+     * #plist_compress_dict_new.
+     */
+    typedef void *plist_compress_dict_t;
+
     /**
      * The enumeration of plist node types.
      */
@@ -110,6 +179,246 @@ extern "C"
         PLIST_NONE	/**< No type */
     } plist_type;
 
+    /**
+     * Options for the binary plist parser, see #plist_from_bin_ex.
+     */
+    typedef enum
+    {
+        PLIST_PARSE_DEFAULT = 0,	/**< Copy all payloads out of the input */
+        PLIST_PARSE_BORROW = 1 << 0,	/**< Data nodes reference the input buffer */
+        PLIST_PARSE_LAZY = 1 << 1	/**< Parse array and dict children on first access */
+    } plist_parse_options_t;
+
+    /**
+     * Limits for #plist_from_bin_limited and #plist_from_xml_limited. A
+     * member that is 0 imposes no limit. The byte counts are the ones
+     * #plist_mem_usage reports and are checked before strings and data
+     * are allocated, so a parse that would exceed them fails early.
+     */
+    typedef struct
+    {
+        uint64_t max_nodes;	/**< Nodes in the tree, dictionary keys included */
+        uint64_t max_bytes;	/**< Bytes taken by the tree */
+        uint32_t max_depth;	/**< Nesting depth like #plist_set_max_depth, 0 for #plist_get_max_depth */
+        uint32_t max_expansion;	/**< Bytes taken by the tree per byte of input */
+    } plist_parse_limits_t;
+
+    /**
+     * Options for the binary plist writer, see #plist_to_bin_ex.
+     */
+    typedef enum
+    {
+        PLIST_WRITE_DEFAULT = 0,	/**< Write every array and dictionary node */
+        PLIST_WRITE_COMPACT = 1 << 0	/**< Write arrays and dictionaries with identical contents only once */
+    } plist_write_options_t;
+
+    /**
+     * Compression methods for #plist_to_bin_compressed.
+     */
+    typedef enum
+    {
+        PLIST_COMPRESS_LZ4 = 1	/**< LZ4 blocks, fast to compress and very fast to decompress */
+    } plist_compression_t;
+
+    /**
+     * Options for the XML writer, see #plist_to_xml_ex.
+     */
+    typedef enum
+    {
+        PLIST_XML_DEFAULT = 0,	/**< Indent with tabs, one element per line, base64 data wrapped into lines */
+        PLIST_XML_COMPACT = 1 << 0,	/**< No indentation or line breaks, base64 data on a single line */
+        PLIST_XML_NO_HEADER = 1 << 1	/**< Omit the XML declaration and DOCTYPE, the output starts with the plist element */
+    } plist_xml_write_options_t;
+
+    /**
+     * Writer option for #plist_to_xml_ex to indent by n (1 to 15) spaces
+     * per level instead of a tab. Ignored with #PLIST_XML_COMPACT.
+     */
+    #define PLIST_XML_INDENT_SPACES(n) (((uint32_t)(n) & 0xF) << 8)
+
+    /**
+     * Why a binary plist is malformed, see #plist_bin_validate.
+     */
+    typedef enum
+    {
+        PLIST_BIN_VALID = 0,	/**< The binary plist is well formed */
+        PLIST_BIN_INVALID_HEADER,	/**< Too small, or the magic or version is wrong */
+        PLIST_BIN_INVALID_TRAILER,	/**< The trailer has invalid sizes, object count or root object */
+        PLIST_BIN_INVALID_OFFSET,	/**< The offset table or an object offset points outside of the data */
+        PLIST_BIN_INVALID_OBJECT,	/**< An object has an unknown type or an invalid size */
+        PLIST_BIN_INVALID_LENGTH,	/**< The data of an object extends beyond the object table */
+        PLIST_BIN_INVALID_REFERENCE,	/**< A container references an object that does not exist */
+        PLIST_BIN_INVALID_KEY,	/**< A dictionary key is not a string */
+        PLIST_BIN_INVALID_RECURSION,	/**< A container contains itself */
+        PLIST_BIN_INVALID_DEPTH,	/**< Containers are nested deeper than #plist_get_max_depth allows */
+        PLIST_BIN_NO_MEMORY	/**< The check ran out of memory */
+    } plist_bin_error_t;
+
+    /**
+     * Options for arenas, see #plist_arena_new_ex.
+     */
+    typedef enum
+    {
+        PLIST_ARENA_DEFAULT = 0,	/**< Every key gets its own copy of the string */
+        PLIST_ARENA_INTERN_KEYS = 1 << 0	/**< Equal dictionary keys share a single string */
+    } plist_arena_options_t;
+
+    /**
+     * Options for #plist_dict_set_items.
+     */
+    typedef enum
+    {
+        PLIST_DICT_SET_DEFAULT = 0,	/**< Replace the items of keys that exist already */
+        PLIST_DICT_SET_UNIQUE = 1 << 0	/**< The keys are known to be distinct and not in the dictionary yet, they are added without looking them up */
+    } plist_dict_set_options_t;
+
+    /**
+     * Allocation function for #plist_set_allocator, gets the ctx passed there.
+     */
+    typedef void *(*plist_malloc_func_t)(size_t size, void *ctx);
+
+    /**
+     * Reallocation function for #plist_set_allocator.
+     */
+    typedef void *(*plist_realloc_func_t)(void *ptr, size_t size, void *ctx);
+
+    /**
+     * Release function for #plist_set_allocator, never called with NULL.
+     */
+    typedef void (*plist_free_func_t)(void *ptr, void *ctx);
+
+    /**
+     * Counters collected by the library, see #plist_stats_get. Times are
+     * in nanoseconds.
+     */
+    typedef struct
+    {
+        uint64_t nodes_created;	/**< nodes allocated by parsers, constructors and #plist_copy */
+        uint64_t bytes_allocated;	/**< bytes allocated for nodes and their strings and data */
+        uint64_t hash_lookups;	/**< lookups in the internal hash tables */
+        uint64_t hash_probes;	/**< slots visited by these lookups */
+        uint64_t hash_max_probes;	/**< the most slots visited by one lookup */
+        uint64_t dedup_hits;	/**< objects the binary writer found to be written already */
+        uint64_t utf16_conversions;	/**< strings converted from or to UTF-16 */
+        uint64_t base64_encoded_bytes;	/**< data bytes encoded to base64 */
+        uint64_t base64_decoded_bytes;	/**< data bytes decoded from base64 */
+        uint64_t bin_parse_time;	/**< time spent parsing binary plists */
+        uint64_t xml_parse_time;	/**< time spent parsing XML plists */
+        uint64_t bin_serialize_time;	/**< time the binary writer spent collecting objects */
+        uint64_t bin_write_time;	/**< time the binary writer spent encoding objects */
+        uint64_t xml_write_time;	/**< time spent writing XML plists */
+    } plist_stats_t;
+
+    /**
+     * The on-disk format of a plist.
+     */
+    typedef enum
+    {
+        PLIST_FORMAT_XML = 1,	/**< XML plist */
+        PLIST_FORMAT_BINARY = 2,	/**< Binary plist (bplist00) */
+        PLIST_FORMAT_JSON = 3	/**< JSON */
+    } plist_format_t;
+
+    /**
+     * Callbacks for #plist_xml_parse_stream. Every callback is optional and
+     * returns 0 to continue parsing or any other value to stop.
+     */
+    typedef struct
+    {
+        int (*begin_dict)(void *user_data);	/**< A dictionary starts */
+        int (*end_dict)(void *user_data);	/**< The current dictionary ends */
+        int (*begin_array)(void *user_data);	/**< An array starts */
+        int (*end_array)(void *user_data);	/**< The current array ends */
+        int (*key)(void *user_data, const char *key, size_t length);	/**< Key of the next dictionary item, only valid during the call */
+        int (*value)(void *user_data, plist_t node);	/**< A scalar value, node is freed after the call (use #plist_copy to keep it) */
+    } plist_xml_handler_t;
+
+    /**
+     * Input callback for #plist_xml_parse_stream. Copies up to size bytes
+     * into buf and returns the number of bytes copied, or 0 at end of input.
+     */
+    typedef size_t (*plist_read_func_t)(void *user_data, char *buf, size_t size);
+
+    /**
+     * Match callback for #plist_path_foreach. Return non-zero to stop.
+     */
+    typedef int (*plist_path_func_t)(void *user_data, plist_t node);
+
+    /**
+     * Match callback for #plist_path_foreach_bin, obj is the index of the
+     * matching object. Return non-zero to stop.
+     */
+    typedef int (*plist_path_bin_func_t)(void *user_data, plist_bin_reader_t reader, uint64_t obj);
+
+    /**
+     * Output callback for #plist_to_xml_stream. Writes size bytes from buf
+     * and returns 0 on success, or any other value to report an error.
+     */
+    typedef int (*plist_write_func_t)(void *user_data, const char *buf, size_t size);
+
+    /**
+     * Field types for #plist_field_t, with the C type each one is stored as.
+     */
+    typedef enum
+    {
+        PLIST_FIELD_BOOL = 1,	/**< #PLIST_BOOLEAN as uint8_t, 0 or 1 */
+        PLIST_FIELD_INT32,	/**< #PLIST_UINT as int32_t, values out of range are an error */
+        PLIST_FIELD_UINT32,	/**< #PLIST_UINT as uint32_t, values out of range are an error */
+        PLIST_FIELD_INT64,	/**< #PLIST_UINT as int64_t */
+        PLIST_FIELD_UINT64,	/**< #PLIST_UINT as uint64_t */
+        PLIST_FIELD_REAL,	/**< #PLIST_REAL as double */
+        PLIST_FIELD_DATE,	/**< #PLIST_DATE as double, seconds since 01/01/2001 */
+        PLIST_FIELD_STRING,	/**< #PLIST_STRING as an allocated char*, NULL fields are not written */
+        PLIST_FIELD_DATA,	/**< #PLIST_DATA as #plist_field_data_t pointing into the input */
+        PLIST_FIELD_UID,	/**< #PLIST_UID as uint64_t */
+        PLIST_FIELD_STRUCT,	/**< #PLIST_DICT as a nested struct described by #plist_field_t.fields */
+        PLIST_FIELD_NODE	/**< any value as a #plist_t tree, NULL fields are not written */
+    } plist_field_type_t;
+
+    /**
+     * Flags for #plist_field_t.
+     */
+    typedef enum
+    {
+        PLIST_FIELD_OPTIONAL = 0,	/**< A missing key leaves the field unchanged */
+        PLIST_FIELD_REQUIRED = 1 << 0	/**< Decoding fails if the key is missing */
+    } plist_field_flags_t;
+
+    /**
+     * A #PLIST_FIELD_DATA field. The data is not copied when decoding, it
+     * points into the binary plist.
+     */
+    typedef struct
+    {
+        const char *data;
+        uint64_t length;
+    } plist_field_data_t;
+
+    /**
+     * Describes how a dictionary entry maps to a member of a C struct, see
+     * #plist_from_bin_struct. A schema is an array of fields ending with
+     * an entry whose key is NULL.
+     */
+    typedef struct plist_field_s
+    {
+        const char *key;	/**< the dictionary key */
+        plist_field_type_t type;	/**< the type of the member */
+        size_t offset;	/**< offsetof() the member in the struct */
+        uint32_t flags;	/**< a bitwise combination of #plist_field_flags_t values */
+        const struct plist_field_s *fields;	/**< the schema of a #PLIST_FIELD_STRUCT member */
+    } plist_field_t;
+
+    /**
+     * Initializer for an optional #plist_field_t of member in struct type
+     * stype, e.g. PLIST_FIELD("Name", PLIST_FIELD_STRING, struct app, name).
+     */
+    #define PLIST_FIELD(key, type, stype, member) { key, type, offsetof(stype, member), PLIST_FIELD_OPTIONAL, NULL }
+
+    /**
+     * The entry that ends a schema.
+     */
+    #define PLIST_FIELD_END { NULL, (plist_field_type_t)0, 0, 0, NULL }
+
 
     /********************************************
      *                                          *
@@ -198,6 +507,33 @@ extern "C"
      */
     plist_t plist_new_uid(uint64_t val);
 
+    /**
+     * Create a new #PLIST_ARRAY of #PLIST_UINT items.
+     *
+     * @param vals the values of the items
+     * @param count the number of values
+     * @return the created array
+     */
+    plist_t plist_new_uint_array(const uint64_t *vals, uint32_t count);
+
+    /**
+     * Create a new #PLIST_ARRAY of #PLIST_REAL items.
+     *
+     * @param vals the values of the items
+     * @param count the number of values
+     * @return the created array
+     */
+    plist_t plist_new_real_array(const double *vals, uint32_t count);
+
+    /**
+     * Create a new #PLIST_ARRAY of #PLIST_STRING items.
+     *
+     * @param vals the UTF-8 values of the items
+     * @param count the number of values
+     * @return the created array
+     */
+    plist_t plist_new_string_array(const char **vals, uint32_t count);
+
     /**
      * Destruct a plist_t node and all its children recursively
      *
@@ -208,11 +544,62 @@ extern "C"
     /**
      * Return a copy of passed node and it's children
      *
+     * Strings and data that are not owned by an arena or borrowed from an
+     * input buffer are shared between the node and the copy instead of
+     * being duplicated, they are released with the last node using them.
+     *
      * @param node the plist to copy
      * @return copied plist
      */
     plist_t plist_copy(plist_t node);
 
+    /**
+     * Create a new arena. Trees imported with #plist_from_bin_arena or
+     * #plist_from_xml_arena allocate their nodes, data and strings from the
+     * arena so that they can be released all at once with #plist_arena_free.
+     *
+     * @return the created arena or NULL on error
+     */
+    plist_arena_t plist_arena_new(void);
+
+    /**
+     * Create a new arena with options. With #PLIST_ARENA_INTERN_KEYS every
+     * distinct dictionary key in the trees of the arena is stored once,
+     * together with its hash, so repeated keys like in arrays of similar
+     * dictionaries take no additional memory and compare by pointer.
+     *
+     * @param options bitwise OR of #plist_arena_options_t values
+     * @return the created arena or NULL on error
+     */
+    plist_arena_t plist_arena_new_ex(uint32_t options);
+
+    /**
+     * Destruct an arena, releasing all trees that were allocated from it.
+     * Calling #plist_free on a node owned by an arena only detaches it from
+     * its parent. Nodes that were created with the plist_new_* functions and
+     * inserted into an arena-owned tree are not released by the arena.
+     * The item vectors of large arrays are released with the arena.
+     *
+     * @param arena the arena to free
+     */
+    void plist_arena_free(plist_arena_t arena);
+
+    /**
+     * Create a new arena whose memory comes from malloc_fn instead of the
+     * allocator of the library, for instance a pool that belongs to a
+     * request. All nodes, strings and data of the trees in the arena are
+     * allocated from it, only the dictionary indexes, the item vectors of
+     * arrays and the bookkeeping of the arena itself use the library
+     * allocator.
+     *
+     * @param options bitwise OR of #plist_arena_options_t values
+     * @param malloc_fn the function allocating the blocks of the arena
+     * @param free_fn the function releasing them in #plist_arena_free
+     * @param ctx passed to malloc_fn and free_fn
+     * @return the created arena or NULL on error
+     */
+    plist_arena_t plist_arena_new_with_allocator(uint32_t options, plist_malloc_func_t malloc_fn, plist_free_func_t free_fn, void *ctx);
+
 
     /********************************************
      *                                          *
@@ -228,8 +615,18 @@ extern "C"
      */
     uint32_t plist_array_get_size(plist_t node);
 
+    /**
+     * Get size of a #PLIST_ARRAY node with more than 2^32 - 1 items.
+     *
+     * @param node the node of type #PLIST_ARRAY
+     * @return size of the #PLIST_ARRAY node
+     */
+    uint64_t plist_array_get_size64(plist_t node);
+
     /**
      * Get the nth item in a #PLIST_ARRAY node.
+     * Arrays with more than a few dozen items keep a vector of their
+     * items, so the lookup takes constant time.
      *
      * @param node the node of type #PLIST_ARRAY
      * @param n the index of the item to get. Range is [0, array_size[
@@ -237,8 +634,20 @@ extern "C"
      */
     plist_t plist_array_get_item(plist_t node, uint32_t n);
 
+    /**
+     * Get the nth item in a #PLIST_ARRAY node with a 64 bit index.
+     *
+     * @param node the node of type #PLIST_ARRAY
+     * @param n the index of the item to get. Range is [0, array_size[
+     * @return the nth item or NULL if node is not of type #PLIST_ARRAY
+     */
+    plist_t plist_array_get_item64(plist_t node, uint64_t n);
+
     /**
      * Get the index of an item. item must be a member of a #PLIST_ARRAY node.
+     * Items don't store their index, so this searches the array and takes
+     * time linear in its size; keep track of the index while iterating
+     * instead of looking it up for each item.
      *
      * @param node the node
      * @return the node index
@@ -263,6 +672,24 @@ extern "C"
      */
     void plist_array_append_item(plist_t node, plist_t item);
 
+    /**
+     * Append several items at the end of a #PLIST_ARRAY node at once.
+     *
+     * @param node the node of type #PLIST_ARRAY
+     * @param items the new items. The array is responsible for freeing them when they are no longer needed.
+     * @param count the number of items
+     */
+    void plist_array_append_items(plist_t node, plist_t *items, uint32_t count);
+
+    /**
+     * Make room for capacity items in a #PLIST_ARRAY node, so that growing
+     * it up to that size does not reallocate its item vector.
+     *
+     * @param node the node of type #PLIST_ARRAY
+     * @param capacity the expected number of items
+     */
+    void plist_array_reserve(plist_t node, uint32_t capacity);
+
     /**
      * Insert a new item at position n in a #PLIST_ARRAY node.
      *
@@ -295,6 +722,14 @@ extern "C"
      */
     uint32_t plist_dict_get_size(plist_t node);
 
+    /**
+     * Get size of a #PLIST_DICT node with more than 2^32 - 1 entries.
+     *
+     * @param node the node of type #PLIST_DICT
+     * @return size of the #PLIST_DICT node
+     */
+    uint64_t plist_dict_get_size64(plist_t node);
+
     /**
      * Create an iterator of a #PLIST_DICT node.
      * The allocated iterator should be freed with the standard free function.
@@ -313,9 +748,25 @@ extern "C"
      *		for freeing the the returned string.
      * @param val a location to store the value, or NULL. The caller should *not*
      *		free the returned value.
+     * @note The iterator keeps a reference to the next item. Removing the item
+     *		just returned is fine, removing any other item while iterating is not.
      */
     void plist_dict_next_item(plist_t node, plist_dict_iter iter, char **key, plist_t *val);
 
+    /**
+     * Increment iterator of a #PLIST_DICT node, without copying the key.
+     *
+     * @param node the node of type #PLIST_DICT
+     * @param iter iterator of the dictionary
+     * @param key a location to store the key, or NULL. The returned string
+     *		belongs to the dictionary and is only valid while the item is
+     *		part of it; it must not be freed.
+     * @param val a location to store the value, or NULL. The caller should *not*
+     *		free the returned value.
+     * @sa plist_dict_next_item
+     */
+    void plist_dict_next_item_ptr(plist_t node, plist_dict_iter iter, const char **key, plist_t *val);
+
     /**
      * Get key associated to an item. Item must be member of a dictionary
      *
@@ -345,6 +796,21 @@ extern "C"
      */
     void plist_dict_set_item(plist_t node, const char* key, plist_t item);
 
+    /**
+     * Set several items of a #PLIST_DICT node at once, like calling
+     * #plist_dict_set_item for each of them.
+     * With #PLIST_DICT_SET_UNIQUE the keys are not looked up, which is
+     * faster for building dictionaries but leaves duplicate keys in the
+     * dictionary if they were not unique.
+     *
+     * @param node the node of type #PLIST_DICT
+     * @param keys the keys of the items
+     * @param items the new items, the dictionary is responsible for freeing them
+     * @param count the number of keys and items
+     * @param options a combination of #plist_dict_set_options_t values
+     */
+    void plist_dict_set_items(plist_t node, const char **keys, plist_t *items, uint32_t count, uint32_t options);
+
     /**
      * Insert a new item into a #PLIST_DICT node.
      *
@@ -475,6 +941,39 @@ extern "C"
      */
     void plist_get_uid_val(plist_t node, uint64_t * val);
 
+    /**
+     * Get a pointer to the value of a #PLIST_KEY node without copying it.
+     *
+     * @param node the node
+     * @param length a location to store the length of the key in bytes, or NULL
+     * @return the NUL-terminated key, or NULL if node is not of type #PLIST_KEY.
+     *         The string belongs to the node and is only valid until the node
+     *         is modified or freed; it must not be freed.
+     */
+    const char* plist_get_key_ptr(plist_t node, uint64_t *length);
+
+    /**
+     * Get a pointer to the value of a #PLIST_STRING node without copying it.
+     *
+     * @param node the node
+     * @param length a location to store the length of the string in bytes, or NULL
+     * @return the NUL-terminated UTF-8 string, or NULL if node is not of type
+     *         #PLIST_STRING. The string belongs to the node and is only valid
+     *         until the node is modified or freed; it must not be freed.
+     */
+    const char* plist_get_string_ptr(plist_t node, uint64_t *length);
+
+    /**
+     * Get a pointer to the value of a #PLIST_DATA node without copying it.
+     *
+     * @param node the node
+     * @param length a location to store the length of the data in bytes, or NULL
+     * @return the data, or NULL if node is not of type #PLIST_DATA. It might
+     *         also be NULL for empty data. The buffer belongs to the node and is
+     *         only valid until the node is modified or freed; it must not be freed.
+     */
+    const char* plist_get_data_ptr(plist_t node, uint64_t *length);
+
 
     /********************************************
      *                                          *
@@ -576,64 +1075,1269 @@ extern "C"
     void plist_to_xml(plist_t plist, char **plist_xml, uint32_t * length);
 
     /**
-     * Export the #plist_t structure to binary format.
+     * Export the #plist_t structure to XML format with writer options.
+     * #PLIST_XML_COMPACT leaves out all whitespace between elements, which
+     * makes documents with large arrays considerably smaller. Parsing the
+     * output gives the same tree as with #plist_to_xml.
      *
      * @param plist the root node to export
-     * @param plist_bin a pointer to a char* buffer. This function allocates the memory,
-     *            caller is responsible for freeing it.
+     * @param options a bitwise combination of #plist_xml_write_options_t
+     *            values, optionally with #PLIST_XML_INDENT_SPACES
+     * @param plist_xml a pointer to a C-string. This function allocates the memory,
+     *            caller is responsible for freeing it. Data is UTF-8 encoded.
      * @param length a pointer to an uint32_t variable. Represents the length of the allocated buffer.
      */
-    void plist_to_bin(plist_t plist, char **plist_bin, uint32_t * length);
+    void plist_to_xml_ex(plist_t plist, uint32_t options, char **plist_xml, uint32_t * length);
 
     /**
-     * Import the #plist_t structure from XML format.
+     * Export the #plist_t structure to XML format with a 64 bit length, for
+     * output of 4 GiB and more. #plist_to_xml and #plist_to_xml_ex fail
+     * for such output and set plist_xml to NULL.
      *
-     * @param plist_xml a pointer to the xml buffer.
-     * @param length length of the buffer to read.
-     * @param plist a pointer to the imported plist.
+     * @param plist the root node to export
+     * @param options a bitwise combination of #plist_xml_write_options_t
+     *            values, optionally with #PLIST_XML_INDENT_SPACES
+     * @param plist_xml a pointer to a C-string. This function allocates the memory,
+     *            caller is responsible for freeing it. Data is UTF-8 encoded.
+     * @param length a pointer to an uint64_t variable. Represents the length of the allocated buffer.
+     * @return 0 on success, -1 on error
      */
-    void plist_from_xml(const char *plist_xml, uint32_t length, plist_t * plist);
+    int plist_to_xml64(plist_t plist, uint32_t options, char **plist_xml, uint64_t * length);
 
     /**
-     * Import the #plist_t structure from binary format.
+     * Export the #plist_t structure to XML format through a callback.
+     * The output is collected in a fixed size buffer that is passed to
+     * writer whenever it fills up, so the document is never held in memory
+     * as a whole. If writer reports an error, no further output is passed
+     * to it.
      *
-     * @param plist_bin a pointer to the xml buffer.
-     * @param length length of the buffer to read.
-     * @param plist a pointer to the imported plist.
+     * @param plist the root node to export
+     * @param writer callback receiving the output
+     * @param user_data passed to writer
+     * @return 0 on success, -1 on error
      */
-    void plist_from_bin(const char *plist_bin, uint32_t length, plist_t * plist);
+    int plist_to_xml_stream(plist_t plist, plist_write_func_t writer, void *user_data);
 
     /**
-     * Import the #plist_t structure from memory data.
-     * This method will look at the first bytes of plist_data
-     * to determine if plist_data contains a binary or XML plist.
+     * Export the #plist_t structure to XML format into a FILE stream.
      *
-     * @param plist_data a pointer to the memory buffer containing plist data.
-     * @param length length of the buffer to read.
-     * @param plist a pointer to the imported plist.
+     * @param plist the root node to export
+     * @param file the stream to write to
+     * @return 0 on success, -1 on error
      */
-    void plist_from_memory(const char *plist_data, uint32_t length, plist_t * plist);
+    int plist_to_xml_file(plist_t plist, FILE *file);
 
     /**
-     * Test if in-memory plist data is binary or XML
-     * This method will look at the first bytes of plist_data
-     * to determine if plist_data contains a binary or XML plist.
-     * This method is not validating the whole memory buffer to check if the
-     * content is truly a plist, it's only using some heuristic on the first few
-     * bytes of plist_data.
+     * Export the #plist_t structure to XML format into a file descriptor.
      *
-     * @param plist_data a pointer to the memory buffer containing plist data.
-     * @param length length of the buffer to read.
-     * @return 1 if the buffer is a binary plist, 0 otherwise.
+     * @param plist the root node to export
+     * @param fd the file descriptor to write to
+     * @return 0 on success, -1 on error
      */
-    int plist_is_binary(const char *plist_data, uint32_t length);
+    int plist_to_xml_fd(plist_t plist, int fd);
 
-    /********************************************
-     *                                          *
+    /**
+     * Export the #plist_t structure to JSON.
+     * Booleans, integers, reals, strings, arrays and dictionaries map to
+     * their JSON counterparts; reals are always written with a fraction or
+     * an exponent, so they are parsed back as reals. Data is written as a
+     * base64 string, dates as an ISO 8601 string like in XML plists and
+     * UIDs as a dictionary with a "CF$UID" number. These are parsed back
+     * as a string and a dictionary respectively.
+     *
+     * @param plist the root node to export
+     * @param plist_json a pointer to a C-string. This function allocates the memory,
+     *            caller is responsible for freeing it. Data is UTF-8 encoded.
+     * @param length a pointer to an uint32_t variable. Represents the length of the allocated buffer.
+     * @param prettify 0 for compact output, otherwise every value is put on
+     *            its own line, indented by two spaces per level
+     * @return 0 on success, -1 if a value can't be represented in JSON
+     *            (real NaN or infinity) or on error
+     */
+    int plist_to_json(plist_t plist, char **plist_json, uint32_t * length, int prettify);
+
+    /**
+     * Export the #plist_t structure to JSON with a 64 bit length, for
+     * output of 4 GiB and more, which makes #plist_to_json fail.
+     *
+     * @param plist the root node to export
+     * @param plist_json a pointer to a C-string. This function allocates the memory,
+     *            caller is responsible for freeing it. Data is UTF-8 encoded.
+     * @param length a pointer to an uint64_t variable. Represents the length of the allocated buffer.
+     * @param prettify 0 for compact output, otherwise indented like #plist_to_json
+     * @return 0 on success, -1 on error
+     */
+    int plist_to_json64(plist_t plist, char **plist_json, uint64_t * length, int prettify);
+
+    /**
+     * Export the #plist_t structure to JSON through a callback, see
+     * #plist_to_json and #plist_to_xml_stream.
+     *
+     * @param plist the root node to export
+     * @param writer callback receiving the output
+     * @param user_data passed to writer
+     * @param prettify 0 for compact output, otherwise indented output
+     * @return 0 on success, -1 on error
+     */
+    int plist_to_json_stream(plist_t plist, plist_write_func_t writer, void *user_data, int prettify);
+
+    /**
+     * Export the #plist_t structure to binary format.
+     *
+     * @param plist the root node to export
+     * @param plist_bin a pointer to a char* buffer. This function allocates the memory,
+     *            caller is responsible for freeing it.
+     * @param length a pointer to an uint32_t variable. Represents the length of the allocated buffer.
+     */
+    void plist_to_bin(plist_t plist, char **plist_bin, uint32_t * length);
+
+    /**
+     * Export the #plist_t structure to binary format with writer options.
+     * Equal scalar values are always written only once. With
+     * #PLIST_WRITE_COMPACT this also applies to arrays and dictionaries,
+     * so repeated subtrees share one object in the output, which can make
+     * it substantially smaller. Since the shared objects are referenced
+     * from several places, such a plist still parses into a regular tree.
+     *
+     * @param plist the root node to export
+     * @param options a bitwise combination of #plist_write_options_t values
+     * @param plist_bin a pointer to a char* buffer. This function allocates the memory,
+     *            caller is responsible for freeing it.
+     * @param length a pointer to an uint32_t variable. Represents the length of the allocated buffer.
+     */
+    void plist_to_bin_ex(plist_t plist, uint32_t options, char **plist_bin, uint32_t * length);
+
+    /**
+     * Export the #plist_t structure to binary format with a 64 bit length,
+     * for output of 4 GiB and more. #plist_to_bin, #plist_to_bin_ex,
+     * #plist_to_bin_parallel and #plist_to_bin_ctx fail for such output and
+     * set plist_bin to NULL.
+     *
+     * @param plist the root node to export
+     * @param options a bitwise combination of #plist_write_options_t values
+     * @param plist_bin a pointer to a char* buffer. This function allocates the memory,
+     *            caller is responsible for freeing it.
+     * @param length a pointer to an uint64_t variable. Represents the length of the allocated buffer.
+     * @return 0 on success, -1 on error
+     */
+    int plist_to_bin64(plist_t plist, uint32_t options, char **plist_bin, uint64_t * length);
+
+    /**
+     * Export the #plist_t structure to binary format using multiple threads.
+     * After the objects have been collected, they are encoded in nthreads
+     * chunks at once and then concatenated. The output is the same as
+     * with #plist_to_bin_ex. The tree must not be modified while it is
+     * written.
+     *
+     * @param plist the root node to export
+     * @param options a bitwise combination of #plist_write_options_t values
+     * @param nthreads the number of threads to use including the calling
+     *		one, or 0 to choose it from the number of processors and the
+     *		size of the plist.
+     * @param plist_bin a pointer to a char* buffer. This function allocates the memory,
+     *            caller is responsible for freeing it.
+     * @param length a pointer to an uint32_t variable. Represents the length of the allocated buffer.
+     */
+    void plist_to_bin_parallel(plist_t plist, uint32_t options, uint32_t nthreads, char **plist_bin, uint32_t * length);
+
+    /**
+     * Create a context for #plist_from_bin_ctx and #plist_to_bin_ctx.
+     * The tables and buffers the binary parser and writer need are kept in
+     * the context and reused by the next call, so converting many plists
+     * in a row doesn't allocate and free them every time. A context must
+     * only be used by one thread at a time.
+     *
+     * @return the new context, or NULL if out of memory.
+     *	It has to be freed with #plist_context_free.
+     */
+    plist_context_t plist_context_new(void);
+
+    /**
+     * Free a context and the buffers it holds, including the last output
+     * of #plist_to_bin_ctx.
+     *
+     * @param ctx the context to free
+     */
+    void plist_context_free(plist_context_t ctx);
+
+    /**
+     * Export the #plist_t structure to binary format using the buffers of
+     * ctx. The output is the same as with #plist_to_bin_ex.
+     *
+     * @param ctx the context to use
+     * @param plist the root node to export
+     * @param options a bitwise combination of #plist_write_options_t values
+     * @param plist_bin a pointer to a const char* that receives the output.
+     *	The buffer belongs to ctx and stays valid until the next call with
+     *	ctx or until ctx is freed, so the caller must not free it.
+     * @param length a pointer to an uint32_t variable that receives the length of the output.
+     */
+    void plist_to_bin_ctx(plist_context_t ctx, plist_t plist, uint32_t options, const char **plist_bin, uint32_t * length);
+
+    /**
+     * Import the #plist_t structure from XML format.
+     *
+     * @param plist_xml a pointer to the xml buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_xml(const char *plist_xml, uint32_t length, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from XML format with a 64 bit length.
+     *
+     * @param plist_xml a pointer to the xml buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_xml64(const char *plist_xml, uint64_t length, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from XML format within limits, see
+     * #plist_from_bin_limited. XML plists describe every node with at
+     * least a few bytes, so their expansion ratios are much lower than
+     * that of binary plists.
+     *
+     * @param plist_xml a pointer to the xml buffer.
+     * @param length length of the buffer to read.
+     * @param limits the limits to enforce, NULL for none
+     * @param plist a pointer to the imported plist, NULL on failure.
+     * @return 0 on success, -1 if the input is not a valid XML plist,
+     *		-2 if it exceeds one of the limits.
+     */
+    int plist_from_xml_limited(const char *plist_xml, uint64_t length, const plist_parse_limits_t *limits, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from binary format.
+     *
+     * @param plist_bin a pointer to the xml buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_bin(const char *plist_bin, uint32_t length, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from XML format into an arena.
+     * The returned tree is owned by the arena and released by #plist_arena_free.
+     *
+     * @param plist_xml a pointer to the xml buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     * @param arena the arena to allocate from, or NULL to behave like #plist_from_xml
+     */
+    void plist_from_xml_arena(const char *plist_xml, uint32_t length, plist_t * plist, plist_arena_t arena);
+
+    /**
+     * Import the #plist_t structure from binary format into an arena.
+     * The returned tree is owned by the arena and released by #plist_arena_free.
+     *
+     * @param plist_bin a pointer to the binary buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     * @param arena the arena to allocate from, or NULL to behave like #plist_from_bin
+     */
+    void plist_from_bin_arena(const char *plist_bin, uint32_t length, plist_t * plist, plist_arena_t arena);
+
+    /**
+     * Import the #plist_t structure from binary format with parser options.
+     * With #PLIST_PARSE_BORROW the payload of #PLIST_DATA nodes is not copied
+     * but points into plist_bin, so the caller has to make sure the buffer
+     * is not modified or freed before the returned tree is freed.
+     * Strings are always copied since they need to be 0-terminated.
+     * Copies made with #plist_copy do not reference the buffer.
+     *
+     * With #PLIST_PARSE_LAZY the children of arrays and dictionaries are
+     * only parsed when the container is first accessed, so plist_bin has
+     * to stay valid as long as the returned tree is used. Since reading a
+     * tree modifies it in this mode, a lazily parsed tree must not be
+     * accessed from multiple threads at once. A container with malformed
+     * children is only detected when it is accessed and then appears
+     * empty, where the regular parser would fail to parse the whole plist.
+     *
+     * @param plist_bin a pointer to the binary buffer.
+     * @param length length of the buffer to read.
+     * @param options a bitwise combination of #plist_parse_options_t values
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_bin_ex(const char *plist_bin, uint32_t length, uint32_t options, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from binary format with a 64 bit length
+     * and parser options, see #plist_from_bin_ex. Binary plists larger
+     * than 4 GiB use 8 byte offsets, which the parser handles.
+     *
+     * @param plist_bin a pointer to the binary buffer.
+     * @param length length of the buffer to read.
+     * @param options a bitwise combination of #plist_parse_options_t values
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_bin64(const char *plist_bin, uint64_t length, uint32_t options, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from binary format within limits,
+     * for input that can't be trusted. Every object reference in a binary
+     * plist becomes a node of its own, so a few bytes that reference the
+     * same containers over and over expand into a huge tree; max_nodes
+     * and max_expansion stop that early. A tree takes about 100 to 150
+     * bytes per node, so sensible expansion ratios for binary plists start
+     * at about 50. #PLIST_PARSE_LAZY is ignored since the limits can only
+     * be enforced while the whole tree is built.
+     *
+     * @param plist_bin a pointer to the binary buffer.
+     * @param length length of the buffer to read.
+     * @param options a bitwise combination of #plist_parse_options_t values
+     * @param limits the limits to enforce, NULL for none
+     * @param plist a pointer to the imported plist, NULL on failure.
+     * @return 0 on success, -1 if the input is not a valid binary plist,
+     *		-2 if it exceeds one of the limits.
+     */
+    int plist_from_bin_limited(const char *plist_bin, uint64_t length, uint32_t options, const plist_parse_limits_t *limits, plist_t * plist);
+
+    /**
+     * Check a binary plist without parsing it. It passes exactly when
+     * #plist_from_bin would succeed, but no nodes are created: the only
+     * memory used is a bitmap and a small counter per object, plus a
+     * stack for nested containers. Containers that are referenced more
+     * than once are only checked the first time.
+     *
+     * @param plist_bin a pointer to the binary buffer.
+     * @param length length of the buffer.
+     * @param error set to the reason if the plist is malformed, can be NULL
+     * @return 0 if the plist is well formed, -1 otherwise.
+     */
+    int plist_bin_validate(const char *plist_bin, uint64_t length, plist_bin_error_t *error);
+
+    /**
+     * Import the #plist_t structure from binary format using multiple threads.
+     * The strings, data and numbers of the object table are decoded by
+     * nthreads threads at once, then the containers are linked up on the
+     * calling thread. The result is the same as with #plist_from_bin.
+     * This pays off for large plists with many scalar objects.
+     *
+     * @param plist_bin a pointer to the binary buffer.
+     * @param length length of the buffer to read.
+     * @param nthreads the number of threads to use including the calling
+     *		one, or 0 to choose it from the number of processors and the
+     *		size of the plist.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_bin_parallel(const char *plist_bin, uint32_t length, uint32_t nthreads, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from binary format using the buffers of
+     * ctx. The result is the same as with #plist_from_bin and is not tied
+     * to ctx, which can be freed or reused right away.
+     *
+     * @param ctx the context to use, see #plist_context_new
+     * @param plist_bin a pointer to the binary buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_bin_ctx(plist_context_t ctx, const char *plist_bin, uint32_t length, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from JSON. Objects become dictionaries
+     * (a repeated key replaces the earlier value), numbers without
+     * fraction and exponent become integers if they fit into 64 bits and
+     * reals otherwise. null has no plist equivalent and makes the import
+     * fail.
+     *
+     * @param plist_json a pointer to the JSON buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist, NULL if the input is
+     *            not valid JSON.
+     */
+    void plist_from_json(const char *plist_json, uint32_t length, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from JSON with a 64 bit length.
+     *
+     * @param plist_json a pointer to the JSON buffer.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist, NULL if the input is
+     *            not valid JSON.
+     */
+    void plist_from_json64(const char *plist_json, uint64_t length, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from memory data.
+     * This method will look at the first bytes of plist_data
+     * to determine if plist_data contains a binary, compressed binary, JSON
+     * or XML plist.
+     *
+     * @param plist_data a pointer to the memory buffer containing plist data.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_memory(const char *plist_data, uint32_t length, plist_t * plist);
+
+    /**
+     * Import the #plist_t structure from memory data with a 64 bit length,
+     * like #plist_from_memory.
+     *
+     * @param plist_data a pointer to the memory buffer containing plist data.
+     * @param length length of the buffer to read.
+     * @param plist a pointer to the imported plist.
+     */
+    void plist_from_memory64(const char *plist_data, uint64_t length, plist_t * plist);
+
+    /**
+     * Parse an XML plist from a stream without building a tree.
+     * Input is requested in chunks from reader and the structure is reported
+     * to handler as it is parsed, so memory use is bounded by the size of the
+     * largest single value rather than the size of the document.
+     *
+     * @param reader callback providing the input data
+     * @param handler callbacks receiving the parse events, or NULL
+     * @param user_data passed to reader and all handler callbacks
+     * @return 0 on success, 1 if a callback stopped parsing, -1 on error
+     */
+    int plist_xml_parse_stream(plist_read_func_t reader, const plist_xml_handler_t *handler, void *user_data);
+
+    /**
+     * Import the #plist_t structure from a file.
+     * The file is mapped into memory (or read if that is not possible) and
+     * parsed as binary, JSON or XML depending on its first bytes. There is no
+     * 4 GiB limit on the file size. Compressed binary plists made without a
+     * dictionary are decompressed and reported as #PLIST_FORMAT_BINARY.
+     *
+     * @param filename the file to read.
+     * @param plist a pointer to the imported plist.
+     * @param format a location to store the detected format, or NULL.
+     * @return 0 on success, -1 if the file could not be read, -2 if it does
+     *		not contain a valid plist.
+     */
+    int plist_read_from_file(const char *filename, plist_t *plist, plist_format_t *format);
+
+    /**
+     * Import the #plist_t structure from a file with parser options.
+     * With #PLIST_PARSE_BORROW, data nodes of binary plists reference the
+     * file mapping directly, and with #PLIST_PARSE_LAZY the containers of
+     * binary plists are parsed from it later. The mapping is returned in
+     * mapping and must be released with #plist_mapping_free after the tree
+     * has been freed. If mapping is NULL the file is always released before
+     * returning and both options are ignored.
+     *
+     * @param filename the file to read.
+     * @param options a bitwise combination of #plist_parse_options_t values
+     * @param plist a pointer to the imported plist.
+     * @param format a location to store the detected format, or NULL.
+     * @param mapping a location to store the file mapping, or NULL.
+     * @return 0 on success, -1 if the file could not be read, -2 if it does
+     *		not contain a valid plist.
+     */
+    int plist_read_from_file_ex(const char *filename, uint32_t options, plist_t *plist, plist_format_t *format, plist_mapping_t *mapping);
+
+    /**
+     * Release a file mapping returned by #plist_read_from_file_ex.
+     *
+     * @param mapping the mapping to release
+     */
+    void plist_mapping_free(plist_mapping_t mapping);
+
+    /**
+     * Test if in-memory plist data is binary or XML
+     * This method will look at the first bytes of plist_data
+     * to determine if plist_data contains a binary or XML plist.
+     * This method is not validating the whole memory buffer to check if the
+     * content is truly a plist, it's only using some heuristic on the first few
+     * bytes of plist_data.
+     *
+     * @param plist_data a pointer to the memory buffer containing plist data.
+     * @param length length of the buffer to read.
+     * @return 1 if the buffer is a binary plist, 0 otherwise.
+     */
+    int plist_is_binary(const char *plist_data, uint32_t length);
+
+    /********************************************
+     *                                          *
+     *          Binary plist reader             *
+     *                                          *
+     ********************************************/
+
+    /**
+     * Open a cursor over a binary plist in memory.
+     * Objects are addressed by their index in the offset table and decoded
+     * on demand, no nodes are created. The buffer is not copied and must
+     * stay valid until the reader is freed.
+     *
+     * @param plist_bin a pointer to the binary buffer.
+     * @param length length of the buffer.
+     * @return the reader or NULL if the buffer is not a valid binary plist.
+     */
+    plist_bin_reader_t plist_bin_reader_open(const char *plist_bin, uint64_t length);
+
+    /**
+     * Free a reader returned by #plist_bin_reader_open.
+     *
+     * @param reader the reader to free
+     */
+    void plist_bin_reader_free(plist_bin_reader_t reader);
+
+    /**
+     * Get the index of the root object.
+     *
+     * @param reader the reader
+     * @return the root object index
+     */
+    uint64_t plist_bin_reader_root(plist_bin_reader_t reader);
+
+    /**
+     * Get the type of an object. Sets are reported as #PLIST_ARRAY.
+     *
+     * @param reader the reader
+     * @param obj the object index
+     * @return the type or #PLIST_NONE if the object is invalid
+     */
+    plist_type plist_bin_reader_get_type(plist_bin_reader_t reader, uint64_t obj);
+
+    /**
+     * Get the size of an object: the number of items of an array or
+     * dictionary, the number of bytes of a data object or the number of
+     * characters of a string. Other types have size 0.
+     *
+     * @param reader the reader
+     * @param obj the object index
+     * @return the size of the object
+     */
+    uint64_t plist_bin_reader_get_size(plist_bin_reader_t reader, uint64_t obj);
+
+    /**
+     * Get the n-th item of an array or the n-th value of a dictionary.
+     *
+     * @param reader the reader
+     * @param obj the index of the array or dictionary
+     * @param n the position of the item
+     * @param child a location to store the object index of the item
+     * @return 0 on success, -1 on error
+     */
+    int plist_bin_reader_child(plist_bin_reader_t reader, uint64_t obj, uint64_t n, uint64_t *child);
+
+    /**
+     * Get the n-th key of a dictionary.
+     *
+     * @param reader the reader
+     * @param obj the index of the dictionary
+     * @param n the position of the key
+     * @param key a location to store the object index of the key
+     * @return 0 on success, -1 on error
+     */
+    int plist_bin_reader_dict_key(plist_bin_reader_t reader, uint64_t obj, uint64_t n, uint64_t *key);
+
+    /**
+     * Look up a dictionary value by key.
+     *
+     * @param reader the reader
+     * @param obj the index of the dictionary
+     * @param key the key to look for
+     * @param value a location to store the object index of the value
+     * @return 0 on success, -1 if the key was not found or on error
+     */
+    int plist_bin_reader_dict_get(plist_bin_reader_t reader, uint64_t obj, const char *key, uint64_t *value);
+
+    /**
+     * Get the value of a boolean object.
+     *
+     * @param reader the reader
+     * @param obj the object index
+     * @param val a location to store the value
+     * @return 0 on success, -1 on error
+     */
+    int plist_bin_reader_get_bool(plist_bin_reader_t reader, uint64_t obj, uint8_t *val);
+
+    /**
+     * Get the value of an integer or UID object.
+     *
+     * @param reader the reader
+     * @param obj the object index
+     * @param val a location to store the value
+     * @return 0 on success, -1 on error
+     */
+    int plist_bin_reader_get_uint(plist_bin_reader_t reader, uint64_t obj, uint64_t *val);
+
+    /**
+     * Get the value of a real or date object. Dates are returned as
+     * seconds since 01/01/2001.
+     *
+     * @param reader the reader
+     * @param obj the object index
+     * @param val a location to store the value
+     * @return 0 on success, -1 on error
+     */
+    int plist_bin_reader_get_real(plist_bin_reader_t reader, uint64_t obj, double *val);
+
+    /**
+     * Get the value of a string object as UTF-8.
+     *
+     * @param reader the reader
+     * @param obj the object index
+     * @param val a pointer to a C-string. This function allocates the memory,
+     *            caller is responsible for freeing it.
+     * @return 0 on success, -1 on error
+     */
+    int plist_bin_reader_get_string(plist_bin_reader_t reader, uint64_t obj, char **val);
+
+    /**
+     * Get the payload of a data object. The returned pointer points into
+     * the buffer the reader was opened on.
+     *
+     * @param reader the reader
+     * @param obj the object index
+     * @param val a location to store the pointer to the payload
+     * @param length a location to store the payload length
+     * @return 0 on success, -1 on error
+     */
+    int plist_bin_reader_get_data(plist_bin_reader_t reader, uint64_t obj, const char **val, uint64_t *length);
+
+    /**
+     * Build a #plist_t tree for an object and everything below it.
+     *
+     * @param reader the reader
+     * @param obj the object index
+     * @return the new tree, caller is responsible for freeing it, or NULL
+     *         on error
+     */
+    plist_t plist_bin_reader_get_node(plist_bin_reader_t reader, uint64_t obj);
+
+    /**
+     * Change a value of a binary plist without parsing and writing all of
+     * it. The object path leads to is overwritten in place if the new
+     * value has the same type and fits into its encoding: booleans, dates,
+     * integers and reals that fit the stored width, UIDs, and ASCII
+     * strings and data of the same length. Otherwise the value is added
+     * as a new object, the reference to it is changed, and the offset
+     * table and trailer are written again. The old object stays in the
+     * buffer unused. Objects that are shared by several containers, like
+     * equal values written only once, are never changed in place; the
+     * containers on the path between them and the value are copied.
+     * Only if the reference size of the plist can't address the new
+     * objects, the plist is parsed and written again.
+     *
+     * Appended integers and reals always use 8 bytes, so a counter that
+     * outgrew its width once is changed in place the next time.
+     *
+     * @param plist_bin a pointer to the binary plist, allocated like the
+     *        output of #plist_to_bin. It is reallocated if the value can't
+     *        be changed in place.
+     * @param length a pointer to the length of the binary plist, updated
+     *        if it changes
+     * @param path a compiled path without "*" elements
+     * @param value the new value, a scalar node that is not a key. It is
+     *        copied.
+     * @return 0 if the value was changed in place, 1 if *plist_bin and
+     *         *length were replaced, -1 if the path doesn't lead to an
+     *         object, the plist is invalid or on error
+     */
+    int plist_bin_patch(char **plist_bin, uint64_t *length, plist_path_t path, plist_t value);
+
+    /********************************************
+     *                                          *
+     *             Frozen plists                *
+     *                                          *
+     ********************************************/
+
+    /**
+     * Create a read-only copy of a tree for fast repeated lookups.
+     * All nodes, strings and data are stored in one contiguous block, nodes
+     * are addressed by their index like objects of #plist_bin_reader_open.
+     * Dictionaries with more than a few entries get a hash table, so
+     * #plist_frozen_dict_get does not scan them. The tree is not referenced
+     * after the call. A frozen plist is never modified and can be shared
+     * by any number of threads.
+     *
+     * @param plist the tree to freeze
+     * @return the frozen plist or NULL on error or if the tree has more
+     *         than 2^32 nodes or a payload of more than 4 GB.
+     */
+    plist_frozen_t plist_freeze(plist_t plist);
+
+    /**
+     * Free a frozen plist returned by #plist_freeze.
+     *
+     * @param frozen the frozen plist to free
+     */
+    void plist_frozen_free(plist_frozen_t frozen);
+
+    /**
+     * Get the index of the root node.
+     *
+     * @param frozen the frozen plist
+     * @return the root node index
+     */
+    uint64_t plist_frozen_root(plist_frozen_t frozen);
+
+    /**
+     * Get the type of a node.
+     *
+     * @param frozen the frozen plist
+     * @param obj the node index
+     * @return the type or #PLIST_NONE if the index is invalid
+     */
+    plist_type plist_frozen_get_type(plist_frozen_t frozen, uint64_t obj);
+
+    /**
+     * Get the size of a node: the number of items of an array or
+     * dictionary, or the number of bytes of a data, string or key node.
+     * Other types have size 0.
+     *
+     * @param frozen the frozen plist
+     * @param obj the node index
+     * @return the size of the node
+     */
+    uint64_t plist_frozen_get_size(plist_frozen_t frozen, uint64_t obj);
+
+    /**
+     * Get the n-th item of an array or the n-th value of a dictionary.
+     *
+     * @param frozen the frozen plist
+     * @param obj the index of the array or dictionary
+     * @param n the position of the item
+     * @param child a location to store the node index of the item
+     * @return 0 on success, -1 on error
+     */
+    int plist_frozen_child(plist_frozen_t frozen, uint64_t obj, uint64_t n, uint64_t *child);
+
+    /**
+     * Get the n-th key of a dictionary.
+     *
+     * @param frozen the frozen plist
+     * @param obj the index of the dictionary
+     * @param n the position of the key
+     * @param key a location to store the node index of the key
+     * @return 0 on success, -1 on error
+     */
+    int plist_frozen_dict_key(plist_frozen_t frozen, uint64_t obj, uint64_t n, uint64_t *key);
+
+    /**
+     * Look up a dictionary value by key.
+     *
+     * @param frozen the frozen plist
+     * @param obj the index of the dictionary
+     * @param key the key to look for
+     * @param value a location to store the node index of the value
+     * @return 0 on success, -1 if the key was not found or on error
+     */
+    int plist_frozen_dict_get(plist_frozen_t frozen, uint64_t obj, const char *key, uint64_t *value);
+
+    /**
+     * Get the value of a boolean node.
+     *
+     * @param frozen the frozen plist
+     * @param obj the node index
+     * @param val a location to store the value
+     * @return 0 on success, -1 on error
+     */
+    int plist_frozen_get_bool(plist_frozen_t frozen, uint64_t obj, uint8_t *val);
+
+    /**
+     * Get the value of an integer or UID node.
+     *
+     * @param frozen the frozen plist
+     * @param obj the node index
+     * @param val a location to store the value
+     * @return 0 on success, -1 on error
+     */
+    int plist_frozen_get_uint(plist_frozen_t frozen, uint64_t obj, uint64_t *val);
+
+    /**
+     * Get the value of a real or date node. Dates are returned as
+     * seconds since 01/01/2001.
+     *
+     * @param frozen the frozen plist
+     * @param obj the node index
+     * @param val a location to store the value
+     * @return 0 on success, -1 on error
+     */
+    int plist_frozen_get_real(plist_frozen_t frozen, uint64_t obj, double *val);
+
+    /**
+     * Get the value of a string or key node. The returned pointer points
+     * into the frozen plist and is NUL terminated.
+     *
+     * @param frozen the frozen plist
+     * @param obj the node index
+     * @param val a location to store the pointer to the string
+     * @param length a location to store the length of the string, or NULL
+     * @return 0 on success, -1 on error
+     */
+    int plist_frozen_get_string(plist_frozen_t frozen, uint64_t obj, const char **val, uint64_t *length);
+
+    /**
+     * Get the payload of a data node. The returned pointer points into
+     * the frozen plist.
+     *
+     * @param frozen the frozen plist
+     * @param obj the node index
+     * @param val a location to store the pointer to the payload
+     * @param length a location to store the payload length, or NULL
+     * @return 0 on success, -1 on error
+     */
+    int plist_frozen_get_data(plist_frozen_t frozen, uint64_t obj, const char **val, uint64_t *length);
+
+    /**
+     * Build a #plist_t tree for a node and everything below it.
+     *
+     * @param frozen the frozen plist
+     * @param obj the node index
+     * @return the new tree, caller is responsible for freeing it, or NULL
+     *         on error
+     */
+    plist_t plist_frozen_get_node(plist_frozen_t frozen, uint64_t obj);
+
+    /********************************************
+     *                                          *
+     *          Binary plist writer             *
+     *                                          *
+     ********************************************/
+
+    /**
+     * Create a writer producing a binary plist incrementally, without
+     * building a tree first. Values are added in document order with the
+     * plist_bin_writer_add_* functions, containers are opened with
+     * #plist_bin_writer_begin_dict or #plist_bin_writer_begin_array and
+     * closed with #plist_bin_writer_end; in dictionaries every value has
+     * to be preceded by its key. Each object is passed to writer as soon
+     * as it is complete, only the offset table and the child references
+     * of the open containers are kept in memory. #plist_bin_writer_finish
+     * writes the offset table and trailer.
+     *
+     * The output uses 4 byte object references, so it can hold up to
+     * 2^32 objects. With #PLIST_WRITE_COMPACT, objects that encode to the
+     * same bytes (equal values, keys and subtrees) are only written once,
+     * which requires keeping a copy of every distinct object in memory.
+     *
+     * All functions taking a writer return 0 on success and -1 on error.
+     * A failed write makes every further call fail.
+     *
+     * @param writer the output callback
+     * @param user_data passed to writer
+     * @param options a bitwise combination of #plist_write_options_t values
+     * @return the writer or NULL on error
+     */
+    plist_bin_writer_t plist_bin_writer_new(plist_write_func_t writer, void *user_data, uint32_t options);
+
+    /**
+     * Create a writer like #plist_bin_writer_new that writes to a file descriptor.
+     *
+     * @param fd the file descriptor to write to
+     * @param options a bitwise combination of #plist_write_options_t values
+     * @return the writer or NULL on error
+     */
+    plist_bin_writer_t plist_bin_writer_new_fd(int fd, uint32_t options);
+
+    /**
+     * Free a writer. Does not write anything, call #plist_bin_writer_finish
+     * first to complete the output.
+     *
+     * @param writer the writer to free
+     */
+    void plist_bin_writer_free(plist_bin_writer_t writer);
+
+    /**
+     * Open a dictionary. Add key/value pairs and close it with #plist_bin_writer_end.
+     *
+     * @param writer the writer
+     */
+    int plist_bin_writer_begin_dict(plist_bin_writer_t writer);
+
+    /**
+     * Open an array. Add items and close it with #plist_bin_writer_end.
+     *
+     * @param writer the writer
+     */
+    int plist_bin_writer_begin_array(plist_bin_writer_t writer);
+
+    /**
+     * Close the innermost open dictionary or array.
+     *
+     * @param writer the writer
+     */
+    int plist_bin_writer_end(plist_bin_writer_t writer);
+
+    /**
+     * Add the key for the next value of the current dictionary.
+     *
+     * @param writer the writer
+     * @param key the key (UTF-8)
+     */
+    int plist_bin_writer_add_key(plist_bin_writer_t writer, const char *key);
+
+    /**
+     * Add a string.
+     *
+     * @param writer the writer
+     * @param val the string (UTF-8)
+     */
+    int plist_bin_writer_add_string(plist_bin_writer_t writer, const char *val);
+
+    /**
+     * Add a boolean.
+     *
+     * @param writer the writer
+     * @param val the boolean value, 0 or 1
+     */
+    int plist_bin_writer_add_bool(plist_bin_writer_t writer, uint8_t val);
+
+    /**
+     * Add an unsigned integer.
+     *
+     * @param writer the writer
+     * @param val the integer value
+     */
+    int plist_bin_writer_add_uint(plist_bin_writer_t writer, uint64_t val);
+
+    /**
+     * Add a signed integer.
+     *
+     * @param writer the writer
+     * @param val the integer value
+     */
+    int plist_bin_writer_add_int(plist_bin_writer_t writer, int64_t val);
+
+    /**
+     * Add a real.
+     *
+     * @param writer the writer
+     * @param val the real value
+     */
+    int plist_bin_writer_add_real(plist_bin_writer_t writer, double val);
+
+    /**
+     * Add a date, see #plist_new_date.
+     *
+     * @param writer the writer
+     * @param sec the number of seconds since 01/01/2001
+     * @param usec the number of microseconds
+     */
+    int plist_bin_writer_add_date(plist_bin_writer_t writer, int32_t sec, int32_t usec);
+
+    /**
+     * Add binary data.
+     *
+     * @param writer the writer
+     * @param val the data, copied into the output
+     * @param length the length of the data
+     */
+    int plist_bin_writer_add_data(plist_bin_writer_t writer, const char *val, uint64_t length);
+
+    /**
+     * Add a UID.
+     *
+     * @param writer the writer
+     * @param val the UID value
+     */
+    int plist_bin_writer_add_uid(plist_bin_writer_t writer, uint64_t val);
+
+    /**
+     * Add a node and all its children, as if added one by one.
+     *
+     * @param writer the writer
+     * @param node the node to add
+     */
+    int plist_bin_writer_add_node(plist_bin_writer_t writer, plist_t node);
+
+    /**
+     * Complete the output by writing the offset table and the trailer.
+     * All containers have to be closed and a root object must have been
+     * added. The writer can't be used afterwards except for freeing it.
+     *
+     * @param writer the writer
+     */
+    int plist_bin_writer_finish(plist_bin_writer_t writer);
+
+    /********************************************
+     *                                          *
+     *        Compressed binary plists          *
+     *                                          *
+     ********************************************/
+
+    /**
+     * Export the #plist_t structure to a compressed binary plist. The
+     * binary plist is split into blocks of 64 KiB that are compressed with
+     * method, and stored uncompressed if that doesn't make them smaller.
+     * Matches reach back into the previous blocks, and into dict if one is
+     * given, so it pays off for large plists as well as for small ones
+     * that resemble the dictionary. The output starts with a header that
+     * #plist_is_compressed recognizes and holds a checksum of the binary
+     * plist.
+     *
+     * @param plist the root node to export
+     * @param method the compression method
+     * @param level 1 (or 0) for the fastest compression up to 12 for the
+     *	smallest output, decompression speed is the same for all levels
+     * @param dict the dictionary to compress with, or NULL. The same
+     *	dictionary has to be passed when the plist is imported again.
+     * @param plist_out a pointer to a char* buffer. This function allocates the memory,
+     *            caller is responsible for freeing it.
+     * @param length a pointer to an uint32_t variable. Represents the length of the allocated buffer.
+     * @return 0 on success, -1 if the arguments are invalid or out of memory.
+     */
+    int plist_to_bin_compressed(plist_t plist, plist_compression_t method, int level, plist_compress_dict_t dict, char **plist_out, uint32_t *length);
+
+    /**
+     * Import the #plist_t structure from a compressed binary plist made by
+     * #plist_to_bin_compressed. The blocks are decompressed directly into
+     * the buffer the binary plist is parsed from, no copy of the input is
+     * made. #plist_from_memory and #plist_read_from_file recognize
+     * compressed plists too, but only those made without a dictionary.
+     *
+     * @param plist_data a pointer to the compressed plist.
+     * @param length length of the buffer to read.
+     * @param dict the dictionary it was compressed with, or NULL
+     * @param plist a pointer to the imported plist, NULL if the data is
+     *	malformed, fails the checksum or needs a different dictionary.
+     */
+    void plist_from_bin_compressed(const char *plist_data, uint32_t length, plist_compress_dict_t dict, plist_t *plist);
+
+    /**
+     * Import the #plist_t structure from a compressed binary plist that is
+     * read in chunks from reader. Each block is decompressed as soon as it
+     * has been read, so besides the binary plist itself only one
+     * compressed block of at most 64 KiB is held in memory.
+     *
+     * @param reader callback providing the compressed data
+     * @param user_data passed to reader
+     * @param dict the dictionary it was compressed with, or NULL
+     * @param plist a pointer to the imported plist, NULL on error.
+     * @return 0 on success, -1 on error.
+     */
+    int plist_from_bin_compressed_stream(plist_read_func_t reader, void *user_data, plist_compress_dict_t dict, plist_t *plist);
+
+    /**
+     * Test if in-memory plist data is a compressed binary plist.
+     * Like #plist_is_binary only the first bytes are checked.
+     *
+     * @param plist_data a pointer to the memory buffer containing plist data.
+     * @param length length of the buffer to read.
+     * @return 1 if the buffer is a compressed binary plist, 0 otherwise.
+     */
+    int plist_is_compressed(const char *plist_data, uint32_t length);
+
+    /**
+     * Create a dictionary for compressing small plists. data should
+     * contain byte sequences that are common in the plists, for instance
+     * one or more typical binary plists, with the most common content at
+     * the end. Only the last 64 KiB are used. A dictionary can be used by
+     * several threads at once.
+     *
+     * @param data the content of the dictionary, it is copied
+     * @param length the length of data
+     * @return the dictionary or NULL on error.
+     *	It has to be freed with #plist_compress_dict_free.
+     */
+    plist_compress_dict_t plist_compress_dict_new(const char *data, uint32_t length);
+
+    /**
+     * Create a dictionary from sample binary plists. Short segments of the
+     * samples containing byte sequences that occur in many of them (keys,
+     * common strings, similar object tables) are picked until max_size is
+     * reached. Save the content with #plist_compress_dict_get_data and
+     * load it with #plist_compress_dict_new.
+     *
+     * @param samples the sample binary plists
+     * @param lengths the lengths of the samples
+     * @param count the number of samples
+     * @param max_size the maximum size of the dictionary, at most 64 KiB
+     * @return the dictionary, or NULL if the samples have nothing in
+     *	common or on error. It has to be freed with #plist_compress_dict_free.
+     */
+    plist_compress_dict_t plist_compress_dict_train(const char *const *samples, const uint32_t *lengths, uint32_t count, uint32_t max_size);
+
+    /**
+     * Get the content of a dictionary, to store it along with the
+     * compressed plists.
+     *
+     * @param dict the dictionary
+     * @param data a pointer that receives the content, owned by dict
+     * @param length a pointer that receives the length of the content
+     */
+    void plist_compress_dict_get_data(plist_compress_dict_t dict, const char **data, uint32_t *length);
+
+    /**
+     * Free a dictionary.
+     *
+     * @param dict the dictionary to free
+     */
+    void plist_compress_dict_free(plist_compress_dict_t dict);
+
+    /********************************************
+     *                                          *
+     *             Struct binding               *
+     *                                          *
+     ********************************************/
+
+    /**
+     * Decode a dictionary of a binary plist into a struct described by a
+     * schema, without creating nodes. Every key of the dictionary is
+     * looked up in fields and the value is stored at the member's offset;
+     * keys that are not in the schema are skipped, members whose key is
+     * missing are left unchanged, so out should be initialized first.
+     * Only #PLIST_FIELD_STRING and #PLIST_FIELD_NODE members allocate
+     * memory, free it with #plist_struct_free.
+     *
+     * @param reader a reader returned by #plist_bin_reader_open
+     * @param obj the index of the dictionary
+     * @param fields the schema, ending with #PLIST_FIELD_END
+     * @param out the struct to fill
+     * @return 0 on success, -1 if obj is not a dictionary, a value has the
+     *         wrong type or is out of range, a key appears twice or a
+     *         required key is missing. Members that were decoded before
+     *         the error keep their values.
+     */
+    int plist_bin_reader_get_struct(plist_bin_reader_t reader, uint64_t obj, const plist_field_t *fields, void *out);
+
+    /**
+     * Decode the root dictionary of a binary plist into a struct, see
+     * #plist_bin_reader_get_struct. #PLIST_FIELD_DATA members point into
+     * plist_bin.
+     *
+     * @param plist_bin a pointer to the binary buffer
+     * @param length length of the buffer
+     * @param fields the schema, ending with #PLIST_FIELD_END
+     * @param out the struct to fill
+     * @return 0 on success, -1 on error
+     */
+    int plist_from_bin_struct(const char *plist_bin, uint64_t length, const plist_field_t *fields, void *out);
+
+    /**
+     * Add a struct as a dictionary with one entry per field of the schema,
+     * in schema order. NULL #PLIST_FIELD_STRING and #PLIST_FIELD_NODE
+     * members are left out.
+     *
+     * @param writer the writer
+     * @param fields the schema, ending with #PLIST_FIELD_END
+     * @param in the struct to add
+     */
+    int plist_bin_writer_add_struct(plist_bin_writer_t writer, const plist_field_t *fields, const void *in);
+
+    /**
+     * Write a struct as a binary plist with a dictionary as root, see
+     * #plist_bin_writer_add_struct.
+     *
+     * @param fields the schema, ending with #PLIST_FIELD_END
+     * @param in the struct to write
+     * @param plist_bin a pointer to store the binary plist, the caller is
+     *        responsible for freeing it
+     * @param length a pointer to store the length of the binary plist
+     * @return 0 on success, -1 on error
+     */
+    int plist_to_bin_struct(const plist_field_t *fields, const void *in, char **plist_bin, uint64_t *length);
+
+    /**
+     * Free the strings and nodes of a struct decoded with
+     * #plist_bin_reader_get_struct and set them to NULL.
+     *
+     * @param fields the schema, ending with #PLIST_FIELD_END
+     * @param s the struct
+     */
+    void plist_struct_free(const plist_field_t *fields, void *s);
+
+    /********************************************
+     *                                          *
      *                 Utils                    *
      *                                          *
      ********************************************/
 
+    /**
+     * Set the maximum nesting depth of arrays and dictionaries accepted by
+     * the XML and binary parsers, input nested deeper fails to parse. The
+     * parsers and all other operations on trees are not recursive, so this
+     * only protects against untrusted input producing degenerate trees.
+     * The setting is global, it should be changed before any parsing
+     * happens in other threads.
+     *
+     * @param depth the maximum depth (a plain array has depth 1), or 0 for
+     *        the default of 512
+     */
+    void plist_set_max_depth(uint32_t depth);
+
+    /**
+     * Get the maximum nesting depth, see #plist_set_max_depth.
+     *
+     * @return the maximum depth
+     */
+    uint32_t plist_get_max_depth(void);
+
+    /**
+     * Set the number of entries from which on dictionaries get a hash index
+     * that makes #plist_dict_get_item independent of the dictionary size.
+     * Dictionaries created by the parsers get it right away, those built
+     * with #plist_dict_set_item once they grow beyond the threshold. The
+     * setting is global and only affects dictionaries created or modified
+     * afterwards.
+     *
+     * @param entries dictionaries with more entries get an index, the
+     *        default is 250. UINT32_MAX effectively disables the index.
+     */
+    void plist_set_dict_index_threshold(uint32_t entries);
+
+    /**
+     * Get the dictionary index threshold, see #plist_set_dict_index_threshold.
+     *
+     * @return the number of entries
+     */
+    uint32_t plist_get_dict_index_threshold(void);
+
+    /**
+     * Get the memory taken by a tree: its nodes, their strings and data and
+     * the indexes of large arrays and dictionaries. Payloads that copies
+     * made with #plist_copy share are counted for every tree, data
+     * borrowed from an input buffer and the overhead of the allocator are
+     * not counted. Lazily parsed containers only count once loaded.
+     *
+     * @param plist the root of the tree
+     * @return the size in bytes, 0 for NULL
+     */
+    uint64_t plist_mem_usage(plist_t plist);
+
+    /**
+     * Get the counters of the calling thread. They are only collected if
+     * libplist was configured with --enable-stats, otherwise the hot paths
+     * carry no instrumentation at all. Worker threads of the *_parallel
+     * functions count into their own counters, which are not reported.
+     *
+     * @param stats a pointer to a #plist_stats_t that receives the counters.
+     *	It is zeroed if statistics are not available.
+     * @return 0 on success, or -1 if libplist was built without statistics.
+     */
+    int plist_stats_get(plist_stats_t *stats);
+
+    /**
+     * Reset the counters of the calling thread to 0.
+     */
+    void plist_stats_reset(void);
+
+    /**
+     * Make the library allocate all its memory with the given functions,
+     * including the nodes of libcnary, parser and writer buffers and the
+     * memory returned to the caller. Once set, everything the library hands
+     * out for the caller to free (output buffers of the plist_to_*
+     * functions, strings and data of the plist_get_*_val functions, keys
+     * and iterators) has to be released with #plist_mem_free instead of
+     * free().
+     *
+     * The allocator has to be set before anything is allocated and can
+     * only be changed when nothing allocated with the previous one is
+     * still in use. It applies to all threads, so the functions must be
+     * thread-safe if the library is used from several threads.
+     *
+     * @param malloc_fn the allocation function
+     * @param realloc_fn the reallocation function
+     * @param free_fn the release function
+     * @param ctx passed to all three functions
+     * @return 0 on success, -1 if only some of the functions are given.
+     *	Passing NULL for all of them restores malloc, realloc and free.
+     */
+    int plist_set_allocator(plist_malloc_func_t malloc_fn, plist_realloc_func_t realloc_fn, plist_free_func_t free_fn, void *ctx);
+
+    /**
+     * Release memory returned by the library, using the allocator set with
+     * #plist_set_allocator. Without a custom allocator this is free().
+     *
+     * @param ptr the memory to release, may be NULL
+     */
+    void plist_mem_free(void *ptr);
+
     /**
      * Get a node from its path. Each path element depends on the associated father node type.
      * For Dictionaries, var args are casted to const char*, for arrays, var args are caster to uint32_t
@@ -655,6 +2359,75 @@ extern "C"
      */
     plist_t plist_access_pathv(plist_t plist, uint32_t length, va_list v);
 
+    /**
+     * Compile a path query that can be evaluated against many trees.
+     * Path elements are separated by '/'. An element of digits is an index
+     * into an array or a key of a dictionary, "*" matches every item of an
+     * array or dictionary and any other element is a dictionary key. A
+     * backslash makes the next character part of a key, so "\\*" is the
+     * key "*" and "a\\/b" the key "a/b". The empty path matches the node
+     * it is evaluated on. Keys are hashed once, here.
+     *
+     * @param path the path, e.g. "Applications/0/CFBundleIdentifier"
+     * @return the compiled path, free it with #plist_path_free, or NULL on
+     *         error
+     */
+    plist_path_t plist_path_compile(const char *path);
+
+    /**
+     * Free a path returned by #plist_path_compile.
+     *
+     * @param path the path to free
+     */
+    void plist_path_free(plist_path_t path);
+
+    /**
+     * Get the first node matching a compiled path.
+     *
+     * @param path the compiled path
+     * @param node the node to evaluate the path on
+     * @return the first match in document order, or NULL if nothing matches
+     */
+    plist_t plist_path_get(plist_path_t path, plist_t node);
+
+    /**
+     * Report all nodes matching a compiled path in document order.
+     *
+     * @param path the compiled path
+     * @param node the node to evaluate the path on
+     * @param func called for each match, stops the search by returning
+     *        non-zero
+     * @param user_data passed to func
+     * @return the number of matches reported
+     */
+    int plist_path_foreach(plist_path_t path, plist_t node, plist_path_func_t func, void *user_data);
+
+    /**
+     * Get the first object of a binary plist matching a compiled path,
+     * without building a tree.
+     *
+     * @param path the compiled path
+     * @param reader a reader returned by #plist_bin_reader_open
+     * @param obj the object to evaluate the path on, e.g. #plist_bin_reader_root
+     * @param match a location to store the index of the matching object
+     * @return 0 on success, -1 if nothing matches or on error
+     */
+    int plist_path_get_bin(plist_path_t path, plist_bin_reader_t reader, uint64_t obj, uint64_t *match);
+
+    /**
+     * Report all objects of a binary plist matching a compiled path in
+     * document order, without building a tree.
+     *
+     * @param path the compiled path
+     * @param reader a reader returned by #plist_bin_reader_open
+     * @param obj the object to evaluate the path on
+     * @param func called for each match, stops the search by returning
+     *        non-zero
+     * @param user_data passed to func
+     * @return the number of matches reported
+     */
+    int plist_path_foreach_bin(plist_path_t path, plist_bin_reader_t reader, uint64_t obj, plist_path_bin_func_t func, void *user_data);
+
     /**
      * Compare two node values
      *
@@ -664,6 +2437,79 @@ extern "C"
      */
     char plist_compare_node_value(plist_t node_l, plist_t node_r);
 
+    /**
+     * Compare two nodes and everything below them. Dictionaries are equal
+     * if they have the same keys with equal values, regardless of the
+     * order of their entries. Containers with different hashes from
+     * #plist_hash are told apart without walking them.
+     *
+     * @param node_l left node to compare
+     * @param node_r right node to compare
+     * @return TRUE if both trees have the same types and values, FALSE otherwise.
+     */
+    char plist_equal_deep(plist_t node_l, plist_t node_r);
+
+    /**
+     * Compute a 64 bit hash of the contents of a node and everything below
+     * it. Trees that are equal according to #plist_equal_deep have the
+     * same hash. The hash does not depend on addresses or on how the tree
+     * was created, so it stays the same between runs on machines with the
+     * same byte order.
+     *
+     * The hashes of arrays and dictionaries are cached in the tree until
+     * they or anything below them change, so hashing a tree again after
+     * a few changes only rehashes the containers on the way to them. As it
+     * stores the hashes, this needs exclusive access to the tree like
+     * changing it does.
+     *
+     * @param plist the node to hash
+     * @return the hash, 0 for NULL
+     */
+    uint64_t plist_hash(plist_t plist);
+
+    /**
+     * Compute the changes that turn one tree into another, as a patch
+     * that #plist_patch applies. The patch is a #PLIST_ARRAY of operations,
+     * each a #PLIST_DICT with these entries:
+     *
+     * - "op": "set" to add or replace the value at path, "insert" to insert
+     *   it into an array before the item at path, or "remove" to remove
+     *   the item at path
+     * - "path": a #PLIST_ARRAY of #PLIST_STRING dictionary keys and
+     *   #PLIST_UINT array indexes leading to the item, empty for the root
+     * - "value": the new value for "set" and "insert"
+     *
+     * The trees are hashed with #plist_hash first. Subtrees with different
+     * hashes are diffed further, subtrees with the same hash are only
+     * checked with #plist_equal_deep, so a diff of two hashed trees only
+     * walks the parts that changed in detail. Array items are matched in
+     * order, looking a few items ahead for inserted and removed ones, so
+     * inserting or removing single items gives a short patch.
+     * As this caches the hashes in both trees, it needs exclusive access
+     * to them.
+     *
+     * @param old_node the original tree
+     * @param new_node the changed tree
+     * @return a new #PLIST_ARRAY with the operations, empty if the trees
+     *         are equal, or NULL if one of the trees is NULL. The caller
+     *         is responsible for freeing it.
+     */
+    plist_t plist_diff(plist_t old_node, plist_t new_node);
+
+    /**
+     * Apply a patch made by #plist_diff to a tree, in place. Applied to
+     * a tree equal to the original tree of the diff, the result is equal
+     * to the changed tree.
+     *
+     * @param target pointer to the tree to patch. A patch that replaces
+     *        the whole tree frees it and stores the new tree in target.
+     * @param patch the patch
+     * @return 0 on success, -1 if the patch is malformed or does not fit
+     *         the tree. The operations before the failing one remain
+     *         applied.
+     */
+    int plist_patch(plist_t *target, plist_t patch);
+
     #define _PLIST_IS_TYPE(__plist, __plist_type) (__plist && (plist_get_node_type(__plist) == PLIST_##__plist_type))
 
     /* Helper macros for the different plist types */
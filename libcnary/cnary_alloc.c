@@ -0,0 +1,50 @@
+/*
+ * cnary_alloc.c
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <stdlib.h>
+
+#include "cnary_alloc.h"
+
+static void *(*cnary_malloc_fn)(size_t size, void *ctx) = NULL;
+static void (*cnary_free_fn)(void *ptr, void *ctx) = NULL;
+static void *cnary_alloc_ctx = NULL;
+
+void cnary_set_allocator(void *(*malloc_fn)(size_t size, void *ctx), void (*free_fn)(void *ptr, void *ctx), void *ctx)
+{
+	cnary_malloc_fn = malloc_fn;
+	cnary_free_fn = free_fn;
+	cnary_alloc_ctx = ctx;
+}
+
+void *cnary_malloc(size_t size)
+{
+	if (cnary_malloc_fn) {
+		return cnary_malloc_fn(size, cnary_alloc_ctx);
+	}
+	return malloc(size);
+}
+
+void cnary_free(void *ptr)
+{
+	if (cnary_free_fn) {
+		if (ptr) {
+			cnary_free_fn(ptr, cnary_alloc_ctx);
+		}
+		return;
+	}
+	free(ptr);
+}
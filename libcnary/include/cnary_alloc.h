@@ -0,0 +1,31 @@
+/*
+ * cnary_alloc.h
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef CNARY_ALLOC_H_
+#define CNARY_ALLOC_H_
+
+#include <stddef.h>
+
+/* Routes the allocations of libcnary through malloc_fn and free_fn, which
+ * get ctx as last argument. NULL functions restore malloc and free. */
+void cnary_set_allocator(void *(*malloc_fn)(size_t size, void *ctx), void (*free_fn)(void *ptr, void *ctx), void *ctx);
+
+void *cnary_malloc(size_t size);
+void cnary_free(void *ptr);
+
+#endif /* CNARY_ALLOC_H_ */
@@ -24,6 +24,8 @@
 #ifndef NODE_H_
 #define NODE_H_
 
+#include <stddef.h>
+
 #include "object.h"
 
 #define NODE_TYPE 1;
@@ -35,7 +37,7 @@ typedef struct node_t {
 	// Super class
 	struct node_t* next;
 	struct node_t* prev;
-	unsigned int count;
+	size_t count;
 
 	// Local Properties
 	int isRoot;
@@ -53,18 +55,50 @@ typedef struct node_t {
 
 } node_t;
 
+#include "node_list.h"
+
+// Iterates over the children of node without allocating an iterator,
+// the loop body must not detach ch from node
+#define node_foreach_child(node, ch) \
+	for ((ch) = ((node)->children) ? (node)->children->begin : NULL; (ch); (ch) = (ch)->next)
+
 void node_destroy(struct node_t* node);
 struct node_t* node_create(struct node_t* parent, void* data);
+void node_init(struct node_t* node, struct node_list_t* children, void* data);
 
 int node_attach(struct node_t* parent, struct node_t* child);
 int node_detach(struct node_t* parent, struct node_t* child);
-int node_insert(struct node_t* parent, unsigned int index, struct node_t* child);
+int node_insert(struct node_t* parent, size_t index, struct node_t* child);
+
+// Like node_detach, but in constant time as the position of child is not
+// determined. Returns 0 on success, -1 if child is not a child of parent.
+int node_unlink(struct node_t* parent, struct node_t* child);
+// Inserts child after prev, or as the first child if prev is NULL
+int node_insert_after(struct node_t* parent, struct node_t* prev, struct node_t* child);
+
+size_t node_n_children(struct node_t* node);
+node_t* node_nth_child(struct node_t* node, size_t n);
+
+static inline node_t* node_first_child(struct node_t* node)
+{
+	if (!node || !node->children) return NULL;
+	return node->children->begin;
+}
+
+static inline node_t* node_prev_sibling(struct node_t* node)
+{
+	if (!node) return NULL;
+	// the first child points back to the child list of its parent
+	if (node->parent && node->prev == (node_t*)node->parent->children) return NULL;
+	return node->prev;
+}
+
+static inline node_t* node_next_sibling(struct node_t* node)
+{
+	if (!node) return NULL;
+	return node->next;
+}
 
-unsigned int node_n_children(struct node_t* node);
-node_t* node_nth_child(struct node_t* node, unsigned int n);
-node_t* node_first_child(struct node_t* node);
-node_t* node_prev_sibling(struct node_t* node);
-node_t* node_next_sibling(struct node_t* node);
 int node_child_position(struct node_t* parent, node_t* child);
 
 typedef void* (*copy_func_t)(const void *src);
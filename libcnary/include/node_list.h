@@ -24,6 +24,8 @@
 #ifndef NODE_LIST_H_
 #define NODE_LIST_H_
 
+#include <stddef.h>
+
 struct node_t;
 
 // This class implements the list_t abstract class
@@ -33,7 +35,7 @@ typedef struct node_list_t {
 	struct node_t* end;
 
 	// node_list_t members
-	unsigned int count;
+	size_t count;
 
 } node_list_t;
 
@@ -41,7 +43,10 @@ void node_list_destroy(struct node_list_t* list);
 struct node_list_t* node_list_create();
 
 int node_list_add(node_list_t* list, node_t* node);
-int node_list_insert(node_list_t* list, unsigned int index, node_t* node);
+int node_list_insert(node_list_t* list, size_t index, node_t* node);
+int node_list_insert_after(node_list_t* list, node_t* prev, node_t* node);
 int node_list_remove(node_list_t* list, node_t* node);
+// Removes node without looking up its position, node must be in list
+int node_list_unlink(node_list_t* list, node_t* node);
 
 #endif /* NODE_LIST_H_ */
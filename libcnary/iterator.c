@@ -28,15 +28,16 @@
 #include "list.h"
 #include "object.h"
 #include "iterator.h"
+#include "cnary_alloc.h"
 
 void iterator_destroy(iterator_t* iterator) {
 	if(iterator) {
-		free(iterator);
+		cnary_free(iterator);
 	}
 }
 
 iterator_t* iterator_create(list_t* list) {
-	iterator_t* iterator = (iterator_t*) malloc(sizeof(iterator_t));
+	iterator_t* iterator = (iterator_t*) cnary_malloc(sizeof(iterator_t));
 	if(iterator == NULL) {
 		return NULL;
 	}
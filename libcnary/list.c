@@ -25,6 +25,7 @@
 #include <stdlib.h>
 
 #include "list.h"
+#include "cnary_alloc.h"
 
 void list_init(list_t* list) {
 	list->next = NULL;
@@ -34,7 +35,7 @@ void list_init(list_t* list) {
 
 void list_destroy(list_t* list) {
 	if(list) {
-		free(list);
+		cnary_free(list);
 	}
 }
 
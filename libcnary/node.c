@@ -24,30 +24,37 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "list.h"
 #include "node.h"
 #include "node_list.h"
-#include "node_iterator.h"
+#include "cnary_alloc.h"
 
 void node_destroy(node_t* node) {
+	node_t* root = node;
+	node_t* parent = NULL;
 	if(!node) return;
 
-	if (node->children && node->children->count > 0) {
-		node_t* ch;
-		while ((ch = node->children->begin)) {
-			node_list_remove(node->children, ch);
-			node_destroy(ch);
+	// Destroy the subtree bottom up, following the parent pointers
+	while (node) {
+		if (node->children && node->children->begin) {
+			node = node->children->begin;
+			continue;
 		}
+		parent = (node == root) ? NULL : node->parent;
+		if (parent) {
+			node_list_remove(parent->children, node);
+		}
+		node_list_destroy(node->children);
+		node->children = NULL;
+		cnary_free(node);
+		node = parent;
 	}
-	node_list_destroy(node->children);
-	node->children = NULL;
-
-	free(node);
 }
 
 node_t* node_create(node_t* parent, void* data) {
 	int error = 0;
 
-	node_t* node = (node_t*) malloc(sizeof(node_t));
+	node_t* node = (node_t*) cnary_malloc(sizeof(node_t));
 	if(node == NULL) {
 		return NULL;
 	}
@@ -61,7 +68,8 @@ node_t* node_create(node_t* parent, void* data) {
 	node->isLeaf = TRUE;
 	node->isRoot = TRUE;
 	node->parent = NULL;
-	node->children = node_list_create();
+	// The child list is created on first attach, leaves never need one
+	node->children = NULL;
 
 	// Pass NULL to create a root node
 	if(parent != NULL) {
@@ -78,8 +86,29 @@ node_t* node_create(node_t* parent, void* data) {
 	return node;
 }
 
+void node_init(node_t* node, node_list_t* children, void* data) {
+	// Set up a node in caller provided storage, e.g. from an arena.
+	// Such a node must not be passed to node_destroy().
+	memset(node, '\0', sizeof(node_t));
+	memset(children, '\0', sizeof(node_list_t));
+	list_init((list_t*) children);
+
+	node->data = data;
+	node->isLeaf = TRUE;
+	node->isRoot = TRUE;
+	node->children = children;
+}
+
+static node_list_t* node_get_children(node_t* node) {
+	if (!node->children) {
+		node->children = node_list_create();
+	}
+	return node->children;
+}
+
 int node_attach(node_t* parent, node_t* child) {
 	if (!parent || !child) return -1;
+	if (!node_get_children(parent)) return -1;
 	child->isLeaf = TRUE;
 	child->isRoot = FALSE;
 	child->parent = parent;
@@ -95,17 +124,46 @@ int node_attach(node_t* parent, node_t* child) {
 }
 
 int node_detach(node_t* parent, node_t* child) {
-	if (!parent || !child) return -1;
+	if (!parent || !child || !parent->children) return -1;
 	int node_index = node_list_remove(parent->children, child);
 	if (node_index >= 0) {
 		parent->count--;
+		child->parent = NULL;
 	}
 	return node_index;
 }
 
-int node_insert(node_t* parent, unsigned int node_index, node_t* child)
+int node_unlink(node_t* parent, node_t* child) {
+	if (!parent || !child || !parent->children || child->parent != parent) return -1;
+	if (node_list_unlink(parent->children, child) < 0) return -1;
+	parent->count--;
+	child->parent = NULL;
+	return 0;
+}
+
+int node_insert_after(node_t* parent, node_t* prev, node_t* child)
 {
 	if (!parent || !child) return -1;
+	if (prev && prev->parent != parent) return -1;
+	if (!node_get_children(parent)) return -1;
+	child->isLeaf = TRUE;
+	child->isRoot = FALSE;
+	child->parent = parent;
+	child->depth = parent->depth + 1;
+	if(parent->isLeaf == TRUE) {
+		parent->isLeaf = FALSE;
+	}
+	int res = node_list_insert_after(parent->children, prev, child);
+	if (res == 0) {
+		parent->count++;
+	}
+	return res;
+}
+
+int node_insert(node_t* parent, size_t node_index, node_t* child)
+{
+	if (!parent || !child) return -1;
+	if (!node_get_children(parent)) return -1;
 	child->isLeaf = TRUE;
 	child->isRoot = FALSE;
 	child->parent = parent;
@@ -123,7 +181,6 @@ int node_insert(node_t* parent, unsigned int node_index, node_t* child)
 void node_debug(node_t* node) {
 	unsigned int i = 0;
 	node_t* current = NULL;
-	node_iterator_t* iter = NULL;
 	for(i = 0; i < node->depth; i++) {
 		printf("\t");
 	}
@@ -138,27 +195,26 @@ void node_debug(node_t* node) {
 		if(!node->isRoot) {
 			printf("NODE\n");
 		}
-		iter = node_iterator_create(node->children);
-		for(current = iter->begin; current != NULL; current = iter->next(iter)) {
+		node_foreach_child(node, current) {
 			node_debug(current);
 		}
 	}
 
 }
 
-unsigned int node_n_children(struct node_t* node)
+size_t node_n_children(struct node_t* node)
 {
 	if (!node) return 0;
 	return node->count;
 }
 
-node_t* node_nth_child(struct node_t* node, unsigned int n)
+node_t* node_nth_child(struct node_t* node, size_t n)
 {
 	if (!node || !node->children || !node->children->begin) return NULL;
-	unsigned int node_index = 0;
+	size_t node_index = 0;
 	int found = 0;
 	node_t *ch;
-	for (ch = node_first_child(node); ch; ch = node_next_sibling(ch)) {
+	node_foreach_child(node, ch) {
 		if (node_index++ == n) {
 			found = 1;
 			break;
@@ -170,31 +226,13 @@ node_t* node_nth_child(struct node_t* node, unsigned int n)
 	return ch;
 }
 
-node_t* node_first_child(struct node_t* node)
-{
-	if (!node || !node->children) return NULL;
-	return node->children->begin;
-}
-
-node_t* node_prev_sibling(struct node_t* node)
-{
-	if (!node) return NULL;
-	return node->prev;
-}
-
-node_t* node_next_sibling(struct node_t* node)
-{
-	if (!node) return NULL;
-	return node->next;
-}
-
 int node_child_position(struct node_t* parent, node_t* child)
 {
 	if (!parent || !parent->children || !parent->children->begin || !child) return -1;
 	int node_index = 0;
 	int found = 0;
 	node_t *ch;
-	for (ch = node_first_child(parent); ch; ch = node_next_sibling(ch)) {
+	node_foreach_child(parent, ch) {
 		if (ch == child) {
 			found = 1;
 			break;
@@ -216,7 +254,7 @@ node_t* node_copy_deep(node_t* node, copy_func_t copy_func)
 	}
 	node_t* copy = node_create(NULL, data);
 	node_t* ch;
-	for (ch = node_first_child(node); ch; ch = node_next_sibling(ch)) {
+	node_foreach_child(node, ch) {
 		node_t* cc = node_copy_deep(ch, copy_func);
 		node_attach(copy, cc);
 	}
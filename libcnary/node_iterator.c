@@ -28,15 +28,16 @@
 #include "node.h"
 #include "node_list.h"
 #include "node_iterator.h"
+#include "cnary_alloc.h"
 
 void node_iterator_destroy(node_iterator_t* iterator) {
 	if(iterator) {
-		free(iterator);
+		cnary_free(iterator);
 	}
 }
 
 node_iterator_t* node_iterator_create(node_list_t* list) {
-	node_iterator_t* iterator = (node_iterator_t*) malloc(sizeof(node_iterator_t));
+	node_iterator_t* iterator = (node_iterator_t*) cnary_malloc(sizeof(node_iterator_t));
 	if(iterator == NULL) {
 		return NULL;
 	}
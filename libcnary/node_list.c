@@ -28,6 +28,7 @@
 #include "list.h"
 #include "node.h"
 #include "node_list.h"
+#include "cnary_alloc.h"
 
 void node_list_destroy(node_list_t* list) {
 	if(list != NULL) {
@@ -36,7 +37,7 @@ void node_list_destroy(node_list_t* list) {
 }
 
 node_list_t* node_list_create() {
-	node_list_t* list = (node_list_t*) malloc(sizeof(node_list_t));
+	node_list_t* list = (node_list_t*) cnary_malloc(sizeof(node_list_t));
 	if(list == NULL) {
 		return NULL;
 	}
@@ -72,7 +73,7 @@ int node_list_add(node_list_t* list, node_t* node) {
 	return 0;
 }
 
-int node_list_insert(node_list_t* list, unsigned int node_index, node_t* node) {
+int node_list_insert(node_list_t* list, size_t node_index, node_t* node) {
 	if (!list || !node) return -1;
 	if (node_index >= list->count) {
 		return node_list_add(list, node);
@@ -81,7 +82,7 @@ int node_list_insert(node_list_t* list, unsigned int node_index, node_t* node) {
 	// Get the first element in the list
 	node_t* cur = list->begin;
 
-	unsigned int pos = 0;
+	size_t pos = 0;
 	node_t* prev = NULL;
 
 	if (node_index > 0) {
@@ -92,20 +93,20 @@ int node_list_insert(node_list_t* list, unsigned int node_index, node_t* node) {
 		}
 	}
 
-	if (prev) {
-		// Set previous node
-		node->prev = prev;
-		// Set next node of our new node to next node of the previous node
-		node->next = prev->next;
-		// Set next node of previous node to our new node
-		prev->next = node;
-	} else {
-		node->prev = NULL;
-		// get old first element in list
-		node->next = list->begin;
-		// set new node as first element in list
-		list->begin = node;
+	return node_list_insert_after(list, prev, node);
+}
+
+int node_list_insert_after(node_list_t* list, node_t* prev, node_t* node) {
+	if (!list || !node) return -1;
+
+	// The list itself acts as the element before the first one, its
+	// begin member overlays the next member of a node
+	if (!prev) {
+		prev = (node_t*) list;
 	}
+	node->prev = prev;
+	node->next = prev->next;
+	prev->next = node;
 
 	if (node->next == NULL) {
 		// Set the lists prev to the new last element
@@ -120,6 +121,24 @@ int node_list_insert(node_list_t* list, unsigned int node_index, node_t* node) {
 	return 0;
 }
 
+int node_list_unlink(node_list_t* list, node_t* node) {
+	if (!list || !node) return -1;
+	if (list->count == 0) return -1;
+
+	node_t* prev = node->prev ? node->prev : (node_t*) list;
+	prev->next = node->next;
+	if (node->next) {
+		node->next->prev = prev;
+	} else {
+		// last element in the list, or the list is empty now
+		list->end = prev;
+	}
+	node->next = NULL;
+	node->prev = NULL;
+	list->count--;
+	return 0;
+}
+
 int node_list_remove(node_list_t* list, node_t* node) {
 	if (!list || !node) return -1;
 	if (list->count == 0) return -1;
@@ -128,23 +147,7 @@ int node_list_remove(node_list_t* list, node_t* node) {
 	node_t* n;
 	for (n = list->begin; n; n = n->next) {
 		if (node == n) {
-			node_t* newnode = node->next;
-			if (node->prev) {
-				node->prev->next = newnode;
-				if (newnode) {
-					newnode->prev = node->prev;
-				} else {
-					// last element in the list
-					list->end = node->prev;
-				}
-			} else {
-				// we just removed the first element
-				if (newnode) {
-					newnode->prev = NULL;
-				}
-				list->begin = newnode;
-			}
-			list->count--;
+			node_list_unlink(list, node);
 			return node_index;
 		}
 		node_index++;
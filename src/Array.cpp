@@ -34,6 +34,12 @@ Array::Array(Node* parent) : Structure(PLIST_ARRAY, parent)
 Array::Array(plist_t node, Node* parent) : Structure(parent)
 {
     _node = node;
+    BuildArray();
+}
+
+/* creates the wrappers for the items of _node */
+void Array::BuildArray()
+{
     uint32_t size = plist_array_get_size(_node);
 
     for (uint32_t i = 0; i < size; i++)
@@ -47,13 +53,7 @@ Array::Array(const PList::Array& a) : Structure()
 {
     _array.clear();
     _node = plist_copy(a.GetPlist());
-    uint32_t size = plist_array_get_size(_node);
-
-    for (uint32_t i = 0; i < size; i++)
-    {
-        plist_t subnode = plist_array_get_item(_node, i);
-        _array.push_back(  Node::FromPlist(subnode, this) );
-    }
+    BuildArray();
 }
 
 Array& Array::operator=(PList::Array& a)
@@ -66,15 +66,48 @@ Array& Array::operator=(PList::Array& a)
     _array.clear();
 
     _node = plist_copy(a.GetPlist());
-    uint32_t size = plist_array_get_size(_node);
+    BuildArray();
+    return *this;
+}
 
-    for (uint32_t i = 0; i < size; i++)
+#if __cplusplus >= 201103L
+/* takes over the wrappers of a if its plist was taken, otherwise _node is
+ * a copy that needs new ones */
+void Array::MoveArray(PList::Array& a)
+{
+    if (a._node) {
+        BuildArray();
+        return;
+    }
+    _array.swap(a._array);
+    for (unsigned int it = 0; it < _array.size(); it++)
     {
-        plist_t subnode = plist_array_get_item(_node, i);
-        _array.push_back(  Node::FromPlist(subnode, this) );
+        AdoptNode(_array[it]);
+    }
+}
+
+Array::Array(PList::Array&& a) : Structure(std::move(a))
+{
+    MoveArray(a);
+}
+
+Array& Array::operator=(PList::Array&& a)
+{
+    if (this != &a) {
+        for (unsigned int it = 0; it < _array.size(); it++)
+        {
+            delete _array.at(it);
+        }
+        _array.clear();
+        if (!GetParent()) {
+            plist_free(_node);
+        }
+        _node = a.TakePlist();
+        MoveArray(a);
     }
     return *this;
 }
+#endif
 
 Array::~Array()
 {
@@ -119,6 +152,33 @@ void Array::Insert(Node* node, unsigned int pos)
     }
 }
 
+#if __cplusplus >= 201103L
+void Array::Append(std::unique_ptr<Node> node)
+{
+    if (node)
+    {
+        /* the node must not belong to a structure, there is no need to clone it */
+        Node* n = node.release();
+        AdoptNode(n);
+        plist_array_append_item(_node, n->GetPlist());
+        _array.push_back(n);
+    }
+}
+
+void Array::Insert(std::unique_ptr<Node> node, unsigned int pos)
+{
+    if (node)
+    {
+        Node* n = node.release();
+        AdoptNode(n);
+        plist_array_insert_item(_node, n->GetPlist(), pos);
+        std::vector<Node*>::iterator it = _array.begin();
+        it += pos;
+        _array.insert(it, n);
+    }
+}
+#endif
+
 void Array::Remove(Node* node)
 {
     if (node)
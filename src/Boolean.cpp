@@ -44,6 +44,21 @@ Boolean& Boolean::operator=(PList::Boolean& b)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+Boolean::Boolean(PList::Boolean&& b) : Node(std::move(b))
+{
+}
+
+Boolean& Boolean::operator=(PList::Boolean&& b)
+{
+    if (this != &b) {
+        plist_free(_node);
+        _node = b.TakePlist();
+    }
+    return *this;
+}
+#endif
+
 Boolean::Boolean(bool b) : Node(PLIST_BOOLEAN)
 {
     plist_set_bool_val(_node, b);
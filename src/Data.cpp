@@ -45,6 +45,21 @@ Data& Data::operator=(PList::Data& b)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+Data::Data(PList::Data&& d) : Node(std::move(d))
+{
+}
+
+Data& Data::operator=(PList::Data&& d)
+{
+    if (this != &d) {
+        plist_free(_node);
+        _node = d.TakePlist();
+    }
+    return *this;
+}
+#endif
+
 Data::Data(const std::vector<char>& buff) : Node(PLIST_DATA)
 {
     plist_set_data_val(_node, &buff[0], buff.size());
@@ -66,12 +81,17 @@ void Data::SetValue(const std::vector<char>& buff)
 
 std::vector<char> Data::GetValue() const
 {
-    char* buff = NULL;
     uint64_t length = 0;
-    plist_get_data_val(_node, &buff, &length);
-    std::vector<char> ret(buff, buff + length);
-    free(buff);
-    return ret;
+    const char* buff = plist_get_data_ptr(_node, &length);
+    if (!buff) {
+        return std::vector<char>();
+    }
+    return std::vector<char>(buff, buff + length);
+}
+
+const char* Data::GetValuePtr(uint64_t* length) const
+{
+    return plist_get_data_ptr(_node, length);
 }
 
 
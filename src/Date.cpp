@@ -45,6 +45,21 @@ Date& Date::operator=(PList::Date& d)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+Date::Date(PList::Date&& d) : Node(std::move(d))
+{
+}
+
+Date& Date::operator=(PList::Date&& d)
+{
+    if (this != &d) {
+        plist_free(_node);
+        _node = d.TakePlist();
+    }
+    return *this;
+}
+#endif
+
 Date::Date(timeval t) : Node(PLIST_DATE)
 {
     plist_set_date_val(_node, t.tv_sec, t.tv_usec);
@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <plist/Dictionary.h>
 
+#include <node.h>
+
 namespace PList
 {
 
@@ -31,22 +33,27 @@ Dictionary::Dictionary(Node* parent) : Structure(PLIST_DICT, parent)
 Dictionary::Dictionary(plist_t node, Node* parent) : Structure(parent)
 {
     _node = node;
+    BuildMap();
+}
+
+/* creates the wrappers for the items of _node */
+void Dictionary::BuildMap()
+{
     plist_dict_iter it = NULL;
 
-    char* key = NULL;
+    const char* key = NULL;
     plist_t subnode = NULL;
     plist_dict_new_iter(_node, &it);
-    plist_dict_next_item(_node, it, &key, &subnode);
+    plist_dict_next_item_ptr(_node, it, &key, &subnode);
     while (subnode)
     {
         _map[std::string(key)] = Node::FromPlist(subnode, this);
 
         subnode = NULL;
-        free(key);
         key = NULL;
-        plist_dict_next_item(_node, it, &key, &subnode);
+        plist_dict_next_item_ptr(_node, it, &key, &subnode);
     }
-    free(it);
+    plist_mem_free(it);
 }
 
 Dictionary::Dictionary(const PList::Dictionary& d) : Structure()
@@ -59,22 +66,7 @@ Dictionary::Dictionary(const PList::Dictionary& d) : Structure()
     _map.clear();
 
     _node = plist_copy(d.GetPlist());
-    plist_dict_iter it = NULL;
-
-    char* key = NULL;
-    plist_t subnode = NULL;
-    plist_dict_new_iter(_node, &it);
-    plist_dict_next_item(_node, it, &key, &subnode);
-    while (subnode)
-    {
-        _map[std::string(key)] = Node::FromPlist(subnode, this);
-
-        subnode = NULL;
-        free(key);
-        key = NULL;
-        plist_dict_next_item(_node, it, &key, &subnode);
-    }
-    free(it);
+    BuildMap();
 }
 
 Dictionary& Dictionary::operator=(PList::Dictionary& d)
@@ -87,24 +79,48 @@ Dictionary& Dictionary::operator=(PList::Dictionary& d)
     _map.clear();
 
     _node = plist_copy(d.GetPlist());
-    plist_dict_iter it = NULL;
+    BuildMap();
+    return *this;
+}
 
-    char* key = NULL;
-    plist_t subnode = NULL;
-    plist_dict_new_iter(_node, &it);
-    plist_dict_next_item(_node, it, &key, &subnode);
-    while (subnode)
+#if __cplusplus >= 201103L
+/* takes over the wrappers of d if its plist was taken, otherwise _node is
+ * a copy that needs new ones */
+void Dictionary::MoveMap(PList::Dictionary& d)
+{
+    if (d._node) {
+        BuildMap();
+        return;
+    }
+    _map.swap(d._map);
+    for (Dictionary::iterator it = _map.begin(); it != _map.end(); it++)
     {
-        _map[std::string(key)] = Node::FromPlist(subnode, this);
+        AdoptNode(it->second);
+    }
+}
 
-        subnode = NULL;
-        free(key);
-        key = NULL;
-        plist_dict_next_item(_node, it, NULL, &subnode);
+Dictionary::Dictionary(PList::Dictionary&& d) : Structure(std::move(d))
+{
+    MoveMap(d);
+}
+
+Dictionary& Dictionary::operator=(PList::Dictionary&& d)
+{
+    if (this != &d) {
+        for (Dictionary::iterator it = _map.begin(); it != _map.end(); it++)
+        {
+            delete it->second;
+        }
+        _map.clear();
+        if (!GetParent()) {
+            plist_free(_node);
+        }
+        _node = d.TakePlist();
+        MoveMap(d);
     }
-    free(it);
     return *this;
 }
+#endif
 
 Dictionary::~Dictionary()
 {
@@ -140,6 +156,19 @@ Dictionary::iterator Dictionary::Find(const std::string& key)
     return _map.find(key);
 }
 
+/* puts node into _map with a single lookup, replacing an existing wrapper */
+Dictionary::iterator Dictionary::StoreNode(const std::string& key, Node* node)
+{
+    iterator it = _map.lower_bound(key);
+    if (it != _map.end() && it->first == key)
+    {
+        delete it->second;
+        it->second = node;
+        return it;
+    }
+    return _map.insert(it, std::make_pair(key, node));
+}
+
 Dictionary::iterator Dictionary::Set(const std::string& key, const Node* node)
 {
     if (node)
@@ -147,9 +176,7 @@ Dictionary::iterator Dictionary::Set(const std::string& key, const Node* node)
         Node* clone = node->Clone();
         UpdateNodeParent(clone);
         plist_dict_set_item(_node, key.c_str(), clone->GetPlist());
-        delete _map[key];
-        _map[key] = clone;
-        return _map.find(key);
+        return StoreNode(key, clone);
     }
     return iterator(this->_map.end());
 }
@@ -159,21 +186,49 @@ Dictionary::iterator Dictionary::Set(const std::string& key, const Node& node)
     return Set(key, &node);
 }
 
+#if __cplusplus >= 201103L
+Dictionary::iterator Dictionary::Set(const std::string& key, std::unique_ptr<Node> node)
+{
+    if (node)
+    {
+        /* the node must not belong to a structure, there is no need to clone it */
+        Node* n = node.release();
+        AdoptNode(n);
+        plist_dict_set_item(_node, key.c_str(), n->GetPlist());
+        return StoreNode(key, n);
+    }
+    return iterator(this->_map.end());
+}
+#endif
+
 Dictionary::iterator Dictionary::Insert(const std::string& key, Node* node)
 {
     return this->Set(key, node);
 }
 
+/* returns the key of an item of this dictionary without copying it, the
+ * key node is the sibling right before the value in the plist */
+static const char* dict_item_key(plist_t dict, Node* node, uint64_t* length)
+{
+    if (!node || plist_get_parent(node->GetPlist()) != dict)
+    {
+        return NULL;
+    }
+    return plist_get_key_ptr((plist_t)node_prev_sibling((node_t*)node->GetPlist()), length);
+}
+
 void Dictionary::Remove(Node* node)
 {
-    if (node)
+    uint64_t length = 0;
+    const char* key = dict_item_key(_node, node, &length);
+    if (key)
     {
-        char* key = NULL;
-        plist_dict_get_item_key(node->GetPlist(), &key);
+        iterator it = _map.find(std::string(key, length));
         plist_dict_remove_item(_node, key);
-        std::string skey = key;
-        free(key);
-        _map.erase(skey);
+        if (it != _map.end())
+        {
+            _map.erase(it);
+        }
         delete node;
     }
 }
@@ -181,18 +236,19 @@ void Dictionary::Remove(Node* node)
 void Dictionary::Remove(const std::string& key)
 {
     plist_dict_remove_item(_node, key.c_str());
-    delete _map[key];
-    _map.erase(key);
+    iterator it = _map.find(key);
+    if (it != _map.end())
+    {
+        delete it->second;
+        _map.erase(it);
+    }
 }
 
 std::string Dictionary::GetNodeKey(Node* node)
 {
-    for (iterator it = _map.begin(); it != _map.end(); ++it)
-    {
-        if (it->second == node)
-            return it->first;
-    }
-    return "";
+    uint64_t length = 0;
+    const char* key = dict_item_key(_node, node, &length);
+    return key ? std::string(key, length) : std::string();
 }
 
 };
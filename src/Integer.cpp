@@ -44,6 +44,21 @@ Integer& Integer::operator=(PList::Integer& i)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+Integer::Integer(PList::Integer&& i) : Node(std::move(i))
+{
+}
+
+Integer& Integer::operator=(PList::Integer&& i)
+{
+    if (this != &i) {
+        plist_free(_node);
+        _node = i.TakePlist();
+    }
+    return *this;
+}
+#endif
+
 Integer::Integer(uint64_t i) : Node(PLIST_UINT)
 {
     plist_set_uint_val(_node, i);
@@ -44,6 +44,21 @@ Key& Key::operator=(PList::Key& k)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+Key::Key(PList::Key&& k) : Node(std::move(k))
+{
+}
+
+Key& Key::operator=(PList::Key&& k)
+{
+    if (this != &k) {
+        plist_free(_node);
+        _node = k.TakePlist();
+    }
+    return *this;
+}
+#endif
+
 Key::Key(const std::string& s) : Node(PLIST_STRING)
 {
     plist_set_key_val(_node, s.c_str());
@@ -65,16 +80,17 @@ void Key::SetValue(const std::string& s)
 
 std::string Key::GetValue() const
 {
-    char* s = NULL;
-    plist_get_key_val(_node, &s);
-    std::string ret;
-    if (s) {
-        ret = s;
-        free(s);
-    } else {
-        ret = "";
+    uint64_t length = 0;
+    const char* s = plist_get_key_ptr(_node, &length);
+    if (!s) {
+        return std::string();
     }
-    return ret;
+    return std::string(s, length);
+}
+
+const char* Key::GetValuePtr(uint64_t* length) const
+{
+    return plist_get_key_ptr(_node, length);
 }
 
 };
@@ -86,6 +86,24 @@ Node::Node(plist_type type, Node* parent) : _parent(parent)
     }
 }
 
+#if __cplusplus >= 201103L
+Node::Node(Node&& node) : _node(node.TakePlist()), _parent(NULL)
+{
+}
+
+/* Returns the plist of this node and leaves it empty. A node that is part
+ * of a structure is copied instead, since the structure still owns it. */
+plist_t Node::TakePlist()
+{
+    plist_t ret = _node;
+    if (_parent) {
+        return plist_copy(_node);
+    }
+    _node = NULL;
+    return ret;
+}
+#endif
+
 Node::~Node()
 {
 	/* If the Node is in a container, let _node be cleaned up by
@@ -44,6 +44,21 @@ Real& Real::operator=(PList::Real& d)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+Real::Real(PList::Real&& d) : Node(std::move(d))
+{
+}
+
+Real& Real::operator=(PList::Real&& d)
+{
+    if (this != &d) {
+        plist_free(_node);
+        _node = d.TakePlist();
+    }
+    return *this;
+}
+#endif
+
 Real::Real(double d) : Node(PLIST_REAL)
 {
     plist_set_real_val(_node, d);
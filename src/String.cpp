@@ -44,6 +44,21 @@ String& String::operator=(PList::String& s)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+String::String(PList::String&& s) : Node(std::move(s))
+{
+}
+
+String& String::operator=(PList::String&& s)
+{
+    if (this != &s) {
+        plist_free(_node);
+        _node = s.TakePlist();
+    }
+    return *this;
+}
+#endif
+
 String::String(const std::string& s) : Node(PLIST_STRING)
 {
     plist_set_string_val(_node, s.c_str());
@@ -65,16 +80,17 @@ void String::SetValue(const std::string& s)
 
 std::string String::GetValue() const
 {
-    char* s = NULL;
-    plist_get_string_val(_node, &s);
-    std::string ret;
-    if (s) {
-        ret = s;
-        free(s);
-    } else {
-        ret = "";
+    uint64_t length = 0;
+    const char* s = plist_get_string_ptr(_node, &length);
+    if (!s) {
+        return std::string();
     }
-    return ret;
+    return std::string(s, length);
+}
+
+const char* String::GetValuePtr(uint64_t* length) const
+{
+    return plist_get_string_ptr(_node, length);
 }
 
 };
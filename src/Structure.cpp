@@ -31,6 +31,12 @@ Structure::Structure(plist_type type, Node* parent) : Node(type, parent)
 {
 }
 
+#if __cplusplus >= 201103L
+Structure::Structure(Structure&& s) : Node(std::move(s))
+{
+}
+#endif
+
 Structure::~Structure()
 {
 }
@@ -53,20 +59,20 @@ uint32_t Structure::GetSize() const
 std::string Structure::ToXml() const
 {
     char* xml = NULL;
-    uint32_t length = 0;
-    plist_to_xml(_node, &xml, &length);
+    uint64_t length = 0;
+    plist_to_xml64(_node, PLIST_XML_DEFAULT, &xml, &length);
     std::string ret(xml, xml+length);
-    free(xml);
+    plist_mem_free(xml);
     return ret;
 }
 
 std::vector<char> Structure::ToBin() const
 {
     char* bin = NULL;
-    uint32_t length = 0;
-    plist_to_bin(_node, &bin, &length);
+    uint64_t length = 0;
+    plist_to_bin64(_node, PLIST_WRITE_DEFAULT, &bin, &length);
     std::vector<char> ret(bin, bin+length);
-    free(bin);
+    plist_mem_free(bin);
     return ret;
 }
 
@@ -85,6 +91,12 @@ void Structure::UpdateNodeParent(Node* node)
     node->_parent = this;
 }
 
+/* makes this the parent of a node that doesn't belong to a structure */
+void Structure::AdoptNode(Node* node)
+{
+    node->_parent = this;
+}
+
 static Structure* ImportStruct(plist_t root)
 {
     Structure* ret = NULL;
@@ -105,7 +117,7 @@ static Structure* ImportStruct(plist_t root)
 Structure* Structure::FromXml(const std::string& xml)
 {
     plist_t root = NULL;
-    plist_from_xml(xml.c_str(), xml.size(), &root);
+    plist_from_xml64(xml.c_str(), xml.size(), &root);
 
     return ImportStruct(root);
 }
@@ -113,7 +125,7 @@ Structure* Structure::FromXml(const std::string& xml)
 Structure* Structure::FromBin(const std::vector<char>& bin)
 {
     plist_t root = NULL;
-    plist_from_bin(&bin[0], bin.size(), &root);
+    plist_from_bin64(&bin[0], bin.size(), PLIST_PARSE_DEFAULT, &root);
 
     return ImportStruct(root);
 
@@ -44,6 +44,21 @@ Uid& Uid::operator=(PList::Uid& i)
     return *this;
 }
 
+#if __cplusplus >= 201103L
+Uid::Uid(PList::Uid&& i) : Node(std::move(i))
+{
+}
+
+Uid& Uid::operator=(PList::Uid&& i)
+{
+    if (this != &i) {
+        plist_free(_node);
+        _node = i.TakePlist();
+    }
+    return *this;
+}
+#endif
+
 Uid::Uid(uint64_t i) : Node(PLIST_UID)
 {
     plist_set_uid_val(_node, i);
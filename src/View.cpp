@@ -0,0 +1,322 @@
+/*
+ * View.cpp
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdlib.h>
+#include <plist/View.h>
+
+#include <node.h>
+
+namespace PList
+{
+
+View::View(plist_t node) : _node(node)
+{
+}
+
+View::View(const PList::Node& node) : _node(node.GetPlist())
+{
+}
+
+bool View::IsValid() const
+{
+    return _node != NULL;
+}
+
+plist_t View::GetPlist() const
+{
+    return _node;
+}
+
+plist_type View::GetType() const
+{
+    if (_node)
+    {
+        return plist_get_node_type(_node);
+    }
+    return PLIST_NONE;
+}
+
+View View::GetParent() const
+{
+    return View(_node ? plist_get_parent(_node) : NULL);
+}
+
+bool View::GetBool() const
+{
+    uint8_t b = 0;
+    if (GetType() == PLIST_BOOLEAN)
+    {
+        plist_get_bool_val(_node, &b);
+    }
+    return b != 0;
+}
+
+uint64_t View::GetUInt() const
+{
+    uint64_t i = 0;
+    if (GetType() == PLIST_UINT)
+    {
+        plist_get_uint_val(_node, &i);
+    }
+    return i;
+}
+
+double View::GetReal() const
+{
+    double d = 0.;
+    if (GetType() == PLIST_REAL)
+    {
+        plist_get_real_val(_node, &d);
+    }
+    return d;
+}
+
+timeval View::GetDate() const
+{
+    int32_t tv_sec = 0;
+    int32_t tv_usec = 0;
+    if (GetType() == PLIST_DATE)
+    {
+        plist_get_date_val(_node, &tv_sec, &tv_usec);
+    }
+    timeval t = {tv_sec, tv_usec};
+    return t;
+}
+
+uint64_t View::GetUid() const
+{
+    uint64_t i = 0;
+    if (GetType() == PLIST_UID)
+    {
+        plist_get_uid_val(_node, &i);
+    }
+    return i;
+}
+
+std::string View::GetString() const
+{
+    uint64_t length = 0;
+    const char* s = GetStringPtr(&length);
+    return s ? std::string(s, length) : std::string();
+}
+
+const char* View::GetStringPtr(uint64_t* length) const
+{
+    return plist_get_string_ptr(_node, length);
+}
+
+std::string View::GetKey() const
+{
+    uint64_t length = 0;
+    const char* s = GetKeyPtr(&length);
+    return s ? std::string(s, length) : std::string();
+}
+
+const char* View::GetKeyPtr(uint64_t* length) const
+{
+    return plist_get_key_ptr(_node, length);
+}
+
+std::vector<char> View::GetData() const
+{
+    uint64_t length = 0;
+    const char* data = GetDataPtr(&length);
+    if (!data)
+    {
+        return std::vector<char>();
+    }
+    return std::vector<char>(data, data + length);
+}
+
+const char* View::GetDataPtr(uint64_t* length) const
+{
+    return plist_get_data_ptr(_node, length);
+}
+
+DictView View::AsDict() const
+{
+    return DictView(_node);
+}
+
+ArrayView View::AsArray() const
+{
+    return ArrayView(_node);
+}
+
+Node* View::Clone() const
+{
+    if (!_node)
+    {
+        return NULL;
+    }
+    return Node::FromPlist(plist_copy(_node));
+}
+
+ArrayView::iterator::iterator(plist_t item) : _item(item)
+{
+}
+
+View ArrayView::iterator::operator*() const
+{
+    return View(_item);
+}
+
+ArrayView::iterator& ArrayView::iterator::operator++()
+{
+    _item = (plist_t)node_next_sibling((node_t*)_item);
+    return *this;
+}
+
+bool ArrayView::iterator::operator==(const ArrayView::iterator& it) const
+{
+    return _item == it._item;
+}
+
+bool ArrayView::iterator::operator!=(const ArrayView::iterator& it) const
+{
+    return _item != it._item;
+}
+
+ArrayView::ArrayView(plist_t node) : View(NULL)
+{
+    if (node && plist_get_node_type(node) == PLIST_ARRAY)
+    {
+        _node = node;
+    }
+}
+
+uint32_t ArrayView::GetSize() const
+{
+    return _node ? plist_array_get_size(_node) : 0;
+}
+
+View ArrayView::operator[](unsigned int index) const
+{
+    return View(_node ? plist_array_get_item(_node, index) : NULL);
+}
+
+ArrayView::iterator ArrayView::Begin() const
+{
+    /* getting the size loads the children of a lazily parsed array */
+    if (GetSize() == 0)
+    {
+        return End();
+    }
+    return iterator((plist_t)node_first_child((node_t*)_node));
+}
+
+ArrayView::iterator ArrayView::End() const
+{
+    return iterator(NULL);
+}
+
+ArrayView::iterator ArrayView::begin() const
+{
+    return Begin();
+}
+
+ArrayView::iterator ArrayView::end() const
+{
+    return End();
+}
+
+DictView::iterator::iterator(plist_t key) : _key(key)
+{
+}
+
+const char* DictView::iterator::GetKey(uint64_t* length) const
+{
+    return plist_get_key_ptr(_key, length);
+}
+
+View DictView::iterator::GetValue() const
+{
+    return View((plist_t)node_next_sibling((node_t*)_key));
+}
+
+const DictView::iterator& DictView::iterator::operator*() const
+{
+    return *this;
+}
+
+DictView::iterator& DictView::iterator::operator++()
+{
+    node_t* value = node_next_sibling((node_t*)_key);
+    _key = (plist_t)node_next_sibling(value);
+    return *this;
+}
+
+bool DictView::iterator::operator==(const DictView::iterator& it) const
+{
+    return _key == it._key;
+}
+
+bool DictView::iterator::operator!=(const DictView::iterator& it) const
+{
+    return _key != it._key;
+}
+
+DictView::DictView(plist_t node) : View(NULL)
+{
+    if (node && plist_get_node_type(node) == PLIST_DICT)
+    {
+        _node = node;
+    }
+}
+
+uint32_t DictView::GetSize() const
+{
+    return _node ? plist_dict_get_size(_node) : 0;
+}
+
+View DictView::operator[](const std::string& key) const
+{
+    return (*this)[key.c_str()];
+}
+
+View DictView::operator[](const char* key) const
+{
+    return View(_node ? plist_dict_get_item(_node, key) : NULL);
+}
+
+DictView::iterator DictView::Begin() const
+{
+    /* getting the size loads the children of a lazily parsed dict */
+    if (GetSize() == 0)
+    {
+        return End();
+    }
+    return iterator((plist_t)node_first_child((node_t*)_node));
+}
+
+DictView::iterator DictView::End() const
+{
+    return iterator(NULL);
+}
+
+DictView::iterator DictView::begin() const
+{
+    return Begin();
+}
+
+DictView::iterator DictView::end() const
+{
+    return End();
+}
+
+};
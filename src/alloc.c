@@ -0,0 +1,107 @@
+/*
+ * alloc.c
+ * memory allocation through the hooks set with plist_set_allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "plist.h"
+#include "alloc.h"
+
+#include <cnary_alloc.h>
+
+/* NULL means libc */
+static plist_malloc_func_t alloc_malloc = NULL;
+static plist_realloc_func_t alloc_realloc = NULL;
+static plist_free_func_t alloc_free = NULL;
+static void *alloc_ctx = NULL;
+
+void *plist_malloc(size_t size)
+{
+    if (alloc_malloc) {
+        return alloc_malloc(size, alloc_ctx);
+    }
+    return malloc(size);
+}
+
+void *plist_calloc(size_t nmemb, size_t size)
+{
+    void *ptr = NULL;
+    if (!alloc_malloc) {
+        return calloc(nmemb, size);
+    }
+    if (size && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    ptr = alloc_malloc(nmemb * size, alloc_ctx);
+    if (ptr) {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+void *plist_realloc(void *ptr, size_t size)
+{
+    if (alloc_realloc) {
+        return alloc_realloc(ptr, size, alloc_ctx);
+    }
+    return realloc(ptr, size);
+}
+
+char *plist_strdup(const char *str)
+{
+    size_t len = strlen(str);
+    char *dup = (char*)plist_malloc(len + 1);
+    if (dup) {
+        memcpy(dup, str, len + 1);
+    }
+    return dup;
+}
+
+PLIST_API void plist_mem_free(void *ptr)
+{
+    if (alloc_free) {
+        if (ptr) {
+            alloc_free(ptr, alloc_ctx);
+        }
+        return;
+    }
+    free(ptr);
+}
+
+PLIST_API int plist_set_allocator(plist_malloc_func_t malloc_fn, plist_realloc_func_t realloc_fn, plist_free_func_t free_fn, void *ctx)
+{
+    if (!malloc_fn && !realloc_fn && !free_fn) {
+        /* back to libc */
+        alloc_malloc = NULL;
+        alloc_realloc = NULL;
+        alloc_free = NULL;
+        alloc_ctx = NULL;
+        cnary_set_allocator(NULL, NULL, NULL);
+        return 0;
+    }
+    if (!malloc_fn || !realloc_fn || !free_fn) {
+        return -1;
+    }
+    alloc_malloc = malloc_fn;
+    alloc_realloc = realloc_fn;
+    alloc_free = free_fn;
+    alloc_ctx = ctx;
+    cnary_set_allocator(malloc_fn, free_fn, ctx);
+    return 0;
+}
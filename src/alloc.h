@@ -0,0 +1,32 @@
+/*
+ * alloc.h
+ * memory allocation through the hooks set with plist_set_allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef ALLOC_H
+#define ALLOC_H
+#include <stdlib.h>
+
+#include "plist/plist.h"
+
+/* all memory of the library is allocated with these and released with
+ * plist_mem_free, the libc functions are only called through them */
+void *plist_malloc(size_t size);
+void *plist_calloc(size_t nmemb, size_t size);
+void *plist_realloc(void *ptr, size_t size);
+char *plist_strdup(const char *str);
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * arena.c
+ * simple arena (bump) allocator implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <string.h>
+#include "arena.h"
+#include "alloc.h"
+
+#define ARENA_ALIGN 8
+#define ARENA_ALIGN_SIZE(x) (((x) + (ARENA_ALIGN-1)) & ~(ARENA_ALIGN-1))
+#define ARENA_CHUNK_HDR ARENA_ALIGN_SIZE(sizeof(arena_chunk_t))
+
+static arena_chunk_t *arena_chunk_new(arena_t *arena, size_t size)
+{
+	arena_chunk_t *chunk = NULL;
+	if (arena->malloc_fn) {
+		chunk = (arena_chunk_t*)arena->malloc_fn(ARENA_CHUNK_HDR + size, arena->ctx);
+	} else {
+		chunk = (arena_chunk_t*)plist_malloc(ARENA_CHUNK_HDR + size);
+	}
+	if (!chunk) return NULL;
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+arena_t *arena_new_with_allocator(size_t chunk_size, arena_malloc_func_t malloc_fn, arena_free_func_t free_fn, void *ctx)
+{
+	arena_t *arena = (arena_t*)plist_malloc(sizeof(arena_t));
+	if (!arena) return NULL;
+	arena->chunk_size = ARENA_ALIGN_SIZE(chunk_size);
+	arena->chunks = NULL;
+	arena->malloc_fn = malloc_fn;
+	arena->free_fn = free_fn;
+	arena->ctx = ctx;
+	return arena;
+}
+
+arena_t *arena_new(size_t chunk_size)
+{
+	return arena_new_with_allocator(chunk_size, NULL, NULL, NULL);
+}
+
+void arena_free(arena_t *arena)
+{
+	if (!arena) return;
+	arena_chunk_t *chunk = arena->chunks;
+	while (chunk) {
+		arena_chunk_t *next = chunk->next;
+		if (arena->free_fn) {
+			arena->free_fn(chunk, arena->ctx);
+		} else {
+			plist_mem_free(chunk);
+		}
+		chunk = next;
+	}
+	plist_mem_free(arena);
+}
+
+void *arena_alloc(arena_t *arena, size_t size)
+{
+	if (!arena) return NULL;
+	size = ARENA_ALIGN_SIZE(size);
+	if (size > arena->chunk_size / 4) {
+		/* large blocks get a chunk of their own; insert it behind the
+		 * current chunk so the remaining space there can still be used */
+		arena_chunk_t *chunk = arena_chunk_new(arena, size);
+		if (!chunk) return NULL;
+		chunk->used = size;
+		if (arena->chunks) {
+			chunk->next = arena->chunks->next;
+			arena->chunks->next = chunk;
+		} else {
+			arena->chunks = chunk;
+		}
+		return (char*)chunk + ARENA_CHUNK_HDR;
+	}
+	arena_chunk_t *chunk = arena->chunks;
+	if (!chunk || chunk->size - chunk->used < size) {
+		chunk = arena_chunk_new(arena, arena->chunk_size);
+		if (!chunk) return NULL;
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+	void *ptr = (char*)chunk + ARENA_CHUNK_HDR + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
@@ -0,0 +1,46 @@
+/*
+ * arena.h
+ * header file for simple arena (bump) allocator implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef ARENA_H
+#define ARENA_H
+#include <stdlib.h>
+
+typedef struct arena_chunk_t {
+	struct arena_chunk_t *next;
+	size_t size;
+	size_t used;
+} arena_chunk_t;
+
+typedef void *(*arena_malloc_func_t)(size_t size, void *ctx);
+typedef void (*arena_free_func_t)(void *ptr, void *ctx);
+
+typedef struct arena_t {
+	arena_chunk_t *chunks;
+	size_t chunk_size;
+	/* where the chunks come from, plist_malloc if NULL */
+	arena_malloc_func_t malloc_fn;
+	arena_free_func_t free_fn;
+	void *ctx;
+} arena_t;
+
+arena_t *arena_new(size_t chunk_size);
+arena_t *arena_new_with_allocator(size_t chunk_size, arena_malloc_func_t malloc_fn, arena_free_func_t free_fn, void *ctx);
+void arena_free(arena_t *arena);
+void *arena_alloc(arena_t *arena, size_t size);
+
+#endif
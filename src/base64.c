@@ -20,6 +20,8 @@
  */
 #include <string.h>
 #include "base64.h"
+#include "alloc.h"
+#include "stats.h"
 
 static const char base64_str[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 static const char base64_pad = '=';
@@ -43,6 +45,29 @@ static const signed char base64_table[256] = {
 	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
 };
 
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+
+/* encodes 12 input bytes to 16 characters, reads 16 input bytes */
+static inline void base64encode_block(char *out, const unsigned char *in)
+{
+	const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'+' - 62, '/' - 63, 'A', 0, 0);
+	__m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), shuf);
+	/* split each 3 byte group into four 6 bit indexes */
+	__m128i t0 = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+	__m128i t1 = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+	__m128i idx = _mm_or_si128(t0, t1);
+	/* map the indexes to the alphabet by adding a per-range offset */
+	__m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+	r = _mm_add_epi8(_mm_shuffle_epi8(shift_lut, r), idx);
+	_mm_storeu_si128((__m128i*)out, r);
+}
+#endif
+
 size_t base64encode(char *outbuf, const unsigned char *buf, size_t size)
 {
 	if (!outbuf || !buf || (size <= 0)) {
@@ -51,32 +76,71 @@ size_t base64encode(char *outbuf, const unsigned char *buf, size_t size)
 
 	size_t n = 0;
 	size_t m = 0;
-	unsigned char input[3];
-	unsigned int output[4];
-	while (n < size) {
-		input[0] = buf[n];
-		input[1] = (n+1 < size) ? buf[n+1] : 0;
-		input[2] = (n+2 < size) ? buf[n+2] : 0;
-		output[0] = input[0] >> 2;
-		output[1] = ((input[0] & 3) << 4) + (input[1] >> 4);
-		output[2] = ((input[1] & 15) << 2) + (input[2] >> 6);
-		output[3] = input[2] & 63;
-		outbuf[m++] = base64_str[(int)output[0]];
-		outbuf[m++] = base64_str[(int)output[1]];
-		outbuf[m++] = (n+1 < size) ? base64_str[(int)output[2]] : base64_pad;
-		outbuf[m++] = (n+2 < size) ? base64_str[(int)output[3]] : base64_pad;
-		n+=3;
+	unsigned int v;
+	PLIST_STAT_ADD(base64_encoded_bytes, size);
+#ifdef __SSSE3__
+	while (size - n >= 16) {
+		base64encode_block(outbuf + m, buf + n);
+		n += 12;
+		m += 16;
+	}
+#endif
+	/* full 3 byte groups */
+	while (size - n >= 3) {
+		v = (buf[n] << 16) | (buf[n+1] << 8) | buf[n+2];
+		outbuf[m++] = base64_str[v >> 18];
+		outbuf[m++] = base64_str[(v >> 12) & 63];
+		outbuf[m++] = base64_str[(v >> 6) & 63];
+		outbuf[m++] = base64_str[v & 63];
+		n += 3;
+	}
+	/* remaining 1 or 2 bytes with padding */
+	if (n < size) {
+		v = buf[n] << 16;
+		if (n+1 < size) {
+			v |= buf[n+1] << 8;
+		}
+		outbuf[m++] = base64_str[v >> 18];
+		outbuf[m++] = base64_str[(v >> 12) & 63];
+		outbuf[m++] = (n+1 < size) ? base64_str[(v >> 6) & 63] : base64_pad;
+		outbuf[m++] = base64_pad;
 	}
 	outbuf[m] = 0; // 0-termination!
 	return m;
 }
 
+size_t base64encode_wrapped_size(size_t size, size_t line_size, unsigned int indent)
+{
+	size_t lines = (size + line_size - 1) / line_size;
+	return ((size + 2) / 3) * 4 + lines * (indent + 1);
+}
+
+size_t base64encode_wrapped(char *outbuf, const unsigned char *buf, size_t size, size_t line_size, char indent_char, unsigned int indent)
+{
+	size_t n = 0;
+	size_t m = 0;
+	size_t count;
+
+	if (!outbuf || !buf || line_size == 0) {
+		return 0;
+	}
+	while (n < size) {
+		memset(outbuf + m, indent_char, indent);
+		m += indent;
+		count = (size - n < line_size) ? size - n : line_size;
+		m += base64encode(outbuf + m, buf + n, count);
+		outbuf[m++] = '\n';
+		n += count;
+	}
+	return m;
+}
+
 unsigned char *base64decode(const char *buf, size_t *size)
 {
 	if (!buf || !size) return NULL;
 	size_t len = (*size > 0) ? *size : strlen(buf);
 	if (len <= 0) return NULL;
-	unsigned char *outbuf = (unsigned char*)malloc((len/4)*3+3);
+	unsigned char *outbuf = (unsigned char*)plist_malloc((len/4)*3+3);
 	const char *ptr = buf;
 	int p = 0;
 	int wv, w1, w2, w3, w4;
@@ -84,6 +148,20 @@ unsigned char *base64decode(const char *buf, size_t *size)
 	int tmpcnt = 0;
 
 	do {
+		/* fast path for complete groups of 4 valid characters */
+		while (tmpcnt == 0 && buf+len - ptr >= 4) {
+			w1 = base64_table[(unsigned char)ptr[0]];
+			w2 = base64_table[(unsigned char)ptr[1]];
+			w3 = base64_table[(unsigned char)ptr[2]];
+			w4 = base64_table[(unsigned char)ptr[3]];
+			if ((w1 | w2 | w3 | w4) < 0) {
+				break;
+			}
+			outbuf[p++] = (unsigned char)(((w1 << 2) + (w2 >> 4)) & 0xFF);
+			outbuf[p++] = (unsigned char)(((w2 << 4) + (w3 >> 2)) & 0xFF);
+			outbuf[p++] = (unsigned char)(((w3 << 6) + w4) & 0xFF);
+			ptr += 4;
+		}
 		while (ptr < buf+len && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')) {
 			ptr++;
 		}
@@ -115,5 +193,7 @@ unsigned char *base64decode(const char *buf, size_t *size)
 
 	outbuf[p] = 0;
 	*size = p;
+	PLIST_STAT_ADD(base64_decoded_bytes, p);
+	PLIST_STAT_ADD(bytes_allocated, (len/4)*3+3);
 	return outbuf;
 }
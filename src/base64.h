@@ -23,6 +23,8 @@
 #include <stdlib.h>
 
 size_t base64encode(char *outbuf, const unsigned char *buf, size_t size);
+size_t base64encode_wrapped_size(size_t size, size_t line_size, unsigned int indent);
+size_t base64encode_wrapped(char *outbuf, const unsigned char *buf, size_t size, size_t line_size, char indent_char, unsigned int indent);
 unsigned char *base64decode(const char *buf, size_t *size);
 
 #endif
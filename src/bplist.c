@@ -36,10 +36,22 @@
 #include "plist.h"
 #include "hashtable.h"
 #include "bytearray.h"
+#include "alloc.h"
 #include "ptrarray.h"
+#include "stats.h"
 
 #include <node.h>
-#include <node_iterator.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 /* Magic marker and size. */
 #define BPLIST_MAGIC            ((uint8_t*)"bplist")
@@ -192,8 +204,174 @@ static int uint64_mul_overflow(uint64_t a, uint64_t b, uint64_t *res)
 }
 #endif
 
+#ifdef __SSE2__
+/* widens 4 32 bit lanes to 4 uint64_t */
+static inline void store_u32x4(uint64_t *out, __m128i v)
+{
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi32(v, zero));
+    _mm_storeu_si128((__m128i*)(out + 2), _mm_unpackhi_epi32(v, zero));
+}
+
+/* widens 8 16 bit lanes to 8 uint64_t */
+static inline void store_u16x8(uint64_t *out, __m128i v)
+{
+    __m128i zero = _mm_setzero_si128();
+    store_u32x4(out, _mm_unpacklo_epi16(v, zero));
+    store_u32x4(out + 4, _mm_unpackhi_epi16(v, zero));
+}
+
+/* narrows 4 uint64_t to the 32 bit lanes of a vector */
+static inline __m128i load_u32x4(const uint64_t *in)
+{
+    __m128i a = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)in), _MM_SHUFFLE(3, 1, 2, 0));
+    __m128i b = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(in + 2)), _MM_SHUFFLE(3, 1, 2, 0));
+    return _mm_unpacklo_epi64(a, b);
+}
+
+/* narrows 8 values below 65536 to 16 bit lanes, packs_epi32 saturates
+ * signed so the values are moved into the signed range and back */
+static inline __m128i pack_u32_u16(__m128i a, __m128i b)
+{
+    __m128i bias = _mm_set1_epi32(0x8000);
+    __m128i v = _mm_packs_epi32(_mm_sub_epi32(a, bias), _mm_sub_epi32(b, bias));
+    return _mm_xor_si128(v, _mm_set1_epi16((short)0x8000));
+}
+
+static inline __m128i bswap_u16x8(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i bswap_u32x4(__m128i v)
+{
+    v = bswap_u16x8(v);
+    return _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+}
+#endif
+
+/* Decodes count big endian integers of size bytes each from in. Returns
+ * the largest one, so callers need just one range check for all of
+ * them. */
+static uint64_t bplist_decode_uints(const char *in, uint8_t size, uint64_t count, uint64_t *out)
+{
+    const uint8_t *p = (const uint8_t*)in;
+    uint64_t max = 0;
+    uint64_t i = 0;
+#ifdef __SSE2__
+    if (size == 1 && count >= 16) {
+        __m128i zero = _mm_setzero_si128();
+        __m128i vmax = zero;
+        uint8_t lanes[16];
+        int k;
+        for (; count - i >= 16; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+            vmax = _mm_max_epu8(vmax, v);
+            store_u16x8(out + i, _mm_unpacklo_epi8(v, zero));
+            store_u16x8(out + i + 8, _mm_unpackhi_epi8(v, zero));
+        }
+        _mm_storeu_si128((__m128i*)lanes, vmax);
+        for (k = 0; k < 16; k++) {
+            max = (lanes[k] > max) ? lanes[k] : max;
+        }
+    } else if (size == 2 && count >= 8) {
+        /* there is no unsigned 16 bit max, compare biased signed values */
+        __m128i bias = _mm_set1_epi16((short)0x8000);
+        __m128i vmax = bias;
+        uint16_t lanes[8];
+        int k;
+        for (; count - i >= 8; i += 8) {
+            __m128i v = bswap_u16x8(_mm_loadu_si128((const __m128i*)(p + i * 2)));
+            vmax = _mm_max_epi16(vmax, _mm_xor_si128(v, bias));
+            store_u16x8(out + i, v);
+        }
+        _mm_storeu_si128((__m128i*)lanes, _mm_xor_si128(vmax, bias));
+        for (k = 0; k < 8; k++) {
+            max = (lanes[k] > max) ? lanes[k] : max;
+        }
+    } else if (size == 4 && count >= 4) {
+        __m128i bias = _mm_set1_epi32((int)0x80000000);
+        __m128i vmax = bias;
+        uint32_t lanes[4];
+        int k;
+        for (; count - i >= 4; i += 4) {
+            __m128i v = bswap_u32x4(_mm_loadu_si128((const __m128i*)(p + i * 4)));
+            __m128i b = _mm_xor_si128(v, bias);
+            __m128i gt = _mm_cmpgt_epi32(b, vmax);
+            vmax = _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, vmax));
+            store_u32x4(out + i, v);
+        }
+        _mm_storeu_si128((__m128i*)lanes, _mm_xor_si128(vmax, bias));
+        for (k = 0; k < 4; k++) {
+            max = (lanes[k] > max) ? lanes[k] : max;
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = UINT_TO_HOST(p + i * size, size);
+        max = (out[i] > max) ? out[i] : max;
+    }
+    return max;
+}
+
+/* Encodes count integers as big endian with size bytes each to out,
+ * which must have room for count * size bytes. */
+static void bplist_encode_uints(const uint64_t *in, uint64_t count, uint8_t size, uint8_t *out)
+{
+    uint64_t i = 0;
+#ifdef __SSE2__
+    if (size == 1 || size == 2 || size == 4) {
+        for (; count - i >= 16; i += 16) {
+            __m128i a = load_u32x4(in + i);
+            __m128i b = load_u32x4(in + i + 4);
+            __m128i c = load_u32x4(in + i + 8);
+            __m128i d = load_u32x4(in + i + 12);
+            if (size == 4) {
+                _mm_storeu_si128((__m128i*)(out + i * 4), bswap_u32x4(a));
+                _mm_storeu_si128((__m128i*)(out + i * 4 + 16), bswap_u32x4(b));
+                _mm_storeu_si128((__m128i*)(out + i * 4 + 32), bswap_u32x4(c));
+                _mm_storeu_si128((__m128i*)(out + i * 4 + 48), bswap_u32x4(d));
+            } else if (size == 2) {
+                _mm_storeu_si128((__m128i*)(out + i * 2), bswap_u16x8(pack_u32_u16(a, b)));
+                _mm_storeu_si128((__m128i*)(out + i * 2 + 16), bswap_u16x8(pack_u32_u16(c, d)));
+            } else {
+                _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(pack_u32_u16(a, b), pack_u32_u16(c, d)));
+            }
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        uint64_t v = be64toh(in[i]);
+        memcpy(out + i * size, (uint8_t*)&v + (sizeof(uint64_t) - size), size);
+    }
+}
+
 #define NODE_IS_ROOT(x) (((node_t*)x)->isRoot)
 
+struct bplist_parse_frame;
+
+/* scratch state of the parser and writer that is kept between calls */
+struct plist_context_s {
+    /* parser: zeroed bitmap and stack of parse_children */
+    uint8_t *used_indexes;
+    uint64_t used_indexes_size;
+    struct bplist_parse_frame *frames;
+    uint32_t frames_capacity;
+    uint64_t *refs;
+    uint64_t refs_capacity;
+    /* writer */
+    ptrarray_t *objects;
+    hashtable_t *ref_table;
+    hashtable_t *containers;
+    uint64_t *obj_refs;
+    uint64_t obj_refs_capacity;
+    uint64_t *ref_starts;
+    uint64_t ref_starts_capacity;
+    uint64_t *offsets;
+    uint64_t offsets_capacity;
+    bytearray_t *out;
+};
+
 struct bplist_data {
     const char* data;
     uint64_t size;
@@ -201,10 +379,61 @@ struct bplist_data {
     uint8_t ref_size;
     uint8_t offset_size;
     const char* offset_table;
-    uint32_t level;
-    plist_t used_indexes;
+    uint8_t *used_indexes;
+    plist_arena_t arena;
+    uint32_t options;
+    /* children of the container parsed last, still to be parsed */
+    const char *pending_refs;
+    uint64_t pending_size;
+    /* interned keys by object index, if the arena interns keys */
+    plist_data_t *key_cache;
+    int intern_keys;
+    /* lazy parsing */
+    struct bplist_lazy_doc *lazy;
+    plist_t lazy_parent;
+    uint64_t index;
+    /* scalar objects decoded in advance by plist_from_bin_parallel */
+    plist_t *slots;
+    uint8_t *slots_taken;
+    /* scratch buffers are borrowed from here, if set */
+    struct plist_context_s *ctx;
+    /* resources used so far, if the parse has limits */
+    struct plist_limits_s *limits;
+};
+
+/* binary plist shared by all deferred containers parsed from it */
+struct bplist_lazy_doc {
+    struct bplist_data bplist;
+    unsigned int refcount;
+};
+
+/* a container whose children have not been parsed yet */
+struct bplist_lazy_node {
+    struct bplist_lazy_doc *doc;
+    const char *refs;
+    uint64_t size;
+};
+
+/* a container whose children are being parsed */
+struct bplist_parse_frame {
+    plist_t node;
+    /* position of the decoded references on the reference stack */
+    uint64_t first;
+    uint64_t size;
+    uint64_t pos;
+    uint64_t index;
 };
 
+/* used_indexes is a bitmap with one bit per object index, marking the
+ * containers on the current parse path */
+#define BPLIST_INDEX_IS_USED(bp, i) ((bp)->used_indexes[(i) >> 3] & (1 << ((i) & 7)))
+#define BPLIST_INDEX_SET_USED(bp, i) ((bp)->used_indexes[(i) >> 3] |= (1 << ((i) & 7)))
+#define BPLIST_INDEX_CLEAR_USED(bp, i) ((bp)->used_indexes[(i) >> 3] &= ~(1 << ((i) & 7)))
+
+/* slots_taken marks the decoded objects that were handed out already */
+#define BPLIST_INDEX_IS_TAKEN(bp, i) ((bp)->slots_taken[(i) >> 3] & (1 << ((i) & 7)))
+#define BPLIST_INDEX_SET_TAKEN(bp, i) ((bp)->slots_taken[(i) >> 3] |= (1 << ((i) & 7)))
+
 #ifdef DEBUG
 static int plist_bin_debug = 0;
 #define PLIST_BIN_ERR(...) if (plist_bin_debug) { fprintf(stderr, "libplist[binparser] ERROR: " __VA_ARGS__); }
@@ -228,11 +457,21 @@ void plist_bin_deinit(void)
     /* deinit binary plist stuff */
 }
 
-static plist_t parse_bin_node_at_index(struct bplist_data *bplist, uint32_t node_index);
+static plist_t parse_bin_node_at_index(struct bplist_data *bplist, uint64_t node_index);
+
+/* counts a node against the limits of the parse, if it has any */
+static int bplist_limit_node(struct bplist_data *bplist, plist_type type, uint64_t length, uint32_t flags)
+{
+    if (bplist->limits && plist_limits_add(bplist->limits, 1, plist_node_size(type, length, flags)) < 0) {
+        PLIST_BIN_ERR("%s: parse limits exceeded\n", __func__);
+        return -1;
+    }
+    return 0;
+}
 
-static plist_t parse_uint_node(const char **bnode, uint8_t size)
+static plist_t parse_uint_node(struct bplist_data *bplist, const char **bnode, uint8_t size)
 {
-    plist_data_t data = plist_new_plist_data();
+    plist_data_t data = plist_new_plist_data_in(bplist->arena);
 
     size = 1 << size;			// make length less misleading
     switch (size)
@@ -247,7 +486,7 @@ static plist_t parse_uint_node(const char **bnode, uint8_t size)
         data->length = size;
         break;
     default:
-        free(data);
+        plist_mem_free(data);
         PLIST_BIN_ERR("%s: Invalid byte size for integer node\n", __func__);
         return NULL;
     };
@@ -257,12 +496,12 @@ static plist_t parse_uint_node(const char **bnode, uint8_t size)
     (*bnode) += size;
     data->type = PLIST_UINT;
 
-    return node_create(NULL, data);
+    return plist_new_node(data);
 }
 
-static plist_t parse_real_node(const char **bnode, uint8_t size)
+static plist_t parse_real_node(struct bplist_data *bplist, const char **bnode, uint8_t size)
 {
-    plist_data_t data = plist_new_plist_data();
+    plist_data_t data = plist_new_plist_data_in(bplist->arena);
     uint8_t buf[8];
 
     size = 1 << size;			// make length less misleading
@@ -277,19 +516,19 @@ static plist_t parse_real_node(const char **bnode, uint8_t size)
         data->realval = *(double *) buf;
         break;
     default:
-        free(data);
+        plist_mem_free(data);
         PLIST_BIN_ERR("%s: Invalid byte size for real node\n", __func__);
         return NULL;
     }
     data->type = PLIST_REAL;
     data->length = sizeof(double);
 
-    return node_create(NULL, data);
+    return plist_new_node(data);
 }
 
-static plist_t parse_date_node(const char **bnode, uint8_t size)
+static plist_t parse_date_node(struct bplist_data *bplist, const char **bnode, uint8_t size)
 {
-    plist_t node = parse_real_node(bnode, size);
+    plist_t node = parse_real_node(bplist, bnode, size);
     plist_data_t data = plist_get_data(node);
 
     data->type = PLIST_DATE;
@@ -297,12 +536,12 @@ static plist_t parse_date_node(const char **bnode, uint8_t size)
     return node;
 }
 
-static plist_t parse_string_node(const char **bnode, uint64_t size)
+static plist_t parse_string_node(struct bplist_data *bplist, const char **bnode, uint64_t size)
 {
-    plist_data_t data = plist_new_plist_data();
+    plist_data_t data = plist_new_plist_data_in(bplist->arena);
 
     data->type = PLIST_STRING;
-    data->strval = (char *) malloc(sizeof(char) * (size + 1));
+    plist_data_alloc_string(data, bplist->arena, size);
     if (!data->strval) {
         plist_free_data(data);
         PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, sizeof(char) * (size + 1));
@@ -312,34 +551,53 @@ static plist_t parse_string_node(const char **bnode, uint64_t size)
     data->strval[size] = '\0';
     data->length = strlen(data->strval);
 
-    return node_create(NULL, data);
+    return plist_new_node(data);
 }
 
-static char *plist_utf16_to_utf8(uint16_t *unistr, long len, long *items_read, long *items_written)
+/* Converts len big endian UTF-16 code units at unistr to UTF-8. If outbuf
+ * is NULL only the number of bytes is computed. Invalid surrogates are
+ * skipped. Returns the number of bytes (without terminating 0). */
+static uint64_t plist_utf16be_to_utf8(const char *unistr, uint64_t len, char *outbuf)
 {
-	if (!unistr || (len <= 0)) return NULL;
-	char *outbuf;
-	int p = 0;
-	long i = 0;
+	const unsigned char *in = (const unsigned char*)unistr;
+	uint64_t p = 0;
+	uint64_t i = 0;
 
 	uint16_t wc;
-	uint32_t w;
+	uint32_t w = 0;
 	int read_lead_surrogate = 0;
 
-	outbuf = (char*)malloc(4*(len+1));
-	if (!outbuf) {
-		PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, (uint64_t)(4*(len+1)));
-		return NULL;
-	}
-
 	while (i < len) {
-		wc = unistr[i++];
-		if (wc >= 0xD800 && wc <= 0xDBFF) {
+#ifdef __SSE2__
+		/* 8 ASCII characters at a time */
+		if (len - i >= 8) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(in + (i<<1)));
+			/* big endian: the high byte comes first, so in each 16 bit
+			 * lane the high byte is in the low half */
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16((short)0x80FF)), _mm_setzero_si128())) == 0xFFFF) {
+				if (outbuf) {
+					__m128i lo = _mm_srli_epi16(v, 8);
+					_mm_storel_epi64((__m128i*)(outbuf + p), _mm_packus_epi16(lo, lo));
+				}
+				p += 8;
+				i += 8;
+				continue;
+			}
+		}
+#endif
+		wc = (uint16_t)((in[i<<1] << 8) | in[(i<<1)+1]);
+		i++;
+		if (wc < 0x80) {
+			if (outbuf) {
+				outbuf[p] = (char)wc;
+			}
+			p++;
+		} else if (wc >= 0xD800 && wc <= 0xDBFF) {
 			if (!read_lead_surrogate) {
 				read_lead_surrogate = 1;
 				w = 0x010000 + ((wc & 0x3FF) << 10);
 			} else {
-				// This is invalid, the next 16 bit char should be a trail surrogate. 
+				// This is invalid, the next 16 bit char should be a trail surrogate.
 				// Handling error by skipping.
 				read_lead_surrogate = 0;
 			}
@@ -347,245 +605,492 @@ static char *plist_utf16_to_utf8(uint16_t *unistr, long len, long *items_read, l
 			if (read_lead_surrogate) {
 				read_lead_surrogate = 0;
 				w = w | (wc & 0x3FF);
-				outbuf[p++] = (char)(0xF0 + ((w >> 18) & 0x7));
-				outbuf[p++] = (char)(0x80 + ((w >> 12) & 0x3F));
-				outbuf[p++] = (char)(0x80 + ((w >> 6) & 0x3F));
-				outbuf[p++] = (char)(0x80 + (w & 0x3F));
+				if (outbuf) {
+					outbuf[p] = (char)(0xF0 + ((w >> 18) & 0x7));
+					outbuf[p+1] = (char)(0x80 + ((w >> 12) & 0x3F));
+					outbuf[p+2] = (char)(0x80 + ((w >> 6) & 0x3F));
+					outbuf[p+3] = (char)(0x80 + (w & 0x3F));
+				}
+				p += 4;
 			} else {
 				// This is invalid.  A trail surrogate should always follow a lead surrogate.
 				// Handling error by skipping
 			}
 		} else if (wc >= 0x800) {
-			outbuf[p++] = (char)(0xE0 + ((wc >> 12) & 0xF));
-			outbuf[p++] = (char)(0x80 + ((wc >> 6) & 0x3F));
-			outbuf[p++] = (char)(0x80 + (wc & 0x3F));
-		} else if (wc >= 0x80) {
-			outbuf[p++] = (char)(0xC0 + ((wc >> 6) & 0x1F));
-			outbuf[p++] = (char)(0x80 + (wc & 0x3F));
+			if (outbuf) {
+				outbuf[p] = (char)(0xE0 + ((wc >> 12) & 0xF));
+				outbuf[p+1] = (char)(0x80 + ((wc >> 6) & 0x3F));
+				outbuf[p+2] = (char)(0x80 + (wc & 0x3F));
+			}
+			p += 3;
 		} else {
-			outbuf[p++] = (char)(wc & 0x7F);
+			if (outbuf) {
+				outbuf[p] = (char)(0xC0 + ((wc >> 6) & 0x1F));
+				outbuf[p+1] = (char)(0x80 + (wc & 0x3F));
+			}
+			p += 2;
 		}
 	}
-	if (items_read) {
-		*items_read = i;
-	}
-	if (items_written) {
-		*items_written = p;
-	}
-	outbuf[p] = 0;
 
-	return outbuf;
+	return p;
 }
 
-static plist_t parse_unicode_node(const char **bnode, uint64_t size)
+static plist_t parse_unicode_node(struct bplist_data *bplist, const char **bnode, uint64_t size)
 {
-    plist_data_t data = plist_new_plist_data();
-    uint64_t i = 0;
-    uint16_t *unicodestr = NULL;
-    char *tmpstr = NULL;
-    long items_read = 0;
-    long items_written = 0;
+    plist_data_t data = NULL;
+    uint64_t len = plist_utf16be_to_utf8(*bnode, size, NULL);
 
-    data->type = PLIST_STRING;
-    unicodestr = (uint16_t*) malloc(sizeof(uint16_t) * size);
-    if (!unicodestr) {
-        plist_free_data(data);
-        PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, sizeof(uint16_t) * size);
+    /* the other types are counted by parse_bin_node */
+    if (bplist_limit_node(bplist, PLIST_STRING, len, PLIST_DATA_SHARED) < 0) {
         return NULL;
     }
-    for (i = 0; i < size; i++)
-        unicodestr[i] = be16toh(get_unaligned((uint16_t*)(*bnode+(i<<1))));
-
-    tmpstr = plist_utf16_to_utf8(unicodestr, size, &items_read, &items_written);
-    free(unicodestr);
-    if (!tmpstr) {
+    data = plist_new_plist_data_in(bplist->arena);
+    data->type = PLIST_STRING;
+    plist_data_alloc_string(data, bplist->arena, len);
+    if (!data->strval) {
         plist_free_data(data);
+        PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, len+1);
         return NULL;
     }
-    tmpstr[items_written] = '\0';
-
-    data->type = PLIST_STRING;
-    data->strval = realloc(tmpstr, items_written+1);
-    if (!data->strval)
-        data->strval = tmpstr;
-    data->length = items_written;
-    return node_create(NULL, data);
+    PLIST_STAT_ADD(utf16_conversions, 1);
+    plist_utf16be_to_utf8(*bnode, size, data->strval);
+    data->strval[len] = '\0';
+    data->length = len;
+    return plist_new_node(data);
 }
 
-static plist_t parse_data_node(const char **bnode, uint64_t size)
+static plist_t parse_data_node(struct bplist_data *bplist, const char **bnode, uint64_t size)
 {
-    plist_data_t data = plist_new_plist_data();
+    plist_data_t data = plist_new_plist_data_in(bplist->arena);
 
     data->type = PLIST_DATA;
     data->length = size;
-    data->buff = (uint8_t *) malloc(sizeof(uint8_t) * size);
-    if (!data->strval) {
+    if (bplist->options & PLIST_PARSE_BORROW) {
+        data->buff = (uint8_t *) *bnode;
+        data->flags |= PLIST_DATA_BORROWED;
+        return plist_new_node(data);
+    }
+    plist_data_alloc_buffer(data, bplist->arena, size);
+    if (!data->buff) {
         plist_free_data(data);
         PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, sizeof(uint8_t) * size);
         return NULL;
     }
     memcpy(data->buff, *bnode, sizeof(uint8_t) * size);
 
-    return node_create(NULL, data);
+    return plist_new_node(data);
 }
 
-static plist_t parse_dict_node(struct bplist_data *bplist, const char** bnode, uint64_t size)
+/* reads the n-th object reference of a container */
+static int bplist_read_ref(struct bplist_data *bplist, const char *refs, uint64_t n, uint64_t *ref)
 {
-    uint64_t j;
-    uint64_t str_i = 0, str_j = 0;
-    uint64_t index1, index2;
-    plist_data_t data = plist_new_plist_data();
-    const char *index1_ptr = NULL;
-    const char *index2_ptr = NULL;
-
-    data->type = PLIST_DICT;
-    data->length = size;
+    const char *ref_ptr = refs + n * bplist->ref_size;
 
-    plist_t node = node_create(NULL, data);
+    if (ref_ptr < bplist->data || ref_ptr + bplist->ref_size > bplist->offset_table) {
+        PLIST_BIN_ERR("%s: reference %" PRIu64 " is outside of valid range\n", __func__, n);
+        return -1;
+    }
+    *ref = UINT_TO_HOST(ref_ptr, bplist->ref_size);
+    if (*ref >= bplist->num_objects) {
+        PLIST_BIN_ERR("%s: reference %" PRIu64 ": object index (%" PRIu64 ") must be smaller than the number of objects (%" PRIu64 ")\n", __func__, n, *ref, bplist->num_objects);
+        return -1;
+    }
+    return 0;
+}
 
-    for (j = 0; j < data->length; j++) {
-        str_i = j * bplist->ref_size;
-        str_j = (j + size) * bplist->ref_size;
-        index1_ptr = (*bnode) + str_i;
-        index2_ptr = (*bnode) + str_j;
+/* Decodes the count references at refs to the end of the reference
+ * stack. All of them are checked at once, before any child is parsed. */
+static int bplist_push_refs(struct bplist_data *bplist, const char *refs, uint64_t count, uint64_t **stack, uint64_t *len, uint64_t *capacity)
+{
+    uint64_t need = 0;
 
-        if ((index1_ptr < bplist->data || index1_ptr + bplist->ref_size > bplist->offset_table) ||
-            (index2_ptr < bplist->data || index2_ptr + bplist->ref_size > bplist->offset_table)) {
-            plist_free(node);
-            PLIST_BIN_ERR("%s: dict entry %" PRIu64 " is outside of valid range\n", __func__, j);
-            return NULL;
+    if (uint64_mul_overflow(count, bplist->ref_size, &need) || refs < bplist->data || need > (uint64_t)(bplist->offset_table - refs)) {
+        PLIST_BIN_ERR("%s: references are outside of valid range\n", __func__);
+        return -1;
+    }
+    if (count > *capacity - *len) {
+        uint64_t newcap = (*capacity > 0) ? *capacity : 256;
+        uint64_t *newstack = NULL;
+        while (count > newcap - *len) {
+            newcap *= 2;
         }
+        newstack = (uint64_t*)plist_realloc(*stack, newcap * sizeof(uint64_t));
+        if (!newstack) {
+            PLIST_BIN_ERR("%s: Could not allocate reference stack\n", __func__);
+            return -1;
+        }
+        *stack = newstack;
+        *capacity = newcap;
+    }
+    if (count > 0 && bplist_decode_uints(refs, bplist->ref_size, count, *stack + *len) >= bplist->num_objects) {
+        PLIST_BIN_ERR("%s: object index must be smaller than the number of objects (%" PRIu64 ")\n", __func__, bplist->num_objects);
+        return -1;
+    }
+    *len += count;
+    return 0;
+}
 
-        index1 = UINT_TO_HOST(index1_ptr, bplist->ref_size);
-        index2 = UINT_TO_HOST(index2_ptr, bplist->ref_size);
+/* Parses the children of node and all their descendants. Instead of
+ * recursing, the containers on the current path are kept in an explicit
+ * stack of frames. */
+static int parse_children(struct bplist_data *bplist, plist_t node, const char *refs, uint64_t size)
+{
+    struct bplist_parse_frame *frames = NULL;
+    struct bplist_parse_frame *f = NULL;
+    uint32_t depth = 0;
+    uint32_t capacity = 0;
+    uint32_t base = 1;
+    uint32_t max_depth = bplist->limits ? bplist->limits->max_depth : plist_get_max_depth();
+    uint64_t *stack = NULL;
+    uint64_t stack_len = 0;
+    uint64_t stack_capacity = 0;
+    node_t *p = NULL;
+    uint64_t index1 = 0;
+    uint64_t index2 = 0;
+    uint64_t j = 0;
+    plist_t key = NULL;
+    plist_t val = NULL;
+    int res = 0;
+
+    /* nesting level of node, which is only larger than 1 when loading
+     * the children of a lazily parsed container */
+    for (p = ((node_t*)node)->parent; p; p = p->parent) {
+        base++;
+    }
 
-        if (index1 >= bplist->num_objects) {
-            plist_free(node);
-            PLIST_BIN_ERR("%s: dict entry %" PRIu64 ": key index (%" PRIu64 ") must be smaller than the number of objects (%" PRIu64 ")\n", __func__, j, index1, bplist->num_objects);
-            return NULL;
-        }
-        if (index2 >= bplist->num_objects) {
-            plist_free(node);
-            PLIST_BIN_ERR("%s: dict entry %" PRIu64 ": value index (%" PRIu64 ") must be smaller than the number of objects (%" PRIu64 ")\n", __func__, j, index1, bplist->num_objects);
-            return NULL;
-        }
+    if (bplist->ctx && bplist->ctx->frames) {
+        frames = bplist->ctx->frames;
+        capacity = bplist->ctx->frames_capacity;
+        bplist->ctx->frames = NULL;
+    } else {
+        capacity = 16;
+        frames = (struct bplist_parse_frame*)plist_malloc(capacity * sizeof(struct bplist_parse_frame));
+    }
+    if (!frames) {
+        PLIST_BIN_ERR("%s: Could not allocate parser stack\n", __func__);
+        return -1;
+    }
+    if (bplist->ctx && bplist->ctx->refs) {
+        stack = bplist->ctx->refs;
+        stack_capacity = bplist->ctx->refs_capacity;
+        bplist->ctx->refs = NULL;
+    }
+    frames[0].node = node;
+    frames[0].first = 0;
+    frames[0].size = size;
+    frames[0].pos = 0;
+    frames[0].index = bplist->index;
+    depth = 1;
+    if (bplist_push_refs(bplist, refs, (plist_get_data(node)->type == PLIST_DICT) ? size * 2 : size, &stack, &stack_len, &stack_capacity) < 0) {
+        depth = 0;
+        res = -1;
+    }
 
-        /* process key node */
-        plist_t key = parse_bin_node_at_index(bplist, index1);
-        if (!key) {
-            plist_free(node);
-            return NULL;
+    while (depth > 0) {
+        f = &frames[depth-1];
+        if (f->pos >= f->size) {
+            if (plist_get_data(f->node)->type == PLIST_DICT) {
+                plist_dict_build_index(f->node);
+            } else {
+                plist_array_build_index(f->node);
+            }
+            if (bplist->limits && plist_limits_add(bplist->limits, 0, plist_container_size(f->node)) < 0) {
+                PLIST_BIN_ERR("%s: parse limits exceeded\n", __func__);
+                res = -1;
+                break;
+            }
+            /* the first frame is marked by the caller */
+            if (depth > 1) {
+                BPLIST_INDEX_CLEAR_USED(bplist, f->index);
+            }
+            stack_len = f->first;
+            depth--;
+            continue;
         }
+        j = f->pos++;
+
+        if (plist_get_data(f->node)->type == PLIST_DICT) {
+            index1 = stack[f->first + j];
+            index2 = stack[f->first + f->size + j];
+
+            /* process key node */
+            if (bplist->key_cache && bplist->key_cache[index1]) {
+                /* the same key object was used before */
+                plist_data_t entry = bplist->key_cache[index1];
+                plist_data_t kdata = plist_new_plist_data_in(bplist->arena);
+                kdata->type = PLIST_STRING;
+                kdata->strval = entry->strval;
+                kdata->length = entry->length;
+                kdata->hash = entry->hash;
+                kdata->flags |= PLIST_DATA_HASHED;
+                key = plist_new_node(kdata);
+            } else {
+                key = parse_bin_node_at_index(bplist, index1);
+            }
+            if (!key) {
+                res = -1;
+                break;
+            }
+            if (plist_get_data(key)->type != PLIST_STRING) {
+                PLIST_BIN_ERR("%s: dict entry %" PRIu64 ": invalid node type for key\n", __func__, j);
+                plist_free(key);
+                res = -1;
+                break;
+            }
 
-        if (plist_get_data(key)->type != PLIST_STRING) {
-            PLIST_BIN_ERR("%s: dict entry %" PRIu64 ": invalid node type for key\n", __func__, j);
-            plist_free(key);
-            plist_free(node);
-            return NULL;
+            /* enforce key type */
+            plist_get_data(key)->type = PLIST_KEY;
+            if (!plist_get_data(key)->strval) {
+                PLIST_BIN_ERR("%s: dict entry %" PRIu64 ": key must not be NULL\n", __func__, j);
+                plist_free(key);
+                res = -1;
+                break;
+            }
+            /* keys from the cache are interned already */
+            if (bplist->intern_keys && !(plist_get_data(key)->flags & PLIST_DATA_HASHED)) {
+                plist_data_t entry = plist_arena_intern_key(plist_get_data(key), 1);
+                if (!entry) {
+                    bplist->intern_keys = 0;
+                } else {
+                    if (!bplist->key_cache) {
+                        bplist->key_cache = (plist_data_t*)plist_calloc(bplist->num_objects, sizeof(plist_data_t));
+                    }
+                    if (bplist->key_cache) {
+                        bplist->key_cache[index1] = entry;
+                    }
+                }
+            }
+        } else {
+            index2 = stack[f->first + j];
+            key = NULL;
         }
 
-        /* enforce key type */
-        plist_get_data(key)->type = PLIST_KEY;
-        if (!plist_get_data(key)->strval) {
-            PLIST_BIN_ERR("%s: dict entry %" PRIu64 ": key must not be NULL\n", __func__, j);
+        /* process value node */
+        if (BPLIST_INDEX_IS_USED(bplist, index2)) {
+            PLIST_BIN_ERR("recursion detected in binary plist\n");
             plist_free(key);
-            plist_free(node);
-            return NULL;
+            res = -1;
+            break;
         }
-
-        /* process value node */
-        plist_t val = parse_bin_node_at_index(bplist, index2);
+        bplist->lazy_parent = f->node;
+        val = parse_bin_node_at_index(bplist, index2);
         if (!val) {
             plist_free(key);
-            plist_free(node);
-            return NULL;
+            res = -1;
+            break;
+        }
+        if (key) {
+            node_attach(f->node, key);
         }
+        node_attach(f->node, val);
+
+        if (plist_get_data(val)->type == PLIST_DICT || plist_get_data(val)->type == PLIST_ARRAY) {
+            if (base + depth > max_depth) {
+                PLIST_BIN_ERR("%s: maximum nesting depth (%u) exceeded\n", __func__, max_depth);
+                if (bplist->limits) {
+                    bplist->limits->exceeded = 1;
+                }
+                res = -1;
+                break;
+            }
+            if (bplist->pending_refs) {
+                if (depth >= capacity) {
+                    struct bplist_parse_frame *newframes = (struct bplist_parse_frame*)plist_realloc(frames, capacity * 2 * sizeof(struct bplist_parse_frame));
+                    if (!newframes) {
+                        PLIST_BIN_ERR("%s: Could not allocate parser stack\n", __func__);
+                        res = -1;
+                        break;
+                    }
+                    frames = newframes;
+                    capacity *= 2;
+                }
+                f = &frames[depth];
+                f->first = stack_len;
+                if (bplist_push_refs(bplist, bplist->pending_refs, (plist_get_data(val)->type == PLIST_DICT) ? bplist->pending_size * 2 : bplist->pending_size, &stack, &stack_len, &stack_capacity) < 0) {
+                    res = -1;
+                    break;
+                }
+                BPLIST_INDEX_SET_USED(bplist, index2);
+                depth++;
+                f->node = val;
+                f->size = bplist->pending_size;
+                f->pos = 0;
+                f->index = index2;
+            }
+        }
+    }
 
-        node_attach(node, key);
-        node_attach(node, val);
+    /* unwind the path after an error */
+    while (depth > 1) {
+        BPLIST_INDEX_CLEAR_USED(bplist, frames[depth-1].index);
+        depth--;
     }
+    if (bplist->ctx) {
+        bplist->ctx->frames = frames;
+        bplist->ctx->frames_capacity = capacity;
+        bplist->ctx->refs = stack;
+        bplist->ctx->refs_capacity = stack_capacity;
+    } else {
+        plist_mem_free(frames);
+        plist_mem_free(stack);
+    }
+    return res;
+}
 
-    return node;
+static void bplist_lazy_doc_release(struct bplist_lazy_doc *doc)
+{
+    if (--doc->refcount == 0) {
+        plist_mem_free(doc->bplist.used_indexes);
+        plist_mem_free(doc);
+    }
 }
 
-static plist_t parse_array_node(struct bplist_data *bplist, const char** bnode, uint64_t size)
+void plist_bin_lazy_free(void *lazy)
 {
-    uint64_t j;
-    uint64_t str_j = 0;
-    uint64_t index1;
-    plist_data_t data = plist_new_plist_data();
-    const char *index1_ptr = NULL;
+    struct bplist_lazy_node *ln = (struct bplist_lazy_node*)lazy;
+    if (!ln) {
+        return;
+    }
+    bplist_lazy_doc_release(ln->doc);
+    plist_mem_free(ln);
+}
 
-    data->type = PLIST_ARRAY;
-    data->length = size;
+/* records where the children of node are instead of parsing them */
+static int bplist_lazy_defer(struct bplist_data *bplist, plist_t node, const char *bnode, uint64_t size)
+{
+    plist_data_t data = plist_get_data(node);
+    struct bplist_lazy_node *ln = NULL;
+    node_t *p = NULL;
+
+    /* the parse path is not on the stack, so check the ancestors */
+    for (p = (node_t*)bplist->lazy_parent; p; p = p->parent) {
+        plist_data_t pdata = plist_get_data(p);
+        if ((pdata->flags & PLIST_DATA_BPLIST_INDEX) && pdata->hash == bplist->index) {
+            PLIST_BIN_ERR("recursion detected in binary plist\n");
+            return -1;
+        }
+    }
 
-    plist_t node = node_create(NULL, data);
+    data->hash = (uint32_t)bplist->index;
+    data->flags |= PLIST_DATA_BPLIST_INDEX;
+    if (size == 0) {
+        return 0;
+    }
 
-    for (j = 0; j < data->length; j++) {
-        str_j = j * bplist->ref_size;
-        index1_ptr = (*bnode) + str_j;
+    ln = (struct bplist_lazy_node*)plist_malloc(sizeof(struct bplist_lazy_node));
+    if (!ln) {
+        PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, (uint64_t)sizeof(struct bplist_lazy_node));
+        return -1;
+    }
+    ln->doc = bplist->lazy;
+    ln->doc->refcount++;
+    ln->refs = bnode;
+    ln->size = size;
+    data->hashtable = ln;
+    data->flags |= PLIST_DATA_LAZY;
+    return 0;
+}
 
-        if (index1_ptr < bplist->data || index1_ptr + bplist->ref_size > bplist->offset_table) {
-            plist_free(node);
-            PLIST_BIN_ERR("%s: array item %" PRIu64 " is outside of valid range\n", __func__, j);
-            return NULL;
+void plist_bin_load_children(plist_t node)
+{
+    plist_data_t data = plist_get_data(node);
+    struct bplist_lazy_node *ln = NULL;
+    struct bplist_data bplist;
+    int res = 0;
+
+    if (!data || !(data->flags & PLIST_DATA_LAZY)) {
+        return;
+    }
+    ln = (struct bplist_lazy_node*)data->hashtable;
+    data->hashtable = NULL;
+    data->flags &= ~PLIST_DATA_LAZY;
+
+    bplist = ln->doc->bplist;
+    bplist.index = data->hash;
+    res = parse_children(&bplist, node, ln->refs, ln->size);
+    if (res < 0) {
+        /* malformed containers end up empty */
+        node_t *ch = NULL;
+        while ((ch = node_first_child((node_t*)node))) {
+            plist_free(ch);
         }
+        data->length = 0;
+    }
+    plist_bin_lazy_free(ln);
+}
 
-        index1 = UINT_TO_HOST(index1_ptr, bplist->ref_size);
+static plist_t parse_dict_node(struct bplist_data *bplist, const char** bnode, uint64_t size)
+{
+    plist_data_t data = plist_new_plist_data_in(bplist->arena);
+    int res = 0;
 
-        if (index1 >= bplist->num_objects) {
-            plist_free(node);
-            PLIST_BIN_ERR("%s: array item %" PRIu64 " object index (%" PRIu64 ") must be smaller than the number of objects (%" PRIu64 ")\n", __func__, j, index1, bplist->num_objects);
-            return NULL;
-        }
+    data->type = PLIST_DICT;
+    data->length = size;
 
-        /* process value node */
-        plist_t val = parse_bin_node_at_index(bplist, index1);
-        if (!val) {
-            plist_free(node);
-            return NULL;
-        }
+    plist_t node = plist_new_node(data);
 
-        node_attach(node, val);
+    if (bplist->lazy) {
+        res = bplist_lazy_defer(bplist, node, *bnode, size);
+    } else if (size > 0) {
+        /* the children are parsed by parse_children */
+        bplist->pending_refs = *bnode;
+        bplist->pending_size = size;
+    }
+    if (res < 0) {
+        plist_free(node);
+        return NULL;
     }
 
     return node;
 }
 
-static plist_t parse_uid_node(const char **bnode, uint8_t size)
+static plist_t parse_array_node(struct bplist_data *bplist, const char** bnode, uint64_t size)
 {
-    plist_data_t data = plist_new_plist_data();
-    size = size + 1;
-    data->intval = UINT_TO_HOST(*bnode, size);
-    if (data->intval > UINT32_MAX) {
-        PLIST_BIN_ERR("%s: value %" PRIu64 " too large for UID node (must be <= %u)\n", __func__, (uint64_t)data->intval, UINT32_MAX);
-        free(data);
+    plist_data_t data = plist_new_plist_data_in(bplist->arena);
+    int res = 0;
+
+    data->type = PLIST_ARRAY;
+    data->length = size;
+
+    plist_t node = plist_new_node(data);
+
+    if (bplist->lazy) {
+        res = bplist_lazy_defer(bplist, node, *bnode, size);
+    } else if (size > 0) {
+        /* the children are parsed by parse_children */
+        bplist->pending_refs = *bnode;
+        bplist->pending_size = size;
+    }
+    if (res < 0) {
+        plist_free(node);
         return NULL;
     }
 
+    return node;
+}
+
+static plist_t parse_uid_node(struct bplist_data *bplist, const char **bnode, uint8_t size)
+{
+    plist_data_t data = plist_new_plist_data_in(bplist->arena);
+    size = size + 1;
+    /* values above UINT32_MAX are rejected by bplist_check_object */
+    data->intval = UINT_TO_HOST(*bnode, size);
+
     (*bnode) += size;
     data->type = PLIST_UID;
     data->length = sizeof(uint64_t);
 
-    return node_create(NULL, data);
+    return plist_new_node(data);
 }
 
-static plist_t parse_bin_node(struct bplist_data *bplist, const char** object)
+static int bplist_read_marker(struct bplist_data *bplist, const char **object, uint8_t *type, uint64_t *size)
 {
-    uint16_t type = 0;
-    uint64_t size = 0;
-    uint64_t pobject = 0;
-    uint64_t poffset_table = (uint64_t)(uintptr_t)bplist->offset_table;
-
-    if (!object)
-        return NULL;
-
-    type = (**object) & BPLIST_MASK;
-    size = (**object) & BPLIST_FILL;
+    *type = (**object) & BPLIST_MASK;
+    *size = (**object) & BPLIST_FILL;
     (*object)++;
 
-    if (size == BPLIST_FILL) {
-        switch (type) {
+    if (*size == BPLIST_FILL) {
+        switch (*type) {
         case BPLIST_DATA:
         case BPLIST_STRING:
         case BPLIST_UNICODE:
@@ -594,17 +1099,21 @@ static plist_t parse_bin_node(struct bplist_data *bplist, const char** object)
         case BPLIST_DICT:
         {
             uint16_t next_size = **object & BPLIST_FILL;
+            if (*object >= bplist->offset_table) {
+                PLIST_BIN_ERR("%s: size node for node type 0x%02x points outside of valid range\n", __func__, *type);
+                return -1;
+            }
             if ((**object & BPLIST_MASK) != BPLIST_UINT) {
-                PLIST_BIN_ERR("%s: invalid size node type for node type 0x%02x: found 0x%02x, expected 0x%02x\n", __func__, type, **object & BPLIST_MASK, BPLIST_UINT);
-                return NULL;
+                PLIST_BIN_ERR("%s: invalid size node type for node type 0x%02x: found 0x%02x, expected 0x%02x\n", __func__, *type, **object & BPLIST_MASK, BPLIST_UINT);
+                return -1;
             }
             (*object)++;
             next_size = 1 << next_size;
             if (*object + next_size > bplist->offset_table) {
-                PLIST_BIN_ERR("%s: size node data bytes for node type 0x%02x point outside of valid range\n", __func__, type);
-                return NULL;
+                PLIST_BIN_ERR("%s: size node data bytes for node type 0x%02x point outside of valid range\n", __func__, *type);
+                return -1;
             }
-            size = UINT_TO_HOST(*object, next_size);
+            *size = UINT_TO_HOST(*object, next_size);
             (*object) += next_size;
             break;
         }
@@ -612,173 +1121,308 @@ static plist_t parse_bin_node(struct bplist_data *bplist, const char** object)
             break;
         }
     }
+    return 0;
+}
+
+/* Decodes the marker of the object at *object, which is advanced to the
+ * object data, and checks that the object is well formed and that its data
+ * lies in front of the offset table. The references of containers are
+ * checked when they are read. Returns a plist_bin_error_t. */
+static int bplist_check_object(struct bplist_data *bplist, const char **object, uint8_t *type, uint64_t *size)
+{
+    uint64_t pobject = 0;
+    uint64_t poffset_table = (uint64_t)(uintptr_t)bplist->offset_table;
+
+    if (bplist_read_marker(bplist, object, type, size) < 0)
+        return PLIST_BIN_INVALID_OBJECT;
 
     pobject = (uint64_t)(uintptr_t)*object;
 
-    switch (type)
+    switch (*type)
     {
 
     case BPLIST_NULL:
-        switch (size)
-        {
-
-        case BPLIST_TRUE:
-        {
-            plist_data_t data = plist_new_plist_data();
-            data->type = PLIST_BOOLEAN;
-            data->boolval = TRUE;
-            data->length = 1;
-            return node_create(NULL, data);
-        }
-
-        case BPLIST_FALSE:
-        {
-            plist_data_t data = plist_new_plist_data();
-            data->type = PLIST_BOOLEAN;
-            data->boolval = FALSE;
-            data->length = 1;
-            return node_create(NULL, data);
-        }
-
-        case BPLIST_NULL:
-        default:
-            return NULL;
+        if (*size != BPLIST_TRUE && *size != BPLIST_FALSE) {
+            PLIST_BIN_ERR("%s: unsupported null or fill object\n", __func__);
+            return PLIST_BIN_INVALID_OBJECT;
         }
+        return PLIST_BIN_VALID;
 
     case BPLIST_UINT:
-        if (pobject + (uint64_t)(1 << size) > poffset_table) {
+        if (*size > 4) {
+            PLIST_BIN_ERR("%s: Invalid byte size for integer node\n", __func__);
+            return PLIST_BIN_INVALID_OBJECT;
+        }
+        if (pobject + (uint64_t)(1 << *size) > poffset_table) {
             PLIST_BIN_ERR("%s: BPLIST_UINT data bytes point outside of valid range\n", __func__);
-            return NULL;
+            return PLIST_BIN_INVALID_LENGTH;
         }
-        return parse_uint_node(object, size);
+        return PLIST_BIN_VALID;
 
     case BPLIST_REAL:
-        if (pobject + (uint64_t)(1 << size) > poffset_table) {
+        if (pobject + (uint64_t)(1 << *size) > poffset_table) {
             PLIST_BIN_ERR("%s: BPLIST_REAL data bytes point outside of valid range\n", __func__);
-            return NULL;
+            return PLIST_BIN_INVALID_LENGTH;
         }
-        return parse_real_node(object, size);
+        if (*size != 2 && *size != 3) {
+            PLIST_BIN_ERR("%s: Invalid byte size for real node\n", __func__);
+            return PLIST_BIN_INVALID_OBJECT;
+        }
+        return PLIST_BIN_VALID;
 
     case BPLIST_DATE:
-        if (3 != size) {
+        if (3 != *size) {
             PLIST_BIN_ERR("%s: invalid data size for BPLIST_DATE node\n", __func__);
-            return NULL;
+            return PLIST_BIN_INVALID_OBJECT;
         }
-        if (pobject + (uint64_t)(1 << size) > poffset_table) {
+        if (pobject + (uint64_t)(1 << *size) > poffset_table) {
             PLIST_BIN_ERR("%s: BPLIST_DATE data bytes point outside of valid range\n", __func__);
-            return NULL;
+            return PLIST_BIN_INVALID_LENGTH;
         }
-        return parse_date_node(object, size);
+        return PLIST_BIN_VALID;
 
     case BPLIST_DATA:
-        if (pobject + size < pobject || pobject + size > poffset_table) {
-            PLIST_BIN_ERR("%s: BPLIST_DATA data bytes point outside of valid range\n", __func__);
-            return NULL;
-        }
-        return parse_data_node(object, size);
-
     case BPLIST_STRING:
-        if (pobject + size < pobject || pobject + size > poffset_table) {
-            PLIST_BIN_ERR("%s: BPLIST_STRING data bytes point outside of valid range\n", __func__);
-            return NULL;
+    case BPLIST_SET:
+    case BPLIST_ARRAY:
+    case BPLIST_DICT:
+        /* containers are checked against their number of entries, each
+         * reference is checked by bplist_read_ref */
+        if (pobject + *size < pobject || pobject + *size > poffset_table) {
+            PLIST_BIN_ERR("%s: data bytes for node type 0x%02x point outside of valid range\n", __func__, *type);
+            return PLIST_BIN_INVALID_LENGTH;
         }
-        return parse_string_node(object, size);
+        return PLIST_BIN_VALID;
 
     case BPLIST_UNICODE:
-        if (size*2 < size) {
+        if (*size*2 < *size) {
             PLIST_BIN_ERR("%s: Integer overflow when calculating BPLIST_UNICODE data size.\n", __func__);
-            return NULL;
+            return PLIST_BIN_INVALID_LENGTH;
         }
-        if (pobject + size*2 < pobject || pobject + size*2 > poffset_table) {
+        if (pobject + *size*2 < pobject || pobject + *size*2 > poffset_table) {
             PLIST_BIN_ERR("%s: BPLIST_UNICODE data bytes point outside of valid range\n", __func__);
-            return NULL;
-        }
-        return parse_unicode_node(object, size);
-
-    case BPLIST_SET:
-    case BPLIST_ARRAY:
-        if (pobject + size < pobject || pobject + size > poffset_table) {
-            PLIST_BIN_ERR("%s: BPLIST_ARRAY data bytes point outside of valid range\n", __func__);
-            return NULL;
+            return PLIST_BIN_INVALID_LENGTH;
         }
-        return parse_array_node(bplist, object, size);
+        return PLIST_BIN_VALID;
 
     case BPLIST_UID:
-        if (pobject + size+1 > poffset_table) {
+        if (pobject + *size+1 > poffset_table) {
             PLIST_BIN_ERR("%s: BPLIST_UID data bytes point outside of valid range\n", __func__);
-            return NULL;
+            return PLIST_BIN_INVALID_LENGTH;
         }
-        return parse_uid_node(object, size);
-
-    case BPLIST_DICT:
-        if (pobject + size < pobject || pobject + size > poffset_table) {
-            PLIST_BIN_ERR("%s: BPLIST_DICT data bytes point outside of valid range\n", __func__);
-            return NULL;
+        if (UINT_TO_HOST(*object, *size + 1) > UINT32_MAX) {
+            PLIST_BIN_ERR("%s: value too large for UID node (must be <= %u)\n", __func__, UINT32_MAX);
+            return PLIST_BIN_INVALID_OBJECT;
         }
-        return parse_dict_node(bplist, object, size);
+        return PLIST_BIN_VALID;
 
     default:
-        PLIST_BIN_ERR("%s: unexpected node type 0x%02x\n", __func__, type);
-        return NULL;
+        PLIST_BIN_ERR("%s: unexpected node type 0x%02x\n", __func__, *type);
+        return PLIST_BIN_INVALID_OBJECT;
     }
-    return NULL;
 }
 
-static plist_t parse_bin_node_at_index(struct bplist_data *bplist, uint32_t node_index)
+static plist_t parse_bin_node(struct bplist_data *bplist, const char** object)
 {
-    int i = 0;
-    const char* ptr = NULL;
-    plist_t plist = NULL;
-    const char* idx_ptr = NULL;
+    uint8_t type = 0;
+    uint64_t size = 0;
 
-    if (node_index >= bplist->num_objects) {
-        PLIST_BIN_ERR("node index (%u) must be smaller than the number of objects (%" PRIu64 ")\n", node_index, bplist->num_objects);
+    if (!object)
         return NULL;
-    }
 
-    idx_ptr = bplist->offset_table + node_index * bplist->offset_size;
-    if (idx_ptr < bplist->offset_table ||
+    if (bplist_check_object(bplist, object, &type, &size) != PLIST_BIN_VALID)
+        return NULL;
+
+    if (bplist->limits) {
+        int res = 0;
+        switch (type)
+        {
+        case BPLIST_STRING:
+            res = bplist_limit_node(bplist, PLIST_STRING, size, PLIST_DATA_SHARED);
+            break;
+        case BPLIST_UNICODE:
+            /* counted once the length in UTF-8 is known */
+            break;
+        case BPLIST_DATA:
+            res = bplist_limit_node(bplist, PLIST_DATA, size, (bplist->options & PLIST_PARSE_BORROW) ? PLIST_DATA_BORROWED : PLIST_DATA_SHARED);
+            break;
+        case BPLIST_SET:
+        case BPLIST_ARRAY:
+            res = bplist_limit_node(bplist, PLIST_ARRAY, size, 0);
+            break;
+        case BPLIST_DICT:
+            res = bplist_limit_node(bplist, PLIST_DICT, size, 0);
+            break;
+        default:
+            res = bplist_limit_node(bplist, PLIST_NONE, 0, 0);
+            break;
+        }
+        if (res < 0) {
+            return NULL;
+        }
+    }
+
+    switch (type)
+    {
+
+    case BPLIST_NULL:
+    {
+        plist_data_t data = plist_new_plist_data_in(bplist->arena);
+        data->type = PLIST_BOOLEAN;
+        data->boolval = (size == BPLIST_TRUE) ? TRUE : FALSE;
+        data->length = 1;
+        return plist_new_node(data);
+    }
+
+    case BPLIST_UINT:
+        return parse_uint_node(bplist, object, size);
+
+    case BPLIST_REAL:
+        return parse_real_node(bplist, object, size);
+
+    case BPLIST_DATE:
+        return parse_date_node(bplist, object, size);
+
+    case BPLIST_DATA:
+        return parse_data_node(bplist, object, size);
+
+    case BPLIST_STRING:
+        return parse_string_node(bplist, object, size);
+
+    case BPLIST_UNICODE:
+        return parse_unicode_node(bplist, object, size);
+
+    case BPLIST_SET:
+    case BPLIST_ARRAY:
+        return parse_array_node(bplist, object, size);
+
+    case BPLIST_UID:
+        return parse_uid_node(bplist, object, size);
+
+    case BPLIST_DICT:
+        return parse_dict_node(bplist, object, size);
+
+    default:
+        break;
+    }
+    return NULL;
+}
+
+static const char *bplist_object_at_index(struct bplist_data *bplist, uint64_t node_index)
+{
+    const char* ptr = NULL;
+    const char* idx_ptr = NULL;
+    uint64_t offset = 0;
+
+    if (node_index >= bplist->num_objects) {
+        PLIST_BIN_ERR("node index (%" PRIu64 ") must be smaller than the number of objects (%" PRIu64 ")\n", node_index, bplist->num_objects);
+        return NULL;
+    }
+
+    idx_ptr = bplist->offset_table + node_index * bplist->offset_size;
+    if (idx_ptr < bplist->offset_table ||
         idx_ptr >= bplist->offset_table + bplist->num_objects * bplist->offset_size) {
-        PLIST_BIN_ERR("node index %u points outside of valid range\n", node_index);
+        PLIST_BIN_ERR("node index %" PRIu64 " points outside of valid range\n", node_index);
         return NULL;
     }
 
-    ptr = bplist->data + UINT_TO_HOST(idx_ptr, bplist->offset_size);
+    offset = UINT_TO_HOST(idx_ptr, bplist->offset_size);
     /* make sure the node offset is in a sane range */
-    if ((ptr < bplist->data) || (ptr >= bplist->offset_table)) {
-        PLIST_BIN_ERR("offset for node index %u points outside of valid range\n", node_index);
+    if (offset >= (uint64_t)(bplist->offset_table - bplist->data)) {
+        PLIST_BIN_ERR("offset for node index %" PRIu64 " points outside of valid range\n", node_index);
         return NULL;
     }
+    ptr = bplist->data + offset;
+    return ptr;
+}
 
-    /* store node_index for current recursion level */
-    if (plist_array_get_size(bplist->used_indexes) < bplist->level+1) {
-        while (plist_array_get_size(bplist->used_indexes) < bplist->level+1) {
-            plist_array_append_item(bplist->used_indexes, plist_new_uint(node_index));
-        }
-    } else {
-        plist_array_set_item(bplist->used_indexes, plist_new_uint(node_index), bplist->level);
+/* returns the node decoded in advance for an object index, the first
+ * reference gets the decoded node itself and later ones get a copy */
+static plist_t bplist_take_slot(struct bplist_data *bplist, uint64_t node_index)
+{
+    plist_t node = bplist->slots[node_index];
+    plist_data_t data = NULL;
+
+    if (!BPLIST_INDEX_IS_TAKEN(bplist, node_index)) {
+        BPLIST_INDEX_SET_TAKEN(bplist, node_index);
+        return node;
+    }
+    node = plist_copy(node);
+    data = plist_get_data(node);
+    /* the first reference might have been turned into a dict key */
+    if (data && data->type == PLIST_KEY) {
+        data->type = PLIST_STRING;
+    }
+    return node;
+}
+
+/* parses a single object, the children of a container are left in
+ * bplist->pending_refs unless it is parsed lazily */
+static plist_t parse_bin_node_at_index(struct bplist_data *bplist, uint64_t node_index)
+{
+    const char* ptr = NULL;
+
+    if (bplist->slots && node_index < bplist->num_objects && bplist->slots[node_index]) {
+        bplist->index = node_index;
+        bplist->pending_refs = NULL;
+        bplist->pending_size = 0;
+        return bplist_take_slot(bplist, node_index);
     }
 
-    /* recursion check */
-    if (bplist->level > 0) {
-        for (i = bplist->level-1; i >= 0; i--) {
-            plist_t node_i = plist_array_get_item(bplist->used_indexes, i);
-            plist_t node_level = plist_array_get_item(bplist->used_indexes, bplist->level);
-            if (plist_compare_node_value(node_i, node_level)) {
-                PLIST_BIN_ERR("recursion detected in binary plist\n");
-                return NULL;
-            }
-        }
+    ptr = bplist_object_at_index(bplist, node_index);
+    if (!ptr) {
+        return NULL;
     }
 
-    /* finally parse node */
-    bplist->level++;
-    plist = parse_bin_node(bplist, &ptr);
-    bplist->level--;
+    bplist->index = node_index;
+    bplist->pending_refs = NULL;
+    bplist->pending_size = 0;
+    return parse_bin_node(bplist, &ptr);
+}
+
+/* parses the object at node_index including all its descendants */
+static plist_t parse_bin_tree(struct bplist_data *bplist, uint64_t node_index)
+{
+    plist_t plist = parse_bin_node_at_index(bplist, node_index);
+    if (plist && bplist->pending_refs) {
+        int res = 0;
+        BPLIST_INDEX_SET_USED(bplist, node_index);
+        res = parse_children(bplist, plist, bplist->pending_refs, bplist->pending_size);
+        BPLIST_INDEX_CLEAR_USED(bplist, node_index);
+        if (res < 0) {
+            plist_free(plist);
+            return NULL;
+        }
+    }
     return plist;
 }
 
 PLIST_API void plist_from_bin(const char *plist_bin, uint32_t length, plist_t * plist)
+{
+    plist_from_bin_internal(plist_bin, length, plist, NULL, PLIST_PARSE_DEFAULT);
+}
+
+PLIST_API void plist_from_bin_arena(const char *plist_bin, uint32_t length, plist_t * plist, plist_arena_t arena)
+{
+    plist_from_bin_internal(plist_bin, length, plist, arena, PLIST_PARSE_DEFAULT);
+}
+
+PLIST_API void plist_from_bin_ex(const char *plist_bin, uint32_t length, uint32_t options, plist_t * plist)
+{
+    plist_from_bin_internal(plist_bin, length, plist, NULL, options);
+}
+
+PLIST_API void plist_from_bin64(const char *plist_bin, uint64_t length, uint32_t options, plist_t * plist)
+{
+    if (!plist) {
+        return;
+    }
+    *plist = NULL;
+    plist_from_bin_internal(plist_bin, length, plist, NULL, options);
+}
+
+/* checks the header, trailer and offset table, returns a plist_bin_error_t */
+static int bplist_data_init(struct bplist_data *bplist, const char *plist_bin, uint64_t length, uint64_t *root_index, struct plist_context_s *ctx)
 {
     bplist_trailer_t *trailer = NULL;
     uint8_t offset_size = 0;
@@ -786,6 +1430,7 @@ PLIST_API void plist_from_bin(const char *plist_bin, uint32_t length, plist_t *
     uint64_t num_objects = 0;
     uint64_t root_object = 0;
     const char *offset_table = NULL;
+    uint64_t offset_table_offset = 0;
     uint64_t offset_table_size = 0;
     const char *start_data = NULL;
     const char *end_data = NULL;
@@ -793,17 +1438,17 @@ PLIST_API void plist_from_bin(const char *plist_bin, uint32_t length, plist_t *
     //first check we have enough data
     if (!(length >= BPLIST_MAGIC_SIZE + BPLIST_VERSION_SIZE + sizeof(bplist_trailer_t))) {
         PLIST_BIN_ERR("plist data is to small to hold a binary plist\n");
-        return;
+        return PLIST_BIN_INVALID_HEADER;
     }
     //check that plist_bin in actually a plist
     if (memcmp(plist_bin, BPLIST_MAGIC, BPLIST_MAGIC_SIZE) != 0) {
         PLIST_BIN_ERR("bplist magic mismatch\n");
-        return;
+        return PLIST_BIN_INVALID_HEADER;
     }
     //check for known version
     if (memcmp(plist_bin + BPLIST_MAGIC_SIZE, BPLIST_VERSION, BPLIST_VERSION_SIZE) != 0) {
         PLIST_BIN_ERR("unsupported binary plist version '%.2s\n", plist_bin+BPLIST_MAGIC_SIZE);
-        return;
+        return PLIST_BIN_INVALID_HEADER;
     }
 
     start_data = plist_bin + BPLIST_MAGIC_SIZE + BPLIST_VERSION_SIZE;
@@ -816,506 +1461,2973 @@ PLIST_API void plist_from_bin(const char *plist_bin, uint32_t length, plist_t *
     ref_size = trailer->ref_size;
     num_objects = be64toh(trailer->num_objects);
     root_object = be64toh(trailer->root_object_index);
-    offset_table = (char *)(plist_bin + be64toh(trailer->offset_table_offset));
+    offset_table_offset = be64toh(trailer->offset_table_offset);
+    if (offset_table_offset > length) {
+        PLIST_BIN_ERR("offset table offset points outside of valid range\n");
+        return PLIST_BIN_INVALID_OFFSET;
+    }
+    offset_table = (char *)(plist_bin + offset_table_offset);
 
     if (num_objects == 0) {
         PLIST_BIN_ERR("number of objects must be larger than 0\n");
-        return;
+        return PLIST_BIN_INVALID_TRAILER;
     }
 
     if (offset_size == 0) {
         PLIST_BIN_ERR("offset size in trailer must be larger than 0\n");
-        return;
+        return PLIST_BIN_INVALID_TRAILER;
     }
 
     if (ref_size == 0) {
         PLIST_BIN_ERR("object reference size in trailer must be larger than 0\n");
-        return;
+        return PLIST_BIN_INVALID_TRAILER;
     }
 
     if (root_object >= num_objects) {
         PLIST_BIN_ERR("root object index (%" PRIu64 ") must be smaller than number of objects (%" PRIu64 ")\n", root_object, num_objects);
-        return;
+        return PLIST_BIN_INVALID_TRAILER;
     }
 
     if (offset_table < start_data || offset_table >= end_data) {
         PLIST_BIN_ERR("offset table offset points outside of valid range\n");
-        return;
+        return PLIST_BIN_INVALID_OFFSET;
     }
 
     if (uint64_mul_overflow(num_objects, offset_size, &offset_table_size)) {
         PLIST_BIN_ERR("integer overflow when calculating offset table size\n");
-        return;
+        return PLIST_BIN_INVALID_OFFSET;
     }
 
     if ((offset_table + offset_table_size < offset_table) || (offset_table + offset_table_size > end_data)) {
         PLIST_BIN_ERR("offset table points outside of valid range\n");
-        return;
+        return PLIST_BIN_INVALID_OFFSET;
     }
 
-    struct bplist_data bplist;
-    bplist.data = plist_bin;
-    bplist.size = length;
-    bplist.num_objects = num_objects;
-    bplist.ref_size = ref_size;
-    bplist.offset_size = offset_size;
-    bplist.offset_table = offset_table;
-    bplist.level = 0;
-    bplist.used_indexes = plist_new_array();
-
-    if (!bplist.used_indexes) {
-        PLIST_BIN_ERR("failed to create array to hold used node indexes. Out of memory?\n");
-        return;
+    bplist->data = plist_bin;
+    bplist->size = length;
+    bplist->num_objects = num_objects;
+    bplist->ref_size = ref_size;
+    bplist->offset_size = offset_size;
+    bplist->offset_table = offset_table;
+    bplist->pending_refs = NULL;
+    bplist->pending_size = 0;
+    if (ctx) {
+        /* the bitmap of a context is all clear between calls */
+        uint64_t size = (num_objects + 7) / 8;
+        if (size > ctx->used_indexes_size) {
+            uint8_t *used_indexes = (uint8_t*)plist_realloc(ctx->used_indexes, size);
+            if (used_indexes) {
+                memset(used_indexes + ctx->used_indexes_size, 0, size - ctx->used_indexes_size);
+                ctx->used_indexes = used_indexes;
+                ctx->used_indexes_size = size;
+            }
+        }
+        bplist->used_indexes = (size <= ctx->used_indexes_size) ? ctx->used_indexes : NULL;
+    } else {
+        bplist->used_indexes = (uint8_t*)plist_calloc(1, (num_objects + 7) / 8);
+    }
+    bplist->ctx = ctx;
+    bplist->arena = NULL;
+    bplist->key_cache = NULL;
+    bplist->intern_keys = 0;
+    bplist->options = 0;
+    bplist->lazy = NULL;
+    bplist->lazy_parent = NULL;
+    bplist->index = 0;
+    bplist->slots = NULL;
+    bplist->slots_taken = NULL;
+    bplist->limits = NULL;
+
+    if (!bplist->used_indexes) {
+        PLIST_BIN_ERR("failed to create bitmap to hold used node indexes. Out of memory?\n");
+        return PLIST_BIN_NO_MEMORY;
     }
 
-    *plist = parse_bin_node_at_index(&bplist, root_object);
-
-    plist_free(bplist.used_indexes);
+    *root_index = root_object;
+    return PLIST_BIN_VALID;
 }
 
-static unsigned int plist_data_hash(const void* key)
+static void bplist_parse(const char *plist_bin, uint64_t length, plist_t * plist, plist_arena_t arena, uint32_t options, struct plist_limits_s *limits)
 {
-    plist_data_t data = plist_get_data((plist_t) key);
-
-    unsigned int hash = data->type;
-    unsigned int i = 0;
-
-    char *buff = NULL;
-    unsigned int size = 0;
+    struct bplist_data bplist;
+    uint64_t root_object = 0;
 
-    switch (data->type)
-    {
-    case PLIST_BOOLEAN:
-    case PLIST_UINT:
-    case PLIST_REAL:
-    case PLIST_DATE:
-    case PLIST_UID:
-        buff = (char *) &data->intval;	//works also for real as we use an union
-        size = 8;
-        break;
-    case PLIST_KEY:
-    case PLIST_STRING:
-        buff = data->strval;
-        size = data->length;
-        break;
-    case PLIST_DATA:
-    case PLIST_ARRAY:
-    case PLIST_DICT:
-        //for these types only hash pointer
-        buff = (char *) &key;
-        size = sizeof(const void*);
-        break;
-    default:
-        break;
+    if (bplist_data_init(&bplist, plist_bin, length, &root_object, NULL) != PLIST_BIN_VALID) {
+        return;
     }
-
-    // now perform hash using djb2 hashing algorithm
-    // see: http://www.cse.yorku.ca/~oz/hash.html
-    hash += 5381;
-    for (i = 0; i < size; buff++, i++) {
-        hash = ((hash << 5) + hash) + *buff;
+    bplist.arena = arena;
+    bplist.options = options;
+    bplist.limits = limits;
+    /* cleared on the first key if the arena doesn't intern keys */
+    bplist.intern_keys = (arena != NULL);
+
+    if ((options & PLIST_PARSE_LAZY) && !arena) {
+        /* the deferred containers share the parser state */
+        struct bplist_lazy_doc *doc = (struct bplist_lazy_doc*)plist_malloc(sizeof(struct bplist_lazy_doc));
+        if (!doc) {
+            plist_mem_free(bplist.used_indexes);
+            return;
+        }
+        doc->refcount = 1;
+        bplist.lazy = doc;
+        doc->bplist = bplist;
+        PLIST_STAT_TIMER_START(lazy_start);
+        *plist = parse_bin_tree(&bplist, root_object);
+        PLIST_STAT_TIMER_STOP(bin_parse_time, lazy_start);
+        bplist_lazy_doc_release(doc);
+        return;
     }
 
-    return hash;
+    PLIST_STAT_TIMER_START(parse_start);
+    *plist = parse_bin_tree(&bplist, root_object);
+    PLIST_STAT_TIMER_STOP(bin_parse_time, parse_start);
+
+    plist_mem_free(bplist.key_cache);
+    plist_mem_free(bplist.used_indexes);
 }
 
-struct serialize_s
+void plist_from_bin_internal(const char *plist_bin, uint64_t length, plist_t * plist, plist_arena_t arena, uint32_t options)
 {
-    ptrarray_t* objects;
-    hashtable_t* ref_table;
-};
+    bplist_parse(plist_bin, length, plist, arena, options, NULL);
+}
 
-static void serialize_plist(node_t* node, void* data)
+PLIST_API int plist_from_bin_limited(const char *plist_bin, uint64_t length, uint32_t options, const plist_parse_limits_t *limits, plist_t * plist)
 {
-    uint64_t *index_val = NULL;
-    struct serialize_s *ser = (struct serialize_s *) data;
-    uint64_t current_index = ser->objects->len;
+    struct plist_limits_s state;
 
-    //first check that node is not yet in objects
-    void* val = hash_table_lookup(ser->ref_table, node);
-    if (val)
-    {
-        //data is already in table
-        return;
+    if (!plist) {
+        return -1;
     }
-    //insert new ref
-    index_val = (uint64_t *) malloc(sizeof(uint64_t));
-    assert(index_val != NULL);
-    *index_val = current_index;
-    hash_table_insert(ser->ref_table, node, index_val);
-
-    //now append current node to object array
-    ptr_array_add(ser->objects, node);
-
-    //now recurse on children
-    node_iterator_t *ni = node_iterator_create(node->children);
-    node_t *ch;
-    while ((ch = node_iterator_next(ni))) {
-        serialize_plist(ch, data);
+    *plist = NULL;
+    options &= ~PLIST_PARSE_LAZY;
+    if (!limits) {
+        bplist_parse(plist_bin, length, plist, NULL, options, NULL);
+        return (*plist) ? 0 : -1;
     }
-    node_iterator_destroy(ni);
-
-    return;
+    plist_limits_init(&state, limits, length);
+    bplist_parse(plist_bin, length, plist, NULL, options, &state);
+    if (*plist) {
+        return 0;
+    }
+    return (state.exceeded) ? -2 : -1;
 }
 
-#define Log2(x) (x == 8 ? 3 : (x == 4 ? 2 : (x == 2 ? 1 : 0)))
-
-static void write_int(bytearray_t * bplist, uint64_t val)
-{
-    int size = get_needed_bytes(val);
-    uint8_t sz;
-    //do not write 3bytes int node
-    if (size == 3)
-        size++;
-    sz = BPLIST_UINT | Log2(size);
+/* a container whose references are checked by plist_bin_validate */
+struct bplist_validate_frame {
+    const char *refs;
+    uint64_t size;
+    uint64_t pos;
+    uint64_t index;
+    /* nesting levels below the container found so far */
+    uint32_t height;
+    int is_dict;
+};
 
-    val = be64toh(val);
-    byte_array_append(bplist, &sz, 1);
-    byte_array_append(bplist, (uint8_t*)&val + (8-size), size);
-}
+/* plist_bin_validate keeps 1 + the height of each container that has been
+ * checked completely, 0 for the others. Saturated heights are checked
+ * again. */
+#define BPLIST_HEIGHT_MAX UINT16_MAX
 
-static void write_uint(bytearray_t * bplist, uint64_t val)
+static int bplist_is_container(uint8_t type)
 {
-    uint8_t sz = BPLIST_UINT | 4;
-    uint64_t zero = 0;
-
-    val = be64toh(val);
-    byte_array_append(bplist, &sz, 1);
-    byte_array_append(bplist, &zero, sizeof(uint64_t));
-    byte_array_append(bplist, &val, sizeof(uint64_t));
+    return (type == BPLIST_ARRAY || type == BPLIST_SET || type == BPLIST_DICT);
 }
 
-static void write_real(bytearray_t * bplist, double val)
+/* checks the object at index like parse_bin_node_at_index would parse it */
+static int bplist_check_object_at_index(struct bplist_data *bplist, uint64_t index, const char **object, uint8_t *type, uint64_t *size)
 {
-    int size = get_real_bytes(val);	//cheat to know used space
-    uint8_t buff[16];
-    buff[7] = BPLIST_REAL | Log2(size);
-    if (size == sizeof(float)) {
-        float floatval = (float)val;
-        *(uint32_t*)(buff+8) = float_bswap32(*(uint32_t*)&floatval);
-    } else {
-        *(uint64_t*)(buff+8) = float_bswap64(*(uint64_t*)&val);
+    *object = bplist_object_at_index(bplist, index);
+    if (!*object) {
+        return PLIST_BIN_INVALID_OFFSET;
     }
-    byte_array_append(bplist, buff+7, size+1);
+    return bplist_check_object(bplist, object, type, size);
 }
 
-static void write_date(bytearray_t * bplist, double val)
+/* the same walk as parse_children, without creating nodes */
+static int bplist_validate_children(struct bplist_data *bplist, uint64_t root, const char *refs, uint64_t size, int is_dict)
 {
-    uint8_t buff[16];
-    buff[7] = BPLIST_DATE | 3;
-    *(uint64_t*)(buff+8) = float_bswap64(*(uint64_t*)&val);
-    byte_array_append(bplist, buff+7, 9);
-}
+    struct bplist_validate_frame *frames = NULL;
+    struct bplist_validate_frame *f = NULL;
+    uint16_t *heights = NULL;
+    uint32_t capacity = 16;
+    uint32_t depth = 0;
+    uint32_t max_depth = plist_get_max_depth();
+    const char *ptr = NULL;
+    uint8_t type = 0;
+    uint64_t index1 = 0;
+    uint64_t index2 = 0;
+    uint64_t j = 0;
+    int res = PLIST_BIN_VALID;
+
+    frames = (struct bplist_validate_frame*)plist_malloc(capacity * sizeof(struct bplist_validate_frame));
+    heights = (uint16_t*)plist_calloc(bplist->num_objects, sizeof(uint16_t));
+    if (!frames || !heights) {
+        plist_mem_free(frames);
+        plist_mem_free(heights);
+        return PLIST_BIN_NO_MEMORY;
+    }
+    frames[0].refs = refs;
+    frames[0].size = size;
+    frames[0].pos = 0;
+    frames[0].index = root;
+    frames[0].height = 0;
+    frames[0].is_dict = is_dict;
+    BPLIST_INDEX_SET_USED(bplist, root);
+    depth = 1;
+
+    while (depth > 0) {
+        uint32_t height = 0;
+        f = &frames[depth-1];
+        if (f->pos >= f->size) {
+            height = f->height + 1;
+            heights[f->index] = (height < BPLIST_HEIGHT_MAX) ? height : BPLIST_HEIGHT_MAX;
+            BPLIST_INDEX_CLEAR_USED(bplist, f->index);
+            depth--;
+            if (depth > 0 && frames[depth-1].height < height) {
+                frames[depth-1].height = height;
+            }
+            continue;
+        }
+        j = f->pos++;
 
-static void write_raw_data(bytearray_t * bplist, uint8_t mark, uint8_t * val, uint64_t size)
-{
-    uint8_t marker = mark | (size < 15 ? size : 0xf);
-    byte_array_append(bplist, &marker, sizeof(uint8_t));
-    if (size >= 15) {
-        write_int(bplist, size);
+        if (f->is_dict) {
+            if (bplist_read_ref(bplist, f->refs, j, &index1) < 0 || bplist_read_ref(bplist, f->refs, j + f->size, &index2) < 0) {
+                res = PLIST_BIN_INVALID_REFERENCE;
+                break;
+            }
+            res = bplist_check_object_at_index(bplist, index1, &ptr, &type, &size);
+            if (res != PLIST_BIN_VALID) {
+                break;
+            }
+            if (type != BPLIST_STRING && type != BPLIST_UNICODE) {
+                PLIST_BIN_ERR("%s: dict entry %" PRIu64 ": invalid node type for key\n", __func__, j);
+                res = PLIST_BIN_INVALID_KEY;
+                break;
+            }
+        } else if (bplist_read_ref(bplist, f->refs, j, &index2) < 0) {
+            res = PLIST_BIN_INVALID_REFERENCE;
+            break;
+        }
+
+        if (BPLIST_INDEX_IS_USED(bplist, index2)) {
+            PLIST_BIN_ERR("recursion detected in binary plist\n");
+            res = PLIST_BIN_INVALID_RECURSION;
+            break;
+        }
+        res = bplist_check_object_at_index(bplist, index2, &ptr, &type, &size);
+        if (res != PLIST_BIN_VALID) {
+            break;
+        }
+        if (!bplist_is_container(type)) {
+            continue;
+        }
+        if (1 + depth > max_depth) {
+            PLIST_BIN_ERR("%s: maximum nesting depth (%u) exceeded\n", __func__, max_depth);
+            res = PLIST_BIN_INVALID_DEPTH;
+            break;
+        }
+        height = heights[index2];
+        if (size == 0 || (height > 0 && height < BPLIST_HEIGHT_MAX)) {
+            /* empty, or checked before: only its depth is left to check */
+            if (size == 0) {
+                height = 1;
+            } else if (depth + height > max_depth) {
+                PLIST_BIN_ERR("%s: maximum nesting depth (%u) exceeded\n", __func__, max_depth);
+                res = PLIST_BIN_INVALID_DEPTH;
+                break;
+            }
+            if (f->height < height) {
+                f->height = height;
+            }
+            continue;
+        }
+        if (depth >= capacity) {
+            struct bplist_validate_frame *newframes = (struct bplist_validate_frame*)plist_realloc(frames, capacity * 2 * sizeof(struct bplist_validate_frame));
+            if (!newframes) {
+                res = PLIST_BIN_NO_MEMORY;
+                break;
+            }
+            frames = newframes;
+            capacity *= 2;
+        }
+        BPLIST_INDEX_SET_USED(bplist, index2);
+        f = &frames[depth++];
+        f->refs = ptr;
+        f->size = size;
+        f->pos = 0;
+        f->index = index2;
+        f->height = 0;
+        f->is_dict = (type == BPLIST_DICT);
     }
-    if (BPLIST_UNICODE==mark) size <<= 1;
-    byte_array_append(bplist, val, size);
-}
 
-static void write_data(bytearray_t * bplist, uint8_t * val, uint64_t size)
-{
-    write_raw_data(bplist, BPLIST_DATA, val, size);
+    plist_mem_free(heights);
+    plist_mem_free(frames);
+    return res;
 }
 
-static void write_string(bytearray_t * bplist, char *val)
+PLIST_API int plist_bin_validate(const char *plist_bin, uint64_t length, plist_bin_error_t *error)
 {
-    uint64_t size = strlen(val);
-    write_raw_data(bplist, BPLIST_STRING, (uint8_t *) val, size);
+    struct bplist_data bplist;
+    uint64_t root = 0;
+    const char *ptr = NULL;
+    uint8_t type = 0;
+    uint64_t size = 0;
+    int res = PLIST_BIN_INVALID_HEADER;
+
+    if (plist_bin) {
+        res = bplist_data_init(&bplist, plist_bin, length, &root, NULL);
+    }
+    if (res == PLIST_BIN_VALID) {
+        res = bplist_check_object_at_index(&bplist, root, &ptr, &type, &size);
+        if (res == PLIST_BIN_VALID && bplist_is_container(type) && size > 0) {
+            res = bplist_validate_children(&bplist, root, ptr, size, (type == BPLIST_DICT));
+        }
+        plist_mem_free(bplist.used_indexes);
+    }
+    if (error) {
+        *error = (plist_bin_error_t)res;
+    }
+    return (res == PLIST_BIN_VALID) ? 0 : -1;
 }
 
-static void write_unicode(bytearray_t * bplist, uint16_t * val, uint64_t size)
+PLIST_API plist_context_t plist_context_new(void)
 {
-    uint64_t i = 0;
-    uint16_t *buff = (uint16_t*)malloc(size << 1);
-    for (i = 0; i < size; i++)
-        buff[i] = be16toh(val[i]);
-    write_raw_data(bplist, BPLIST_UNICODE, (uint8_t*)buff, size);
-    free(buff);
+    return plist_calloc(1, sizeof(struct plist_context_s));
 }
 
-static void write_array(bytearray_t * bplist, node_t* node, hashtable_t* ref_table, uint8_t ref_size)
+PLIST_API void plist_context_free(plist_context_t context)
 {
-    node_t* cur = NULL;
-    uint64_t i = 0;
-
-    uint64_t size = node_n_children(node);
-    uint8_t marker = BPLIST_ARRAY | (size < 15 ? size : 0xf);
-    byte_array_append(bplist, &marker, sizeof(uint8_t));
-    if (size >= 15) {
-        write_int(bplist, size);
+    struct plist_context_s *ctx = (struct plist_context_s*)context;
+    if (!ctx) {
+        return;
     }
-
-    for (i = 0, cur = node_first_child(node); cur && i < size; cur = node_next_sibling(cur), i++) {
-        uint64_t idx = *(uint64_t *) (hash_table_lookup(ref_table, cur));
-        idx = be64toh(idx);
-        byte_array_append(bplist, (uint8_t*)&idx + (sizeof(uint64_t) - ref_size), ref_size);
+    plist_mem_free(ctx->used_indexes);
+    plist_mem_free(ctx->frames);
+    plist_mem_free(ctx->refs);
+    if (ctx->objects) {
+        ptr_array_free(ctx->objects);
     }
+    hash_table_destroy(ctx->ref_table);
+    hash_table_destroy(ctx->containers);
+    plist_mem_free(ctx->obj_refs);
+    plist_mem_free(ctx->ref_starts);
+    plist_mem_free(ctx->offsets);
+    byte_array_free(ctx->out);
+    plist_mem_free(ctx);
 }
 
-static void write_dict(bytearray_t * bplist, node_t* node, hashtable_t* ref_table, uint8_t ref_size)
+PLIST_API void plist_from_bin_ctx(plist_context_t context, const char *plist_bin, uint32_t length, plist_t * plist)
 {
-    node_t* cur = NULL;
-    uint64_t i = 0;
+    struct plist_context_s *ctx = (struct plist_context_s*)context;
+    struct bplist_data bplist;
+    uint64_t root_object = 0;
+
+    if (!ctx) {
+        plist_from_bin(plist_bin, length, plist);
+        return;
+    }
+    if (bplist_data_init(&bplist, plist_bin, length, &root_object, ctx) != PLIST_BIN_VALID) {
+        return;
+    }
+
+    PLIST_STAT_TIMER_START(parse_start);
+    *plist = parse_bin_tree(&bplist, root_object);
+    PLIST_STAT_TIMER_STOP(bin_parse_time, parse_start);
+    if (!*plist) {
+        /* leave the bitmap clear for the next call */
+        memset(ctx->used_indexes, 0, (bplist.num_objects + 7) / 8);
+    }
+}
+
+/* objects per thread below which the parallel parser and writer don't start
+ * more threads if the number of threads is chosen automatically */
+#define BPLIST_PARALLEL_MIN_OBJECTS 4096
+
+struct bplist_decode_job {
+    /* private copy of the parser state */
+    struct bplist_data bplist;
+    uint64_t first;
+    uint64_t last;
+};
+
+/* decodes the scalar objects with an index in [first, last) into their
+ * slots, containers and invalid objects are left to the tree walk */
+static void bplist_decode_range(void *arg)
+{
+    struct bplist_decode_job *job = (struct bplist_decode_job*)arg;
+    struct bplist_data *bplist = &job->bplist;
+    const char *ptr = NULL;
+    uint8_t type = 0;
+    uint64_t i = 0;
+
+    for (i = job->first; i < job->last; i++) {
+        ptr = bplist_object_at_index(bplist, i);
+        if (!ptr) {
+            continue;
+        }
+        type = (*ptr) & BPLIST_MASK;
+        if (type == BPLIST_ARRAY || type == BPLIST_SET || type == BPLIST_DICT) {
+            continue;
+        }
+        bplist->slots[i] = parse_bin_node(bplist, &ptr);
+    }
+}
+
+static uint32_t bplist_num_cpus(void)
+{
+#ifdef WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0) ? (uint32_t)info.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (uint32_t)n : 1;
+#endif
+}
+
+struct bplist_thread {
+    void (*func)(void *job);
+    void *job;
+};
+
+#ifdef WIN32
+static DWORD WINAPI bplist_thread_main(LPVOID arg)
+{
+    struct bplist_thread *thread = (struct bplist_thread*)arg;
+    thread->func(thread->job);
+    return 0;
+}
+#else
+static void *bplist_thread_main(void *arg)
+{
+    struct bplist_thread *thread = (struct bplist_thread*)arg;
+    thread->func(thread->job);
+    return NULL;
+}
+#endif
+
+/* Runs func for each of the njobs jobs of job_size bytes, each on a thread
+ * of its own. The calling thread takes the first job, and also the job of
+ * any thread that could not be started. */
+static void bplist_run_jobs(void *jobs, size_t job_size, uint32_t njobs, void (*func)(void *job))
+{
+    struct bplist_thread *threads = NULL;
+#ifdef WIN32
+    HANDLE *handles = NULL;
+#else
+    pthread_t *handles = NULL;
+    uint8_t *started = NULL;
+#endif
+    uint32_t i = 0;
+
+    threads = (struct bplist_thread*)plist_calloc(njobs, sizeof(struct bplist_thread));
+#ifdef WIN32
+    handles = (HANDLE*)plist_calloc(njobs, sizeof(HANDLE));
+#else
+    handles = (pthread_t*)plist_calloc(njobs, sizeof(pthread_t));
+    started = (uint8_t*)plist_calloc(njobs, 1);
+#endif
+    for (i = 1; i < njobs; i++) {
+        void *job = (char*)jobs + i * job_size;
+#ifdef WIN32
+        if (threads && handles) {
+            threads[i].func = func;
+            threads[i].job = job;
+            handles[i] = CreateThread(NULL, 0, bplist_thread_main, &threads[i], 0, NULL);
+        }
+        if (!handles || !handles[i]) {
+            func(job);
+        }
+#else
+        if (threads && handles && started) {
+            threads[i].func = func;
+            threads[i].job = job;
+            started[i] = (pthread_create(&handles[i], NULL, bplist_thread_main, &threads[i]) == 0);
+        }
+        if (!started || !started[i]) {
+            func(job);
+        }
+#endif
+    }
+    func(jobs);
+    for (i = 1; i < njobs; i++) {
+#ifdef WIN32
+        if (handles && handles[i]) {
+            WaitForSingleObject(handles[i], INFINITE);
+            CloseHandle(handles[i]);
+        }
+#else
+        if (started && started[i]) {
+            pthread_join(handles[i], NULL);
+        }
+#endif
+    }
+    plist_mem_free(threads);
+    plist_mem_free(handles);
+#ifndef WIN32
+    plist_mem_free(started);
+#endif
+}
+
+/* decodes all scalar objects of bplist with nthreads threads including
+ * the calling one */
+static int bplist_decode_objects(struct bplist_data *bplist, uint32_t nthreads)
+{
+    struct bplist_decode_job *jobs = NULL;
+    uint64_t chunk = 0;
+    uint32_t i = 0;
+
+    bplist->slots = (plist_t*)plist_calloc(bplist->num_objects, sizeof(plist_t));
+    bplist->slots_taken = (uint8_t*)plist_calloc(1, (bplist->num_objects + 7) / 8);
+    jobs = (struct bplist_decode_job*)plist_calloc(nthreads, sizeof(struct bplist_decode_job));
+    if (!bplist->slots || !bplist->slots_taken || !jobs) {
+        PLIST_BIN_ERR("%s: Could not allocate decoder state\n", __func__);
+        plist_mem_free(bplist->slots);
+        plist_mem_free(bplist->slots_taken);
+        bplist->slots = NULL;
+        bplist->slots_taken = NULL;
+        plist_mem_free(jobs);
+        return -1;
+    }
+
+    chunk = (bplist->num_objects + nthreads - 1) / nthreads;
+    for (i = 0; i < nthreads; i++) {
+        jobs[i].bplist = *bplist;
+        jobs[i].first = (uint64_t)i * chunk;
+        jobs[i].last = jobs[i].first + chunk;
+        if (jobs[i].first > bplist->num_objects) {
+            jobs[i].first = bplist->num_objects;
+        }
+        if (jobs[i].last > bplist->num_objects) {
+            jobs[i].last = bplist->num_objects;
+        }
+    }
+    bplist_run_jobs(jobs, sizeof(struct bplist_decode_job), nthreads, bplist_decode_range);
+
+    plist_mem_free(jobs);
+    return 0;
+}
+
+PLIST_API void plist_from_bin_parallel(const char *plist_bin, uint32_t length, uint32_t nthreads, plist_t * plist)
+{
+    struct bplist_data bplist;
+    uint64_t root_object = 0;
+    uint64_t i = 0;
+
+    if (bplist_data_init(&bplist, plist_bin, length, &root_object, NULL) != PLIST_BIN_VALID) {
+        return;
+    }
+
+    if (nthreads == 0) {
+        nthreads = bplist_num_cpus();
+        if (nthreads > bplist.num_objects / BPLIST_PARALLEL_MIN_OBJECTS) {
+            nthreads = (uint32_t)(bplist.num_objects / BPLIST_PARALLEL_MIN_OBJECTS);
+        }
+    }
+    if (nthreads > bplist.num_objects) {
+        nthreads = (uint32_t)bplist.num_objects;
+    }
+    PLIST_STAT_TIMER_START(parse_start);
+    /* without the slots the tree is parsed like plist_from_bin does */
+    if (nthreads > 1) {
+        bplist_decode_objects(&bplist, nthreads);
+    }
+
+    *plist = parse_bin_tree(&bplist, root_object);
+    PLIST_STAT_TIMER_STOP(bin_parse_time, parse_start);
+
+    if (bplist.slots) {
+        for (i = 0; i < bplist.num_objects; i++) {
+            if (bplist.slots[i] && !BPLIST_INDEX_IS_TAKEN(&bplist, i)) {
+                plist_free(bplist.slots[i]);
+            }
+        }
+        plist_mem_free(bplist.slots);
+        plist_mem_free(bplist.slots_taken);
+    }
+    plist_mem_free(bplist.used_indexes);
+}
+
+struct plist_bin_reader_s {
+    struct bplist_data bplist;
+    uint64_t root;
+};
+
+PLIST_API plist_bin_reader_t plist_bin_reader_open(const char *plist_bin, uint64_t length)
+{
+    struct plist_bin_reader_s *reader = NULL;
+
+    if (!plist_bin) {
+        return NULL;
+    }
+    reader = (struct plist_bin_reader_s*)plist_calloc(1, sizeof(struct plist_bin_reader_s));
+    if (!reader) {
+        return NULL;
+    }
+    if (bplist_data_init(&reader->bplist, plist_bin, length, &reader->root, NULL) != PLIST_BIN_VALID) {
+        plist_mem_free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+PLIST_API void plist_bin_reader_free(plist_bin_reader_t reader)
+{
+    struct plist_bin_reader_s *r = (struct plist_bin_reader_s*)reader;
+    if (!r) {
+        return;
+    }
+    plist_mem_free(r->bplist.used_indexes);
+    plist_mem_free(r);
+}
+
+PLIST_API uint64_t plist_bin_reader_root(plist_bin_reader_t reader)
+{
+    struct plist_bin_reader_s *r = (struct plist_bin_reader_s*)reader;
+    return (r) ? r->root : 0;
+}
+
+/* Locates object obj, decodes its marker and verifies that the complete
+ * payload lies in front of the offset table. */
+static int reader_get_object(struct plist_bin_reader_s *r, uint64_t obj, uint8_t *type, uint64_t *size, const char **payload)
+{
+    struct bplist_data *bplist = NULL;
+    const char *ptr = NULL;
+    uint64_t avail = 0;
+    uint64_t need = 0;
+
+    if (!r) {
+        return -1;
+    }
+    bplist = &r->bplist;
+    ptr = bplist_object_at_index(bplist, obj);
+    if (!ptr || bplist_read_marker(bplist, &ptr, type, size) < 0) {
+        return -1;
+    }
+    avail = (uint64_t)(bplist->offset_table - ptr);
+
+    switch (*type) {
+    case BPLIST_NULL:
+        need = 0;
+        break;
+    case BPLIST_UINT:
+    case BPLIST_REAL:
+    case BPLIST_DATE:
+        if (*size > 4) {
+            return -1;
+        }
+        need = 1 << *size;
+        break;
+    case BPLIST_DATA:
+    case BPLIST_STRING:
+        need = *size;
+        break;
+    case BPLIST_UNICODE:
+        if (uint64_mul_overflow(*size, 2, &need)) {
+            return -1;
+        }
+        break;
+    case BPLIST_UID:
+        need = *size + 1;
+        break;
+    case BPLIST_ARRAY:
+    case BPLIST_SET:
+        if (uint64_mul_overflow(*size, bplist->ref_size, &need)) {
+            return -1;
+        }
+        break;
+    case BPLIST_DICT:
+        if (uint64_mul_overflow(*size, 2 * bplist->ref_size, &need)) {
+            return -1;
+        }
+        break;
+    default:
+        PLIST_BIN_ERR("%s: unexpected node type 0x%02x\n", __func__, *type);
+        return -1;
+    }
+    if (need > avail) {
+        PLIST_BIN_ERR("%s: data bytes for object %" PRIu64 " point outside of valid range\n", __func__, obj);
+        return -1;
+    }
+    *payload = ptr;
+    return 0;
+}
+
+static int reader_get_ref(struct plist_bin_reader_s *r, const char *refs, uint64_t n, uint64_t *ref)
+{
+    uint64_t index = UINT_TO_HOST(refs + n * r->bplist.ref_size, r->bplist.ref_size);
+    if (index >= r->bplist.num_objects) {
+        PLIST_BIN_ERR("%s: object index (%" PRIu64 ") must be smaller than the number of objects (%" PRIu64 ")\n", __func__, index, r->bplist.num_objects);
+        return -1;
+    }
+    *ref = index;
+    return 0;
+}
+
+PLIST_API plist_type plist_bin_reader_get_type(plist_bin_reader_t reader, uint64_t obj)
+{
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+
+    if (reader_get_object((struct plist_bin_reader_s*)reader, obj, &type, &size, &payload) < 0) {
+        return PLIST_NONE;
+    }
+    switch (type) {
+    case BPLIST_NULL:
+        return (size == BPLIST_TRUE || size == BPLIST_FALSE) ? PLIST_BOOLEAN : PLIST_NONE;
+    case BPLIST_UINT:
+        return PLIST_UINT;
+    case BPLIST_REAL:
+        return PLIST_REAL;
+    case BPLIST_DATE:
+        return PLIST_DATE;
+    case BPLIST_DATA:
+        return PLIST_DATA;
+    case BPLIST_STRING:
+    case BPLIST_UNICODE:
+        return PLIST_STRING;
+    case BPLIST_UID:
+        return PLIST_UID;
+    case BPLIST_ARRAY:
+    case BPLIST_SET:
+        return PLIST_ARRAY;
+    case BPLIST_DICT:
+        return PLIST_DICT;
+    default:
+        break;
+    }
+    return PLIST_NONE;
+}
+
+PLIST_API uint64_t plist_bin_reader_get_size(plist_bin_reader_t reader, uint64_t obj)
+{
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+
+    if (reader_get_object((struct plist_bin_reader_s*)reader, obj, &type, &size, &payload) < 0) {
+        return 0;
+    }
+    switch (type) {
+    case BPLIST_DATA:
+    case BPLIST_STRING:
+    case BPLIST_UNICODE:
+    case BPLIST_ARRAY:
+    case BPLIST_SET:
+    case BPLIST_DICT:
+        return size;
+    default:
+        break;
+    }
+    return 0;
+}
+
+PLIST_API int plist_bin_reader_child(plist_bin_reader_t reader, uint64_t obj, uint64_t n, uint64_t *child)
+{
+    struct plist_bin_reader_s *r = (struct plist_bin_reader_s*)reader;
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+
+    if (!child || reader_get_object(r, obj, &type, &size, &payload) < 0 || n >= size) {
+        return -1;
+    }
+    switch (type) {
+    case BPLIST_ARRAY:
+    case BPLIST_SET:
+        return reader_get_ref(r, payload, n, child);
+    case BPLIST_DICT:
+        return reader_get_ref(r, payload, size + n, child);
+    default:
+        break;
+    }
+    return -1;
+}
+
+PLIST_API int plist_bin_reader_dict_key(plist_bin_reader_t reader, uint64_t obj, uint64_t n, uint64_t *key)
+{
+    struct plist_bin_reader_s *r = (struct plist_bin_reader_s*)reader;
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+
+    if (!key || reader_get_object(r, obj, &type, &size, &payload) < 0 || type != BPLIST_DICT || n >= size) {
+        return -1;
+    }
+    return reader_get_ref(r, payload, n, key);
+}
+
+PLIST_API int plist_bin_reader_dict_get(plist_bin_reader_t reader, uint64_t obj, const char *key, uint64_t *value)
+{
+    struct plist_bin_reader_s *r = (struct plist_bin_reader_s*)reader;
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+    uint64_t keylen = 0;
+    uint64_t i;
+
+    if (!key || !value || reader_get_object(r, obj, &type, &size, &payload) < 0 || type != BPLIST_DICT) {
+        return -1;
+    }
+    keylen = strlen(key);
+    for (i = 0; i < size; i++) {
+        uint64_t kobj = 0;
+        uint8_t ktype = 0;
+        uint64_t ksize = 0;
+        const char *kpayload = NULL;
+        int match = 0;
+
+        if (reader_get_ref(r, payload, i, &kobj) < 0 || reader_get_object(r, kobj, &ktype, &ksize, &kpayload) < 0) {
+            return -1;
+        }
+        if (ktype == BPLIST_STRING) {
+            /* ASCII keys compare directly against the buffer */
+            match = (ksize == keylen && memcmp(kpayload, key, keylen) == 0);
+        } else if (ktype == BPLIST_UNICODE) {
+            char *kstr = NULL;
+            if (plist_bin_reader_get_string(reader, kobj, &kstr) < 0) {
+                return -1;
+            }
+            match = (strcmp(kstr, key) == 0);
+            plist_mem_free(kstr);
+        }
+        if (match) {
+            return reader_get_ref(r, payload, size + i, value);
+        }
+    }
+    return -1;
+}
+
+PLIST_API int plist_bin_reader_get_bool(plist_bin_reader_t reader, uint64_t obj, uint8_t *val)
+{
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+
+    if (!val || reader_get_object((struct plist_bin_reader_s*)reader, obj, &type, &size, &payload) < 0) {
+        return -1;
+    }
+    if (type != BPLIST_NULL || (size != BPLIST_TRUE && size != BPLIST_FALSE)) {
+        return -1;
+    }
+    *val = (size == BPLIST_TRUE);
+    return 0;
+}
+
+PLIST_API int plist_bin_reader_get_uint(plist_bin_reader_t reader, uint64_t obj, uint64_t *val)
+{
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+
+    if (!val || reader_get_object((struct plist_bin_reader_s*)reader, obj, &type, &size, &payload) < 0) {
+        return -1;
+    }
+    switch (type) {
+    case BPLIST_UINT:
+        size = 1 << size;
+        if (size != 1 && size != 2 && size != 4 && size != 8 && size != 16) {
+            return -1;
+        }
+        break;
+    case BPLIST_UID:
+        size = size + 1;
+        break;
+    default:
+        return -1;
+    }
+    *val = UINT_TO_HOST(payload, size);
+    return 0;
+}
+
+PLIST_API int plist_bin_reader_get_real(plist_bin_reader_t reader, uint64_t obj, double *val)
+{
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+    uint8_t buf[8];
+
+    if (!val || reader_get_object((struct plist_bin_reader_s*)reader, obj, &type, &size, &payload) < 0) {
+        return -1;
+    }
+    if (type != BPLIST_REAL && type != BPLIST_DATE) {
+        return -1;
+    }
+    switch (1 << size) {
+    case sizeof(uint32_t):
+        *(uint32_t*)buf = float_bswap32(get_unaligned((uint32_t*)payload));
+        *val = *(float *) buf;
+        break;
+    case sizeof(uint64_t):
+        *(uint64_t*)buf = float_bswap64(get_unaligned((uint64_t*)payload));
+        *val = *(double *) buf;
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+PLIST_API int plist_bin_reader_get_string(plist_bin_reader_t reader, uint64_t obj, char **val)
+{
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+    uint64_t len = 0;
+
+    if (!val || reader_get_object((struct plist_bin_reader_s*)reader, obj, &type, &size, &payload) < 0) {
+        return -1;
+    }
+    switch (type) {
+    case BPLIST_STRING:
+        *val = (char*)plist_malloc(size + 1);
+        if (!*val) {
+            return -1;
+        }
+        memcpy(*val, payload, size);
+        (*val)[size] = '\0';
+        return 0;
+    case BPLIST_UNICODE:
+        len = plist_utf16be_to_utf8(payload, size, NULL);
+        *val = (char*)plist_malloc(len + 1);
+        if (!*val) {
+            return -1;
+        }
+        PLIST_STAT_ADD(utf16_conversions, 1);
+        plist_utf16be_to_utf8(payload, size, *val);
+        (*val)[len] = '\0';
+        return 0;
+    default:
+        break;
+    }
+    return -1;
+}
+
+PLIST_API int plist_bin_reader_get_data(plist_bin_reader_t reader, uint64_t obj, const char **val, uint64_t *length)
+{
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+
+    if (!val || !length || reader_get_object((struct plist_bin_reader_s*)reader, obj, &type, &size, &payload) < 0) {
+        return -1;
+    }
+    if (type != BPLIST_DATA) {
+        return -1;
+    }
+    *val = payload;
+    *length = size;
+    return 0;
+}
+
+int plist_bin_reader_get_raw_string(plist_bin_reader_t reader, uint64_t obj, const char **val, uint64_t *length)
+{
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+
+    if (reader_get_object((struct plist_bin_reader_s*)reader, obj, &type, &size, &payload) < 0) {
+        return -1;
+    }
+    switch (type) {
+    case BPLIST_STRING:
+        *val = payload;
+        *length = size;
+        return 0;
+    case BPLIST_UNICODE:
+        return 1;
+    default:
+        break;
+    }
+    return -1;
+}
+
+PLIST_API plist_t plist_bin_reader_get_node(plist_bin_reader_t reader, uint64_t obj)
+{
+    struct plist_bin_reader_s *r = (struct plist_bin_reader_s*)reader;
+    if (!r || obj >= r->bplist.num_objects) {
+        return NULL;
+    }
+    return parse_bin_tree(&r->bplist, obj);
+}
+
+static unsigned int plist_data_hash(const void* key)
+{
+    plist_data_t data = plist_get_data((plist_t) key);
+
+    switch (data->type)
+    {
+    case PLIST_BOOLEAN:
+    case PLIST_UINT:
+    case PLIST_REAL:
+    case PLIST_DATE:
+    case PLIST_UID:
+        //works also for real as we use an union
+        return plist_hash_bytes(&data->intval, sizeof(data->intval), data->type);
+    case PLIST_KEY:
+    case PLIST_STRING:
+    case PLIST_DATA:
+        //use the cached payload hash if there is one, but don't store it:
+        //writing only reads the tree, so it may run on several threads
+        if (data->flags & PLIST_DATA_HASHED) {
+            return data->hash ^ (data->type * 0x9e3779b9U);
+        }
+        return plist_hash_bytes(data->buff, (data->buff) ? data->length : 0, 0) ^ (data->type * 0x9e3779b9U);
+    case PLIST_ARRAY:
+    case PLIST_DICT:
+        //for these types only hash pointer
+        return plist_hash_bytes(&key, sizeof(const void*), data->type);
+    default:
+        break;
+    }
+
+    return data->type;
+}
+
+struct serialize_s
+{
+    ptrarray_t* objects;
+    hashtable_t* ref_table;
+    /* references of all containers in the order they are written, the
+     * keys of a dict first and then its values */
+    uint64_t *refs;
+    uint64_t refs_len;
+    uint64_t refs_capacity;
+    /* position of the references of each object in refs */
+    uint64_t *ref_starts;
+    uint64_t ref_starts_capacity;
+};
+
+/* ref_table maps nodes to their object index, which is stored in the value
+ * pointer itself plus one, so that index 0 isn't NULL. By default it only
+ * holds scalars, to find value-equal ones, the compact writer also puts
+ * containers in it. */
+#define REF_INDEX_TO_PTR(i) ((void*)(uintptr_t)((i) + 1))
+#define REF_PTR_TO_INDEX(p) ((uint64_t)(uintptr_t)(p) - 1)
+
+/* appends node as a new object with count reference slots for its
+ * children, returns its object index */
+static uint64_t serialize_add_object(struct serialize_s *ser, node_t *node, uint64_t count)
+{
+    uint64_t idx = ser->objects->len;
+
+    if (idx >= ser->ref_starts_capacity) {
+        uint64_t newcap = (ser->ref_starts_capacity > 0) ? ser->ref_starts_capacity * 2 : 256;
+        ser->ref_starts = (uint64_t*)plist_realloc(ser->ref_starts, newcap * sizeof(uint64_t));
+        assert(ser->ref_starts != NULL);
+        ser->ref_starts_capacity = newcap;
+    }
+    if (!ser->refs || count > ser->refs_capacity - ser->refs_len) {
+        uint64_t newcap = (ser->refs_capacity > 0) ? ser->refs_capacity : 256;
+        while (count > newcap - ser->refs_len) {
+            newcap *= 2;
+        }
+        ser->refs = (uint64_t*)plist_realloc(ser->refs, newcap * sizeof(uint64_t));
+        assert(ser->refs != NULL);
+        ser->refs_capacity = newcap;
+    }
+    ser->ref_starts[idx] = ser->refs_len;
+    ser->refs_len += count;
+    ptr_array_add(ser->objects, node);
+    return idx;
+}
+
+/* a container of serialize_plist whose children are being added */
+struct serialize_frame
+{
+    node_t *next;
+    uint64_t start;
+    uint64_t pos;
+    /* number of entries of a dict, 0 for an array */
+    uint64_t half;
+};
+
+/* adds all nodes in pre-order, walking the tree without recursion. The
+ * object index of each child is stored in the reference slot of its
+ * parent right away, so writing a container needs no lookups. */
+static void serialize_plist(node_t* root, struct serialize_s *ser)
+{
+    struct serialize_frame *frames = NULL;
+    struct serialize_frame *f = NULL;
+    uint32_t depth = 0;
+    uint32_t capacity = 16;
+    node_t *node = root;
+    uint64_t slot = 0;
+    uint64_t idx = 0;
+
+    frames = (struct serialize_frame*)plist_malloc(capacity * sizeof(struct serialize_frame));
+    assert(frames != NULL);
+    for (;;) {
+        plist_data_t data = plist_get_data(node);
+        if (data->type == PLIST_ARRAY || data->type == PLIST_DICT) {
+            plist_load_children(node);
+            idx = serialize_add_object(ser, node, node_n_children(node));
+            if (node_first_child(node)) {
+                if (depth >= capacity) {
+                    capacity *= 2;
+                    frames = (struct serialize_frame*)plist_realloc(frames, capacity * sizeof(struct serialize_frame));
+                    assert(frames != NULL);
+                }
+                f = &frames[depth++];
+                f->next = node_first_child(node);
+                f->start = ser->ref_starts[idx];
+                f->pos = 0;
+                f->half = (data->type == PLIST_DICT) ? node_n_children(node) / 2 : 0;
+            }
+        } else {
+            void *existing = hash_table_insert_unique(ser->ref_table, node, REF_INDEX_TO_PTR(ser->objects->len));
+            if (existing) {
+                PLIST_STAT_ADD(dedup_hits, 1);
+                idx = REF_PTR_TO_INDEX(existing);
+            } else {
+                idx = serialize_add_object(ser, node, 0);
+            }
+        }
+        if (node != root) {
+            ser->refs[slot] = idx;
+        }
+
+        /* the next child of the innermost unfinished container */
+        while (depth > 0 && !frames[depth-1].next) {
+            depth--;
+        }
+        if (depth == 0) {
+            break;
+        }
+        f = &frames[depth-1];
+        node = f->next;
+        f->next = node_next_sibling(node);
+        if (f->half) {
+            slot = f->start + (f->pos >> 1) + ((f->pos & 1) ? f->half : 0);
+        } else {
+            slot = f->start + f->pos;
+        }
+        f->pos++;
+    }
+    plist_mem_free(frames);
+}
+
+/* an already written object identified by its type and contents, used
+ * to deduplicate objects that can't be compared by their node: for
+ * containers the contents are the object indices of the children, for
+ * the streaming writer the encoded object */
+struct object_ref
+{
+    unsigned int hash;
+    plist_type type;
+    uint64_t index;
+    uint64_t size;
+    uint8_t data[];
+};
+
+static unsigned int object_ref_hash(const void* key)
+{
+    return ((const struct object_ref*)key)->hash;
+}
+
+static int object_ref_compare(const void *a, const void *b)
+{
+    const struct object_ref *ra = (const struct object_ref*)a;
+    const struct object_ref *rb = (const struct object_ref*)b;
+    return (ra->type == rb->type && ra->size == rb->size && !memcmp(ra->data, rb->data, ra->size));
+}
+
+/* Adds node to the objects of a compact plist, all its children must have
+ * been added before. Arrays and dictionaries with identical contents are
+ * only added once. Returns the object index of node. */
+static uint64_t serialize_compact_node(node_t* node, struct serialize_s *ser, hashtable_t *containers)
+{
+    void *index_val = NULL;
+    plist_data_t data = plist_get_data(node);
+    struct object_ref *ref = NULL;
+    struct object_ref *existing = NULL;
+    node_t *ch;
+    uint64_t i = 0;
+
+    //first check that node is not yet in objects
+    index_val = hash_table_lookup(ser->ref_table, node);
+    if (index_val) {
+        PLIST_STAT_ADD(dedup_hits, 1);
+        return REF_PTR_TO_INDEX(index_val);
+    }
+
+    if (data->type == PLIST_ARRAY || data->type == PLIST_DICT) {
+        ref = (struct object_ref*)plist_malloc(sizeof(struct object_ref) + node_n_children(node) * sizeof(uint64_t));
+        assert(ref != NULL);
+        ref->type = data->type;
+        ref->size = node_n_children(node) * sizeof(uint64_t);
+        for (ch = node_first_child(node); ch && i < ref->size; ch = node_next_sibling(ch), i += sizeof(uint64_t)) {
+            void *idx = hash_table_lookup(ser->ref_table, ch);
+            uint64_t idx_val;
+            assert(idx != NULL);
+            idx_val = REF_PTR_TO_INDEX(idx);
+            memcpy(ref->data + i, &idx_val, sizeof(uint64_t));
+        }
+        ref->size = i;
+        ref->hash = plist_hash_bytes(ref->data, ref->size, ref->type);
+
+        existing = (struct object_ref*)hash_table_lookup(containers, ref);
+        if (existing) {
+            PLIST_STAT_ADD(dedup_hits, 1);
+            plist_mem_free(ref);
+            hash_table_insert(ser->ref_table, node, REF_INDEX_TO_PTR(existing->index));
+            return existing->index;
+        }
+        ref->index = ser->objects->len;
+        hash_table_insert(containers, ref, ref);
+    }
+
+    //insert new ref
+    i = serialize_add_object(ser, node, (ref) ? ref->size / sizeof(uint64_t) : 0);
+    hash_table_insert(ser->ref_table, node, REF_INDEX_TO_PTR(i));
+    if (ref) {
+        uint64_t *out = ser->refs + ser->ref_starts[i];
+        uint64_t count = ref->size / sizeof(uint64_t);
+        if (data->type == PLIST_DICT) {
+            uint64_t half = count / 2;
+            uint64_t k;
+            for (k = 0; k < half; k++) {
+                memcpy(&out[k], ref->data + 2 * k * sizeof(uint64_t), sizeof(uint64_t));
+                memcpy(&out[half + k], ref->data + (2 * k + 1) * sizeof(uint64_t), sizeof(uint64_t));
+            }
+        } else {
+            memcpy(out, ref->data, ref->size);
+        }
+    }
+
+    return i;
+}
+
+/* Like serialize_plist but children are added before their parent (in
+ * post-order), so a container can be identified by the indices of its
+ * children. Returns the object index of root. */
+static uint64_t serialize_plist_compact(node_t* root, struct serialize_s *ser, hashtable_t *containers)
+{
+    node_t *node = root;
+    node_t *ch = NULL;
+    uint64_t idx = 0;
+
+    for (;;) {
+        /* descend to the first node without children left to add */
+        while (!hash_table_lookup(ser->ref_table, node)) {
+            plist_type type = plist_get_data(node)->type;
+            if (type != PLIST_ARRAY && type != PLIST_DICT) {
+                break;
+            }
+            plist_load_children(node);
+            ch = node_first_child(node);
+            if (!ch) {
+                break;
+            }
+            node = ch;
+        }
+        /* add nodes until there is a sibling to descend into */
+        for (;;) {
+            idx = serialize_compact_node(node, ser, containers);
+            if (node == root) {
+                return idx;
+            }
+            if (node_next_sibling(node)) {
+                node = node_next_sibling(node);
+                break;
+            }
+            node = node->parent;
+        }
+    }
+}
+
+#define Log2(x) (x == 8 ? 3 : (x == 4 ? 2 : (x == 2 ? 1 : 0)))
+
+static void write_int(bytearray_t * bplist, uint64_t val)
+{
+    int size = get_needed_bytes(val);
+    uint8_t sz;
+    //do not write 3bytes int node
+    if (size == 3)
+        size++;
+    sz = BPLIST_UINT | Log2(size);
+
+    val = be64toh(val);
+    byte_array_append(bplist, &sz, 1);
+    byte_array_append(bplist, (uint8_t*)&val + (8-size), size);
+}
+
+static void write_uint(bytearray_t * bplist, uint64_t val)
+{
+    uint8_t sz = BPLIST_UINT | 4;
+    uint64_t zero = 0;
+
+    val = be64toh(val);
+    byte_array_append(bplist, &sz, 1);
+    byte_array_append(bplist, &zero, sizeof(uint64_t));
+    byte_array_append(bplist, &val, sizeof(uint64_t));
+}
+
+static void write_real(bytearray_t * bplist, double val)
+{
+    int size = get_real_bytes(val);	//cheat to know used space
+    uint8_t buff[16];
+    buff[7] = BPLIST_REAL | Log2(size);
+    if (size == sizeof(float)) {
+        float floatval = (float)val;
+        *(uint32_t*)(buff+8) = float_bswap32(*(uint32_t*)&floatval);
+    } else {
+        *(uint64_t*)(buff+8) = float_bswap64(*(uint64_t*)&val);
+    }
+    byte_array_append(bplist, buff+7, size+1);
+}
+
+static void write_date(bytearray_t * bplist, double val)
+{
+    uint8_t buff[16];
+    buff[7] = BPLIST_DATE | 3;
+    *(uint64_t*)(buff+8) = float_bswap64(*(uint64_t*)&val);
+    byte_array_append(bplist, buff+7, 9);
+}
+
+static void write_raw_data(bytearray_t * bplist, uint8_t mark, uint8_t * val, uint64_t size)
+{
+    uint8_t marker = mark | (size < 15 ? size : 0xf);
+    byte_array_append(bplist, &marker, sizeof(uint8_t));
+    if (size >= 15) {
+        write_int(bplist, size);
+    }
+    if (BPLIST_UNICODE==mark) size <<= 1;
+    byte_array_append(bplist, val, size);
+}
+
+static void write_data(bytearray_t * bplist, uint8_t * val, uint64_t size)
+{
+    write_raw_data(bplist, BPLIST_DATA, val, size);
+}
+
+static void write_string(bytearray_t * bplist, char *val, uint64_t size)
+{
+    write_raw_data(bplist, BPLIST_STRING, (uint8_t *) val, size);
+}
+
+static uint64_t plist_utf8_to_utf16be(const char *unistr, uint64_t size, uint64_t *pos, uint8_t *outbuf, uint64_t max_units);
+
+/* converts the UTF-8 string val in chunks directly into the output buffer */
+static void write_unicode(bytearray_t * bplist, const char *val, uint64_t len, uint64_t units)
+{
+    uint8_t chunk[4096];
+    uint64_t pos = 0;
+    uint8_t marker = BPLIST_UNICODE | (uint8_t)(units < 15 ? units : 0xf);
+    byte_array_append(bplist, &marker, sizeof(uint8_t));
+    if (units >= 15) {
+        write_int(bplist, units);
+    }
+    PLIST_STAT_ADD(utf16_conversions, 1);
+    while (pos < len) {
+        uint64_t n = plist_utf8_to_utf16be(val, len, &pos, chunk, sizeof(chunk) / 2);
+        byte_array_append(bplist, chunk, n * 2);
+    }
+}
+
+#define REF_CHUNK 64
+
+/* appends count references in blocks, so they are encoded together */
+static void write_refs(bytearray_t * bplist, const uint64_t *refs, uint64_t count, uint8_t ref_size)
+{
+    uint8_t buf[REF_CHUNK * sizeof(uint64_t)];
+    uint64_t i = 0;
+
+    for (i = 0; i < count; i += REF_CHUNK) {
+        uint64_t n = (count - i < REF_CHUNK) ? count - i : REF_CHUNK;
+        bplist_encode_uints(refs + i, n, ref_size, buf);
+        byte_array_append(bplist, buf, n * ref_size);
+    }
+}
+
+static void write_array(bytearray_t * bplist, node_t* node, const uint64_t *refs, uint8_t ref_size)
+{
+    uint64_t size = node_n_children(node);
+    uint8_t marker = BPLIST_ARRAY | (size < 15 ? size : 0xf);
+    byte_array_append(bplist, &marker, sizeof(uint8_t));
+    if (size >= 15) {
+        write_int(bplist, size);
+    }
+    write_refs(bplist, refs, size, ref_size);
+}
+
+static void write_dict(bytearray_t * bplist, node_t* node, const uint64_t *refs, uint8_t ref_size)
+{
+    uint64_t size = node_n_children(node) / 2;
+    uint8_t marker = BPLIST_DICT | (size < 15 ? size : 0xf);
+    byte_array_append(bplist, &marker, sizeof(uint8_t));
+    if (size >= 15) {
+        write_int(bplist, size);
+    }
+    /* the keys are followed by the values */
+    write_refs(bplist, refs, 2 * size, ref_size);
+}
+
+static void write_uid(bytearray_t * bplist, uint64_t val)
+{
+    val = (uint32_t)val;
+    int size = get_needed_bytes(val);
+    uint8_t sz;
+    //do not write 3bytes int node
+    if (size == 3)
+        size++;
+    sz = BPLIST_UID | (size-1); // yes, this is what Apple does...
+
+    val = be64toh(val);
+    byte_array_append(bplist, &sz, 1);
+    byte_array_append(bplist, (uint8_t*)&val + (8-size), size);
+}
+
+static int is_ascii_string(const char* s, uint64_t len)
+{
+    uint64_t i = 0;
+#ifdef __SSE2__
+    for (; len - i >= 16; i += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i)))) {
+            return 0;
+        }
+    }
+#endif
+    for (; len - i >= 8; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, sizeof(w));
+        if (w & 0x8080808080808080ULL) {
+            return 0;
+        }
+    }
+    for (; i < len; i++) {
+        if (!isascii(s[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Converts UTF-8 at unistr[*pos] to big endian UTF-16 until size bytes
+ * are consumed or at most max_units code units have been written. If
+ * outbuf is NULL only the code units are counted. Conversion stops at an
+ * invalid sequence, in that case *pos is set to size. Returns the number
+ * of code units. */
+static uint64_t plist_utf8_to_utf16be(const char *unistr, uint64_t size, uint64_t *pos, uint8_t *outbuf, uint64_t max_units)
+{
+	const unsigned char *in = (const unsigned char*)unistr;
+	uint64_t p = 0;
+	uint64_t i = *pos;
+
+	unsigned char c0;
+	unsigned char c1;
+	unsigned char c2;
+	unsigned char c3;
+
+	uint32_t w;
+	uint16_t u;
+
+	while (i < size && max_units - p >= 2) {
+#ifdef __SSE2__
+		/* 16 ASCII characters at a time */
+		if (size - i >= 16 && max_units - p >= 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+			if (_mm_movemask_epi8(v) == 0) {
+				if (outbuf) {
+					__m128i zero = _mm_setzero_si128();
+					_mm_storeu_si128((__m128i*)(outbuf + (p<<1)), _mm_unpacklo_epi8(zero, v));
+					_mm_storeu_si128((__m128i*)(outbuf + (p<<1) + 16), _mm_unpackhi_epi8(zero, v));
+				}
+				p += 16;
+				i += 16;
+				continue;
+			}
+		}
+#endif
+		c0 = in[i];
+		if (c0 < 0x80) {
+			// 1 byte sequence
+			if (outbuf) {
+				outbuf[p<<1] = 0;
+				outbuf[(p<<1)+1] = c0;
+			}
+			p++;
+			i++;
+			continue;
+		}
+		c1 = (i+1 < size) ? in[i+1] : 0;
+		c2 = (i+2 < size) ? in[i+2] : 0;
+		c3 = (i+3 < size) ? in[i+3] : 0;
+		if ((c0 >= 0xF0) && (i+3 < size) && (c1 >= 0x80) && (c2 >= 0x80) && (c3 >= 0x80)) {
+			// 4 byte sequence.  Need to generate UTF-16 surrogate pair
+			w = ((((c0 & 7) << 18) + ((c1 & 0x3F) << 12) + ((c2 & 0x3F) << 6) + (c3 & 0x3F)) & 0x1FFFFF) - 0x010000;
+			if (outbuf) {
+				u = 0xD800 + (w >> 10);
+				outbuf[p<<1] = u >> 8;
+				outbuf[(p<<1)+1] = u & 0xFF;
+				u = 0xDC00 + (w & 0x3FF);
+				outbuf[(p<<1)+2] = u >> 8;
+				outbuf[(p<<1)+3] = u & 0xFF;
+			}
+			p += 2;
+			i += 4;
+		} else if ((c0 >= 0xE0) && (i+2 < size) && (c1 >= 0x80) && (c2 >= 0x80)) {
+			// 3 byte sequence
+			if (outbuf) {
+				u = ((c2 & 0x3F) + ((c1 & 3) << 6)) + (((c1 >> 2) & 15) << 8) + ((c0 & 15) << 12);
+				outbuf[p<<1] = u >> 8;
+				outbuf[(p<<1)+1] = u & 0xFF;
+			}
+			p++;
+			i += 3;
+		} else if ((c0 >= 0xC0) && (i+1 < size) && (c1 >= 0x80)) {
+			// 2 byte sequence
+			if (outbuf) {
+				u = ((c1 & 0x3F) + ((c0 & 3) << 6)) + (((c0 >> 2) & 7) << 8);
+				outbuf[p<<1] = u >> 8;
+				outbuf[(p<<1)+1] = u & 0xFF;
+			}
+			p++;
+			i += 2;
+		} else {
+			// invalid character
+			if (outbuf) {
+				PLIST_BIN_ERR("%s: invalid utf8 sequence in string at index %" PRIu64 "\n", __func__, i);
+			}
+			i = size;
+			break;
+		}
+	}
+	*pos = i;
+	return p;
+}
+
+static uint64_t get_int_size(uint64_t val)
+{
+    uint64_t size = get_needed_bytes(val);
+    //3 byte ints are written as 4 bytes
+    return (size == 3) ? 4 : size;
+}
+
+static uint64_t get_raw_data_size(uint64_t size, uint64_t unit)
+{
+    uint64_t res = 1 + size * unit;
+    if (size >= 15) {
+        res += 1 + get_int_size(size);
+    }
+    return res;
+}
+
+/* number of UTF-16 code units needed for a UTF-8 string */
+static uint64_t get_utf16_length(const char *str, uint64_t len)
+{
+    uint64_t pos = 0;
+    return plist_utf8_to_utf16be(str, len, &pos, NULL, UINT64_MAX);
+}
+
+/* number of bytes object will take up in the binary plist */
+static uint64_t get_object_size(node_t* node, uint8_t ref_size)
+{
+    plist_data_t data = plist_get_data(node);
+    uint64_t len = 0;
+
+    switch (data->type)
+    {
+    case PLIST_BOOLEAN:
+        return 1;
+    case PLIST_UINT:
+        return (data->length == 16) ? 17 : 1 + get_int_size(data->intval);
+    case PLIST_REAL:
+        return 1 + get_real_bytes(data->realval);
+    case PLIST_DATE:
+        return 9;
+    case PLIST_UID:
+        return 1 + get_int_size((uint32_t)data->intval);
+    case PLIST_KEY:
+    case PLIST_STRING:
+        len = data->length;
+        if (is_ascii_string(data->strval, len)) {
+            return get_raw_data_size(len, 1);
+        }
+        return get_raw_data_size(get_utf16_length(data->strval, len), 2);
+    case PLIST_DATA:
+        return get_raw_data_size(data->length, 1);
+    case PLIST_ARRAY:
+        return get_raw_data_size(node_n_children(node), ref_size);
+    case PLIST_DICT:
+        len = node_n_children(node) / 2;
+        return get_raw_data_size(len, 2 * ref_size);
+    default:
+        break;
+    }
+    return 0;
+}
+
+/* encodes a single object of the object table, refs are the object
+ * indexes of the children of a container */
+static void write_object(bytearray_t * bplist, node_t* node, const uint64_t *refs, uint8_t ref_size)
+{
+    plist_data_t data = plist_get_data(node);
+    long len = 0;
+
+    switch (data->type)
+    {
+    case PLIST_BOOLEAN:
+    {
+        uint8_t b = data->boolval ? BPLIST_TRUE : BPLIST_FALSE;
+        byte_array_append(bplist, &b, sizeof(uint8_t));
+        break;
+    }
+
+    case PLIST_UINT:
+        if (data->length == 16) {
+            write_uint(bplist, data->intval);
+        } else {
+            write_int(bplist, data->intval);
+        }
+        break;
+
+    case PLIST_REAL:
+        write_real(bplist, data->realval);
+        break;
+
+    case PLIST_KEY:
+    case PLIST_STRING:
+        len = data->length;
+        if ( is_ascii_string(data->strval, len) )
+        {
+            write_string(bplist, data->strval, len);
+        }
+        else
+        {
+            write_unicode(bplist, data->strval, len, get_utf16_length(data->strval, len));
+        }
+        break;
+    case PLIST_DATA:
+        write_data(bplist, data->buff, data->length);
+        break;
+    case PLIST_ARRAY:
+        write_array(bplist, node, refs, ref_size);
+        break;
+    case PLIST_DICT:
+        write_dict(bplist, node, refs, ref_size);
+        break;
+    case PLIST_DATE:
+        write_date(bplist, data->realval);
+        break;
+    case PLIST_UID:
+        write_uid(bplist, data->intval);
+        break;
+    default:
+        break;
+    }
+}
 
-    uint64_t size = node_n_children(node) / 2;
-    uint8_t marker = BPLIST_DICT | (size < 15 ? size : 0xf);
-    byte_array_append(bplist, &marker, sizeof(uint8_t));
-    if (size >= 15) {
-        write_int(bplist, size);
+struct bplist_encode_job {
+    ptrarray_t *objects;
+    const struct serialize_s *ser;
+    uint8_t ref_size;
+    uint64_t first;
+    uint64_t last;
+    /* offsets relative to the start of buff */
+    uint64_t *offsets;
+    bytearray_t *buff;
+};
+
+/* encodes the objects with an index in [first, last) into a buffer of
+ * their own */
+static void bplist_encode_range(void *arg)
+{
+    struct bplist_encode_job *job = (struct bplist_encode_job*)arg;
+    uint64_t size = 0;
+    uint64_t i = 0;
+
+    for (i = job->first; i < job->last; i++) {
+        size += get_object_size(ptr_array_index(job->objects, i), job->ref_size);
+    }
+    job->buff = byte_array_new_size(size);
+    for (i = job->first; i < job->last; i++) {
+        job->offsets[i] = job->buff->len;
+        write_object(job->buff, ptr_array_index(job->objects, i), job->ser->refs + job->ser->ref_starts[i], job->ref_size);
+    }
+}
+
+/* Encodes all objects with nthreads threads and appends them to bplist.
+ * The threads only read the references collected in ser. */
+static void write_objects_parallel(bytearray_t *bplist, const struct serialize_s *ser, uint8_t ref_size, uint64_t *offsets, uint32_t nthreads)
+{
+    struct bplist_encode_job *jobs = NULL;
+    ptrarray_t *objects = ser->objects;
+    uint64_t num_objects = objects->len;
+    uint64_t chunk = 0;
+    uint64_t base = 0;
+    uint64_t size = 0;
+    uint64_t i = 0;
+    uint32_t t = 0;
+
+    jobs = (struct bplist_encode_job*)plist_calloc(nthreads, sizeof(struct bplist_encode_job));
+    assert(jobs != NULL);
+    chunk = (num_objects + nthreads - 1) / nthreads;
+    for (t = 0; t < nthreads; t++) {
+        jobs[t].objects = objects;
+        jobs[t].ser = ser;
+        jobs[t].ref_size = ref_size;
+        jobs[t].first = (uint64_t)t * chunk;
+        jobs[t].last = jobs[t].first + chunk;
+        if (jobs[t].first > num_objects) {
+            jobs[t].first = num_objects;
+        }
+        if (jobs[t].last > num_objects) {
+            jobs[t].last = num_objects;
+        }
+        jobs[t].offsets = offsets;
+    }
+
+    bplist_run_jobs(jobs, sizeof(struct bplist_encode_job), nthreads, bplist_encode_range);
+
+    /* make room for the objects, the offset table and the trailer */
+    size = 0;
+    for (t = 0; t < nthreads; t++) {
+        size += jobs[t].buff->len;
+    }
+    size += num_objects * sizeof(uint64_t) + sizeof(bplist_trailer_t);
+    if (bplist->capacity - bplist->len < size) {
+        byte_array_grow(bplist, size - (bplist->capacity - bplist->len));
+    }
+
+    /* the offset of each chunk is the size of the chunks before it */
+    for (t = 0; t < nthreads; t++) {
+        base = bplist->len;
+        for (i = jobs[t].first; i < jobs[t].last; i++) {
+            offsets[i] += base;
+        }
+        byte_array_append(bplist, jobs[t].buff->data, jobs[t].buff->len);
+        byte_array_free(jobs[t].buff);
+    }
+    plist_mem_free(jobs);
+}
+
+static void plist_to_bin_internal(plist_t plist, uint32_t options, uint32_t nthreads, struct plist_context_s *ctx, char **plist_bin, uint64_t * length)
+{
+    ptrarray_t* objects = NULL;
+    hashtable_t* ref_table = NULL;
+    struct serialize_s ser_s;
+    uint8_t offset_size = 0;
+    uint8_t ref_size = 0;
+    uint64_t num_objects = 0;
+    uint64_t root_object = 0;
+    uint64_t offset_table_index = 0;
+    bytearray_t *bplist_buff = NULL;
+    uint64_t i = 0;
+    uint64_t *offsets = NULL;
+    bplist_trailer_t trailer;
+    uint64_t objects_len = 0;
+    uint64_t objects_size = 0;
+    uint64_t buff_len = 0;
+
+    //check for valid input
+    if (!plist || !plist_bin || *plist_bin || !length)
+        return;
+
+    PLIST_STAT_TIMER_START(serialize_start);
+    if (ctx) {
+        //reuse the tables of the previous call
+        if (!ctx->objects) {
+            ctx->objects = ptr_array_new(256);
+            ctx->ref_table = hash_table_new(plist_data_hash, plist_data_compare, NULL);
+        }
+        objects = ctx->objects;
+        objects->len = 0;
+        ref_table = ctx->ref_table;
+        hash_table_clear(ref_table);
+    } else {
+        //list of objects
+        objects = ptr_array_new(256);
+        //hashtable to write only once same nodes
+        ref_table = hash_table_new(plist_data_hash, plist_data_compare, NULL);
+    }
+
+    //serialize plist
+    memset(&ser_s, 0, sizeof(ser_s));
+    ser_s.objects = objects;
+    ser_s.ref_table = ref_table;
+    if (ctx) {
+        ser_s.refs = ctx->obj_refs;
+        ser_s.refs_capacity = ctx->obj_refs_capacity;
+        ser_s.ref_starts = ctx->ref_starts;
+        ser_s.ref_starts_capacity = ctx->ref_starts_capacity;
+    }
+    if (options & PLIST_WRITE_COMPACT) {
+        hashtable_t *containers = NULL;
+        if (ctx) {
+            if (!ctx->containers) {
+                ctx->containers = hash_table_new(object_ref_hash, object_ref_compare, plist_mem_free);
+            }
+            containers = ctx->containers;
+        } else {
+            containers = hash_table_new(object_ref_hash, object_ref_compare, plist_mem_free);
+        }
+        root_object = serialize_plist_compact(plist, &ser_s, containers);
+        if (ctx) {
+            hash_table_clear(containers);
+        } else {
+            hash_table_destroy(containers);
+        }
+    } else {
+        serialize_plist(plist, &ser_s);
+        root_object = 0;		//root is first in list
+    }
+
+    PLIST_STAT_TIMER_STOP(bin_serialize_time, serialize_start);
+
+    //now stream to output buffer
+    PLIST_STAT_TIMER_START(write_start);
+    offset_size = 0;			//unknown yet
+    objects_len = objects->len;
+    ref_size = get_needed_bytes(objects_len);
+    num_objects = objects->len;
+    offset_table_index = 0;		//unknown yet
+
+    if (nthreads == 0) {
+        nthreads = bplist_num_cpus();
+        if (nthreads > num_objects / BPLIST_PARALLEL_MIN_OBJECTS) {
+            nthreads = (uint32_t)(num_objects / BPLIST_PARALLEL_MIN_OBJECTS);
+        }
+    }
+    if (nthreads > num_objects) {
+        nthreads = (uint32_t)num_objects;
+    }
+
+    //compute the output size so the buffer is allocated only once,
+    //the threads of the parallel writer size their own chunks
+    objects_size = 0;
+    for (i = 0; nthreads <= 1 && i < num_objects; i++) {
+        objects_size += get_object_size(ptr_array_index(objects, i), ref_size);
+    }
+    buff_len = BPLIST_MAGIC_SIZE + BPLIST_VERSION_SIZE + objects_size;
+    buff_len += num_objects * get_needed_bytes(buff_len) + sizeof(bplist_trailer_t);
+
+    //setup a dynamic bytes array to store bplist in
+    if (ctx) {
+        if (!ctx->out) {
+            ctx->out = byte_array_new_size(buff_len);
+        } else if (ctx->out->capacity < buff_len) {
+            byte_array_grow(ctx->out, buff_len - ctx->out->capacity);
+        }
+        bplist_buff = ctx->out;
+        bplist_buff->len = 0;
+    } else {
+        bplist_buff = byte_array_new_size(buff_len);
+    }
+
+    //set magic number and version
+    byte_array_append(bplist_buff, BPLIST_MAGIC, BPLIST_MAGIC_SIZE);
+    byte_array_append(bplist_buff, BPLIST_VERSION, BPLIST_VERSION_SIZE);
+
+    //write objects and table
+    if (ctx) {
+        if (ctx->offsets_capacity < num_objects) {
+            plist_mem_free(ctx->offsets);
+            ctx->offsets = (uint64_t *) plist_malloc(num_objects * sizeof(uint64_t));
+            ctx->offsets_capacity = num_objects;
+        }
+        offsets = ctx->offsets;
+    } else {
+        offsets = (uint64_t *) plist_malloc(num_objects * sizeof(uint64_t));
+    }
+    assert(offsets != NULL);
+    if (nthreads > 1) {
+        write_objects_parallel(bplist_buff, &ser_s, ref_size, offsets, nthreads);
+    } else {
+        for (i = 0; i < num_objects; i++) {
+            offsets[i] = bplist_buff->len;
+            write_object(bplist_buff, ptr_array_index(objects, i), ser_s.refs + ser_s.ref_starts[i], ref_size);
+        }
+    }
+
+    //free intermediate objects
+    if (ctx) {
+        ctx->obj_refs = ser_s.refs;
+        ctx->obj_refs_capacity = ser_s.refs_capacity;
+        ctx->ref_starts = ser_s.ref_starts;
+        ctx->ref_starts_capacity = ser_s.ref_starts_capacity;
+    } else {
+        ptr_array_free(objects);
+        hash_table_destroy(ref_table);
+        plist_mem_free(ser_s.refs);
+        plist_mem_free(ser_s.ref_starts);
+    }
+
+    //write offsets
+    buff_len = bplist_buff->len;
+    offset_size = get_needed_bytes(buff_len);
+    offset_table_index = bplist_buff->len;
+    write_refs(bplist_buff, offsets, num_objects, offset_size);
+    if (!ctx) {
+        plist_mem_free(offsets);
+    }
+
+    //setup trailer
+    memset(trailer.unused, '\0', sizeof(trailer.unused));
+    trailer.offset_size = offset_size;
+    trailer.ref_size = ref_size;
+    trailer.num_objects = be64toh(num_objects);
+    trailer.root_object_index = be64toh(root_object);
+    trailer.offset_table_offset = be64toh(offset_table_index);
+
+    byte_array_append(bplist_buff, &trailer, sizeof(bplist_trailer_t));
+    PLIST_STAT_TIMER_STOP(bin_write_time, write_start);
+
+    //set output buffer and size
+    *plist_bin = bplist_buff->data;
+    *length = bplist_buff->len;
+
+    if (ctx) {
+        return; // the output buffer belongs to the context
+    }
+    bplist_buff->data = NULL; // make sure we don't free the output buffer
+    byte_array_free(bplist_buff);
+}
+
+/* the functions with 32 bit lengths fail for larger output instead of
+ * returning a truncated length */
+static void plist_to_bin_internal32(plist_t plist, uint32_t options, uint32_t nthreads, char **plist_bin, uint32_t * length)
+{
+    uint64_t len = 0;
+    if (!length) {
+        return;
+    }
+    plist_to_bin_internal(plist, options, nthreads, NULL, plist_bin, &len);
+    if (len > UINT32_MAX) {
+        plist_mem_free(*plist_bin);
+        *plist_bin = NULL;
+        len = 0;
+    }
+    *length = (uint32_t)len;
+}
+
+PLIST_API void plist_to_bin_ex(plist_t plist, uint32_t options, char **plist_bin, uint32_t * length)
+{
+    plist_to_bin_internal32(plist, options, 1, plist_bin, length);
+}
+
+PLIST_API int plist_to_bin64(plist_t plist, uint32_t options, char **plist_bin, uint64_t * length)
+{
+    if (!plist || !plist_bin || !length) {
+        return -1;
+    }
+    *plist_bin = NULL;
+    *length = 0;
+    plist_to_bin_internal(plist, options, 1, NULL, plist_bin, length);
+    return (*plist_bin) ? 0 : -1;
+}
+
+PLIST_API void plist_to_bin_parallel(plist_t plist, uint32_t options, uint32_t nthreads, char **plist_bin, uint32_t * length)
+{
+    plist_to_bin_internal32(plist, options, nthreads, plist_bin, length);
+}
+
+PLIST_API void plist_to_bin_ctx(plist_context_t context, plist_t plist, uint32_t options, const char **plist_bin, uint32_t * length)
+{
+    char *bin = NULL;
+    uint64_t len = 0;
+    if (!context || !plist_bin || !length) {
+        return;
+    }
+    plist_to_bin_internal(plist, options, 1, (struct plist_context_s*)context, &bin, &len);
+    if (len > UINT32_MAX) {
+        /* the buffer stays with the context */
+        bin = NULL;
+        len = 0;
+    }
+    *plist_bin = bin;
+    *length = (uint32_t)len;
+}
+
+PLIST_API void plist_to_bin(plist_t plist, char **plist_bin, uint32_t * length)
+{
+    plist_to_bin_ex(plist, PLIST_WRITE_DEFAULT, plist_bin, length);
+}
+
+/* streaming binary plist writer */
+
+/* size of the output buffer of the streaming writer */
+#define BPLIST_WRITER_BUFSIZE 65536
+
+/* objects are written before the total count is known, so the size of
+ * object references has to be fixed upfront */
+#define BPLIST_WRITER_REF_SIZE 4
+
+struct bplist_writer_level
+{
+    plist_type type;
+    uint64_t *refs;
+    uint64_t count;
+    uint64_t capacity;
+};
+
+struct plist_bin_writer_s
+{
+    plist_write_func_t write;
+    void *user_data;
+    int fd;
+    uint32_t options;
+    int error;
+    bytearray_t *buf;
+    bytearray_t *obj;
+    uint64_t written;
+    uint64_t *offsets;
+    uint64_t num_objects;
+    uint64_t offsets_capacity;
+    struct bplist_writer_level *levels;
+    uint32_t depth;
+    uint32_t levels_capacity;
+    int have_root;
+    uint64_t root_object;
+    hashtable_t *objects;
+};
+
+static int bplist_writer_flush(void *ctx, const char *buf, size_t len)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)ctx;
+    w->written += len;
+    return w->write(w->user_data, buf, len);
+}
+
+PLIST_API plist_bin_writer_t plist_bin_writer_new(plist_write_func_t writer, void *user_data, uint32_t options)
+{
+    struct plist_bin_writer_s *w = NULL;
+    if (!writer) {
+        return NULL;
+    }
+    w = (struct plist_bin_writer_s*)plist_calloc(1, sizeof(struct plist_bin_writer_s));
+    if (!w) {
+        return NULL;
+    }
+    w->write = writer;
+    w->user_data = user_data;
+    w->options = options;
+    w->buf = byte_array_new_stream(BPLIST_WRITER_BUFSIZE, bplist_writer_flush, w);
+    w->obj = byte_array_new_size(256);
+    if (options & PLIST_WRITE_COMPACT) {
+        w->objects = hash_table_new(object_ref_hash, object_ref_compare, plist_mem_free);
+    }
+    if (!w->buf || !w->buf->data || !w->obj || !w->obj->data || ((options & PLIST_WRITE_COMPACT) && !w->objects)) {
+        plist_bin_writer_free(w);
+        return NULL;
+    }
+
+    byte_array_append(w->buf, BPLIST_MAGIC, BPLIST_MAGIC_SIZE);
+    byte_array_append(w->buf, BPLIST_VERSION, BPLIST_VERSION_SIZE);
+    return w;
+}
+
+PLIST_API plist_bin_writer_t plist_bin_writer_new_fd(int fd, uint32_t options)
+{
+    struct plist_bin_writer_s *w = NULL;
+    if (fd < 0) {
+        return NULL;
+    }
+    w = plist_bin_writer_new(plist_write_to_fd, NULL, options);
+    if (w) {
+        w->fd = fd;
+        w->user_data = &w->fd;
+    }
+    return w;
+}
+
+PLIST_API void plist_bin_writer_free(plist_bin_writer_t writer)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    uint32_t i = 0;
+    if (!w) {
+        return;
+    }
+    for (i = 0; i < w->depth; i++) {
+        plist_mem_free(w->levels[i].refs);
+    }
+    plist_mem_free(w->levels);
+    plist_mem_free(w->offsets);
+    if (w->objects) {
+        hash_table_destroy(w->objects);
+    }
+    byte_array_free(w->obj);
+    byte_array_free(w->buf);
+    plist_mem_free(w);
+}
+
+/* records ref as the next child of the innermost open container, or as the root */
+static int bplist_writer_add_ref(struct plist_bin_writer_s *w, uint64_t ref)
+{
+    struct bplist_writer_level *level = NULL;
+    if (w->depth == 0) {
+        if (w->have_root) {
+            PLIST_BIN_ERR("%s: the plist can only have one root object\n", __func__);
+            return -1;
+        }
+        w->have_root = 1;
+        w->root_object = ref;
+        return 0;
+    }
+    level = &w->levels[w->depth-1];
+    if (level->count >= level->capacity) {
+        uint64_t newcap = (level->capacity) ? level->capacity * 2 : 16;
+        uint64_t *refs = (uint64_t*)plist_realloc(level->refs, newcap * sizeof(uint64_t));
+        if (!refs) {
+            return -1;
+        }
+        level->refs = refs;
+        level->capacity = newcap;
+    }
+    level->refs[level->count++] = ref;
+    return 0;
+}
+
+/* checks that a value (or a key if is_key is set) may be added next */
+static int bplist_writer_begin_value(struct plist_bin_writer_s *w, int is_key)
+{
+    struct bplist_writer_level *level = (w->depth > 0) ? &w->levels[w->depth-1] : NULL;
+    if (w->error) {
+        return -1;
+    }
+    if (level && level->type == PLIST_DICT) {
+        if (is_key != ((level->count & 1) == 0)) {
+            PLIST_BIN_ERR("%s: expected %s in dictionary\n", __func__, (is_key) ? "a value" : "a key");
+            return -1;
+        }
+    } else if (is_key) {
+        PLIST_BIN_ERR("%s: keys are only allowed in dictionaries\n", __func__);
+        return -1;
+    }
+    if (!level && w->have_root) {
+        PLIST_BIN_ERR("%s: the plist can only have one root object\n", __func__);
+        return -1;
+    }
+    return 0;
+}
+
+/* writes the object encoded in w->obj, returns its index or -1 */
+static int64_t bplist_writer_emit(struct plist_bin_writer_s *w, plist_type type)
+{
+    struct object_ref *ref = NULL;
+    struct object_ref *existing = NULL;
+    uint64_t index = w->num_objects;
+
+    if (index >= (1ULL << (BPLIST_WRITER_REF_SIZE * 8))) {
+        PLIST_BIN_ERR("%s: too many objects\n", __func__);
+        w->error = 1;
+        return -1;
+    }
+    if (w->objects) {
+        ref = (struct object_ref*)plist_malloc(sizeof(struct object_ref) + w->obj->len);
+        if (!ref) {
+            w->error = 1;
+            return -1;
+        }
+        ref->type = type;
+        ref->size = w->obj->len;
+        memcpy(ref->data, w->obj->data, w->obj->len);
+        ref->hash = plist_hash_bytes(ref->data, ref->size, 0);
+        existing = (struct object_ref*)hash_table_lookup(w->objects, ref);
+        if (existing) {
+            plist_mem_free(ref);
+            return (int64_t)existing->index;
+        }
+        ref->index = index;
+        hash_table_insert(w->objects, ref, ref);
+    }
+
+    if (w->num_objects >= w->offsets_capacity) {
+        uint64_t newcap = (w->offsets_capacity) ? w->offsets_capacity * 2 : 256;
+        uint64_t *offsets = (uint64_t*)plist_realloc(w->offsets, newcap * sizeof(uint64_t));
+        if (!offsets) {
+            w->error = 1;
+            return -1;
+        }
+        w->offsets = offsets;
+        w->offsets_capacity = newcap;
+    }
+    w->offsets[w->num_objects++] = w->written + w->buf->len;
+    byte_array_append(w->buf, w->obj->data, w->obj->len);
+    if (w->buf->error) {
+        w->error = 1;
+        return -1;
+    }
+    return (int64_t)index;
+}
+
+static int bplist_writer_finish_value(struct plist_bin_writer_s *w, plist_type type)
+{
+    int64_t index = bplist_writer_emit(w, type);
+    w->obj->len = 0;
+    if (index < 0 || bplist_writer_add_ref(w, (uint64_t)index) < 0) {
+        w->error = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int bplist_writer_add_string(struct plist_bin_writer_s *w, plist_type type, const char *val, uint64_t len)
+{
+    if (!val || bplist_writer_begin_value(w, (type == PLIST_KEY)) < 0) {
+        return -1;
+    }
+    if (is_ascii_string(val, len)) {
+        write_string(w->obj, (char*)val, len);
+    } else {
+        write_unicode(w->obj, val, len, get_utf16_length(val, len));
+    }
+    return bplist_writer_finish_value(w, PLIST_STRING);
+}
+
+PLIST_API int plist_bin_writer_add_key(plist_bin_writer_t writer, const char *key)
+{
+    if (!writer || !key) {
+        return -1;
+    }
+    return bplist_writer_add_string((struct plist_bin_writer_s*)writer, PLIST_KEY, key, strlen(key));
+}
+
+PLIST_API int plist_bin_writer_add_string(plist_bin_writer_t writer, const char *val)
+{
+    if (!writer || !val) {
+        return -1;
+    }
+    return bplist_writer_add_string((struct plist_bin_writer_s*)writer, PLIST_STRING, val, strlen(val));
+}
+
+PLIST_API int plist_bin_writer_add_bool(plist_bin_writer_t writer, uint8_t val)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    uint8_t b = val ? BPLIST_TRUE : BPLIST_FALSE;
+    if (!w || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
+    }
+    byte_array_append(w->obj, &b, sizeof(uint8_t));
+    return bplist_writer_finish_value(w, PLIST_BOOLEAN);
+}
+
+PLIST_API int plist_bin_writer_add_uint(plist_bin_writer_t writer, uint64_t val)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    if (!w || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
+    }
+    if (val > INT64_MAX) {
+        write_uint(w->obj, val);
+    } else {
+        write_int(w->obj, val);
+    }
+    return bplist_writer_finish_value(w, PLIST_UINT);
+}
+
+PLIST_API int plist_bin_writer_add_int(plist_bin_writer_t writer, int64_t val)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    if (!w || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
+    }
+    write_int(w->obj, (uint64_t)val);
+    return bplist_writer_finish_value(w, PLIST_UINT);
+}
+
+PLIST_API int plist_bin_writer_add_real(plist_bin_writer_t writer, double val)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    if (!w || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
+    }
+    write_real(w->obj, val);
+    return bplist_writer_finish_value(w, PLIST_REAL);
+}
+
+PLIST_API int plist_bin_writer_add_date(plist_bin_writer_t writer, int32_t sec, int32_t usec)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    if (!w || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
+    }
+    write_date(w->obj, (double)sec + (double)usec / 1000000);
+    return bplist_writer_finish_value(w, PLIST_DATE);
+}
+
+int plist_bin_writer_add_date_real(plist_bin_writer_t writer, double val)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    if (!w || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
+    }
+    write_date(w->obj, val);
+    return bplist_writer_finish_value(w, PLIST_DATE);
+}
+
+PLIST_API int plist_bin_writer_add_data(plist_bin_writer_t writer, const char *val, uint64_t length)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    if (!w || (!val && length > 0) || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
     }
+    write_data(w->obj, (uint8_t*)val, length);
+    return bplist_writer_finish_value(w, PLIST_DATA);
+}
 
-    for (i = 0, cur = node_first_child(node); cur && i < size; cur = node_next_sibling(node_next_sibling(cur)), i++) {
-        uint64_t idx1 = *(uint64_t *) (hash_table_lookup(ref_table, cur));
-        idx1 = be64toh(idx1);
-        byte_array_append(bplist, (uint8_t*)&idx1 + (sizeof(uint64_t) - ref_size), ref_size);
+PLIST_API int plist_bin_writer_add_uid(plist_bin_writer_t writer, uint64_t val)
+{
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    if (!w || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
     }
+    write_uid(w->obj, val);
+    return bplist_writer_finish_value(w, PLIST_UID);
+}
 
-    for (i = 0, cur = node_first_child(node); cur && i < size; cur = node_next_sibling(node_next_sibling(cur)), i++) {
-        uint64_t idx2 = *(uint64_t *) (hash_table_lookup(ref_table, cur->next));
-        idx2 = be64toh(idx2);
-        byte_array_append(bplist, (uint8_t*)&idx2 + (sizeof(uint64_t) - ref_size), ref_size);
+static int bplist_writer_begin(struct plist_bin_writer_s *w, plist_type type)
+{
+    if (!w || bplist_writer_begin_value(w, 0) < 0) {
+        return -1;
+    }
+    if (w->depth >= w->levels_capacity) {
+        uint32_t newcap = (w->levels_capacity) ? w->levels_capacity * 2 : 16;
+        struct bplist_writer_level *levels = (struct bplist_writer_level*)plist_realloc(w->levels, newcap * sizeof(struct bplist_writer_level));
+        if (!levels) {
+            w->error = 1;
+            return -1;
+        }
+        w->levels = levels;
+        w->levels_capacity = newcap;
     }
+    memset(&w->levels[w->depth], 0, sizeof(struct bplist_writer_level));
+    w->levels[w->depth].type = type;
+    w->depth++;
+    return 0;
 }
 
-static void write_uid(bytearray_t * bplist, uint64_t val)
+PLIST_API int plist_bin_writer_begin_dict(plist_bin_writer_t writer)
 {
-    val = (uint32_t)val;
-    int size = get_needed_bytes(val);
-    uint8_t sz;
-    //do not write 3bytes int node
-    if (size == 3)
-        size++;
-    sz = BPLIST_UID | (size-1); // yes, this is what Apple does...
+    return bplist_writer_begin((struct plist_bin_writer_s*)writer, PLIST_DICT);
+}
 
-    val = be64toh(val);
-    byte_array_append(bplist, &sz, 1);
-    byte_array_append(bplist, (uint8_t*)&val + (8-size), size);
+PLIST_API int plist_bin_writer_begin_array(plist_bin_writer_t writer)
+{
+    return bplist_writer_begin((struct plist_bin_writer_s*)writer, PLIST_ARRAY);
 }
 
-static int is_ascii_string(char* s, int len)
+static void bplist_writer_append_ref(bytearray_t *bplist, uint64_t ref)
 {
-  int ret = 1, i = 0;
-  for(i = 0; i < len; i++)
-  {
-      if ( !isascii( s[i] ) )
-      {
-          ret = 0;
-          break;
-      }
-  }
-  return ret;
+    ref = be64toh(ref);
+    byte_array_append(bplist, (uint8_t*)&ref + (sizeof(uint64_t) - BPLIST_WRITER_REF_SIZE), BPLIST_WRITER_REF_SIZE);
 }
 
-static uint16_t *plist_utf8_to_utf16(char *unistr, long size, long *items_read, long *items_written)
+PLIST_API int plist_bin_writer_end(plist_bin_writer_t writer)
 {
-	uint16_t *outbuf;
-	int p = 0;
-	long i = 0;
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
+    struct bplist_writer_level level;
+    uint64_t size = 0;
+    uint64_t i = 0;
+    uint8_t marker;
+    int res = 0;
 
-	unsigned char c0;
-	unsigned char c1;
-	unsigned char c2;
-	unsigned char c3;
+    if (!w || w->error || w->depth == 0) {
+        return -1;
+    }
+    level = w->levels[w->depth-1];
+    if (level.type == PLIST_DICT && (level.count & 1)) {
+        PLIST_BIN_ERR("%s: dictionary key without value\n", __func__);
+        return -1;
+    }
+    w->depth--;
 
-	uint32_t w;
+    if (level.type == PLIST_DICT) {
+        size = level.count / 2;
+        marker = BPLIST_DICT | (size < 15 ? size : 0xf);
+    } else {
+        size = level.count;
+        marker = BPLIST_ARRAY | (size < 15 ? size : 0xf);
+    }
+    byte_array_append(w->obj, &marker, sizeof(uint8_t));
+    if (size >= 15) {
+        write_int(w->obj, size);
+    }
+    if (level.type == PLIST_DICT) {
+        for (i = 0; i < level.count; i += 2) {
+            bplist_writer_append_ref(w->obj, level.refs[i]);
+        }
+        for (i = 1; i < level.count; i += 2) {
+            bplist_writer_append_ref(w->obj, level.refs[i]);
+        }
+    } else {
+        write_refs(w->obj, level.refs, level.count, BPLIST_WRITER_REF_SIZE);
+    }
+    plist_mem_free(level.refs);
+
+    res = bplist_writer_finish_value(w, level.type);
+    /* drop the scratch buffer again after large containers */
+    if (w->obj->capacity > BPLIST_WRITER_BUFSIZE) {
+        bytearray_t *obj = byte_array_new_size(256);
+        if (obj && obj->data) {
+            byte_array_free(w->obj);
+            w->obj = obj;
+        } else {
+            byte_array_free(obj);
+        }
+    }
+    return res;
+}
 
-	outbuf = (uint16_t*)malloc(((size*2)+1)*sizeof(uint16_t));
-	if (!outbuf) {
-		PLIST_BIN_ERR("%s: Could not allocate %" PRIu64 " bytes\n", __func__, (uint64_t)((size*2)+1)*sizeof(uint16_t));
-		return NULL;
-	}
+static int bplist_writer_add_scalar(struct plist_bin_writer_s *w, plist_t node)
+{
+    plist_data_t data = plist_get_data(node);
 
-	while (i < size) {
-		c0 = unistr[i];
-		c1 = (i < size-1) ? unistr[i+1] : 0;
-		c2 = (i < size-2) ? unistr[i+2] : 0;
-		c3 = (i < size-3) ? unistr[i+3] : 0;
-		if ((c0 >= 0xF0) && (i < size-3) && (c1 >= 0x80) && (c2 >= 0x80) && (c3 >= 0x80)) {
-			// 4 byte sequence.  Need to generate UTF-16 surrogate pair
-			w = ((((c0 & 7) << 18) + ((c1 & 0x3F) << 12) + ((c2 & 0x3F) << 6) + (c3 & 0x3F)) & 0x1FFFFF) - 0x010000;
-			outbuf[p++] = 0xD800 + (w >> 10);
-			outbuf[p++] = 0xDC00 + (w & 0x3FF);
-			i+=4;
-		} else if ((c0 >= 0xE0) && (i < size-2) && (c1 >= 0x80) && (c2 >= 0x80)) {
-			// 3 byte sequence
-			outbuf[p++] = ((c2 & 0x3F) + ((c1 & 3) << 6)) + (((c1 >> 2) & 15) << 8) + ((c0 & 15) << 12);
-			i+=3;
-		} else if ((c0 >= 0xC0) && (i < size-1) && (c1 >= 0x80)) {
-			// 2 byte sequence
-			outbuf[p++] = ((c1 & 0x3F) + ((c0 & 3) << 6)) + (((c0 >> 2) & 7) << 8);
-			i+=2;
-		} else if (c0 < 0x80) {
-			// 1 byte sequence
-			outbuf[p++] = c0;
-			i+=1;
-		} else {
-			// invalid character
-			PLIST_BIN_ERR("%s: invalid utf8 sequence in string at index %lu\n", __func__, i);
-			break;
-		}
-	}
-	if (items_read) {
-		*items_read = i;
-	}
-	if (items_written) {
-		*items_written = p;
-	}
-	outbuf[p] = 0;
+    switch (data->type) {
+    case PLIST_BOOLEAN:
+        return plist_bin_writer_add_bool(w, data->boolval);
+    case PLIST_UINT:
+        if (data->length == 16) {
+            return plist_bin_writer_add_uint(w, data->intval);
+        }
+        return plist_bin_writer_add_int(w, (int64_t)data->intval);
+    case PLIST_REAL:
+        if (bplist_writer_begin_value(w, 0) < 0) {
+            return -1;
+        }
+        write_real(w->obj, data->realval);
+        return bplist_writer_finish_value(w, PLIST_REAL);
+    case PLIST_DATE:
+        if (bplist_writer_begin_value(w, 0) < 0) {
+            return -1;
+        }
+        write_date(w->obj, data->realval);
+        return bplist_writer_finish_value(w, PLIST_DATE);
+    case PLIST_KEY:
+    case PLIST_STRING:
+        return bplist_writer_add_string(w, data->type, data->strval, data->length);
+    case PLIST_DATA:
+        return plist_bin_writer_add_data(w, (const char*)data->buff, data->length);
+    case PLIST_UID:
+        return plist_bin_writer_add_uid(w, data->intval);
+    default:
+        break;
+    }
+    return -1;
+}
 
-	return outbuf;
+/* walks the tree without recursion, using the parent pointers to climb up */
+static int bplist_writer_add_node(struct plist_bin_writer_s *w, plist_t root)
+{
+    node_t *node = (node_t*)root;
+    node_t *ch = NULL;
+
+    while (node) {
+        plist_type type = plist_get_data(node)->type;
+        if (type == PLIST_ARRAY || type == PLIST_DICT) {
+            if (bplist_writer_begin(w, type) < 0) {
+                return -1;
+            }
+            plist_load_children(node);
+            ch = node_first_child(node);
+            if (ch) {
+                node = ch;
+                continue;
+            }
+            if (plist_bin_writer_end(w) < 0) {
+                return -1;
+            }
+        } else if (bplist_writer_add_scalar(w, node) < 0) {
+            return -1;
+        }
+        while (node != (node_t*)root && !node_next_sibling(node)) {
+            node = node->parent;
+            if (plist_bin_writer_end(w) < 0) {
+                return -1;
+            }
+        }
+        node = (node == (node_t*)root) ? NULL : node_next_sibling(node);
+    }
+    return 0;
+}
 
+PLIST_API int plist_bin_writer_add_node(plist_bin_writer_t writer, plist_t node)
+{
+    if (!writer || !node) {
+        return -1;
+    }
+    return bplist_writer_add_node((struct plist_bin_writer_s*)writer, node);
 }
 
-PLIST_API void plist_to_bin(plist_t plist, char **plist_bin, uint32_t * length)
+PLIST_API int plist_bin_writer_finish(plist_bin_writer_t writer)
 {
-    ptrarray_t* objects = NULL;
-    hashtable_t* ref_table = NULL;
-    struct serialize_s ser_s;
-    uint8_t offset_size = 0;
-    uint8_t ref_size = 0;
-    uint64_t num_objects = 0;
-    uint64_t root_object = 0;
-    uint64_t offset_table_index = 0;
-    bytearray_t *bplist_buff = NULL;
-    uint64_t i = 0;
-    uint8_t *buff = NULL;
-    uint64_t *offsets = NULL;
+    struct plist_bin_writer_s *w = (struct plist_bin_writer_s*)writer;
     bplist_trailer_t trailer;
-    //for string
-    long len = 0;
-    long items_read = 0;
-    long items_written = 0;
-    uint16_t *unicodestr = NULL;
-    uint64_t objects_len = 0;
-    uint64_t buff_len = 0;
-
-    //check for valid input
-    if (!plist || !plist_bin || *plist_bin || !length)
-        return;
+    uint64_t offset_table_index = 0;
+    uint8_t offset_size = 0;
 
-    //list of objects
-    objects = ptr_array_new(256);
-    //hashtable to write only once same nodes
-    ref_table = hash_table_new(plist_data_hash, plist_data_compare, free);
+    if (!w || w->error) {
+        return -1;
+    }
+    if (w->depth > 0 || !w->have_root) {
+        PLIST_BIN_ERR("%s: %s\n", __func__, (w->depth > 0) ? "unterminated container" : "no root object");
+        return -1;
+    }
 
-    //serialize plist
-    ser_s.objects = objects;
-    ser_s.ref_table = ref_table;
-    serialize_plist(plist, &ser_s);
+    offset_table_index = w->written + w->buf->len;
+    offset_size = get_needed_bytes(offset_table_index);
+    write_refs(w->buf, w->offsets, w->num_objects, offset_size);
 
-    //now stream to output buffer
-    offset_size = 0;			//unknown yet
-    objects_len = objects->len;
-    ref_size = get_needed_bytes(objects_len);
-    num_objects = objects->len;
-    root_object = 0;			//root is first in list
-    offset_table_index = 0;		//unknown yet
+    memset(trailer.unused, '\0', sizeof(trailer.unused));
+    trailer.offset_size = offset_size;
+    trailer.ref_size = BPLIST_WRITER_REF_SIZE;
+    trailer.num_objects = be64toh(w->num_objects);
+    trailer.root_object_index = be64toh(w->root_object);
+    trailer.offset_table_offset = be64toh(offset_table_index);
+    byte_array_append(w->buf, &trailer, sizeof(bplist_trailer_t));
+    byte_array_flush(w->buf);
 
-    //setup a dynamic bytes array to store bplist in
-    bplist_buff = byte_array_new();
+    /* nothing can be added after the trailer */
+    w->error = 1;
+    return (w->buf->error) ? -1 : 0;
+}
 
-    //set magic number and version
-    byte_array_append(bplist_buff, BPLIST_MAGIC, BPLIST_MAGIC_SIZE);
-    byte_array_append(bplist_buff, BPLIST_VERSION, BPLIST_VERSION_SIZE);
+/* an object on the path of plist_bin_patch */
+struct bplist_patch_step {
+    uint64_t obj;
+    /* the reference to the next object on the path, counted like the
+     * refs of the container */
+    uint64_t slot;
+    /* the number of references to obj in the whole document */
+    uint64_t refs;
+};
 
-    //write objects and table
-    offsets = (uint64_t *) malloc(num_objects * sizeof(uint64_t));
-    assert(offsets != NULL);
-    for (i = 0; i < num_objects; i++)
-    {
+/* finds the position of key among the keys of a dictionary */
+static int bplist_patch_find_key(struct plist_bin_reader_s *r, const char *refs, uint64_t size, const char *key, uint64_t keylen, uint64_t *pos)
+{
+    uint64_t i;
 
-        plist_data_t data = plist_get_data(ptr_array_index(objects, i));
-        offsets[i] = bplist_buff->len;
+    for (i = 0; i < size; i++) {
+        uint64_t kobj = 0;
+        const char *kstr = NULL;
+        uint64_t klen = 0;
+        char *ukey = NULL;
+        int match = 0;
 
-        switch (data->type)
-        {
-        case PLIST_BOOLEAN:
-            buff = (uint8_t *) malloc(sizeof(uint8_t));
-            buff[0] = data->boolval ? BPLIST_TRUE : BPLIST_FALSE;
-            byte_array_append(bplist_buff, buff, sizeof(uint8_t));
-            free(buff);
+        if (reader_get_ref(r, refs, i, &kobj) < 0) {
+            return -1;
+        }
+        switch (plist_bin_reader_get_raw_string(r, kobj, &kstr, &klen)) {
+        case 0:
+            match = (klen == keylen && memcmp(kstr, key, keylen) == 0);
             break;
-
-        case PLIST_UINT:
-            if (data->length == 16) {
-                write_uint(bplist_buff, data->intval);
-            } else {
-                write_int(bplist_buff, data->intval);
+        case 1:
+            if (plist_bin_reader_get_string(r, kobj, &ukey) < 0) {
+                return -1;
             }
+            match = (strlen(ukey) == keylen && memcmp(ukey, key, keylen) == 0);
+            plist_mem_free(ukey);
             break;
-
-        case PLIST_REAL:
-            write_real(bplist_buff, data->realval);
+        default:
             break;
+        }
+        if (match) {
+            *pos = i;
+            return 0;
+        }
+    }
+    return -1;
+}
 
-        case PLIST_KEY:
-        case PLIST_STRING:
-            len = strlen(data->strval);
-            if ( is_ascii_string(data->strval, len) )
-            {
-                write_string(bplist_buff, data->strval);
+/* follows path from the root, steps[count] is the object it leads to */
+static int bplist_patch_walk(struct plist_bin_reader_s *r, plist_path_t path, struct bplist_patch_step *steps, uint32_t count)
+{
+    uint64_t obj = r->root;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        const char *key = NULL;
+        uint64_t keylen = 0;
+        int64_t index = 0;
+        uint8_t type = 0;
+        uint64_t size = 0;
+        const char *payload = NULL;
+        uint64_t pos = 0;
+
+        steps[i].obj = obj;
+        if (plist_path_get_segment(path, i, &key, &keylen, &index) < 0 || reader_get_object(r, obj, &type, &size, &payload) < 0) {
+            return -1;
+        }
+        if (type == BPLIST_ARRAY || type == BPLIST_SET) {
+            if (index < 0 || (uint64_t)index >= size) {
+                return -1;
             }
-            else
-            {
-                unicodestr = plist_utf8_to_utf16(data->strval, len, &items_read, &items_written);
-                write_unicode(bplist_buff, unicodestr, items_written);
-                free(unicodestr);
+            steps[i].slot = (uint64_t)index;
+        } else if (type == BPLIST_DICT) {
+            if (bplist_patch_find_key(r, payload, size, key, keylen, &pos) < 0) {
+                return -1;
             }
-            break;
-        case PLIST_DATA:
-            write_data(bplist_buff, data->buff, data->length);
-            break;
-        case PLIST_ARRAY:
-            write_array(bplist_buff, ptr_array_index(objects, i), ref_table, ref_size);
-            break;
-        case PLIST_DICT:
-            write_dict(bplist_buff, ptr_array_index(objects, i), ref_table, ref_size);
-            break;
-        case PLIST_DATE:
-            write_date(bplist_buff, data->realval);
-            break;
-        case PLIST_UID:
-            write_uid(bplist_buff, data->intval);
-            break;
-        default:
-            break;
+            steps[i].slot = size + pos;
+        } else {
+            return -1;
+        }
+        if (reader_get_ref(r, payload, steps[i].slot, &obj) < 0) {
+            return -1;
         }
     }
+    steps[count].obj = obj;
+    return 0;
+}
 
-    //free intermediate objects
-    ptr_array_free(objects);
-    hash_table_destroy(ref_table);
+/* counts the references to the objects on the path in all containers */
+static void bplist_patch_count_refs(struct plist_bin_reader_s *r, struct bplist_patch_step *steps, uint32_t count)
+{
+    uint8_t ref_size = r->bplist.ref_size;
+    uint64_t i;
+    uint64_t j;
+    uint32_t k;
 
-    //write offsets
-    buff_len = bplist_buff->len;
-    offset_size = get_needed_bytes(buff_len);
-    offset_table_index = bplist_buff->len;
-    for (i = 0; i < num_objects; i++) {
-        uint64_t offset = be64toh(offsets[i]);
-        byte_array_append(bplist_buff, (uint8_t*)&offset + (sizeof(uint64_t) - offset_size), offset_size);
+    for (k = 0; k <= count; k++) {
+        steps[k].refs = 0;
     }
-    free(offsets);
+    for (i = 0; i < r->bplist.num_objects; i++) {
+        uint8_t type = 0;
+        uint64_t size = 0;
+        const char *payload = NULL;
 
-    //setup trailer
-    memset(trailer.unused, '\0', sizeof(trailer.unused));
-    trailer.offset_size = offset_size;
-    trailer.ref_size = ref_size;
-    trailer.num_objects = be64toh(num_objects);
-    trailer.root_object_index = be64toh(root_object);
-    trailer.offset_table_offset = be64toh(offset_table_index);
+        if (reader_get_object(r, i, &type, &size, &payload) < 0) {
+            continue;
+        }
+        if (type == BPLIST_DICT) {
+            size *= 2;
+        } else if (type != BPLIST_ARRAY && type != BPLIST_SET) {
+            continue;
+        }
+        for (j = 0; j < size; j++) {
+            uint64_t ref = UINT_TO_HOST(payload + j * ref_size, ref_size);
+            for (k = 0; k <= count; k++) {
+                if (steps[k].obj == ref) {
+                    steps[k].refs++;
+                }
+            }
+        }
+    }
+}
 
-    byte_array_append(bplist_buff, &trailer, sizeof(bplist_trailer_t));
+/* stores the low size (at most 8) bytes of val big endian */
+static void bplist_patch_put_uint(char *buf, uint64_t val, uint64_t size)
+{
+    uint64_t i;
+    for (i = size; i > 0; i--) {
+        buf[i - 1] = (char)(val & 0xff);
+        val >>= 8;
+    }
+}
 
-    //set output buffer and size
-    *plist_bin = bplist_buff->data;
-    *length = bplist_buff->len;
+/* overwrites the object at payload with value if the new encoding has the
+ * same size, returns 1 if it did */
+static int bplist_patch_in_place(char *payload, uint8_t type, uint64_t size, plist_t value)
+{
+    plist_data_t data = plist_get_data(value);
+    uint64_t width = 0;
+    uint64_t val = 0;
 
-    bplist_buff->data = NULL; // make sure we don't free the output buffer
-    byte_array_free(bplist_buff);
+    switch (data->type) {
+    case PLIST_BOOLEAN:
+        if (type != BPLIST_NULL || (size != BPLIST_TRUE && size != BPLIST_FALSE)) {
+            return 0;
+        }
+        /* the value is part of the marker */
+        payload[-1] = (char)(data->boolval ? BPLIST_TRUE : BPLIST_FALSE);
+        return 1;
+    case PLIST_UINT:
+        if (type != BPLIST_UINT || size > 4) {
+            return 0;
+        }
+        width = 1 << size;
+        val = data->intval;
+        if (data->length == 16) {
+            /* unsigned values above INT64_MAX only fit into 16 bytes */
+            if (width != 16) {
+                return 0;
+            }
+        } else if ((int64_t)val < 0) {
+            /* negative values are 8 bytes, smaller integers are unsigned */
+            if (width != 8) {
+                return 0;
+            }
+        } else if (width < 8 && val >> (8 * width) != 0) {
+            return 0;
+        }
+        if (width == 16) {
+            memset(payload, 0, 8);
+            bplist_patch_put_uint(payload + 8, val, 8);
+        } else {
+            bplist_patch_put_uint(payload, val, width);
+        }
+        return 1;
+    case PLIST_REAL:
+        if (type != BPLIST_REAL) {
+            return 0;
+        }
+        if (size == 2) {
+            float floatval = (float)data->realval;
+            uint32_t bits = 0;
+            if ((double)floatval != data->realval && data->realval == data->realval) {
+                return 0;
+            }
+            memcpy(&bits, &floatval, sizeof(bits));
+            bplist_patch_put_uint(payload, bits, 4);
+            return 1;
+        } else if (size == 3) {
+            memcpy(&val, &data->realval, sizeof(val));
+            bplist_patch_put_uint(payload, val, 8);
+            return 1;
+        }
+        return 0;
+    case PLIST_DATE:
+        if (type != BPLIST_DATE || size != 3) {
+            return 0;
+        }
+        memcpy(&val, &data->realval, sizeof(val));
+        bplist_patch_put_uint(payload, val, 8);
+        return 1;
+    case PLIST_UID:
+        width = size + 1;
+        if (type != BPLIST_UID || (width < 8 && data->intval >> (8 * width) != 0)) {
+            return 0;
+        }
+        if (width > 8) {
+            memset(payload, 0, width - 8);
+            bplist_patch_put_uint(payload + width - 8, data->intval, 8);
+        } else {
+            bplist_patch_put_uint(payload, data->intval, width);
+        }
+        return 1;
+    case PLIST_STRING:
+        if (type != BPLIST_STRING || size != data->length || !is_ascii_string(data->strval, data->length)) {
+            return 0;
+        }
+        memcpy(payload, data->strval, size);
+        return 1;
+    case PLIST_DATA:
+        if (type != BPLIST_DATA || size != data->length) {
+            return 0;
+        }
+        memcpy(payload, data->buff, size);
+        return 1;
+    default:
+        break;
+    }
+    return 0;
+}
+
+/* appends value as a new object; integers and reals always get 8 bytes,
+ * so changing them again later fits in place */
+static void bplist_patch_write_value(bytearray_t *out, plist_t value)
+{
+    plist_data_t data = plist_get_data(value);
+    uint8_t buf[9];
+
+    switch (data->type) {
+    case PLIST_UINT:
+        if (data->length == 16) {
+            write_uint(out, data->intval);
+            return;
+        }
+        buf[0] = BPLIST_UINT | 3;
+        bplist_patch_put_uint((char*)buf + 1, data->intval, 8);
+        byte_array_append(out, buf, 9);
+        return;
+    case PLIST_REAL: {
+        uint64_t bits = 0;
+        memcpy(&bits, &data->realval, sizeof(bits));
+        buf[0] = BPLIST_REAL | 3;
+        bplist_patch_put_uint((char*)buf + 1, bits, 8);
+        byte_array_append(out, buf, 9);
+        return;
+    }
+    default:
+        write_object(out, (node_t*)value, NULL, 0);
+        return;
+    }
+}
+
+/* the slow path: parses the plist, replaces the value and writes it again */
+static int bplist_patch_rewrite(char **plist_bin, uint64_t *length, plist_path_t path, plist_t value)
+{
+    plist_t root = NULL;
+    plist_t node = NULL;
+    plist_t parent = NULL;
+    char *out = NULL;
+    uint64_t out_length = 0;
+
+    plist_from_bin64(*plist_bin, *length, PLIST_PARSE_DEFAULT, &root);
+    node = plist_path_get(path, root);
+    if (!node) {
+        plist_free(root);
+        return -1;
+    }
+    parent = plist_get_parent(node);
+    if (!parent) {
+        plist_free(root);
+        root = plist_copy(value);
+    } else if (PLIST_IS_DICT(parent)) {
+        char *key = NULL;
+        plist_dict_get_item_key(node, &key);
+        plist_dict_set_item(parent, key, plist_copy(value));
+        plist_mem_free(key);
+    } else {
+        plist_array_set_item(parent, plist_copy(value), plist_array_get_item_index(node));
+    }
+    if (plist_to_bin64(root, PLIST_WRITE_DEFAULT, &out, &out_length) < 0) {
+        plist_free(root);
+        return -1;
+    }
+    plist_free(root);
+    plist_mem_free(*plist_bin);
+    *plist_bin = out;
+    *length = out_length;
+    return 1;
+}
+
+PLIST_API int plist_bin_patch(char **plist_bin, uint64_t *length, plist_path_t path, plist_t value)
+{
+    struct plist_bin_reader_s *r = NULL;
+    struct bplist_patch_step *steps = NULL;
+    bplist_trailer_t trailer;
+    bytearray_t *tail = NULL;
+    uint64_t *offsets = NULL;
+    uint64_t prefix = 0;
+    uint64_t num_objects = 0;
+    uint64_t new_index = 0;
+    uint64_t slot_offset = 0;
+    uint64_t new_length = 0;
+    uint32_t count = 0;
+    uint32_t shared = 0;
+    uint8_t ref_size = 0;
+    uint8_t offset_size = 0;
+    uint8_t type = 0;
+    uint64_t size = 0;
+    const char *payload = NULL;
+    char *buf = NULL;
+    plist_type vtype = plist_get_node_type(value);
+    int64_t i = 0;
+    int res = -1;
+
+    if (!plist_bin || !*plist_bin || !length || !path) {
+        return -1;
+    }
+    if (vtype != PLIST_BOOLEAN && vtype != PLIST_UINT && vtype != PLIST_REAL && vtype != PLIST_STRING
+        && vtype != PLIST_DATA && vtype != PLIST_DATE && vtype != PLIST_UID) {
+        return -1;
+    }
+    r = (struct plist_bin_reader_s*)plist_bin_reader_open(*plist_bin, *length);
+    if (!r) {
+        return -1;
+    }
+    count = plist_path_get_count(path);
+    steps = (struct bplist_patch_step*)plist_calloc(count + 1, sizeof(struct bplist_patch_step));
+    if (!steps || bplist_patch_walk(r, path, steps, count) < 0) {
+        goto out;
+    }
+
+    /* Objects can be referenced more than once, e.g. equal strings and
+     * numbers are usually written only once. Changing a shared object
+     * would change every place it is used, so only the objects above the
+     * first shared one on the path can be changed in place. */
+    bplist_patch_count_refs(r, steps, count);
+    shared = (steps[0].refs > 0) ? 0 : count + 1;
+    for (i = 1; i <= (int64_t)count && shared > count; i++) {
+        if (steps[i].refs > 1) {
+            shared = (uint32_t)i;
+        }
+    }
+    if (reader_get_object(r, steps[count].obj, &type, &size, &payload) < 0) {
+        goto out;
+    }
+    if (shared > count && bplist_patch_in_place(*plist_bin + (payload - r->bplist.data), type, size, value)) {
+        res = 0;
+        goto out;
+    }
+
+    /* Otherwise the value becomes a new object after the existing ones,
+     * the shared containers on the path are copied, and the reference in
+     * the nearest container that is not shared, or the root index in the
+     * trailer, is changed to point to the new objects. */
+    num_objects = r->bplist.num_objects;
+    ref_size = r->bplist.ref_size;
+    if (ref_size < 8 && num_objects + count + 1 > (1ULL << (8 * ref_size))) {
+        /* the new objects can't be referenced with the existing ref size */
+        plist_bin_reader_free((plist_bin_reader_t)r);
+        r = NULL;
+        res = bplist_patch_rewrite(plist_bin, length, path, value);
+        goto out;
+    }
+    offsets = (uint64_t*)plist_malloc((num_objects + count + 1) * sizeof(uint64_t));
+    tail = byte_array_new_size(256);
+    if (!offsets || !tail->data) {
+        goto out;
+    }
+    for (i = 0; i < (int64_t)num_objects; i++) {
+        offsets[i] = UINT_TO_HOST(r->bplist.offset_table + i * r->bplist.offset_size, r->bplist.offset_size);
+    }
+    prefix = (uint64_t)(r->bplist.offset_table - r->bplist.data);
+
+    new_index = num_objects;
+    offsets[new_index] = prefix;
+    bplist_patch_write_value(tail, value);
+    for (i = (int64_t)count - 1; i >= 0; i--) {
+        const char *start = NULL;
+        uint64_t refs_size = 0;
+        uint64_t copy_size = 0;
+        uint64_t copy = 0;
+
+        if (reader_get_object(r, steps[i].obj, &type, &size, &payload) < 0) {
+            goto out;
+        }
+        if ((uint32_t)i < shared) {
+            /* this container is only reached through the path */
+            slot_offset = (uint64_t)(payload - r->bplist.data) + steps[i].slot * ref_size;
+            break;
+        }
+        start = bplist_object_at_index(&r->bplist, steps[i].obj);
+        refs_size = ((type == BPLIST_DICT) ? 2 * size : size) * ref_size;
+        copy_size = (uint64_t)(payload - start) + refs_size;
+        copy = tail->len;
+        byte_array_append(tail, (void*)start, copy_size);
+        if (!tail->data) {
+            goto out;
+        }
+        bplist_encode_uints(&new_index, 1, ref_size, (uint8_t*)tail->data + copy + (payload - start) + steps[i].slot * ref_size);
+        new_index++;
+        offsets[new_index] = prefix + copy;
+    }
+    offset_size = get_needed_bytes(prefix + tail->len);
+    memcpy(&trailer, r->bplist.data + *length - sizeof(bplist_trailer_t), sizeof(bplist_trailer_t));
+    trailer.offset_size = offset_size;
+    trailer.num_objects = be64toh(new_index + 1);
+    if (i < 0) {
+        /* the root itself is replaced */
+        trailer.root_object_index = be64toh(new_index);
+    }
+    trailer.offset_table_offset = be64toh(prefix + tail->len);
+    write_refs(tail, offsets, new_index + 1, offset_size);
+    byte_array_append(tail, &trailer, sizeof(bplist_trailer_t));
+    if (!tail->data) {
+        goto out;
+    }
+
+    plist_bin_reader_free((plist_bin_reader_t)r);
+    r = NULL;
+    new_length = prefix + tail->len;
+    buf = (char*)plist_realloc(*plist_bin, new_length);
+    if (!buf) {
+        goto out;
+    }
+    memcpy(buf + prefix, tail->data, tail->len);
+    if (i >= 0) {
+        bplist_encode_uints(&new_index, 1, ref_size, (uint8_t*)buf + slot_offset);
+    }
+    *plist_bin = buf;
+    *length = new_length;
+    res = 1;
+
+out:
+    byte_array_free(tail);
+    plist_mem_free(offsets);
+    plist_mem_free(steps);
+    plist_bin_reader_free((plist_bin_reader_t)r);
+    return res;
 }
@@ -20,15 +20,32 @@
  */
 #include <string.h>
 #include "bytearray.h"
+#include "alloc.h"
 
 #define PAGE_SIZE 4096
 
 bytearray_t *byte_array_new()
 {
-	bytearray_t *a = (bytearray_t*)malloc(sizeof(bytearray_t));
-	a->capacity = PAGE_SIZE * 8;
-	a->data = malloc(a->capacity);
+	return byte_array_new_size(PAGE_SIZE * 8);
+}
+
+bytearray_t *byte_array_new_size(size_t initial)
+{
+	bytearray_t *a = (bytearray_t*)plist_malloc(sizeof(bytearray_t));
+	a->capacity = (initial > 0) ? initial : PAGE_SIZE;
+	a->data = plist_malloc(a->capacity);
 	a->len = 0;
+	a->flush = NULL;
+	a->flush_ctx = NULL;
+	a->error = 0;
+	return a;
+}
+
+bytearray_t *byte_array_new_stream(size_t size, byte_array_flush_func flush, void *ctx)
+{
+	bytearray_t *a = byte_array_new_size(size);
+	a->flush = flush;
+	a->flush_ctx = ctx;
 	return a;
 }
 
@@ -36,15 +53,23 @@ void byte_array_free(bytearray_t *ba)
 {
 	if (!ba) return;
 	if (ba->data) {
-		free(ba->data);
+		plist_mem_free(ba->data);
 	}
-	free(ba);
+	plist_mem_free(ba);
 }
 
 void byte_array_grow(bytearray_t *ba, size_t amount)
 {
+	if (ba->flush) {
+		/* fixed size, flushed by byte_array_append */
+		return;
+	}
 	size_t increase = (amount > PAGE_SIZE) ? (amount+(PAGE_SIZE-1)) & (~(PAGE_SIZE-1)) : PAGE_SIZE;
-	ba->data = realloc(ba->data, ba->capacity + increase);
+	/* grow geometrically to keep the number of reallocs logarithmic */
+	if (increase < ba->capacity) {
+		increase = ba->capacity;
+	}
+	ba->data = plist_realloc(ba->data, ba->capacity + increase);
 	ba->capacity += increase;
 }
 
@@ -53,9 +78,29 @@ void byte_array_append(bytearray_t *ba, void *buf, size_t len)
 	if (!ba || !ba->data || (len <= 0)) return;
 	size_t remaining = ba->capacity-ba->len;
 	if (len > remaining) {
-		size_t needed = len - remaining;
-		byte_array_grow(ba, needed);
+		if (ba->flush) {
+			byte_array_flush(ba);
+			if (len >= ba->capacity) {
+				/* too large to be buffered, pass it on directly */
+				if (!ba->error && ba->flush(ba->flush_ctx, (const char*)buf, len) != 0) {
+					ba->error = 1;
+				}
+				return;
+			}
+		} else {
+			size_t needed = len - remaining;
+			byte_array_grow(ba, needed);
+		}
 	}
 	memcpy(((char*)ba->data) + ba->len, buf, len);
 	ba->len += len;
 }
+
+void byte_array_flush(bytearray_t *ba)
+{
+	if (!ba || !ba->flush || ba->len == 0) return;
+	if (!ba->error && ba->flush(ba->flush_ctx, (const char*)ba->data, ba->len) != 0) {
+		ba->error = 1;
+	}
+	ba->len = 0;
+}
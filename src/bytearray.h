@@ -22,15 +22,23 @@
 #define BYTEARRAY_H
 #include <stdlib.h>
 
+typedef int (*byte_array_flush_func)(void *ctx, const char *buf, size_t len);
+
 typedef struct bytearray_t {
 	void *data;
 	size_t len;
 	size_t capacity;
+	byte_array_flush_func flush;
+	void *flush_ctx;
+	int error;
 } bytearray_t;
 
 bytearray_t *byte_array_new();
+bytearray_t *byte_array_new_size(size_t initial);
+bytearray_t *byte_array_new_stream(size_t size, byte_array_flush_func flush, void *ctx);
 void byte_array_free(bytearray_t *ba);
 void byte_array_grow(bytearray_t *ba, size_t amount);
 void byte_array_append(bytearray_t *ba, void *buf, size_t len);
+void byte_array_flush(bytearray_t *ba);
 
 #endif
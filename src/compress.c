@@ -0,0 +1,939 @@
+/*
+ * compress.c
+ * compressed binary plists
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "plist.h"
+#include "alloc.h"
+
+/*
+ * Container layout, numbers are big endian:
+ *
+ *   "bplz00"   magic and version
+ *   method     1 byte, a plist_compression_t
+ *   flags      1 byte, BPLZ_FLAG_DICT if a dictionary is needed
+ *   length     8 bytes, the size of the binary plist
+ *   checksum   4 bytes, plist_hash_bytes() of the binary plist
+ *   dict_id    4 bytes, the id of the dictionary or 0
+ *
+ * followed by blocks that decode to BPLZ_BLOCK_SIZE bytes each, the last
+ * one to the rest. A block starts with its size in 4 bytes. If the top
+ * bit is set the block is stored as is, otherwise it is an LZ4 block whose
+ * matches may reach up to 64 KiB back, into previous blocks and into the
+ * dictionary, which is treated as if it preceded the data.
+ */
+#define BPLZ_MAGIC "bplz00"
+#define BPLZ_MAGIC_LEN 6
+#define BPLZ_HEADER_SIZE 24
+#define BPLZ_FLAG_DICT 1
+#define BPLZ_BLOCK_SIZE 65536
+#define BPLZ_BLOCK_STORED 0x80000000u
+/* an LZ4 block for BPLZ_BLOCK_SIZE bytes is never larger than this */
+#define BPLZ_BLOCK_BOUND (BPLZ_BLOCK_SIZE + BPLZ_BLOCK_SIZE / 255 + 16)
+/* initial output size when the input comes from a read callback */
+#define BPLZ_STREAM_INITIAL_SIZE (1 << 20)
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_OFFSET 65535
+/* the last match of a block starts at least this many bytes before its
+ * end, and the last LZ4_LAST_LITERALS bytes are literals */
+#define LZ4_MFLIMIT 12
+#define LZ4_LAST_LITERALS 5
+
+#define LZ4_FAST_HASH_BITS 14
+#define LZ4_CHAIN_HASH_BITS 15
+#define LZ4_CHAIN_SIZE 65536
+#define LZ4_MAX_LEVEL 12
+
+/* The hash tables store positions in a virtual buffer in which the
+ * dictionary ends at DICT_END and the input starts there. Position 0
+ * marks an empty slot. */
+#define DICT_MAX_SIZE 65536
+#define DICT_END (DICT_MAX_SIZE + 1)
+
+/* dictionary training, see plist_compress_dict_train() */
+#define TRAIN_DMER_SIZE 8
+#define TRAIN_SEGMENT_SIZE 32
+#define TRAIN_SEGMENT_STEP 8
+#define TRAIN_HASH_BITS 20
+
+struct plist_compress_dict_s {
+    char *data;
+    uint32_t length;
+    uint32_t id;
+    /* hash tables with the positions of the dictionary, copied by every
+     * compression that uses it */
+    uint32_t *fast_table;
+    uint32_t *chain_head;
+    uint16_t *chain;
+};
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t be32dec(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void be32enc(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+}
+
+static uint32_t lz4_hash(uint32_t v, unsigned int bits)
+{
+    return (v * 2654435761u) >> (32 - bits);
+}
+
+/* the input of a compression, see the comment on DICT_END */
+struct lz4_source {
+    const uint8_t *in;
+    size_t length;
+    const uint8_t *dict;
+    uint32_t dict_length;
+    uint32_t *table;
+    unsigned int hash_bits;
+    uint16_t *chain;
+    unsigned int max_attempts;
+};
+
+static const uint8_t *lz4_source_ptr(const struct lz4_source *s, uint32_t v)
+{
+    return (v >= DICT_END) ? s->in + (v - DICT_END) : s->dict + s->dict_length - (DICT_END - v);
+}
+
+static size_t common_length(const uint8_t *a, const uint8_t *b, const uint8_t *a_end)
+{
+    const uint8_t *start = a;
+    while (a + 8 <= a_end && read64(a) == read64(b)) {
+        a += 8;
+        b += 8;
+    }
+    while (a < a_end && *a == *b) {
+        a++;
+        b++;
+    }
+    return (size_t)(a - start);
+}
+
+/* length of the match of the input at ip with the virtual position cand,
+ * at most limit - ip. A match in the dictionary can continue at the
+ * start of the input. */
+static size_t lz4_match_length(const struct lz4_source *s, size_t ip, uint32_t cand, size_t limit)
+{
+    const uint8_t *p = s->in + ip;
+    size_t len = 0;
+    if (cand >= DICT_END) {
+        return common_length(p, s->in + (cand - DICT_END), s->in + limit);
+    }
+    if ((size_t)(DICT_END - cand) < limit - ip) {
+        len = common_length(p, lz4_source_ptr(s, cand), p + (DICT_END - cand));
+        if (len < (size_t)(DICT_END - cand)) {
+            return len;
+        }
+        return len + common_length(p + len, s->in, s->in + limit);
+    }
+    return common_length(p, lz4_source_ptr(s, cand), s->in + limit);
+}
+
+static void lz4_chain_insert(struct lz4_source *s, uint32_t v, const uint8_t *p)
+{
+    uint32_t h = lz4_hash(read32(p), s->hash_bits);
+    uint32_t prev = s->table[h];
+    uint32_t delta = v - prev;
+    s->chain[v & (LZ4_CHAIN_SIZE - 1)] = (prev == 0 || delta > LZ4_MAX_OFFSET) ? 0 : (uint16_t)delta;
+    s->table[h] = v;
+}
+
+static uint8_t *lz4_write_length(uint8_t *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t *lz4_write_sequence(uint8_t *op, const uint8_t *literals, size_t lit_len, uint32_t offset, size_t match_len)
+{
+    size_t ml = match_len - LZ4_MIN_MATCH;
+    uint8_t token = (uint8_t)(((lit_len >= 15) ? 15 : lit_len) << 4);
+    token |= (uint8_t)((ml >= 15) ? 15 : ml);
+    *op++ = token;
+    if (lit_len >= 15) {
+        op = lz4_write_length(op, lit_len - 15);
+    }
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    if (ml >= 15) {
+        op = lz4_write_length(op, ml - 15);
+    }
+    return op;
+}
+
+static uint8_t *lz4_write_last_literals(uint8_t *op, const uint8_t *literals, size_t lit_len)
+{
+    *op++ = (uint8_t)(((lit_len >= 15) ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = lz4_write_length(op, lit_len - 15);
+    }
+    memcpy(op, literals, lit_len);
+    return op + lit_len;
+}
+
+/* Compresses the input from start to end into op, which has room for
+ * BPLZ_BLOCK_BOUND bytes, and returns the end of the output. All input
+ * before start is in the hash tables already. */
+static uint8_t *lz4_compress_block(struct lz4_source *s, size_t start, size_t end, uint8_t *op)
+{
+    const uint8_t *in = s->in;
+    uint32_t low = DICT_END - s->dict_length;
+    size_t anchor = start;
+    size_t ip = start;
+    size_t next_insert = start;
+    size_t mflimit = 0;
+    size_t matchlimit = 0;
+    unsigned int misses = 0;
+
+    if (end - start < LZ4_MFLIMIT + 1) {
+        return lz4_write_last_literals(op, in + start, end - start);
+    }
+    mflimit = end - LZ4_MFLIMIT;
+    matchlimit = end - LZ4_LAST_LITERALS;
+
+    while (ip < mflimit) {
+        uint32_t v = (uint32_t)(ip + DICT_END);
+        uint32_t best = 0;
+        size_t best_len = 0;
+
+        if (s->chain) {
+            uint32_t cand = 0;
+            unsigned int attempts = s->max_attempts;
+            while (next_insert < ip) {
+                lz4_chain_insert(s, (uint32_t)(next_insert + DICT_END), in + next_insert);
+                next_insert++;
+            }
+            cand = s->table[lz4_hash(read32(in + ip), s->hash_bits)];
+            while (cand && v - cand <= LZ4_MAX_OFFSET && attempts-- > 0) {
+                if (*lz4_source_ptr(s, cand + (uint32_t)best_len) == in[ip + best_len] && read32(lz4_source_ptr(s, cand)) == read32(in + ip)) {
+                    size_t len = lz4_match_length(s, ip, cand, matchlimit);
+                    if (len > best_len) {
+                        best_len = len;
+                        best = cand;
+                        if (ip + len == matchlimit) {
+                            break;
+                        }
+                    }
+                }
+                if (s->chain[cand & (LZ4_CHAIN_SIZE - 1)] == 0) {
+                    break;
+                }
+                cand -= s->chain[cand & (LZ4_CHAIN_SIZE - 1)];
+            }
+            if (best_len < LZ4_MIN_MATCH) {
+                ip++;
+                continue;
+            }
+        } else {
+            uint32_t h = lz4_hash(read32(in + ip), s->hash_bits);
+            uint32_t cand = s->table[h];
+            s->table[h] = v;
+            if (cand == 0 || v - cand > LZ4_MAX_OFFSET || read32(lz4_source_ptr(s, cand)) != read32(in + ip)) {
+                /* skip ahead faster in data that doesn't compress */
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            best = cand;
+            best_len = lz4_match_length(s, ip, cand, matchlimit);
+            misses = 0;
+        }
+
+        /* the match may start earlier */
+        while (ip > anchor && best > low && in[ip - 1] == *lz4_source_ptr(s, best - 1)) {
+            ip--;
+            best--;
+            best_len++;
+        }
+        op = lz4_write_sequence(op, in + anchor, ip - anchor, (uint32_t)(ip + DICT_END) - best, best_len);
+        ip += best_len;
+        anchor = ip;
+        if (!s->chain && ip < mflimit) {
+            /* keep a position inside the match for the next one */
+            uint32_t p = (uint32_t)(ip - 2);
+            s->table[lz4_hash(read32(in + p), s->hash_bits)] = p + DICT_END;
+        }
+    }
+    if (s->chain) {
+        /* the following blocks can refer to the rest of this one */
+        while (next_insert < end && next_insert + LZ4_MIN_MATCH <= s->length) {
+            lz4_chain_insert(s, (uint32_t)(next_insert + DICT_END), in + next_insert);
+            next_insert++;
+        }
+    }
+    return lz4_write_last_literals(op, in + anchor, end - anchor);
+}
+
+/* copies a match of len bytes from offset bytes back, which may overlap */
+static void lz4_copy_match(uint8_t *out, size_t op, size_t offset, size_t len)
+{
+    uint8_t *dst = out + op;
+    const uint8_t *src = dst - offset;
+    if (offset >= len) {
+        memcpy(dst, src, len);
+    } else if (offset >= 8) {
+        while (len >= 8) {
+            memcpy(dst, src, 8);
+            dst += 8;
+            src += 8;
+            len -= 8;
+        }
+        while (len-- > 0) {
+            *dst++ = *src++;
+        }
+    } else {
+        while (len-- > 0) {
+            *dst++ = *src++;
+        }
+    }
+}
+
+/* Decodes an LZ4 block to out from op to end, which has to be filled
+ * exactly. out holds the previous blocks. Returns 0 on success. */
+static int lz4_decode_block(const uint8_t *ip, size_t size, uint8_t *out, size_t op, size_t end, const uint8_t *dict, size_t dict_length)
+{
+    const uint8_t *iend = ip + size;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t len = token >> 4;
+        size_t offset = 0;
+        if (len == 15) {
+            uint8_t b = 0;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (size_t)(iend - ip) || len > end - op) {
+            return -1;
+        }
+        memcpy(out + op, ip, len);
+        ip += len;
+        op += len;
+        if (ip == iend) {
+            /* the last sequence has no match */
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        len = token & 15;
+        if (len == 15) {
+            uint8_t b = 0;
+            do {
+                if (ip >= iend) {
+                    return -1;
+                }
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ4_MIN_MATCH;
+        if (offset == 0 || len > end - op) {
+            return -1;
+        }
+        if (offset > op) {
+            /* the match starts in the dictionary */
+            size_t back = offset - op;
+            size_t n = (back < len) ? back : len;
+            if (back > dict_length) {
+                return -1;
+            }
+            memcpy(out + op, dict + dict_length - back, n);
+            op += n;
+            len -= n;
+        }
+        lz4_copy_match(out, op, offset, len);
+        op += len;
+    }
+    return (op == end) ? 0 : -1;
+}
+
+static int bplz_compress(const char *bin, size_t length, int level, struct plist_compress_dict_s *d, char **out, uint32_t *out_length)
+{
+    struct lz4_source s;
+    uint8_t *buf = NULL;
+    uint8_t *op = NULL;
+    size_t nblocks = (length + BPLZ_BLOCK_SIZE - 1) / BPLZ_BLOCK_SIZE;
+    size_t capacity = BPLZ_HEADER_SIZE + length + nblocks * 4 + BPLZ_BLOCK_BOUND;
+    size_t table_size = 0;
+    size_t pos = 0;
+    int i = 0;
+
+    if (level < 0 || level > LZ4_MAX_LEVEL || length > UINT32_MAX - DICT_END || capacity > UINT32_MAX) {
+        return -1;
+    }
+    if (level == 0) {
+        level = 1;
+    }
+
+    memset(&s, 0, sizeof(s));
+    s.in = (const uint8_t*)bin;
+    s.length = length;
+    if (d) {
+        s.dict = (const uint8_t*)d->data;
+        s.dict_length = d->length;
+    }
+    if (level == 1) {
+        /* small inputs without a dictionary get a smaller table, so the
+         * time to clear it doesn't dominate */
+        s.hash_bits = LZ4_FAST_HASH_BITS;
+        while (!d && s.hash_bits > 10 && ((size_t)1 << (s.hash_bits - 1)) >= length) {
+            s.hash_bits--;
+        }
+    } else {
+        s.hash_bits = LZ4_CHAIN_HASH_BITS;
+        s.max_attempts = 1u << (level - 1);
+        s.chain = (uint16_t*)plist_malloc(LZ4_CHAIN_SIZE * sizeof(uint16_t));
+        if (!s.chain) {
+            return -1;
+        }
+    }
+    table_size = ((size_t)1 << s.hash_bits) * sizeof(uint32_t);
+    s.table = (uint32_t*)plist_malloc(table_size);
+    buf = (uint8_t*)plist_malloc(capacity);
+    if (!s.table || !buf) {
+        plist_mem_free(s.table);
+        plist_mem_free(s.chain);
+        plist_mem_free(buf);
+        return -1;
+    }
+    if (d && s.chain) {
+        memcpy(s.table, d->chain_head, table_size);
+        memcpy(s.chain, d->chain, LZ4_CHAIN_SIZE * sizeof(uint16_t));
+    } else if (d) {
+        memcpy(s.table, d->fast_table, table_size);
+    } else {
+        memset(s.table, 0, table_size);
+    }
+
+    memcpy(buf, BPLZ_MAGIC, BPLZ_MAGIC_LEN);
+    buf[6] = PLIST_COMPRESS_LZ4;
+    buf[7] = (d) ? BPLZ_FLAG_DICT : 0;
+    for (i = 0; i < 8; i++) {
+        buf[8 + i] = (uint8_t)((uint64_t)length >> (56 - 8 * i));
+    }
+    be32enc(buf + 16, plist_hash_bytes(bin, length, 0));
+    be32enc(buf + 20, (d) ? d->id : 0);
+
+    op = buf + BPLZ_HEADER_SIZE;
+    while (pos < length) {
+        size_t end = (length - pos > BPLZ_BLOCK_SIZE) ? pos + BPLZ_BLOCK_SIZE : length;
+        uint8_t *block_end = lz4_compress_block(&s, pos, end, op + 4);
+        size_t size = (size_t)(block_end - (op + 4));
+        if (size >= end - pos) {
+            /* stored blocks only need to be copied when reading */
+            memcpy(op + 4, bin + pos, end - pos);
+            be32enc(op, (uint32_t)(end - pos) | BPLZ_BLOCK_STORED);
+            size = end - pos;
+        } else {
+            be32enc(op, (uint32_t)size);
+        }
+        op += 4 + size;
+        pos = end;
+    }
+    plist_mem_free(s.table);
+    plist_mem_free(s.chain);
+
+    *out_length = (uint32_t)(op - buf);
+    *out = (char*)plist_realloc(buf, *out_length);
+    if (!*out) {
+        *out = (char*)buf;
+    }
+    return 0;
+}
+
+PLIST_API int plist_to_bin_compressed(plist_t plist, plist_compression_t method, int level, plist_compress_dict_t dict, char **plist_out, uint32_t *length)
+{
+    char *bin = NULL;
+    uint32_t bin_length = 0;
+    int res = -1;
+
+    if (!plist || !plist_out || !length || method != PLIST_COMPRESS_LZ4) {
+        return -1;
+    }
+    *plist_out = NULL;
+    *length = 0;
+    plist_to_bin(plist, &bin, &bin_length);
+    if (!bin) {
+        return -1;
+    }
+    res = bplz_compress(bin, bin_length, level, (struct plist_compress_dict_s*)dict, plist_out, length);
+    plist_mem_free(bin);
+    return res;
+}
+
+/* compressed input, either in memory or from a read callback */
+struct bplz_input {
+    const char *data;
+    uint64_t length;
+    uint64_t pos;
+    plist_read_func_t reader;
+    void *user_data;
+    char *buf;
+};
+
+/* reads exactly size bytes to dst, returns 0 on success */
+static int bplz_input_read(struct bplz_input *in, char *dst, size_t size)
+{
+    if (in->data) {
+        if (size > in->length - in->pos) {
+            return -1;
+        }
+        memcpy(dst, in->data + in->pos, size);
+        in->pos += size;
+        return 0;
+    }
+    while (size > 0) {
+        size_t n = in->reader(in->user_data, dst, size);
+        if (n == 0 || n > size) {
+            return -1;
+        }
+        dst += n;
+        size -= n;
+    }
+    return 0;
+}
+
+/* returns the next size bytes (at most BPLZ_BLOCK_BOUND), or NULL at the
+ * end of the input. Memory input is not copied. */
+static const uint8_t *bplz_input_get(struct bplz_input *in, size_t size)
+{
+    const char *p = NULL;
+    if (in->data) {
+        if (size > in->length - in->pos) {
+            return NULL;
+        }
+        p = in->data + in->pos;
+        in->pos += size;
+        return (const uint8_t*)p;
+    }
+    return (bplz_input_read(in, in->buf, size) == 0) ? (const uint8_t*)in->buf : NULL;
+}
+
+static int bplz_decompress(struct bplz_input *in, struct plist_compress_dict_s *d, char **out, uint64_t *out_length)
+{
+    const uint8_t *hdr = bplz_input_get(in, BPLZ_HEADER_SIZE);
+    const uint8_t *dict = NULL;
+    size_t dict_length = 0;
+    uint8_t *buf = NULL;
+    uint32_t checksum = 0;
+    uint64_t length = 0;
+    uint64_t capacity = 0;
+    uint64_t pos = 0;
+    int i = 0;
+
+    if (!hdr || memcmp(hdr, BPLZ_MAGIC, BPLZ_MAGIC_LEN) != 0 || hdr[6] != PLIST_COMPRESS_LZ4 || (hdr[7] & ~BPLZ_FLAG_DICT) != 0) {
+        return -1;
+    }
+    for (i = 0; i < 8; i++) {
+        length = (length << 8) | hdr[8 + i];
+    }
+    checksum = be32dec(hdr + 16);
+    if (hdr[7] & BPLZ_FLAG_DICT) {
+        if (!d || d->id != be32dec(hdr + 20)) {
+            return -1;
+        }
+        dict = (const uint8_t*)d->data;
+        dict_length = d->length;
+    } else if (be32dec(hdr + 20) != 0) {
+        return -1;
+    }
+    if (length == 0 || length > SIZE_MAX) {
+        return -1;
+    }
+    if (in->data) {
+        /* LZ4 can't compress more than 255:1, so claiming more is an error
+         * that would otherwise only be noticed after the allocation */
+        if (length / 256 > in->length - in->pos) {
+            return -1;
+        }
+        capacity = length;
+    } else {
+        capacity = (length < BPLZ_STREAM_INITIAL_SIZE) ? length : BPLZ_STREAM_INITIAL_SIZE;
+    }
+    buf = (uint8_t*)plist_malloc((size_t)capacity);
+    if (!buf) {
+        return -1;
+    }
+
+    while (pos < length) {
+        uint64_t end = (length - pos > BPLZ_BLOCK_SIZE) ? pos + BPLZ_BLOCK_SIZE : length;
+        const uint8_t *p = bplz_input_get(in, 4);
+        uint32_t size = 0;
+        if (!p) {
+            break;
+        }
+        size = be32dec(p);
+        if (end > capacity) {
+            uint8_t *newbuf = NULL;
+            capacity = (capacity * 2 < length) ? capacity * 2 : length;
+            newbuf = (uint8_t*)plist_realloc(buf, (size_t)capacity);
+            if (!newbuf) {
+                break;
+            }
+            buf = newbuf;
+        }
+        if (size & BPLZ_BLOCK_STORED) {
+            if ((size & ~BPLZ_BLOCK_STORED) != end - pos || bplz_input_read(in, (char*)buf + pos, (size_t)(end - pos)) < 0) {
+                break;
+            }
+        } else {
+            if (size == 0 || size > BPLZ_BLOCK_BOUND) {
+                break;
+            }
+            p = bplz_input_get(in, size);
+            if (!p || lz4_decode_block(p, size, buf, (size_t)pos, (size_t)end, dict, dict_length) < 0) {
+                break;
+            }
+        }
+        pos = end;
+    }
+    if (pos != length || (in->data && in->pos != in->length) || plist_hash_bytes(buf, (size_t)length, 0) != checksum) {
+        plist_mem_free(buf);
+        return -1;
+    }
+    *out = (char*)buf;
+    *out_length = length;
+    return 0;
+}
+
+static void bplz_parse(struct bplz_input *in, plist_compress_dict_t dict, plist_t *plist)
+{
+    char *bin = NULL;
+    uint64_t length = 0;
+
+    *plist = NULL;
+    if (bplz_decompress(in, (struct plist_compress_dict_s*)dict, &bin, &length) < 0) {
+        return;
+    }
+    plist_from_bin_internal(bin, length, plist, NULL, PLIST_PARSE_DEFAULT);
+    plist_mem_free(bin);
+}
+
+void plist_from_compressed_internal(const char *plist_data, uint64_t length, plist_compress_dict_t dict, plist_t *plist)
+{
+    struct bplz_input in;
+
+    memset(&in, 0, sizeof(in));
+    in.data = plist_data;
+    in.length = length;
+    bplz_parse(&in, dict, plist);
+}
+
+PLIST_API void plist_from_bin_compressed(const char *plist_data, uint32_t length, plist_compress_dict_t dict, plist_t *plist)
+{
+    if (!plist) {
+        return;
+    }
+    *plist = NULL;
+    if (!plist_data) {
+        return;
+    }
+    plist_from_compressed_internal(plist_data, length, dict, plist);
+}
+
+PLIST_API int plist_from_bin_compressed_stream(plist_read_func_t reader, void *user_data, plist_compress_dict_t dict, plist_t *plist)
+{
+    struct bplz_input in;
+
+    if (!plist) {
+        return -1;
+    }
+    *plist = NULL;
+    if (!reader) {
+        return -1;
+    }
+    memset(&in, 0, sizeof(in));
+    in.reader = reader;
+    in.user_data = user_data;
+    in.buf = (char*)plist_malloc(BPLZ_BLOCK_BOUND);
+    if (!in.buf) {
+        return -1;
+    }
+    bplz_parse(&in, dict, plist);
+    plist_mem_free(in.buf);
+    return (*plist) ? 0 : -1;
+}
+
+PLIST_API int plist_is_compressed(const char *plist_data, uint32_t length)
+{
+    if (length < BPLZ_MAGIC_LEN) {
+        return 0;
+    }
+    return (memcmp(plist_data, BPLZ_MAGIC, BPLZ_MAGIC_LEN) == 0);
+}
+
+PLIST_API plist_compress_dict_t plist_compress_dict_new(const char *data, uint32_t length)
+{
+    struct plist_compress_dict_s *d = NULL;
+    struct lz4_source s;
+    uint32_t i = 0;
+
+    if (!data || length == 0) {
+        return NULL;
+    }
+    /* only the last 64 KiB can be reached by matches */
+    if (length > DICT_MAX_SIZE) {
+        data += length - DICT_MAX_SIZE;
+        length = DICT_MAX_SIZE;
+    }
+    d = (struct plist_compress_dict_s*)plist_calloc(1, sizeof(struct plist_compress_dict_s));
+    if (!d) {
+        return NULL;
+    }
+    d->data = (char*)plist_malloc(length);
+    d->fast_table = (uint32_t*)plist_calloc((size_t)1 << LZ4_FAST_HASH_BITS, sizeof(uint32_t));
+    d->chain_head = (uint32_t*)plist_calloc((size_t)1 << LZ4_CHAIN_HASH_BITS, sizeof(uint32_t));
+    d->chain = (uint16_t*)plist_calloc(LZ4_CHAIN_SIZE, sizeof(uint16_t));
+    if (!d->data || !d->fast_table || !d->chain_head || !d->chain) {
+        plist_compress_dict_free(d);
+        return NULL;
+    }
+    memcpy(d->data, data, length);
+    d->length = length;
+    d->id = plist_hash_bytes(data, length, 0);
+
+    memset(&s, 0, sizeof(s));
+    s.table = d->chain_head;
+    s.hash_bits = LZ4_CHAIN_HASH_BITS;
+    s.chain = d->chain;
+    for (i = 0; i + LZ4_MIN_MATCH <= length; i++) {
+        const uint8_t *p = (const uint8_t*)d->data + i;
+        uint32_t v = DICT_END - length + i;
+        d->fast_table[lz4_hash(read32(p), LZ4_FAST_HASH_BITS)] = v;
+        lz4_chain_insert(&s, v, p);
+    }
+    return d;
+}
+
+struct train_segment {
+    uint32_t score;
+    uint32_t sample;
+    uint32_t offset;
+};
+
+static void train_heap_push(struct train_segment *heap, size_t *count, struct train_segment seg)
+{
+    size_t i = (*count)++;
+    while (i > 0 && heap[(i - 1) / 2].score < seg.score) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = seg;
+}
+
+static struct train_segment train_heap_pop(struct train_segment *heap, size_t *count)
+{
+    struct train_segment top = heap[0];
+    struct train_segment last = heap[--(*count)];
+    size_t i = 0;
+    while (2 * i + 1 < *count) {
+        size_t c = 2 * i + 1;
+        if (c + 1 < *count && heap[c + 1].score > heap[c].score) {
+            c++;
+        }
+        if (heap[c].score <= last.score) {
+            break;
+        }
+        heap[i] = heap[c];
+        i = c;
+    }
+    if (*count > 0) {
+        heap[i] = last;
+    }
+    return top;
+}
+
+static uint32_t train_dmer_hash(const char *p)
+{
+    return (uint32_t)(plist_hash_bytes64(p, TRAIN_DMER_SIZE, 0) >> (64 - TRAIN_HASH_BITS));
+}
+
+/* sum of the frequencies of the d-mers in a segment */
+static uint32_t train_score(const uint32_t *freq, const char *p)
+{
+    uint32_t score = 0;
+    int i = 0;
+    for (i = 0; i + TRAIN_DMER_SIZE <= TRAIN_SEGMENT_SIZE; i++) {
+        score += freq[train_dmer_hash(p + i)];
+    }
+    return score;
+}
+
+PLIST_API plist_compress_dict_t plist_compress_dict_train(const char *const *samples, const uint32_t *lengths, uint32_t count, uint32_t max_size)
+{
+    plist_compress_dict_t d = NULL;
+    uint32_t *freq = NULL;
+    uint32_t *seen = NULL;
+    struct train_segment *heap = NULL;
+    size_t heap_count = 0;
+    size_t num_segments = 0;
+    char *buf = NULL;
+    uint32_t pos = 0;
+    uint32_t n = 0;
+    uint32_t i = 0;
+
+    if (!samples || !lengths || count == 0 || max_size == 0) {
+        return NULL;
+    }
+    if (max_size > DICT_MAX_SIZE) {
+        max_size = DICT_MAX_SIZE;
+    }
+    for (n = 0; n < count; n++) {
+        if (lengths[n] >= TRAIN_SEGMENT_SIZE) {
+            num_segments += (lengths[n] - TRAIN_SEGMENT_SIZE) / TRAIN_SEGMENT_STEP + 1;
+        }
+    }
+    if (num_segments == 0) {
+        return NULL;
+    }
+    freq = (uint32_t*)plist_calloc((size_t)1 << TRAIN_HASH_BITS, sizeof(uint32_t));
+    seen = (uint32_t*)plist_calloc((size_t)1 << TRAIN_HASH_BITS, sizeof(uint32_t));
+    heap = (struct train_segment*)plist_malloc(num_segments * sizeof(struct train_segment));
+    buf = (char*)plist_malloc(max_size);
+    if (!freq || !seen || !heap || !buf) {
+        goto leave;
+    }
+
+    /* in how many samples every d-mer occurs */
+    for (n = 0; n < count; n++) {
+        for (i = 0; i + TRAIN_DMER_SIZE <= lengths[n]; i++) {
+            uint32_t h = train_dmer_hash(samples[n] + i);
+            if (seen[h] != n + 1) {
+                seen[h] = n + 1;
+                freq[h]++;
+            }
+        }
+    }
+    /* a d-mer found in one sample only doesn't help the others */
+    for (i = 0; i < (1u << TRAIN_HASH_BITS); i++) {
+        if (freq[i] < 2) {
+            freq[i] = 0;
+        }
+    }
+    for (n = 0; n < count; n++) {
+        for (i = 0; lengths[n] >= TRAIN_SEGMENT_SIZE && i <= lengths[n] - TRAIN_SEGMENT_SIZE; i += TRAIN_SEGMENT_STEP) {
+            struct train_segment seg;
+            seg.score = train_score(freq, samples[n] + i);
+            seg.sample = n;
+            seg.offset = i;
+            if (seg.score > 0) {
+                train_heap_push(heap, &heap_count, seg);
+            }
+        }
+    }
+
+    /* Picks the segments covering the most frequent d-mers, which are then
+     * no longer counted for the others. The best segments go to the end
+     * of the dictionary, closest to the data. Scores only decrease, so a
+     * segment whose updated score is still the highest is the best. */
+    pos = max_size;
+    while (heap_count > 0 && pos >= TRAIN_SEGMENT_SIZE) {
+        struct train_segment seg = train_heap_pop(heap, &heap_count);
+        const char *p = samples[seg.sample] + seg.offset;
+        uint32_t score = train_score(freq, p);
+        if (score == 0) {
+            continue;
+        }
+        if (score < seg.score && heap_count > 0 && score < heap[0].score) {
+            seg.score = score;
+            train_heap_push(heap, &heap_count, seg);
+            continue;
+        }
+        pos -= TRAIN_SEGMENT_SIZE;
+        memcpy(buf + pos, p, TRAIN_SEGMENT_SIZE);
+        for (i = 0; i + TRAIN_DMER_SIZE <= TRAIN_SEGMENT_SIZE; i++) {
+            freq[train_dmer_hash(p + i)] = 0;
+        }
+    }
+    if (pos < max_size) {
+        d = plist_compress_dict_new(buf + pos, max_size - pos);
+    }
+
+leave:
+    plist_mem_free(freq);
+    plist_mem_free(seen);
+    plist_mem_free(heap);
+    plist_mem_free(buf);
+    return d;
+}
+
+PLIST_API void plist_compress_dict_get_data(plist_compress_dict_t dict, const char **data, uint32_t *length)
+{
+    struct plist_compress_dict_s *d = (struct plist_compress_dict_s*)dict;
+    if (data) {
+        *data = (d) ? d->data : NULL;
+    }
+    if (length) {
+        *length = (d) ? d->length : 0;
+    }
+}
+
+PLIST_API void plist_compress_dict_free(plist_compress_dict_t dict)
+{
+    struct plist_compress_dict_s *d = (struct plist_compress_dict_s*)dict;
+    if (!d) {
+        return;
+    }
+    plist_mem_free(d->data);
+    plist_mem_free(d->fast_table);
+    plist_mem_free(d->chain_head);
+    plist_mem_free(d->chain);
+    plist_mem_free(d);
+}
@@ -0,0 +1,320 @@
+/*
+ * diff.c
+ * tree diff and patch
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "plist.h"
+
+#include <node.h>
+
+/* adds an operation on path to the patch, value is copied */
+static void diff_emit(plist_t patch, const char *op, plist_t path, plist_t value)
+{
+    plist_t entry = plist_new_dict();
+    plist_dict_set_item(entry, "op", plist_new_string(op));
+    plist_dict_set_item(entry, "path", plist_copy(path));
+    if (value) {
+        plist_dict_set_item(entry, "value", plist_copy(value));
+    }
+    plist_array_append_item(patch, entry);
+}
+
+static int is_container(plist_t node)
+{
+    plist_type type = plist_get_node_type(node);
+    return (type == PLIST_ARRAY || type == PLIST_DICT);
+}
+
+/* the hashes of both trees are computed before the diff, so comparing
+ * them is a cheap reject for containers. Equal hashes are confirmed with
+ * a deep compare, which also rejects early on cached hashes that differ. */
+static int diff_same(plist_t a, plist_t b)
+{
+    if (plist_get_node_type(a) != plist_get_node_type(b)) {
+        return 0;
+    }
+    if (is_container(a)) {
+        return plist_hash(a) == plist_hash(b) && plist_equal_deep(a, b);
+    }
+    return plist_data_compare(a, b);
+}
+
+static void diff_node(plist_t old_node, plist_t new_node, plist_t path, plist_t patch, uint32_t depth);
+
+/* diffs item old_item of old and new_item of new, component of the path
+ * leads to them */
+static void diff_child(plist_t old_item, plist_t new_item, plist_t component, plist_t path, plist_t patch, uint32_t depth)
+{
+    if (diff_same(old_item, new_item)) {
+        plist_free(component);
+        return;
+    }
+    plist_array_append_item(path, component);
+    diff_node(old_item, new_item, path, patch, depth + 1);
+    plist_array_remove_item(path, plist_array_get_size(path) - 1);
+}
+
+static void diff_dict(plist_t old_node, plist_t new_node, plist_t path, plist_t patch, uint32_t depth)
+{
+    node_t *key = NULL;
+    node_t *other = NULL;
+    plist_t item = NULL;
+    uint32_t found = 0;
+
+    /* changed and removed keys */
+    other = node_first_child((node_t*)new_node);
+    for (key = node_first_child((node_t*)old_node); key && node_next_sibling(key); key = node_next_sibling(node_next_sibling(key))) {
+        const char *name = plist_get_data(key)->strval;
+        item = plist_dict_find_value(new_node, key, other);
+        if (!item) {
+            plist_array_append_item(path, plist_new_string(name));
+            diff_emit(patch, "remove", path, NULL);
+            plist_array_remove_item(path, plist_array_get_size(path) - 1);
+        } else {
+            diff_child(node_next_sibling(key), item, plist_new_string(name), path, patch, depth);
+            found++;
+        }
+        if (other && node_next_sibling(other)) {
+            other = node_next_sibling(node_next_sibling(other));
+        }
+    }
+
+    /* added keys, if new has more than the old keys it has */
+    if (found == plist_dict_get_size(new_node)) {
+        return;
+    }
+    other = node_first_child((node_t*)old_node);
+    for (key = node_first_child((node_t*)new_node); key && node_next_sibling(key); key = node_next_sibling(node_next_sibling(key))) {
+        if (!plist_dict_find_value(old_node, key, other)) {
+            plist_array_append_item(path, plist_new_string(plist_get_data(key)->strval));
+            diff_emit(patch, "set", path, node_next_sibling(key));
+            plist_array_remove_item(path, plist_array_get_size(path) - 1);
+        }
+        if (other && node_next_sibling(other)) {
+            other = node_next_sibling(node_next_sibling(other));
+        }
+    }
+}
+
+/* how far diff_array looks ahead for an item that was inserted or removed */
+#define DIFF_LOOKAHEAD 16
+
+/* emits an operation on the array item at index */
+static void diff_emit_index(plist_t patch, const char *op, plist_t path, uint32_t index, plist_t value)
+{
+    plist_array_append_item(path, plist_new_uint(index));
+    diff_emit(patch, op, path, value);
+    plist_array_remove_item(path, plist_array_get_size(path) - 1);
+}
+
+static void diff_array(plist_t old_node, plist_t new_node, plist_t path, plist_t patch, uint32_t depth)
+{
+    uint32_t old_size = plist_array_get_size(old_node);
+    uint32_t new_size = plist_array_get_size(new_node);
+    uint32_t suffix = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+
+    while (suffix < old_size && suffix < new_size && diff_same(plist_array_get_item(old_node, old_size - 1 - suffix), plist_array_get_item(new_node, new_size - 1 - suffix))) {
+        suffix++;
+    }
+    old_size -= suffix;
+    new_size -= suffix;
+
+    /* the patched array holds the new items before j and the old items
+     * from i on, so all operations use index j */
+    while (i < old_size && j < new_size) {
+        plist_t old_item = plist_array_get_item(old_node, i);
+        plist_t new_item = plist_array_get_item(new_node, j);
+        uint32_t inserted = 0;
+        uint32_t removed = 0;
+        uint32_t k = 0;
+
+        if (diff_same(old_item, new_item)) {
+            i++;
+            j++;
+            continue;
+        }
+        /* a few items inserted or removed here, the smaller change wins */
+        for (k = 1; k <= DIFF_LOOKAHEAD && !inserted && !removed; k++) {
+            if (j + k < new_size && diff_same(old_item, plist_array_get_item(new_node, j + k))) {
+                inserted = k;
+            } else if (i + k < old_size && diff_same(plist_array_get_item(old_node, i + k), new_item)) {
+                removed = k;
+            }
+        }
+        if (inserted) {
+            for (k = 0; k < inserted; k++, j++) {
+                diff_emit_index(patch, "insert", path, j, plist_array_get_item(new_node, j));
+            }
+        } else if (removed) {
+            for (k = 0; k < removed; k++, i++) {
+                diff_emit_index(patch, "remove", path, j, NULL);
+            }
+        } else {
+            diff_child(old_item, new_item, plist_new_uint(j), path, patch, depth);
+            i++;
+            j++;
+        }
+    }
+    for (; j < new_size; j++) {
+        diff_emit_index(patch, "insert", path, j, plist_array_get_item(new_node, j));
+    }
+    for (; i < old_size; i++) {
+        diff_emit_index(patch, "remove", path, j, NULL);
+    }
+}
+
+static void diff_node(plist_t old_node, plist_t new_node, plist_t path, plist_t patch, uint32_t depth)
+{
+    plist_type type = plist_get_node_type(old_node);
+
+    /* very deep subtrees are replaced instead of recursing further */
+    if (type != plist_get_node_type(new_node) || !is_container(old_node) || depth >= plist_get_max_depth()) {
+        diff_emit(patch, "set", path, new_node);
+    } else if (type == PLIST_DICT) {
+        diff_dict(old_node, new_node, path, patch, depth);
+    } else {
+        diff_array(old_node, new_node, path, patch, depth);
+    }
+}
+
+PLIST_API plist_t plist_diff(plist_t old_node, plist_t new_node)
+{
+    plist_t patch = NULL;
+    plist_t path = NULL;
+
+    if (!old_node || !new_node) {
+        return NULL;
+    }
+    patch = plist_new_array();
+    plist_hash(old_node);
+    plist_hash(new_node);
+    if (!diff_same(old_node, new_node)) {
+        path = plist_new_array();
+        diff_node(old_node, new_node, path, patch, 0);
+        plist_free(path);
+    }
+    return patch;
+}
+
+/* returns the node the path component leads to in node */
+static plist_t patch_child(plist_t node, plist_t component)
+{
+    plist_type type = plist_get_node_type(component);
+    uint64_t index = 0;
+
+    if (type == PLIST_STRING && plist_get_node_type(node) == PLIST_DICT) {
+        return plist_dict_get_item(node, plist_get_string_ptr(component, NULL));
+    }
+    if (type == PLIST_UINT && plist_get_node_type(node) == PLIST_ARRAY) {
+        plist_get_uint_val(component, &index);
+        return (index < UINT32_MAX) ? plist_array_get_item(node, (uint32_t)index) : NULL;
+    }
+    return NULL;
+}
+
+static int patch_apply(plist_t *target, plist_t entry)
+{
+    const char *op = plist_get_string_ptr(plist_dict_get_item(entry, "op"), NULL);
+    plist_t path = plist_dict_get_item(entry, "path");
+    plist_t value = plist_dict_get_item(entry, "value");
+    plist_t parent = *target;
+    plist_t last = NULL;
+    uint32_t count = plist_array_get_size(path);
+    uint32_t i = 0;
+    uint64_t index = 0;
+
+    if (!op || !path || plist_get_node_type(path) != PLIST_ARRAY) {
+        return -1;
+    }
+    if (count == 0) {
+        /* only the whole tree can be replaced */
+        if (strcmp(op, "set") != 0 || !value) {
+            return -1;
+        }
+        plist_free(*target);
+        *target = plist_copy(value);
+        return 0;
+    }
+    for (i = 0; i < count - 1 && parent; i++) {
+        parent = patch_child(parent, plist_array_get_item(path, i));
+    }
+    last = plist_array_get_item(path, count - 1);
+    if (!parent) {
+        return -1;
+    }
+
+    if (plist_get_node_type(last) == PLIST_STRING && plist_get_node_type(parent) == PLIST_DICT) {
+        const char *key = plist_get_string_ptr(last, NULL);
+        if (strcmp(op, "set") == 0 && value) {
+            plist_dict_set_item(parent, key, plist_copy(value));
+            return 0;
+        }
+        if (strcmp(op, "remove") == 0 && plist_dict_get_item(parent, key)) {
+            plist_dict_remove_item(parent, key);
+            return 0;
+        }
+        return -1;
+    }
+    if (plist_get_node_type(last) != PLIST_UINT || plist_get_node_type(parent) != PLIST_ARRAY) {
+        return -1;
+    }
+    plist_get_uint_val(last, &index);
+    if (index > plist_array_get_size(parent)) {
+        return -1;
+    }
+    if (strcmp(op, "set") == 0 && value) {
+        if (index == plist_array_get_size(parent)) {
+            plist_array_append_item(parent, plist_copy(value));
+        } else {
+            plist_array_set_item(parent, plist_copy(value), (uint32_t)index);
+        }
+    } else if (strcmp(op, "insert") == 0 && value) {
+        plist_array_insert_item(parent, plist_copy(value), (uint32_t)index);
+    } else if (strcmp(op, "remove") == 0 && index < plist_array_get_size(parent)) {
+        plist_array_remove_item(parent, (uint32_t)index);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+PLIST_API int plist_patch(plist_t *target, plist_t patch)
+{
+    uint32_t count = 0;
+    uint32_t i = 0;
+
+    if (!target || !*target || plist_get_node_type(patch) != PLIST_ARRAY) {
+        return -1;
+    }
+    count = plist_array_get_size(patch);
+    for (i = 0; i < count; i++) {
+        plist_t entry = plist_array_get_item(patch, i);
+        if (plist_get_node_type(entry) != PLIST_DICT || patch_apply(target, entry) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
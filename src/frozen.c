@@ -0,0 +1,568 @@
+/*
+ * frozen.c
+ * read-only plists stored in a single contiguous block
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "plist.h"
+#include "ptrarray.h"
+#include "alloc.h"
+
+#include <node.h>
+
+/* dictionaries with more entries get a hash table, smaller ones are
+ * scanned */
+#define FROZEN_HASH_THRESHOLD 8
+
+/*
+ * Nodes are stored in depth first order, dict keys are nodes of their own
+ * and precede their value. Strings, keys and data live in the pool,
+ * strings are NUL terminated.
+ *
+ * The item table of an array holds the node indexes of its items. The
+ * item table of a dict with n entries holds key and value node indexes
+ * in turn, followed by a hash table {hash, entry + 1} for larger dicts.
+ */
+struct frozen_node_s {
+    uint32_t type;
+    uint32_t size;	/* payload length, items of an array or entries of a dict */
+    union {
+        uint64_t intval;
+        double realval;
+        uint64_t offset;	/* pool offset of the payload or item table offset */
+    };
+};
+
+struct plist_frozen_s {
+    uint64_t num_nodes;
+    uint64_t num_items;
+    uint64_t pool_size;
+    struct frozen_node_s *nodes;
+    uint32_t *items;
+    char *pool;
+};
+
+static uint64_t frozen_hash_slots(uint64_t entries)
+{
+    uint64_t slots = 16;
+    if (entries <= FROZEN_HASH_THRESHOLD) {
+        return 0;
+    }
+    while (slots < entries * 2) {
+        slots <<= 1;
+    }
+    return slots;
+}
+
+/* number of item table entries used by a container with n children */
+static uint64_t frozen_table_size(plist_type type, uint64_t n)
+{
+    if (type == PLIST_ARRAY) {
+        return n;
+    }
+    return n + 2 * frozen_hash_slots(n / 2);
+}
+
+/* counts nodes, item table entries and pool bytes, returns -1 if the tree
+ * is too large to be frozen */
+static int frozen_measure(node_t *root, uint64_t *num_nodes, uint64_t *num_items, uint64_t *pool_size)
+{
+    node_t *node = root;
+    node_t *ch = NULL;
+    plist_data_t data = NULL;
+
+    *num_nodes = *num_items = *pool_size = 0;
+    while (node) {
+        plist_load_children(node);
+        data = plist_get_data(node);
+        (*num_nodes)++;
+        switch (data->type) {
+        case PLIST_KEY:
+        case PLIST_STRING:
+        case PLIST_DATA:
+            if (data->length > UINT32_MAX) {
+                return -1;
+            }
+            *pool_size += data->length + ((data->type == PLIST_DATA) ? 0 : 1);
+            break;
+        case PLIST_ARRAY:
+        case PLIST_DICT:
+            /* length may hold a tree hash, see plist_data_s */
+            *num_items += frozen_table_size(data->type, node_n_children(node));
+            break;
+        default:
+            break;
+        }
+
+        ch = node_first_child(node);
+        if (ch) {
+            node = ch;
+            continue;
+        }
+        while (node && node != root && !node_next_sibling(node)) {
+            node = node->parent;
+        }
+        node = (node && node != root) ? node_next_sibling(node) : NULL;
+    }
+    if (*num_nodes > UINT32_MAX || *num_items > UINT32_MAX) {
+        return -1;
+    }
+    return 0;
+}
+
+static void frozen_build_hash(struct plist_frozen_s *frozen, struct frozen_node_s *dict)
+{
+    uint32_t *table = frozen->items + dict->offset;
+    uint32_t *slots = table + 2 * (uint64_t)dict->size;
+    uint64_t mask = frozen_hash_slots(dict->size) - 1;
+    uint32_t i = 0;
+
+    if (mask == (uint64_t)-1) {
+        return;
+    }
+    memset(slots, 0, (mask + 1) * 2 * sizeof(uint32_t));
+    for (i = 0; i < dict->size; i++) {
+        struct frozen_node_s *key = &frozen->nodes[table[2 * i]];
+        uint32_t hash = plist_hash_bytes(frozen->pool + key->offset, key->size, 0);
+        uint64_t slot = hash & mask;
+        while (slots[2 * slot + 1]) {
+            slot = (slot + 1) & mask;
+        }
+        slots[2 * slot] = hash;
+        slots[2 * slot + 1] = i + 1;
+    }
+}
+
+/* stacks of node indexes, stored off by one as ptrarray_t skips NULL */
+static void frozen_push(ptrarray_t *stack, uint64_t i)
+{
+    ptr_array_add(stack, (void*)(uintptr_t)(i + 1));
+}
+
+static uint64_t frozen_top(ptrarray_t *stack)
+{
+    return (uintptr_t)ptr_array_index(stack, stack->len - 1) - 1;
+}
+
+static uint64_t frozen_pop(ptrarray_t *stack)
+{
+    uint64_t i = frozen_top(stack);
+    ptr_array_remove(stack, stack->len - 1);
+    return i;
+}
+
+/* stores node at index i and adds it to the item table of parent */
+static void frozen_add_node(struct plist_frozen_s *frozen, node_t *node, uint64_t i, struct frozen_node_s *parent, uint64_t *item_pos, uint64_t *pool_pos)
+{
+    plist_data_t data = plist_get_data(node);
+    struct frozen_node_s *fn = &frozen->nodes[i];
+
+    fn->type = data->type;
+    fn->size = (uint32_t)data->length;
+    switch (data->type) {
+    case PLIST_KEY:
+    case PLIST_STRING:
+        fn->offset = *pool_pos;
+        memcpy(frozen->pool + *pool_pos, data->strval, data->length + 1);
+        *pool_pos += data->length + 1;
+        break;
+    case PLIST_DATA:
+        fn->offset = *pool_pos;
+        if (data->length > 0) {
+            memcpy(frozen->pool + *pool_pos, data->buff, data->length);
+        }
+        *pool_pos += data->length;
+        break;
+    case PLIST_ARRAY:
+    case PLIST_DICT:
+        /* size counts the children added so far */
+        fn->size = 0;
+        fn->offset = *item_pos;
+        *item_pos += frozen_table_size(data->type, node_n_children(node));
+        break;
+    case PLIST_BOOLEAN:
+        fn->intval = data->boolval;
+        break;
+    case PLIST_REAL:
+    case PLIST_DATE:
+        fn->realval = data->realval;
+        break;
+    default:
+        fn->intval = data->intval;
+        break;
+    }
+    if (parent) {
+        frozen->items[parent->offset + parent->size] = (uint32_t)i;
+        parent->size++;
+    }
+}
+
+/* called when all children of the container at index i were added */
+static void frozen_finish(struct plist_frozen_s *frozen, uint64_t i)
+{
+    struct frozen_node_s *fn = &frozen->nodes[i];
+    if (fn->type == PLIST_DICT) {
+        fn->size /= 2;
+        frozen_build_hash(frozen, fn);
+    }
+}
+
+PLIST_API plist_frozen_t plist_freeze(plist_t plist)
+{
+    struct plist_frozen_s *frozen = NULL;
+    node_t *root = (node_t*)plist;
+    node_t *node = root;
+    node_t *ch = NULL;
+    ptrarray_t *stack = NULL;
+    uint64_t num_nodes = 0;
+    uint64_t num_items = 0;
+    uint64_t pool_size = 0;
+    uint64_t item_pos = 0;
+    uint64_t pool_pos = 0;
+    uint64_t cur = 0;
+    uint64_t next = 0;
+    size_t size = 0;
+
+    if (!root || frozen_measure(root, &num_nodes, &num_items, &pool_size) < 0) {
+        return NULL;
+    }
+    size = sizeof(struct plist_frozen_s) + num_nodes * sizeof(struct frozen_node_s) + num_items * sizeof(uint32_t) + pool_size;
+    frozen = (struct plist_frozen_s*)plist_malloc(size);
+    stack = ptr_array_new(16);
+    if (!frozen || !stack) {
+        plist_mem_free(frozen);
+        ptr_array_free(stack);
+        return NULL;
+    }
+    frozen->num_nodes = num_nodes;
+    frozen->num_items = num_items;
+    frozen->pool_size = pool_size;
+    frozen->nodes = (struct frozen_node_s*)(frozen + 1);
+    frozen->items = (uint32_t*)(frozen->nodes + num_nodes);
+    frozen->pool = (char*)(frozen->items + num_items);
+
+    /* same walk as plist_copy, stack holds the indexes of the containers
+     * above node */
+    frozen_add_node(frozen, root, next++, NULL, &item_pos, &pool_pos);
+    while (node) {
+        ch = node_first_child(node);
+        if (ch) {
+            frozen_push(stack, cur);
+            cur = next++;
+            frozen_add_node(frozen, ch, cur, &frozen->nodes[frozen_top(stack)], &item_pos, &pool_pos);
+            node = ch;
+            continue;
+        }
+        while (node) {
+            frozen_finish(frozen, cur);
+            if (node == root) {
+                node = NULL;
+                break;
+            }
+            if (node_next_sibling(node)) {
+                node = node_next_sibling(node);
+                cur = next++;
+                frozen_add_node(frozen, node, cur, &frozen->nodes[frozen_top(stack)], &item_pos, &pool_pos);
+                break;
+            }
+            node = node->parent;
+            cur = frozen_pop(stack);
+        }
+    }
+    ptr_array_free(stack);
+    return frozen;
+}
+
+PLIST_API void plist_frozen_free(plist_frozen_t frozen)
+{
+    plist_mem_free(frozen);
+}
+
+static struct frozen_node_s *frozen_get(plist_frozen_t frozen, uint64_t obj)
+{
+    struct plist_frozen_s *f = (struct plist_frozen_s*)frozen;
+    if (!f || obj >= f->num_nodes) {
+        return NULL;
+    }
+    return &f->nodes[obj];
+}
+
+PLIST_API uint64_t plist_frozen_root(plist_frozen_t frozen)
+{
+    return 0;
+}
+
+PLIST_API plist_type plist_frozen_get_type(plist_frozen_t frozen, uint64_t obj)
+{
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    return (fn) ? (plist_type)fn->type : PLIST_NONE;
+}
+
+PLIST_API uint64_t plist_frozen_get_size(plist_frozen_t frozen, uint64_t obj)
+{
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    if (!fn) {
+        return 0;
+    }
+    switch (fn->type) {
+    case PLIST_ARRAY:
+    case PLIST_DICT:
+    case PLIST_STRING:
+    case PLIST_KEY:
+    case PLIST_DATA:
+        return fn->size;
+    default:
+        return 0;
+    }
+}
+
+PLIST_API int plist_frozen_child(plist_frozen_t frozen, uint64_t obj, uint64_t n, uint64_t *child)
+{
+    struct plist_frozen_s *f = (struct plist_frozen_s*)frozen;
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    if (!fn || !child || n >= fn->size) {
+        return -1;
+    }
+    if (fn->type == PLIST_ARRAY) {
+        *child = f->items[fn->offset + n];
+    } else if (fn->type == PLIST_DICT) {
+        *child = f->items[fn->offset + 2 * n + 1];
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+PLIST_API int plist_frozen_dict_key(plist_frozen_t frozen, uint64_t obj, uint64_t n, uint64_t *key)
+{
+    struct plist_frozen_s *f = (struct plist_frozen_s*)frozen;
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    if (!fn || !key || fn->type != PLIST_DICT || n >= fn->size) {
+        return -1;
+    }
+    *key = f->items[fn->offset + 2 * n];
+    return 0;
+}
+
+PLIST_API int plist_frozen_dict_get(plist_frozen_t frozen, uint64_t obj, const char *key, uint64_t *value)
+{
+    struct plist_frozen_s *f = (struct plist_frozen_s*)frozen;
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    const uint32_t *table = NULL;
+    const struct frozen_node_s *kn = NULL;
+    size_t len = 0;
+    uint32_t i = 0;
+
+    if (!fn || !key || !value || fn->type != PLIST_DICT) {
+        return -1;
+    }
+    table = f->items + fn->offset;
+    len = strlen(key);
+    if (fn->size <= FROZEN_HASH_THRESHOLD) {
+        for (i = 0; i < fn->size; i++) {
+            kn = &f->nodes[table[2 * i]];
+            if (kn->size == len && memcmp(f->pool + kn->offset, key, len) == 0) {
+                *value = table[2 * i + 1];
+                return 0;
+            }
+        }
+    } else {
+        const uint32_t *slots = table + 2 * (uint64_t)fn->size;
+        uint64_t mask = frozen_hash_slots(fn->size) - 1;
+        uint32_t hash = plist_hash_bytes(key, len, 0);
+        uint64_t slot = hash & mask;
+        while (slots[2 * slot + 1]) {
+            if (slots[2 * slot] == hash) {
+                i = slots[2 * slot + 1] - 1;
+                kn = &f->nodes[table[2 * i]];
+                if (kn->size == len && memcmp(f->pool + kn->offset, key, len) == 0) {
+                    *value = table[2 * i + 1];
+                    return 0;
+                }
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    return -1;
+}
+
+PLIST_API int plist_frozen_get_bool(plist_frozen_t frozen, uint64_t obj, uint8_t *val)
+{
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    if (!fn || !val || fn->type != PLIST_BOOLEAN) {
+        return -1;
+    }
+    *val = (uint8_t)fn->intval;
+    return 0;
+}
+
+PLIST_API int plist_frozen_get_uint(plist_frozen_t frozen, uint64_t obj, uint64_t *val)
+{
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    if (!fn || !val || (fn->type != PLIST_UINT && fn->type != PLIST_UID)) {
+        return -1;
+    }
+    *val = fn->intval;
+    return 0;
+}
+
+PLIST_API int plist_frozen_get_real(plist_frozen_t frozen, uint64_t obj, double *val)
+{
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    if (!fn || !val || (fn->type != PLIST_REAL && fn->type != PLIST_DATE)) {
+        return -1;
+    }
+    *val = fn->realval;
+    return 0;
+}
+
+PLIST_API int plist_frozen_get_string(plist_frozen_t frozen, uint64_t obj, const char **val, uint64_t *length)
+{
+    struct plist_frozen_s *f = (struct plist_frozen_s*)frozen;
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    if (!fn || !val || (fn->type != PLIST_STRING && fn->type != PLIST_KEY)) {
+        return -1;
+    }
+    *val = f->pool + fn->offset;
+    if (length) {
+        *length = fn->size;
+    }
+    return 0;
+}
+
+PLIST_API int plist_frozen_get_data(plist_frozen_t frozen, uint64_t obj, const char **val, uint64_t *length)
+{
+    struct plist_frozen_s *f = (struct plist_frozen_s*)frozen;
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    if (!fn || !val || fn->type != PLIST_DATA) {
+        return -1;
+    }
+    *val = f->pool + fn->offset;
+    if (length) {
+        *length = fn->size;
+    }
+    return 0;
+}
+
+static plist_t frozen_new_node(struct plist_frozen_s *frozen, uint64_t obj)
+{
+    struct frozen_node_s *fn = &frozen->nodes[obj];
+    plist_data_t data = plist_new_plist_data();
+
+    data->type = (plist_type)fn->type;
+    data->length = fn->size;
+    switch (fn->type) {
+    case PLIST_KEY:
+    case PLIST_STRING:
+        plist_data_alloc_string(data, NULL, fn->size);
+        memcpy(data->strval, frozen->pool + fn->offset, fn->size + 1);
+        break;
+    case PLIST_DATA:
+        plist_data_alloc_buffer(data, NULL, fn->size);
+        memcpy(data->buff, frozen->pool + fn->offset, fn->size);
+        break;
+    case PLIST_ARRAY:
+    case PLIST_DICT:
+        data->length = 0;
+        break;
+    case PLIST_BOOLEAN:
+        data->boolval = (char)fn->intval;
+        break;
+    case PLIST_REAL:
+    case PLIST_DATE:
+        data->realval = fn->realval;
+        break;
+    default:
+        data->intval = fn->intval;
+        break;
+    }
+    return plist_new_node(data);
+}
+
+/* number of child nodes of a container, keys included */
+static uint64_t frozen_children(struct frozen_node_s *fn)
+{
+    if (fn->type == PLIST_ARRAY) {
+        return fn->size;
+    } else if (fn->type == PLIST_DICT) {
+        return 2 * (uint64_t)fn->size;
+    }
+    return 0;
+}
+
+static void frozen_thaw_finish(plist_t node)
+{
+    if (plist_get_node_type(node) == PLIST_DICT) {
+        plist_dict_build_index(node);
+    } else if (plist_get_node_type(node) == PLIST_ARRAY) {
+        plist_array_build_index(node);
+    }
+}
+
+PLIST_API plist_t plist_frozen_get_node(plist_frozen_t frozen, uint64_t obj)
+{
+    struct plist_frozen_s *f = (struct plist_frozen_s*)frozen;
+    struct frozen_node_s *fn = frozen_get(frozen, obj);
+    ptrarray_t *stack = NULL;
+    node_t *root = NULL;
+    node_t *parent = NULL;
+    node_t *node = NULL;
+    uint64_t i = 0;
+
+    if (!fn) {
+        return NULL;
+    }
+    root = (node_t*)frozen_new_node(f, obj);
+    if (frozen_children(fn) == 0) {
+        return (plist_t)root;
+    }
+    stack = ptr_array_new(16);
+    if (!stack) {
+        plist_free(root);
+        return NULL;
+    }
+
+    /* the subtree of obj follows it in depth first order, stack holds
+     * the indexes of the containers being filled */
+    frozen_push(stack, obj);
+    parent = root;
+    i = obj + 1;
+    while (stack->len > 0) {
+        fn = &f->nodes[frozen_top(stack)];
+        if (node_n_children(parent) == frozen_children(fn)) {
+            frozen_thaw_finish((plist_t)parent);
+            frozen_pop(stack);
+            parent = parent->parent;
+            continue;
+        }
+        node = (node_t*)frozen_new_node(f, i);
+        node_attach(parent, node);
+        if (frozen_children(&f->nodes[i]) > 0) {
+            frozen_push(stack, i);
+            parent = node;
+        }
+        i++;
+    }
+    ptr_array_free(stack);
+    return (plist_t)root;
+}
@@ -1,6 +1,6 @@
 /*
  * hashtable.c
- * really simple hash table implementation
+ * open addressing hash table implementation
  *
  * Copyright (c) 2011-2016 Nikias Bassen, All Rights Reserved.
  *
@@ -19,14 +19,53 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 #include "hashtable.h"
+#include "alloc.h"
+#include "stats.h"
 
-hashtable_t* hash_table_new(hash_func_t hash_func, compare_func_t compare_func, free_func_t free_func)
+#include <string.h>
+
+/*
+ * Open addressing with linear probing and Robin Hood displacement: an entry
+ * that is further away from its home slot takes the slot of one that is
+ * closer to home. This keeps probe sequences short, and a lookup can stop
+ * as soon as it meets an entry that is closer to home than the probed key
+ * would be. Slots with key == NULL are empty. The full hash is stored per
+ * entry so compare_func is only called on real candidates.
+ */
+
+#define HASH_TABLE_MIN_CAPACITY 8
+
+/* we can't rely on the low bits of the caller's hash function */
+static unsigned int hash_mix(unsigned int h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+#define HASH_HOME(ht, h) ((h) & ((ht)->capacity - 1))
+#define HASH_DIST(ht, h, idx) (((idx) - HASH_HOME(ht, h)) & ((ht)->capacity - 1))
+
+hashtable_t* hash_table_new_sized(hash_func_t hash_func, compare_func_t compare_func, free_func_t free_func, size_t expected_count)
 {
-	hashtable_t* ht = (hashtable_t*)malloc(sizeof(hashtable_t));
-	int i;
-	for (i = 0; i < 4096; i++) {
-		ht->entries[i] = NULL;
+	size_t capacity = HASH_TABLE_MIN_CAPACITY;
+	/* keep the load factor below 3/4 without growing */
+	while (capacity - (capacity >> 2) <= expected_count) {
+		capacity <<= 1;
 	}
+	hashtable_t* ht = (hashtable_t*)plist_malloc(sizeof(hashtable_t));
+	if (!ht) {
+		return NULL;
+	}
+	ht->entries = (hashentry_t*)plist_calloc(capacity, sizeof(hashentry_t));
+	if (!ht->entries) {
+		plist_mem_free(ht);
+		return NULL;
+	}
+	ht->capacity = capacity;
 	ht->count = 0;
 	ht->hash_func = hash_func;
 	ht->compare_func = compare_func;
@@ -34,107 +73,241 @@ hashtable_t* hash_table_new(hash_func_t hash_func, compare_func_t compare_func,
 	return ht;
 }
 
+hashtable_t* hash_table_new(hash_func_t hash_func, compare_func_t compare_func, free_func_t free_func)
+{
+	return hash_table_new_sized(hash_func, compare_func, free_func, 0);
+}
+
 void hash_table_destroy(hashtable_t *ht)
 {
 	if (!ht) return;
 
-	int i = 0;
-	for (i = 0; i < 4096; i++) {
-		if (ht->entries[i]) {
-			hashentry_t* e = ht->entries[i];
-			while (e) {
-				if (ht->free_func) {
-					ht->free_func(e->value);
-				}
-				hashentry_t* old = e;
-				e = e->next;
-				free(old);
+	if (ht->free_func) {
+		size_t i;
+		for (i = 0; i < ht->capacity; i++) {
+			if (ht->entries[i].key) {
+				ht->free_func(ht->entries[i].value);
 			}
 		}
 	}
-	free(ht);
+	plist_mem_free(ht->entries);
+	plist_mem_free(ht);
+}
+
+/* removes all entries so the table can be reused. The table keeps the size
+ * it needs for as many entries as it held, so a table that once grew large
+ * doesn't have to be scanned in full after every later use. */
+void hash_table_clear(hashtable_t *ht)
+{
+	size_t capacity = HASH_TABLE_MIN_CAPACITY;
+	size_t i;
+
+	if (!ht) return;
+
+	if (ht->free_func) {
+		for (i = 0; i < ht->capacity; i++) {
+			if (ht->entries[i].key) {
+				ht->free_func(ht->entries[i].value);
+			}
+		}
+	}
+	while (capacity - (capacity >> 2) <= ht->count) {
+		capacity <<= 1;
+	}
+	if (capacity < ht->capacity) {
+		hashentry_t *entries = (hashentry_t*)plist_calloc(capacity, sizeof(hashentry_t));
+		if (entries) {
+			plist_mem_free(ht->entries);
+			ht->entries = entries;
+			ht->capacity = capacity;
+			ht->count = 0;
+			return;
+		}
+	}
+	memset(ht->entries, 0, ht->capacity * sizeof(hashentry_t));
+	ht->count = 0;
+}
+
+/* place an entry that is known not to be in the table yet */
+static void hash_table_place(hashtable_t* ht, hashentry_t entry, size_t idx, size_t dist)
+{
+	while (1) {
+		hashentry_t* e = &ht->entries[idx];
+		if (!e->key) {
+			*e = entry;
+			return;
+		}
+		size_t edist = HASH_DIST(ht, e->hash, idx);
+		if (edist < dist) {
+			hashentry_t tmp = *e;
+			*e = entry;
+			entry = tmp;
+			dist = edist;
+		}
+		idx = (idx + 1) & (ht->capacity - 1);
+		dist++;
+	}
+}
+
+static int hash_table_grow(hashtable_t* ht)
+{
+	hashentry_t* old_entries = ht->entries;
+	size_t old_capacity = ht->capacity;
+	size_t i;
+
+	ht->entries = (hashentry_t*)plist_calloc(old_capacity << 1, sizeof(hashentry_t));
+	if (!ht->entries) {
+		ht->entries = old_entries;
+		return -1;
+	}
+	ht->capacity = old_capacity << 1;
+	for (i = 0; i < old_capacity; i++) {
+		if (old_entries[i].key) {
+			hash_table_place(ht, old_entries[i], HASH_HOME(ht, old_entries[i].hash), 0);
+		}
+	}
+	plist_mem_free(old_entries);
+	return 0;
 }
 
 void hash_table_insert(hashtable_t* ht, void *key, void *value)
 {
 	if (!ht || !key) return;
 
-	unsigned int hash = ht->hash_func(key);
+	unsigned int hash = hash_mix(ht->hash_func(key));
+	size_t idx = HASH_HOME(ht, hash);
+	size_t dist = 0;
 
-	int idx0 = hash & 0xFFF;
-
-	// get the idx0 list
-	hashentry_t* e = ht->entries[idx0];
-	while (e) {
-		if (ht->compare_func(e->key, key)) {
+	// look for an existing entry first
+	while (1) {
+		hashentry_t* e = &ht->entries[idx];
+		if (!e->key || HASH_DIST(ht, e->hash, idx) < dist) {
+			break;
+		}
+		if (e->hash == hash && ht->compare_func(e->key, key)) {
 			// element already present. replace value.
 			e->value = value;
 			return;
 		}
-		e = e->next;
+		idx = (idx + 1) & (ht->capacity - 1);
+		dist++;
 	}
 
-	// if we get here, the element is not yet in the list.
-
-	// make a new entry.
-	hashentry_t* entry = (hashentry_t*)malloc(sizeof(hashentry_t));
-	entry->key = key;
-	entry->value = value;
-	if (!ht->entries[idx0]) {
-		// first entry
-		entry->next = NULL;
-	} else {
-		// add to list
-		entry->next = ht->entries[idx0];
+	// if we get here, the element is not yet in the table.
+	if (ht->count + 1 > ht->capacity - (ht->capacity >> 2)) {
+		if (hash_table_grow(ht) < 0) {
+			return;
+		}
+		idx = HASH_HOME(ht, hash);
+		dist = 0;
 	}
-	ht->entries[idx0] = entry;
+
+	hashentry_t entry;
+	entry.key = key;
+	entry.value = value;
+	entry.hash = hash;
+	hash_table_place(ht, entry, idx, dist);
 	ht->count++;
 }
 
-void* hash_table_lookup(hashtable_t* ht, void *key)
+/* inserts key unless an equal key is present, hashing it only once.
+ * Returns the value of the present entry, or NULL if key was inserted. */
+void* hash_table_insert_unique(hashtable_t* ht, void *key, void *value)
 {
 	if (!ht || !key) return NULL;
-	unsigned int hash = ht->hash_func(key);
 
-	int idx0 = hash & 0xFFF;
+	unsigned int hash = hash_mix(ht->hash_func(key));
+	size_t idx = HASH_HOME(ht, hash);
+	size_t dist = 0;
 
-	hashentry_t* e = ht->entries[idx0];
-	while (e) {
-		if (ht->compare_func(e->key, key)) {
+	while (1) {
+		hashentry_t* e = &ht->entries[idx];
+		if (!e->key || HASH_DIST(ht, e->hash, idx) < dist) {
+			break;
+		}
+		if (e->hash == hash && ht->compare_func(e->key, key)) {
 			return e->value;
 		}
-		e = e->next;
+		idx = (idx + 1) & (ht->capacity - 1);
+		dist++;
 	}
+
+	if (ht->count + 1 > ht->capacity - (ht->capacity >> 2)) {
+		if (hash_table_grow(ht) < 0) {
+			return NULL;
+		}
+		idx = HASH_HOME(ht, hash);
+		dist = 0;
+	}
+
+	hashentry_t entry;
+	entry.key = key;
+	entry.value = value;
+	entry.hash = hash;
+	hash_table_place(ht, entry, idx, dist);
+	ht->count++;
 	return NULL;
 }
 
+/* counts a lookup that visited dist + 1 slots */
+#define HASH_STAT_LOOKUP(dist) do { \
+	PLIST_STAT_ADD(hash_lookups, 1); \
+	PLIST_STAT_ADD(hash_probes, (dist) + 1); \
+	PLIST_STAT_MAX(hash_max_probes, (dist) + 1); \
+} while (0)
+
+static hashentry_t* hash_table_find(hashtable_t* ht, void *key)
+{
+	unsigned int hash = hash_mix(ht->hash_func(key));
+	size_t idx = HASH_HOME(ht, hash);
+	size_t dist = 0;
+
+	while (1) {
+		hashentry_t* e = &ht->entries[idx];
+		if (!e->key || HASH_DIST(ht, e->hash, idx) < dist) {
+			HASH_STAT_LOOKUP(dist);
+			return NULL;
+		}
+		if (e->hash == hash && ht->compare_func(e->key, key)) {
+			HASH_STAT_LOOKUP(dist);
+			return e;
+		}
+		idx = (idx + 1) & (ht->capacity - 1);
+		dist++;
+	}
+}
+
+void* hash_table_lookup(hashtable_t* ht, void *key)
+{
+	if (!ht || !key) return NULL;
+
+	hashentry_t* e = hash_table_find(ht, key);
+	return (e) ? e->value : NULL;
+}
+
 void hash_table_remove(hashtable_t* ht, void *key)
 {
 	if (!ht || !key) return;
 
-	unsigned int hash = ht->hash_func(key);
-
-	int idx0 = hash & 0xFFF;
-
-	// get the idx0 list
-	hashentry_t* e = ht->entries[idx0];
-	hashentry_t* last = e;
-	while (e) {
-		if (ht->compare_func(e->key, key)) {
-			// found element, remove it from the list
-			hashentry_t* old = e;
-			if (e == ht->entries[idx0]) {
-				ht->entries[idx0] = e->next;
-			} else {
-				last->next = e->next;
-			}
-			if (ht->free_func) {
-				ht->free_func(old->value);
-			}
-			free(old);
-			return;
+	hashentry_t* e = hash_table_find(ht, key);
+	if (!e) {
+		return;
+	}
+	if (ht->free_func) {
+		ht->free_func(e->value);
+	}
+	ht->count--;
+
+	// shift following displaced entries back by one slot
+	size_t idx = e - ht->entries;
+	while (1) {
+		size_t next = (idx + 1) & (ht->capacity - 1);
+		hashentry_t* n = &ht->entries[next];
+		if (!n->key || HASH_DIST(ht, n->hash, next) == 0) {
+			break;
 		}
-		last = e;
-		e = e->next;
+		ht->entries[idx] = *n;
+		idx = next;
 	}
+	memset(&ht->entries[idx], '\0', sizeof(hashentry_t));
 }
@@ -25,7 +25,7 @@
 typedef struct hashentry_t {
 	void *key;
 	void *value;
-	void *next;
+	unsigned int hash;
 } hashentry_t;
 
 typedef unsigned int(*hash_func_t)(const void* key);
@@ -33,7 +33,8 @@ typedef int (*compare_func_t)(const void *a, const void *b);
 typedef void (*free_func_t)(void *ptr);
 
 typedef struct hashtable_t {
-	hashentry_t *entries[4096];
+	hashentry_t *entries;
+	size_t capacity;
 	size_t count;
 	hash_func_t hash_func;
 	compare_func_t compare_func;
@@ -41,9 +42,12 @@ typedef struct hashtable_t {
 } hashtable_t;
 
 hashtable_t* hash_table_new(hash_func_t hash_func, compare_func_t compare_func, free_func_t free_func);
+hashtable_t* hash_table_new_sized(hash_func_t hash_func, compare_func_t compare_func, free_func_t free_func, size_t expected_count);
 void hash_table_destroy(hashtable_t *ht);
+void hash_table_clear(hashtable_t *ht);
 
 void hash_table_insert(hashtable_t* ht, void *key, void *value);
+void* hash_table_insert_unique(hashtable_t* ht, void *key, void *value);
 void* hash_table_lookup(hashtable_t* ht, void *key);
 void hash_table_remove(hashtable_t* ht, void *key);
 
@@ -0,0 +1,911 @@
+/*
+ * jplist.c
+ * JSON plist implementation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <node.h>
+
+#include "plist.h"
+#include "base64.h"
+#include "numparse.h"
+#include "strbuf.h"
+#include "alloc.h"
+
+#ifdef DEBUG
+static int plist_json_debug = 0;
+#define PLIST_JSON_ERR(...) if (plist_json_debug) { fprintf(stderr, "libplist[jsonparser] ERROR: " __VA_ARGS__); }
+#else
+#define PLIST_JSON_ERR(...)
+#endif
+
+void plist_json_init(void)
+{
+    /* init JSON stuff */
+#ifdef DEBUG
+    char *env_debug = getenv("PLIST_JSON_DEBUG");
+    if (env_debug && !strcmp(env_debug, "1")) {
+        plist_json_debug = 1;
+    }
+#endif
+}
+
+void plist_json_deinit(void)
+{
+    /* deinit JSON stuff */
+}
+
+/* returns the offset of the first '"', '\' or control character in str, or
+ * len. These are the characters that end the plain part of a JSON string. */
+static size_t find_json_special(const char *str, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    while (len - i >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        /* v <= 0x1F as unsigned bytes */
+        __m128i m = _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl);
+        m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+#endif
+    for (; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\' || c < 0x20) {
+            break;
+        }
+    }
+    return i;
+}
+
+static void json_write_string(bytearray_t *outbuf, const char *str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t start = 0;
+
+    str_buf_append(outbuf, "\"", 1);
+    while (start < len) {
+        size_t cur = start + find_json_special(str + start, len - start);
+        char esc[6];
+        str_buf_append(outbuf, str + start, cur - start);
+        if (cur >= len) {
+            break;
+        }
+        esc[0] = '\\';
+        switch (str[cur]) {
+        case '"':
+        case '\\':
+            esc[1] = str[cur];
+            str_buf_append(outbuf, esc, 2);
+            break;
+        case '\n':
+            str_buf_append(outbuf, "\\n", 2);
+            break;
+        case '\r':
+            str_buf_append(outbuf, "\\r", 2);
+            break;
+        case '\t':
+            str_buf_append(outbuf, "\\t", 2);
+            break;
+        case '\b':
+            str_buf_append(outbuf, "\\b", 2);
+            break;
+        case '\f':
+            str_buf_append(outbuf, "\\f", 2);
+            break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[(unsigned char)str[cur] >> 4];
+            esc[5] = hex[str[cur] & 0xF];
+            str_buf_append(outbuf, esc, 6);
+            break;
+        }
+        start = cur + 1;
+    }
+    str_buf_append(outbuf, "\"", 1);
+}
+
+static void json_write_data(bytearray_t *outbuf, const uint8_t *buff, uint64_t length)
+{
+    char buf[4096];
+    /* a multiple of 3 bytes, so the chunks concatenate */
+    size_t chunk = ((sizeof(buf) - 1) / 4) * 3;
+    uint64_t j = 0;
+
+    str_buf_append(outbuf, "\"", 1);
+    while (j < length) {
+        size_t count = (length - j < chunk) ? (size_t)(length - j) : chunk;
+        str_buf_append(outbuf, buf, base64encode(buf, buff + j, count));
+        j += count;
+    }
+    str_buf_append(outbuf, "\"", 1);
+}
+
+static const char json_spaces[] = "                                                                ";
+
+/* starts a new line indented by depth levels when prettifying */
+static void json_newline(bytearray_t *outbuf, int prettify, uint32_t depth)
+{
+    size_t n = (size_t)depth * 2;
+    if (!prettify) {
+        return;
+    }
+    str_buf_append(outbuf, "\n", 1);
+    while (n > 0) {
+        size_t count = (n < sizeof(json_spaces) - 1) ? n : sizeof(json_spaces) - 1;
+        str_buf_append(outbuf, json_spaces, count);
+        n -= count;
+    }
+}
+
+/* writes a scalar node, or the opening bracket of a non-empty structured
+ * node in which case 1 is returned and node_to_json_end has to be called
+ * after the children have been written. Returns -1 for values JSON can't
+ * represent. */
+static int node_to_json_begin(node_t *node, bytearray_t *outbuf, int prettify, uint32_t depth)
+{
+    plist_data_t node_data = plist_get_data(node);
+    char buf[64];
+    size_t len = 0;
+
+    plist_load_children(node);
+    switch (node_data->type) {
+    case PLIST_BOOLEAN:
+        if (node_data->boolval) {
+            str_buf_append(outbuf, "true", 4);
+        } else {
+            str_buf_append(outbuf, "false", 5);
+        }
+        break;
+    case PLIST_UINT:
+        if (node_data->length == 16) {
+            len = u64tostr(buf, node_data->intval);
+        } else {
+            len = i64tostr(buf, (int64_t)node_data->intval);
+        }
+        str_buf_append(outbuf, buf, len);
+        break;
+    case PLIST_REAL:
+        len = format_double(buf, node_data->realval);
+        if (len == 0) {
+            PLIST_JSON_ERR("Can't represent real value %f in JSON\n", node_data->realval);
+            return -1;
+        }
+        str_buf_append(outbuf, buf, len);
+        break;
+    case PLIST_STRING:
+    case PLIST_KEY:
+        json_write_string(outbuf, node_data->strval, node_data->length);
+        break;
+    case PLIST_DATA:
+        json_write_data(outbuf, node_data->buff, node_data->length);
+        break;
+    case PLIST_DATE:
+        len = plist_format_date(buf, node_data->realval);
+        if (len == 0) {
+            PLIST_JSON_ERR("Can't represent date value %f\n", node_data->realval);
+            return -1;
+        }
+        str_buf_append(outbuf, "\"", 1);
+        str_buf_append(outbuf, buf, len);
+        str_buf_append(outbuf, "\"", 1);
+        break;
+    case PLIST_UID:
+        /* written like in XML plists */
+        str_buf_append(outbuf, "{", 1);
+        json_newline(outbuf, prettify, depth + 1);
+        str_buf_append(outbuf, "\"CF$UID\":", 9);
+        if (prettify) {
+            str_buf_append(outbuf, " ", 1);
+        }
+        if (node_data->length == 16) {
+            len = u64tostr(buf, node_data->intval);
+        } else {
+            len = i64tostr(buf, (int64_t)node_data->intval);
+        }
+        str_buf_append(outbuf, buf, len);
+        json_newline(outbuf, prettify, depth);
+        str_buf_append(outbuf, "}", 1);
+        break;
+    case PLIST_ARRAY:
+        if (!node_first_child(node)) {
+            str_buf_append(outbuf, "[]", 2);
+            break;
+        }
+        str_buf_append(outbuf, "[", 1);
+        return 1;
+    case PLIST_DICT:
+        if (!node_first_child(node)) {
+            str_buf_append(outbuf, "{}", 2);
+            break;
+        }
+        str_buf_append(outbuf, "{", 1);
+        return 1;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+/* writes the closing bracket of a structured node */
+static void node_to_json_end(node_t *node, bytearray_t *outbuf, int prettify, uint32_t depth)
+{
+    json_newline(outbuf, prettify, depth);
+    if (plist_get_data(node)->type == PLIST_DICT) {
+        str_buf_append(outbuf, "}", 1);
+    } else {
+        str_buf_append(outbuf, "]", 1);
+    }
+}
+
+/* walks the tree without recursion like node_to_xml(), returns 0 on
+ * success or -1 if a value can't be written */
+static int node_to_json(node_t *root, bytearray_t *outbuf, int prettify)
+{
+    node_t *node = root;
+    uint32_t depth = 0;
+    int res = 0;
+
+    while (node) {
+        node_t *parent = (node == root) ? NULL : node->parent;
+        if (parent) {
+            if (node != node_first_child(parent)) {
+                str_buf_append(outbuf, ",", 1);
+            }
+            json_newline(outbuf, prettify, depth);
+            if (plist_get_data(parent)->type == PLIST_DICT) {
+                /* node is the key, its sibling the value */
+                plist_data_t key = plist_get_data(node);
+                json_write_string(outbuf, key->strval, key->length);
+                str_buf_append(outbuf, (prettify) ? ": " : ":", (prettify) ? 2 : 1);
+                node = node_next_sibling(node);
+                if (!node) {
+                    return -1;
+                }
+            }
+        }
+        res = node_to_json_begin(node, outbuf, prettify, depth);
+        if (res < 0) {
+            return -1;
+        }
+        if (res > 0) {
+            node = node_first_child(node);
+            depth++;
+            continue;
+        }
+        while (node != root && !node_next_sibling(node)) {
+            node = node->parent;
+            depth--;
+            node_to_json_end(node, outbuf, prettify, depth);
+        }
+        node = (node == root) ? NULL : node_next_sibling(node);
+    }
+    if (prettify) {
+        str_buf_append(outbuf, "\n", 1);
+    }
+    return 0;
+}
+
+PLIST_API int plist_to_json64(plist_t plist, char **plist_json, uint64_t *length, int prettify)
+{
+    strbuf_t *outbuf = NULL;
+
+    if (!plist || !plist_json || !length) {
+        return -1;
+    }
+    *plist_json = NULL;
+    *length = 0;
+
+    outbuf = str_buf_new();
+    if (!outbuf) {
+        return -1;
+    }
+    if (node_to_json((node_t*)plist, outbuf, prettify) < 0) {
+        str_buf_free(outbuf);
+        return -1;
+    }
+    str_buf_append(outbuf, "", 1);
+
+    *plist_json = outbuf->data;
+    *length = outbuf->len - 1;
+
+    outbuf->data = NULL;
+    str_buf_free(outbuf);
+    return 0;
+}
+
+PLIST_API int plist_to_json(plist_t plist, char **plist_json, uint32_t *length, int prettify)
+{
+    uint64_t len = 0;
+
+    if (!length) {
+        return -1;
+    }
+    *length = 0;
+    if (plist_to_json64(plist, plist_json, &len, prettify) < 0) {
+        return -1;
+    }
+    /* fail instead of returning a truncated length */
+    if (len > UINT32_MAX) {
+        plist_mem_free(*plist_json);
+        *plist_json = NULL;
+        return -1;
+    }
+    *length = (uint32_t)len;
+    return 0;
+}
+
+/* size of the output buffer used by plist_to_json_stream */
+#define JPLIST_STREAM_BUFSIZE 65536
+
+PLIST_API int plist_to_json_stream(plist_t plist, plist_write_func_t writer, void *user_data, int prettify)
+{
+    strbuf_t *outbuf = NULL;
+    int res = 0;
+
+    if (!plist || !writer) {
+        return -1;
+    }
+    outbuf = str_buf_new_stream(JPLIST_STREAM_BUFSIZE, writer, user_data);
+    if (!outbuf || !outbuf->data) {
+        str_buf_free(outbuf);
+        return -1;
+    }
+
+    res = node_to_json((node_t*)plist, outbuf, prettify);
+    str_buf_flush(outbuf);
+
+    if (outbuf->error) {
+        res = -1;
+    }
+    str_buf_free(outbuf);
+    return res;
+}
+
+struct json_parse_ctx {
+    const char *pos;
+    const char *end;
+    int err;
+    /* the current dict key, 0-terminated */
+    char *key;
+    size_t key_capacity;
+};
+typedef struct json_parse_ctx *json_parse_ctx_t;
+
+static void json_skip_ws(json_parse_ctx_t ctx)
+{
+    while (ctx->pos < ctx->end && (*ctx->pos == ' ' || *ctx->pos == '\n' || *ctx->pos == '\r' || *ctx->pos == '\t')) {
+        ctx->pos++;
+    }
+}
+
+static int json_hex4(const char *p, unsigned int *val)
+{
+    int i = 0;
+    *val = 0;
+    for (i = 0; i < 4; i++) {
+        char c = p[i];
+        *val <<= 4;
+        if (c >= '0' && c <= '9') {
+            *val |= c - '0';
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            *val |= (c | 0x20) - 'a' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* decodes the escaped JSON string content str into out, which has room for
+ * len bytes (escapes never decode to more bytes than they take). Lone
+ * surrogates become U+FFFD. Returns the decoded length or -1. */
+static int64_t json_unescape(const char *str, size_t len, char *out)
+{
+    size_t i = 0;
+    size_t o = 0;
+
+    while (i < len) {
+        size_t plain = find_json_special(str + i, len - i);
+        unsigned int cp = 0;
+        memmove(out + o, str + i, plain);
+        o += plain;
+        i += plain;
+        if (i >= len) {
+            break;
+        }
+        /* only backslashes are left in the content */
+        if (i + 1 >= len) {
+            return -1;
+        }
+        i++;
+        switch (str[i]) {
+        case '"':
+        case '\\':
+        case '/':
+            out[o++] = str[i];
+            i++;
+            continue;
+        case 'b':
+            out[o++] = '\b';
+            i++;
+            continue;
+        case 'f':
+            out[o++] = '\f';
+            i++;
+            continue;
+        case 'n':
+            out[o++] = '\n';
+            i++;
+            continue;
+        case 'r':
+            out[o++] = '\r';
+            i++;
+            continue;
+        case 't':
+            out[o++] = '\t';
+            i++;
+            continue;
+        case 'u':
+            break;
+        default:
+            PLIST_JSON_ERR("Invalid escape sequence \\%c\n", str[i]);
+            return -1;
+        }
+        if (len - i < 5 || json_hex4(str + i + 1, &cp) < 0) {
+            PLIST_JSON_ERR("Invalid \\u escape sequence\n");
+            return -1;
+        }
+        i += 5;
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            unsigned int low = 0;
+            if (len - i >= 6 && str[i] == '\\' && str[i+1] == 'u' && json_hex4(str + i + 2, &low) == 0 && low >= 0xDC00 && low <= 0xDFFF) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                i += 6;
+            } else {
+                cp = 0xFFFD;
+            }
+        } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            cp = 0xFFFD;
+        }
+        if (cp < 0x80) {
+            out[o++] = (char)cp;
+        } else if (cp < 0x800) {
+            out[o++] = (char)(0xC0 | (cp >> 6));
+            out[o++] = (char)(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out[o++] = (char)(0xE0 | (cp >> 12));
+            out[o++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            out[o++] = (char)(0x80 | (cp & 0x3F));
+        } else {
+            out[o++] = (char)(0xF0 | (cp >> 18));
+            out[o++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+            out[o++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+            out[o++] = (char)(0x80 | (cp & 0x3F));
+        }
+    }
+    return (int64_t)o;
+}
+
+/* finds the end of the string starting after the opening quote at
+ * ctx->pos. On success ctx->pos is moved past the closing quote and the
+ * raw content is returned in begin and len, with escaped set if it has to
+ * be unescaped. */
+static int json_scan_string(json_parse_ctx_t ctx, const char **begin, size_t *len, int *escaped)
+{
+    const char *p = ctx->pos;
+
+    *begin = p;
+    *escaped = 0;
+    while (p < ctx->end) {
+        p += find_json_special(p, ctx->end - p);
+        if (p >= ctx->end) {
+            break;
+        }
+        if (*p == '"') {
+            *len = p - *begin;
+            ctx->pos = p + 1;
+            return 0;
+        }
+        if (*p != '\\') {
+            PLIST_JSON_ERR("Unescaped control character in string\n");
+            return -1;
+        }
+        *escaped = 1;
+        p += 2;
+    }
+    PLIST_JSON_ERR("EOF while parsing string\n");
+    return -1;
+}
+
+/* parses a string into the 0-terminated ctx->key */
+static int json_parse_key(json_parse_ctx_t ctx)
+{
+    const char *begin = NULL;
+    size_t len = 0;
+    int escaped = 0;
+
+    if (json_scan_string(ctx, &begin, &len, &escaped) < 0) {
+        return -1;
+    }
+    if (len + 1 > ctx->key_capacity) {
+        size_t capacity = (ctx->key_capacity) ? ctx->key_capacity : 64;
+        char *key = NULL;
+        while (capacity < len + 1) {
+            capacity *= 2;
+        }
+        key = (char*)plist_realloc(ctx->key, capacity);
+        if (!key) {
+            return -1;
+        }
+        ctx->key = key;
+        ctx->key_capacity = capacity;
+    }
+    if (escaped) {
+        int64_t n = json_unescape(begin, len, ctx->key);
+        if (n < 0) {
+            return -1;
+        }
+        len = (size_t)n;
+    } else {
+        memcpy(ctx->key, begin, len);
+    }
+    ctx->key[len] = '\0';
+    return 0;
+}
+
+static int json_parse_string(json_parse_ctx_t ctx, plist_data_t data)
+{
+    const char *begin = NULL;
+    size_t len = 0;
+    int escaped = 0;
+    char *str = NULL;
+
+    if (json_scan_string(ctx, &begin, &len, &escaped) < 0) {
+        return -1;
+    }
+    data->type = PLIST_STRING;
+    str = plist_data_alloc_string(data, NULL, len);
+    if (!str) {
+        return -1;
+    }
+    if (escaped) {
+        int64_t n = json_unescape(begin, len, str);
+        if (n < 0) {
+            return -1;
+        }
+        len = (size_t)n;
+    } else {
+        memcpy(str, begin, len);
+    }
+    str[len] = '\0';
+    data->length = len;
+    return 0;
+}
+
+#define IS_DIGIT(c) ((unsigned char)((c) - '0') < 10)
+
+/* numbers without fraction and exponent become integers if they fit,
+ * everything else becomes a real */
+static int json_parse_number(json_parse_ctx_t ctx, plist_data_t data)
+{
+    const char *p = ctx->pos;
+    int negative = 0;
+    int is_real = 0;
+    size_t digits = 0;
+
+    if (p < ctx->end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    if (p < ctx->end && *p == '0') {
+        p++;
+    } else if (p < ctx->end && IS_DIGIT(*p)) {
+        while (p < ctx->end && IS_DIGIT(*p)) {
+            p++;
+        }
+    } else {
+        PLIST_JSON_ERR("Invalid number\n");
+        return -1;
+    }
+    digits = p - ctx->pos - negative;
+    if (p < ctx->end && *p == '.') {
+        p++;
+        if (p >= ctx->end || !IS_DIGIT(*p)) {
+            PLIST_JSON_ERR("Missing digits after decimal point\n");
+            return -1;
+        }
+        while (p < ctx->end && IS_DIGIT(*p)) {
+            p++;
+        }
+        is_real = 1;
+    }
+    if (p < ctx->end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < ctx->end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p >= ctx->end || !IS_DIGIT(*p)) {
+            PLIST_JSON_ERR("Missing digits in exponent\n");
+            return -1;
+        }
+        while (p < ctx->end && IS_DIGIT(*p)) {
+            p++;
+        }
+        is_real = 1;
+    }
+
+    /* integers are limited to -2^63 .. 2^64-1 */
+    if (!is_real) {
+        const char *d = ctx->pos + negative;
+        if (negative) {
+            is_real = (digits > 19 || (digits == 19 && memcmp(d, "9223372036854775808", 19) > 0));
+        } else {
+            is_real = (digits > 20 || (digits == 20 && memcmp(d, "18446744073709551615", 20) > 0));
+        }
+    }
+    if (is_real) {
+        parse_double(ctx->pos, p - ctx->pos, &data->realval);
+        data->type = PLIST_REAL;
+        data->length = 8;
+    } else {
+        uint64_t v = 0;
+        int is_negative = 0;
+        parse_uint64(ctx->pos, p - ctx->pos, &v, &is_negative);
+        data->type = PLIST_UINT;
+        if (is_negative) {
+            data->intval = (uint64_t)0 - v;
+            data->length = 8;
+        } else {
+            data->intval = v;
+            data->length = (v > INT64_MAX) ? 16 : 8;
+        }
+    }
+    ctx->pos = p;
+    return 0;
+}
+
+static int json_match(json_parse_ctx_t ctx, const char *word, size_t len)
+{
+    if ((size_t)(ctx->end - ctx->pos) < len || memcmp(ctx->pos, word, len) != 0) {
+        return 0;
+    }
+    ctx->pos += len;
+    return 1;
+}
+
+/* parses the value at ctx->pos into data. Arrays and dicts are only
+ * started, their contents are parsed by node_from_json(). */
+static int json_parse_value(json_parse_ctx_t ctx, plist_data_t data)
+{
+    if (ctx->pos >= ctx->end) {
+        PLIST_JSON_ERR("EOF while expecting a value\n");
+        return -1;
+    }
+    switch (*ctx->pos) {
+    case '{':
+        ctx->pos++;
+        data->type = PLIST_DICT;
+        return 0;
+    case '[':
+        ctx->pos++;
+        data->type = PLIST_ARRAY;
+        return 0;
+    case '"':
+        ctx->pos++;
+        return json_parse_string(ctx, data);
+    case 't':
+        if (json_match(ctx, "true", 4)) {
+            data->type = PLIST_BOOLEAN;
+            data->boolval = 1;
+            data->length = 1;
+            return 0;
+        }
+        break;
+    case 'f':
+        if (json_match(ctx, "false", 5)) {
+            data->type = PLIST_BOOLEAN;
+            data->boolval = 0;
+            data->length = 1;
+            return 0;
+        }
+        break;
+    case 'n':
+        if (json_match(ctx, "null", 4)) {
+            PLIST_JSON_ERR("null values are not supported\n");
+            return -1;
+        }
+        break;
+    default:
+        if (*ctx->pos == '-' || IS_DIGIT(*ctx->pos)) {
+            return json_parse_number(ctx, data);
+        }
+        break;
+    }
+    PLIST_JSON_ERR("Unexpected character '%c'\n", *ctx->pos);
+    return -1;
+}
+
+static void node_from_json(json_parse_ctx_t ctx, plist_t *plist)
+{
+    plist_t parent = NULL;
+    plist_t subnode = NULL;
+    int first = 0;
+
+    while (!ctx->err) {
+        plist_data_t data = NULL;
+
+        json_skip_ws(ctx);
+        if (parent) {
+            plist_type type = plist_get_node_type(parent);
+            if (first && ctx->pos < ctx->end && *ctx->pos == ((type == PLIST_DICT) ? '}' : ']')) {
+                /* empty container */
+                ctx->pos++;
+                parent = ((node_t*)parent)->parent;
+                goto after_value;
+            }
+            if (type == PLIST_DICT) {
+                if (ctx->pos >= ctx->end || *ctx->pos != '"') {
+                    PLIST_JSON_ERR("Expected a key\n");
+                    ctx->err++;
+                    break;
+                }
+                ctx->pos++;
+                if (json_parse_key(ctx) < 0) {
+                    ctx->err++;
+                    break;
+                }
+                json_skip_ws(ctx);
+                if (ctx->pos >= ctx->end || *ctx->pos != ':') {
+                    PLIST_JSON_ERR("Expected ':' after key\n");
+                    ctx->err++;
+                    break;
+                }
+                ctx->pos++;
+                json_skip_ws(ctx);
+            }
+        }
+
+        data = plist_new_plist_data();
+        subnode = plist_new_node(data);
+        if (!subnode || json_parse_value(ctx, data) < 0) {
+            ctx->err++;
+            break;
+        }
+        if (!parent) {
+            *plist = subnode;
+        } else if (plist_get_node_type(parent) == PLIST_DICT) {
+            plist_dict_set_item(parent, ctx->key, subnode);
+        } else {
+            plist_array_append_item(parent, subnode);
+        }
+        if (data->type == PLIST_DICT || data->type == PLIST_ARRAY) {
+            if (((node_t*)subnode)->depth >= plist_get_max_depth()) {
+                PLIST_JSON_ERR("maximum nesting depth (%u) exceeded\n", plist_get_max_depth());
+                subnode = NULL;
+                ctx->err++;
+                break;
+            }
+            parent = subnode;
+            subnode = NULL;
+            first = 1;
+            continue;
+        }
+        subnode = NULL;
+
+after_value:
+        /* a ',' continues the container, closing brackets end it */
+        while (parent) {
+            plist_type type = plist_get_node_type(parent);
+            json_skip_ws(ctx);
+            if (ctx->pos < ctx->end && *ctx->pos == ',') {
+                ctx->pos++;
+                first = 0;
+                break;
+            }
+            if (ctx->pos < ctx->end && *ctx->pos == ((type == PLIST_DICT) ? '}' : ']')) {
+                ctx->pos++;
+                parent = ((node_t*)parent)->parent;
+                continue;
+            }
+            PLIST_JSON_ERR("Expected ',' or '%c'\n", (type == PLIST_DICT) ? '}' : ']');
+            ctx->err++;
+            break;
+        }
+        if (!parent) {
+            break;
+        }
+    }
+
+    if (!ctx->err) {
+        json_skip_ws(ctx);
+        if (ctx->pos < ctx->end) {
+            PLIST_JSON_ERR("Unexpected data after the value\n");
+            ctx->err++;
+        }
+    }
+    plist_free(subnode);
+    if (ctx->err) {
+        plist_free(*plist);
+        *plist = NULL;
+    }
+}
+
+void plist_from_json_internal(const char *plist_json, uint64_t length, plist_t * plist)
+{
+    struct json_parse_ctx ctx;
+
+    if (!plist) {
+        return;
+    }
+    *plist = NULL;
+    if (!plist_json || length == 0) {
+        return;
+    }
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.pos = plist_json;
+    ctx.end = plist_json + length;
+    /* skip a UTF-8 byte order mark */
+    if (length >= 3 && memcmp(plist_json, "\xEF\xBB\xBF", 3) == 0) {
+        ctx.pos += 3;
+    }
+    node_from_json(&ctx, plist);
+    plist_mem_free(ctx.key);
+}
+
+PLIST_API void plist_from_json(const char *plist_json, uint32_t length, plist_t * plist)
+{
+    plist_from_json_internal(plist_json, length, plist);
+}
+
+PLIST_API void plist_from_json64(const char *plist_json, uint64_t length, plist_t * plist)
+{
+    plist_from_json_internal(plist_json, length, plist);
+}
+
+int plist_is_json(const char *plist_data, uint64_t length)
+{
+    uint64_t i = 0;
+    if (length >= 3 && memcmp(plist_data, "\xEF\xBB\xBF", 3) == 0) {
+        i = 3;
+    }
+    while (i < length && (plist_data[i] == ' ' || plist_data[i] == '\n' || plist_data[i] == '\r' || plist_data[i] == '\t')) {
+        i++;
+    }
+    return (i < length && (plist_data[i] == '{' || plist_data[i] == '['));
+}
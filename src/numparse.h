@@ -0,0 +1,53 @@
+/*
+ * numparse.h
+ * header file for locale independent number parsing and formatting
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef NUMPARSE_H
+#define NUMPARSE_H
+#include <stdlib.h>
+#include <stdint.h>
+
+/* Parses an unsigned integer from the first len bytes of str like
+ * strtoull(str, NULL, 0) after an optional sign: leading whitespace is
+ * skipped, "0x" selects hexadecimal and a leading "0" octal, and values
+ * that don't fit are clamped to UINT64_MAX. The magnitude is stored in
+ * value and is_negative is set if there was a '-'. str does not need to be
+ * 0-terminated. Returns the number of bytes used, or 0 if there are no
+ * digits. */
+size_t parse_uint64(const char *str, size_t len, uint64_t *value, int *is_negative);
+
+/* Parses a decimal floating point number from the first len bytes of str
+ * like strtod() in the "C" locale, including "inf", "infinity" and "nan".
+ * The result is correctly rounded. str does not need to be 0-terminated.
+ * Returns the number of bytes used, or 0 if there is no number (value is
+ * set to 0 then). */
+size_t parse_double(const char *str, size_t len, double *value);
+
+/* writes val in decimal to buf (at least 20 bytes), returns the length */
+size_t u64tostr(char *buf, uint64_t val);
+
+/* writes val in decimal to buf (at least 21 bytes), returns the length */
+size_t i64tostr(char *buf, int64_t val);
+
+/* Writes val to buf (at least 32 bytes) with 15, 16 or 17 significant
+ * digits, the fewest of these that parse back to the same value, without
+ * trailing zeros and always with a '.' or an exponent, independent of the
+ * current locale. The output is 0-terminated. Returns the length, or 0 if
+ * val is NaN or infinite. */
+size_t format_double(char *buf, double val);
+
+#endif
@@ -0,0 +1,320 @@
+/*
+ * path.c
+ * compiled path queries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "plist.h"
+#include "alloc.h"
+
+#include <node.h>
+
+enum path_segment_type {
+    PATH_KEY,	/* a dict key */
+    PATH_INDEX,	/* an array index, or a dict key made of digits */
+    PATH_ANY	/* every item of an array or dict */
+};
+
+struct path_segment_s {
+    enum path_segment_type type;
+    uint32_t index;
+    /* prepared like a key node, so lookups don't hash it again */
+    struct plist_data_s key;
+};
+
+struct plist_path_s {
+    uint32_t count;
+    struct path_segment_s *segments;
+    char *keys;
+};
+
+PLIST_API plist_path_t plist_path_compile(const char *path)
+{
+    struct plist_path_s *p = NULL;
+    const char *c = NULL;
+    char *out = NULL;
+    uint32_t count = 1;
+    uint32_t i = 0;
+
+    if (!path) {
+        return NULL;
+    }
+    if (*path == '\0') {
+        count = 0;
+    }
+    for (c = path; *c; c++) {
+        if (*c == '\\' && c[1]) {
+            c++;
+        } else if (*c == '/') {
+            count++;
+        }
+    }
+
+    p = (struct plist_path_s*)plist_calloc(1, sizeof(struct plist_path_s));
+    if (!p) {
+        return NULL;
+    }
+    p->count = count;
+    p->segments = (struct path_segment_s*)plist_calloc((count > 0) ? count : 1, sizeof(struct path_segment_s));
+    /* unescaped keys are never longer than the path */
+    p->keys = (char*)plist_malloc(strlen(path) + count + 1);
+    if (!p->segments || !p->keys) {
+        plist_path_free(p);
+        return NULL;
+    }
+
+    out = p->keys;
+    c = path;
+    for (i = 0; i < count; i++) {
+        struct path_segment_s *seg = &p->segments[i];
+        int escaped = 0;
+        int digits = 1;
+        uint64_t index = 0;
+
+        seg->key.type = PLIST_KEY;
+        seg->key.strval = out;
+        while (*c && *c != '/') {
+            if (*c == '\\' && c[1]) {
+                c++;
+                escaped = 1;
+            }
+            if (*c < '0' || *c > '9') {
+                digits = 0;
+            } else if (index <= UINT32_MAX) {
+                index = index * 10 + (*c - '0');
+            }
+            *out++ = *c++;
+        }
+        *out++ = '\0';
+        seg->key.length = (uint64_t)(out - seg->key.strval - 1);
+        plist_data_payload_hash(&seg->key);
+
+        if (!escaped && seg->key.length == 1 && seg->key.strval[0] == '*') {
+            seg->type = PATH_ANY;
+        } else if (!escaped && digits && seg->key.length > 0 && index <= UINT32_MAX) {
+            seg->type = PATH_INDEX;
+            seg->index = (uint32_t)index;
+        } else {
+            seg->type = PATH_KEY;
+        }
+        if (*c == '/') {
+            c++;
+        }
+    }
+    return p;
+}
+
+PLIST_API void plist_path_free(plist_path_t path)
+{
+    struct plist_path_s *p = (struct plist_path_s*)path;
+    if (!p) {
+        return;
+    }
+    plist_mem_free(p->segments);
+    plist_mem_free(p->keys);
+    plist_mem_free(p);
+}
+
+uint32_t plist_path_get_count(plist_path_t path)
+{
+    struct plist_path_s *p = (struct plist_path_s*)path;
+    return (p) ? p->count : 0;
+}
+
+int plist_path_get_segment(plist_path_t path, uint32_t n, const char **key, uint64_t *keylen, int64_t *index)
+{
+    struct plist_path_s *p = (struct plist_path_s*)path;
+    struct path_segment_s *s = NULL;
+
+    if (!p || n >= p->count) {
+        return -1;
+    }
+    s = &p->segments[n];
+    if (s->type == PATH_ANY) {
+        return -1;
+    }
+    *key = s->key.strval;
+    *keylen = s->key.length;
+    *index = (s->type == PATH_INDEX) ? (int64_t)s->index : -1;
+    return 0;
+}
+
+/* reports all matches of the segments from seg on below node, returns 1 if
+ * the callback asked to stop */
+static int path_eval(struct plist_path_s *p, uint32_t seg, plist_t node, plist_path_func_t func, void *user_data, int *matches)
+{
+    struct path_segment_s *s = NULL;
+    plist_type type = PLIST_NONE;
+
+    if (seg == p->count) {
+        (*matches)++;
+        return func(user_data, node);
+    }
+    s = &p->segments[seg];
+    type = plist_get_node_type(node);
+    if (type == PLIST_ARRAY) {
+        if (s->type == PATH_INDEX) {
+            plist_t item = plist_array_get_item(node, s->index);
+            return (item) ? path_eval(p, seg + 1, item, func, user_data, matches) : 0;
+        } else if (s->type == PATH_ANY) {
+            node_t *ch = NULL;
+            plist_load_children((node_t*)node);
+            for (ch = node_first_child((node_t*)node); ch; ch = node_next_sibling(ch)) {
+                if (path_eval(p, seg + 1, (plist_t)ch, func, user_data, matches)) {
+                    return 1;
+                }
+            }
+        }
+    } else if (type == PLIST_DICT) {
+        if (s->type == PATH_ANY) {
+            node_t *ch = NULL;
+            plist_load_children((node_t*)node);
+            for (ch = node_first_child((node_t*)node); ch; ch = node_next_sibling(ch)) {
+                /* ch is the key, its sibling the value */
+                ch = node_next_sibling(ch);
+                if (ch && path_eval(p, seg + 1, (plist_t)ch, func, user_data, matches)) {
+                    return 1;
+                }
+            }
+        } else {
+            plist_t item = plist_dict_lookup(node, &s->key);
+            return (item) ? path_eval(p, seg + 1, item, func, user_data, matches) : 0;
+        }
+    }
+    return 0;
+}
+
+static int path_first(void *user_data, plist_t node)
+{
+    *(plist_t*)user_data = node;
+    return 1;
+}
+
+PLIST_API plist_t plist_path_get(plist_path_t path, plist_t node)
+{
+    struct plist_path_s *p = (struct plist_path_s*)path;
+    plist_t current = node;
+    plist_t match = NULL;
+    uint32_t i = 0;
+    int matches = 0;
+
+    if (!p || !node) {
+        return NULL;
+    }
+    /* up to the first wildcard there is at most one candidate */
+    for (i = 0; i < p->count && current; i++) {
+        struct path_segment_s *s = &p->segments[i];
+        plist_type type = plist_get_node_type(current);
+        if (s->type == PATH_ANY) {
+            break;
+        } else if (type == PLIST_ARRAY && s->type == PATH_INDEX) {
+            current = plist_array_get_item(current, s->index);
+        } else if (type == PLIST_DICT) {
+            current = plist_dict_lookup(current, &s->key);
+        } else {
+            current = NULL;
+        }
+    }
+    if (!current || i == p->count) {
+        return current;
+    }
+    path_eval(p, i, current, path_first, &match, &matches);
+    return match;
+}
+
+PLIST_API int plist_path_foreach(plist_path_t path, plist_t node, plist_path_func_t func, void *user_data)
+{
+    struct plist_path_s *p = (struct plist_path_s*)path;
+    int matches = 0;
+
+    if (!p || !node || !func) {
+        return 0;
+    }
+    path_eval(p, 0, node, func, user_data, &matches);
+    return matches;
+}
+
+/* like path_eval, for an object of a binary plist */
+static int path_eval_bin(struct plist_path_s *p, uint32_t seg, plist_bin_reader_t reader, uint64_t obj, plist_path_bin_func_t func, void *user_data, int *matches)
+{
+    struct path_segment_s *s = NULL;
+    plist_type type = PLIST_NONE;
+    uint64_t child = 0;
+    uint64_t size = 0;
+    uint64_t n = 0;
+
+    if (seg == p->count) {
+        (*matches)++;
+        return func(user_data, reader, obj);
+    }
+    s = &p->segments[seg];
+    type = plist_bin_reader_get_type(reader, obj);
+    if (type != PLIST_ARRAY && type != PLIST_DICT) {
+        return 0;
+    }
+    if (s->type == PATH_ANY) {
+        size = plist_bin_reader_get_size(reader, obj);
+        for (n = 0; n < size; n++) {
+            if (plist_bin_reader_child(reader, obj, n, &child) == 0 && path_eval_bin(p, seg + 1, reader, child, func, user_data, matches)) {
+                return 1;
+            }
+        }
+    } else if (type == PLIST_ARRAY) {
+        if (s->type == PATH_INDEX && plist_bin_reader_child(reader, obj, s->index, &child) == 0) {
+            return path_eval_bin(p, seg + 1, reader, child, func, user_data, matches);
+        }
+    } else if (plist_bin_reader_dict_get(reader, obj, s->key.strval, &child) == 0) {
+        return path_eval_bin(p, seg + 1, reader, child, func, user_data, matches);
+    }
+    return 0;
+}
+
+static int path_first_bin(void *user_data, plist_bin_reader_t reader, uint64_t obj)
+{
+    *(uint64_t*)user_data = obj;
+    return 1;
+}
+
+PLIST_API int plist_path_get_bin(plist_path_t path, plist_bin_reader_t reader, uint64_t obj, uint64_t *match)
+{
+    struct plist_path_s *p = (struct plist_path_s*)path;
+    int matches = 0;
+
+    if (!p || !reader || !match) {
+        return -1;
+    }
+    path_eval_bin(p, 0, reader, obj, path_first_bin, match, &matches);
+    return (matches > 0) ? 0 : -1;
+}
+
+PLIST_API int plist_path_foreach_bin(plist_path_t path, plist_bin_reader_t reader, uint64_t obj, plist_path_bin_func_t func, void *user_data)
+{
+    struct plist_path_s *p = (struct plist_path_s*)path;
+    int matches = 0;
+
+    if (!p || !reader || !func) {
+        return 0;
+    }
+    path_eval_bin(p, 0, reader, obj, func, user_data, &matches);
+    return matches;
+}
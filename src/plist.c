@@ -35,25 +35,40 @@
 #include <pthread.h>
 #endif
 
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 #include <node.h>
-#include <node_iterator.h>
+#include <node_list.h>
 #include <hashtable.h>
 
+#include "arena.h"
+#include "ptrarray.h"
+#include "alloc.h"
+#include "stats.h"
+
 extern void plist_xml_init(void);
 extern void plist_xml_deinit(void);
 extern void plist_bin_init(void);
 extern void plist_bin_deinit(void);
+extern void plist_json_init(void);
+extern void plist_json_deinit(void);
 
 static void internal_plist_init(void)
 {
     plist_bin_init();
     plist_xml_init();
+    plist_json_init();
 }
 
 static void internal_plist_deinit(void)
 {
     plist_bin_deinit();
     plist_xml_deinit();
+    plist_json_deinit();
 }
 
 #ifdef WIN32
@@ -111,6 +126,30 @@ static void __attribute__((destructor)) libplist_deinitialize(void)
 #endif
 
 
+static uint32_t plist_max_depth = PLIST_MAX_DEPTH_DEFAULT;
+
+PLIST_API void plist_set_max_depth(uint32_t depth)
+{
+    plist_max_depth = (depth > 0) ? depth : PLIST_MAX_DEPTH_DEFAULT;
+}
+
+PLIST_API uint32_t plist_get_max_depth(void)
+{
+    return plist_max_depth;
+}
+
+static uint32_t plist_dict_index_threshold = PLIST_DICT_INDEX_THRESHOLD_DEFAULT;
+
+PLIST_API void plist_set_dict_index_threshold(uint32_t entries)
+{
+    plist_dict_index_threshold = entries;
+}
+
+PLIST_API uint32_t plist_get_dict_index_threshold(void)
+{
+    return plist_dict_index_threshold;
+}
+
 PLIST_API int plist_is_binary(const char *plist_data, uint32_t length)
 {
     if (length < 8) {
@@ -121,22 +160,463 @@ PLIST_API int plist_is_binary(const char *plist_data, uint32_t length)
 }
 
 
+PLIST_API void plist_from_memory64(const char *plist_data, uint64_t length, plist_t * plist)
+{
+    if (!plist) {
+        return;
+    }
+    *plist = NULL;
+    if (!plist_data || length < 8) {
+        return;
+    }
+
+    if (plist_is_binary(plist_data, 8)) {
+        plist_from_bin_internal(plist_data, length, plist, NULL, PLIST_PARSE_DEFAULT);
+    } else if (plist_is_compressed(plist_data, 8)) {
+        plist_from_compressed_internal(plist_data, length, NULL, plist);
+    } else if (plist_is_json(plist_data, length)) {
+        plist_from_json_internal(plist_data, length, plist);
+    } else {
+        plist_from_xml_internal(plist_data, length, plist, NULL);
+    }
+}
+
 PLIST_API void plist_from_memory(const char *plist_data, uint32_t length, plist_t * plist)
 {
-    if (length < 8) {
-        *plist = NULL;
+    plist_from_memory64(plist_data, length, plist);
+}
+
+struct plist_mapping_s {
+    char *data;
+    size_t size;
+    int is_mapped;
+};
+
+static struct plist_mapping_s *plist_mapping_open(const char *filename)
+{
+    struct plist_mapping_s *m = NULL;
+    struct stat st;
+
+    m = (struct plist_mapping_s*)plist_calloc(1, sizeof(struct plist_mapping_s));
+    if (!m) {
+        return NULL;
+    }
+#ifdef HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        plist_mem_free(m);
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        plist_mem_free(m);
+        return NULL;
+    }
+    m->size = (size_t)st.st_size;
+    if (m->size > 0) {
+        void *addr = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            m->data = (char*)addr;
+            m->is_mapped = 1;
+        }
+    }
+    close(fd);
+    if (m->is_mapped || m->size == 0) {
+        return m;
+    }
+#endif
+    /* no mmap available, or mapping failed: read the file into memory */
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+        plist_mem_free(m);
+        return NULL;
+    }
+    if (fstat(fileno(f), &st) < 0) {
+        fclose(f);
+        plist_mem_free(m);
+        return NULL;
+    }
+    m->size = (size_t)st.st_size;
+    m->data = (char*)plist_malloc(m->size + 1);
+    if (!m->data || fread(m->data, 1, m->size, f) != m->size) {
+        fclose(f);
+        plist_mem_free(m->data);
+        plist_mem_free(m);
+        return NULL;
+    }
+    fclose(f);
+    return m;
+}
+
+PLIST_API void plist_mapping_free(plist_mapping_t mapping)
+{
+    struct plist_mapping_s *m = (struct plist_mapping_s*)mapping;
+    if (!m) {
+        return;
+    }
+#ifdef HAVE_MMAP
+    if (m->is_mapped) {
+        munmap(m->data, m->size);
+        m->data = NULL;
+    }
+#endif
+    plist_mem_free(m->data);
+    plist_mem_free(m);
+}
+
+PLIST_API int plist_read_from_file_ex(const char *filename, uint32_t options, plist_t *plist, plist_format_t *format, plist_mapping_t *mapping)
+{
+    struct plist_mapping_s *m = NULL;
+
+    if (!filename || !plist) {
+        return -1;
+    }
+    *plist = NULL;
+    if (mapping) {
+        *mapping = NULL;
+    } else {
+        /* nothing would keep the input alive */
+        options &= ~(PLIST_PARSE_BORROW | PLIST_PARSE_LAZY);
+    }
+
+    m = plist_mapping_open(filename);
+    if (!m) {
+        return -1;
+    }
+
+    if (m->size >= 8 && plist_is_binary(m->data, 8)) {
+        plist_from_bin_internal(m->data, m->size, plist, NULL, options);
+        if (format) {
+            *format = PLIST_FORMAT_BINARY;
+        }
+    } else if (m->size >= 8 && plist_is_compressed(m->data, 8)) {
+        plist_from_compressed_internal(m->data, m->size, NULL, plist);
+        if (format) {
+            *format = PLIST_FORMAT_BINARY;
+        }
+    } else if (plist_is_json(m->data, m->size)) {
+        plist_from_json_internal(m->data, m->size, plist);
+        if (format) {
+            *format = PLIST_FORMAT_JSON;
+        }
+    } else if (m->size >= 8) {
+        plist_from_xml_internal(m->data, m->size, plist, NULL);
+        if (format) {
+            *format = PLIST_FORMAT_XML;
+        }
+    }
+
+    if (!*plist) {
+        plist_mapping_free(m);
+        return -2;
+    }
+
+    if (mapping) {
+        *mapping = m;
+    } else {
+        plist_mapping_free(m);
+    }
+    return 0;
+}
+
+PLIST_API int plist_read_from_file(const char *filename, plist_t *plist, plist_format_t *format)
+{
+    return plist_read_from_file_ex(filename, PLIST_PARSE_DEFAULT, plist, format, NULL);
+}
+
+struct plist_arena_s {
+    arena_t *mem;
+    ptrarray_t *tables;
+    /* item vectors of arrays */
+    ptrarray_t *arrays;
+    uint32_t options;
+    /* interned keys, created on first use */
+    hashtable_t *keys;
+};
+
+/* arena nodes keep node, child list and data in a single block */
+struct plist_arena_node_s {
+    struct plist_data_s data;
+    node_t node;
+    node_list_t children;
+    struct plist_arena_s *arena;
+};
+
+#define PLIST_ARENA_CHUNK_SIZE 65536
+
+PLIST_API plist_arena_t plist_arena_new_with_allocator(uint32_t options, plist_malloc_func_t malloc_fn, plist_free_func_t free_fn, void *ctx)
+{
+    struct plist_arena_s *arena = NULL;
+    if ((malloc_fn == NULL) != (free_fn == NULL)) {
+        return NULL;
+    }
+    arena = (struct plist_arena_s*)plist_malloc(sizeof(struct plist_arena_s));
+    if (!arena) {
+        return NULL;
+    }
+    arena->options = options;
+    arena->keys = NULL;
+    arena->mem = arena_new_with_allocator(PLIST_ARENA_CHUNK_SIZE, malloc_fn, free_fn, ctx);
+    arena->tables = ptr_array_new(8);
+    arena->arrays = ptr_array_new(8);
+    if (!arena->mem || !arena->tables || !arena->arrays) {
+        arena_free(arena->mem);
+        ptr_array_free(arena->tables);
+        ptr_array_free(arena->arrays);
+        plist_mem_free(arena);
+        return NULL;
+    }
+    return arena;
+}
+
+PLIST_API plist_arena_t plist_arena_new_ex(uint32_t options)
+{
+    return plist_arena_new_with_allocator(options, NULL, NULL, NULL);
+}
+
+PLIST_API plist_arena_t plist_arena_new(void)
+{
+    return plist_arena_new_ex(PLIST_ARENA_DEFAULT);
+}
+
+PLIST_API void plist_arena_free(plist_arena_t arena)
+{
+    struct plist_arena_s *a = (struct plist_arena_s*)arena;
+    size_t i;
+    if (!a) {
         return;
     }
+    /* dict hash tables and array item vectors are the only parts not
+     * allocated from the arena */
+    for (i = 0; i < a->tables->len; i++) {
+        hash_table_destroy((hashtable_t*)ptr_array_index(a->tables, i));
+    }
+    ptr_array_free(a->tables);
+    for (i = 0; i < a->arrays->len; i++) {
+        ptr_array_free((ptrarray_t*)ptr_array_index(a->arrays, i));
+    }
+    ptr_array_free(a->arrays);
+    hash_table_destroy(a->keys);
+    arena_free(a->mem);
+    plist_mem_free(a);
+}
+
+void *plist_arena_alloc(plist_arena_t arena, size_t size)
+{
+    PLIST_STAT_ADD(bytes_allocated, size);
+    if (!arena) {
+        return plist_malloc(size);
+    }
+    return arena_alloc(((struct plist_arena_s*)arena)->mem, size);
+}
+
+/* payloads of heap strings and data nodes are preceded by a reference
+ * count, so plist_copy() hands the same payload to the copy instead of
+ * duplicating it. The header keeps the payload aligned like plist_malloc(). */
+#define PLIST_SHARED_HEADER_SIZE 16
+
+#ifdef WIN32
+typedef LONG plist_refcount_t;
+#else
+typedef uint32_t plist_refcount_t;
+#endif
+
+static plist_refcount_t *plist_shared_refcount(void *payload)
+{
+    return (plist_refcount_t*)((char*)payload - PLIST_SHARED_HEADER_SIZE);
+}
+
+void *plist_shared_alloc(size_t size)
+{
+    char *block = (char*)plist_malloc(PLIST_SHARED_HEADER_SIZE + size);
+    if (!block) {
+        return NULL;
+    }
+    PLIST_STAT_ADD(bytes_allocated, size);
+    *(plist_refcount_t*)block = 1;
+    return block + PLIST_SHARED_HEADER_SIZE;
+}
+
+static void *plist_shared_retain(void *payload)
+{
+#ifdef WIN32
+    InterlockedIncrement(plist_shared_refcount(payload));
+#else
+    __atomic_add_fetch(plist_shared_refcount(payload), 1, __ATOMIC_RELAXED);
+#endif
+    return payload;
+}
+
+void plist_shared_release(void *payload)
+{
+    if (!payload) {
+        return;
+    }
+#ifdef WIN32
+    if (InterlockedDecrement(plist_shared_refcount(payload)) != 0) {
+        return;
+    }
+#else
+    if (__atomic_sub_fetch(plist_shared_refcount(payload), 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+#endif
+    plist_mem_free((char*)payload - PLIST_SHARED_HEADER_SIZE);
+}
+
+/* sets strval of data to a buffer for length bytes plus terminator, short
+ * strings are stored inline, heap strings are shared with copies */
+char *plist_data_alloc_string(plist_data_t data, plist_arena_t arena, uint64_t length)
+{
+    data->flags &= ~(PLIST_DATA_INLINE | PLIST_DATA_SHARED);
+    if (length < PLIST_DATA_INLINE_SIZE) {
+        data->flags |= PLIST_DATA_INLINE;
+        data->strval = data->inline_str;
+    } else if (!arena) {
+        data->strval = (char*)plist_shared_alloc(length + 1);
+        if (data->strval) {
+            data->flags |= PLIST_DATA_SHARED;
+        }
+    } else {
+        data->strval = (char*)plist_arena_alloc(arena, length + 1);
+    }
+    return data->strval;
+}
+
+/* sets buff of data to a buffer for length bytes, heap buffers are shared
+ * with copies */
+uint8_t *plist_data_alloc_buffer(plist_data_t data, plist_arena_t arena, uint64_t length)
+{
+    data->flags &= ~(PLIST_DATA_BORROWED | PLIST_DATA_SHARED);
+    if (!arena) {
+        data->buff = (uint8_t*)plist_shared_alloc(length);
+        if (data->buff) {
+            data->flags |= PLIST_DATA_SHARED;
+        }
+    } else {
+        data->buff = (uint8_t*)plist_arena_alloc(arena, length);
+    }
+    return data->buff;
+}
+
+plist_arena_t plist_data_get_arena(plist_data_t data)
+{
+    if (!data || !(data->flags & PLIST_DATA_ARENA)) {
+        return NULL;
+    }
+    return ((struct plist_arena_node_s*)data)->arena;
+}
+
+void plist_limits_init(struct plist_limits_s *state, const plist_parse_limits_t *limits, uint64_t length)
+{
+    memset(state, 0, sizeof(struct plist_limits_s));
+    state->max_nodes = limits->max_nodes ? limits->max_nodes : UINT64_MAX;
+    state->max_bytes = limits->max_bytes ? limits->max_bytes : UINT64_MAX;
+    if (limits->max_expansion && length <= UINT64_MAX / limits->max_expansion && length * limits->max_expansion < state->max_bytes) {
+        state->max_bytes = length * limits->max_expansion;
+    }
+    state->max_depth = limits->max_depth ? limits->max_depth : plist_get_max_depth();
+}
+
+int plist_limits_add(struct plist_limits_s *state, uint64_t nodes, uint64_t bytes)
+{
+    state->nodes += nodes;
+    state->bytes += bytes;
+    if (state->nodes > state->max_nodes || state->bytes > state->max_bytes || state->bytes < bytes) {
+        state->exceeded = 1;
+        return -1;
+    }
+    return 0;
+}
 
-    if (plist_is_binary(plist_data, length)) {
-        plist_from_bin(plist_data, length, plist);
+uint64_t plist_node_size(plist_type type, uint64_t length, uint32_t flags)
+{
+    uint64_t size = 0;
+    uint64_t header = (flags & PLIST_DATA_SHARED) ? PLIST_SHARED_HEADER_SIZE : 0;
+
+    if (flags & PLIST_DATA_ARENA) {
+        size = sizeof(struct plist_arena_node_s);
     } else {
-        plist_from_xml(plist_data, length, plist);
+        size = sizeof(node_t) + sizeof(struct plist_data_s);
     }
+    switch (type) {
+    case PLIST_KEY:
+    case PLIST_STRING:
+        if (!(flags & PLIST_DATA_INLINE) && length >= PLIST_DATA_INLINE_SIZE) {
+            size += header + length + 1;
+        }
+        break;
+    case PLIST_DATA:
+        if (!(flags & PLIST_DATA_BORROWED)) {
+            size += header + length;
+        }
+        break;
+    default:
+        break;
+    }
+    return size;
+}
+
+uint64_t plist_index_size(plist_data_t data)
+{
+    if (!data->hashtable || (data->flags & PLIST_DATA_LAZY)) {
+        return 0;
+    }
+    if (data->type == PLIST_DICT) {
+        return sizeof(hashtable_t) + ((hashtable_t*)data->hashtable)->capacity * sizeof(hashentry_t);
+    }
+    if (data->type == PLIST_ARRAY) {
+        return sizeof(ptrarray_t) + ((ptrarray_t*)data->hashtable)->capacity * sizeof(void*);
+    }
+    return 0;
+}
+
+uint64_t plist_container_size(plist_t node)
+{
+    plist_data_t data = plist_get_data(node);
+    uint64_t size = plist_index_size(data);
+
+    if (((node_t*)node)->children && !(data->flags & PLIST_DATA_ARENA)) {
+        size += sizeof(node_list_t);
+    }
+    return size;
+}
+
+PLIST_API uint64_t plist_mem_usage(plist_t plist)
+{
+    node_t *root = (node_t*)plist;
+    node_t *node = root;
+    uint64_t size = 0;
+
+    while (node) {
+        plist_data_t data = plist_get_data(node);
+        size += plist_node_size(data->type, data->length, data->flags);
+        if (data->type == PLIST_ARRAY || data->type == PLIST_DICT) {
+            size += plist_container_size(node);
+        }
+
+        /* depth first along the parent pointers, without the siblings of root */
+        if (node_first_child(node)) {
+            node = node_first_child(node);
+            continue;
+        }
+        while (node != root && !node_next_sibling(node)) {
+            node = node->parent;
+        }
+        node = (node == root) ? NULL : node_next_sibling(node);
+    }
+    return size;
 }
 
 plist_t plist_new_node(plist_data_t data)
 {
+    PLIST_STAT_ADD(nodes_created, 1);
+    if (data && (data->flags & PLIST_DATA_ARENA)) {
+        struct plist_arena_node_s *an = (struct plist_arena_node_s*)data;
+        node_init(&an->node, &an->children, data);
+        return (plist_t)&an->node;
+    }
+    PLIST_STAT_ADD(bytes_allocated, sizeof(node_t));
     return (plist_t) node_create(NULL, data);
 }
 
@@ -149,20 +629,88 @@ plist_data_t plist_get_data(const plist_t node)
 
 plist_data_t plist_new_plist_data(void)
 {
-    plist_data_t data = (plist_data_t) calloc(sizeof(struct plist_data_s), 1);
+    plist_data_t data = (plist_data_t) plist_calloc(sizeof(struct plist_data_s), 1);
+    PLIST_STAT_ADD(bytes_allocated, sizeof(struct plist_data_s));
     return data;
 }
 
-static unsigned int dict_key_hash(const void *data)
+plist_data_t plist_new_plist_data_in(plist_arena_t arena)
 {
-    plist_data_t keydata = (plist_data_t)data;
-    unsigned int hash = 5381;
-    size_t i;
-    char *str = keydata->strval;
-    for (i = 0; i < keydata->length; str++, i++) {
-        hash = ((hash << 5) + hash) + *str;
+    struct plist_arena_node_s *an = NULL;
+    if (!arena) {
+        return plist_new_plist_data();
+    }
+    PLIST_STAT_ADD(bytes_allocated, sizeof(struct plist_arena_node_s));
+    an = (struct plist_arena_node_s*)arena_alloc(((struct plist_arena_s*)arena)->mem, sizeof(struct plist_arena_node_s));
+    if (!an) {
+        return NULL;
+    }
+    memset(an, '\0', sizeof(struct plist_arena_node_s));
+    an->arena = (struct plist_arena_s*)arena;
+    an->data.flags = PLIST_DATA_ARENA;
+    return &an->data;
+}
+
+/* 64 bit word-at-a-time hash based on MurmurHash64A */
+uint64_t plist_hash_bytes64(const void *buf, size_t len, uint64_t seed)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    const uint8_t *p = (const uint8_t*)buf;
+    const uint8_t *end = p + (len & ~(size_t)7);
+    uint64_t h = seed ^ (len * m);
+    uint64_t k;
+
+    while (p != end) {
+        memcpy(&k, p, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+        p += 8;
+    }
+
+    switch (len & 7) {
+    case 7: h ^= (uint64_t)p[6] << 48; /* fall through */
+    case 6: h ^= (uint64_t)p[5] << 40; /* fall through */
+    case 5: h ^= (uint64_t)p[4] << 32; /* fall through */
+    case 4: h ^= (uint64_t)p[3] << 24; /* fall through */
+    case 3: h ^= (uint64_t)p[2] << 16; /* fall through */
+    case 2: h ^= (uint64_t)p[1] << 8; /* fall through */
+    case 1: h ^= (uint64_t)p[0];
+            h *= m;
+            break;
+    default:
+        break;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+unsigned int plist_hash_bytes(const void *buf, size_t len, unsigned int seed)
+{
+    uint64_t h = plist_hash_bytes64(buf, len, seed);
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+unsigned int plist_data_payload_hash(plist_data_t data)
+{
+    if (!(data->flags & PLIST_DATA_HASHED)) {
+        /* strval and buff share the union, both are length bytes long */
+        data->hash = plist_hash_bytes(data->buff, (data->buff) ? data->length : 0, 0);
+        data->flags |= PLIST_DATA_HASHED;
     }
-    return hash;
+    return data->hash;
+}
+
+static unsigned int dict_key_hash(const void *data)
+{
+    return plist_data_payload_hash((plist_data_t)data);
 }
 
 static int dict_key_compare(const void* a, const void* b)
@@ -172,53 +720,247 @@ static int dict_key_compare(const void* a, const void* b)
     if (data_a->strval == NULL || data_b->strval == NULL) {
         return FALSE;
     }
+    /* interned keys */
+    if (data_a->strval == data_b->strval) {
+        return TRUE;
+    }
     if (data_a->length != data_b->length) {
         return FALSE;
     }
     return (strcmp(data_a->strval, data_b->strval) == 0) ? TRUE : FALSE;
 }
 
+plist_data_t plist_arena_intern_key(plist_data_t data, int adopt)
+{
+    struct plist_arena_s *arena = (struct plist_arena_s*)plist_data_get_arena(data);
+    plist_data_t entry = NULL;
+
+    if (!arena || !(arena->options & PLIST_ARENA_INTERN_KEYS) || !data->strval) {
+        return NULL;
+    }
+    if (!arena->keys) {
+        arena->keys = hash_table_new(dict_key_hash, dict_key_compare, NULL);
+        if (!arena->keys) {
+            return NULL;
+        }
+    }
+    plist_data_payload_hash(data);
+    entry = (plist_data_t)hash_table_lookup(arena->keys, data);
+    if (!entry) {
+        /* pool entries are not nodes, so nothing else can modify them */
+        entry = (plist_data_t)arena_alloc(arena->mem, sizeof(struct plist_data_s));
+        if (!entry) {
+            return NULL;
+        }
+        memset(entry, 0, sizeof(struct plist_data_s));
+        entry->type = PLIST_KEY;
+        entry->length = data->length;
+        entry->hash = data->hash;
+        entry->flags = PLIST_DATA_HASHED;
+        if (adopt && !(data->flags & PLIST_DATA_INLINE)) {
+            entry->strval = data->strval;
+        } else {
+            entry->strval = (char*)arena_alloc(arena->mem, data->length + 1);
+            if (!entry->strval) {
+                return NULL;
+            }
+            memcpy(entry->strval, data->strval, data->length + 1);
+        }
+        hash_table_insert(arena->keys, entry, entry);
+    }
+    data->strval = entry->strval;
+    data->flags &= ~PLIST_DATA_INLINE;
+    return entry;
+}
+
+void plist_dict_build_index(plist_t node)
+{
+    plist_data_t data = plist_get_data(node);
+    node_t *cur = NULL;
+    hashtable_t *ht = NULL;
+    struct plist_arena_s *arena = NULL;
+    unsigned int i = 0;
+
+    if (data->hashtable || (data->flags & PLIST_DATA_LAZY) || ((node_t*)node)->count / 2 <= plist_dict_index_threshold) {
+        return;
+    }
+    ht = hash_table_new_sized(dict_key_hash, dict_key_compare, NULL, ((node_t*)node)->count / 2);
+    if (!ht) {
+        return;
+    }
+    /* walk backwards so that of duplicate keys the first one ends up in
+     * the index, just like with a linear search. The prev pointer of the
+     * first child is not NULL, so the entries are counted. */
+    cur = ((node_t*)node)->children->end;
+    for (i = ((node_t*)node)->count / 2; i > 0; i--, cur = cur->prev->prev) {
+        hash_table_insert(ht, cur->prev->data, cur);
+    }
+    data->hashtable = ht;
+    arena = (struct plist_arena_s*)plist_data_get_arena(data);
+    if (arena) {
+        ptr_array_add(arena->tables, ht);
+    }
+}
+
+/* adds an item vector with room for capacity items to an array */
+static ptrarray_t *plist_array_new_index(plist_t node, uint32_t capacity)
+{
+    plist_data_t data = plist_get_data(node);
+    node_t *ch = NULL;
+    ptrarray_t *pa = NULL;
+    struct plist_arena_s *arena = NULL;
+
+    if (capacity < ((node_t*)node)->count) {
+        capacity = ((node_t*)node)->count;
+    }
+    pa = ptr_array_new(capacity);
+    if (!pa || !pa->pdata) {
+        ptr_array_free(pa);
+        return NULL;
+    }
+    for (ch = node_first_child((node_t*)node); ch; ch = node_next_sibling(ch)) {
+        ptr_array_add(pa, ch);
+    }
+    data->hashtable = pa;
+    arena = (struct plist_arena_s*)plist_data_get_arena(data);
+    if (arena) {
+        ptr_array_add(arena->arrays, pa);
+    }
+    return pa;
+}
+
+void plist_array_build_index(plist_t node)
+{
+    plist_data_t data = plist_get_data(node);
+
+    if (data->type != PLIST_ARRAY || data->hashtable || (data->flags & PLIST_DATA_LAZY) || ((node_t*)node)->count <= PLIST_ARRAY_INDEX_THRESHOLD) {
+        return;
+    }
+    plist_array_new_index(node, ((node_t*)node)->count);
+}
+
+/* the item vector of an array node, or NULL if it has none */
+static ptrarray_t *plist_array_index(node_t *node)
+{
+    plist_data_t data = plist_get_data(node);
+    if (!data || data->type != PLIST_ARRAY || (data->flags & PLIST_DATA_LAZY)) {
+        return NULL;
+    }
+    return (ptrarray_t*)data->hashtable;
+}
+
 void plist_free_data(plist_data_t data)
 {
-    if (data)
+    if (data && !(data->flags & PLIST_DATA_ARENA))
     {
         switch (data->type)
         {
         case PLIST_KEY:
         case PLIST_STRING:
-            free(data->strval);
+            if (data->flags & PLIST_DATA_SHARED)
+                plist_shared_release(data->strval);
+            else if (!(data->flags & PLIST_DATA_INLINE))
+                plist_mem_free(data->strval);
             break;
         case PLIST_DATA:
-            free(data->buff);
+            if (data->flags & PLIST_DATA_SHARED)
+                plist_shared_release(data->buff);
+            else if (!(data->flags & PLIST_DATA_BORROWED))
+                plist_mem_free(data->buff);
             break;
+        case PLIST_ARRAY:
         case PLIST_DICT:
-            hash_table_destroy(data->hashtable);
+            if (data->flags & PLIST_DATA_LAZY)
+                plist_bin_lazy_free(data->hashtable);
+            else if (data->type == PLIST_DICT)
+                hash_table_destroy(data->hashtable);
+            else
+                ptr_array_free(data->hashtable);
             break;
         default:
             break;
         }
-        free(data);
+        plist_mem_free(data);
     }
 }
 
-static int plist_free_node(node_t* node)
+static int plist_node_is_arena(node_t* node)
 {
-    plist_data_t data = NULL;
-    int node_index = node_detach(node->parent, node);
-    data = plist_get_data(node);
-    plist_free_data(data);
-    node->data = NULL;
+    plist_data_t data = plist_get_data(node);
+    return (data && (data->flags & PLIST_DATA_ARENA));
+}
 
-    node_iterator_t *ni = node_iterator_create(node->children);
-    node_t *ch;
-    while ((ch = node_iterator_next(ni))) {
-        plist_free_node(ch);
+/* drops the cached plist_hash() of node and of the containers above it
+ * after node or its children changed */
+static void plist_tree_changed(node_t *node)
+{
+    while (node && node->data) {
+        plist_data_t data = (plist_data_t)node->data;
+        if (!(data->flags & PLIST_DATA_TREE_HASHED)) {
+            /* nothing above is hashed either */
+            break;
+        }
+        data->flags &= ~PLIST_DATA_TREE_HASHED;
+        node = node->parent;
     }
-    node_iterator_destroy(ni);
+}
+
+/* position of item in the item vector pa, starting with hint, or pa->len
+ * if it is not there. Items don't store their position, so this is a
+ * scan, but over a plain vector. */
+static size_t plist_array_index_find(ptrarray_t *pa, plist_t item, size_t hint)
+{
+    size_t i;
+    if (hint < pa->len && pa->pdata[hint] == item) {
+        return hint;
+    }
+    for (i = 0; i < pa->len && pa->pdata[i] != item; i++);
+    return i;
+}
+
+/* values for the pos argument of plist_free_node */
+#define FREE_NODE_POS_UNKNOWN UINT32_MAX
+/* the caller updates the item vector of the parent array itself */
+#define FREE_NODE_POS_KEEP (UINT32_MAX - 1)
 
-    node_destroy(node);
+/* detaches root from its parent and frees it. If the parent is an array
+ * with an item vector, pos is the position of root in it, if known. */
+static void plist_free_node(node_t* root, uint32_t pos)
+{
+    node_t *node = root;
+    node_t *parent = NULL;
+    node_t *ch = NULL;
+    ptrarray_t *pa = (pos != FREE_NODE_POS_KEEP) ? plist_array_index(root->parent) : NULL;
+
+    plist_tree_changed(root->parent);
+    if (node_unlink(root->parent, root) == 0 && pa) {
+        ptr_array_remove(pa, plist_array_index_find(pa, root, pos));
+    }
+    if (plist_node_is_arena(root)) {
+        /* released together with the arena */
+        return;
+    }
 
-    return node_index;
+    /* free the subtree bottom up, following the parent pointers */
+    while (node) {
+        ch = node_first_child(node);
+        if (ch) {
+            if (plist_node_is_arena(ch)) {
+                node_unlink(node, ch);
+            } else {
+                node = ch;
+            }
+            continue;
+        }
+        parent = (node == root) ? NULL : node->parent;
+        if (parent) {
+            node_unlink(parent, node);
+        }
+        plist_free_data(plist_get_data(node));
+        node->data = NULL;
+        node_destroy(node);
+        node = parent;
+    }
 }
 
 PLIST_API plist_t plist_new_dict(void)
@@ -236,12 +978,16 @@ PLIST_API plist_t plist_new_array(void)
 }
 
 //These nodes should not be handled by users
-static plist_t plist_new_key(const char *val)
+static plist_t plist_new_key(plist_arena_t arena, const char *val)
 {
-    plist_data_t data = plist_new_plist_data();
+    plist_data_t data = plist_new_plist_data_in(arena);
     data->type = PLIST_KEY;
-    data->strval = strdup(val);
     data->length = strlen(val);
+    data->strval = (char*)val;
+    if (!plist_arena_intern_key(data, 0)) {
+        plist_data_alloc_string(data, arena, data->length);
+        memcpy(data->strval, val, data->length + 1);
+    }
     return plist_new_node(data);
 }
 
@@ -249,8 +995,9 @@ PLIST_API plist_t plist_new_string(const char *val)
 {
     plist_data_t data = plist_new_plist_data();
     data->type = PLIST_STRING;
-    data->strval = strdup(val);
     data->length = strlen(val);
+    plist_data_alloc_string(data, NULL, data->length);
+    memcpy(data->strval, val, data->length + 1);
     return plist_new_node(data);
 }
 
@@ -294,7 +1041,7 @@ PLIST_API plist_t plist_new_data(const char *val, uint64_t length)
 {
     plist_data_t data = plist_new_plist_data();
     data->type = PLIST_DATA;
-    data->buff = (uint8_t *) malloc(length);
+    plist_data_alloc_buffer(data, NULL, length);
     memcpy(data->buff, val, length);
     data->length = length;
     return plist_new_node(data);
@@ -313,104 +1060,175 @@ PLIST_API void plist_free(plist_t plist)
 {
     if (plist)
     {
-        plist_free_node(plist);
+        plist_free_node(plist, FREE_NODE_POS_UNKNOWN);
     }
 }
 
-static void plist_copy_node(node_t *node, void *parent_node_ptr)
+/* copies node without its children */
+static node_t *plist_copy_node(node_t *node)
 {
-    plist_type node_type = PLIST_NONE;
-    plist_t newnode = NULL;
     plist_data_t data = plist_get_data(node);
     plist_data_t newdata = plist_new_plist_data();
 
     assert(data);				// plist should always have data
 
+    plist_load_children(node);
     memcpy(newdata, data, sizeof(struct plist_data_s));
+    newdata->flags &= ~(PLIST_DATA_ARENA | PLIST_DATA_BORROWED | PLIST_DATA_BPLIST_INDEX);
 
-    node_type = plist_get_node_type(node);
-    switch (node_type) {
+    switch (data->type) {
         case PLIST_DATA:
-            newdata->buff = (uint8_t *) malloc(data->length);
-            memcpy(newdata->buff, data->buff, data->length);
+            if (data->flags & PLIST_DATA_SHARED) {
+                plist_shared_retain(newdata->buff);
+            } else {
+                plist_data_alloc_buffer(newdata, NULL, data->length);
+                memcpy(newdata->buff, data->buff, data->length);
+            }
             break;
         case PLIST_KEY:
         case PLIST_STRING:
-            newdata->strval = strdup((char *) data->strval);
+            if (data->flags & PLIST_DATA_SHARED) {
+                plist_shared_retain(newdata->strval);
+            } else if (data->flags & PLIST_DATA_INLINE) {
+                newdata->strval = newdata->inline_str;
+            } else {
+                plist_data_alloc_string(newdata, NULL, data->length);
+                memcpy(newdata->strval, data->strval, data->length + 1);
+            }
             break;
         case PLIST_DICT:
-            if (data->hashtable) {
-                hashtable_t* ht = hash_table_new(dict_key_hash, dict_key_compare, NULL);
-                assert(ht);
-                plist_t current = NULL;
-                for (current = (plist_t)node_first_child(node);
-                     ht && current;
-                     current = (plist_t)node_next_sibling(node_next_sibling(current)))
-                {
-                    hash_table_insert(ht, ((node_t*)current)->data, node_next_sibling(current));
-                }
-                newdata->hashtable = ht;
-            }
+            /* rebuilt by plist_copy_finish once the items are copied */
+            newdata->hashtable = NULL;
+            break;
+        case PLIST_ARRAY:
+            /* rebuilt once the items are copied */
+            newdata->hashtable = NULL;
             break;
         default:
             break;
     }
-    newnode = plist_new_node(newdata);
-
-    if (*(plist_t*)parent_node_ptr)
-    {
-        node_attach(*(plist_t*)parent_node_ptr, newnode);
-    }
-    else
-    {
-        *(plist_t*)parent_node_ptr = newnode;
-    }
+    return (node_t*)plist_new_node(newdata);
+}
 
-    node_iterator_t *ni = node_iterator_create(node->children);
-    node_t *ch;
-    while ((ch = node_iterator_next(ni))) {
-        plist_copy_node(ch, &newnode);
+/* called when all children of node have been copied to newnode */
+static void plist_copy_finish(node_t *node, node_t *newnode)
+{
+    if (plist_get_data(node)->type == PLIST_DICT) {
+        plist_dict_build_index(newnode);
+    } else if (plist_get_data(node)->type == PLIST_ARRAY) {
+        plist_array_build_index(newnode);
     }
-    node_iterator_destroy(ni);
 }
 
-PLIST_API plist_t plist_copy(plist_t node)
+PLIST_API plist_t plist_copy(plist_t plist)
 {
-    plist_t copied = NULL;
-    plist_copy_node(node, &copied);
+    node_t *root = (node_t*)plist;
+    node_t *node = root;
+    node_t *copied = NULL;
+    node_t *newnode = NULL;
+    node_t *ch = NULL;
+
+    if (!root) {
+        return NULL;
+    }
+    copied = newnode = plist_copy_node(root);
+
+    /* walk the tree along the parent pointers, newnode always is the
+     * copy of node */
+    while (node) {
+        ch = node_first_child(node);
+        if (ch) {
+            node_t *newch = plist_copy_node(ch);
+            node_attach(newnode, newch);
+            node = ch;
+            newnode = newch;
+            continue;
+        }
+        while (node) {
+            plist_copy_finish(node, newnode);
+            if (node == root) {
+                node = NULL;
+                break;
+            }
+            if (node_next_sibling(node)) {
+                node_t *newsib = plist_copy_node(node_next_sibling(node));
+                node_attach(newnode->parent, newsib);
+                node = node_next_sibling(node);
+                newnode = newsib;
+                break;
+            }
+            node = node->parent;
+            newnode = newnode->parent;
+        }
+    }
+
     return copied;
 }
 
-PLIST_API uint32_t plist_array_get_size(plist_t node)
+PLIST_API uint64_t plist_array_get_size64(plist_t node)
 {
-    uint32_t ret = 0;
+    uint64_t ret = 0;
     if (node && PLIST_ARRAY == plist_get_node_type(node))
     {
+        plist_load_children(node);
         ret = node_n_children(node);
     }
     return ret;
 }
 
-PLIST_API plist_t plist_array_get_item(plist_t node, uint32_t n)
+PLIST_API uint32_t plist_array_get_size(plist_t node)
+{
+    return (uint32_t)plist_array_get_size64(node);
+}
+
+PLIST_API plist_t plist_array_get_item64(plist_t node, uint64_t n)
 {
     plist_t ret = NULL;
-    if (node && PLIST_ARRAY == plist_get_node_type(node))
+    if (node && PLIST_ARRAY == plist_get_node_type(node) && n <= SIZE_MAX)
     {
-        ret = (plist_t)node_nth_child(node, n);
+        ptrarray_t *pa = NULL;
+        plist_load_children(node);
+        pa = plist_array_index((node_t*)node);
+        if (pa) {
+            ret = (plist_t)ptr_array_index(pa, (size_t)n);
+        } else {
+            ret = (plist_t)node_nth_child(node, (size_t)n);
+        }
     }
     return ret;
 }
 
+PLIST_API plist_t plist_array_get_item(plist_t node, uint32_t n)
+{
+    return plist_array_get_item64(node, n);
+}
+
 PLIST_API uint32_t plist_array_get_item_index(plist_t node)
 {
     plist_t father = plist_get_parent(node);
     if (PLIST_ARRAY == plist_get_node_type(father))
     {
+        ptrarray_t *pa = plist_array_index((node_t*)father);
+        if (pa) {
+            size_t i = plist_array_index_find(pa, node, 0);
+            return (i < pa->len) ? (uint32_t)i : 0;
+        }
         return node_child_position(father, node);
     }
     return 0;
 }
 
+/* keeps the item vector of node in sync after item was inserted at n */
+static void plist_array_index_insert(plist_t node, plist_t item, uint32_t n)
+{
+    ptrarray_t *pa = plist_array_index((node_t*)node);
+    if (pa) {
+        ptr_array_insert(pa, item, n);
+    } else {
+        plist_array_build_index(node);
+    }
+}
+
 PLIST_API void plist_array_set_item(plist_t node, plist_t item, uint32_t n)
 {
     if (node && PLIST_ARRAY == plist_get_node_type(node))
@@ -418,12 +1236,19 @@ PLIST_API void plist_array_set_item(plist_t node, plist_t item, uint32_t n)
         plist_t old_item = plist_array_get_item(node, n);
         if (old_item)
         {
-            int idx = plist_free_node(old_item);
-	    if (idx < 0) {
-		node_attach(node, item);
-	    } else {
-		node_insert(node, idx, item);
-	    }
+            ptrarray_t *pa = plist_array_index((node_t*)node);
+            node_t *prev = node_prev_sibling((node_t*)old_item);
+            plist_tree_changed((node_t*)node);
+            /* the item takes the place of the old one, in the list and in
+             * the item vector */
+            plist_free_node((node_t*)old_item, FREE_NODE_POS_KEEP);
+            if (node_insert_after((node_t*)node, prev, (node_t*)item) == 0) {
+                if (pa) {
+                    ptr_array_set(pa, item, n);
+                }
+            } else if (pa) {
+                ptr_array_remove(pa, n);
+            }
         }
     }
     return;
@@ -433,16 +1258,109 @@ PLIST_API void plist_array_append_item(plist_t node, plist_t item)
 {
     if (node && PLIST_ARRAY == plist_get_node_type(node))
     {
-        node_attach(node, item);
+        plist_load_children(node);
+        plist_tree_changed((node_t*)node);
+        if (node_attach(node, item) == 0) {
+            plist_array_index_insert(node, item, UINT32_MAX);
+        }
     }
     return;
 }
 
+PLIST_API void plist_array_reserve(plist_t node, uint32_t capacity)
+{
+    ptrarray_t *pa = NULL;
+
+    if (!node || PLIST_ARRAY != plist_get_node_type(node) || capacity <= PLIST_ARRAY_INDEX_THRESHOLD) {
+        return;
+    }
+    plist_load_children(node);
+    pa = plist_array_index((node_t*)node);
+    if (pa) {
+        ptr_array_reserve(pa, capacity);
+    } else {
+        plist_array_new_index(node, capacity);
+    }
+}
+
+PLIST_API void plist_array_append_items(plist_t node, plist_t *items, uint32_t count)
+{
+    uint64_t capacity = 0;
+    ptrarray_t *pa = NULL;
+    uint32_t i = 0;
+
+    if (!node || PLIST_ARRAY != plist_get_node_type(node) || !items) {
+        return;
+    }
+    plist_load_children(node);
+    plist_tree_changed((node_t*)node);
+    capacity = (uint64_t)((node_t*)node)->count + count;
+    plist_array_reserve(node, (capacity > UINT32_MAX) ? UINT32_MAX : (uint32_t)capacity);
+    pa = plist_array_index((node_t*)node);
+    for (i = 0; i < count; i++) {
+        if (items[i] && node_attach(node, items[i]) == 0 && pa) {
+            ptr_array_add(pa, items[i]);
+        }
+    }
+}
+
+/* creates an array of count items made by new_item */
+static plist_t plist_new_array_of(const void *vals, uint32_t count, plist_t (*new_item)(const void *vals, uint32_t i))
+{
+    plist_t node = plist_new_array();
+    ptrarray_t *pa = NULL;
+    uint32_t i = 0;
+
+    plist_array_reserve(node, count);
+    pa = plist_array_index((node_t*)node);
+    for (i = 0; i < count; i++) {
+        plist_t item = new_item(vals, i);
+        if (node_attach(node, item) == 0 && pa) {
+            ptr_array_add(pa, item);
+        }
+    }
+    return node;
+}
+
+static plist_t new_uint_item(const void *vals, uint32_t i)
+{
+    return plist_new_uint(((const uint64_t*)vals)[i]);
+}
+
+static plist_t new_real_item(const void *vals, uint32_t i)
+{
+    return plist_new_real(((const double*)vals)[i]);
+}
+
+static plist_t new_string_item(const void *vals, uint32_t i)
+{
+    return plist_new_string(((const char**)vals)[i]);
+}
+
+PLIST_API plist_t plist_new_uint_array(const uint64_t *vals, uint32_t count)
+{
+    return plist_new_array_of(vals, (vals) ? count : 0, new_uint_item);
+}
+
+PLIST_API plist_t plist_new_real_array(const double *vals, uint32_t count)
+{
+    return plist_new_array_of(vals, (vals) ? count : 0, new_real_item);
+}
+
+PLIST_API plist_t plist_new_string_array(const char **vals, uint32_t count)
+{
+    return plist_new_array_of(vals, (vals) ? count : 0, new_string_item);
+}
+
 PLIST_API void plist_array_insert_item(plist_t node, plist_t item, uint32_t n)
 {
     if (node && PLIST_ARRAY == plist_get_node_type(node))
     {
-        node_insert(node, n, item);
+        plist_load_children(node);
+        plist_tree_changed((node_t*)node);
+        if (node_insert(node, n, item) == 0) {
+            plist_array_index_insert(node, item, n);
+        }
     }
     return;
 }
@@ -454,61 +1372,110 @@ PLIST_API void plist_array_remove_item(plist_t node, uint32_t n)
         plist_t old_item = plist_array_get_item(node, n);
         if (old_item)
         {
-            plist_free(old_item);
+            plist_free_node((node_t*)old_item, n);
         }
     }
     return;
 }
 
-PLIST_API uint32_t plist_dict_get_size(plist_t node)
+PLIST_API uint64_t plist_dict_get_size64(plist_t node)
 {
-    uint32_t ret = 0;
+    uint64_t ret = 0;
     if (node && PLIST_DICT == plist_get_node_type(node))
     {
+        plist_load_children(node);
         ret = node_n_children(node) / 2;
     }
     return ret;
 }
 
+PLIST_API uint32_t plist_dict_get_size(plist_t node)
+{
+    return (uint32_t)plist_dict_get_size64(node);
+}
+
+/* dict iterator state: the key node that will be returned next */
+struct plist_dict_iter_s {
+    node_t *next_key;
+    int started;
+};
+
 PLIST_API void plist_dict_new_iter(plist_t node, plist_dict_iter *iter)
 {
     if (iter && *iter == NULL)
     {
-        *iter = malloc(sizeof(uint32_t));
-        *((uint32_t*)(*iter)) = 0;
+        struct plist_dict_iter_s *it = (struct plist_dict_iter_s*)plist_malloc(sizeof(struct plist_dict_iter_s));
+        if (it) {
+            it->next_key = NULL;
+            it->started = 0;
+        }
+        *iter = it;
     }
     return;
 }
 
-PLIST_API void plist_dict_next_item(plist_t node, plist_dict_iter iter, char **key, plist_t *val)
+static plist_t plist_dict_iter_step(plist_t node, plist_dict_iter iter, plist_t *val)
 {
-    uint32_t* iter_int = (uint32_t*) iter;
+    struct plist_dict_iter_s *it = (struct plist_dict_iter_s*)iter;
+    node_t *key_node = NULL;
 
-    if (key)
-    {
-        *key = NULL;
-    }
     if (val)
     {
         *val = NULL;
     }
 
-    if (node && PLIST_DICT == plist_get_node_type(node) && *iter_int < node_n_children(node))
+    if (!it || !node || PLIST_DICT != plist_get_node_type(node))
+    {
+        return NULL;
+    }
+    plist_load_children(node);
+
+    if (!it->started)
     {
+        /* set up the cursor on first use so items added after
+         * plist_dict_new_iter() are still returned */
+        it->next_key = node_first_child((node_t*)node);
+        it->started = 1;
+    }
 
-        if (key)
-        {
-            plist_get_key_val((plist_t)node_nth_child(node, *iter_int), key);
-        }
+    key_node = it->next_key;
+    if (!key_node || !key_node->next)
+    {
+        it->next_key = NULL;
+        return NULL;
+    }
+
+    if (val)
+    {
+        *val = (plist_t)key_node->next;
+    }
+    it->next_key = key_node->next->next;
+
+    return (plist_t)key_node;
+}
+
+PLIST_API void plist_dict_next_item(plist_t node, plist_dict_iter iter, char **key, plist_t *val)
+{
+    plist_t key_node = plist_dict_iter_step(node, iter, val);
 
-        if (val)
+    if (key)
+    {
+        *key = NULL;
+        if (key_node)
         {
-            *val = (plist_t) node_nth_child(node, *iter_int + 1);
+            plist_get_key_val(key_node, key);
         }
+    }
+}
+
+PLIST_API void plist_dict_next_item_ptr(plist_t node, plist_dict_iter iter, const char **key, plist_t *val)
+{
+    plist_t key_node = plist_dict_iter_step(node, iter, val);
 
-        *iter_int += 2;
+    if (key)
+    {
+        *key = (key_node) ? (const char*)plist_get_data(key_node)->strval : NULL;
     }
-    return;
 }
 
 PLIST_API void plist_dict_get_item_key(plist_t node, char **key)
@@ -520,19 +1487,17 @@ PLIST_API void plist_dict_get_item_key(plist_t node, char **key)
     }
 }
 
-PLIST_API plist_t plist_dict_get_item(plist_t node, const char* key)
+plist_t plist_dict_lookup(plist_t node, plist_data_t key)
 {
     plist_t ret = NULL;
 
     if (node && PLIST_DICT == plist_get_node_type(node))
     {
+        plist_load_children(node);
         plist_data_t data = plist_get_data(node);
         hashtable_t *ht = (hashtable_t*)data->hashtable;
         if (ht) {
-            struct plist_data_s sdata;
-            sdata.strval = (char*)key;
-            sdata.length = strlen(key);
-            ret = (plist_t)hash_table_lookup(ht, &sdata);
+            ret = (plist_t)hash_table_lookup(ht, key);
         } else {
             plist_t current = NULL;
             for (current = (plist_t)node_first_child(node);
@@ -542,7 +1507,7 @@ PLIST_API plist_t plist_dict_get_item(plist_t node, const char* key)
                 data = plist_get_data(current);
                 assert( PLIST_KEY == plist_get_node_type(current) );
 
-                if (data && !strcmp(key, data->strval))
+                if (data && data->length == key->length && !memcmp(key->strval, data->strval, key->length))
                 {
                     ret = (plist_t)node_next_sibling(current);
                     break;
@@ -553,21 +1518,27 @@ PLIST_API plist_t plist_dict_get_item(plist_t node, const char* key)
     return ret;
 }
 
+PLIST_API plist_t plist_dict_get_item(plist_t node, const char* key)
+{
+    struct plist_data_s sdata;
+    sdata.flags = 0;
+    sdata.strval = (char*)key;
+    sdata.length = strlen(key);
+    return plist_dict_lookup(node, &sdata);
+}
+
 PLIST_API void plist_dict_set_item(plist_t node, const char* key, plist_t item)
 {
     if (node && PLIST_DICT == plist_get_node_type(node)) {
         node_t* old_item = plist_dict_get_item(node, key);
         plist_t key_node = NULL;
+        plist_tree_changed((node_t*)node);
         if (old_item) {
-            int idx = plist_free_node(old_item);
-            if (idx < 0) {
-                node_attach(node, item);
-            } else {
-                node_insert(node, idx, item);
-            }
-            key_node = node_prev_sibling(item);
+            key_node = node_prev_sibling(old_item);
+            plist_free_node(old_item, FREE_NODE_POS_UNKNOWN);
+            node_insert_after(node, key_node, item);
         } else {
-            key_node = plist_new_key(key);
+            key_node = plist_new_key(plist_data_get_arena(plist_get_data(node)), key);
             node_attach(node, key_node);
             node_attach(node, item);
         }
@@ -577,24 +1548,52 @@ PLIST_API void plist_dict_set_item(plist_t node, const char* key, plist_t item)
             /* store pointer to item in hash table */
             hash_table_insert(ht, (plist_data_t)((node_t*)key_node)->data, item);
         } else {
-            if (((node_t*)node)->count > 500) {
-                /* make new hash table */
-                ht = hash_table_new(dict_key_hash, dict_key_compare, NULL);
-                /* calculate the hashes for all entries we have so far */
-                plist_t current = NULL;
-                for (current = (plist_t)node_first_child(node);
-                     ht && current;
-                     current = (plist_t)node_next_sibling(node_next_sibling(current)))
-                {
-                    hash_table_insert(ht, ((node_t*)current)->data, node_next_sibling(current));
-                }
-                ((plist_data_t)((node_t*)node)->data)->hashtable = ht;
-            }
+            plist_dict_build_index(node);
         }
     }
     return;
 }
 
+PLIST_API void plist_dict_set_items(plist_t node, const char **keys, plist_t *items, uint32_t count, uint32_t options)
+{
+    plist_arena_t arena = NULL;
+    hashtable_t *ht = NULL;
+    uint32_t i = 0;
+
+    if (!node || PLIST_DICT != plist_get_node_type(node) || !keys || !items) {
+        return;
+    }
+    if (!(options & PLIST_DICT_SET_UNIQUE)) {
+        for (i = 0; i < count; i++) {
+            if (keys[i] && items[i]) {
+                plist_dict_set_item(node, keys[i], items[i]);
+            }
+        }
+        return;
+    }
+
+    plist_load_children(node);
+    plist_tree_changed((node_t*)node);
+    arena = plist_data_get_arena(plist_get_data(node));
+    ht = (hashtable_t*)plist_get_data(node)->hashtable;
+    for (i = 0; i < count; i++) {
+        plist_t key_node = NULL;
+        if (!keys[i] || !items[i]) {
+            continue;
+        }
+        key_node = plist_new_key(arena, keys[i]);
+        node_attach(node, key_node);
+        node_attach(node, items[i]);
+        if (ht) {
+            hash_table_insert(ht, (plist_data_t)((node_t*)key_node)->data, items[i]);
+        }
+    }
+    /* one index for all new keys */
+    if (!ht) {
+        plist_dict_build_index(node);
+    }
+}
+
 PLIST_API void plist_dict_insert_item(plist_t node, const char* key, plist_t item)
 {
     plist_dict_set_item(node, key, item);
@@ -624,7 +1623,7 @@ PLIST_API void plist_dict_merge(plist_t *target, plist_t source)
 	if (!target || !*target || (plist_get_node_type(*target) != PLIST_DICT) || !source || (plist_get_node_type(source) != PLIST_DICT))
 		return;
 
-	char* key = NULL;
+	const char* key = NULL;
 	plist_dict_iter it = NULL;
 	plist_t subnode = NULL;
 	plist_dict_new_iter(source, &it);
@@ -632,15 +1631,13 @@ PLIST_API void plist_dict_merge(plist_t *target, plist_t source)
 		return;
 
 	do {
-		plist_dict_next_item(source, it, &key, &subnode);
+		plist_dict_next_item_ptr(source, it, &key, &subnode);
 		if (!key)
 			break;
 
 		plist_dict_set_item(*target, key, plist_copy(subnode));
-		free(key);
-		key = NULL;
 	} while (1);
-	free(it);	
+	plist_mem_free(it);	
 }
 
 PLIST_API plist_t plist_access_pathv(plist_t plist, uint32_t length, va_list v)
@@ -705,10 +1702,10 @@ static void plist_get_type_and_value(plist_t node, plist_type * type, void *valu
         break;
     case PLIST_KEY:
     case PLIST_STRING:
-        *((char **) value) = strdup(data->strval);
+        *((char **) value) = plist_strdup(data->strval);
         break;
     case PLIST_DATA:
-        *((uint8_t **) value) = (uint8_t *) malloc(*length * sizeof(uint8_t));
+        *((uint8_t **) value) = (uint8_t *) plist_malloc(*length * sizeof(uint8_t));
         memcpy(*((uint8_t **) value), data->buff, *length * sizeof(uint8_t));
         break;
     case PLIST_ARRAY:
@@ -795,6 +1792,34 @@ PLIST_API void plist_get_data_val(plist_t node, char **val, uint64_t * length)
         plist_get_type_and_value(node, &type, (void *) val, length);
 }
 
+static const char* plist_get_payload_ptr(plist_t node, plist_type type, uint64_t *length)
+{
+    plist_data_t data = NULL;
+    if (plist_get_node_type(node) != type) {
+        return NULL;
+    }
+    data = plist_get_data(node);
+    if (length) {
+        *length = data->length;
+    }
+    return (type == PLIST_DATA) ? (const char*)data->buff : data->strval;
+}
+
+PLIST_API const char* plist_get_key_ptr(plist_t node, uint64_t *length)
+{
+    return plist_get_payload_ptr(node, PLIST_KEY, length);
+}
+
+PLIST_API const char* plist_get_string_ptr(plist_t node, uint64_t *length)
+{
+    return plist_get_payload_ptr(node, PLIST_STRING, length);
+}
+
+PLIST_API const char* plist_get_data_ptr(plist_t node, uint64_t *length)
+{
+    return plist_get_payload_ptr(node, PLIST_DATA, length);
+}
+
 PLIST_API void plist_get_date_val(plist_t node, int32_t * sec, int32_t * usec)
 {
     plist_type type = plist_get_node_type(node);
@@ -840,6 +1865,11 @@ int plist_data_compare(const void *a, const void *b)
 
     case PLIST_KEY:
     case PLIST_STRING:
+        /* interned keys share their string */
+        if (val_a->strval == val_b->strval)
+            return TRUE;
+        if (val_a->length != val_b->length)
+            return FALSE;
         if (!strcmp(val_a->strval, val_b->strval))
             return TRUE;
         else
@@ -848,7 +1878,7 @@ int plist_data_compare(const void *a, const void *b)
     case PLIST_DATA:
         if (val_a->length != val_b->length)
             return FALSE;
-        if (!memcmp(val_a->buff, val_b->buff, val_a->length))
+        if (val_a->length == 0 || !memcmp(val_a->buff, val_b->buff, val_a->length))
             return TRUE;
         else
             return FALSE;
@@ -871,26 +1901,254 @@ PLIST_API char plist_compare_node_value(plist_t node_l, plist_t node_r)
     return plist_data_compare(node_l, node_r);
 }
 
+/* one step of MurmurHash64A, combines v into h */
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    v *= m;
+    v ^= v >> 47;
+    v *= m;
+    h ^= v;
+    h *= m;
+    return h;
+}
+
+static uint64_t plist_node_hash(node_t *node)
+{
+    plist_data_t data = plist_get_data(node);
+
+    switch (data->type) {
+    case PLIST_BOOLEAN:
+        return hash_mix(data->type, (uint8_t)data->boolval);
+    case PLIST_UINT:
+    case PLIST_REAL:
+    case PLIST_DATE:
+    case PLIST_UID:
+        /* the union holds the bits of reals and dates, unsigned and signed
+         * integers differ in length */
+        return hash_mix(hash_mix(data->type, data->length), data->intval);
+    case PLIST_KEY:
+    case PLIST_STRING:
+    case PLIST_DATA:
+        return plist_hash_bytes64(data->buff, (data->buff) ? data->length : 0, data->type);
+    case PLIST_ARRAY:
+    case PLIST_DICT:
+        return (data->flags & PLIST_DATA_TREE_HASHED) ? data->tree_hash : 0;
+    default:
+        break;
+    }
+    return hash_mix(data->type, 0);
+}
+
+/* hashes a container from the hashes of its items,
+ * dict entries are combined independent of their order */
+static void plist_container_hash(node_t *node)
+{
+    plist_data_t data = plist_get_data(node);
+    uint64_t h = hash_mix(data->type, node_n_children(node));
+    uint64_t sum = 0;
+    node_t *ch = NULL;
+
+    for (ch = node_first_child(node); ch; ch = node_next_sibling(ch)) {
+        if (data->type == PLIST_DICT) {
+            node_t *val = node_next_sibling(ch);
+            sum += hash_mix(plist_node_hash(ch), (val) ? plist_node_hash(val) : 0);
+            if (!val) {
+                break;
+            }
+            ch = val;
+        } else {
+            h = hash_mix(h, plist_node_hash(ch));
+        }
+    }
+    if (data->type == PLIST_DICT) {
+        h = hash_mix(h, sum);
+    }
+    h ^= h >> 47;
+    h *= 0xc6a4a7935bd1e995ULL;
+    h ^= h >> 47;
+    data->tree_hash = h;
+    data->flags |= PLIST_DATA_TREE_HASHED;
+}
+
+static int plist_needs_hash(node_t *node)
+{
+    plist_data_t data = plist_get_data(node);
+    return (data->type == PLIST_ARRAY || data->type == PLIST_DICT) && !(data->flags & PLIST_DATA_TREE_HASHED);
+}
+
+PLIST_API uint64_t plist_hash(plist_t plist)
+{
+    node_t *root = (node_t*)plist;
+    node_t *node = root;
+    node_t *ch = NULL;
+
+    if (!root || !root->data) {
+        return 0;
+    }
+
+    /* hash the containers bottom up along the parent pointers, skipping
+     * subtrees that are hashed already */
+    while (node) {
+        if (plist_needs_hash(node)) {
+            plist_load_children(node);
+            ch = node_first_child(node);
+            if (ch) {
+                node = ch;
+                continue;
+            }
+        }
+        while (node) {
+            if (plist_needs_hash(node)) {
+                plist_container_hash(node);
+            }
+            if (node == root) {
+                node = NULL;
+                break;
+            }
+            if (node_next_sibling(node)) {
+                node = node_next_sibling(node);
+                break;
+            }
+            node = node->parent;
+        }
+    }
+
+    return plist_node_hash(root);
+}
+
+plist_t plist_dict_find_value(plist_t node, plist_t key, plist_t key_at_pos)
+{
+    plist_data_t kdata = plist_get_data(key);
+    struct plist_data_s lookup;
+
+    if (key_at_pos) {
+        plist_data_t pdata = plist_get_data(key_at_pos);
+        if (pdata->length == kdata->length && (pdata->strval == kdata->strval || memcmp(pdata->strval, kdata->strval, kdata->length) == 0)) {
+            return node_next_sibling((node_t*)key_at_pos);
+        }
+    }
+    /* a private copy, hashing the key for the lookup must not modify the
+     * tree it belongs to */
+    memcpy(&lookup, kdata, sizeof(struct plist_data_s));
+    return plist_dict_lookup(node, &lookup);
+}
+
+PLIST_API char plist_equal_deep(plist_t node_l, plist_t node_r)
+{
+    ptrarray_t *stack = NULL;
+    char res = TRUE;
+
+    if (!node_l || !node_r) {
+        return FALSE;
+    }
+    stack = ptr_array_new(64);
+    if (!stack) {
+        return FALSE;
+    }
+    ptr_array_add(stack, node_l);
+    ptr_array_add(stack, node_r);
+
+    /* pairs of nodes still to compare */
+    while (res && stack->len > 0) {
+        node_t *a = (node_t*)stack->pdata[stack->len - 2];
+        node_t *b = (node_t*)stack->pdata[stack->len - 1];
+        plist_data_t data_a = plist_get_data(a);
+        plist_data_t data_b = plist_get_data(b);
+        node_t *ch_a = NULL;
+        node_t *ch_b = NULL;
+
+        stack->len -= 2;
+        if (a == b) {
+            continue;
+        }
+        if (!data_a || !data_b || data_a->type != data_b->type) {
+            res = FALSE;
+            break;
+        }
+        if (data_a->type != PLIST_ARRAY && data_a->type != PLIST_DICT) {
+            res = plist_data_compare(a, b);
+            continue;
+        }
+        if ((data_a->flags & PLIST_DATA_TREE_HASHED) && (data_b->flags & PLIST_DATA_TREE_HASHED) && data_a->tree_hash != data_b->tree_hash) {
+            res = FALSE;
+            break;
+        }
+        plist_load_children(a);
+        plist_load_children(b);
+        if (node_n_children(a) != node_n_children(b)) {
+            res = FALSE;
+            break;
+        }
+        ch_b = node_first_child(b);
+        for (ch_a = node_first_child(a); ch_a; ch_a = node_next_sibling(ch_a)) {
+            node_t *val_b = ch_b;
+            if (data_a->type == PLIST_DICT) {
+                val_b = (node_t*)plist_dict_find_value(b, ch_a, ch_b);
+                ch_a = node_next_sibling(ch_a);
+                if (!val_b || !ch_a) {
+                    res = FALSE;
+                    break;
+                }
+                if (ch_b) {
+                    ch_b = node_next_sibling(ch_b);
+                }
+            }
+            if (stack->len + 2 > stack->capacity && ptr_array_reserve(stack, stack->capacity * 2) < 0) {
+                res = FALSE;
+                break;
+            }
+            ptr_array_add(stack, ch_a);
+            ptr_array_add(stack, val_b);
+            if (ch_b) {
+                ch_b = node_next_sibling(ch_b);
+            }
+        }
+    }
+    ptr_array_free(stack);
+    return res;
+}
+
 static void plist_set_element_val(plist_t node, plist_type type, const void *value, uint64_t length)
 {
     //free previous allocated buffer
     plist_data_t data = plist_get_data(node);
     assert(data);				// a node should always have data attached
+    plist_arena_t arena = plist_data_get_arena(data);
 
     switch (data->type)
     {
+    case PLIST_ARRAY:
+    case PLIST_DICT:
+        if (data->flags & PLIST_DATA_LAZY) {
+            plist_bin_lazy_free(data->hashtable);
+        } else if (!arena && data->type == PLIST_DICT) {
+            hash_table_destroy(data->hashtable);
+        } else if (!arena) {
+            ptr_array_free(data->hashtable);
+        }
+        data->hashtable = NULL;
+        break;
     case PLIST_KEY:
     case PLIST_STRING:
-        free(data->strval);
+        if (data->flags & PLIST_DATA_SHARED)
+            plist_shared_release(data->strval);
+        else if (!arena && !(data->flags & PLIST_DATA_INLINE))
+            plist_mem_free(data->strval);
         data->strval = NULL;
         break;
     case PLIST_DATA:
-        free(data->buff);
+        if (data->flags & PLIST_DATA_SHARED)
+            plist_shared_release(data->buff);
+        else if (!arena && !(data->flags & PLIST_DATA_BORROWED))
+            plist_mem_free(data->buff);
         data->buff = NULL;
         break;
     default:
         break;
     }
+    data->flags &= ~(PLIST_DATA_HASHED | PLIST_DATA_BORROWED | PLIST_DATA_LAZY | PLIST_DATA_BPLIST_INDEX | PLIST_DATA_INLINE | PLIST_DATA_SHARED | PLIST_DATA_TREE_HASHED);
+    plist_tree_changed(((node_t*)node)->parent);
 
     //now handle value
 
@@ -912,10 +2170,11 @@ static void plist_set_element_val(plist_t node, plist_type type, const void *val
         break;
     case PLIST_KEY:
     case PLIST_STRING:
-        data->strval = strdup((char *) value);
+        plist_data_alloc_string(data, arena, length);
+        memcpy(data->strval, value, length + 1);
         break;
     case PLIST_DATA:
-        data->buff = (uint8_t *) malloc(length);
+        plist_data_alloc_buffer(data, arena, length);
         memcpy(data->buff, value, length);
         break;
     case PLIST_ARRAY:
@@ -47,6 +47,10 @@
   #endif
 #endif
 
+/* strings shorter than this are stored in plist_data_s itself, the size
+ * fills the structure to 48 bytes on 64 bit platforms */
+#define PLIST_DATA_INLINE_SIZE 20
+
 struct plist_data_s
 {
     union
@@ -58,17 +62,163 @@ struct plist_data_s
         uint8_t *buff;
         void *hashtable;
     };
-    uint64_t length;
+    union
+    {
+        uint64_t length;
+        /* content hash of an array or dict with PLIST_DATA_TREE_HASHED.
+         * The length of a container is not maintained, code reading
+         * length must skip arrays and dicts. */
+        uint64_t tree_hash;
+    };
     plist_type type;
+    uint32_t flags;
+    uint32_t hash;
+    char inline_str[PLIST_DATA_INLINE_SIZE];
 };
 
 typedef struct plist_data_s *plist_data_t;
 
+/* node, data and payload are owned by a plist_arena_t */
+#define PLIST_DATA_ARENA (1 << 0)
+/* hash holds the payload hash of a string, key or data node */
+#define PLIST_DATA_HASHED (1 << 1)
+/* buff points into a buffer owned by the caller */
+#define PLIST_DATA_BORROWED (1 << 2)
+/* children of an array or dict have not been parsed yet, hashtable holds
+ * the deferred state, see plist_bin_load_children() */
+#define PLIST_DATA_LAZY (1 << 3)
+/* hash holds the binary plist object index of a lazily parsed container */
+#define PLIST_DATA_BPLIST_INDEX (1 << 4)
+/* strval points to inline_str */
+#define PLIST_DATA_INLINE (1 << 5)
+/* strval or buff is a reference counted payload that copies of the node
+ * share, it must not be modified, see plist_shared_alloc() */
+#define PLIST_DATA_SHARED (1 << 6)
+/* tree_hash holds the plist_hash() of an array or dict. If a container
+ * has it, all containers below it have it too, see plist_tree_changed() */
+#define PLIST_DATA_TREE_HASHED (1 << 7)
+
 plist_t plist_new_node(plist_data_t data);
 plist_data_t plist_get_data(const plist_t node);
 plist_data_t plist_new_plist_data(void);
+plist_data_t plist_new_plist_data_in(plist_arena_t arena);
 void plist_free_data(plist_data_t data);
+void *plist_arena_alloc(plist_arena_t arena, size_t size);
+void *plist_shared_alloc(size_t size);
+void plist_shared_release(void *payload);
+char *plist_data_alloc_string(plist_data_t data, plist_arena_t arena, uint64_t length);
+uint8_t *plist_data_alloc_buffer(plist_data_t data, plist_arena_t arena, uint64_t length);
+plist_arena_t plist_data_get_arena(plist_data_t data);
 int plist_data_compare(const void *a, const void *b);
+unsigned int plist_hash_bytes(const void *buf, size_t len, unsigned int seed);
+uint64_t plist_hash_bytes64(const void *buf, size_t len, uint64_t seed);
+unsigned int plist_data_payload_hash(plist_data_t data);
+
+/* parser entry points taking 64 bit lengths */
+void plist_from_xml_internal(const char *plist_xml, uint64_t length, plist_t * plist, plist_arena_t arena);
+void plist_from_bin_internal(const char *plist_bin, uint64_t length, plist_t * plist, plist_arena_t arena, uint32_t options);
+void plist_from_json_internal(const char *plist_json, uint64_t length, plist_t * plist);
+void plist_from_compressed_internal(const char *plist_data, uint64_t length, plist_compress_dict_t dict, plist_t * plist);
+
+/* Gets the bytes of an ASCII string object of a binary plist without
+ * copying them. Returns 0 for ASCII strings, 1 for UTF-16 strings, which
+ * have to be converted with plist_bin_reader_get_string(), and -1 if obj
+ * is not a string. */
+int plist_bin_reader_get_raw_string(plist_bin_reader_t reader, uint64_t obj, const char **val, uint64_t *length);
+
+/* Gets segment n of a compiled path for walking it without nodes: the
+ * dictionary key with its length, and the array index or -1 if the
+ * segment is no index. Returns -1 for "*" segments or if n is out of
+ * range. */
+uint32_t plist_path_get_count(plist_path_t path);
+int plist_path_get_segment(plist_path_t path, uint32_t n, const char **key, uint64_t *keylen, int64_t *index);
+
+/* adds a date given as seconds since 2001-01-01, without rounding it to
+ * microseconds like plist_bin_writer_add_date() */
+int plist_bin_writer_add_date_real(plist_bin_writer_t writer, double val);
+
+/* checks if the data starts like a JSON plist, with '{' or '[' */
+int plist_is_json(const char *plist_data, uint64_t length);
+
+/* default for plist_set_max_depth() */
+#define PLIST_MAX_DEPTH_DEFAULT 512
+
+/* what a parse with plist_parse_limits_t has used so far, the parsers
+ * keep a NULL pointer to it when there are no limits */
+struct plist_limits_s {
+    uint64_t max_nodes;
+    uint64_t max_bytes;
+    uint32_t max_depth;
+    uint64_t nodes;
+    uint64_t bytes;
+    int exceeded;
+};
+
+/* sets up state for parsing length bytes with limits, replacing the 0
+ * values by their defaults */
+void plist_limits_init(struct plist_limits_s *state, const plist_parse_limits_t *limits, uint64_t length);
+
+/* adds nodes and bytes to state, returns -1 and sets exceeded if that
+ * goes over one of the limits */
+int plist_limits_add(struct plist_limits_s *state, uint64_t nodes, uint64_t bytes);
+
+/* bytes a node of type takes with a payload of length bytes, given the
+ * PLIST_DATA_* flags it has or will have. The child list and the index of
+ * a container are not included, see plist_container_size(). */
+uint64_t plist_node_size(plist_type type, uint64_t length, uint32_t flags);
+
+/* bytes taken by the key index of a dict or the item vector of an array */
+uint64_t plist_index_size(plist_data_t data);
+
+/* bytes taken by the child list and the index of a container, the list
+ * is only allocated with the first child */
+uint64_t plist_container_size(plist_t node);
+
+/* default for plist_set_dict_index_threshold() */
+#define PLIST_DICT_INDEX_THRESHOLD_DEFAULT 250
+
+/* Makes the key data share the string of an equal key in the key pool of
+ * its arena. With adopt set, data->strval is arena memory that becomes the
+ * pooled string if the key is new, otherwise it is copied. Returns the pool
+ * entry, or NULL if the arena doesn't intern keys. */
+plist_data_t plist_arena_intern_key(plist_data_t data, int adopt);
+
+/* adds a key index to a dict with more entries than the index threshold */
+void plist_dict_build_index(plist_t node);
+
+/* looks up a dict value by key data, a key with PLIST_DATA_HASHED set is
+ * not hashed again */
+plist_t plist_dict_lookup(plist_t node, plist_data_t key);
+
+/* finds the value of the key node of another dict in the dict node, trying
+ * key_at_pos, the key at the same position, first. The key is not
+ * modified. */
+plist_t plist_dict_find_value(plist_t node, plist_t key, plist_t key_at_pos);
+
+/* arrays with more items get an item vector for O(1) indexed access */
+#define PLIST_ARRAY_INDEX_THRESHOLD 32
+
+/* adds an item vector to an array with more items than
+ * PLIST_ARRAY_INDEX_THRESHOLD */
+void plist_array_build_index(plist_t node);
+
+/* writes the date realval (seconds since 2001-01-01) in the ISO 8601 form
+ * of XML plists to buf (at least 64 bytes), returns the length or 0 */
+size_t plist_format_date(char *buf, double realval);
+
+/* plist_write_func_t writing to the file descriptor user_data points to */
+int plist_write_to_fd(void *user_data, const char *buf, size_t size);
+
+/* lazily parsed containers */
+void plist_bin_load_children(plist_t node);
+void plist_bin_lazy_free(void *lazy);
+
+#define plist_load_children(node) \
+    do { \
+        plist_data_t __lazy_data = plist_get_data(node); \
+        if (__lazy_data && (__lazy_data->flags & PLIST_DATA_LAZY)) \
+            plist_bin_load_children(node); \
+    } while (0)
 
 
 #endif
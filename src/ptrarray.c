@@ -19,11 +19,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 #include "ptrarray.h"
+#include "alloc.h"
+
+#include <string.h>
 
 ptrarray_t *ptr_array_new(int capacity)
 {
-	ptrarray_t *pa = (ptrarray_t*)malloc(sizeof(ptrarray_t));
-	pa->pdata = (void**)malloc(sizeof(void*) * capacity);
+	ptrarray_t *pa = (ptrarray_t*)plist_malloc(sizeof(ptrarray_t));
+	pa->pdata = (void**)plist_malloc(sizeof(void*) * capacity);
 	pa->capacity = capacity;
 	pa->capacity_step = (capacity > 64) ? 64 : capacity;
 	pa->len = 0;
@@ -34,9 +37,21 @@ void ptr_array_free(ptrarray_t *pa)
 {
 	if (!pa) return;
 	if (pa->pdata) {
-		free(pa->pdata);
+		plist_mem_free(pa->pdata);
 	}
-	free(pa);
+	plist_mem_free(pa);
+}
+
+int ptr_array_reserve(ptrarray_t *pa, size_t capacity)
+{
+	void **pdata = NULL;
+	if (!pa || !pa->pdata) return -1;
+	if (capacity <= pa->capacity) return 0;
+	pdata = (void**)plist_realloc(pa->pdata, sizeof(void*) * capacity);
+	if (!pdata) return -1;
+	pa->pdata = pdata;
+	pa->capacity = capacity;
+	return 0;
 }
 
 void ptr_array_add(ptrarray_t *pa, void *data)
@@ -44,13 +59,40 @@ void ptr_array_add(ptrarray_t *pa, void *data)
 	if (!pa || !pa->pdata || !data) return;
 	size_t remaining = pa->capacity-pa->len;
 	if (remaining == 0) {
-		pa->pdata = realloc(pa->pdata, sizeof(void*) * (pa->capacity + pa->capacity_step));
-		pa->capacity += pa->capacity_step;
+		/* grow by half once the array is large, so appending stays
+		 * linear */
+		size_t step = (pa->capacity / 2 > pa->capacity_step) ? pa->capacity / 2 : pa->capacity_step;
+		if (ptr_array_reserve(pa, pa->capacity + step) < 0) return;
 	}
 	pa->pdata[pa->len] = data;
 	pa->len++;
 }
 
+void ptr_array_insert(ptrarray_t *pa, void *data, size_t array_index)
+{
+	if (!pa || !pa->pdata || !data) return;
+	if (array_index >= pa->len) {
+		ptr_array_add(pa, data);
+		return;
+	}
+	ptr_array_add(pa, pa->pdata[pa->len-1]);
+	memmove(&pa->pdata[array_index+1], &pa->pdata[array_index], sizeof(void*) * (pa->len - 2 - array_index));
+	pa->pdata[array_index] = data;
+}
+
+void ptr_array_remove(ptrarray_t *pa, size_t array_index)
+{
+	if (!pa || !pa->pdata || array_index >= pa->len) return;
+	memmove(&pa->pdata[array_index], &pa->pdata[array_index+1], sizeof(void*) * (pa->len - 1 - array_index));
+	pa->len--;
+}
+
+void ptr_array_set(ptrarray_t *pa, void *data, size_t array_index)
+{
+	if (!pa || !pa->pdata || !data || array_index >= pa->len) return;
+	pa->pdata[array_index] = data;
+}
+
 void* ptr_array_index(ptrarray_t *pa, size_t array_index)
 {
 	if (!pa) return NULL;
@@ -31,6 +31,10 @@ typedef struct ptrarray_t {
 
 ptrarray_t *ptr_array_new(int capacity);
 void ptr_array_free(ptrarray_t *pa);
+int ptr_array_reserve(ptrarray_t *pa, size_t capacity);
 void ptr_array_add(ptrarray_t *pa, void *data);
+void ptr_array_insert(ptrarray_t *pa, void *data, size_t index);
+void ptr_array_remove(ptrarray_t *pa, size_t index);
+void ptr_array_set(ptrarray_t *pa, void *data, size_t index);
 void* ptr_array_index(ptrarray_t *pa, size_t index);
 #endif
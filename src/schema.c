@@ -0,0 +1,383 @@
+/*
+ * schema.c
+ * Decoding binary plist dictionaries into C structs and back
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "plist.h"
+#include "alloc.h"
+#include "bytearray.h"
+
+/* schemas with up to this many fields keep track of the keys that were
+ * seen on the stack */
+#define SCHEMA_SEEN_STACK 64
+
+#define FIELD_MEMBER(s, field) ((char*)(s) + (field)->offset)
+
+static size_t schema_count(const plist_field_t *fields)
+{
+    size_t n = 0;
+    while (fields[n].key) {
+        n++;
+    }
+    return n;
+}
+
+/* compares the 0-terminated key of a field with the len bytes of key */
+static int schema_key_equal(const char *field_key, const char *key, uint64_t len)
+{
+    uint64_t i;
+    for (i = 0; i < len; i++) {
+        if (field_key[i] != key[i] || field_key[i] == '\0') {
+            return 0;
+        }
+    }
+    return (field_key[len] == '\0');
+}
+
+/* Returns the index of the field for key, or count if there is none. The
+ * search starts at hint, the field after the previous match, so keys in
+ * schema order are found with one comparison each. */
+static size_t schema_find(const plist_field_t *fields, size_t count, size_t hint, const char *key, uint64_t len)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        size_t n = (hint + i < count) ? hint + i : hint + i - count;
+        if (schema_key_equal(fields[n].key, key, len)) {
+            return n;
+        }
+    }
+    return count;
+}
+
+static int schema_decode_dict(plist_bin_reader_t reader, uint64_t obj, const plist_field_t *fields, void *out, uint32_t depth);
+
+static int schema_decode_value(plist_bin_reader_t reader, uint64_t obj, const plist_field_t *field, void *out, uint32_t depth)
+{
+    char *member = FIELD_MEMBER(out, field);
+    plist_type type = plist_bin_reader_get_type(reader, obj);
+    uint64_t uval = 0;
+    int64_t ival = 0;
+
+    switch (field->type) {
+    case PLIST_FIELD_BOOL:
+        return plist_bin_reader_get_bool(reader, obj, (uint8_t*)member);
+    case PLIST_FIELD_INT32:
+        if (type != PLIST_UINT || plist_bin_reader_get_uint(reader, obj, &uval) < 0) {
+            return -1;
+        }
+        ival = (int64_t)uval;
+        if (ival < INT32_MIN || ival > INT32_MAX) {
+            return -1;
+        }
+        *(int32_t*)member = (int32_t)ival;
+        return 0;
+    case PLIST_FIELD_UINT32:
+        if (type != PLIST_UINT || plist_bin_reader_get_uint(reader, obj, &uval) < 0 || uval > UINT32_MAX) {
+            return -1;
+        }
+        *(uint32_t*)member = (uint32_t)uval;
+        return 0;
+    case PLIST_FIELD_INT64:
+        if (type != PLIST_UINT || plist_bin_reader_get_uint(reader, obj, &uval) < 0) {
+            return -1;
+        }
+        *(int64_t*)member = (int64_t)uval;
+        return 0;
+    case PLIST_FIELD_UINT64:
+        if (type != PLIST_UINT) {
+            return -1;
+        }
+        return plist_bin_reader_get_uint(reader, obj, (uint64_t*)member);
+    case PLIST_FIELD_REAL:
+        if (type != PLIST_REAL) {
+            return -1;
+        }
+        return plist_bin_reader_get_real(reader, obj, (double*)member);
+    case PLIST_FIELD_DATE:
+        if (type != PLIST_DATE) {
+            return -1;
+        }
+        return plist_bin_reader_get_real(reader, obj, (double*)member);
+    case PLIST_FIELD_STRING:
+        return plist_bin_reader_get_string(reader, obj, (char**)member);
+    case PLIST_FIELD_DATA: {
+        plist_field_data_t *data = (plist_field_data_t*)member;
+        return plist_bin_reader_get_data(reader, obj, &data->data, &data->length);
+    }
+    case PLIST_FIELD_UID:
+        if (type != PLIST_UID) {
+            return -1;
+        }
+        return plist_bin_reader_get_uint(reader, obj, (uint64_t*)member);
+    case PLIST_FIELD_STRUCT:
+        if (!field->fields) {
+            return -1;
+        }
+        return schema_decode_dict(reader, obj, field->fields, member, depth + 1);
+    case PLIST_FIELD_NODE:
+        *(plist_t*)member = plist_bin_reader_get_node(reader, obj);
+        return (*(plist_t*)member) ? 0 : -1;
+    default:
+        break;
+    }
+    return -1;
+}
+
+static int schema_decode_dict(plist_bin_reader_t reader, uint64_t obj, const plist_field_t *fields, void *out, uint32_t depth)
+{
+    uint8_t seen_stack[SCHEMA_SEEN_STACK];
+    uint8_t *seen = seen_stack;
+    size_t count = schema_count(fields);
+    size_t hint = 0;
+    uint64_t size = 0;
+    uint64_t i;
+    int res = 0;
+
+    /* the data may contain cycles and a broken schema may refer to itself */
+    if (depth > plist_get_max_depth() || plist_bin_reader_get_type(reader, obj) != PLIST_DICT) {
+        return -1;
+    }
+    if (count > SCHEMA_SEEN_STACK) {
+        seen = (uint8_t*)plist_malloc(count);
+        if (!seen) {
+            return -1;
+        }
+    }
+    memset(seen, 0, count);
+
+    size = plist_bin_reader_get_size(reader, obj);
+    for (i = 0; i < size && res == 0; i++) {
+        uint64_t kobj = 0;
+        uint64_t vobj = 0;
+        const char *key = NULL;
+        char *ukey = NULL;
+        uint64_t keylen = 0;
+        size_t n = count;
+
+        if (plist_bin_reader_dict_key(reader, obj, i, &kobj) < 0) {
+            res = -1;
+            break;
+        }
+        switch (plist_bin_reader_get_raw_string(reader, kobj, &key, &keylen)) {
+        case 0:
+            break;
+        case 1:
+            /* UTF-16 keys are rare, convert them */
+            if (plist_bin_reader_get_string(reader, kobj, &ukey) < 0) {
+                res = -1;
+                continue;
+            }
+            key = ukey;
+            keylen = strlen(ukey);
+            break;
+        default:
+            res = -1;
+            continue;
+        }
+        n = schema_find(fields, count, hint, key, keylen);
+        plist_mem_free(ukey);
+        if (n == count) {
+            /* not in the schema, the value is never looked at */
+            continue;
+        }
+        if (seen[n] || plist_bin_reader_child(reader, obj, i, &vobj) < 0) {
+            res = -1;
+            break;
+        }
+        seen[n] = 1;
+        hint = n + 1;
+        res = schema_decode_value(reader, vobj, &fields[n], out, depth);
+    }
+    for (i = 0; i < count && res == 0; i++) {
+        if ((fields[i].flags & PLIST_FIELD_REQUIRED) && !seen[i]) {
+            res = -1;
+        }
+    }
+
+    if (seen != seen_stack) {
+        plist_mem_free(seen);
+    }
+    return res;
+}
+
+PLIST_API int plist_bin_reader_get_struct(plist_bin_reader_t reader, uint64_t obj, const plist_field_t *fields, void *out)
+{
+    if (!reader || !fields || !out) {
+        return -1;
+    }
+    return schema_decode_dict(reader, obj, fields, out, 1);
+}
+
+PLIST_API int plist_from_bin_struct(const char *plist_bin, uint64_t length, const plist_field_t *fields, void *out)
+{
+    plist_bin_reader_t reader = NULL;
+    int res = 0;
+
+    if (!plist_bin || !fields || !out) {
+        return -1;
+    }
+    reader = plist_bin_reader_open(plist_bin, length);
+    if (!reader) {
+        return -1;
+    }
+    res = plist_bin_reader_get_struct(reader, plist_bin_reader_root(reader), fields, out);
+    plist_bin_reader_free(reader);
+    return res;
+}
+
+static int schema_encode_dict(plist_bin_writer_t writer, const plist_field_t *fields, const void *in, uint32_t depth);
+
+static int schema_encode_value(plist_bin_writer_t writer, const plist_field_t *field, const char *member, uint32_t depth)
+{
+    switch (field->type) {
+    case PLIST_FIELD_BOOL:
+        return plist_bin_writer_add_bool(writer, *(const uint8_t*)member ? 1 : 0);
+    case PLIST_FIELD_INT32:
+        return plist_bin_writer_add_int(writer, *(const int32_t*)member);
+    case PLIST_FIELD_UINT32:
+        return plist_bin_writer_add_uint(writer, *(const uint32_t*)member);
+    case PLIST_FIELD_INT64:
+        return plist_bin_writer_add_int(writer, *(const int64_t*)member);
+    case PLIST_FIELD_UINT64:
+        return plist_bin_writer_add_uint(writer, *(const uint64_t*)member);
+    case PLIST_FIELD_REAL:
+        return plist_bin_writer_add_real(writer, *(const double*)member);
+    case PLIST_FIELD_DATE:
+        return plist_bin_writer_add_date_real(writer, *(const double*)member);
+    case PLIST_FIELD_STRING:
+        return plist_bin_writer_add_string(writer, *(char *const*)member);
+    case PLIST_FIELD_DATA: {
+        const plist_field_data_t *data = (const plist_field_data_t*)member;
+        return plist_bin_writer_add_data(writer, data->data, data->length);
+    }
+    case PLIST_FIELD_UID:
+        return plist_bin_writer_add_uid(writer, *(const uint64_t*)member);
+    case PLIST_FIELD_STRUCT:
+        if (!field->fields) {
+            return -1;
+        }
+        return schema_encode_dict(writer, field->fields, member, depth + 1);
+    case PLIST_FIELD_NODE:
+        return plist_bin_writer_add_node(writer, *(plist_t const*)member);
+    default:
+        break;
+    }
+    return -1;
+}
+
+static int schema_encode_dict(plist_bin_writer_t writer, const plist_field_t *fields, const void *in, uint32_t depth)
+{
+    const plist_field_t *field = NULL;
+
+    if (depth > plist_get_max_depth() || plist_bin_writer_begin_dict(writer) < 0) {
+        return -1;
+    }
+    for (field = fields; field->key; field++) {
+        const char *member = (const char*)in + field->offset;
+        if ((field->type == PLIST_FIELD_STRING || field->type == PLIST_FIELD_NODE) && !*(void *const*)member) {
+            continue;
+        }
+        if (plist_bin_writer_add_key(writer, field->key) < 0 || schema_encode_value(writer, field, member, depth) < 0) {
+            return -1;
+        }
+    }
+    return plist_bin_writer_end(writer);
+}
+
+PLIST_API int plist_bin_writer_add_struct(plist_bin_writer_t writer, const plist_field_t *fields, const void *in)
+{
+    if (!writer || !fields || !in) {
+        return -1;
+    }
+    return schema_encode_dict(writer, fields, in, 1);
+}
+
+static int schema_write_buffer(void *user_data, const char *buf, size_t size)
+{
+    bytearray_t *out = (bytearray_t*)user_data;
+    byte_array_append(out, (void*)buf, size);
+    return (out->data) ? 0 : -1;
+}
+
+PLIST_API int plist_to_bin_struct(const plist_field_t *fields, const void *in, char **plist_bin, uint64_t *length)
+{
+    plist_bin_writer_t writer = NULL;
+    bytearray_t *out = NULL;
+    int res = 0;
+
+    if (!fields || !in || !plist_bin || !length) {
+        return -1;
+    }
+    out = byte_array_new_size(256);
+    if (!out->data) {
+        byte_array_free(out);
+        return -1;
+    }
+    writer = plist_bin_writer_new(schema_write_buffer, out, PLIST_WRITE_DEFAULT);
+    if (!writer) {
+        byte_array_free(out);
+        return -1;
+    }
+    res = plist_bin_writer_add_struct(writer, fields, in);
+    if (res == 0) {
+        res = plist_bin_writer_finish(writer);
+    }
+    plist_bin_writer_free(writer);
+    if (res < 0 || !out->data) {
+        byte_array_free(out);
+        return -1;
+    }
+    *plist_bin = (char*)out->data;
+    *length = out->len;
+    out->data = NULL;
+    byte_array_free(out);
+    return 0;
+}
+
+PLIST_API void plist_struct_free(const plist_field_t *fields, void *s)
+{
+    const plist_field_t *field = NULL;
+
+    if (!fields || !s) {
+        return;
+    }
+    for (field = fields; field->key; field++) {
+        char *member = FIELD_MEMBER(s, field);
+        switch (field->type) {
+        case PLIST_FIELD_STRING:
+            plist_mem_free(*(char**)member);
+            *(char**)member = NULL;
+            break;
+        case PLIST_FIELD_NODE:
+            plist_free(*(plist_t*)member);
+            *(plist_t*)member = NULL;
+            break;
+        case PLIST_FIELD_STRUCT:
+            plist_struct_free(field->fields, member);
+            break;
+        default:
+            break;
+        }
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * stats.c
+ * optional counters for the hot paths
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "plist.h"
+#include "stats.h"
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#ifdef ENABLE_STATS
+
+PLIST_THREAD_LOCAL plist_stats_t plist_stats_tls;
+
+uint64_t plist_stats_clock(void)
+{
+#ifdef WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart / (double)freq.QuadPart * 1e9);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+PLIST_API int plist_stats_get(plist_stats_t *stats)
+{
+    if (!stats) {
+        return -1;
+    }
+    *stats = plist_stats_tls;
+    return 0;
+}
+
+PLIST_API void plist_stats_reset(void)
+{
+    memset(&plist_stats_tls, 0, sizeof(plist_stats_t));
+}
+
+#else
+
+PLIST_API int plist_stats_get(plist_stats_t *stats)
+{
+    if (stats) {
+        memset(stats, 0, sizeof(plist_stats_t));
+    }
+    return -1;
+}
+
+PLIST_API void plist_stats_reset(void)
+{
+}
+
+#endif
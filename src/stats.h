@@ -0,0 +1,56 @@
+/*
+ * stats.h
+ * optional counters for the hot paths, see plist_stats_get
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "plist/plist.h"
+
+#ifdef ENABLE_STATS
+
+#ifdef _MSC_VER
+#define PLIST_THREAD_LOCAL __declspec(thread)
+#else
+#define PLIST_THREAD_LOCAL __thread
+#endif
+
+extern PLIST_THREAD_LOCAL plist_stats_t plist_stats_tls;
+
+uint64_t plist_stats_clock(void);
+
+#define PLIST_STAT_ADD(field, n) (plist_stats_tls.field += (n))
+#define PLIST_STAT_MAX(field, n) do { if ((uint64_t)(n) > plist_stats_tls.field) plist_stats_tls.field = (n); } while (0)
+/* declares the timer variable t, so it has to be used where declarations
+ * are allowed */
+#define PLIST_STAT_TIMER_START(t) uint64_t t = plist_stats_clock()
+#define PLIST_STAT_TIMER_STOP(field, t) (plist_stats_tls.field += plist_stats_clock() - (t))
+
+#else
+
+#define PLIST_STAT_ADD(field, n) do { } while (0)
+#define PLIST_STAT_MAX(field, n) do { } while (0)
+#define PLIST_STAT_TIMER_START(t)
+#define PLIST_STAT_TIMER_STOP(field, t) do { } while (0)
+
+#endif
+
+#endif
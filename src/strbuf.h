@@ -27,8 +27,10 @@
 typedef struct bytearray_t strbuf_t;
 
 #define str_buf_new() byte_array_new()
+#define str_buf_new_stream(__sz, __fn, __ctx) byte_array_new_stream(__sz, __fn, __ctx)
 #define str_buf_free(__ba) byte_array_free(__ba)
 #define str_buf_grow(__ba, __am) byte_array_grow(__ba, __am)
 #define str_buf_append(__ba, __str, __len) byte_array_append(__ba, (void*)(__str), __len)
+#define str_buf_flush(__ba) byte_array_flush(__ba)
 
 #endif
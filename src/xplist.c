@@ -37,15 +37,27 @@
 
 #include <inttypes.h>
 #include <math.h>
+#include <errno.h>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <node.h>
 #include <node_list.h>
-#include <node_iterator.h>
 
 #include "plist.h"
 #include "base64.h"
+#include "numparse.h"
 #include "strbuf.h"
+#include "alloc.h"
 #include "time64.h"
+#include "stats.h"
 
 #define XPLIST_KEY	"key"
 #define XPLIST_KEY_LEN 3
@@ -67,13 +79,15 @@
 #define XPLIST_ARRAY_LEN 5
 #define XPLIST_DICT	"dict"
 #define XPLIST_DICT_LEN 4
+#define XPLIST_PLIST	"plist"
+#define XPLIST_PLIST_LEN 5
 
 #define MAC_EPOCH 978307200
 
-static const char XML_PLIST_PROLOG[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n\
-<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n\
-<plist version=\"1.0\">\n";
-static const char XML_PLIST_EPILOG[] = "</plist>\n";
+static const char XML_PLIST_DECLARATION[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>";
+static const char XML_PLIST_DOCTYPE[] = "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">";
+static const char XML_PLIST_PROLOG[] = "<plist version=\"1.0\">";
+static const char XML_PLIST_EPILOG[] = "</plist>";
 
 #ifdef DEBUG
 static int plist_xml_debug = 0;
@@ -106,12 +120,17 @@ static size_t dtostr(char *buf, size_t bufsize, double realval)
     size_t len;
     size_t p;
 
-    f = modf(f, &ip);
-    len = snprintf(buf, bufsize, "%s%"PRIi64, ((f < 0) && (ip >= 0)) ? "-" : "", (int64_t)ip);
-    if (len >= bufsize) {
+    if (bufsize < 32) {
         return 0;
     }
 
+    f = modf(f, &ip);
+    len = 0;
+    if ((f < 0) && (ip >= 0)) {
+        buf[len++] = '-';
+    }
+    len += i64tostr(buf + len, (int64_t)ip);
+
     if (f < 0) {
         f *= -1;
     }
@@ -129,7 +148,207 @@ static size_t dtostr(char *buf, size_t bufsize, double realval)
     return p;
 }
 
-static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
+/* returns the offset of the first '<', '>' or '&' in str, or len */
+static size_t find_xml_special(const char *str, size_t len)
+{
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i amp = _mm_set1_epi8('&');
+    while (len - i >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, gt)), _mm_cmpeq_epi8(v, amp));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(m);
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+#endif
+    for (; i < len; i++) {
+        if (str[i] == '<' || str[i] == '>' || str[i] == '&') {
+            break;
+        }
+    }
+    return i;
+}
+
+static void put_2digits(char *buf, int val)
+{
+    buf[0] = (char)('0' + val / 10);
+    buf[1] = (char)('0' + val % 10);
+}
+
+/* days since 1970-01-01 of a date in the proleptic Gregorian calendar,
+ * month is 1 to 12, days past the end of the month carry over */
+static int64_t days_from_civil(int64_t year, unsigned int month, unsigned int day)
+{
+    int64_t era = 0;
+    unsigned int yoe = 0;
+    unsigned int doy = 0;
+    unsigned int doe = 0;
+
+    year -= (month <= 2);
+    era = (year >= 0 ? year : year - 399) / 400;
+    yoe = (unsigned int)(year - era * 400);
+    doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+/* the inverse of days_from_civil */
+static void civil_from_days(int64_t days, int64_t *year, unsigned int *month, unsigned int *day)
+{
+    int64_t era = 0;
+    unsigned int doe = 0;
+    unsigned int yoe = 0;
+    unsigned int doy = 0;
+    unsigned int mp = 0;
+
+    days += 719468;
+    era = (days >= 0 ? days : days - 146096) / 146097;
+    doe = (unsigned int)(days - era * 146097);
+    yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    mp = (5 * doy + 2) / 153;
+    *day = doy - (153 * mp + 2) / 5 + 1;
+    *month = (mp < 10) ? mp + 3 : mp - 9;
+    *year = (int64_t)yoe + era * 400 + (*month <= 2);
+}
+
+/* 1000-01-01T00:00:00Z and 9999-12-31T23:59:59Z in seconds since 1970 */
+#define DATE_FAST_MIN -30610224000LL
+#define DATE_FAST_MAX 253402300799LL
+
+/* formats timev (seconds since 1970) as YYYY-MM-DDTHH:MM:SSZ into buf (at
+ * least 20 bytes). Returns 0 if the year doesn't have four digits, those
+ * dates go through gmtime64_r() and format_date(). */
+static size_t format_date_fast(char *buf, int64_t timev)
+{
+    int64_t days = 0;
+    int64_t secs = 0;
+    int64_t year = 0;
+    unsigned int month = 0;
+    unsigned int day = 0;
+
+    if (timev < DATE_FAST_MIN || timev > DATE_FAST_MAX) {
+        return 0;
+    }
+    days = timev / 86400;
+    secs = timev % 86400;
+    if (secs < 0) {
+        secs += 86400;
+        days--;
+    }
+    civil_from_days(days, &year, &month, &day);
+
+    put_2digits(buf, (int)(year / 100));
+    put_2digits(buf + 2, (int)(year % 100));
+    buf[4] = '-';
+    put_2digits(buf + 5, month);
+    buf[7] = '-';
+    put_2digits(buf + 8, day);
+    buf[10] = 'T';
+    put_2digits(buf + 11, (int)(secs / 3600));
+    buf[13] = ':';
+    put_2digits(buf + 14, (int)(secs / 60 % 60));
+    buf[16] = ':';
+    put_2digits(buf + 17, (int)(secs % 60));
+    buf[19] = 'Z';
+    return 20;
+}
+
+/* formats btime as %Y-%m-%dT%H:%M:%SZ into buf (at least 40 bytes) */
+static size_t format_date(char *buf, const struct TM *btime)
+{
+    size_t len = i64tostr(buf, (int64_t)btime->tm_year + 1900);
+    buf[len++] = '-';
+    put_2digits(buf + len, btime->tm_mon + 1);
+    len += 2;
+    buf[len++] = '-';
+    put_2digits(buf + len, btime->tm_mday);
+    len += 2;
+    buf[len++] = 'T';
+    put_2digits(buf + len, btime->tm_hour);
+    len += 2;
+    buf[len++] = ':';
+    put_2digits(buf + len, btime->tm_min);
+    len += 2;
+    buf[len++] = ':';
+    put_2digits(buf + len, btime->tm_sec);
+    len += 2;
+    buf[len++] = 'Z';
+    return len;
+}
+
+size_t plist_format_date(char *buf, double realval)
+{
+    Time64_T timev = (Time64_T)realval + MAC_EPOCH;
+    size_t len = format_date_fast(buf, timev);
+    if (len == 0) {
+        struct TM _btime;
+        struct TM *btime = gmtime64_r(&timev, &_btime);
+        if (btime) {
+            len = format_date(buf, btime);
+        }
+    }
+    return len;
+}
+
+/* how plist_to_xml_ex() lays out the output */
+struct xml_format {
+    const char *indent;	/* a run of the indentation character */
+    size_t indent_len;	/* characters per level, 0 for no indentation */
+    int newlines;	/* put every element on its own line */
+    int wrap_data;	/* wrap base64 data into indented lines */
+    int header;	/* start with the XML declaration and DOCTYPE */
+};
+
+static const char xml_tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+static const char xml_spaces[] = "                                                                ";
+
+static const struct xml_format xml_format_default = { xml_tabs, 1, 1, 1, 1 };
+
+static void xml_format_init(struct xml_format *fmt, uint32_t options)
+{
+    uint32_t spaces = (options >> 8) & 0xF;
+    *fmt = xml_format_default;
+    if (options & PLIST_XML_COMPACT) {
+        fmt->indent_len = 0;
+        fmt->newlines = 0;
+        fmt->wrap_data = 0;
+    } else if (spaces > 0) {
+        fmt->indent = xml_spaces;
+        fmt->indent_len = spaces;
+    }
+    if (options & PLIST_XML_NO_HEADER) {
+        fmt->header = 0;
+    }
+}
+
+static void xml_indent(bytearray_t *outbuf, const struct xml_format *fmt, uint32_t depth)
+{
+    size_t n = depth * fmt->indent_len;
+    size_t max = (fmt->indent == xml_tabs) ? sizeof(xml_tabs) - 1 : sizeof(xml_spaces) - 1;
+    while (n > 0) {
+        size_t count = (n < max) ? n : max;
+        str_buf_append(outbuf, fmt->indent, count);
+        n -= count;
+    }
+}
+
+static void xml_newline(bytearray_t *outbuf, const struct xml_format *fmt)
+{
+    if (fmt->newlines) {
+        str_buf_append(outbuf, "\n", 1);
+    }
+}
+
+/* writes a scalar node, or the opening tag of a structured node in which
+ * case 1 is returned and node_to_xml_end has to be called after the children
+ * have been written */
+static int node_to_xml_begin(node_t* node, bytearray_t **outbuf, const struct xml_format *fmt, uint32_t depth)
 {
     plist_data_t node_data = NULL;
 
@@ -140,13 +359,10 @@ static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
     size_t tag_len = 0;
     char *val = NULL;
     size_t val_len = 0;
-
-    uint32_t i = 0;
-
-    if (!node)
-        return;
+    char valbuf[64];
 
     node_data = plist_get_data(node);
+    plist_load_children(node);
 
     switch (node_data->type)
     {
@@ -165,19 +381,19 @@ static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
     case PLIST_UINT:
         tag = XPLIST_INT;
         tag_len = XPLIST_INT_LEN;
-        val = (char*)malloc(64);
+        val = valbuf;
         if (node_data->length == 16) {
-            val_len = snprintf(val, 64, "%"PRIu64, node_data->intval);
+            val_len = u64tostr(val, node_data->intval);
         } else {
-            val_len = snprintf(val, 64, "%"PRIi64, node_data->intval);
+            val_len = i64tostr(val, (int64_t)node_data->intval);
         }
         break;
 
     case PLIST_REAL:
         tag = XPLIST_REAL;
         tag_len = XPLIST_REAL_LEN;
-        val = (char*)malloc(64);
-        val_len = dtostr(val, 64, node_data->realval);
+        val = valbuf;
+        val_len = dtostr(val, sizeof(valbuf), node_data->realval);
         break;
 
     case PLIST_STRING:
@@ -210,131 +426,130 @@ static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
     case PLIST_DATE:
         tag = XPLIST_DATE;
         tag_len = XPLIST_DATE_LEN;
-        {
-            Time64_T timev = (Time64_T)node_data->realval + MAC_EPOCH;
-            struct TM _btime;
-            struct TM *btime = gmtime64_r(&timev, &_btime);
-            if (btime) {
-                val = (char*)malloc(24);
-                memset(val, 0, 24);
-                struct tm _tmcopy;
-                copy_TM64_to_tm(btime, &_tmcopy);
-                val_len = strftime(val, 24, "%Y-%m-%dT%H:%M:%SZ", &_tmcopy);
-                if (val_len <= 0) {
-                    free (val);
-                    val = NULL;
-                }
-            }
+        val_len = plist_format_date(valbuf, node_data->realval);
+        if (val_len > 0) {
+            val = valbuf;
         }
         break;
     case PLIST_UID:
         tag = XPLIST_DICT;
         tag_len = XPLIST_DICT_LEN;
-        val = (char*)malloc(64);
+        val = valbuf;
         if (node_data->length == 16) {
-            val_len = snprintf(val, 64, "%"PRIu64, node_data->intval);
+            val_len = u64tostr(val, node_data->intval);
         } else {
-            val_len = snprintf(val, 64, "%"PRIi64, node_data->intval);
+            val_len = i64tostr(val, (int64_t)node_data->intval);
         }
         break;
     default:
         break;
     }
 
-    for (i = 0; i < depth; i++) {
-        str_buf_append(*outbuf, "\t", 1);
-    }
+    xml_indent(*outbuf, fmt, depth);
 
     /* append tag */
     str_buf_append(*outbuf, "<", 1);
     str_buf_append(*outbuf, tag, tag_len);
     if (node_data->type == PLIST_STRING || node_data->type == PLIST_KEY) {
-        size_t j;
-        size_t len;
-        off_t start = 0;
-        off_t cur = 0;
+        size_t start = 0;
+        size_t len = node_data->length;
 
         str_buf_append(*outbuf, ">", 1);
         tagOpen = TRUE;
 
         /* make sure we convert the following predefined xml entities */
         /* < = &lt; > = &gt; & = &amp; */
-        len = node_data->length;
-        for (j = 0; j < len; j++) {
-            switch (node_data->strval[j]) {
+        while (start < len) {
+            size_t cur = start + find_xml_special(node_data->strval + start, len - start);
+            str_buf_append(*outbuf, node_data->strval + start, cur - start);
+            if (cur >= len) {
+                break;
+            }
+            switch (node_data->strval[cur]) {
             case '<':
-                str_buf_append(*outbuf, node_data->strval + start, cur - start);
                 str_buf_append(*outbuf, "&lt;", 4);
-                start = cur+1;
                 break;
             case '>':
-                str_buf_append(*outbuf, node_data->strval + start, cur - start);
                 str_buf_append(*outbuf, "&gt;", 4);
-                start = cur+1;
-                break;
-            case '&':
-                str_buf_append(*outbuf, node_data->strval + start, cur - start);
-                str_buf_append(*outbuf, "&amp;", 5);
-                start = cur+1;
                 break;
             default:
+                str_buf_append(*outbuf, "&amp;", 5);
                 break;
             }
-            cur++;
+            start = cur+1;
         }
-        str_buf_append(*outbuf, node_data->strval + start, cur - start);
     } else if (node_data->type == PLIST_DATA) {
         str_buf_append(*outbuf, ">", 1);
         tagOpen = TRUE;
-        str_buf_append(*outbuf, "\n", 1);
-        if (node_data->length > 0) {
-            char *buf = malloc(80);
-            uint32_t j = 0;
-            uint32_t indent = (depth > 8) ? 8 : depth;
-            uint32_t maxread = ((76 - indent*8) / 4) * 3;
-            size_t count = 0;
-            size_t b64count = 0;
-            str_buf_grow(*outbuf, (node_data->length / 3 * 4) + 4 + (((node_data->length / maxread) + 1) * (indent+1)));
-            while (j < node_data->length) {
-                for (i = 0; i < indent; i++) {
-                    str_buf_append(*outbuf, "\t", 1);
+        if (!fmt->wrap_data) {
+            if (node_data->length > 0) {
+                char buf[4096];
+                uint64_t j = 0;
+                /* a multiple of 3 bytes, so the chunks concatenate */
+                size_t chunk = ((sizeof(buf) - 1) / 4) * 3;
+                size_t count = 0;
+                size_t b64size = ((node_data->length + 2) / 3) * 4;
+                if (b64size > (*outbuf)->capacity - (*outbuf)->len) {
+                    str_buf_grow(*outbuf, b64size - ((*outbuf)->capacity - (*outbuf)->len));
+                }
+                while (j < node_data->length) {
+                    count = (node_data->length-j < chunk) ? node_data->length-j : chunk;
+                    str_buf_append(*outbuf, buf, base64encode(buf, node_data->buff + j, count));
+                    j+=count;
                 }
-                count = (node_data->length-j < maxread) ? node_data->length-j : maxread;
-                b64count = base64encode(buf, node_data->buff + j, count);
-                str_buf_append(*outbuf, buf, b64count);
-                str_buf_append(*outbuf, "\n", 1);
-                j+=count;
             }
-            free(buf);
-        }
-        for (i = 0; i < depth; i++) {
-            str_buf_append(*outbuf, "\t", 1);
+        } else {
+            str_buf_append(*outbuf, "\n", 1);
+            if (node_data->length > 0) {
+                char buf[4096];
+                uint64_t j = 0;
+                /* lines are at most 76 columns with tabs counted as 8 */
+                uint32_t cols = (fmt->indent == xml_tabs) ? depth * 8 : depth * (uint32_t)fmt->indent_len;
+                uint32_t indent = 0;
+                uint32_t maxread = 0;
+                size_t chunk = 0;
+                size_t count = 0;
+                size_t b64count = 0;
+                size_t b64size = 0;
+                if (cols > 64) {
+                    cols = 64;
+                }
+                indent = (fmt->indent == xml_tabs) ? cols / 8 : cols;
+                maxread = ((76 - cols) / 4) * 3;
+                /* encode as many complete lines at once as fit into buf */
+                chunk = (sizeof(buf) / base64encode_wrapped_size(maxread, maxread, indent)) * maxread;
+                b64size = base64encode_wrapped_size(node_data->length, maxread, indent);
+                if (b64size > (*outbuf)->capacity - (*outbuf)->len) {
+                    str_buf_grow(*outbuf, b64size - ((*outbuf)->capacity - (*outbuf)->len));
+                }
+                while (j < node_data->length) {
+                    count = (node_data->length-j < chunk) ? node_data->length-j : chunk;
+                    b64count = base64encode_wrapped(buf, node_data->buff + j, count, maxread, fmt->indent[0], indent);
+                    str_buf_append(*outbuf, buf, b64count);
+                    j+=count;
+                }
+            }
+            xml_indent(*outbuf, fmt, depth);
         }
     } else if (node_data->type == PLIST_UID) {
         /* special case for UID nodes: create a DICT */
         str_buf_append(*outbuf, ">", 1);
         tagOpen = TRUE;
-        str_buf_append(*outbuf, "\n", 1);
+        xml_newline(*outbuf, fmt);
 
         /* add CF$UID key */
-        for (i = 0; i < depth+1; i++) {
-            str_buf_append(*outbuf, "\t", 1);
-        }
+        xml_indent(*outbuf, fmt, depth+1);
         str_buf_append(*outbuf, "<key>CF$UID</key>", 17);
-        str_buf_append(*outbuf, "\n", 1);
+        xml_newline(*outbuf, fmt);
 
         /* add UID value */
-        for (i = 0; i < depth+1; i++) {
-            str_buf_append(*outbuf, "\t", 1);
-        }
+        xml_indent(*outbuf, fmt, depth+1);
         str_buf_append(*outbuf, "<integer>", 9);
         str_buf_append(*outbuf, val, val_len);
         str_buf_append(*outbuf, "</integer>", 10);
-        str_buf_append(*outbuf, "\n", 1);
+        xml_newline(*outbuf, fmt);
 
-        for (i = 0; i < depth; i++) {
-            str_buf_append(*outbuf, "\t", 1);
-        }
+        xml_indent(*outbuf, fmt, depth);
     } else if (val) {
         str_buf_append(*outbuf, ">", 1);
         tagOpen = TRUE;
@@ -346,26 +561,10 @@ static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
         tagOpen = FALSE;
         str_buf_append(*outbuf, "/>", 2);
     }
-    free(val);
-
     /* add return for structured types */
-    if (node_data->type == PLIST_ARRAY || node_data->type == PLIST_DICT)
-        str_buf_append(*outbuf, "\n", 1);
-
     if (isStruct) {
-        node_iterator_t *ni = node_iterator_create(node->children);
-        node_t *ch;
-        while ((ch = node_iterator_next(ni))) {
-            node_to_xml(ch, outbuf, depth+1);
-        }
-        node_iterator_destroy(ni);
-    }
-
-    /* fix indent for structured types */
-    if (node_data->type == PLIST_ARRAY || node_data->type == PLIST_DICT) {
-        for (i = 0; i < depth; i++) {
-            str_buf_append(*outbuf, "\t", 1);
-        }
+        xml_newline(*outbuf, fmt);
+        return 1;
     }
 
     if (tagOpen) {
@@ -374,9 +573,82 @@ static void node_to_xml(node_t* node, bytearray_t **outbuf, uint32_t depth)
         str_buf_append(*outbuf, tag, tag_len);
         str_buf_append(*outbuf, ">", 1);
     }
-    str_buf_append(*outbuf, "\n", 1);
+    xml_newline(*outbuf, fmt);
+
+    return 0;
+}
+
+/* writes the closing tag of a structured node */
+static void node_to_xml_end(node_t* node, bytearray_t **outbuf, const struct xml_format *fmt, uint32_t depth)
+{
+    xml_indent(*outbuf, fmt, depth);
+    if (plist_get_data(node)->type == PLIST_DICT) {
+        str_buf_append(*outbuf, "</" XPLIST_DICT ">", XPLIST_DICT_LEN + 3);
+    } else {
+        str_buf_append(*outbuf, "</" XPLIST_ARRAY ">", XPLIST_ARRAY_LEN + 3);
+    }
+    xml_newline(*outbuf, fmt);
+}
+
+/* walks the tree without recursion, using the parent pointers to climb up */
+static void node_to_xml(node_t* root, bytearray_t **outbuf, const struct xml_format *fmt)
+{
+    node_t *node = root;
+    uint32_t depth = 0;
+
+    if (!root)
+        return;
+
+    while (node) {
+        if (node_to_xml_begin(node, outbuf, fmt, depth)) {
+            node_t *ch = node_first_child(node);
+            if (ch) {
+                node = ch;
+                depth++;
+                continue;
+            }
+            node_to_xml_end(node, outbuf, fmt, depth);
+        }
+        while (node != root && !node_next_sibling(node)) {
+            node = node->parent;
+            depth--;
+            node_to_xml_end(node, outbuf, fmt, depth);
+        }
+        node = (node == root) ? NULL : node_next_sibling(node);
+    }
+}
+
+/* parses a date in the exact form YYYY-MM-DDTHH:MM:SSZ that plist writers
+ * produce, returns 0 on success and -1 if the generic parser is needed */
+static int parse_date_fast(const char *strval, size_t length, Time64_T *timev)
+{
+    static const char pattern[] = "0000-00-00T00:00:00Z";
+    unsigned int month = 0;
+    size_t i = 0;
 
-    return;
+    if (length != sizeof(pattern) - 1) {
+        return -1;
+    }
+    for (i = 0; i < length; i++) {
+        if (pattern[i] == '0') {
+            if ((unsigned char)(strval[i] - '0') > 9) {
+                return -1;
+            }
+        } else if (strval[i] != pattern[i]) {
+            return -1;
+        }
+    }
+#define DATE_DIGITS2(p) (((p)[0] - '0') * 10 + ((p)[1] - '0'))
+    month = DATE_DIGITS2(strval + 5);
+    if (month < 1 || month > 12) {
+        return -1;
+    }
+    /* days, hours, minutes and seconds out of range carry over like with
+     * timegm() */
+    *timev = days_from_civil(DATE_DIGITS2(strval) * 100 + DATE_DIGITS2(strval + 2), month, DATE_DIGITS2(strval + 8)) * 86400
+        + DATE_DIGITS2(strval + 11) * 3600 + DATE_DIGITS2(strval + 14) * 60 + DATE_DIGITS2(strval + 17);
+#undef DATE_DIGITS2
+    return 0;
 }
 
 static void parse_date(const char *strval, struct TM *btime)
@@ -399,32 +671,180 @@ static void parse_date(const char *strval, struct TM *btime)
     btime->tm_isdst=0;
 }
 
-PLIST_API void plist_to_xml(plist_t plist, char **plist_xml, uint32_t * length)
+/* parses dates that are not in the form parse_date_fast() handles */
+static Time64_T parse_date_generic(const char *str_content, size_t length)
+{
+    if ((length >= 11) && (length < 32)) {
+        /* we need to copy here and 0-terminate because sscanf will read the entire string (whole rest of XML data) which can be huge */
+        char strval[32];
+        struct TM btime;
+        strncpy(strval, str_content, length);
+        strval[length] = '\0';
+        parse_date(strval, &btime);
+        return timegm64(&btime);
+    }
+    PLIST_XML_ERR("Invalid text content in date node\n");
+    return 0;
+}
+
+/* writes the whole document: header, plist element and the tree */
+static void xml_write_document(plist_t plist, bytearray_t **outbuf, const struct xml_format *fmt)
 {
-    strbuf_t *outbuf = str_buf_new();
+    if (fmt->header) {
+        str_buf_append(*outbuf, XML_PLIST_DECLARATION, sizeof(XML_PLIST_DECLARATION)-1);
+        xml_newline(*outbuf, fmt);
+        str_buf_append(*outbuf, XML_PLIST_DOCTYPE, sizeof(XML_PLIST_DOCTYPE)-1);
+        xml_newline(*outbuf, fmt);
+    }
+    str_buf_append(*outbuf, XML_PLIST_PROLOG, sizeof(XML_PLIST_PROLOG)-1);
+    xml_newline(*outbuf, fmt);
+
+    node_to_xml(plist, outbuf, fmt);
 
-    str_buf_append(outbuf, XML_PLIST_PROLOG, sizeof(XML_PLIST_PROLOG)-1);
+    str_buf_append(*outbuf, XML_PLIST_EPILOG, sizeof(XML_PLIST_EPILOG)-1);
+    xml_newline(*outbuf, fmt);
+}
+
+PLIST_API void plist_to_xml(plist_t plist, char **plist_xml, uint32_t * length)
+{
+    plist_to_xml_ex(plist, PLIST_XML_DEFAULT, plist_xml, length);
+}
 
-    node_to_xml(plist, &outbuf, 0);
+PLIST_API int plist_to_xml64(plist_t plist, uint32_t options, char **plist_xml, uint64_t * length)
+{
+    PLIST_STAT_TIMER_START(write_start);
+    strbuf_t *outbuf = NULL;
+    struct xml_format fmt;
 
-    str_buf_append(outbuf, XML_PLIST_EPILOG, sizeof(XML_PLIST_EPILOG));
+    if (!plist_xml || !length) {
+        return -1;
+    }
+    outbuf = str_buf_new();
+    xml_format_init(&fmt, options);
+    xml_write_document(plist, &outbuf, &fmt);
+    str_buf_append(outbuf, "", 1);
 
     *plist_xml = outbuf->data;
     *length = outbuf->len - 1;
 
     outbuf->data = NULL;
     str_buf_free(outbuf);
+    PLIST_STAT_TIMER_STOP(xml_write_time, write_start);
+    return (*plist_xml) ? 0 : -1;
+}
+
+PLIST_API void plist_to_xml_ex(plist_t plist, uint32_t options, char **plist_xml, uint32_t * length)
+{
+    uint64_t len = 0;
+    if (!plist_xml || !length) {
+        return;
+    }
+    plist_to_xml64(plist, options, plist_xml, &len);
+    /* fail instead of returning a truncated length */
+    if (len > UINT32_MAX) {
+        plist_mem_free(*plist_xml);
+        *plist_xml = NULL;
+        len = 0;
+    }
+    *length = (uint32_t)len;
+}
+
+/* size of the output buffer used by plist_to_xml_stream */
+#define XPLIST_STREAM_BUFSIZE 65536
+
+PLIST_API int plist_to_xml_stream(plist_t plist, plist_write_func_t writer, void *user_data)
+{
+    strbuf_t *outbuf = NULL;
+    int res = 0;
+
+    if (!plist || !writer) {
+        return -1;
+    }
+    outbuf = str_buf_new_stream(XPLIST_STREAM_BUFSIZE, writer, user_data);
+    if (!outbuf || !outbuf->data) {
+        str_buf_free(outbuf);
+        return -1;
+    }
+
+    xml_write_document(plist, &outbuf, &xml_format_default);
+    str_buf_flush(outbuf);
+
+    res = (outbuf->error) ? -1 : 0;
+    str_buf_free(outbuf);
+    return res;
+}
+
+static int write_to_file(void *user_data, const char *buf, size_t size)
+{
+    return (fwrite(buf, 1, size, (FILE*)user_data) == size) ? 0 : -1;
+}
+
+PLIST_API int plist_to_xml_file(plist_t plist, FILE *file)
+{
+    if (!file) {
+        return -1;
+    }
+    return plist_to_xml_stream(plist, write_to_file, file);
+}
+
+int plist_write_to_fd(void *user_data, const char *buf, size_t size)
+{
+    int fd = *(int*)user_data;
+    while (size > 0) {
+#ifdef WIN32
+        int written = _write(fd, buf, (unsigned int)size);
+#else
+        ssize_t written = write(fd, buf, size);
+#endif
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += written;
+        size -= written;
+    }
+    return 0;
+}
+
+PLIST_API int plist_to_xml_fd(plist_t plist, int fd)
+{
+    if (fd < 0) {
+        return -1;
+    }
+    return plist_to_xml_stream(plist, plist_write_to_fd, &fd);
 }
 
 struct _parse_ctx {
     const char *pos;
     const char *end;
     int err;
+    plist_arena_t arena;
+    /* resources used so far, if the parse has limits */
+    struct plist_limits_s *limits;
 };
 typedef struct _parse_ctx* parse_ctx;
 
 static void parse_skip_ws(parse_ctx ctx)
 {
+#ifdef __SSE2__
+    /* check 16 bytes at a time for the first non-whitespace character */
+    const __m128i sp = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    while (ctx->end - ctx->pos >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)ctx->pos);
+        __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)),
+                                  _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)));
+        unsigned int mask = ~(unsigned int)_mm_movemask_epi8(ws) & 0xFFFF;
+        if (mask) {
+            ctx->pos += __builtin_ctz(mask);
+            return;
+        }
+        ctx->pos += 16;
+    }
+#endif
     while (ctx->pos < ctx->end && ((*(ctx->pos) == ' ') || (*(ctx->pos) == '\t') || (*(ctx->pos) == '\r') || (*(ctx->pos) == '\n'))) {
         ctx->pos++;
     }
@@ -432,6 +852,12 @@ static void parse_skip_ws(parse_ctx ctx)
 
 static void find_char(parse_ctx ctx, char c, int skip_quotes)
 {
+    if (!skip_quotes || c == '"') {
+        /* memchr is vectorized by the C library */
+        const char *p = (ctx->pos < ctx->end) ? memchr(ctx->pos, c, ctx->end - ctx->pos) : NULL;
+        ctx->pos = (p) ? p : ((ctx->pos < ctx->end) ? ctx->end : ctx->pos);
+        return;
+    }
     while (ctx->pos < ctx->end && (*(ctx->pos) != c)) {
         if (skip_quotes && (c != '"') && (*(ctx->pos) == '"')) {
             ctx->pos++;
@@ -451,6 +877,22 @@ static void find_char(parse_ctx ctx, char c, int skip_quotes)
 
 static void find_str(parse_ctx ctx, const char *str, size_t len, int skip_quotes)
 {
+    if (!skip_quotes) {
+        /* jump to candidates for the first character */
+        while (ctx->pos < (ctx->end - len)) {
+            const char *p = memchr(ctx->pos, str[0], (ctx->end - len) - ctx->pos);
+            if (!p) {
+                ctx->pos = ctx->end - len;
+                return;
+            }
+            ctx->pos = p;
+            if (!memcmp(ctx->pos, str, len)) {
+                return;
+            }
+            ctx->pos++;
+        }
+        return;
+    }
     while (ctx->pos < (ctx->end - len)) {
         if (!strncmp(ctx->pos, str, len)) {
             break;
@@ -474,6 +916,12 @@ static void find_str(parse_ctx ctx, const char *str, size_t len, int skip_quotes
 static void find_next(parse_ctx ctx, const char *nextchars, int numchars, int skip_quotes)
 {
     int i = 0;
+    /* bitmap of the characters to stop at, so each byte is tested once */
+    uint8_t stop[32];
+    memset(stop, '\0', sizeof(stop));
+    for (i = 0; i < numchars; i++) {
+        stop[(uint8_t)nextchars[i] >> 3] |= 1 << ((uint8_t)nextchars[i] & 7);
+    }
     while (ctx->pos < ctx->end) {
         if (skip_quotes && (*(ctx->pos) == '"')) {
             ctx->pos++;
@@ -487,10 +935,9 @@ static void find_next(parse_ctx ctx, const char *nextchars, int numchars, int sk
                 return;
             }
         }
-        for (i = 0; i < numchars; i++) {
-            if (*(ctx->pos) == nextchars[i]) {
-                return;
-            }
+        uint8_t c = (uint8_t)*(ctx->pos);
+        if (stop[c >> 3] & (1 << (c & 7))) {
+            return;
         }
         ctx->pos++;
     }
@@ -500,40 +947,62 @@ typedef struct {
     const char *begin;
     size_t length;
     int is_cdata;
-    void *next;
 } text_part_t;
 
-static text_part_t* text_part_init(text_part_t* part, const char *begin, size_t length, int is_cdata)
+/* the text and CDATA segments of an element. More than a few of them only
+ * occur with comments or CDATA sections in between, so the first ones are
+ * kept in place. */
+#define TEXT_PARTS_INLINE 4
+
+typedef struct {
+    text_part_t *parts;
+    size_t count;
+    size_t capacity;
+    text_part_t inline_parts[TEXT_PARTS_INLINE];
+} text_parts_t;
+
+static void text_parts_init(text_parts_t *tp)
 {
-    part->begin = begin;
-    part->length = length;
-    part->is_cdata = is_cdata;
-    part->next = NULL;
-    return part;
+    tp->parts = tp->inline_parts;
+    tp->count = 0;
+    tp->capacity = TEXT_PARTS_INLINE;
 }
 
-static void text_parts_free(text_part_t *tp)
+static void text_parts_free(text_parts_t *tp)
 {
-    while (tp) {
-        text_part_t *tmp = tp;
-        tp = tp->next;
-        free(tmp);
+    if (tp->parts != tp->inline_parts) {
+        plist_mem_free(tp->parts);
     }
+    text_parts_init(tp);
 }
 
-static text_part_t* text_part_append(text_part_t* parts, const char *begin, size_t length, int is_cdata)
+static void text_parts_add(text_parts_t *tp, const char *begin, size_t length, int is_cdata)
 {
-    text_part_t* newpart = malloc(sizeof(text_part_t));
-    assert(newpart);
-    parts->next = text_part_init(newpart, begin, length, is_cdata);
-    return newpart;
+    if (!tp) {
+        return;
+    }
+    if (tp->count == tp->capacity) {
+        text_part_t *parts = (text_part_t*)plist_malloc(tp->capacity * 2 * sizeof(text_part_t));
+        assert(parts);
+        memcpy(parts, tp->parts, tp->count * sizeof(text_part_t));
+        if (tp->parts != tp->inline_parts) {
+            plist_mem_free(tp->parts);
+        }
+        tp->parts = parts;
+        tp->capacity *= 2;
+    }
+    tp->parts[tp->count].begin = begin;
+    tp->parts[tp->count].length = length;
+    tp->parts[tp->count].is_cdata = is_cdata;
+    tp->count++;
 }
 
-static text_part_t* get_text_parts(parse_ctx ctx, const char* tag, size_t tag_len, int skip_ws, text_part_t *parts)
+/* collects the content of an element up to its closing tag into parts,
+ * which can be NULL to skip it. Returns 0 on success or -1 on error. */
+static int get_text_parts(parse_ctx ctx, const char* tag, size_t tag_len, int skip_ws, text_parts_t *parts)
 {
     const char *p = NULL;
     const char *q = NULL;
-    text_part_t *last = NULL;
 
     if (skip_ws) {
         parse_skip_ws(ctx);
@@ -544,34 +1013,30 @@ static text_part_t* get_text_parts(parse_ctx ctx, const char* tag, size_t tag_le
         if (ctx->pos >= ctx->end || *ctx->pos != '<') {
             PLIST_XML_ERR("EOF while looking for closing tag\n");
             ctx->err++;
-            return NULL;
+            return -1;
         }
         q = ctx->pos;
         ctx->pos++;
         if (ctx->pos >= ctx->end) {
             PLIST_XML_ERR("EOF while parsing '%s'\n", p);
             ctx->err++;
-            return NULL;
+            return -1;
         }
         if (*ctx->pos == '!') {
             ctx->pos++;
             if (ctx->pos >= ctx->end-1) {
                 PLIST_XML_ERR("EOF while parsing <! special tag\n");
                 ctx->err++;
-                return NULL;
+                return -1;
             }
             if (*ctx->pos == '-' && *(ctx->pos+1) == '-') {
-                if (last) {
-                    last = text_part_append(last, p, q-p, 0);
-                } else if (parts) {
-                    last = text_part_init(parts, p, q-p, 0);
-                }
+                text_parts_add(parts, p, q-p, 0);
                 ctx->pos += 2;
                 find_str(ctx, "-->", 3, 0);
                 if (ctx->pos > ctx->end-3 || strncmp(ctx->pos, "-->", 3) != 0) {
                     PLIST_XML_ERR("EOF while looking for end of comment\n");
                     ctx->err++;
-                    return NULL;
+                    return -1;
                 }
                 ctx->pos += 3;
             } else if (*ctx->pos == '[') {
@@ -579,15 +1044,11 @@ static text_part_t* get_text_parts(parse_ctx ctx, const char* tag, size_t tag_le
                 if (ctx->pos >= ctx->end - 8) {
                     PLIST_XML_ERR("EOF while parsing <[ tag\n");
                     ctx->err++;
-                    return NULL;
+                    return -1;
                 }
                 if (strncmp(ctx->pos, "CDATA[", 6) == 0) {
                     if (q-p > 0) {
-                        if (last) {
-                            last = text_part_append(last, p, q-p, 0);
-                        } else if (parts) {
-                            last = text_part_init(parts, p, q-p, 0);
-                        }
+                        text_parts_add(parts, p, q-p, 0);
                     }
                     ctx->pos+=6;
                     p = ctx->pos;
@@ -595,241 +1056,497 @@ static text_part_t* get_text_parts(parse_ctx ctx, const char* tag, size_t tag_le
                     if (ctx->pos > ctx->end-3 || strncmp(ctx->pos, "]]>", 3) != 0) {
                         PLIST_XML_ERR("EOF while looking for end of CDATA block\n");
                         ctx->err++;
-                        return NULL;
+                        return -1;
                     }
                     q = ctx->pos;
-                    if (last) {
-                        last = text_part_append(last, p, q-p, 1);
-                    } else if (parts) {
-                        last = text_part_init(parts, p, q-p, 1);
-                    }
+                    text_parts_add(parts, p, q-p, 1);
                     ctx->pos += 3;
                 } else {
                     p = ctx->pos;
                     find_next(ctx, " \r\n\t>", 5, 1);
-                    PLIST_XML_ERR("Invalid special tag <[%.*s> encountered inside <%s> tag\n", (int)(ctx->pos - p), p, tag);
+                    PLIST_XML_ERR("Invalid special tag <[%.*s> encountered inside <%.*s> tag\n", (int)(ctx->pos - p), p, (int)tag_len, tag);
                     ctx->err++;
-                    return NULL;
+                    return -1;
                 }
             } else {
                 p = ctx->pos;
                 find_next(ctx, " \r\n\t>", 5, 1);
-                PLIST_XML_ERR("Invalid special tag <!%.*s> encountered inside <%s> tag\n", (int)(ctx->pos - p), p, tag);
+                PLIST_XML_ERR("Invalid special tag <!%.*s> encountered inside <%.*s> tag\n", (int)(ctx->pos - p), p, (int)tag_len, tag);
                 ctx->err++;
-                return NULL;
+                return -1;
             }
         } else if (*ctx->pos == '/') {
             break;
         } else {
             p = ctx->pos;
             find_next(ctx, " \r\n\t>", 5, 1);
-            PLIST_XML_ERR("Invalid tag <%.*s> encountered inside <%s> tag\n", (int)(ctx->pos - p), p, tag);
+            PLIST_XML_ERR("Invalid tag <%.*s> encountered inside <%.*s> tag\n", (int)(ctx->pos - p), p, (int)tag_len, tag);
             ctx->err++;
-            return NULL;
+            return -1;
         }
     } while (1);
     ctx->pos++;
     if (ctx->pos >= ctx->end-tag_len || strncmp(ctx->pos, tag, tag_len)) {
         PLIST_XML_ERR("EOF or end tag mismatch\n");
         ctx->err++;
-        return NULL;
+        return -1;
     }
     ctx->pos+=tag_len;
     parse_skip_ws(ctx);
     if (ctx->pos >= ctx->end) {
         PLIST_XML_ERR("EOF while parsing closing tag\n");
         ctx->err++;
-        return NULL;
+        return -1;
     } else if (*ctx->pos != '>') {
         PLIST_XML_ERR("Invalid closing tag; expected '>', found '%c'\n", *ctx->pos);
         ctx->err++;
-        return NULL;
+        return -1;
     }
     ctx->pos++;
 
     if (q-p > 0) {
-        if (last) {
-            last = text_part_append(last, p, q-p, 0);
-        } else if (parts) {
-            last = text_part_init(parts, p, q-p, 0);
-        }
+        text_parts_add(parts, p, q-p, 0);
     }
-    return parts;
+    return 0;
 }
 
 static int unescape_entities(char *str, size_t *length)
 {
-    size_t i = 0;
     size_t len = *length;
-    while (len > 0 && i < len-1) {
-        if (str[i] == '&') {
-            char *entp = str + i + 1;
-            while (i < len && str[i] != ';') {
-                i++;
-            }
-            if (i >= len) {
-                PLIST_XML_ERR("Invalid entity sequence encountered (missing terminating ';')\n");
+    char *end = str + len;
+    char *r = NULL;
+    char *w = NULL;
+    char *amp = NULL;
+
+    /* fast path: nothing to do for strings without entities. An '&' in
+     * the last byte can not start an entity and is kept as is. */
+    if (len < 2 || !(amp = memchr(str, '&', len - 1))) {
+        return 0;
+    }
+
+    r = w = amp;
+    while (amp) {
+        char *entp = amp + 1;
+        char *semi = NULL;
+        char out[4];
+        int entlen = 0;
+        int bytelen = 1;
+
+        /* move the clean run in front of the entity into place */
+        if (w != r) {
+            memmove(w, r, amp - r);
+        }
+        w += amp - r;
+
+        semi = memchr(entp, ';', end - entp);
+        if (!semi) {
+            PLIST_XML_ERR("Invalid entity sequence encountered (missing terminating ';')\n");
+            return -1;
+        }
+        if (semi == entp) {
+            PLIST_XML_ERR("Invalid empty entity sequence &;\n");
+            return -1;
+        }
+        entlen = semi - entp;
+
+        if (!strncmp(entp, "amp", 3)) {
+            out[0] = '&';
+        } else if (!strncmp(entp, "apos", 4)) {
+            out[0] = '\'';
+        } else if (!strncmp(entp, "quot", 4)) {
+            out[0] = '"';
+        } else if (!strncmp(entp, "lt", 2)) {
+            out[0] = '<';
+        } else if (!strncmp(entp, "gt", 2)) {
+            out[0] = '>';
+        } else if (*entp == '#') {
+            /* numerical  character reference */
+            uint64_t val = 0;
+            char* ep = NULL;
+            if (entlen > 8) {
+                PLIST_XML_ERR("Invalid numerical character reference encountered, sequence too long: &%.*s;\n", entlen, entp);
                 return -1;
             }
-            if (str+i >= entp+1) {
-                int entlen = str+i - entp;
-                int bytelen = 1;
-                if (!strncmp(entp, "amp", 3)) {
-                    /* the '&' is already there */
-                } else if (!strncmp(entp, "apos", 4)) {
-                    *(entp-1) = '\'';
-                } else if (!strncmp(entp, "quot", 4)) {
-                    *(entp-1) = '"';
-                } else if (!strncmp(entp, "lt", 2)) {
-                    *(entp-1) = '<';
-                } else if (!strncmp(entp, "gt", 2)) {
-                    *(entp-1) = '>';
-                } else if (*entp == '#') {
-                    /* numerical  character reference */
-                    uint64_t val = 0;
-                    char* ep = NULL;
-                    if (entlen > 8) {
-                        PLIST_XML_ERR("Invalid numerical character reference encountered, sequence too long: &%.*s;\n", entlen, entp);
-                        return -1;
-                    }
-                    if (*(entp+1) == 'x' || *(entp+1) == 'X') {
-                        if (entlen < 3) {
-                            PLIST_XML_ERR("Invalid numerical character reference encountered, sequence too short: &%.*s;\n", entlen, entp);
-                            return -1;
-                        }
-                        val = strtoull(entp+2, &ep, 16);
-                    } else {
-                        if (entlen < 2) {
-                            PLIST_XML_ERR("Invalid numerical character reference encountered, sequence too short: &%.*s;\n", entlen, entp);
-                            return -1;
-                        }
-                        val = strtoull(entp+1, &ep, 10);
-                    }
-                    if (val == 0 || val > 0x10FFFF || ep-entp != entlen) {
-                        PLIST_XML_ERR("Invalid numerical character reference found: &%.*s;\n", entlen, entp);
-                        return -1;
-                    }
-                    /* convert to UTF8 */
-                    if (val >= 0x10000) {
-                        /* four bytes */
-                        *(entp-1) = (char)(0xF0 + ((val >> 18) & 0x7));
-                        *(entp+0) = (char)(0x80 + ((val >> 12) & 0x3F));
-                        *(entp+1) = (char)(0x80 + ((val >> 6) & 0x3F));
-                        *(entp+2) = (char)(0x80 + (val & 0x3F));
-                        entp+=3;
-                        bytelen = 4;
-                    } else if (val >= 0x800) {
-                        /* three bytes */
-                        *(entp-1) = (char)(0xE0 + ((val >> 12) & 0xF));
-                        *(entp+0) = (char)(0x80 + ((val >> 6) & 0x3F));
-                        *(entp+1) = (char)(0x80 + (val & 0x3F));
-                        entp+=2;
-                        bytelen = 3;
-                    } else if (val >= 0x80) {
-                        /* two bytes */
-                        *(entp-1) = (char)(0xC0 + ((val >> 6) & 0x1F));
-                        *(entp+0) = (char)(0x80 + (val & 0x3F));
-                        entp++;
-                        bytelen = 2;
-                    } else {
-                        /* one byte */
-                        *(entp-1) = (char)(val & 0x7F);
-                    }
-                } else {
-                    PLIST_XML_ERR("Invalid entity encountered: &%.*s;\n", entlen, entp);
+            if (*(entp+1) == 'x' || *(entp+1) == 'X') {
+                if (entlen < 3) {
+                    PLIST_XML_ERR("Invalid numerical character reference encountered, sequence too short: &%.*s;\n", entlen, entp);
                     return -1;
                 }
-                memmove(entp, str+i+1, len - i);
-                i -= entlen+1 - bytelen;
-                len -= entlen+2 - bytelen;
-                continue;
+                val = strtoull(entp+2, &ep, 16);
             } else {
-                PLIST_XML_ERR("Invalid empty entity sequence &;\n");
+                if (entlen < 2) {
+                    PLIST_XML_ERR("Invalid numerical character reference encountered, sequence too short: &%.*s;\n", entlen, entp);
+                    return -1;
+                }
+                val = strtoull(entp+1, &ep, 10);
+            }
+            if (val == 0 || val > 0x10FFFF || ep-entp != entlen) {
+                PLIST_XML_ERR("Invalid numerical character reference found: &%.*s;\n", entlen, entp);
                 return -1;
             }
+            /* convert to UTF8 */
+            if (val >= 0x10000) {
+                /* four bytes */
+                out[0] = (char)(0xF0 + ((val >> 18) & 0x7));
+                out[1] = (char)(0x80 + ((val >> 12) & 0x3F));
+                out[2] = (char)(0x80 + ((val >> 6) & 0x3F));
+                out[3] = (char)(0x80 + (val & 0x3F));
+                bytelen = 4;
+            } else if (val >= 0x800) {
+                /* three bytes */
+                out[0] = (char)(0xE0 + ((val >> 12) & 0xF));
+                out[1] = (char)(0x80 + ((val >> 6) & 0x3F));
+                out[2] = (char)(0x80 + (val & 0x3F));
+                bytelen = 3;
+            } else if (val >= 0x80) {
+                /* two bytes */
+                out[0] = (char)(0xC0 + ((val >> 6) & 0x1F));
+                out[1] = (char)(0x80 + (val & 0x3F));
+                bytelen = 2;
+            } else {
+                /* one byte */
+                out[0] = (char)(val & 0x7F);
+            }
+        } else {
+            PLIST_XML_ERR("Invalid entity encountered: &%.*s;\n", entlen, entp);
+            return -1;
         }
-        i++;
+        /* the replacement is never longer than the entity */
+        memcpy(w, out, bytelen);
+        w += bytelen;
+        r = semi + 1;
+
+        amp = (end - r >= 2) ? memchr(r, '&', end - r - 1) : NULL;
     }
-    *length = len;
+    if (w != r) {
+        memmove(w, r, end - r);
+    }
+    w += end - r;
+    *length = w - str;
     return 0;
 }
 
-static char* text_parts_get_content(text_part_t *tp, int unesc_entities, size_t *length, int *requires_free)
+/* joins the parts of a text. A single part that needs no unescaping is
+ * returned in place, then *requires_free is 0 and the text is not 0
+ * terminated but followed by '<'. */
+static char* text_parts_get_content(text_parts_t *tp, int unesc_entities, size_t *length, int *requires_free, plist_arena_t arena)
 {
     char *str = NULL;
+    char *p = NULL;
     size_t total_length = 0;
+    size_t i = 0;
 
-    if (!tp) {
-        return NULL;
+    if (tp->count == 0) {
+        *requires_free = 0;
+        if (length) {
+            *length = 0;
+        }
+        return (char*)"";
     }
-    char *p;
-    if (requires_free && !tp->next) {
-        if (tp->is_cdata || !unesc_entities) {
+    if (tp->count == 1) {
+        text_part_t *part = &tp->parts[0];
+        if (part->is_cdata || !unesc_entities || !memchr(part->begin, '&', part->length)) {
             *requires_free = 0;
             if (length) {
-                *length = tp->length;
+                *length = part->length;
             }
-            return (char*)tp->begin;
+            return (char*)part->begin;
         }
     }
-    text_part_t *tmp = tp;
-    while (tp && tp->begin) {
-        total_length += tp->length;
-        tp = tp->next;
+    for (i = 0; i < tp->count; i++) {
+        total_length += tp->parts[i].length;
     }
-    str = malloc(total_length + 1);
+    str = (char*)plist_arena_alloc(arena, total_length + 1);
     assert(str);
     p = str;
-    tp = tmp;
-    while (tp && tp->begin) {
-        size_t len = tp->length;
-        strncpy(p, tp->begin, len);
+    for (i = 0; i < tp->count; i++) {
+        size_t len = tp->parts[i].length;
+        memcpy(p, tp->parts[i].begin, len);
         p[len] = '\0';
-        if (!tp->is_cdata && unesc_entities) {
+        if (!tp->parts[i].is_cdata && unesc_entities) {
             if (unescape_entities(p, &len) < 0) {
-                free(str);
+                if (!arena)
+                    plist_mem_free(str);
                 return NULL;
             }
         }
         p += len;
-        tp = tp->next;
     }
     *p = '\0';
     if (length) {
         *length = p - str;
     }
-    if (requires_free) {
-        *requires_free = 1;
-    }
+    *requires_free = 1;
     return str;
 }
 
-static void node_from_xml(parse_ctx ctx, plist_t *plist)
+static int tag_is(const char *tag, size_t taglen, const char *name, size_t namelen)
 {
-    char *tag = NULL;
-    char *keyname = NULL;
-    plist_t subnode = NULL;
-    const char *p = NULL;
-    plist_t parent = NULL;
-    int has_content = 0;
-
-    struct node_path_item {
-        const char *type;
-        void *prev;
-    };
-    struct node_path_item* node_path = NULL;
+    return taglen == namelen && !memcmp(tag, name, namelen);
+}
 
-    while (ctx->pos < ctx->end && !ctx->err) {
-        parse_skip_ws(ctx);
-        if (ctx->pos >= ctx->end) {
-            break;
-        }
-        if (*ctx->pos != '<') {
-            p = ctx->pos;
-            find_next(ctx, " \t\r\n", 4, 0);
-            PLIST_XML_ERR("Expected: opening tag, found: %.*s\n", (int)(ctx->pos - p), p);
-            ctx->err++;
-            goto err_out;
+/* parses the content of a scalar element into data. Strings (and keys) are
+ * allocated from str_arena. Returns 0 on success, 1 if tag is not a scalar
+ * element, and -1 on error (ctx->err is incremented). */
+static int parse_scalar_element(parse_ctx ctx, const char *tag, int taglen, int is_empty, plist_data_t data, plist_arena_t str_arena)
+{
+    text_parts_t tp;
+    int res = 0;
+
+    text_parts_init(&tp);
+    if (tag_is(tag, taglen, XPLIST_INT, XPLIST_INT_LEN)) {
+        if (!is_empty) {
+            if (get_text_parts(ctx, tag, taglen, 1, &tp) < 0) {
+                PLIST_XML_ERR("Could not parse text content for '%.*s' node\n", taglen, tag);
+                res = -1;
+                goto out;
+            }
+            if (tp.count > 0) {
+                int requires_free = 0;
+                int is_negative = 0;
+                size_t length = 0;
+                char *str_content = text_parts_get_content(&tp, 0, &length, &requires_free, NULL);
+                if (!str_content) {
+                    PLIST_XML_ERR("Could not get text content for '%.*s' node\n", taglen, tag);
+                    res = -1;
+                    goto out;
+                }
+                parse_uint64(str_content, length, &data->intval, &is_negative);
+                if (is_negative || (data->intval <= INT64_MAX)) {
+                    uint64_t v = data->intval;
+                    if (is_negative) {
+                        v = -v;
+                    }
+                    data->intval = v;
+                    data->length = 8;
+                } else {
+                    data->length = 16;
+                }
+                if (requires_free) {
+                    plist_mem_free(str_content);
+                }
+            } else {
+                is_empty = 1;
+            }
+        }
+        if (is_empty) {
+            data->intval = 0;
+            data->length = 8;
+        }
+        data->type = PLIST_UINT;
+    } else if (tag_is(tag, taglen, XPLIST_REAL, XPLIST_REAL_LEN)) {
+        if (!is_empty) {
+            if (get_text_parts(ctx, tag, taglen, 1, &tp) < 0) {
+                PLIST_XML_ERR("Could not parse text content for '%.*s' node\n", taglen, tag);
+                res = -1;
+                goto out;
+            }
+            if (tp.count > 0) {
+                int requires_free = 0;
+                size_t length = 0;
+                char *str_content = text_parts_get_content(&tp, 0, &length, &requires_free, NULL);
+                if (!str_content) {
+                    PLIST_XML_ERR("Could not get text content for '%.*s' node\n", taglen, tag);
+                    res = -1;
+                    goto out;
+                }
+                parse_double(str_content, length, &data->realval);
+                if (requires_free) {
+                    plist_mem_free(str_content);
+                }
+            }
+        }
+        data->type = PLIST_REAL;
+        data->length = 8;
+    } else if (tag_is(tag, taglen, XPLIST_TRUE, XPLIST_TRUE_LEN)) {
+        if (!is_empty) {
+            get_text_parts(ctx, tag, taglen, 1, NULL);
+        }
+        data->type = PLIST_BOOLEAN;
+        data->boolval = 1;
+        data->length = 1;
+    } else if (tag_is(tag, taglen, XPLIST_FALSE, XPLIST_FALSE_LEN)) {
+        if (!is_empty) {
+            get_text_parts(ctx, tag, taglen, 1, NULL);
+        }
+        data->type = PLIST_BOOLEAN;
+        data->boolval = 0;
+        data->length = 1;
+    } else if (tag_is(tag, taglen, XPLIST_STRING, XPLIST_STRING_LEN) || tag_is(tag, taglen, XPLIST_KEY, XPLIST_KEY_LEN)) {
+        if (!is_empty) {
+            char *str = NULL;
+            size_t length = 0;
+            int requires_free = 0;
+            if (get_text_parts(ctx, tag, taglen, 0, &tp) < 0) {
+                PLIST_XML_ERR("Could not parse text content for '%.*s' node\n", taglen, tag);
+                res = -1;
+                goto out;
+            }
+            str = text_parts_get_content(&tp, 1, &length, &requires_free, str_arena);
+            if (!str) {
+                PLIST_XML_ERR("Could not get text content for '%.*s' node\n", taglen, tag);
+                res = -1;
+                goto out;
+            }
+            if (requires_free && length >= PLIST_DATA_INLINE_SIZE) {
+                data->strval = str;
+            } else {
+                /* str points into the input unless requires_free is set,
+                 * plain text is copied straight into the node */
+                plist_data_alloc_string(data, str_arena, length);
+                memcpy(data->strval, str, length);
+                data->strval[length] = '\0';
+                if (requires_free && !str_arena) {
+                    plist_mem_free(str);
+                }
+            }
+            data->length = length;
+        } else {
+            plist_data_alloc_string(data, str_arena, 0);
+            data->strval[0] = '\0';
+            data->length = 0;
+        }
+        data->type = PLIST_STRING;
+    } else if (tag_is(tag, taglen, XPLIST_DATA, XPLIST_DATA_LEN)) {
+        if (!is_empty) {
+            if (get_text_parts(ctx, tag, taglen, 1, &tp) < 0) {
+                PLIST_XML_ERR("Could not parse text content for '%.*s' node\n", taglen, tag);
+                res = -1;
+                goto out;
+            }
+            if (tp.count > 0) {
+                int requires_free = 0;
+                size_t size = 0;
+                char *str_content = text_parts_get_content(&tp, 0, &size, &requires_free, NULL);
+                if (!str_content) {
+                    PLIST_XML_ERR("Could not get text content for '%.*s' node\n", taglen, tag);
+                    res = -1;
+                    goto out;
+                }
+                if (size > 0) {
+                    data->buff = base64decode(str_content, &size);
+                    data->length = size;
+                    if (ctx->arena && data->buff) {
+                        uint8_t *buff = (uint8_t*)plist_arena_alloc(ctx->arena, size);
+                        memcpy(buff, data->buff, size);
+                        plist_mem_free(data->buff);
+                        data->buff = buff;
+                    }
+                }
+
+                if (requires_free) {
+                    plist_mem_free(str_content);
+                }
+            }
+        }
+        data->type = PLIST_DATA;
+    } else if (tag_is(tag, taglen, XPLIST_DATE, XPLIST_DATE_LEN)) {
+        if (!is_empty) {
+            Time64_T timev = 0;
+            if (get_text_parts(ctx, tag, taglen, 1, &tp) < 0) {
+                PLIST_XML_ERR("Could not parse text content for '%.*s' node\n", taglen, tag);
+                res = -1;
+                goto out;
+            }
+            if (tp.count > 0) {
+                int requires_free = 0;
+                size_t length = 0;
+                char *str_content = text_parts_get_content(&tp, 0, &length, &requires_free, NULL);
+                if (!str_content) {
+                    PLIST_XML_ERR("Could not get text content for '%.*s' node\n", taglen, tag);
+                    res = -1;
+                    goto out;
+                }
+
+                if (parse_date_fast(str_content, length, &timev) != 0) {
+                    timev = parse_date_generic(str_content, length);
+                }
+                if (requires_free) {
+                    plist_mem_free(str_content);
+                }
+            }
+            data->realval = (double)(timev - MAC_EPOCH);
+        }
+        data->length = sizeof(double);
+        data->type = PLIST_DATE;
+    } else {
+        res = 1;
+    }
+
+out:
+    if (res < 0) {
+        ctx->err++;
+    }
+    text_parts_free(&tp);
+    return res;
+}
+
+/* dict keys taken from a parsed string node may be shared payloads */
+static void free_keyname(char *keyname, int shared)
+{
+    if (shared) {
+        plist_shared_release(keyname);
+    } else {
+        plist_mem_free(keyname);
+    }
+}
+
+/* adds an open element to the stack of node_from_xml */
+static int node_path_push(const char ***node_path, uint32_t *depth, uint32_t *capacity, const char *type)
+{
+    if (*depth == *capacity) {
+        uint32_t newcap = (*capacity > 0) ? *capacity * 2 : 16;
+        const char **path = (const char**)plist_realloc(*node_path, newcap * sizeof(const char*));
+        if (!path) {
+            PLIST_XML_ERR("out of memory when allocating node path item\n");
+            return -1;
+        }
+        *node_path = path;
+        *capacity = newcap;
+    }
+    (*node_path)[(*depth)++] = type;
+    return 0;
+}
+
+/* counts a node and its payload against the limits of the parse, if it
+ * has any */
+static int xml_limit_node(parse_ctx ctx, plist_data_t data)
+{
+    if (ctx->limits && plist_limits_add(ctx->limits, 1, plist_node_size(data->type, data->length, data->flags)) < 0) {
+        PLIST_XML_ERR("parse limits exceeded\n");
+        ctx->err++;
+        return -1;
+    }
+    return 0;
+}
+
+static void node_from_xml(parse_ctx ctx, plist_t *plist)
+{
+    const char *tag = NULL;
+    char *keyname = NULL;
+    int keyname_shared = 0;
+    plist_t subnode = NULL;
+    const char *p = NULL;
+    plist_t parent = NULL;
+    int has_content = 0;
+
+    /* the names of the open elements, innermost last */
+    const char **node_path = NULL;
+    uint32_t path_depth = 0;
+    uint32_t path_capacity = 0;
+    uint32_t max_depth = ctx->limits ? ctx->limits->max_depth : plist_get_max_depth();
+
+    while (ctx->pos < ctx->end && !ctx->err) {
+        parse_skip_ws(ctx);
+        if (ctx->pos >= ctx->end) {
+            break;
+        }
+        if (*ctx->pos != '<') {
+            p = ctx->pos;
+            find_next(ctx, " \t\r\n", 4, 0);
+            PLIST_XML_ERR("Expected: opening tag, found: %.*s\n", (int)(ctx->pos - p), p);
+            ctx->err++;
+            goto err_out;
         }
         ctx->pos++;
         if (ctx->pos >= ctx->end) {
@@ -911,10 +1628,9 @@ static void node_from_xml(parse_ctx ctx, plist_t *plist)
                 ctx->err++;
                 goto err_out;
             }
+            /* the tag is compared in place */
             int taglen = ctx->pos - p;
-            tag = malloc(taglen + 1);
-            strncpy(tag, p, taglen);
-            tag[taglen] = '\0';
+            tag = p;
             if (*ctx->pos != '>') {
                 find_next(ctx, "<>", 2, 1);
             }
@@ -924,23 +1640,21 @@ static void node_from_xml(parse_ctx ctx, plist_t *plist)
                 goto err_out;
             }
             if (*ctx->pos != '>') {
-                PLIST_XML_ERR("Missing '>' for tag <%s\n", tag);
+                PLIST_XML_ERR("Missing '>' for tag <%.*s\n", taglen, tag);
                 ctx->err++;
                 goto err_out;
             }
             if (*(ctx->pos-1) == '/') {
                 int idx = ctx->pos - p - 1;
                 if (idx < taglen)
-                    tag[idx] = '\0';
+                    taglen = idx;
                 is_empty = 1;
             }
             ctx->pos++;
-            if (!strcmp(tag, "plist")) {
-                free(tag);
-                tag = NULL;
+            if (tag_is(tag, taglen, XPLIST_PLIST, XPLIST_PLIST_LEN)) {
                 has_content = 0;
 
-                if (!node_path && *plist) {
+                if (path_depth == 0 && *plist) {
                     /* we don't allow another top-level <plist> */
                     break;
                 }
@@ -950,260 +1664,77 @@ static void node_from_xml(parse_ctx ctx, plist_t *plist)
                     goto err_out;
                 }
 
-                struct node_path_item *path_item = malloc(sizeof(struct node_path_item));
-                if (!path_item) {
-                    PLIST_XML_ERR("out of memory when allocating node path item\n");
+                if (node_path_push(&node_path, &path_depth, &path_capacity, XPLIST_PLIST) < 0) {
                     ctx->err++;
                     goto err_out;
                 }
-                path_item->type = "plist";
-                path_item->prev = node_path;
-                node_path = path_item;
 
                 continue;
-            } else if (!strcmp(tag, "/plist")) {
+            } else if (taglen == XPLIST_PLIST_LEN + 1 && tag[0] == '/' && tag_is(tag + 1, taglen - 1, XPLIST_PLIST, XPLIST_PLIST_LEN)) {
                 if (!has_content) {
                     PLIST_XML_ERR("encountered empty plist tag\n");
                     ctx->err++;
                     goto err_out;
                 }
-                if (!node_path) {
+                if (path_depth == 0) {
                     PLIST_XML_ERR("node path is empty while trying to match closing tag with opening tag\n");
                     ctx->err++;
                     goto err_out;
                 }
-                if (strcmp(node_path->type, tag+1) != 0) {
-                    PLIST_XML_ERR("mismatching closing tag <%s> found for opening tag <%s>\n", tag, node_path->type);
+                if (strcmp(node_path[path_depth-1], XPLIST_PLIST) != 0) {
+                    PLIST_XML_ERR("mismatching closing tag <%.*s> found for opening tag <%s>\n", taglen, tag, node_path[path_depth-1]);
                     ctx->err++;
                     goto err_out;
                 }
-                struct node_path_item *path_item = node_path;
-                node_path = node_path->prev;
-                free(path_item);
-
-                free(tag);
-                tag = NULL;
+                path_depth--;
 
                 continue;
             }
 
-            plist_data_t data = plist_new_plist_data();
+            plist_data_t data = plist_new_plist_data_in(ctx->arena);
             subnode = plist_new_node(data);
             has_content = 1;
 
-            if (!strcmp(tag, XPLIST_DICT)) {
+            if (tag_is(tag, taglen, XPLIST_DICT, XPLIST_DICT_LEN)) {
                 data->type = PLIST_DICT;
-            } else if (!strcmp(tag, XPLIST_ARRAY)) {
-                data->type = PLIST_ARRAY;
-            } else if (!strcmp(tag, XPLIST_INT)) {
-                if (!is_empty) {
-                    text_part_t first_part = { NULL, 0, 0, NULL };
-                    text_part_t *tp = get_text_parts(ctx, tag, taglen, 1, &first_part);
-                    if (!tp) {
-                        PLIST_XML_ERR("Could not parse text content for '%s' node\n", tag);
-                        text_parts_free(first_part.next);
-                        ctx->err++;
-                        goto err_out;
-                    }
-                    if (tp->begin) {
-                        int requires_free = 0;
-                        char *str_content = text_parts_get_content(tp, 0, NULL, &requires_free);
-                        if (!str_content) {
-                            PLIST_XML_ERR("Could not get text content for '%s' node\n", tag);
-                            text_parts_free(first_part.next);
-                            ctx->err++;
-                            goto err_out;
-                        }
-                        char *str = str_content;
-                        int is_negative = 0;
-                        if ((str[0] == '-') || (str[0] == '+')) {
-                            if (str[0] == '-') {
-                                is_negative = 1;
-                            }
-                            str++;
-                        }
-                        data->intval = strtoull((char*)str, NULL, 0);
-                        if (is_negative || (data->intval <= INT64_MAX)) {
-                            uint64_t v = data->intval;
-                            if (is_negative) {
-                                v = -v;
-                            }
-                            data->intval = v;
-                            data->length = 8;
-                        } else {
-                            data->length = 16;
-                        }
-                        if (requires_free) {
-                            free(str_content);
-                        }
-                    } else {
-                        is_empty = 1;
-                    }
-                    text_parts_free(tp->next);
-                }
-                if (is_empty) {
-                    data->intval = 0;
-                    data->length = 8;
+                if (xml_limit_node(ctx, data) < 0) {
+                    goto err_out;
                 }
-                data->type = PLIST_UINT;
-            } else if (!strcmp(tag, XPLIST_REAL)) {
-                if (!is_empty) {
-                    text_part_t first_part = { NULL, 0, 0, NULL };
-                    text_part_t *tp = get_text_parts(ctx, tag, taglen, 1, &first_part);
-                    if (!tp) {
-                        PLIST_XML_ERR("Could not parse text content for '%s' node\n", tag);
-                        text_parts_free(first_part.next);
-                        ctx->err++;
-                        goto err_out;
-                    }
-                    if (tp->begin) {
-                        int requires_free = 0;
-                        char *str_content = text_parts_get_content(tp, 0, NULL, &requires_free);
-                        if (!str_content) {
-                            PLIST_XML_ERR("Could not get text content for '%s' node\n", tag);
-                            text_parts_free(first_part.next);
-                            ctx->err++;
-                            goto err_out;
-                        }
-                        data->realval = atof(str_content);
-                        if (requires_free) {
-                            free(str_content);
-                        }
-                    }
-                    text_parts_free(tp->next);
+            } else if (tag_is(tag, taglen, XPLIST_ARRAY, XPLIST_ARRAY_LEN)) {
+                data->type = PLIST_ARRAY;
+                if (xml_limit_node(ctx, data) < 0) {
+                    goto err_out;
                 }
-                data->type = PLIST_REAL;
-                data->length = 8;
-            } else if (!strcmp(tag, XPLIST_TRUE)) {
-                if (!is_empty) {
-                    get_text_parts(ctx, tag, taglen, 1, NULL);
+            } else if (taglen == 0 || tag[0] != '/') {
+                /* dict keys are kept on the heap until the item is added */
+                int is_key = (!is_empty && tag_is(tag, taglen, XPLIST_KEY, XPLIST_KEY_LEN) && !keyname && parent && (plist_get_node_type(parent) == PLIST_DICT));
+                int res = parse_scalar_element(ctx, tag, taglen, is_empty, data, (is_key) ? NULL : ctx->arena);
+                if (res < 0) {
+                    goto err_out;
+                } else if (res > 0) {
+                    PLIST_XML_ERR("Unexpected tag <%.*s%s> encountered\n", taglen, tag, (is_empty) ? "/" : "");
+                    ctx->pos = ctx->end;
+                    ctx->err++;
+                    goto err_out;
                 }
-                data->type = PLIST_BOOLEAN;
-                data->boolval = 1;
-                data->length = 1;
-            } else if (!strcmp(tag, XPLIST_FALSE)) {
-                if (!is_empty) {
-                    get_text_parts(ctx, tag, taglen, 1, NULL);
+                /* keys become key nodes of the same size */
+                if (xml_limit_node(ctx, data) < 0) {
+                    goto err_out;
                 }
-                data->type = PLIST_BOOLEAN;
-                data->boolval = 0;
-                data->length = 1;
-            } else if (!strcmp(tag, XPLIST_STRING) || !strcmp(tag, XPLIST_KEY)) {
-                if (!is_empty) {
-                    text_part_t first_part = { NULL, 0, 0, NULL };
-                    text_part_t *tp = get_text_parts(ctx, tag, taglen, 0, &first_part);
-                    char *str = NULL;
-                    size_t length = 0;
-                    if (!tp) {
-                        PLIST_XML_ERR("Could not parse text content for '%s' node\n", tag);
-                        text_parts_free(first_part.next);
-                        ctx->err++;
-                        goto err_out;
-                    }
-                    str = text_parts_get_content(tp, 1, &length, NULL);
-                    text_parts_free(first_part.next);
-                    if (!str) {
-                        PLIST_XML_ERR("Could not get text content for '%s' node\n", tag);
-                        ctx->err++;
-                        goto err_out;
-                    }
-                    if (!strcmp(tag, "key") && !keyname && parent && (plist_get_node_type(parent) == PLIST_DICT)) {
-                        keyname = str;
-                        free(tag);
-                        tag = NULL;
-                        plist_free(subnode);
-                        subnode = NULL;
-                        continue;
+                if (is_key) {
+                    if (data->flags & PLIST_DATA_INLINE) {
+                        keyname = plist_strdup(data->strval);
                     } else {
-                        data->strval = str;
-                        data->length = length;
-                    }
-                } else {
-                    data->strval = strdup("");
-                    data->length = 0;
-                }
-                data->type = PLIST_STRING;
-            } else if (!strcmp(tag, XPLIST_DATA)) {
-                if (!is_empty) {
-                    text_part_t first_part = { NULL, 0, 0, NULL };
-                    text_part_t *tp = get_text_parts(ctx, tag, taglen, 1, &first_part);
-                    if (!tp) {
-                        PLIST_XML_ERR("Could not parse text content for '%s' node\n", tag);
-                        text_parts_free(first_part.next);
-                        ctx->err++;
-                        goto err_out;
-                    }
-                    if (tp->begin) {
-                        int requires_free = 0;
-                        char *str_content = text_parts_get_content(tp, 0, NULL, &requires_free);
-                        if (!str_content) {
-                            PLIST_XML_ERR("Could not get text content for '%s' node\n", tag);
-                            text_parts_free(first_part.next);
-                            ctx->err++;
-                            goto err_out;
-                        }
-                        size_t size = tp->length;
-                        if (size > 0) {
-                            data->buff = base64decode(str_content, &size);
-                            data->length = size;
-                        }
-
-                        if (requires_free) {
-                            free(str_content);
-                        }
+                        keyname = data->strval;
+                        keyname_shared = (data->flags & PLIST_DATA_SHARED) != 0;
+                        data->strval = NULL;
                     }
-                    text_parts_free(tp->next);
+                    plist_free(subnode);
+                    subnode = NULL;
+                    continue;
                 }
-                data->type = PLIST_DATA;
-            } else if (!strcmp(tag, XPLIST_DATE)) {
-                if (!is_empty) {
-                    text_part_t first_part = { NULL, 0, 0, NULL };
-                    text_part_t *tp = get_text_parts(ctx, tag, taglen, 1, &first_part);
-                    if (!tp) {
-                        PLIST_XML_ERR("Could not parse text content for '%s' node\n", tag);
-                        text_parts_free(first_part.next);
-                        ctx->err++;
-                        goto err_out;
-                    }
-                    Time64_T timev = 0;
-                    if (tp->begin) {
-                        int requires_free = 0;
-                        size_t length = 0;
-                        char *str_content = text_parts_get_content(tp, 0, &length, &requires_free);
-                        if (!str_content) {
-                            PLIST_XML_ERR("Could not get text content for '%s' node\n", tag);
-                            text_parts_free(first_part.next);
-                            ctx->err++;
-                            goto err_out;
-                        }
-
-                        if ((length >= 11) && (length < 32)) {
-                            /* we need to copy here and 0-terminate because sscanf will read the entire string (whole rest of XML data) which can be huge */
-                            char strval[32];
-                            struct TM btime;
-                            strncpy(strval, str_content, length);
-                            strval[tp->length] = '\0';
-                            parse_date(strval, &btime);
-                            timev = timegm64(&btime);
-                        } else {
-                            PLIST_XML_ERR("Invalid text content in date node\n");
-                        }
-                        if (requires_free) {
-                            free(str_content);
-                        }
-                    }
-                    text_parts_free(tp->next);
-                    data->realval = (double)(timev - MAC_EPOCH);
-                }
-                data->length = sizeof(double);
-                data->type = PLIST_DATE;
-            } else if (tag[0] == '/') {
-                 closing_tag = 1;
             } else {
-                PLIST_XML_ERR("Unexpected tag <%s%s> encountered\n", tag, (is_empty) ? "/" : "");
-                ctx->pos = ctx->end;
-                ctx->err++;
-                goto err_out;
+                 closing_tag = 1;
             }
             if (subnode && !closing_tag) {
                 if (!*plist) {
@@ -1236,65 +1767,64 @@ static void node_from_xml(parse_ctx ctx, plist_t *plist)
                     }
                 }
                 if (!is_empty && (data->type == PLIST_DICT || data->type == PLIST_ARRAY)) {
-                    struct node_path_item *path_item = malloc(sizeof(struct node_path_item));
-                    if (!path_item) {
-                        PLIST_XML_ERR("out of memory when allocating node path item\n");
+                    if (((node_t*)subnode)->depth >= max_depth) {
+                        PLIST_XML_ERR("maximum nesting depth (%u) exceeded\n", max_depth);
+                        if (ctx->limits) {
+                            ctx->limits->exceeded = 1;
+                        }
+                        subnode = NULL;
+                        ctx->err++;
+                        goto err_out;
+                    }
+                    if (node_path_push(&node_path, &path_depth, &path_capacity, (data->type == PLIST_DICT) ? XPLIST_DICT : XPLIST_ARRAY) < 0) {
                         ctx->err++;
                         goto err_out;
                     }
-                    path_item->type = (data->type == PLIST_DICT) ? XPLIST_DICT : XPLIST_ARRAY;
-                    path_item->prev = node_path;
-                    node_path = path_item;
 
                     parent = subnode;
                 }
                 subnode = NULL;
             } else if (closing_tag) {
-                if (!node_path) {
+                if (path_depth == 0) {
                     PLIST_XML_ERR("node path is empty while trying to match closing tag with opening tag\n");
                     ctx->err++;
                     goto err_out;
                 }
-                if (strcmp(node_path->type, tag+1) != 0) {
-                    PLIST_XML_ERR("unexpected %s found (for opening %s)\n", tag, node_path->type);
+                if (!tag_is(tag + 1, taglen - 1, node_path[path_depth-1], strlen(node_path[path_depth-1]))) {
+                    PLIST_XML_ERR("unexpected %.*s found (for opening %s)\n", taglen, tag, node_path[path_depth-1]);
                     ctx->err++;
                     goto err_out;
                 }
-                struct node_path_item *path_item = node_path;
-                node_path = node_path->prev;
-                free(path_item);
+                path_depth--;
 
+                if (ctx->limits && plist_limits_add(ctx->limits, 0, plist_container_size(parent)) < 0) {
+                    PLIST_XML_ERR("parse limits exceeded\n");
+                    ctx->err++;
+                    goto err_out;
+                }
                 parent = ((node_t*)parent)->parent;
                 if (!parent) {
                     goto err_out;
                 }
             }
 
-            free(tag);
-            tag = NULL;
-            free(keyname);
+            free_keyname(keyname, keyname_shared);
             keyname = NULL;
+            keyname_shared = 0;
             plist_free(subnode);
             subnode = NULL;
         }
     }
 
-    if (node_path) {
-        PLIST_XML_ERR("EOF encountered while </%s> was expected\n", node_path->type);
+    if (path_depth > 0) {
+        PLIST_XML_ERR("EOF encountered while </%s> was expected\n", node_path[path_depth-1]);
         ctx->err++;
     }
 
 err_out:
-    free(tag);
-    free(keyname);
+    free_keyname(keyname, keyname_shared);
     plist_free(subnode);
-
-    /* clean up node_path if required */
-    while (node_path) {
-        struct node_path_item *path_item = node_path;
-        node_path = path_item->prev;
-        free(path_item);
-    }
+    plist_mem_free(node_path);
 
     if (ctx->err) {
         plist_free(*plist);
@@ -1303,13 +1833,463 @@ err_out:
 }
 
 PLIST_API void plist_from_xml(const char *plist_xml, uint32_t length, plist_t * plist)
+{
+    plist_from_xml_internal(plist_xml, length, plist, NULL);
+}
+
+PLIST_API void plist_from_xml64(const char *plist_xml, uint64_t length, plist_t * plist)
+{
+    if (!plist) {
+        return;
+    }
+    *plist = NULL;
+    plist_from_xml_internal(plist_xml, length, plist, NULL);
+}
+
+PLIST_API void plist_from_xml_arena(const char *plist_xml, uint32_t length, plist_t * plist, plist_arena_t arena)
+{
+    plist_from_xml_internal(plist_xml, length, plist, arena);
+}
+
+static void xml_parse(const char *plist_xml, uint64_t length, plist_t * plist, plist_arena_t arena, struct plist_limits_s *limits)
 {
     if (!plist_xml || (length == 0)) {
         *plist = NULL;
         return;
     }
 
-    struct _parse_ctx ctx = { plist_xml, plist_xml + length, 0 };
+    struct _parse_ctx ctx = { plist_xml, plist_xml + length, 0, arena, limits };
 
+    PLIST_STAT_TIMER_START(parse_start);
     node_from_xml(&ctx, plist);
+    PLIST_STAT_TIMER_STOP(xml_parse_time, parse_start);
+}
+
+void plist_from_xml_internal(const char *plist_xml, uint64_t length, plist_t * plist, plist_arena_t arena)
+{
+    xml_parse(plist_xml, length, plist, arena, NULL);
+}
+
+PLIST_API int plist_from_xml_limited(const char *plist_xml, uint64_t length, const plist_parse_limits_t *limits, plist_t * plist)
+{
+    struct plist_limits_s state;
+
+    if (!plist) {
+        return -1;
+    }
+    *plist = NULL;
+    if (!limits) {
+        xml_parse(plist_xml, length, plist, NULL, NULL);
+        return (*plist) ? 0 : -1;
+    }
+    plist_limits_init(&state, limits, length);
+    xml_parse(plist_xml, length, plist, NULL, &state);
+    if (*plist) {
+        return 0;
+    }
+    return (state.exceeded) ? -2 : -1;
+}
+
+/* streaming (event based) XML parser */
+
+#define XML_STREAM_CHUNK_SIZE 65536
+
+/* return values of xml_stream_token */
+#define XML_STREAM_OK 0
+#define XML_STREAM_STOP 1
+#define XML_STREAM_ERROR -1
+#define XML_STREAM_INCOMPLETE -2
+
+struct xml_stream_level {
+    plist_type type;
+    int have_key;
+};
+
+struct xml_stream_state {
+    const plist_xml_handler_t *handler;
+    void *user_data;
+    struct xml_stream_level *levels;
+    size_t depth;
+    size_t levels_size;
+    int in_plist;
+    int has_content;
+    int finished;
+};
+
+static int xml_stream_emit(struct xml_stream_state *st, int (*cb)(void*))
+{
+    return (cb) ? cb(st->user_data) : 0;
+}
+
+/* checks where a new value goes and updates the parent's state */
+static int xml_stream_begin_value(struct xml_stream_state *st)
+{
+    if (st->depth == 0) {
+        return XML_STREAM_OK;
+    }
+    struct xml_stream_level *parent = &st->levels[st->depth-1];
+    if (parent->type == PLIST_DICT) {
+        if (!parent->have_key) {
+            PLIST_XML_ERR("missing key name while adding dict item\n");
+            return XML_STREAM_ERROR;
+        }
+        parent->have_key = 0;
+    }
+    return XML_STREAM_OK;
+}
+
+static int xml_stream_push(struct xml_stream_state *st, plist_type type)
+{
+    if (st->depth >= plist_get_max_depth()) {
+        PLIST_XML_ERR("maximum nesting depth (%u) exceeded\n", plist_get_max_depth());
+        return XML_STREAM_ERROR;
+    }
+    if (st->depth == st->levels_size) {
+        size_t newsize = (st->levels_size) ? st->levels_size * 2 : 16;
+        struct xml_stream_level *levels = plist_realloc(st->levels, newsize * sizeof(struct xml_stream_level));
+        if (!levels) {
+            PLIST_XML_ERR("out of memory when allocating node path item\n");
+            return XML_STREAM_ERROR;
+        }
+        st->levels = levels;
+        st->levels_size = newsize;
+    }
+    st->levels[st->depth].type = type;
+    st->levels[st->depth].have_key = 0;
+    st->depth++;
+    return XML_STREAM_OK;
+}
+
+/* parses one markup token starting at ctx->pos (which points to '<').
+ * Events are only emitted once the token has been parsed completely, so an
+ * incomplete token can be retried after more input has been read. */
+/* checks whether the content of a scalar element starting at p is
+ * buffered up to the '>' of its closing tag, which is the first closing
+ * tag outside of comments and CDATA sections like for get_text_parts() */
+static int xml_stream_element_buffered(const char *p, const char *end)
+{
+    while (p < end && (p = memchr(p, '<', end - p))) {
+        struct _parse_ctx c = { p, end, 0, NULL, NULL };
+        if (end - p < 9) {
+            /* too short to tell a closing tag from a comment or CDATA */
+            return (end - p >= 2 && p[1] == '/' && memchr(p, '>', end - p));
+        }
+        if (p[1] == '/') {
+            return memchr(p, '>', end - p) != NULL;
+        }
+        if (!strncmp(p, "<!--", 4)) {
+            c.pos += 4;
+            find_str(&c, "-->", 3, 0);
+            if (c.pos > c.end-3 || strncmp(c.pos, "-->", 3)) {
+                return 0;
+            }
+            p = c.pos + 3;
+        } else if (!strncmp(p, "<![CDATA[", 9)) {
+            c.pos += 9;
+            find_str(&c, "]]>", 3, 0);
+            if (c.pos > c.end-3 || strncmp(c.pos, "]]>", 3)) {
+                return 0;
+            }
+            p = c.pos + 3;
+        } else {
+            p++;
+        }
+    }
+    return 0;
+}
+
+static int xml_stream_token(parse_ctx ctx, struct xml_stream_state *st)
+{
+    const char *p = NULL;
+    char tag[32];
+    int taglen = 0;
+    int is_empty = 0;
+
+    if (*ctx->pos != '<') {
+        PLIST_XML_ERR("Expected: opening tag\n");
+        return XML_STREAM_ERROR;
+    }
+    ctx->pos++;
+    if (ctx->pos >= ctx->end) {
+        return XML_STREAM_INCOMPLETE;
+    }
+
+    if (*(ctx->pos) == '?') {
+        find_str(ctx, "?>", 2, 1);
+        if (ctx->pos > ctx->end-2 || strncmp(ctx->pos, "?>", 2)) {
+            return XML_STREAM_INCOMPLETE;
+        }
+        ctx->pos += 2;
+        return XML_STREAM_OK;
+    } else if (*(ctx->pos) == '!') {
+        if (ctx->end - ctx->pos < 9) {
+            return XML_STREAM_INCOMPLETE;
+        }
+        if (!strncmp(ctx->pos, "!--", 3)) {
+            ctx->pos += 3;
+            find_str(ctx, "-->", 3, 0);
+            if (ctx->pos > ctx->end-3 || strncmp(ctx->pos, "-->", 3)) {
+                return XML_STREAM_INCOMPLETE;
+            }
+            ctx->pos += 3;
+            return XML_STREAM_OK;
+        } else if (!strncmp(ctx->pos, "!DOCTYPE", 8)) {
+            int embedded_dtd = 0;
+            ctx->pos += 8;
+            while (ctx->pos < ctx->end) {
+                find_next(ctx, " \t\r\n[>", 6, 1);
+                if (ctx->pos >= ctx->end) {
+                    return XML_STREAM_INCOMPLETE;
+                }
+                if (*ctx->pos == '[') {
+                    embedded_dtd = 1;
+                    break;
+                } else if (*ctx->pos == '>') {
+                    ctx->pos++;
+                    return XML_STREAM_OK;
+                } else {
+                    parse_skip_ws(ctx);
+                }
+            }
+            if (!embedded_dtd) {
+                return XML_STREAM_INCOMPLETE;
+            }
+            find_str(ctx, "]>", 2, 1);
+            if (ctx->pos > ctx->end-2 || strncmp(ctx->pos, "]>", 2)) {
+                return XML_STREAM_INCOMPLETE;
+            }
+            ctx->pos += 2;
+            return XML_STREAM_OK;
+        }
+        PLIST_XML_ERR("Invalid or incomplete special tag encountered\n");
+        return XML_STREAM_ERROR;
+    }
+
+    p = ctx->pos;
+    find_next(ctx, " \r\n\t<>", 6, 0);
+    if (ctx->pos >= ctx->end) {
+        return XML_STREAM_INCOMPLETE;
+    }
+    taglen = ctx->pos - p;
+    if (*ctx->pos != '>') {
+        find_next(ctx, "<>", 2, 1);
+    }
+    if (ctx->pos >= ctx->end) {
+        return XML_STREAM_INCOMPLETE;
+    }
+    if (*ctx->pos != '>') {
+        PLIST_XML_ERR("Missing '>' for tag <%.*s\n", taglen, p);
+        return XML_STREAM_ERROR;
+    }
+    if (taglen >= (int)sizeof(tag)) {
+        PLIST_XML_ERR("Unexpected tag <%.*s> encountered\n", taglen, p);
+        return XML_STREAM_ERROR;
+    }
+    memcpy(tag, p, taglen);
+    tag[taglen] = '\0';
+    if (*(ctx->pos-1) == '/') {
+        int idx = ctx->pos - p - 1;
+        if (idx < taglen) {
+            tag[idx] = '\0';
+            taglen = idx;
+        }
+        is_empty = 1;
+    }
+    ctx->pos++;
+
+    if (!strcmp(tag, "plist")) {
+        if (st->in_plist && st->has_content) {
+            /* we don't allow another top-level <plist> */
+            st->finished = 1;
+            return XML_STREAM_OK;
+        }
+        if (is_empty) {
+            PLIST_XML_ERR("Empty plist tag\n");
+            return XML_STREAM_ERROR;
+        }
+        st->in_plist++;
+        return XML_STREAM_OK;
+    } else if (!strcmp(tag, "/plist")) {
+        if (!st->has_content) {
+            PLIST_XML_ERR("encountered empty plist tag\n");
+            return XML_STREAM_ERROR;
+        }
+        if (!st->in_plist || st->depth > 0) {
+            PLIST_XML_ERR("mismatching closing tag <%s> found\n", tag);
+            return XML_STREAM_ERROR;
+        }
+        st->in_plist--;
+        return XML_STREAM_OK;
+    }
+
+    if (st->finished) {
+        return XML_STREAM_OK;
+    }
+
+    if (!strcmp(tag, XPLIST_DICT) || !strcmp(tag, XPLIST_ARRAY)) {
+        int is_dict = (tag[0] == 'd');
+        if (xml_stream_begin_value(st) < 0) {
+            return XML_STREAM_ERROR;
+        }
+        if (!is_empty && xml_stream_push(st, (is_dict) ? PLIST_DICT : PLIST_ARRAY) < 0) {
+            return XML_STREAM_ERROR;
+        }
+        st->has_content = 1;
+        if (((is_dict) ? xml_stream_emit(st, st->handler->begin_dict) : xml_stream_emit(st, st->handler->begin_array)) != 0) {
+            return XML_STREAM_STOP;
+        }
+        if (is_empty) {
+            if (((is_dict) ? xml_stream_emit(st, st->handler->end_dict) : xml_stream_emit(st, st->handler->end_array)) != 0) {
+                return XML_STREAM_STOP;
+            }
+            if (st->depth == 0) {
+                st->finished = 1;
+            }
+        }
+        return XML_STREAM_OK;
+    } else if (tag[0] == '/') {
+        struct xml_stream_level *level = (st->depth > 0) ? &st->levels[st->depth-1] : NULL;
+        const char *type = (level) ? ((level->type == PLIST_DICT) ? XPLIST_DICT : XPLIST_ARRAY) : NULL;
+        if (!type) {
+            PLIST_XML_ERR("node path is empty while trying to match closing tag with opening tag\n");
+            return XML_STREAM_ERROR;
+        }
+        if (strcmp(type, tag+1) != 0) {
+            PLIST_XML_ERR("unexpected %s found (for opening %s)\n", tag, type);
+            return XML_STREAM_ERROR;
+        }
+        st->depth--;
+        if (((level->type == PLIST_DICT) ? xml_stream_emit(st, st->handler->end_dict) : xml_stream_emit(st, st->handler->end_array)) != 0) {
+            return XML_STREAM_STOP;
+        }
+        if (st->depth == 0) {
+            st->finished = 1;
+        }
+        return XML_STREAM_OK;
+    }
+
+    /* scalar element or key */
+    int is_key = (!is_empty && !strcmp(tag, XPLIST_KEY) && st->depth > 0
+                  && st->levels[st->depth-1].type == PLIST_DICT && !st->levels[st->depth-1].have_key);
+    if (!is_empty && !xml_stream_element_buffered(ctx->pos, ctx->end)) {
+        return XML_STREAM_INCOMPLETE;
+    }
+    plist_data_t data = plist_new_plist_data();
+    plist_t node = plist_new_node(data);
+    int res = parse_scalar_element(ctx, tag, taglen, is_empty, data, NULL);
+    if (res != 0) {
+        plist_free(node);
+        if (res > 0) {
+            PLIST_XML_ERR("Unexpected tag <%s%s> encountered\n", tag, (is_empty) ? "/" : "");
+        }
+        /* the whole element is buffered, so the content is malformed */
+        return XML_STREAM_ERROR;
+    }
+
+    st->has_content = 1;
+    if (is_key) {
+        st->levels[st->depth-1].have_key = 1;
+        res = (st->handler->key) ? st->handler->key(st->user_data, data->strval, (size_t)data->length) : 0;
+    } else {
+        if (xml_stream_begin_value(st) < 0) {
+            plist_free(node);
+            return XML_STREAM_ERROR;
+        }
+        res = (st->handler->value) ? st->handler->value(st->user_data, node) : 0;
+        if (st->depth == 0) {
+            st->finished = 1;
+        }
+    }
+    plist_free(node);
+
+    return (res != 0) ? XML_STREAM_STOP : XML_STREAM_OK;
+}
+
+PLIST_API int plist_xml_parse_stream(plist_read_func_t reader, const plist_xml_handler_t *handler, void *user_data)
+{
+    static const plist_xml_handler_t no_handler = { NULL, NULL, NULL, NULL, NULL, NULL };
+    struct xml_stream_state st;
+    char *buf = NULL;
+    size_t buf_size = 0;
+    size_t buf_len = 0;
+    size_t buf_pos = 0;
+    int eof = 0;
+    int res = XML_STREAM_OK;
+
+    if (!reader) {
+        return -1;
+    }
+
+    memset(&st, '\0', sizeof(st));
+    st.handler = (handler) ? handler : &no_handler;
+    st.user_data = user_data;
+
+    while (!st.finished) {
+        struct _parse_ctx ctx = { buf + buf_pos, buf + buf_len, 0, NULL, NULL };
+        int need_more = 0;
+
+        parse_skip_ws(&ctx);
+        buf_pos = ctx.pos - buf;
+        if (ctx.pos >= ctx.end) {
+            need_more = 1;
+        } else {
+            res = xml_stream_token(&ctx, &st);
+            if (res == XML_STREAM_INCOMPLETE) {
+                need_more = 1;
+            } else if (res != XML_STREAM_OK) {
+                break;
+            } else {
+                buf_pos = ctx.pos - buf;
+            }
+        }
+
+        if (!need_more) {
+            continue;
+        }
+        if (eof) {
+            if (buf_pos < buf_len || st.depth > 0 || !st.has_content) {
+                PLIST_XML_ERR("EOF encountered while parsing XML stream\n");
+                res = XML_STREAM_ERROR;
+            } else {
+                res = XML_STREAM_OK;
+            }
+            break;
+        }
+
+        /* drop consumed input and make room for at least as much as is buffered */
+        if (buf_pos > 0) {
+            memmove(buf, buf + buf_pos, buf_len - buf_pos);
+            buf_len -= buf_pos;
+            buf_pos = 0;
+        }
+        size_t want = (buf_len > XML_STREAM_CHUNK_SIZE) ? buf_len : XML_STREAM_CHUNK_SIZE;
+        if (buf_size - buf_len < want) {
+            char *newbuf = plist_realloc(buf, buf_len + want);
+            if (!newbuf) {
+                PLIST_XML_ERR("out of memory while reading XML stream\n");
+                res = XML_STREAM_ERROR;
+                break;
+            }
+            buf = newbuf;
+            buf_size = buf_len + want;
+        }
+        /* an incomplete token is parsed again only once the buffer has
+         * doubled, so a large token is not rescanned for every small read */
+        size_t target = (buf_len > 0) ? 2 * buf_len : 1;
+        while (!eof && buf_len < target) {
+            size_t n = reader(user_data, buf + buf_len, buf_size - buf_len);
+            if (n == 0) {
+                eof = 1;
+            }
+            buf_len += n;
+        }
+    }
+
+    plist_mem_free(buf);
+    plist_mem_free(st.levels);
+
+    if (res == XML_STREAM_STOP) {
+        return 1;
+    }
+    return (res == XML_STREAM_OK) ? 0 : -1;
 }
@@ -0,0 +1,304 @@
+/*
+ * plist_access_test.cpp
+ * checks the typed accessors and visit() of the C++ binding, built as
+ * C++11 and as C++17
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <plist/Access.h>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace PList;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// one node of every type, the key node is taken from a dictionary
+struct Sample
+{
+    plist_t boolean;
+    plist_t uint;
+    plist_t negative;
+    plist_t real;
+    plist_t string;
+    plist_t key;
+    plist_t data;
+    plist_t date;
+    plist_t uid;
+    plist_t array;
+    plist_t dict;
+};
+
+static void create_sample(Sample& s)
+{
+    s.boolean = plist_new_bool(1);
+    s.uint = plist_new_uint(42);
+    s.negative = plist_new_uint((uint64_t)-7);
+    s.real = plist_new_real(1.5);
+    s.string = plist_new_string("text");
+    s.key = plist_new_string("name");
+    plist_set_key_val(s.key, "name");
+    s.data = plist_new_data("a\0b", 3);
+    s.date = plist_new_date(1000, 500000);
+    s.uid = plist_new_uid(9);
+    s.array = plist_new_array();
+    plist_array_append_item(s.array, plist_new_uint(1));
+    plist_array_append_item(s.array, plist_new_uint(2));
+    s.dict = plist_new_dict();
+    plist_dict_set_item(s.dict, "a", plist_new_bool(0));
+}
+
+static void free_sample(Sample& s)
+{
+    plist_free(s.boolean);
+    plist_free(s.uint);
+    plist_free(s.negative);
+    plist_free(s.real);
+    plist_free(s.string);
+    plist_free(s.key);
+    plist_free(s.data);
+    plist_free(s.date);
+    plist_free(s.uid);
+    plist_free(s.array);
+    plist_free(s.dict);
+}
+
+static void check_accessors(const Sample& s)
+{
+    bool b = false;
+    CHECK(get(s.boolean, b) && b);
+    CHECK(get<bool>(s.boolean));
+
+    uint64_t u = 0;
+    CHECK(get(s.uint, u) && u == 42);
+    CHECK(get<uint64_t>(s.uint) == 42);
+
+    int64_t i = 0;
+    CHECK(get(s.negative, i) && i == -7);
+    CHECK(get<int64_t>(s.uint) == 42);
+
+    double d = 0;
+    CHECK(get(s.real, d) && d == 1.5);
+
+    StringRef sr = StringRef();
+    CHECK(get(s.string, sr) && sr.size == 4 && sr.str() == "text");
+
+    KeyRef kr = KeyRef();
+    CHECK(get(s.key, kr) && kr.size == 4 && kr.str() == "name");
+
+    const char* cs = NULL;
+    CHECK(get(s.string, cs) && cs && strcmp(cs, "text") == 0);
+
+    std::string str;
+    CHECK(get(s.string, str) && str == "text");
+    CHECK(get<std::string>(s.string) == "text");
+
+    DataRef dr = DataRef();
+    CHECK(get(s.data, dr) && dr.size == 3 && memcmp(dr.data, "a\0b", 3) == 0);
+
+    timeval tv = timeval();
+    CHECK(get(s.date, tv) && tv.tv_sec == 1000 && tv.tv_usec == 500000);
+
+    UidValue uid = UidValue();
+    CHECK(get(s.uid, uid) && uid.value == 9);
+
+    ArrayView av;
+    CHECK(get(s.array, av) && av.GetPlist() == s.array && av.GetSize() == 2);
+
+    DictView dv;
+    CHECK(get(s.dict, dv) && dv.GetPlist() == s.dict && dv.GetSize() == 1);
+
+#if __cplusplus >= 201703L
+    std::string_view sv;
+    CHECK(get(s.string, sv) && sv == "text");
+    CHECK(get<std::string_view>(s.string) == "text");
+    CHECK(std::string_view(get<StringRef>(s.string)) == "text");
+#endif
+
+    CHECK(is<bool>(s.boolean));
+    CHECK(is<uint64_t>(s.uint) && is<int64_t>(s.uint));
+    CHECK(is<double>(s.real));
+    CHECK(is<std::string>(s.string) && is<StringRef>(s.string) && is<const char*>(s.string));
+    CHECK(is<KeyRef>(s.key));
+    CHECK(is<DataRef>(s.data));
+    CHECK(is<timeval>(s.date));
+    CHECK(is<UidValue>(s.uid));
+    CHECK(is<ArrayView>(s.array));
+    CHECK(is<DictView>(s.dict));
+}
+
+// every accessor has to leave out alone for a wrong type or NULL
+template<typename T> static void check_rejects(plist_t node, const T& sentinel)
+{
+    T out = sentinel;
+    CHECK(!get(node, out));
+    CHECK(memcmp(&out, &sentinel, sizeof(T)) == 0);
+    CHECK(!is<T>(node));
+}
+
+static void check_wrong_type(const Sample& s)
+{
+    plist_t nodes[] = { s.string, NULL };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(nodes)/sizeof(nodes[0]); i++)
+    {
+        check_rejects<bool>(nodes[i], true);
+        check_rejects<uint64_t>(nodes[i], 5);
+        check_rejects<int64_t>(nodes[i], -5);
+        check_rejects<double>(nodes[i], 2.5);
+        check_rejects<DataRef>(nodes[i], DataRef());
+        check_rejects<timeval>(nodes[i], timeval());
+        check_rejects<UidValue>(nodes[i], UidValue());
+    }
+
+    // the string types must not accept keys or anything else
+    plist_t others[] = { s.key, s.uint, NULL };
+    for (i = 0; i < sizeof(others)/sizeof(others[0]); i++)
+    {
+        check_rejects<StringRef>(others[i], StringRef());
+        check_rejects<const char*>(others[i], "unchanged");
+        std::string str("unchanged");
+        CHECK(!get(others[i], str) && str == "unchanged");
+        CHECK(get<std::string>(others[i]).empty());
+#if __cplusplus >= 201703L
+        std::string_view sv("unchanged");
+        CHECK(!get(others[i], sv) && sv == "unchanged");
+#endif
+    }
+    check_rejects<KeyRef>(s.string, KeyRef());
+    check_rejects<KeyRef>(NULL, KeyRef());
+
+    ArrayView av;
+    CHECK(!get(s.dict, av) && !av.IsValid());
+    CHECK(!get<ArrayView>(NULL).IsValid());
+    DictView dv;
+    CHECK(!get(s.array, dv) && !dv.IsValid());
+    CHECK(!is<DictView>(NULL));
+
+    // value initialized defaults
+    CHECK(get<uint64_t>(s.string) == 0);
+    CHECK(get<double>(NULL) == 0);
+    CHECK(!get<bool>(s.uint));
+    CHECK(get<const char*>(s.key) == NULL);
+}
+
+// reports the type each overload was called with
+struct TypeOf
+{
+    plist_type operator()(bool) const { return PLIST_BOOLEAN; }
+    plist_type operator()(uint64_t) const { return PLIST_UINT; }
+    plist_type operator()(double) const { return PLIST_REAL; }
+    plist_type operator()(StringRef) const { return PLIST_STRING; }
+    plist_type operator()(KeyRef) const { return PLIST_KEY; }
+    plist_type operator()(DataRef) const { return PLIST_DATA; }
+    plist_type operator()(timeval) const { return PLIST_DATE; }
+    plist_type operator()(UidValue) const { return PLIST_UID; }
+    plist_type operator()(ArrayView) const { return PLIST_ARRAY; }
+    plist_type operator()(DictView) const { return PLIST_DICT; }
+    plist_type operator()(None) const { return PLIST_NONE; }
+};
+
+static void check_visit(const Sample& s)
+{
+    plist_t nodes[] = { s.boolean, s.uint, s.real, s.string, s.array, s.dict, s.date, s.data, s.key, s.uid };
+    unsigned int i;
+
+    for (i = 0; i < sizeof(nodes)/sizeof(nodes[0]); i++)
+    {
+        CHECK(visit(nodes[i], TypeOf()) == plist_get_node_type(nodes[i]));
+    }
+    CHECK(visit(NULL, TypeOf()) == PLIST_NONE);
+
+    // the visited values are the ones get() returns
+    struct Values
+    {
+        std::string operator()(bool v) const { return v ? "true" : "false"; }
+        std::string operator()(uint64_t v) const { return std::to_string(v); }
+        std::string operator()(double v) const { return std::to_string(v); }
+        std::string operator()(StringRef v) const { return "s:" + v.str(); }
+        std::string operator()(KeyRef v) const { return "k:" + v.str(); }
+        std::string operator()(DataRef v) const { return std::to_string(v.size); }
+        std::string operator()(timeval v) const { return std::to_string(v.tv_sec); }
+        std::string operator()(UidValue v) const { return "u" + std::to_string(v.value); }
+        std::string operator()(ArrayView v) const { return "a" + std::to_string(v.GetSize()); }
+        std::string operator()(DictView v) const { return "d" + std::to_string(v.GetSize()); }
+        std::string operator()(None) const { return "none"; }
+    };
+    CHECK(visit(s.boolean, Values()) == "true");
+    CHECK(visit(s.uint, Values()) == "42");
+    CHECK(visit(s.string, Values()) == "s:text");
+    CHECK(visit(s.key, Values()) == "k:name");
+    CHECK(visit(s.data, Values()) == "3");
+    CHECK(visit(s.date, Values()) == "1000");
+    CHECK(visit(s.uid, Values()) == "u9");
+    CHECK(visit(s.array, Values()) == "a2");
+    CHECK(visit(s.dict, Values()) == "d1");
+    CHECK(visit(NULL, Values()) == "none");
+
+#if __cplusplus >= 201703L
+    for (i = 0; i < sizeof(nodes)/sizeof(nodes[0]); i++)
+    {
+        plist_type type = visit(nodes[i], overloaded{
+            [](uint64_t) { return PLIST_UINT; },
+            [](StringRef) { return PLIST_STRING; },
+            [](KeyRef) { return PLIST_KEY; },
+            [](auto) { return PLIST_NONE; } });
+        plist_type expected = plist_get_node_type(nodes[i]);
+        if (expected != PLIST_UINT && expected != PLIST_STRING && expected != PLIST_KEY)
+        {
+            expected = PLIST_NONE;
+        }
+        CHECK(type == expected);
+    }
+    uint64_t sum = 0;
+    for (View item : get<ArrayView>(s.array))
+    {
+        visit(item.GetPlist(), overloaded{
+            [&](uint64_t v) { sum += v; },
+            [](auto) {} });
+    }
+    CHECK(sum == 3);
+#endif
+}
+
+int main(void)
+{
+    Sample s;
+
+    create_sample(s);
+    check_accessors(s);
+    check_wrong_type(s);
+    check_visit(s);
+    free_sample(s);
+
+    if (failures > 0)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("C++ accessor tests succeeded (C++%ld)\n", (long)(__cplusplus / 100 % 100));
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * plist_alloc_test.c
+ * checks that all memory goes through the allocator set with
+ * plist_set_allocator and the one given to an arena
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOCK_MAGIC 0x706c6973u
+/* keeps the returned memory aligned for any type */
+#define BLOCK_HDR 16
+
+struct counter {
+    long live;
+    long total;
+    long bad_frees;
+};
+
+static struct counter global_counter;
+static struct counter arena_counter;
+
+static void *test_malloc(size_t size, void *ctx)
+{
+    struct counter *c = (struct counter*)ctx;
+    unsigned char *p = (unsigned char*)malloc(size + BLOCK_HDR);
+    if (!p) {
+        return NULL;
+    }
+    *(unsigned int*)p = BLOCK_MAGIC;
+    c->live++;
+    c->total++;
+    return p + BLOCK_HDR;
+}
+
+static void test_free(void *ptr, void *ctx)
+{
+    struct counter *c = (struct counter*)ctx;
+    unsigned char *p = (unsigned char*)ptr - BLOCK_HDR;
+    if (*(unsigned int*)p != BLOCK_MAGIC) {
+        c->bad_frees++;
+        return;
+    }
+    *(unsigned int*)p = 0;
+    c->live--;
+    free(p);
+}
+
+static void *test_realloc(void *ptr, size_t size, void *ctx)
+{
+    unsigned char *p = NULL;
+    if (!ptr) {
+        return test_malloc(size, ctx);
+    }
+    p = (unsigned char*)ptr - BLOCK_HDR;
+    if (*(unsigned int*)p != BLOCK_MAGIC) {
+        ((struct counter*)ctx)->bad_frees++;
+        return NULL;
+    }
+    p = (unsigned char*)realloc(p, size + BLOCK_HDR);
+    return p ? p + BLOCK_HDR : NULL;
+}
+
+static plist_t build_tree(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t array = plist_new_array();
+    char key[32];
+    uint32_t i = 0;
+
+    for (i = 0; i < 500; i++) {
+        snprintf(key, sizeof(key), "key %u", i);
+        plist_dict_set_item(root, key, plist_new_string("a string that is not stored inline"));
+    }
+    for (i = 0; i < 100; i++) {
+        plist_array_append_item(array, plist_new_uint(i));
+        plist_array_append_item(array, plist_new_real(i * 0.5));
+        plist_array_append_item(array, plist_new_data("\x01\x02\x03", 3));
+        plist_array_append_item(array, plist_new_string("\xc3\xa4\xc3\xb6\xc3\xbc"));
+    }
+    plist_dict_set_item(root, "array", array);
+    return root;
+}
+
+static int exercise(plist_arena_t arena)
+{
+    plist_t root = build_tree();
+    plist_t parsed = NULL;
+    plist_t copy = NULL;
+    plist_dict_iter it = NULL;
+    char *bin = NULL;
+    char *xml = NULL;
+    char *key = NULL;
+    char *str = NULL;
+    char *data = NULL;
+    uint64_t length = 0;
+    uint32_t bin_size = 0;
+    uint32_t xml_size = 0;
+    plist_t val = NULL;
+    int res = 0;
+
+    plist_to_bin(root, &bin, &bin_size);
+    plist_to_xml(root, &xml, &xml_size);
+    if (!bin || !xml) {
+        printf("Writing failed\n");
+        return 1;
+    }
+
+    if (arena) {
+        plist_from_bin_arena(bin, bin_size, &parsed, arena);
+    } else {
+        plist_from_bin(bin, bin_size, &parsed);
+    }
+    if (!parsed || plist_dict_get_size(parsed) != 501) {
+        printf("Binary round trip failed\n");
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    if (arena) {
+        plist_from_xml_arena(xml, xml_size, &parsed, arena);
+    } else {
+        plist_from_xml(xml, xml_size, &parsed);
+    }
+    if (!parsed || plist_dict_get_size(parsed) != 501) {
+        printf("XML round trip failed\n");
+        res = 1;
+    }
+
+    copy = plist_copy(parsed);
+    plist_dict_new_iter(copy, &it);
+    plist_dict_next_item(copy, it, &key, &val);
+    plist_mem_free(key);
+    plist_mem_free(it);
+    plist_get_string_val(plist_dict_get_item(copy, "key 1"), &str);
+    plist_mem_free(str);
+    plist_get_data_val(plist_array_get_item(plist_dict_get_item(copy, "array"), 2), &data, &length);
+    plist_mem_free(data);
+    plist_free(copy);
+    plist_free(parsed);
+
+    plist_mem_free(bin);
+    plist_mem_free(xml);
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_arena_t arena = NULL;
+    int res = 0;
+
+    if (plist_set_allocator(test_malloc, NULL, test_free, NULL) != -1) {
+        printf("An incomplete allocator must be rejected\n");
+        return 1;
+    }
+    if (plist_set_allocator(test_malloc, test_realloc, test_free, &global_counter) != 0) {
+        printf("Could not set the allocator\n");
+        return 1;
+    }
+
+    res |= exercise(NULL);
+    if (global_counter.total == 0 || global_counter.live != 0 || global_counter.bad_frees != 0) {
+        printf("Global allocator: %ld allocations, %ld leaked, %ld bad frees\n", global_counter.total, global_counter.live, global_counter.bad_frees);
+        res = 1;
+    }
+
+    /* the trees of the arena come from the arena allocator */
+    arena = plist_arena_new_with_allocator(PLIST_ARENA_DEFAULT, test_malloc, test_free, &arena_counter);
+    if (!arena) {
+        printf("Could not create an arena\n");
+        return 1;
+    }
+    res |= exercise(arena);
+    if (arena_counter.total == 0) {
+        printf("The arena allocator was not used\n");
+        res = 1;
+    }
+    plist_arena_free(arena);
+    if (arena_counter.live != 0 || arena_counter.bad_frees != 0 || global_counter.live != 0 || global_counter.bad_frees != 0) {
+        printf("Arena allocator: %ld leaked, %ld bad frees\n", arena_counter.live + global_counter.live, arena_counter.bad_frees + global_counter.bad_frees);
+        res = 1;
+    }
+
+    plist_set_allocator(NULL, NULL, NULL, NULL);
+    res |= exercise(NULL);
+
+    if (res == 0) {
+        printf("All allocations went through the allocators\n");
+    }
+    return res;
+}
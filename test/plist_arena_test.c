@@ -0,0 +1,232 @@
+/*
+ * plist_arena_test.c
+ * checks that arena-backed, borrowing and lazy parsers yield the same trees
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+int main(int argc, char *argv[])
+{
+    FILE *iplist = NULL;
+    plist_t root_heap = NULL;
+    plist_t root_xml = NULL;
+    plist_t root_bin = NULL;
+    plist_t root_borrow = NULL;
+    plist_t root_lazy = NULL;
+    plist_t root_lazy_src = NULL;
+    plist_t root_lazy_copy = NULL;
+    plist_t root_untouched = NULL;
+    plist_t root_file = NULL;
+    plist_t root_mapped = NULL;
+    plist_mapping_t mapping = NULL;
+    plist_t root_interned_xml = NULL;
+    plist_t root_interned_bin = NULL;
+    plist_arena_t arena = NULL;
+    plist_arena_t intern_arena = NULL;
+    char *plist_xml = NULL;
+    char *plist_bin = NULL;
+    char *xml_heap = NULL;
+    char *xml_arena = NULL;
+    char *xml_arena_bin = NULL;
+    char *xml_borrow = NULL;
+    char *xml_lazy = NULL;
+    char *xml_lazy_copy = NULL;
+    char *xml_file = NULL;
+    char *xml_mapped = NULL;
+    char *xml_interned_xml = NULL;
+    char *xml_interned_bin = NULL;
+    uint32_t bin_size = 0;
+    uint32_t size_heap = 0;
+    uint32_t size_arena = 0;
+    uint32_t size_arena_bin = 0;
+    uint32_t size_borrow = 0;
+    uint32_t size_lazy = 0;
+    uint32_t size_lazy_copy = 0;
+    uint32_t size_file = 0;
+    uint32_t size_mapped = 0;
+    uint32_t size_interned_xml = 0;
+    uint32_t size_interned_bin = 0;
+    struct stat filestats;
+    int res = 0;
+
+    if (argc != 3) {
+        printf("Wrong input\n");
+        return 1;
+    }
+
+    iplist = fopen(argv[1], "rb");
+    if (!iplist) {
+        printf("File does not exists\n");
+        return 2;
+    }
+    stat(argv[1], &filestats);
+    plist_xml = (char*)malloc(filestats.st_size + 1);
+    fread(plist_xml, 1, filestats.st_size, iplist);
+    fclose(iplist);
+
+    plist_from_xml(plist_xml, filestats.st_size, &root_heap);
+    if (!root_heap) {
+        printf("PList XML parsing failed\n");
+        return 3;
+    }
+    plist_to_xml(root_heap, &xml_heap, &size_heap);
+    plist_to_bin(root_heap, &plist_bin, &bin_size);
+
+    arena = plist_arena_new();
+    if (!arena) {
+        printf("Could not create arena\n");
+        return 4;
+    }
+
+    plist_from_xml_arena(plist_xml, filestats.st_size, &root_xml, arena);
+    if (!root_xml) {
+        printf("PList XML parsing into arena failed\n");
+        return 5;
+    }
+    plist_to_xml(root_xml, &xml_arena, &size_arena);
+
+    plist_from_bin_arena(plist_bin, bin_size, &root_bin, arena);
+    if (!root_bin) {
+        printf("PList BIN parsing into arena failed\n");
+        return 6;
+    }
+    plist_to_xml(root_bin, &xml_arena_bin, &size_arena_bin);
+
+    intern_arena = plist_arena_new_ex(PLIST_ARENA_INTERN_KEYS);
+    plist_from_xml_arena(plist_xml, filestats.st_size, &root_interned_xml, intern_arena);
+    plist_from_bin_arena(plist_bin, bin_size, &root_interned_bin, intern_arena);
+    if (!root_interned_xml || !root_interned_bin) {
+        printf("PList parsing into arena with interned keys failed\n");
+        return 14;
+    }
+    plist_to_xml(root_interned_xml, &xml_interned_xml, &size_interned_xml);
+    plist_to_xml(root_interned_bin, &xml_interned_bin, &size_interned_bin);
+
+    plist_from_bin_ex(plist_bin, bin_size, PLIST_PARSE_BORROW, &root_borrow);
+    if (!root_borrow) {
+        printf("PList BIN parsing with borrowed data failed\n");
+        return 9;
+    }
+    plist_to_xml(root_borrow, &xml_borrow, &size_borrow);
+
+    plist_from_bin_ex(plist_bin, bin_size, PLIST_PARSE_LAZY, &root_lazy);
+    plist_from_bin_ex(plist_bin, bin_size, PLIST_PARSE_LAZY, &root_lazy_src);
+    plist_from_bin_ex(plist_bin, bin_size, PLIST_PARSE_LAZY | PLIST_PARSE_BORROW, &root_untouched);
+    if (!root_lazy || !root_lazy_src || !root_untouched) {
+        printf("PList BIN lazy parsing failed\n");
+        return 11;
+    }
+    plist_to_xml(root_lazy, &xml_lazy, &size_lazy);
+    root_lazy_copy = plist_copy(root_lazy_src);
+    plist_to_xml(root_lazy_copy, &xml_lazy_copy, &size_lazy_copy);
+
+    /* without a mapping the file is gone before the tree is walked */
+    iplist = fopen(argv[2], "wb");
+    if (!iplist || fwrite(plist_bin, 1, bin_size, iplist) != bin_size) {
+        printf("Could not write %s\n", argv[2]);
+        return 17;
+    }
+    fclose(iplist);
+    if (plist_read_from_file_ex(argv[2], PLIST_PARSE_LAZY, &root_file, NULL, NULL) != 0) {
+        printf("PList BIN lazy parsing from file failed\n");
+        return 18;
+    }
+    plist_to_xml(root_file, &xml_file, &size_file);
+    if (plist_read_from_file_ex(argv[2], PLIST_PARSE_LAZY | PLIST_PARSE_BORROW, &root_mapped, NULL, &mapping) != 0) {
+        printf("PList BIN lazy parsing from mapped file failed\n");
+        return 18;
+    }
+    plist_to_xml(root_mapped, &xml_mapped, &size_mapped);
+
+    if (size_heap != size_arena || memcmp(xml_heap, xml_arena, size_heap) != 0) {
+        printf("XML output of arena tree (from XML) differs\n");
+        res = 7;
+    }
+    if (size_heap != size_arena_bin || memcmp(xml_heap, xml_arena_bin, size_heap) != 0) {
+        printf("XML output of arena tree (from BIN) differs\n");
+        res = 8;
+    }
+    if (size_heap != size_borrow || memcmp(xml_heap, xml_borrow, size_heap) != 0) {
+        printf("XML output of tree with borrowed data differs\n");
+        res = 10;
+    }
+    if (size_heap != size_lazy || memcmp(xml_heap, xml_lazy, size_heap) != 0) {
+        printf("XML output of lazily parsed tree differs\n");
+        res = 12;
+    }
+    if (size_heap != size_lazy_copy || memcmp(xml_heap, xml_lazy_copy, size_heap) != 0) {
+        printf("XML output of copied lazy tree differs\n");
+        res = 13;
+    }
+    if (size_heap != size_file || memcmp(xml_heap, xml_file, size_heap) != 0) {
+        printf("XML output of lazy tree read from file differs\n");
+        res = 19;
+    }
+    if (size_heap != size_mapped || memcmp(xml_heap, xml_mapped, size_heap) != 0) {
+        printf("XML output of lazy tree read from mapped file differs\n");
+        res = 20;
+    }
+
+    if (size_heap != size_interned_xml || memcmp(xml_heap, xml_interned_xml, size_heap) != 0) {
+        printf("XML output of tree with interned keys (from XML) differs\n");
+        res = 15;
+    }
+    if (size_heap != size_interned_bin || memcmp(xml_heap, xml_interned_bin, size_heap) != 0) {
+        printf("XML output of tree with interned keys (from BIN) differs\n");
+        res = 16;
+    }
+
+    /* must be harmless on arena nodes */
+    plist_free(root_xml);
+    plist_arena_free(arena);
+    plist_arena_free(intern_arena);
+    plist_free(root_heap);
+    plist_free(root_borrow);
+    plist_free(root_lazy_copy);
+    plist_free(root_lazy);
+    plist_free(root_lazy_src);
+    plist_free(root_untouched);
+    plist_free(root_file);
+    plist_free(root_mapped);
+    plist_mapping_free(mapping);
+    free(plist_xml);
+    free(plist_bin);
+    free(xml_heap);
+    free(xml_arena);
+    free(xml_arena_bin);
+    free(xml_borrow);
+    free(xml_lazy);
+    free(xml_lazy_copy);
+    free(xml_file);
+    free(xml_mapped);
+    free(xml_interned_xml);
+    free(xml_interned_bin);
+
+    if (res == 0) {
+        printf("Arena, borrowed and lazy parsing succeeded\n");
+    }
+    return res;
+}
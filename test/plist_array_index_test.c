@@ -0,0 +1,199 @@
+/*
+ * plist_array_index_test.c
+ * checks indexed access to arrays with and without an item vector
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ITEMS 2000
+#define NUM_OPS 5000
+
+static uint64_t expected[MAX_ITEMS];
+static uint32_t expected_size = 0;
+
+static int check_items(plist_t array, const char *what)
+{
+    uint64_t val = 0;
+    uint32_t i = 0;
+
+    if (plist_array_get_size(array) != expected_size) {
+        printf("%s: array has %u items instead of %u\n", what, plist_array_get_size(array), expected_size);
+        return 1;
+    }
+    for (i = 0; i < expected_size; i++) {
+        plist_t item = plist_array_get_item(array, i);
+        plist_get_uint_val(item, &val);
+        if (!item || val != expected[i]) {
+            printf("%s: item %u has value %llu instead of %llu\n", what, i, (unsigned long long)val, (unsigned long long)expected[i]);
+            return 1;
+        }
+        if (plist_array_get_item_index(item) != i) {
+            printf("%s: item %u reports index %u\n", what, i, plist_array_get_item_index(item));
+            return 1;
+        }
+    }
+    if (plist_array_get_item(array, expected_size)) {
+        printf("%s: found an item past the end\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+/* applies random modifications to array and the expected values */
+static int modify(plist_t array, const char *what)
+{
+    uint32_t i = 0;
+    uint32_t pos = 0;
+
+    for (i = 0; i < NUM_OPS; i++) {
+        uint64_t val = 100000 + i;
+        switch (rand() % 4) {
+        case 0:
+            if (expected_size >= MAX_ITEMS) {
+                break;
+            }
+            plist_array_append_item(array, plist_new_uint(val));
+            expected[expected_size++] = val;
+            break;
+        case 1:
+            if (expected_size >= MAX_ITEMS) {
+                break;
+            }
+            pos = rand() % (expected_size + 1);
+            plist_array_insert_item(array, plist_new_uint(val), pos);
+            memmove(&expected[pos + 1], &expected[pos], (expected_size - pos) * sizeof(uint64_t));
+            expected[pos] = val;
+            expected_size++;
+            break;
+        case 2:
+            if (expected_size == 0) {
+                break;
+            }
+            pos = rand() % expected_size;
+            if (rand() % 2) {
+                plist_array_remove_item(array, pos);
+            } else {
+                plist_free(plist_array_get_item(array, pos));
+            }
+            memmove(&expected[pos], &expected[pos + 1], (expected_size - pos - 1) * sizeof(uint64_t));
+            expected_size--;
+            break;
+        default:
+            if (expected_size == 0) {
+                break;
+            }
+            pos = rand() % expected_size;
+            plist_array_set_item(array, plist_new_uint(val), pos);
+            expected[pos] = val;
+            break;
+        }
+    }
+    return check_items(array, what);
+}
+
+int main(int argc, char *argv[])
+{
+    plist_t array = plist_new_array();
+    plist_t parsed = NULL;
+    plist_t copy = NULL;
+    plist_arena_t arena = NULL;
+    char *bin = NULL;
+    char *xml = NULL;
+    uint32_t bin_size = 0;
+    uint32_t xml_size = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    srand(12345);
+
+    /* small arrays use the linked list, larger ones the item vector */
+    for (i = 0; i < 10; i++) {
+        plist_array_append_item(array, plist_new_uint(i));
+        expected[expected_size++] = i;
+    }
+    res |= check_items(array, "small");
+    for (i = 10; i < 1000; i++) {
+        plist_array_append_item(array, plist_new_uint(i));
+        expected[expected_size++] = i;
+    }
+    res |= check_items(array, "large");
+    res |= modify(array, "modified");
+
+    copy = plist_copy(array);
+    res |= check_items(copy, "copy");
+    res |= modify(copy, "modified copy");
+    plist_free(copy);
+
+    /* trees coming from the parsers */
+    plist_free(array);
+    array = plist_new_array();
+    for (i = 0; i < expected_size; i++) {
+        plist_array_append_item(array, plist_new_uint(expected[i]));
+    }
+    plist_to_bin(array, &bin, &bin_size);
+    plist_to_xml(array, &xml, &xml_size);
+    plist_free(array);
+
+    plist_from_bin(bin, bin_size, &parsed);
+    res |= check_items(parsed, "binary");
+    res |= modify(parsed, "modified binary");
+    plist_free(parsed);
+    parsed = NULL;
+
+    /* the expected values changed, start over from the written plist */
+    plist_from_xml(xml, xml_size, &parsed);
+    expected_size = plist_array_get_size(parsed);
+    for (i = 0; i < expected_size; i++) {
+        plist_get_uint_val(plist_array_get_item(parsed, i), &expected[i]);
+    }
+    res |= modify(parsed, "modified XML");
+    plist_free(parsed);
+    parsed = NULL;
+
+    arena = plist_arena_new();
+    plist_from_bin_arena(bin, bin_size, &parsed, arena);
+    expected_size = plist_array_get_size(parsed);
+    for (i = 0; i < expected_size; i++) {
+        plist_get_uint_val(plist_array_get_item(parsed, i), &expected[i]);
+    }
+    /* nodes created with plist_new_* are not released by the arena, so
+     * only remove items here */
+    for (i = 0; i < 300 && expected_size > 0; i++) {
+        uint32_t pos = rand() % expected_size;
+        if (i % 2) {
+            plist_array_remove_item(parsed, pos);
+        } else {
+            plist_free(plist_array_get_item(parsed, pos));
+        }
+        memmove(&expected[pos], &expected[pos + 1], (expected_size - pos - 1) * sizeof(uint64_t));
+        expected_size--;
+    }
+    res |= check_items(parsed, "arena");
+    plist_arena_free(arena);
+
+    plist_mem_free(bin);
+    plist_mem_free(xml);
+
+    if (res == 0) {
+        printf("Indexed array access succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,474 @@
+/*
+ * plist_bench.c
+ * measures the throughput of parsing, writing and accessing plists
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include <node.h>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+/* minimum time in seconds each operation is repeated for */
+static double min_time = 0.5;
+
+static double now(void)
+{
+#ifdef WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+/* a corpus and everything the operations need, prepared upfront */
+struct corpus {
+    const char *name;
+    plist_t root;
+    char *bin;
+    uint32_t bin_size;
+    char *xml;
+    uint32_t xml_size;
+    uint64_t nodes;
+    /* every dict with each of its keys, for the lookups */
+    plist_t *dicts;
+    char **keys;
+    uint64_t num_keys;
+    uint64_t keys_capacity;
+};
+
+static void add_key(struct corpus *c, plist_t dict, const char *key)
+{
+    if (c->num_keys >= c->keys_capacity) {
+        c->keys_capacity = c->keys_capacity ? c->keys_capacity * 2 : 256;
+        c->dicts = (plist_t*)realloc(c->dicts, c->keys_capacity * sizeof(plist_t));
+        c->keys = (char**)realloc(c->keys, c->keys_capacity * sizeof(char*));
+    }
+    c->dicts[c->num_keys] = dict;
+    c->keys[c->num_keys] = strdup(key);
+    c->num_keys++;
+}
+
+static void scan_node(struct corpus *c, plist_t node)
+{
+    c->nodes++;
+    if (plist_get_node_type(node) == PLIST_ARRAY) {
+        node_t *ch = NULL;
+        for (ch = node_first_child((node_t*)node); ch; ch = node_next_sibling(ch)) {
+            scan_node(c, (plist_t)ch);
+        }
+    } else if (plist_get_node_type(node) == PLIST_DICT) {
+        plist_dict_iter it = NULL;
+        char *key = NULL;
+        plist_t val = NULL;
+        plist_dict_new_iter(node, &it);
+        do {
+            key = NULL;
+            val = NULL;
+            plist_dict_next_item(node, it, &key, &val);
+            if (val) {
+                /* count the key nodes too */
+                c->nodes++;
+                add_key(c, node, key);
+                scan_node(c, val);
+            }
+            free(key);
+        } while (val);
+        free(it);
+    }
+}
+
+static void corpus_init(struct corpus *c, const char *name, plist_t root)
+{
+    memset(c, 0, sizeof(struct corpus));
+    c->name = name;
+    c->root = root;
+    plist_to_bin(root, &c->bin, &c->bin_size);
+    plist_to_xml(root, &c->xml, &c->xml_size);
+    scan_node(c, root);
+}
+
+static void corpus_free(struct corpus *c)
+{
+    uint64_t i = 0;
+    for (i = 0; i < c->num_keys; i++) {
+        free(c->keys[i]);
+    }
+    free(c->keys);
+    free(c->dicts);
+    free(c->bin);
+    free(c->xml);
+    plist_free(c->root);
+}
+
+enum bench_op {
+    OP_FROM_BIN,
+    OP_FROM_XML,
+    OP_TO_BIN,
+    OP_TO_XML,
+    OP_COPY,
+    OP_DICT_GET_ITEM,
+    OP_FREE,
+    OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+    "plist_from_bin",
+    "plist_from_xml",
+    "plist_to_bin",
+    "plist_to_xml",
+    "plist_copy",
+    "plist_dict_get_item",
+    "plist_free"
+};
+
+/* runs op once and returns the time spent on the measured part */
+static double run_op(struct corpus *c, enum bench_op op)
+{
+    plist_t tmp = NULL;
+    char *out = NULL;
+    uint32_t size = 0;
+    uint64_t i = 0;
+    double start = 0;
+    double elapsed = 0;
+
+    switch (op) {
+    case OP_FROM_BIN:
+        start = now();
+        plist_from_bin(c->bin, c->bin_size, &tmp);
+        elapsed = now() - start;
+        plist_free(tmp);
+        break;
+    case OP_FROM_XML:
+        start = now();
+        plist_from_xml(c->xml, c->xml_size, &tmp);
+        elapsed = now() - start;
+        plist_free(tmp);
+        break;
+    case OP_TO_BIN:
+        start = now();
+        plist_to_bin(c->root, &out, &size);
+        elapsed = now() - start;
+        free(out);
+        break;
+    case OP_TO_XML:
+        start = now();
+        plist_to_xml(c->root, &out, &size);
+        elapsed = now() - start;
+        free(out);
+        break;
+    case OP_COPY:
+        start = now();
+        tmp = plist_copy(c->root);
+        elapsed = now() - start;
+        plist_free(tmp);
+        break;
+    case OP_DICT_GET_ITEM:
+        start = now();
+        for (i = 0; i < c->num_keys; i++) {
+            if (!plist_dict_get_item(c->dicts[i], c->keys[i])) {
+                fprintf(stderr, "%s: lookup of %s failed\n", c->name, c->keys[i]);
+                exit(1);
+            }
+        }
+        elapsed = now() - start;
+        break;
+    case OP_FREE:
+        tmp = plist_copy(c->root);
+        start = now();
+        plist_free(tmp);
+        elapsed = now() - start;
+        break;
+    default:
+        break;
+    }
+    return elapsed;
+}
+
+static void bench_corpus(struct corpus *c)
+{
+    int op = 0;
+
+    for (op = 0; op < OP_COUNT; op++) {
+        double total = 0;
+        double t = 0;
+        uint64_t runs = 0;
+        uint64_t bytes = 0;
+        uint64_t items = c->nodes;
+
+        if (op == OP_DICT_GET_ITEM) {
+            if (c->num_keys == 0) {
+                continue;
+            }
+            items = c->num_keys;
+        }
+        if (op == OP_FROM_BIN || op == OP_TO_BIN) {
+            bytes = c->bin_size;
+        } else if (op == OP_FROM_XML || op == OP_TO_XML) {
+            bytes = c->xml_size;
+        }
+
+        /* one untimed run to warm up caches and the allocator */
+        run_op(c, (enum bench_op)op);
+        do {
+            total += run_op(c, (enum bench_op)op);
+            runs++;
+        } while (total < min_time);
+
+        t = total / runs;
+        printf("%s\t%s\t%u\t%u\t%" PRIu64 "\t%" PRIu64 "\t%.1f\t", c->name, op_names[op], c->bin_size, c->xml_size, items, runs, t * 1e9 / items);
+        if (bytes) {
+            printf("%.2f\n", bytes / t / 1e6);
+        } else {
+            printf("-\n");
+        }
+        fflush(stdout);
+    }
+}
+
+/* generators of the synthetic corpora */
+
+static plist_t gen_flat_dict(void)
+{
+    plist_t dict = plist_new_dict();
+    char key[32];
+    uint32_t i = 0;
+    for (i = 0; i < 100000; i++) {
+        snprintf(key, sizeof(key), "key_%u", i);
+        plist_dict_set_item(dict, key, plist_new_uint(i));
+    }
+    return dict;
+}
+
+static plist_t gen_deep_dict(void)
+{
+    plist_t root = plist_new_array();
+    char key[32];
+    uint32_t i = 0;
+    uint32_t j = 0;
+    for (i = 0; i < 1000; i++) {
+        plist_t top = plist_new_dict();
+        plist_t cur = top;
+        for (j = 0; j < 64; j++) {
+            plist_t child = plist_new_dict();
+            plist_dict_set_item(cur, "depth", plist_new_uint(j));
+            plist_dict_set_item(cur, "enabled", plist_new_bool(j & 1));
+            snprintf(key, sizeof(key), "level%u", j);
+            plist_dict_set_item(cur, key, child);
+            cur = child;
+        }
+        plist_array_append_item(root, top);
+    }
+    return root;
+}
+
+static plist_t gen_big_array(void)
+{
+    plist_t array = plist_new_array();
+    uint32_t i = 0;
+    for (i = 0; i < 200000; i++) {
+        if (i & 1) {
+            plist_array_append_item(array, plist_new_real(i / 3.0));
+        } else {
+            plist_array_append_item(array, plist_new_uint((uint64_t)i * 2654435761u));
+        }
+    }
+    return array;
+}
+
+static plist_t gen_strings(void)
+{
+    static const char *words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "&amp;", "<tag>", "\xc3\xa4\xc3\xb6\xc3\xbc", "\xe6\x97\xa5\xe6\x9c\xac" };
+    plist_t array = plist_new_array();
+    char buf[512];
+    uint32_t i = 0;
+    for (i = 0; i < 50000; i++) {
+        size_t len = 0;
+        uint32_t n = 2 + (i * 7) % 40;
+        uint32_t j = 0;
+        for (j = 0; j < n && len + 16 < sizeof(buf); j++) {
+            const char *w = words[(i + j * 3) % (sizeof(words) / sizeof(words[0]))];
+            len += snprintf(buf + len, sizeof(buf) - len, "%s ", w);
+        }
+        plist_array_append_item(array, plist_new_string(buf));
+    }
+    return array;
+}
+
+static plist_t gen_data(void)
+{
+    plist_t array = plist_new_array();
+    char *buf = (char*)malloc(16384);
+    uint32_t i = 0;
+    uint32_t j = 0;
+    for (i = 0; i < 2000; i++) {
+        uint32_t len = 256 + (i * 977) % 16000;
+        for (j = 0; j < len; j++) {
+            buf[j] = (char)(i * 31 + j * 7);
+        }
+        plist_array_append_item(array, plist_new_data(buf, len));
+    }
+    free(buf);
+    return array;
+}
+
+/* an NSKeyedArchiver style archive with many small objects */
+static plist_t gen_keyed_archive(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t objects = plist_new_array();
+    plist_t top = plist_new_dict();
+    plist_t list = plist_new_dict();
+    plist_t items = plist_new_array();
+    plist_t cls = plist_new_dict();
+    plist_t classes = plist_new_array();
+    char buf[64];
+    uint32_t n = 20000;
+    uint32_t i = 0;
+
+    plist_array_append_item(objects, plist_new_string("$null"));
+    /* 1: the list, 2: its class, then the items and their classes */
+    plist_dict_set_item(list, "NS.objects", items);
+    plist_dict_set_item(list, "$class", plist_new_uid(2));
+    plist_array_append_item(objects, list);
+    plist_array_append_item(classes, plist_new_string("NSArray"));
+    plist_array_append_item(classes, plist_new_string("NSObject"));
+    plist_dict_set_item(cls, "$classes", classes);
+    plist_dict_set_item(cls, "$classname", plist_new_string("NSArray"));
+    plist_array_append_item(objects, cls);
+
+    for (i = 0; i < n; i++) {
+        plist_t obj = plist_new_dict();
+        uint64_t index = plist_array_get_size(objects);
+        plist_dict_set_item(obj, "$class", plist_new_uid(3 + 2 * n));
+        snprintf(buf, sizeof(buf), "Item %u", i);
+        plist_dict_set_item(obj, "title", plist_new_uid(index + 1));
+        plist_dict_set_item(obj, "count", plist_new_uint(i));
+        plist_dict_set_item(obj, "timestamp", plist_new_date(600000000 + i, 0));
+        plist_array_append_item(objects, obj);
+        plist_array_append_item(objects, plist_new_string(buf));
+        plist_array_append_item(items, plist_new_uid(index));
+    }
+    cls = plist_new_dict();
+    classes = plist_new_array();
+    plist_array_append_item(classes, plist_new_string("Item"));
+    plist_array_append_item(classes, plist_new_string("NSObject"));
+    plist_dict_set_item(cls, "$classes", classes);
+    plist_dict_set_item(cls, "$classname", plist_new_string("Item"));
+    plist_array_append_item(objects, cls);
+
+    plist_dict_set_item(top, "root", plist_new_uid(1));
+    plist_dict_set_item(root, "$archiver", plist_new_string("NSKeyedArchiver"));
+    plist_dict_set_item(root, "$version", plist_new_uint(100000));
+    plist_dict_set_item(root, "$top", top);
+    plist_dict_set_item(root, "$objects", objects);
+    return root;
+}
+
+static plist_t load_file(const char *filename)
+{
+    plist_t root = NULL;
+    if (plist_read_from_file(filename, &root, NULL) != 0) {
+        fprintf(stderr, "Could not read %s\n", filename);
+        return NULL;
+    }
+    return root;
+}
+
+static void print_usage(const char *name)
+{
+    printf("Usage: %s [-t SECONDS] [-c CORPUS] [FILE...]\n", name);
+    printf("\n");
+    printf("Benchmarks libplist on synthetic corpora and the given plist files.\n");
+    printf("Prints one tab separated line per corpus and operation with the\n");
+    printf("columns of the header line. ns_per_node is per lookup for\n");
+    printf("plist_dict_get_item, MB/s refers to the binary or XML size.\n");
+    printf("\n");
+    printf("  -t SECONDS  repeat each operation for at least SECONDS (default 0.5)\n");
+    printf("  -c CORPUS   only run the synthetic corpus named CORPUS\n");
+    printf("  -h          print this message\n");
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct {
+        const char *name;
+        plist_t (*gen)(void);
+    } generators[] = {
+        { "flat_dict", gen_flat_dict },
+        { "deep_dict", gen_deep_dict },
+        { "big_array", gen_big_array },
+        { "strings", gen_strings },
+        { "data", gen_data },
+        { "keyed_archive", gen_keyed_archive }
+    };
+    const char *only = NULL;
+    struct corpus c;
+    size_t g = 0;
+    int i = 0;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            min_time = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            only = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return strcmp(argv[i], "-h") ? 1 : 0;
+        }
+    }
+
+    printf("corpus\top\tbin_bytes\txml_bytes\tnodes\truns\tns_per_node\tMB/s\n");
+
+    for (g = 0; g < sizeof(generators) / sizeof(generators[0]); g++) {
+        if (only && strcmp(only, generators[g].name) != 0) {
+            continue;
+        }
+        corpus_init(&c, generators[g].name, generators[g].gen());
+        bench_corpus(&c);
+        corpus_free(&c);
+    }
+
+    for (; i < argc; i++) {
+        plist_t root = load_file(argv[i]);
+        if (!root) {
+            return 1;
+        }
+        corpus_init(&c, argv[i], root);
+        bench_corpus(&c);
+        corpus_free(&c);
+    }
+
+    return 0;
+}
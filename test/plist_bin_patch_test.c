@@ -0,0 +1,315 @@
+/*
+ * plist_bin_patch_test.c
+ * checks changing values of binary plists in place
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int same_plist(plist_t a, plist_t b)
+{
+    char *bin_a = NULL;
+    char *bin_b = NULL;
+    uint32_t size_a = 0;
+    uint32_t size_b = 0;
+    int res = 0;
+
+    if (!a || !b) {
+        return 0;
+    }
+    plist_to_bin(a, &bin_a, &size_a);
+    plist_to_bin(b, &bin_b, &size_b);
+    res = (bin_a && bin_b && size_a == size_b && memcmp(bin_a, bin_b, size_a) == 0);
+    free(bin_a);
+    free(bin_b);
+    return res;
+}
+
+/* replaces the node at path in the tree, the way the patch should */
+static void tree_set(plist_t *root, const char *path, plist_t value)
+{
+    plist_path_t p = plist_path_compile(path);
+    plist_t node = plist_path_get(p, *root);
+    plist_t parent = plist_get_parent(node);
+
+    if (!parent) {
+        plist_free(*root);
+        *root = plist_copy(value);
+    } else if (PLIST_IS_DICT(parent)) {
+        char *key = NULL;
+        plist_dict_get_item_key(node, &key);
+        plist_dict_set_item(parent, key, plist_copy(value));
+        free(key);
+    } else {
+        plist_array_set_item(parent, plist_copy(value), plist_array_get_item_index(node));
+    }
+    plist_path_free(p);
+}
+
+/* patches bin and the tree root the same way and compares them, expect is
+ * the expected result of plist_bin_patch or -2 for any success */
+static int check_patch(char **bin, uint64_t *size, plist_t *root, const char *path, plist_t value, int expect)
+{
+    plist_path_t p = plist_path_compile(path);
+    plist_t parsed = NULL;
+    int r = plist_bin_patch(bin, size, p, value);
+    int res = 0;
+
+    plist_path_free(p);
+    if (r < 0 || (expect >= 0 && r != expect)) {
+        printf("%s: plist_bin_patch returned %d instead of %d\n", path, r, expect);
+        plist_free(value);
+        return 1;
+    }
+    tree_set(root, path, value);
+    plist_free(value);
+    if (plist_bin_validate(*bin, *size, NULL) < 0) {
+        printf("%s: patched plist is invalid\n", path);
+        return 1;
+    }
+    plist_from_bin64(*bin, *size, PLIST_PARSE_DEFAULT, &parsed);
+    if (!same_plist(*root, parsed)) {
+        printf("%s: patched plist differs\n", path);
+        res = 1;
+    }
+    plist_free(parsed);
+    return res;
+}
+
+static int check_generated(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t nested = plist_new_dict();
+    plist_t list = plist_new_array();
+    plist_t value = NULL;
+    plist_path_t p = NULL;
+    char *bin = NULL;
+    uint32_t size32 = 0;
+    uint64_t size = 0;
+    uint64_t old_size = 0;
+    int res = 0;
+
+    plist_dict_set_item(root, "counter", plist_new_uint(5));
+    plist_dict_set_item(root, "same", plist_new_uint(5));
+    plist_dict_set_item(root, "flag", plist_new_bool(0));
+    plist_dict_set_item(root, "name", plist_new_string("abc"));
+    plist_dict_set_item(root, "big", plist_new_uint(100000));
+    plist_dict_set_item(root, "ratio", plist_new_real(1.5));
+    plist_dict_set_item(root, "precise", plist_new_real(0.1));
+    plist_dict_set_item(root, "when", plist_new_date(1000, 0));
+    plist_dict_set_item(root, "blob", plist_new_data("1234", 4));
+    plist_dict_set_item(root, "id", plist_new_uid(7));
+    plist_dict_set_item(nested, "count", plist_new_uint(1));
+    plist_dict_set_item(root, "nested", nested);
+    plist_array_append_item(list, plist_new_uint(10));
+    plist_array_append_item(list, plist_new_uint(20));
+    plist_dict_set_item(root, "list", list);
+    plist_to_bin(root, &bin, &size32);
+    size = size32;
+
+    /* values with their own object and a fitting encoding */
+    res |= check_patch(&bin, &size, &root, "flag", plist_new_bool(1), 0);
+    res |= check_patch(&bin, &size, &root, "name", plist_new_string("xyz"), 0);
+    res |= check_patch(&bin, &size, &root, "big", plist_new_uint(65000), 0);
+    res |= check_patch(&bin, &size, &root, "precise", plist_new_real(-2.75), 0);
+    res |= check_patch(&bin, &size, &root, "when", plist_new_date(-5000, 250000), 0);
+    res |= check_patch(&bin, &size, &root, "blob", plist_new_data("abcd", 4), 0);
+    res |= check_patch(&bin, &size, &root, "id", plist_new_uid(200), 0);
+    res |= check_patch(&bin, &size, &root, "nested/count", plist_new_uint(2), 0);
+    if (size != size32) {
+        printf("In place changes changed the size\n");
+        res = 1;
+    }
+
+    /* 5 is shared by counter and same, the new value gets its own object */
+    res |= check_patch(&bin, &size, &root, "counter", plist_new_uint(6), 1);
+    /* and now has 8 bytes */
+    old_size = size;
+    res |= check_patch(&bin, &size, &root, "counter", plist_new_uint(100000000000ULL), 0);
+    res |= check_patch(&bin, &size, &root, "counter", plist_new_uint((uint64_t)-3), 0);
+    if (size != old_size) {
+        printf("Appended integer was not changed in place\n");
+        res = 1;
+    }
+
+    /* encodings that don't fit */
+    res |= check_patch(&bin, &size, &root, "nested/count", plist_new_uint(1000), 1);
+    res |= check_patch(&bin, &size, &root, "ratio", plist_new_real(0.1), 1);
+    res |= check_patch(&bin, &size, &root, "name", plist_new_string("longer"), 1);
+    res |= check_patch(&bin, &size, &root, "name", plist_new_string("\xc3\xa4\xc3\xb6\xc3\xbc"), 1);
+    res |= check_patch(&bin, &size, &root, "list/1", plist_new_string("twenty"), 1);
+    res |= check_patch(&bin, &size, &root, "list/0", plist_new_uint(UINT64_MAX), 1);
+    res |= check_patch(&bin, &size, &root, "list/0", plist_new_uint(UINT64_MAX - 1), 0);
+    res |= check_patch(&bin, &size, &root, "flag", plist_new_real(1.0), 1);
+
+    /* errors leave the buffer alone */
+    old_size = size;
+    value = plist_new_uint(1);
+    p = plist_path_compile("missing");
+    if (plist_bin_patch(&bin, &size, p, value) != -1) {
+        res = 1;
+    }
+    plist_path_free(p);
+    p = plist_path_compile("list/*");
+    if (plist_bin_patch(&bin, &size, p, value) != -1) {
+        res = 1;
+    }
+    plist_path_free(p);
+    p = plist_path_compile("list/7");
+    if (plist_bin_patch(&bin, &size, p, value) != -1) {
+        res = 1;
+    }
+    plist_path_free(p);
+    p = plist_path_compile("list");
+    plist_free(value);
+    value = plist_new_array();
+    if (plist_bin_patch(&bin, &size, p, value) != -1) {
+        res = 1;
+    }
+    plist_path_free(p);
+    plist_free(value);
+    if (size != old_size) {
+        printf("Failed patch changed the plist\n");
+        res = 1;
+    }
+
+    /* the root itself */
+    res |= check_patch(&bin, &size, &root, "", plist_new_string("root"), 1);
+    res |= check_patch(&bin, &size, &root, "", plist_new_string("tree"), 0);
+
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+/* containers written once for several places are copied, not changed */
+static int check_shared_containers(void)
+{
+    plist_t root = plist_new_array();
+    plist_t item = plist_new_dict();
+    plist_t inner = plist_new_array();
+    char *bin = NULL;
+    uint32_t size32 = 0;
+    uint64_t size = 0;
+    int res = 0;
+
+    plist_array_append_item(inner, plist_new_uint(1));
+    plist_dict_set_item(item, "value", inner);
+    plist_array_append_item(root, item);
+    plist_array_append_item(root, plist_copy(item));
+    plist_to_bin_ex(root, PLIST_WRITE_COMPACT, &bin, &size32);
+    size = size32;
+
+    res |= check_patch(&bin, &size, &root, "1/value/0", plist_new_uint(2), 1);
+    /* the second item has its own copies now, so nothing is shared */
+    res |= check_patch(&bin, &size, &root, "0/value/0", plist_new_uint(3), 0);
+    res |= check_patch(&bin, &size, &root, "1/value/0", plist_new_uint(4), 0);
+
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+/* with 1 byte references there is no room for new objects */
+static int check_full(void)
+{
+    plist_t root = plist_new_array();
+    char *bin = NULL;
+    uint32_t size32 = 0;
+    uint64_t size = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    /* 254 items and the array are 255 objects */
+    for (i = 0; i < 254; i++) {
+        plist_array_append_item(root, plist_new_uint(i));
+    }
+    plist_to_bin(root, &bin, &size32);
+    size = size32;
+    res |= check_patch(&bin, &size, &root, "3", plist_new_string("three"), 1);
+    res |= check_patch(&bin, &size, &root, "4", plist_new_uint(44), -2);
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+#define MAX_KEYS 20
+
+/* changes the values directly below the root */
+static int check_file(const char *filename)
+{
+    char *keys[MAX_KEYS];
+    plist_t root = NULL;
+    plist_t item = NULL;
+    plist_dict_iter it = NULL;
+    char *bin = NULL;
+    uint32_t size32 = 0;
+    uint64_t size = 0;
+    uint32_t count = 0;
+    uint32_t n = 0;
+    int res = 0;
+
+    plist_read_from_file(filename, &root, NULL);
+    if (!PLIST_IS_DICT(root)) {
+        plist_free(root);
+        return 0;
+    }
+    plist_dict_new_iter(root, &it);
+    do {
+        char *key = NULL;
+        item = NULL;
+        plist_dict_next_item(root, it, &key, &item);
+        if (key && item && !strchr(key, '/') && !strchr(key, '\\') && strcmp(key, "*") != 0 && !PLIST_IS_ARRAY(item) && !PLIST_IS_DICT(item) && count < MAX_KEYS) {
+            keys[count++] = key;
+        } else {
+            free(key);
+        }
+    } while (item);
+    plist_mem_free(it);
+
+    plist_to_bin(root, &bin, &size32);
+    size = size32;
+    for (n = 0; n < count; n++) {
+        plist_t value = (n & 1) ? plist_new_uint(n) : plist_new_bool(1);
+        res |= check_patch(&bin, &size, &root, keys[n], value, -2);
+        free(keys[n]);
+    }
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    res |= check_generated();
+    res |= check_shared_containers();
+    res |= check_full();
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("Patching binary plists succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,267 @@
+/*
+ * plist_bin_writer_test.c
+ * checks that the incremental binary plist writer produces the same trees
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+struct collector {
+    char *buf;
+    size_t len;
+};
+
+static int collect(void *user_data, const char *buf, size_t size)
+{
+    struct collector *c = (struct collector*)user_data;
+    char *nbuf = (char*)realloc(c->buf, c->len + size);
+    if (!nbuf) {
+        return -1;
+    }
+    c->buf = nbuf;
+    memcpy(c->buf + c->len, buf, size);
+    c->len += size;
+    return 0;
+}
+
+static int fail_write(void *user_data, const char *buf, size_t size)
+{
+    return -1;
+}
+
+/* feeds the tree to the writer value by value */
+static int walk(plist_bin_writer_t w, plist_t node)
+{
+    uint32_t i = 0;
+    uint8_t b = 0;
+    uint64_t u = 0;
+    double d = 0;
+    int32_t sec = 0;
+    int32_t usec = 0;
+    char *s = NULL;
+    int res = 0;
+
+    switch (plist_get_node_type(node)) {
+    case PLIST_DICT: {
+        plist_dict_iter iter = NULL;
+        char *key = NULL;
+        plist_t val = NULL;
+        if (plist_bin_writer_begin_dict(w) < 0) {
+            return -1;
+        }
+        plist_dict_new_iter(node, &iter);
+        for (plist_dict_next_item(node, iter, &key, &val); val; plist_dict_next_item(node, iter, &key, &val)) {
+            res = plist_bin_writer_add_key(w, key);
+            free(key);
+            key = NULL;
+            if (res < 0 || walk(w, val) < 0) {
+                free(iter);
+                return -1;
+            }
+        }
+        free(iter);
+        return plist_bin_writer_end(w);
+    }
+    case PLIST_ARRAY:
+        if (plist_bin_writer_begin_array(w) < 0) {
+            return -1;
+        }
+        for (i = 0; i < plist_array_get_size(node); i++) {
+            if (walk(w, plist_array_get_item(node, i)) < 0) {
+                return -1;
+            }
+        }
+        return plist_bin_writer_end(w);
+    case PLIST_BOOLEAN:
+        plist_get_bool_val(node, &b);
+        return plist_bin_writer_add_bool(w, b);
+    case PLIST_UINT:
+        plist_get_uint_val(node, &u);
+        return plist_bin_writer_add_int(w, (int64_t)u);
+    case PLIST_REAL:
+        plist_get_real_val(node, &d);
+        return plist_bin_writer_add_real(w, d);
+    case PLIST_DATE:
+        plist_get_date_val(node, &sec, &usec);
+        return plist_bin_writer_add_date(w, sec, usec);
+    case PLIST_STRING:
+        plist_get_string_val(node, &s);
+        res = plist_bin_writer_add_string(w, s);
+        free(s);
+        return res;
+    case PLIST_DATA:
+        plist_get_data_val(node, &s, &u);
+        res = plist_bin_writer_add_data(w, s, u);
+        free(s);
+        return res;
+    case PLIST_UID:
+        plist_get_uid_val(node, &u);
+        return plist_bin_writer_add_uid(w, u);
+    default:
+        break;
+    }
+    return -1;
+}
+
+static int compare_output(const char *what, const char *bin, size_t bin_size, const char *xml_orig, uint32_t size_orig)
+{
+    plist_t root = NULL;
+    char *xml = NULL;
+    uint32_t size = 0;
+    int res = 0;
+
+    plist_from_bin(bin, bin_size, &root);
+    if (!root) {
+        printf("Parsing output of %s failed\n", what);
+        return -1;
+    }
+    plist_to_xml(root, &xml, &size);
+    if (size != size_orig || memcmp(xml, xml_orig, size) != 0) {
+        printf("XML output of %s differs\n", what);
+        res = -1;
+    }
+    plist_free(root);
+    free(xml);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *iplist = NULL;
+    FILE *tmp = NULL;
+    plist_t root = NULL;
+    plist_bin_writer_t w = NULL;
+    struct collector out = { NULL, 0 };
+    struct collector out_compact = { NULL, 0 };
+    char *plist_xml = NULL;
+    char *xml_orig = NULL;
+    char *file_buf = NULL;
+    uint32_t size_orig = 0;
+    long file_size = 0;
+    struct stat filestats;
+    int res = 0;
+
+    if (argc != 2) {
+        printf("Wrong input\n");
+        return 1;
+    }
+
+    iplist = fopen(argv[1], "rb");
+    if (!iplist) {
+        printf("File does not exists\n");
+        return 2;
+    }
+    stat(argv[1], &filestats);
+    plist_xml = (char*)malloc(filestats.st_size + 1);
+    fread(plist_xml, 1, filestats.st_size, iplist);
+    fclose(iplist);
+
+    plist_from_xml(plist_xml, filestats.st_size, &root);
+    if (!root) {
+        printf("PList XML parsing failed\n");
+        return 3;
+    }
+    plist_to_xml(root, &xml_orig, &size_orig);
+
+    /* value by value */
+    w = plist_bin_writer_new(collect, &out, PLIST_WRITE_DEFAULT);
+    if (!w || walk(w, root) < 0 || plist_bin_writer_finish(w) < 0) {
+        printf("Writing values failed\n");
+        return 4;
+    }
+    plist_bin_writer_free(w);
+    if (compare_output("writer", out.buf, out.len, xml_orig, size_orig) < 0) {
+        res = 5;
+    }
+
+    /* whole tree, deduplicated */
+    w = plist_bin_writer_new(collect, &out_compact, PLIST_WRITE_COMPACT);
+    if (!w || plist_bin_writer_add_node(w, root) < 0 || plist_bin_writer_finish(w) < 0) {
+        printf("Writing tree failed\n");
+        return 6;
+    }
+    plist_bin_writer_free(w);
+    if (compare_output("compact writer", out_compact.buf, out_compact.len, xml_orig, size_orig) < 0) {
+        res = 7;
+    }
+    if (out_compact.len > out.len) {
+        printf("Compact output is larger (%u > %u bytes)\n", (unsigned)out_compact.len, (unsigned)out.len);
+        res = 8;
+    }
+
+    /* file descriptor */
+    tmp = tmpfile();
+    if (!tmp) {
+        printf("Could not create temporary file\n");
+        return 9;
+    }
+    w = plist_bin_writer_new_fd(fileno(tmp), PLIST_WRITE_DEFAULT);
+    if (!w || plist_bin_writer_add_node(w, root) < 0 || plist_bin_writer_finish(w) < 0) {
+        printf("Writing to file descriptor failed\n");
+        return 10;
+    }
+    plist_bin_writer_free(w);
+    file_size = ftell(tmp);
+    fseek(tmp, 0, SEEK_SET);
+    file_buf = (char*)malloc(file_size);
+    if (fread(file_buf, 1, file_size, tmp) != (size_t)file_size
+        || (size_t)file_size != out.len || memcmp(file_buf, out.buf, out.len) != 0) {
+        printf("Output written to file descriptor differs\n");
+        res = 11;
+    }
+    fclose(tmp);
+    free(file_buf);
+
+    /* misuse and write errors */
+    w = plist_bin_writer_new(collect, &out, PLIST_WRITE_DEFAULT);
+    plist_bin_writer_begin_dict(w);
+    if (plist_bin_writer_add_string(w, "value") == 0 || plist_bin_writer_finish(w) == 0) {
+        printf("Value without key or unterminated dictionary not rejected\n");
+        res = 12;
+    }
+    plist_bin_writer_end(w);
+    if (plist_bin_writer_add_bool(w, 1) == 0 || plist_bin_writer_finish(w) != 0) {
+        printf("Second root object not rejected\n");
+        res = 13;
+    }
+    plist_bin_writer_free(w);
+    w = plist_bin_writer_new(fail_write, NULL, PLIST_WRITE_DEFAULT);
+    if (plist_bin_writer_add_node(w, root) == 0 && plist_bin_writer_finish(w) == 0) {
+        printf("Write error not reported\n");
+        res = 14;
+    }
+    plist_bin_writer_free(w);
+
+    plist_free(root);
+    free(plist_xml);
+    free(xml_orig);
+    free(out.buf);
+    free(out_compact.buf);
+
+    if (res == 0) {
+        printf("Binary plist writer succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,190 @@
+/*
+ * plist_bulk_test.c
+ * checks that the bulk construction functions build the same trees as
+ * adding the items one by one
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_ITEMS 1000
+
+static int same_tree(plist_t a, plist_t b, const char *what)
+{
+    char *bin = NULL;
+    char *bin2 = NULL;
+    uint32_t size = 0;
+    uint32_t size2 = 0;
+    int res = 0;
+
+    plist_to_bin(a, &bin, &size);
+    plist_to_bin(b, &bin2, &size2);
+    if (!bin || !bin2 || size != size2 || memcmp(bin, bin2, size) != 0) {
+        printf("%s: trees differ\n", what);
+        res = 1;
+    }
+    free(bin);
+    free(bin2);
+    return res;
+}
+
+static int check_arrays(void)
+{
+    uint64_t uvals[NUM_ITEMS];
+    double rvals[NUM_ITEMS];
+    const char *svals[NUM_ITEMS];
+    char strings[NUM_ITEMS][32];
+    plist_t items[NUM_ITEMS];
+    plist_t expected_uint = plist_new_array();
+    plist_t expected_real = plist_new_array();
+    plist_t expected_string = plist_new_array();
+    plist_t array = NULL;
+    uint32_t i = 0;
+    int res = 0;
+
+    for (i = 0; i < NUM_ITEMS; i++) {
+        uvals[i] = (uint64_t)i * 1000003;
+        rvals[i] = i / 3.0;
+        snprintf(strings[i], sizeof(strings[i]), "string %u", i);
+        svals[i] = strings[i];
+        plist_array_append_item(expected_uint, plist_new_uint(uvals[i]));
+        plist_array_append_item(expected_real, plist_new_real(rvals[i]));
+        plist_array_append_item(expected_string, plist_new_string(svals[i]));
+    }
+
+    array = plist_new_uint_array(uvals, NUM_ITEMS);
+    res |= same_tree(expected_uint, array, "uint array");
+    plist_free(array);
+    array = plist_new_real_array(rvals, NUM_ITEMS);
+    res |= same_tree(expected_real, array, "real array");
+    plist_free(array);
+    array = plist_new_string_array(svals, NUM_ITEMS);
+    res |= same_tree(expected_string, array, "string array");
+    if (plist_array_get_size(array) != NUM_ITEMS || strcmp(plist_get_string_ptr(plist_array_get_item(array, 777), NULL), "string 777") != 0) {
+        printf("Item lookup in string array failed\n");
+        res = 1;
+    }
+    plist_free(array);
+
+    /* appending in chunks to a reserved and to a small array */
+    array = plist_new_array();
+    plist_array_reserve(array, NUM_ITEMS);
+    plist_array_append_item(array, plist_new_uint(uvals[0]));
+    for (i = 1; i < NUM_ITEMS; i++) {
+        items[i] = plist_new_uint(uvals[i]);
+    }
+    plist_array_append_items(array, items + 1, 10);
+    plist_array_append_items(array, items + 11, NUM_ITEMS - 11);
+    res |= same_tree(expected_uint, array, "appended array");
+    if (plist_array_get_item_index(plist_array_get_item(array, 500)) != 500) {
+        printf("Item index in appended array is wrong\n");
+        res = 1;
+    }
+    plist_free(array);
+
+    array = plist_new_array();
+    for (i = 0; i < 3; i++) {
+        items[i] = plist_new_uint(uvals[i]);
+    }
+    plist_array_append_items(array, items, 3);
+    plist_array_reserve(array, 5);
+    if (plist_array_get_size(array) != 3 || plist_array_get_item_index(plist_array_get_item(array, 2)) != 2) {
+        printf("Small appended array is wrong\n");
+        res = 1;
+    }
+    plist_free(array);
+
+    /* empty input */
+    array = plist_new_uint_array(NULL, 10);
+    if (plist_array_get_size(array) != 0) {
+        printf("Array from no values is not empty\n");
+        res = 1;
+    }
+    plist_array_append_items(array, items, 0);
+    plist_free(array);
+
+    plist_free(expected_uint);
+    plist_free(expected_real);
+    plist_free(expected_string);
+    return res;
+}
+
+static int check_dict(uint32_t count, uint32_t options)
+{
+    const char *keys[NUM_ITEMS];
+    char names[NUM_ITEMS][32];
+    plist_t items[NUM_ITEMS];
+    plist_t expected = plist_new_dict();
+    plist_t dict = plist_new_dict();
+    plist_t item = NULL;
+    char buf[64];
+    uint32_t i = 0;
+    int res = 0;
+
+    plist_dict_set_item(expected, "first", plist_new_bool(1));
+    plist_dict_set_item(dict, "first", plist_new_bool(1));
+    for (i = 0; i < count; i++) {
+        snprintf(names[i], sizeof(names[i]), "key %u", i);
+        keys[i] = names[i];
+        items[i] = plist_new_uint(i);
+        plist_dict_set_item(expected, keys[i], plist_new_uint(i));
+    }
+    plist_dict_set_items(dict, keys, items, count, options);
+    snprintf(buf, sizeof(buf), "dict of %u items with options %u", count, options);
+    res |= same_tree(expected, dict, buf);
+    for (i = 0; i < count; i++) {
+        item = plist_dict_get_item(dict, keys[i]);
+        uint64_t val = 0;
+        plist_get_uint_val(item, &val);
+        if (!item || val != i) {
+            printf("%s: lookup of '%s' failed\n", buf, keys[i]);
+            res = 1;
+            break;
+        }
+    }
+
+    /* later keys still replace existing ones */
+    items[0] = plist_new_string("replaced");
+    plist_dict_set_items(dict, keys, items, (count > 0) ? 1 : 0, PLIST_DICT_SET_DEFAULT);
+    if (count > 0 && (plist_dict_get_size(dict) != count + 1 || plist_get_node_type(plist_dict_get_item(dict, keys[0])) != PLIST_STRING)) {
+        printf("%s: replacing an item failed\n", buf);
+        res = 1;
+    }
+
+    plist_free(expected);
+    plist_free(dict);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+
+    res |= check_arrays();
+    res |= check_dict(5, PLIST_DICT_SET_DEFAULT);
+    res |= check_dict(5, PLIST_DICT_SET_UNIQUE);
+    res |= check_dict(NUM_ITEMS, PLIST_DICT_SET_DEFAULT);
+    res |= check_dict(NUM_ITEMS, PLIST_DICT_SET_UNIQUE);
+
+    if (res == 0) {
+        printf("Bulk construction succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,109 @@
+/*
+ * plist_compact_test.c
+ * checks that compact binary plists parse into the same tree
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+int main(int argc, char *argv[])
+{
+    FILE *iplist = NULL;
+    plist_t root = NULL;
+    plist_t root_compact = NULL;
+    char *plist_xml = NULL;
+    char *plist_bin = NULL;
+    char *plist_bin_compact = NULL;
+    char *xml_orig = NULL;
+    char *xml_compact = NULL;
+    uint32_t bin_size = 0;
+    uint32_t bin_size_compact = 0;
+    uint32_t size_orig = 0;
+    uint32_t size_compact = 0;
+    struct stat filestats;
+    int res = 0;
+
+    if (argc < 2 || argc > 3) {
+        printf("Wrong input\n");
+        return 1;
+    }
+
+    iplist = fopen(argv[1], "rb");
+    if (!iplist) {
+        printf("File does not exists\n");
+        return 2;
+    }
+    stat(argv[1], &filestats);
+    plist_xml = (char*)malloc(filestats.st_size + 1);
+    fread(plist_xml, 1, filestats.st_size, iplist);
+    fclose(iplist);
+
+    plist_from_xml(plist_xml, filestats.st_size, &root);
+    if (!root) {
+        printf("PList XML parsing failed\n");
+        return 3;
+    }
+    plist_to_xml(root, &xml_orig, &size_orig);
+
+    plist_to_bin(root, &plist_bin, &bin_size);
+    plist_to_bin_ex(root, PLIST_WRITE_COMPACT, &plist_bin_compact, &bin_size_compact);
+    if (!plist_bin || !plist_bin_compact) {
+        printf("PList BIN writing failed\n");
+        return 4;
+    }
+
+    plist_from_bin(plist_bin_compact, bin_size_compact, &root_compact);
+    if (!root_compact) {
+        printf("PList BIN parsing of compact output failed\n");
+        return 5;
+    }
+    plist_to_xml(root_compact, &xml_compact, &size_compact);
+
+    if (size_orig != size_compact || memcmp(xml_orig, xml_compact, size_orig) != 0) {
+        printf("XML output of compact binary plist differs\n");
+        res = 6;
+    }
+    if (bin_size_compact > bin_size) {
+        printf("Compact output is larger (%u > %u bytes)\n", bin_size_compact, bin_size);
+        res = 7;
+    }
+    if (argc == 3 && !strcmp(argv[2], "smaller") && bin_size_compact >= bin_size) {
+        printf("Compact output is not smaller (%u >= %u bytes)\n", bin_size_compact, bin_size);
+        res = 8;
+    }
+
+    plist_free(root);
+    plist_free(root_compact);
+    free(plist_xml);
+    free(plist_bin);
+    free(plist_bin_compact);
+    free(xml_orig);
+    free(xml_compact);
+
+    if (res == 0) {
+        printf("Compact binary plist (%u bytes, %u without deduplication) succeeded\n", bin_size_compact, bin_size);
+    }
+    return res;
+}
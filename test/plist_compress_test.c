@@ -0,0 +1,343 @@
+/*
+ * plist_compress_test.c
+ * checks compressed binary plists, streaming decompression and
+ * dictionaries
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_ENTRIES 5000
+#define NUM_SAMPLES 200
+
+struct chunk_reader {
+    const char *data;
+    size_t length;
+    size_t pos;
+    size_t chunk;
+};
+
+static size_t read_chunk(void *user_data, char *buf, size_t size)
+{
+    struct chunk_reader *r = (struct chunk_reader*)user_data;
+    size_t n = r->length - r->pos;
+    if (n > size) {
+        n = size;
+    }
+    if (n > r->chunk) {
+        n = r->chunk;
+    }
+    memcpy(buf, r->data + r->pos, n);
+    r->pos += n;
+    return n;
+}
+
+static int same_plist(plist_t a, plist_t b)
+{
+    char *bin_a = NULL;
+    char *bin_b = NULL;
+    uint32_t size_a = 0;
+    uint32_t size_b = 0;
+    int res = 0;
+
+    if (!a || !b) {
+        return 0;
+    }
+    plist_to_bin(a, &bin_a, &size_a);
+    plist_to_bin(b, &bin_b, &size_b);
+    res = (bin_a && bin_b && size_a == size_b && memcmp(bin_a, bin_b, size_a) == 0);
+    free(bin_a);
+    free(bin_b);
+    return res;
+}
+
+/* compresses root at level and reads it back in every way */
+static int check_round_trip(plist_t root, int level, plist_compress_dict_t dict, const char *what, uint32_t *compressed_size)
+{
+    struct chunk_reader r;
+    plist_t out = NULL;
+    char *data = NULL;
+    uint32_t size = 0;
+    int res = 0;
+
+    if (plist_to_bin_compressed(root, PLIST_COMPRESS_LZ4, level, dict, &data, &size) < 0) {
+        printf("%s: level %d: could not compress\n", what, level);
+        return 1;
+    }
+    if (compressed_size) {
+        *compressed_size = size;
+    }
+    if (!plist_is_compressed(data, size) || plist_is_binary(data, size)) {
+        printf("%s: level %d: not detected as compressed\n", what, level);
+        res = 1;
+    }
+
+    plist_from_bin_compressed(data, size, dict, &out);
+    if (!same_plist(root, out)) {
+        printf("%s: level %d: decompressed plist differs\n", what, level);
+        res = 1;
+    }
+    plist_free(out);
+
+    memset(&r, 0, sizeof(r));
+    r.data = data;
+    r.length = size;
+    r.chunk = 7;
+    if (plist_from_bin_compressed_stream(read_chunk, &r, dict, &out) < 0 || !same_plist(root, out)) {
+        printf("%s: level %d: streamed plist differs\n", what, level);
+        res = 1;
+    }
+    plist_free(out);
+
+    if (!dict) {
+        plist_from_memory(data, size, &out);
+        if (!same_plist(root, out)) {
+            printf("%s: level %d: plist_from_memory failed\n", what, level);
+            res = 1;
+        }
+        plist_free(out);
+    }
+    free(data);
+    return res;
+}
+
+static plist_t make_entry(uint32_t i)
+{
+    plist_t entry = plist_new_dict();
+    char buf[64];
+
+    snprintf(buf, sizeof(buf), "com.example.application%u", i);
+    plist_dict_set_item(entry, "CFBundleIdentifier", plist_new_string(buf));
+    plist_dict_set_item(entry, "CFBundleVersion", plist_new_uint(i % 17));
+    plist_dict_set_item(entry, "CFBundleDisplayName", plist_new_string("Example Application"));
+    plist_dict_set_item(entry, "UIRequiredDeviceCapabilities", plist_new_string("armv7"));
+    plist_dict_set_item(entry, "Ratio", plist_new_real(i / 3.0));
+    plist_dict_set_item(entry, "Enabled", plist_new_bool(i & 1));
+    return entry;
+}
+
+static int check_generated(void)
+{
+    plist_t root = plist_new_array();
+    plist_t small = plist_new_string("x");
+    char *random = (char*)malloc(200000);
+    char *bin = NULL;
+    uint32_t bin_size = 0;
+    uint32_t size = 0;
+    uint32_t fast_size = 0;
+    uint32_t i = 0;
+    int level = 0;
+    int res = 0;
+
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        plist_array_append_item(root, make_entry(i));
+    }
+    plist_to_bin(root, &bin, &bin_size);
+    free(bin);
+    for (level = 0; level <= 12; level += 3) {
+        res |= check_round_trip(root, level, NULL, "generated", &size);
+        if (level == 0) {
+            fast_size = size;
+        }
+        if (size > bin_size / 2) {
+            printf("Level %d: %u bytes compressed to %u\n", level, bin_size, size);
+            res = 1;
+        }
+    }
+    if (size > fast_size) {
+        printf("Level 12 output is larger than level 0 output\n");
+        res = 1;
+    }
+
+    /* data that doesn't compress ends up in stored blocks */
+    srand(1);
+    for (i = 0; i < 200000; i++) {
+        random[i] = (char)rand();
+    }
+    plist_array_append_item(root, plist_new_data(random, 200000));
+    res |= check_round_trip(root, 1, NULL, "incompressible", NULL);
+    res |= check_round_trip(small, 1, NULL, "small", NULL);
+    res |= check_round_trip(small, 9, NULL, "small", NULL);
+
+    if (plist_to_bin_compressed(root, PLIST_COMPRESS_LZ4, 13, NULL, &bin, &size) == 0 || plist_to_bin_compressed(root, (plist_compression_t)7, 1, NULL, &bin, &size) == 0) {
+        printf("Invalid arguments were accepted\n");
+        res = 1;
+    }
+    free(random);
+    plist_free(small);
+    plist_free(root);
+    return res;
+}
+
+static int check_corrupt(void)
+{
+    plist_t root = plist_new_array();
+    plist_t out = NULL;
+    char *data = NULL;
+    uint32_t size = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    for (i = 0; i < 100; i++) {
+        plist_array_append_item(root, make_entry(i));
+    }
+    plist_to_bin_compressed(root, PLIST_COMPRESS_LZ4, 1, NULL, &data, &size);
+
+    /* every truncation fails */
+    for (i = 0; i < size; i += 3) {
+        plist_from_bin_compressed(data, i, NULL, &out);
+        if (out) {
+            printf("Truncated to %u bytes was accepted\n", i);
+            plist_free(out);
+            res = 1;
+        }
+    }
+    /* changed bytes either fail or are caught by the checksum */
+    for (i = 6; i < size; i++) {
+        data[i] ^= 0x20;
+        plist_from_bin_compressed(data, size, NULL, &out);
+        if (out) {
+            printf("Changed byte %u was accepted\n", i);
+            plist_free(out);
+            res = 1;
+        }
+        data[i] ^= 0x20;
+    }
+    free(data);
+    plist_free(root);
+    return res;
+}
+
+static int check_dict(void)
+{
+    char *samples[NUM_SAMPLES];
+    uint32_t lengths[NUM_SAMPLES];
+    plist_compress_dict_t dict = NULL;
+    plist_compress_dict_t loaded = NULL;
+    plist_compress_dict_t other = NULL;
+    plist_t doc = make_entry(123456);
+    plist_t out = NULL;
+    const char *content = NULL;
+    char *data = NULL;
+    uint32_t content_size = 0;
+    uint32_t plain_size = 0;
+    uint32_t dict_size = 0;
+    uint32_t size = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    for (i = 0; i < NUM_SAMPLES; i++) {
+        plist_t entry = make_entry(i * 7);
+        samples[i] = NULL;
+        plist_to_bin(entry, &samples[i], &lengths[i]);
+        plist_free(entry);
+    }
+    dict = plist_compress_dict_train((const char *const *)samples, lengths, NUM_SAMPLES, 4096);
+    if (!dict) {
+        printf("Could not train a dictionary\n");
+        return 1;
+    }
+    plist_compress_dict_get_data(dict, &content, &content_size);
+    if (content_size == 0 || content_size > 4096) {
+        printf("Dictionary has %u bytes\n", content_size);
+        res = 1;
+    }
+
+    res |= check_round_trip(doc, 1, NULL, "without dictionary", &plain_size);
+    res |= check_round_trip(doc, 1, dict, "dictionary", &dict_size);
+    res |= check_round_trip(doc, 9, dict, "dictionary", &size);
+    if (dict_size * 2 > plain_size || size > dict_size) {
+        printf("Dictionary does not help: %u bytes with, %u without\n", dict_size, plain_size);
+        res = 1;
+    }
+
+    /* a dictionary made from the saved content is the same */
+    loaded = plist_compress_dict_new(content, content_size);
+    other = plist_compress_dict_new("something else entirely", 23);
+    plist_to_bin_compressed(doc, PLIST_COMPRESS_LZ4, 1, dict, &data, &size);
+    plist_from_bin_compressed(data, size, loaded, &out);
+    if (!same_plist(doc, out)) {
+        printf("Loaded dictionary does not work\n");
+        res = 1;
+    }
+    plist_free(out);
+    plist_from_bin_compressed(data, size, NULL, &out);
+    if (out) {
+        printf("Decompressed without the dictionary\n");
+        plist_free(out);
+        res = 1;
+    }
+    plist_from_bin_compressed(data, size, other, &out);
+    if (out) {
+        printf("Decompressed with the wrong dictionary\n");
+        plist_free(out);
+        res = 1;
+    }
+    plist_from_memory(data, size, &out);
+    if (out) {
+        printf("plist_from_memory ignored the dictionary\n");
+        plist_free(out);
+        res = 1;
+    }
+    free(data);
+
+    plist_compress_dict_free(dict);
+    plist_compress_dict_free(loaded);
+    plist_compress_dict_free(other);
+    for (i = 0; i < NUM_SAMPLES; i++) {
+        free(samples[i]);
+    }
+    plist_free(doc);
+    return res;
+}
+
+static int check_file(const char *filename)
+{
+    plist_t root = NULL;
+    int res = 0;
+
+    /* invalid files are checked elsewhere */
+    plist_read_from_file(filename, &root, NULL);
+    if (!root) {
+        return 0;
+    }
+    res |= check_round_trip(root, 1, NULL, filename, NULL);
+    res |= check_round_trip(root, 9, NULL, filename, NULL);
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    res |= check_generated();
+    res |= check_corrupt();
+    res |= check_dict();
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("Compressed plists succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,192 @@
+/*
+ * plist_context_test.c
+ * checks that parsing and writing binary plists with a reused context gives
+ * the same result as the regular parser and writer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+/* a dict that contains itself */
+static const char recursive_bplist[] = {
+    'b', 'p', 'l', 'i', 's', 't', '0', '0',
+    /* 0: dict with one entry, key object 1, value object 0 */
+    (char)0xD1, 0x01, 0x00,
+    /* 1: "a" */
+    0x51, 'a',
+    /* offset table */
+    0x08, 0x0B,
+    /* trailer */
+    0, 0, 0, 0, 0, 0, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 2,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 13
+};
+
+static int check_bin(plist_context_t ctx, const char *bin, uint32_t size, const char *what)
+{
+    uint32_t options[] = { PLIST_WRITE_DEFAULT, PLIST_WRITE_COMPACT };
+    plist_t expected = NULL;
+    plist_t parsed = NULL;
+    char *out = NULL;
+    const char *out2 = NULL;
+    uint32_t out_size = 0;
+    uint32_t out_size2 = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    plist_from_bin(bin, size, &expected);
+    plist_from_bin_ctx(ctx, bin, size, &parsed);
+    if (!expected || !parsed) {
+        if (expected || parsed) {
+            printf("%s: parsing with a context %s\n", what, parsed ? "must fail" : "failed");
+            res = 1;
+        }
+        plist_free(expected);
+        plist_free(parsed);
+        return res;
+    }
+
+    for (i = 0; i < sizeof(options) / sizeof(options[0]); i++) {
+        out = NULL;
+        out2 = NULL;
+        plist_to_bin_ex(expected, options[i], &out, &out_size);
+        plist_to_bin_ctx(ctx, parsed, options[i], &out2, &out_size2);
+        if (!out2 || out_size != out_size2 || memcmp(out, out2, out_size) != 0) {
+            printf("%s: output with a context differs (options %u)\n", what, options[i]);
+            res = 1;
+        }
+        free(out);
+    }
+
+    plist_free(expected);
+    plist_free(parsed);
+    return res;
+}
+
+static int check_generated(plist_context_t ctx, uint32_t count)
+{
+    plist_t root = plist_new_dict();
+    plist_t items = plist_new_array();
+    char *bin = NULL;
+    uint32_t size = 0;
+    char buf[64];
+    uint32_t i = 0;
+    int res = 0;
+
+    for (i = 0; i < count; i++) {
+        plist_t entry = plist_new_dict();
+        snprintf(buf, sizeof(buf), "item %u", i);
+        plist_dict_set_item(entry, "name", plist_new_string(buf));
+        plist_dict_set_item(entry, "index", plist_new_uint(i));
+        plist_dict_set_item(entry, "flag", plist_new_bool(i & 1));
+        plist_dict_set_item(entry, "data", plist_new_data(buf, strlen(buf)));
+        plist_array_append_item(items, entry);
+        /* the same contents again, for the compact writer */
+        plist_array_append_item(items, plist_copy(entry));
+    }
+    plist_dict_set_item(root, "items", items);
+    plist_to_bin(root, &bin, &size);
+    plist_free(root);
+
+    snprintf(buf, sizeof(buf), "generated (%u)", count);
+    res = check_bin(ctx, bin, size, buf);
+    free(bin);
+    return res;
+}
+
+static int check_file(plist_context_t ctx, const char *filename)
+{
+    plist_t root = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    FILE *f = NULL;
+    long len = 0;
+    int res = 0;
+
+    f = fopen(filename, "rb");
+    if (!f) {
+        printf("Could not open %s\n", filename);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bin = (char*)malloc(len > 0 ? len : 1);
+    if (!bin || fread(bin, 1, len, f) != (size_t)len) {
+        printf("Could not read %s\n", filename);
+        fclose(f);
+        free(bin);
+        return 1;
+    }
+    fclose(f);
+    size = (uint32_t)len;
+
+    /* XML plists are checked in binary form */
+    if (!plist_is_binary(bin, size)) {
+        plist_from_xml(bin, size, &root);
+        free(bin);
+        bin = NULL;
+        if (!root) {
+            return 0;
+        }
+        plist_to_bin(root, &bin, &size);
+        plist_free(root);
+    }
+
+    res = check_bin(ctx, bin, size, filename);
+    free(bin);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_context_t ctx = plist_context_new();
+    int res = 0;
+    int round = 0;
+    int i = 0;
+
+    if (!ctx) {
+        printf("Could not create a context\n");
+        return 1;
+    }
+
+    /* large plists first, so the smaller ones run with oversized buffers */
+    for (round = 0; round < 2; round++) {
+        res |= check_generated(ctx, 20000);
+        res |= check_generated(ctx, 10);
+        res |= check_bin(ctx, recursive_bplist, sizeof(recursive_bplist), "recursive");
+        res |= check_generated(ctx, 1);
+        for (i = 1; i < argc; i++) {
+            res |= check_file(ctx, argv[i]);
+        }
+    }
+
+    plist_context_free(ctx);
+
+    if (res == 0) {
+        printf("Parsing and writing with a context succeeded\n");
+    }
+    return res;
+}
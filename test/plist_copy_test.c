@@ -0,0 +1,184 @@
+/*
+ * plist_copy_test.c
+ * checks that copies share string and data payloads and stay independent
+ * of the original tree
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LONG_STRING "a string that is too long to be stored inline"
+#define LONG_DATA "some data that is shared between copies"
+
+static plist_t build_tree(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t items = plist_new_array();
+    char buf[64];
+    int i = 0;
+
+    plist_dict_set_item(root, "long", plist_new_string(LONG_STRING));
+    plist_dict_set_item(root, "short", plist_new_string("short"));
+    plist_dict_set_item(root, "data", plist_new_data(LONG_DATA, strlen(LONG_DATA)));
+    plist_dict_set_item(root, "a key that is long enough to be on the heap", plist_new_bool(1));
+    for (i = 0; i < 100; i++) {
+        snprintf(buf, sizeof(buf), "item number %d of the array", i);
+        plist_array_append_item(items, plist_new_string(buf));
+    }
+    plist_dict_set_item(root, "items", items);
+    return root;
+}
+
+static int check_values(plist_t root, const char *what)
+{
+    const char *str = NULL;
+    uint64_t len = 0;
+    char buf[64];
+    int i = 0;
+
+    str = plist_get_string_ptr(plist_dict_get_item(root, "long"), &len);
+    if (!str || len != strlen(LONG_STRING) || strcmp(str, LONG_STRING) != 0) {
+        printf("%s: long string differs\n", what);
+        return 1;
+    }
+    str = plist_get_string_ptr(plist_dict_get_item(root, "short"), NULL);
+    if (!str || strcmp(str, "short") != 0) {
+        printf("%s: short string differs\n", what);
+        return 1;
+    }
+    str = plist_get_data_ptr(plist_dict_get_item(root, "data"), &len);
+    if (!str || len != strlen(LONG_DATA) || memcmp(str, LONG_DATA, len) != 0) {
+        printf("%s: data differs\n", what);
+        return 1;
+    }
+    if (!plist_dict_get_item(root, "a key that is long enough to be on the heap")) {
+        printf("%s: long key is missing\n", what);
+        return 1;
+    }
+    for (i = 0; i < 100; i++) {
+        snprintf(buf, sizeof(buf), "item number %d of the array", i);
+        str = plist_get_string_ptr(plist_access_path(root, 2, "items", i), NULL);
+        if (!str || strcmp(str, buf) != 0) {
+            printf("%s: array item %d differs\n", what, i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int check_shared(void)
+{
+    plist_t root = build_tree();
+    plist_t copy = plist_copy(root);
+    plist_t copy2 = NULL;
+    int res = 0;
+
+    if (plist_get_string_ptr(plist_dict_get_item(root, "long"), NULL) != plist_get_string_ptr(plist_dict_get_item(copy, "long"), NULL)) {
+        printf("Long string is not shared\n");
+        res = 1;
+    }
+    if (plist_get_data_ptr(plist_dict_get_item(root, "data"), NULL) != plist_get_data_ptr(plist_dict_get_item(copy, "data"), NULL)) {
+        printf("Data is not shared\n");
+        res = 1;
+    }
+
+    /* changing a copy replaces its payload only */
+    plist_set_string_val(plist_dict_get_item(copy, "long"), "changed");
+    plist_set_data_val(plist_dict_get_item(copy, "data"), "x", 1);
+    res |= check_values(root, "original after changing the copy");
+
+    /* the copy outlives the original */
+    copy2 = plist_copy(root);
+    plist_free(root);
+    res |= check_values(copy2, "copy of freed original");
+    plist_set_string_val(plist_dict_get_item(copy, "long"), LONG_STRING);
+    plist_set_data_val(plist_dict_get_item(copy, "data"), LONG_DATA, strlen(LONG_DATA));
+    res |= check_values(copy, "changed copy");
+
+    plist_free(copy);
+    res |= check_values(copy2, "copy after freeing the other copy");
+    plist_free(copy2);
+    return res;
+}
+
+static int check_sources(void)
+{
+    plist_t root = build_tree();
+    plist_arena_t arena = plist_arena_new();
+    plist_t parsed = NULL;
+    plist_t copy = NULL;
+    char *bin = NULL;
+    char *xml = NULL;
+    uint32_t size = 0;
+    uint32_t xml_size = 0;
+    int res = 0;
+
+    plist_to_bin(root, &bin, &size);
+    plist_to_xml(root, &xml, &xml_size);
+    plist_free(root);
+
+    plist_from_bin(bin, size, &parsed);
+    copy = plist_copy(parsed);
+    plist_free(parsed);
+    res |= check_values(copy, "copy of binary plist");
+    plist_free(copy);
+
+    parsed = NULL;
+    plist_from_bin_ex(bin, size, PLIST_PARSE_BORROW, &parsed);
+    copy = plist_copy(parsed);
+    plist_free(parsed);
+    res |= check_values(copy, "copy of borrowing binary plist");
+    plist_free(copy);
+
+    parsed = NULL;
+    plist_from_xml(xml, xml_size, &parsed);
+    copy = plist_copy(parsed);
+    plist_free(parsed);
+    res |= check_values(copy, "copy of XML plist");
+    plist_free(copy);
+
+    parsed = NULL;
+    plist_from_bin_arena(bin, size, &parsed, arena);
+    if (!parsed) {
+        printf("Could not parse into an arena\n");
+        return 1;
+    }
+    copy = plist_copy(parsed);
+    plist_arena_free(arena);
+    res |= check_values(copy, "copy of arena plist");
+    plist_free(copy);
+
+    free(bin);
+    free(xml);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+
+    res |= check_shared();
+    res |= check_sources();
+
+    if (res == 0) {
+        printf("Copies succeeded\n");
+    }
+    return res;
+}
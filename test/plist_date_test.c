@@ -0,0 +1,181 @@
+/*
+ * plist_date_test.c
+ * checks writing and parsing of dates in XML plists
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef WIN32
+
+int main(int argc, char *argv[])
+{
+    /* skipped, the expected values come from gmtime_r() */
+    return 77;
+}
+
+#else
+
+#define MAC_EPOCH 978307200
+
+#define XML_HEAD "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n<plist version=\"1.0\">\n<date>"
+#define XML_TAIL "</date>\n</plist>\n"
+
+/* the text of the date element written for node */
+static int get_date_text(plist_t node, char *text, size_t size)
+{
+    char *xml = NULL;
+    uint32_t length = 0;
+    char *start = NULL;
+    char *end = NULL;
+
+    plist_to_xml(node, &xml, &length);
+    if (!xml) {
+        return -1;
+    }
+    start = strstr(xml, "<date>");
+    end = strstr(xml, "</date>");
+    if (!start || !end || (size_t)(end - start - 6) >= size) {
+        plist_mem_free(xml);
+        return -1;
+    }
+    start += 6;
+    memcpy(text, start, end - start);
+    text[end - start] = '\0';
+    plist_mem_free(xml);
+    return 0;
+}
+
+static plist_t parse_date_text(const char *text)
+{
+    char xml[512];
+    plist_t node = NULL;
+    snprintf(xml, sizeof(xml), "%s%s%s", XML_HEAD, text, XML_TAIL);
+    plist_from_xml(xml, strlen(xml), &node);
+    return node;
+}
+
+/* writes a date with the given Mac time and compares with gmtime_r() */
+static int check_seconds(int32_t sec)
+{
+    time_t t = (time_t)sec + MAC_EPOCH;
+    struct tm tm;
+    char expected[64];
+    char text[64];
+    plist_t node = plist_new_date(sec, 0);
+    plist_t parsed = NULL;
+    int32_t psec = 0;
+    int32_t pusec = 0;
+    int res = 0;
+
+    gmtime_r(&t, &tm);
+    strftime(expected, sizeof(expected), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    if (get_date_text(node, text, sizeof(text)) != 0 || strcmp(text, expected) != 0) {
+        printf("%d: wrote '%s' instead of '%s'\n", sec, text, expected);
+        res = 1;
+    }
+    parsed = parse_date_text(expected);
+    plist_get_date_val(parsed, &psec, &pusec);
+    if (!parsed || psec != sec) {
+        printf("'%s': parsed as %d instead of %d\n", expected, psec, sec);
+        res = 1;
+    }
+    plist_free(parsed);
+    plist_free(node);
+    return res;
+}
+
+/* parses text and checks that writing it again gives the same text */
+static int check_round_trip(const char *text)
+{
+    char out[64];
+    plist_t node = parse_date_text(text);
+    int res = 0;
+
+    if (!node || get_date_text(node, out, sizeof(out)) != 0 || strcmp(out, text) != 0) {
+        printf("'%s': written back as '%s'\n", text, node ? out : "(null)");
+        res = 1;
+    }
+    plist_free(node);
+    return res;
+}
+
+static int check_same(const char *text1, const char *text2)
+{
+    plist_t node1 = parse_date_text(text1);
+    plist_t node2 = parse_date_text(text2);
+    int res = 0;
+
+    if (!node1 || !node2 || !plist_compare_node_value(node1, node2)) {
+        printf("'%s' and '%s' differ\n", text1, text2);
+        res = 1;
+    }
+    plist_free(node1);
+    plist_free(node2);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *round_trips[] = {
+        "2001-01-01T00:00:00Z",
+        "1970-01-01T00:00:00Z",
+        "1969-12-31T23:59:59Z",
+        "1000-01-01T00:00:00Z",
+        "1582-10-15T12:00:00Z",
+        "1600-02-29T01:02:03Z",
+        "1900-02-28T23:59:59Z",
+        "2000-02-29T12:34:56Z",
+        "2038-01-19T03:14:08Z",
+        "2400-02-29T00:00:00Z",
+        "9999-12-31T23:59:59Z",
+        NULL
+    };
+    int32_t sec = 0;
+    int64_t s = 0;
+    int res = 0;
+    int i = 0;
+
+    for (i = 0; round_trips[i]; i++) {
+        res |= check_round_trip(round_trips[i]);
+    }
+
+    /* values out of range carry over like with timegm() */
+    res |= check_same("2011-02-31T00:00:00Z", "2011-03-03T00:00:00Z");
+    res |= check_same("2011-12-31T24:00:60Z", "2012-01-01T00:01:00Z");
+
+    /* the whole range of plist_new_date() */
+    for (s = INT32_MIN; s <= INT32_MAX; s += 7777777) {
+        res |= check_seconds((int32_t)s);
+    }
+    for (sec = -100000; sec < 100000; sec += 37) {
+        res |= check_seconds(sec);
+    }
+    res |= check_seconds(INT32_MIN);
+    res |= check_seconds(INT32_MAX);
+
+    if (res == 0) {
+        printf("Date formatting and parsing succeeded\n");
+    }
+    return res;
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * plist_depth_test.c
+ * checks deeply nested plists and the nesting depth limit of the parsers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* deep enough to overflow the stack of a recursive implementation */
+#define DEEP_NESTING 200000
+/* the XML output grows quadratically with the nesting because of the indentation */
+#define XML_NESTING 2000
+
+/* creates depth nested containers, alternating arrays and dicts */
+static plist_t create_nested(uint32_t depth)
+{
+    plist_t root = plist_new_array();
+    plist_t cur = root;
+    uint32_t i = 0;
+
+    for (i = 1; i < depth; i++) {
+        plist_t ch = (i & 1) ? plist_new_dict() : plist_new_array();
+        if (plist_get_node_type(cur) == PLIST_DICT) {
+            plist_dict_set_item(cur, "a", plist_new_uint(i));
+            plist_dict_set_item(cur, "b", ch);
+        } else {
+            plist_array_append_item(cur, plist_new_bool(1));
+            plist_array_append_item(cur, ch);
+        }
+        cur = ch;
+    }
+    return root;
+}
+
+static int check_bin_roundtrip(plist_t root, uint32_t depth)
+{
+    plist_t copy = NULL;
+    plist_t parsed = NULL;
+    char *bin = NULL;
+    char *bin2 = NULL;
+    uint32_t size = 0;
+    uint32_t size2 = 0;
+    int res = 0;
+
+    copy = plist_copy(root);
+    plist_to_bin(copy, &bin, &size);
+    if (!bin) {
+        printf("Binary output of nested plist failed\n");
+        plist_free(copy);
+        return 1;
+    }
+
+    plist_from_bin(bin, size, &parsed);
+    if (parsed) {
+        printf("Parsing %u nested containers must fail with the default limit\n", depth);
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    plist_set_max_depth(depth);
+    plist_from_bin(bin, size, &parsed);
+    if (!parsed) {
+        printf("Binary parsing of %u nested containers failed\n", depth);
+        res = 1;
+    } else {
+        plist_to_bin_ex(parsed, PLIST_WRITE_COMPACT, &bin2, &size2);
+        free(bin2);
+        bin2 = NULL;
+        plist_to_bin(parsed, &bin2, &size2);
+        if (!bin2 || size != size2 || memcmp(bin, bin2, size) != 0) {
+            printf("Binary output of reparsed nested plist differs\n");
+            res = 1;
+        }
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    plist_set_max_depth(depth - 1);
+    plist_from_bin(bin, size, &parsed);
+    if (parsed) {
+        printf("Parsing %u nested containers must fail with a limit of %u\n", depth, depth - 1);
+        res = 1;
+    }
+    plist_free(parsed);
+    plist_set_max_depth(0);
+
+    plist_free(copy);
+    free(bin);
+    free(bin2);
+    return res;
+}
+
+static int check_xml_roundtrip(plist_t root, uint32_t depth)
+{
+    plist_t parsed = NULL;
+    char *xml = NULL;
+    char *xml2 = NULL;
+    uint32_t size = 0;
+    uint32_t size2 = 0;
+    int res = 0;
+
+    plist_to_xml(root, &xml, &size);
+    if (!xml) {
+        printf("XML output of nested plist failed\n");
+        return 1;
+    }
+
+    plist_from_xml(xml, size, &parsed);
+    if (parsed) {
+        printf("Parsing %u nested XML containers must fail with the default limit\n", depth);
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    plist_set_max_depth(depth);
+    plist_from_xml(xml, size, &parsed);
+    if (!parsed) {
+        printf("XML parsing of %u nested containers failed\n", depth);
+        res = 1;
+    } else {
+        plist_to_xml(parsed, &xml2, &size2);
+        if (!xml2 || size != size2 || memcmp(xml, xml2, size) != 0) {
+            printf("XML output of reparsed nested plist differs\n");
+            res = 1;
+        }
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    plist_set_max_depth(depth - 1);
+    plist_from_xml(xml, size, &parsed);
+    if (parsed) {
+        printf("Parsing %u nested XML containers must fail with a limit of %u\n", depth, depth - 1);
+        res = 1;
+    }
+    plist_free(parsed);
+    plist_set_max_depth(0);
+
+    free(xml);
+    free(xml2);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_t root = NULL;
+    int res = 0;
+
+    root = create_nested(DEEP_NESTING);
+    res |= check_bin_roundtrip(root, DEEP_NESTING);
+    plist_free(root);
+
+    root = create_nested(XML_NESTING);
+    res |= check_xml_roundtrip(root, XML_NESTING);
+    plist_free(root);
+
+    if (res == 0) {
+        printf("Nested plists succeeded\n");
+    }
+    return res;
+}
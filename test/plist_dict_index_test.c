@@ -0,0 +1,204 @@
+/*
+ * plist_dict_index_test.c
+ * checks dictionary lookups with and without a key index
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_ENTRIES 1000
+
+static int check_lookups(plist_t dict, const char *what, int modify)
+{
+    char key[32];
+    uint64_t val = 0;
+    uint32_t i = 0;
+
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        snprintf(key, sizeof(key), "key%u", i);
+        plist_t item = plist_dict_get_item(dict, key);
+        if (!item) {
+            printf("%s: %s not found\n", what, key);
+            return 1;
+        }
+        plist_get_uint_val(item, &val);
+        if (val != i) {
+            printf("%s: %s has value %llu\n", what, key, (unsigned long long)val);
+            return 1;
+        }
+    }
+    if (plist_dict_get_item(dict, "missing")) {
+        printf("%s: found a key that doesn't exist\n", what);
+        return 1;
+    }
+
+    if (!modify) {
+        return 0;
+    }
+
+    /* the index must follow modifications */
+    plist_dict_remove_item(dict, "key7");
+    plist_dict_set_item(dict, "key8", plist_new_uint(8000));
+    plist_dict_set_item(dict, "added", plist_new_bool(1));
+    if (plist_dict_get_item(dict, "key7") || !plist_dict_get_item(dict, "added")) {
+        printf("%s: lookup after modification failed\n", what);
+        return 1;
+    }
+    plist_get_uint_val(plist_dict_get_item(dict, "key8"), &val);
+    if (val != 8000) {
+        printf("%s: replaced item not found\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+/* checks the order after check_lookups() modified dict, then removes all
+ * items again */
+static int check_removal(plist_t dict, const char *what)
+{
+    plist_dict_iter it = NULL;
+    const char *k = NULL;
+    plist_t val = NULL;
+    char key[32];
+    uint32_t expected = 0;
+    uint32_t size = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    /* a replaced item keeps its position */
+    plist_dict_new_iter(dict, &it);
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        if (i == 7) {
+            continue;
+        }
+        snprintf(key, sizeof(key), "key%u", i);
+        plist_dict_next_item_ptr(dict, it, &k, &val);
+        if (!k || strcmp(k, key) != 0) {
+            printf("%s: found %s instead of %s\n", what, k ? k : "(null)", key);
+            res = 1;
+            break;
+        }
+    }
+    plist_dict_next_item_ptr(dict, it, &k, &val);
+    if (res == 0 && (!k || strcmp(k, "added") != 0)) {
+        printf("%s: added item is not last\n", what);
+        res = 1;
+    }
+    free(it);
+
+    size = plist_dict_get_size(dict);
+    expected = size;
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        snprintf(key, sizeof(key), "key%u", (i * 7) % NUM_ENTRIES);
+        if (plist_dict_get_item(dict, key)) {
+            plist_dict_remove_item(dict, key);
+            expected--;
+        }
+        if (plist_dict_get_item(dict, key) || plist_dict_get_size(dict) != expected) {
+            printf("%s: removing %s failed\n", what, key);
+            return 1;
+        }
+    }
+    plist_dict_remove_item(dict, "added");
+    if (plist_dict_get_size(dict) != 0) {
+        printf("%s: dictionary not empty after removing all items\n", what);
+        res = 1;
+    }
+    /* the empty dictionary can be filled again */
+    plist_dict_set_item(dict, "again", plist_new_bool(1));
+    if (plist_dict_get_size(dict) != 1 || !plist_dict_get_item(dict, "again")) {
+        printf("%s: adding to the emptied dictionary failed\n", what);
+        res = 1;
+    }
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t thresholds[] = { 0, 250, UINT32_MAX };
+    plist_t dict = NULL;
+    plist_t parsed = NULL;
+    plist_t copy = NULL;
+    plist_arena_t arena = NULL;
+    char *bin = NULL;
+    char *xml = NULL;
+    uint32_t bin_size = 0;
+    uint32_t xml_size = 0;
+    char key[32];
+    uint32_t i = 0;
+    int res = 0;
+
+    dict = plist_new_dict();
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        snprintf(key, sizeof(key), "key%u", i);
+        plist_dict_set_item(dict, key, plist_new_uint(i));
+    }
+    plist_to_bin(dict, &bin, &bin_size);
+    plist_to_xml(dict, &xml, &xml_size);
+    plist_free(dict);
+
+    for (i = 0; i < sizeof(thresholds) / sizeof(thresholds[0]); i++) {
+        plist_set_dict_index_threshold(thresholds[i]);
+
+        plist_from_bin(bin, bin_size, &parsed);
+        res |= check_lookups(parsed, "binary", 1);
+        plist_free(parsed);
+
+        plist_from_bin_ex(bin, bin_size, PLIST_PARSE_LAZY, &parsed);
+        res |= check_lookups(parsed, "lazy binary", 1);
+        plist_free(parsed);
+
+        arena = plist_arena_new();
+        plist_from_bin_arena(bin, bin_size, &parsed, arena);
+        /* heap nodes can't be added to an arena tree */
+        res |= check_lookups(parsed, "binary arena", 0);
+        plist_arena_free(arena);
+        parsed = NULL;
+
+        arena = plist_arena_new_ex(PLIST_ARENA_INTERN_KEYS);
+        plist_from_bin_arena(bin, bin_size, &parsed, arena);
+        res |= check_lookups(parsed, "interned binary arena", 0);
+        plist_arena_free(arena);
+        parsed = NULL;
+
+        plist_from_xml(xml, xml_size, &parsed);
+        if (!parsed) {
+            printf("XML parsing failed\n");
+            res = 1;
+            break;
+        }
+        copy = plist_copy(parsed);
+        res |= check_lookups(parsed, "XML", 1);
+        res |= check_lookups(copy, "copy", 1);
+        res |= check_removal(parsed, "XML");
+        res |= check_removal(copy, "copy");
+        plist_free(parsed);
+        plist_free(copy);
+    }
+    plist_set_dict_index_threshold(250);
+
+    free(bin);
+    free(xml);
+
+    if (res == 0) {
+        printf("Dictionary lookups succeeded\n");
+    }
+    return res;
+}
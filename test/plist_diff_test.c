@@ -0,0 +1,291 @@
+/*
+ * plist_diff_test.c
+ * checks that patches made by plist_diff turn the old tree into the new one
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_APPS 50
+#define NUM_ROUNDS 200
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return (n > 0) ? ((rnd_state >> 8) % n) : 0;
+}
+
+static plist_t build_tree(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t apps = plist_new_array();
+    char buf[64];
+    int i = 0;
+
+    for (i = 0; i < NUM_APPS; i++) {
+        plist_t app = plist_new_dict();
+        plist_t list = plist_new_array();
+        snprintf(buf, sizeof(buf), "com.example.app%d", i);
+        plist_dict_set_item(app, "CFBundleIdentifier", plist_new_string(buf));
+        plist_dict_set_item(app, "Version", plist_new_uint(i));
+        plist_array_append_item(list, plist_new_bool(i & 1));
+        plist_array_append_item(list, plist_new_real(i / 2.0));
+        plist_dict_set_item(app, "List", list);
+        plist_array_append_item(apps, app);
+    }
+    plist_dict_set_item(root, "Applications", apps);
+    plist_dict_set_item(root, "Name", plist_new_string("device"));
+    plist_dict_set_item(root, "Data", plist_new_data("\0\1\2", 3));
+    return root;
+}
+
+/* picks a random array or dict in the tree */
+static plist_t pick_container(plist_t root)
+{
+    plist_t node = root;
+    int depth = rnd(4);
+
+    while (depth-- > 0) {
+        plist_t child = NULL;
+        if (plist_get_node_type(node) == PLIST_ARRAY && plist_array_get_size(node) > 0) {
+            child = plist_array_get_item(node, rnd(plist_array_get_size(node)));
+        } else if (plist_get_node_type(node) == PLIST_DICT && plist_dict_get_size(node) > 0) {
+            plist_dict_iter it = NULL;
+            const char *key = NULL;
+            uint32_t n = rnd(plist_dict_get_size(node));
+            plist_dict_new_iter(node, &it);
+            do {
+                plist_dict_next_item_ptr(node, it, &key, &child);
+            } while (n-- > 0);
+            free(it);
+        }
+        if (!child || (plist_get_node_type(child) != PLIST_ARRAY && plist_get_node_type(child) != PLIST_DICT)) {
+            break;
+        }
+        node = child;
+    }
+    return node;
+}
+
+static plist_t random_value(void)
+{
+    char buf[32];
+    switch (rnd(5)) {
+    case 0:
+        return plist_new_uint(rnd(1000));
+    case 1:
+        snprintf(buf, sizeof(buf), "value %u", rnd(1000));
+        return plist_new_string(buf);
+    case 2:
+        return plist_new_bool(rnd(2));
+    case 3:
+        return plist_new_array();
+    default:
+        return plist_new_dict();
+    }
+}
+
+static void mutate(plist_t root)
+{
+    plist_t node = pick_container(root);
+    char key[32];
+
+    snprintf(key, sizeof(key), "key %u", rnd(8));
+    if (plist_get_node_type(node) == PLIST_DICT) {
+        if (rnd(3) == 0 && plist_dict_get_item(node, key)) {
+            plist_dict_remove_item(node, key);
+        } else {
+            plist_dict_set_item(node, key, random_value());
+        }
+        return;
+    }
+    switch (rnd(4)) {
+    case 0:
+        plist_array_append_item(node, random_value());
+        break;
+    case 1:
+        plist_array_insert_item(node, random_value(), rnd(plist_array_get_size(node) + 1));
+        break;
+    case 2:
+        if (plist_array_get_size(node) > 0) {
+            plist_array_remove_item(node, rnd(plist_array_get_size(node)));
+        }
+        break;
+    default:
+        if (plist_array_get_size(node) > 0) {
+            plist_array_set_item(node, random_value(), rnd(plist_array_get_size(node)));
+        }
+        break;
+    }
+}
+
+/* diffs old_node and new_node and checks the patch, also after a binary
+ * round trip of the patch */
+static int check_patch(plist_t old_node, plist_t new_node, uint32_t max_ops, const char *what)
+{
+    plist_t patch = plist_diff(old_node, new_node);
+    plist_t target = plist_copy(old_node);
+    plist_t parsed = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    int res = 0;
+
+    if (!patch) {
+        printf("%s: no patch\n", what);
+        plist_free(target);
+        return 1;
+    }
+    if (max_ops > 0 && plist_array_get_size(patch) > max_ops) {
+        printf("%s: %u operations instead of at most %u\n", what, plist_array_get_size(patch), max_ops);
+        res = 1;
+    }
+    if (plist_patch(&target, patch) < 0 || !plist_equal_deep(target, new_node)) {
+        printf("%s: patched tree differs\n", what);
+        res = 1;
+    }
+    plist_free(target);
+
+    plist_to_bin(patch, &bin, &size);
+    plist_from_bin(bin, size, &parsed);
+    target = plist_copy(old_node);
+    if (plist_patch(&target, parsed) < 0 || !plist_equal_deep(target, new_node)) {
+        printf("%s: binary patch failed\n", what);
+        res = 1;
+    }
+    plist_free(target);
+    plist_free(parsed);
+    free(bin);
+    plist_free(patch);
+    return res;
+}
+
+static int check_small_changes(void)
+{
+    plist_t root = build_tree();
+    plist_t changed = plist_copy(root);
+    plist_t apps = plist_dict_get_item(changed, "Applications");
+    plist_t patch = NULL;
+    int res = 0;
+
+    patch = plist_diff(root, changed);
+    if (!patch || plist_array_get_size(patch) != 0) {
+        printf("Equal trees have a non-empty patch\n");
+        res = 1;
+    }
+    plist_free(patch);
+
+    plist_set_uint_val(plist_access_path(changed, 3, "Applications", 10, "Version"), 1000);
+    res |= check_patch(root, changed, 1, "changed value");
+    plist_array_insert_item(apps, plist_new_string("inserted"), 20);
+    res |= check_patch(root, changed, 2, "inserted item");
+    plist_array_remove_item(apps, 0);
+    res |= check_patch(root, changed, 3, "removed item");
+    plist_dict_remove_item(changed, "Name");
+    plist_dict_set_item(changed, "Other", plist_new_uint(1));
+    res |= check_patch(root, changed, 5, "changed keys");
+    plist_free(changed);
+
+    /* the root can change its type */
+    changed = plist_new_string("replaced");
+    res |= check_patch(root, changed, 1, "replaced root");
+    res |= check_patch(changed, root, 1, "replaced string");
+    plist_free(changed);
+    plist_free(root);
+    return res;
+}
+
+static int check_random_changes(void)
+{
+    plist_t root = build_tree();
+    plist_t changed = NULL;
+    char what[32];
+    int round = 0;
+    int i = 0;
+    int res = 0;
+
+    for (round = 0; round < NUM_ROUNDS && res == 0; round++) {
+        int count = 1 + rnd(10);
+        changed = plist_copy(root);
+        for (i = 0; i < count; i++) {
+            mutate(changed);
+        }
+        snprintf(what, sizeof(what), "round %d", round);
+        res |= check_patch(root, changed, 0, what);
+        res |= check_patch(changed, root, 0, what);
+        plist_free(changed);
+    }
+    plist_free(root);
+    return res;
+}
+
+static int check_invalid(void)
+{
+    plist_t root = build_tree();
+    plist_t patch = NULL;
+    plist_t entry = NULL;
+    plist_t path = NULL;
+    int res = 0;
+
+    /* a path that does not exist */
+    patch = plist_new_array();
+    entry = plist_new_dict();
+    path = plist_new_array();
+    plist_array_append_item(path, plist_new_string("Applications"));
+    plist_array_append_item(path, plist_new_uint(1000));
+    plist_dict_set_item(entry, "op", plist_new_string("remove"));
+    plist_dict_set_item(entry, "path", path);
+    plist_array_append_item(patch, entry);
+    if (plist_patch(&root, patch) == 0) {
+        printf("Patch with a missing path succeeded\n");
+        res = 1;
+    }
+
+    /* an unknown operation */
+    plist_dict_set_item(entry, "op", plist_new_string("move"));
+    plist_array_set_item(path, plist_new_uint(0), 1);
+    if (plist_patch(&root, patch) == 0) {
+        printf("Patch with an unknown operation succeeded\n");
+        res = 1;
+    }
+    plist_free(patch);
+
+    if (plist_diff(root, NULL) || plist_patch(&root, NULL) == 0) {
+        printf("NULL handling failed\n");
+        res = 1;
+    }
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+
+    res |= check_small_changes();
+    res |= check_random_changes();
+    res |= check_invalid();
+
+    if (res == 0) {
+        printf("Diff and patch succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,250 @@
+/*
+ * plist_frozen_test.c
+ * checks that frozen plists return the same values as the tree they were
+ * made from
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define NUM_ENTRIES 1000
+
+/* compares the frozen node obj with node and everything below it */
+static int check_node(plist_frozen_t frozen, uint64_t obj, plist_t node)
+{
+    plist_type type = plist_get_node_type(node);
+    const char *str = NULL;
+    const char *expected = NULL;
+    uint64_t len = 0;
+    uint64_t expected_len = 0;
+    uint64_t uval = 0;
+    uint64_t expected_uval = 0;
+    double dval = 0;
+    double expected_dval = 0;
+    uint8_t bval = 0;
+    uint8_t expected_bval = 0;
+    uint64_t child = 0;
+    uint64_t key = 0;
+    uint32_t i = 0;
+
+    if (plist_frozen_get_type(frozen, obj) != type) {
+        printf("Node %llu has type %d instead of %d\n", (unsigned long long)obj, plist_frozen_get_type(frozen, obj), type);
+        return 1;
+    }
+    switch (type) {
+    case PLIST_BOOLEAN:
+        plist_get_bool_val(node, &expected_bval);
+        return plist_frozen_get_bool(frozen, obj, &bval) < 0 || bval != expected_bval;
+    case PLIST_UINT:
+    case PLIST_UID:
+        if (type == PLIST_UID) {
+            plist_get_uid_val(node, &expected_uval);
+        } else {
+            plist_get_uint_val(node, &expected_uval);
+        }
+        return plist_frozen_get_uint(frozen, obj, &uval) < 0 || uval != expected_uval;
+    case PLIST_REAL:
+    case PLIST_DATE:
+        if (type == PLIST_DATE) {
+            /* compared as a thawed node, plist_get_date_val rounds */
+            int32_t sec = 0;
+            int32_t usec = 0;
+            int32_t expected_sec = 0;
+            int32_t expected_usec = 0;
+            plist_t thawed = plist_frozen_get_node(frozen, obj);
+            plist_get_date_val(node, &expected_sec, &expected_usec);
+            plist_get_date_val(thawed, &sec, &usec);
+            plist_free(thawed);
+            return plist_frozen_get_real(frozen, obj, &dval) < 0 || sec != expected_sec || usec != expected_usec;
+        }
+        plist_get_real_val(node, &expected_dval);
+        return plist_frozen_get_real(frozen, obj, &dval) < 0 || dval != expected_dval;
+    case PLIST_STRING:
+        expected = plist_get_string_ptr(node, &expected_len);
+        return plist_frozen_get_string(frozen, obj, &str, &len) < 0 || len != expected_len || strcmp(str, expected) != 0;
+    case PLIST_DATA:
+        expected = plist_get_data_ptr(node, &expected_len);
+        return plist_frozen_get_data(frozen, obj, &str, &len) < 0 || len != expected_len || (len > 0 && memcmp(str, expected, len) != 0);
+    case PLIST_ARRAY:
+        if (plist_frozen_get_size(frozen, obj) != plist_array_get_size(node)) {
+            printf("Array %llu has a different size\n", (unsigned long long)obj);
+            return 1;
+        }
+        for (i = 0; i < plist_array_get_size(node); i++) {
+            if (plist_frozen_child(frozen, obj, i, &child) < 0 || check_node(frozen, child, plist_array_get_item(node, i))) {
+                printf("Array item %u differs\n", i);
+                return 1;
+            }
+        }
+        return 0;
+    case PLIST_DICT:
+        if (plist_frozen_get_size(frozen, obj) != plist_dict_get_size(node)) {
+            printf("Dictionary %llu has a different size\n", (unsigned long long)obj);
+            return 1;
+        }
+        for (i = 0; i < plist_dict_get_size(node); i++) {
+            if (plist_frozen_dict_key(frozen, obj, i, &key) < 0 || plist_frozen_get_string(frozen, key, &str, NULL) < 0) {
+                printf("Dictionary key %u is missing\n", i);
+                return 1;
+            }
+            if (plist_frozen_child(frozen, obj, i, &child) < 0 || plist_frozen_dict_get(frozen, obj, str, &uval) < 0 || uval != child) {
+                printf("Lookup of '%s' failed\n", str);
+                return 1;
+            }
+            if (check_node(frozen, child, plist_dict_get_item(node, str))) {
+                printf("Value of '%s' differs\n", str);
+                return 1;
+            }
+        }
+        if (plist_frozen_dict_get(frozen, obj, "no such key", &uval) == 0) {
+            printf("Lookup of a missing key succeeded\n");
+            return 1;
+        }
+        return 0;
+    default:
+        return 0;
+    }
+}
+
+static int check_tree(plist_t root, const char *what)
+{
+    plist_frozen_t frozen = plist_freeze(root);
+    plist_t thawed = NULL;
+    char *bin = NULL;
+    char *bin2 = NULL;
+    uint32_t size = 0;
+    uint32_t size2 = 0;
+    int res = 0;
+
+    if (!frozen) {
+        printf("%s: could not freeze\n", what);
+        return 1;
+    }
+    if (check_node(frozen, plist_frozen_root(frozen), root)) {
+        printf("%s: frozen plist differs\n", what);
+        res = 1;
+    }
+
+    thawed = plist_frozen_get_node(frozen, plist_frozen_root(frozen));
+    plist_to_bin(root, &bin, &size);
+    plist_to_bin(thawed, &bin2, &size2);
+    if (!bin || !bin2 || size != size2 || memcmp(bin, bin2, size) != 0) {
+        printf("%s: thawed tree differs\n", what);
+        res = 1;
+    }
+    free(bin);
+    free(bin2);
+    plist_free(thawed);
+    plist_frozen_free(frozen);
+    return res;
+}
+
+static int check_generated(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t items = plist_new_array();
+    plist_t small = plist_new_dict();
+    plist_frozen_t frozen = NULL;
+    const char *name = NULL;
+    uint64_t obj = 0;
+    char buf[64];
+    uint32_t i = 0;
+    int res = 0;
+
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        plist_t entry = plist_new_dict();
+        snprintf(buf, sizeof(buf), "item %u", i);
+        plist_dict_set_item(entry, "name", plist_new_string(buf));
+        plist_dict_set_item(entry, "index", plist_new_uint(i));
+        plist_dict_set_item(entry, "ratio", plist_new_real(i / 7.0));
+        plist_dict_set_item(entry, "flag", plist_new_bool(i & 1));
+        plist_dict_set_item(entry, "data", plist_new_data(buf, strlen(buf)));
+        plist_dict_set_item(entry, "date", plist_new_date(i, 0));
+        plist_dict_set_item(entry, "uid", plist_new_uid(i));
+        plist_dict_set_item(entry, "empty", plist_new_array());
+        plist_array_append_item(items, entry);
+        snprintf(buf, sizeof(buf), "key %u", i);
+        plist_dict_set_item(root, buf, plist_new_uint(i));
+    }
+    plist_dict_set_item(small, "a", plist_new_string(""));
+    plist_dict_set_item(small, "b", plist_new_dict());
+    plist_dict_set_item(root, "items", items);
+    plist_dict_set_item(root, "small", small);
+    res |= check_tree(root, "generated");
+    res |= check_tree(items, "array");
+    res |= check_tree(plist_array_get_item(items, 5), "entry");
+
+    /* the frozen plist does not depend on the tree */
+    frozen = plist_freeze(root);
+    plist_free(root);
+    if (plist_frozen_dict_get(frozen, plist_frozen_root(frozen), "items", &obj) < 0
+     || plist_frozen_child(frozen, obj, 42, &obj) < 0
+     || plist_frozen_dict_get(frozen, obj, "name", &obj) < 0
+     || plist_frozen_get_string(frozen, obj, &name, NULL) < 0
+     || strcmp(name, "item 42") != 0) {
+        printf("Lookup after freeing the tree failed\n");
+        res = 1;
+    }
+    if (plist_frozen_get_type(frozen, 1 << 30) != PLIST_NONE || plist_frozen_child(frozen, obj, 0, &obj) == 0) {
+        printf("Invalid access succeeded\n");
+        res = 1;
+    }
+    plist_frozen_free(frozen);
+
+    root = plist_new_string("scalar");
+    res |= check_tree(root, "scalar");
+    plist_free(root);
+    return res;
+}
+
+static int check_file(const char *filename)
+{
+    plist_t root = NULL;
+    int res = 0;
+
+    /* invalid files are checked elsewhere */
+    plist_read_from_file(filename, &root, NULL);
+    if (!root) {
+        return 0;
+    }
+    res = check_tree(root, filename);
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    res |= check_generated();
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("Frozen plists succeeded\n");
+    }
+    return res;
+}
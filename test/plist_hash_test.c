@@ -0,0 +1,250 @@
+/*
+ * plist_hash_test.c
+ * checks deep equality and cached content hashes of trees
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_APPS 300
+
+/* builds the same tree with the dict entries in forward or reverse order */
+static plist_t build_tree(int reverse)
+{
+    plist_t root = plist_new_dict();
+    plist_t apps = plist_new_array();
+    char buf[64];
+    int i = 0;
+
+    for (i = 0; i < NUM_APPS; i++) {
+        plist_t app = plist_new_dict();
+        snprintf(buf, sizeof(buf), "com.example.app%d", i);
+        if (reverse) {
+            plist_dict_set_item(app, "Flags", plist_new_bool(i & 1));
+            plist_dict_set_item(app, "Version", plist_new_real(i / 4.0));
+            plist_dict_set_item(app, "CFBundleIdentifier", plist_new_string(buf));
+        } else {
+            plist_dict_set_item(app, "CFBundleIdentifier", plist_new_string(buf));
+            plist_dict_set_item(app, "Version", plist_new_real(i / 4.0));
+            plist_dict_set_item(app, "Flags", plist_new_bool(i & 1));
+        }
+        plist_array_append_item(apps, app);
+    }
+    for (i = 0; i < NUM_APPS; i++) {
+        int n = (reverse) ? NUM_APPS - 1 - i : i;
+        snprintf(buf, sizeof(buf), "key %d", n);
+        plist_dict_set_item(root, buf, plist_new_uint(n));
+    }
+    plist_dict_set_item(root, "Applications", apps);
+    plist_dict_set_item(root, "Data", plist_new_data("\0\1\2\3", 4));
+    plist_dict_set_item(root, "Date", plist_new_date(1000, 0));
+    plist_dict_set_item(root, "Uid", plist_new_uid(7));
+    return root;
+}
+
+static int check_equal(plist_t a, plist_t b, int expected, const char *what)
+{
+    uint64_t ha = plist_hash(a);
+    uint64_t hb = plist_hash(b);
+
+    if (plist_equal_deep(a, b) != expected || plist_equal_deep(b, a) != expected) {
+        printf("%s: trees are %s\n", what, (expected) ? "not equal" : "equal");
+        return 1;
+    }
+    if (expected && ha != hb) {
+        printf("%s: equal trees have different hashes\n", what);
+        return 1;
+    }
+    if (!expected && ha == hb) {
+        printf("%s: different trees have the same hash\n", what);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_changes(void)
+{
+    plist_t root = build_tree(0);
+    plist_t other = build_tree(1);
+    plist_t app = plist_access_path(root, 2, "Applications", 100);
+    uint64_t hash = plist_hash(root);
+    int res = 0;
+
+    res |= check_equal(root, other, 1, "reversed dict order");
+
+    /* changes deep down reach the root */
+    plist_set_string_val(plist_dict_get_item(app, "CFBundleIdentifier"), "changed");
+    res |= check_equal(root, other, 0, "changed string");
+    plist_set_string_val(plist_dict_get_item(app, "CFBundleIdentifier"), "com.example.app100");
+    if (plist_hash(root) != hash) {
+        printf("Hash differs after restoring the string\n");
+        res = 1;
+    }
+    res |= check_equal(root, other, 1, "restored string");
+
+    plist_array_append_item(plist_dict_get_item(root, "Applications"), plist_new_dict());
+    res |= check_equal(root, other, 0, "appended item");
+    plist_array_remove_item(plist_dict_get_item(root, "Applications"), NUM_APPS);
+    res |= check_equal(root, other, 1, "removed item");
+
+    plist_dict_set_item(app, "Version", plist_new_uint(100));
+    res |= check_equal(root, other, 0, "replaced item");
+    plist_dict_set_item(app, "Version", plist_new_real(100 / 4.0));
+    res |= check_equal(root, other, 1, "restored item");
+
+    plist_dict_remove_item(root, "Uid");
+    res |= check_equal(root, other, 0, "removed key");
+    plist_dict_set_item(root, "Uid", plist_new_uint(7));
+    res |= check_equal(root, other, 0, "uint instead of uid");
+    plist_dict_set_item(root, "Uid", plist_new_uid(7));
+    res |= check_equal(root, other, 1, "restored uid");
+    if (plist_hash(root) != hash) {
+        printf("Hash differs after restoring the tree\n");
+        res = 1;
+    }
+
+    plist_free(root);
+    plist_free(other);
+    return res;
+}
+
+static int check_copies(void)
+{
+    plist_t root = build_tree(0);
+    plist_t copy = NULL;
+    plist_t array = NULL;
+    uint64_t hash = plist_hash(root);
+    int res = 0;
+
+    /* copies inherit the cached hashes, and changes stay separate */
+    copy = plist_copy(root);
+    res |= check_equal(root, copy, 1, "copy");
+    plist_array_insert_item(plist_dict_get_item(copy, "Applications"), plist_new_string("new"), 5);
+    res |= check_equal(root, copy, 0, "changed copy");
+    if (plist_hash(root) != hash) {
+        printf("Changing the copy changed the original\n");
+        res = 1;
+    }
+    plist_free(copy);
+
+    /* arrays keep their order */
+    array = plist_new_array();
+    plist_array_append_item(array, plist_new_uint(1));
+    plist_array_append_item(array, plist_new_uint(2));
+    copy = plist_new_array();
+    plist_array_append_item(copy, plist_new_uint(2));
+    plist_array_append_item(copy, plist_new_uint(1));
+    res |= check_equal(array, copy, 0, "reordered array");
+    plist_free(copy);
+    copy = plist_new_dict();
+    res |= check_equal(array, copy, 0, "array and dict");
+    plist_free(copy);
+    plist_free(array);
+
+    if (plist_equal_deep(root, NULL) || plist_hash(NULL) != 0) {
+        printf("NULL handling failed\n");
+        res = 1;
+    }
+    plist_free(root);
+    return res;
+}
+
+static int check_freeze(void)
+{
+    plist_t root = build_tree(0);
+    plist_t copy = NULL;
+    plist_t thawed = NULL;
+    plist_frozen_t frozen = NULL;
+    int res = 0;
+
+    /* the cached hashes must not get in the way of other tree walks */
+    plist_hash(root);
+    copy = plist_copy(root);
+    frozen = plist_freeze(root);
+    if (!frozen) {
+        printf("Freezing a hashed tree failed\n");
+        res = 1;
+    } else {
+        thawed = plist_frozen_get_node(frozen, plist_frozen_root(frozen));
+        if (!plist_equal_deep(root, thawed)) {
+            printf("Thawed hashed tree differs\n");
+            res = 1;
+        }
+        plist_free(thawed);
+        plist_frozen_free(frozen);
+    }
+    frozen = plist_freeze(copy);
+    if (!frozen) {
+        printf("Freezing the copy of a hashed tree failed\n");
+        res = 1;
+    }
+    plist_frozen_free(frozen);
+    plist_free(copy);
+    plist_free(root);
+    return res;
+}
+
+static int check_file(const char *filename)
+{
+    plist_t root = NULL;
+    plist_t parsed = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    int res = 0;
+
+    /* invalid files are checked elsewhere */
+    plist_read_from_file(filename, &root, NULL);
+    if (!root) {
+        return 0;
+    }
+    plist_to_bin(root, &bin, &size);
+    plist_from_bin(bin, size, &parsed);
+    res |= check_equal(root, parsed, 1, filename);
+    plist_free(parsed);
+
+    parsed = NULL;
+    plist_from_bin_ex(bin, size, PLIST_PARSE_LAZY, &parsed);
+    if (!plist_equal_deep(parsed, root)) {
+        printf("%s: lazily parsed tree differs\n", filename);
+        res = 1;
+    }
+    plist_free(parsed);
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    res |= check_changes();
+    res |= check_copies();
+    res |= check_freeze();
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("Deep equality and hashing succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,276 @@
+/*
+ * plist_json_test.c
+ * checks JSON import and export
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+static plist_t parse(const char *json)
+{
+    plist_t root = NULL;
+    plist_from_json(json, strlen(json), &root);
+    return root;
+}
+
+static int check_invalid(const char *json)
+{
+    plist_t root = parse(json);
+    if (root) {
+        printf("%s: must not parse\n", json);
+        plist_free(root);
+        return 1;
+    }
+    return 0;
+}
+
+/* parses json, writes it compact and compares with expected */
+static int check_output(const char *json, const char *expected)
+{
+    plist_t root = parse(json);
+    char *out = NULL;
+    uint32_t len = 0;
+    int res = 0;
+
+    if (!root || plist_to_json(root, &out, &len, 0) < 0) {
+        printf("%s: could not convert\n", json);
+        plist_free(root);
+        return 1;
+    }
+    if (len != strlen(expected) || strcmp(out, expected) != 0) {
+        printf("%s: written as %s instead of %s\n", json, out, expected);
+        res = 1;
+    }
+    free(out);
+    plist_free(root);
+    return res;
+}
+
+static int check_strings(void)
+{
+    plist_t root = NULL;
+    const char *str = NULL;
+    uint64_t len = 0;
+    int res = 0;
+
+    res |= check_output("\"plain\"", "\"plain\"");
+    res |= check_output("\"a \\\"quoted\\\" \\\\ \\/ string\"", "\"a \\\"quoted\\\" \\\\ / string\"");
+    res |= check_output("\"\\b\\f\\n\\r\\t\\u0001\\u001f\"", "\"\\b\\f\\n\\r\\t\\u0001\\u001f\"");
+    res |= check_output("\"\\u00e9\\u20ac\\ud83d\\ude00\"", "\"\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\"");
+    res |= check_output("\"lone \\ud800 surrogate \\udc00\"", "\"lone \xEF\xBF\xBD surrogate \xEF\xBF\xBD\"");
+    res |= check_output("\"a long string with an escape at the very end, after the SIMD scan\\n\"", "\"a long string with an escape at the very end, after the SIMD scan\\n\"");
+    res |= check_output("{\"k\\u0065y\": \"v\", \"\": []}", "{\"key\":\"v\",\"\":[]}");
+
+    root = parse("\"nul \\u0000 inside\"");
+    str = plist_get_string_ptr(root, &len);
+    if (!str || len != 12 || memcmp(str, "nul \0 inside", 12) != 0) {
+        printf("Escaped NUL failed\n");
+        res = 1;
+    }
+    plist_free(root);
+    return res;
+}
+
+static int check_numbers(void)
+{
+    static const double reals[] = { 0.1, 1.0 / 3, 1e300, -2.5e-300, 4.9e-324, 1e21, 123456789.125, -0.0, 42.0, 9007199254740993.0 };
+    plist_t root = NULL;
+    char *out = NULL;
+    uint32_t len = 0;
+    uint64_t uval = 0;
+    size_t i = 0;
+    int res = 0;
+
+    res |= check_output("[0, -0, 1, -1, 42]", "[0,0,1,-1,42]");
+    res |= check_output("9223372036854775807", "9223372036854775807");
+    res |= check_output("-9223372036854775808", "-9223372036854775808");
+    res |= check_output("18446744073709551615", "18446744073709551615");
+    res |= check_output("[1.5, 2e3, -1E-2, 1.0, 0.0]", "[1.5,2000.0,-0.01,1.0,0.0]");
+
+    /* integers that don't fit become reals */
+    root = parse("[18446744073709551616, -9223372036854775809]");
+    if (plist_get_node_type(plist_array_get_item(root, 0)) != PLIST_REAL || plist_get_node_type(plist_array_get_item(root, 1)) != PLIST_REAL) {
+        printf("Integers out of range are not reals\n");
+        res = 1;
+    }
+    plist_free(root);
+
+    root = parse("18446744073709551615");
+    plist_get_uint_val(root, &uval);
+    if (plist_get_node_type(root) != PLIST_UINT || uval != UINT64_MAX) {
+        printf("Largest integer failed\n");
+        res = 1;
+    }
+    plist_free(root);
+
+    /* reals survive a round trip bit for bit */
+    for (i = 0; i < sizeof(reals) / sizeof(reals[0]); i++) {
+        double val = 0;
+        plist_t node = plist_new_real(reals[i]);
+        plist_to_json(node, &out, &len, 0);
+        root = parse(out);
+        plist_get_real_val(root, &val);
+        if (plist_get_node_type(root) != PLIST_REAL || memcmp(&val, &reals[i], sizeof(double)) != 0) {
+            printf("Real %.17g written as %s parsed as %.17g\n", reals[i], out, val);
+            res = 1;
+        }
+        free(out);
+        plist_free(root);
+        plist_free(node);
+    }
+
+    root = plist_new_real(NAN);
+    if (plist_to_json(root, &out, &len, 0) == 0 || out) {
+        printf("NaN must not be written\n");
+        res = 1;
+    }
+    plist_free(root);
+    return res;
+}
+
+static int check_mapping(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t parsed = NULL;
+    char *out = NULL;
+    uint32_t len = 0;
+    int res = 0;
+
+    plist_dict_set_item(root, "data", plist_new_data("Hello", 5));
+    plist_dict_set_item(root, "date", plist_new_date(0, 0));
+    plist_dict_set_item(root, "uid", plist_new_uid(7));
+    plist_dict_set_item(root, "bool", plist_new_bool(0));
+    plist_to_json(root, &out, &len, 0);
+    if (!out || strcmp(out, "{\"data\":\"SGVsbG8=\",\"date\":\"2001-01-01T00:00:00Z\",\"uid\":{\"CF$UID\":7},\"bool\":false}") != 0) {
+        printf("Mapping of data, date and UID failed: %s\n", (out) ? out : "(null)");
+        res = 1;
+    }
+    free(out);
+
+    plist_to_json(root, &out, &len, 1);
+    if (!out || strcmp(out, "{\n  \"data\": \"SGVsbG8=\",\n  \"date\": \"2001-01-01T00:00:00Z\",\n  \"uid\": {\n    \"CF$UID\": 7\n  },\n  \"bool\": false\n}\n") != 0) {
+        printf("Prettified output differs: %s\n", (out) ? out : "(null)");
+        res = 1;
+    }
+    plist_from_memory(out, len, &parsed);
+    if (!parsed || plist_get_node_type(plist_dict_get_item(parsed, "data")) != PLIST_STRING || plist_get_node_type(plist_access_path(parsed, 2, "uid", "CF$UID")) != PLIST_UINT) {
+        printf("plist_from_memory did not parse JSON\n");
+        res = 1;
+    }
+    free(out);
+    plist_free(parsed);
+    plist_free(root);
+    return res;
+}
+
+static int check_errors(void)
+{
+    char deep[2100];
+    int res = 0;
+    int i = 0;
+
+    res |= check_invalid("");
+    res |= check_invalid("   ");
+    res |= check_invalid("[1,]");
+    res |= check_invalid("[1 2]");
+    res |= check_invalid("{\"a\" 1}");
+    res |= check_invalid("{\"a\": 1,}");
+    res |= check_invalid("{1: 2}");
+    res |= check_invalid("[null]");
+    res |= check_invalid("[tru]");
+    res |= check_invalid("\"unterminated");
+    res |= check_invalid("\"bad \\x escape\"");
+    res |= check_invalid("\"bad \\u12 escape\"");
+    res |= check_invalid("\"raw\ncontrol\"");
+    res |= check_invalid("01");
+    res |= check_invalid("1.");
+    res |= check_invalid("-");
+    res |= check_invalid("1e+");
+    res |= check_invalid("[1] x");
+    res |= check_invalid("[[1]");
+    res |= check_invalid("[1]]");
+    res |= check_invalid("{\"a\": [1}");
+
+    /* nesting is limited like for the other formats */
+    for (i = 0; i < 1000; i++) {
+        deep[i] = '[';
+        deep[1000 + i] = ']';
+    }
+    deep[2000] = '\0';
+    res |= check_invalid(deep);
+    return res;
+}
+
+/* the JSON of a file parses into a tree that is written the same way */
+static int check_file(const char *filename)
+{
+    plist_t root = NULL;
+    plist_t parsed = NULL;
+    char *json = NULL;
+    char *json2 = NULL;
+    uint32_t len = 0;
+    uint32_t len2 = 0;
+    int prettify = 0;
+    int res = 0;
+
+    plist_read_from_file(filename, &root, NULL);
+    if (!root) {
+        return 0;
+    }
+    for (prettify = 0; prettify < 2; prettify++) {
+        if (plist_to_json(root, &json, &len, prettify) < 0) {
+            /* NaN and infinity can't be written */
+            break;
+        }
+        plist_from_json(json, len, &parsed);
+        if (!parsed || plist_to_json(parsed, &json2, &len2, prettify) < 0 || len != len2 || memcmp(json, json2, len) != 0) {
+            printf("%s: JSON does not round trip\n", filename);
+            res = 1;
+        }
+        free(json);
+        free(json2);
+        json2 = NULL;
+        plist_free(parsed);
+        parsed = NULL;
+    }
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    res |= check_strings();
+    res |= check_numbers();
+    res |= check_mapping();
+    res |= check_errors();
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("JSON succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,428 @@
+/*
+ * plist_limits_test.c
+ * checks the parse limits and plist_mem_usage()
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* containers that each reference the previous one twice */
+#define BOMB_LEVELS 20
+/* arrays nested in each other for the depth limit */
+#define NESTING 150
+
+/* nodes in a tree, dict keys included */
+static uint64_t count_nodes(plist_t node)
+{
+    uint64_t count = 1;
+    plist_type type = plist_get_node_type(node);
+
+    if (type == PLIST_ARRAY) {
+        uint32_t i = 0;
+        for (i = 0; i < plist_array_get_size(node); i++) {
+            count += count_nodes(plist_array_get_item(node, i));
+        }
+    } else if (type == PLIST_DICT) {
+        plist_dict_iter it = NULL;
+        plist_t item = NULL;
+        plist_dict_new_iter(node, &it);
+        do {
+            item = NULL;
+            plist_dict_next_item(node, it, NULL, &item);
+            if (item) {
+                count += 1 + count_nodes(item);
+            }
+        } while (item);
+        free(it);
+    }
+    return count;
+}
+
+static plist_t create_sample(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t arr = plist_new_array();
+    char key[16];
+    int i = 0;
+
+    for (i = 0; i < 300; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        plist_dict_set_item(root, key, plist_new_uint(i));
+    }
+    for (i = 0; i < 300; i++) {
+        plist_array_append_item(arr, plist_new_string("a string too long to be stored inline"));
+    }
+    plist_dict_set_item(root, "array", arr);
+    plist_dict_set_item(root, "data", plist_new_data("0123456789abcdef0123456789abcdef", 32));
+    return root;
+}
+
+static int check_mem_usage(void)
+{
+    plist_t root = NULL;
+    uint64_t empty = 0;
+    uint64_t small = 0;
+    uint64_t large = 0;
+    int res = 0;
+
+    if (plist_mem_usage(NULL) != 0) {
+        printf("Memory usage of NULL must be 0\n");
+        res = 1;
+    }
+
+    root = plist_new_array();
+    empty = plist_mem_usage(root);
+    plist_array_append_item(root, plist_new_string("x"));
+    small = plist_mem_usage(root);
+    plist_array_append_item(root, plist_new_data(NULL, 0));
+    plist_array_set_item(root, plist_new_string("a string that takes a few hundred bytes, a string that takes a few hundred bytes, a string that takes a few hundred bytes, a string that takes a few hundred bytes, a string that takes a few hundred bytes"), 0);
+    large = plist_mem_usage(root);
+    if (empty == 0 || small <= empty || large < small + 200) {
+        printf("Memory usage doesn't grow with the tree: %llu, %llu, %llu\n", (unsigned long long)empty, (unsigned long long)small, (unsigned long long)large);
+        res = 1;
+    }
+    if (plist_mem_usage(plist_array_get_item(root, 1)) >= small) {
+        printf("Memory usage of a leaf must not include its siblings\n");
+        res = 1;
+    }
+    plist_free(root);
+    return res;
+}
+
+static int check_limits(const char *name, int (*parse)(const char *, uint64_t, const plist_parse_limits_t *, plist_t *), const char *buf, uint64_t length, uint64_t nodes, uint64_t bytes)
+{
+    plist_parse_limits_t limits;
+    plist_t parsed = NULL;
+    int res = 0;
+    int ret = 0;
+
+    ret = parse(buf, length, NULL, &parsed);
+    if (ret != 0 || !parsed) {
+        printf("%s: parsing without limits failed\n", name);
+        return 1;
+    }
+    plist_free(parsed);
+
+    memset(&limits, 0, sizeof(limits));
+    limits.max_nodes = nodes;
+    ret = parse(buf, length, &limits, &parsed);
+    if (ret != 0 || !parsed) {
+        printf("%s: parsing with a limit of exactly %llu nodes failed\n", name, (unsigned long long)nodes);
+        res = 1;
+    }
+    plist_free(parsed);
+
+    limits.max_nodes = nodes - 1;
+    ret = parse(buf, length, &limits, &parsed);
+    if (ret != -2 || parsed) {
+        printf("%s: parsing %llu nodes with a limit of one less must fail with -2, got %d\n", name, (unsigned long long)nodes, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+
+    memset(&limits, 0, sizeof(limits));
+    limits.max_bytes = bytes;
+    ret = parse(buf, length, &limits, &parsed);
+    if (ret != 0 || !parsed) {
+        printf("%s: parsing with a limit of %llu bytes failed\n", name, (unsigned long long)bytes);
+        res = 1;
+    }
+    plist_free(parsed);
+
+    limits.max_bytes = bytes / 2;
+    ret = parse(buf, length, &limits, &parsed);
+    if (ret != -2 || parsed) {
+        printf("%s: parsing with a limit of %llu bytes must fail with -2, got %d\n", name, (unsigned long long)(bytes / 2), ret);
+        res = 1;
+    }
+    plist_free(parsed);
+
+    memset(&limits, 0, sizeof(limits));
+    limits.max_depth = 1;
+    ret = parse(buf, length, &limits, &parsed);
+    if (ret != -2 || parsed) {
+        printf("%s: parsing nested containers with a depth of 1 must fail with -2, got %d\n", name, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    ret = parse(buf, length / 2, NULL, &parsed);
+    if (ret != -1 || parsed) {
+        printf("%s: parsing truncated input must fail with -1, got %d\n", name, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+    return res;
+}
+
+static int parse_bin(const char *buf, uint64_t length, const plist_parse_limits_t *limits, plist_t *plist)
+{
+    return plist_from_bin_limited(buf, length, 0, limits, plist);
+}
+
+static int parse_bin_borrow(const char *buf, uint64_t length, const plist_parse_limits_t *limits, plist_t *plist)
+{
+    return plist_from_bin_limited(buf, length, PLIST_PARSE_BORROW, limits, plist);
+}
+
+/* a limit of exactly what plist_mem_usage() reports for the parsed tree
+ * must pass, one byte less must fail */
+static int check_exact_bytes(const char *name, int (*parse)(const char *, uint64_t, const plist_parse_limits_t *, plist_t *), const char *buf, uint64_t length)
+{
+    plist_parse_limits_t limits;
+    plist_t parsed = NULL;
+    uint64_t usage = 0;
+    int ret = 0;
+    int res = 0;
+
+    parse(buf, length, NULL, &parsed);
+    if (!parsed) {
+        printf("%s: parsing without limits failed\n", name);
+        return 1;
+    }
+    usage = plist_mem_usage(parsed);
+    plist_free(parsed);
+    parsed = NULL;
+
+    memset(&limits, 0, sizeof(limits));
+    limits.max_bytes = usage;
+    ret = parse(buf, length, &limits, &parsed);
+    if (ret != 0 || !parsed) {
+        printf("%s: parsing with max_bytes %llu, the memory usage of the tree, failed with %d\n", name, (unsigned long long)usage, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    limits.max_bytes = usage - 1;
+    ret = parse(buf, length, &limits, &parsed);
+    if (ret != -2 || parsed) {
+        printf("%s: parsing with max_bytes %llu must fail with -2, got %d\n", name, (unsigned long long)(usage - 1), ret);
+        res = 1;
+    }
+    plist_free(parsed);
+    return res;
+}
+
+static int check_exact(plist_t root)
+{
+    char *bin = NULL;
+    char *xml = NULL;
+    uint32_t bin_size = 0;
+    uint32_t xml_size = 0;
+    int res = 0;
+
+    plist_to_bin(root, &bin, &bin_size);
+    plist_to_xml(root, &xml, &xml_size);
+    plist_free(root);
+    if (!bin || !xml) {
+        printf("Output of plist for exact limits failed\n");
+        free(bin);
+        free(xml);
+        return 1;
+    }
+    res |= check_exact_bytes("binary", parse_bin, bin, bin_size);
+    res |= check_exact_bytes("binary borrowed", parse_bin_borrow, bin, bin_size);
+    res |= check_exact_bytes("XML", plist_from_xml_limited, xml, xml_size);
+    free(bin);
+    free(xml);
+    return res;
+}
+
+static int check_exact_limits(void)
+{
+    plist_t root = plist_new_array();
+    plist_t dict = plist_new_dict();
+    int res = 0;
+
+    /* empty containers have no child list */
+    res |= check_exact(plist_copy(root));
+    plist_array_append_item(root, plist_new_array());
+    plist_array_append_item(root, plist_new_dict());
+    plist_dict_set_item(dict, "empty", plist_new_array());
+    plist_dict_set_item(dict, "data", plist_new_data("0123456789abcdef0123456789abcdef", 32));
+    plist_array_append_item(root, dict);
+    res |= check_exact(root);
+    res |= check_exact(create_sample());
+    return res;
+}
+
+static int check_parse_limits(void)
+{
+    plist_t root = create_sample();
+    char *bin = NULL;
+    char *xml = NULL;
+    uint32_t bin_size = 0;
+    uint32_t xml_size = 0;
+    uint64_t nodes = count_nodes(root);
+    uint64_t bytes = 0;
+    plist_t parsed = NULL;
+    int res = 0;
+
+    plist_to_bin(root, &bin, &bin_size);
+    plist_to_xml(root, &xml, &xml_size);
+    if (!bin || !xml) {
+        printf("Output of sample plist failed\n");
+        plist_free(root);
+        return 1;
+    }
+
+    /* the parser counts about what the tree takes */
+    plist_from_bin(bin, bin_size, &parsed);
+    bytes = plist_mem_usage(parsed) + plist_mem_usage(parsed) / 4;
+    plist_free(parsed);
+
+    res |= check_limits("binary", parse_bin, bin, bin_size, nodes, bytes);
+    res |= check_limits("XML", plist_from_xml_limited, xml, xml_size, nodes, bytes);
+
+    plist_free(root);
+    free(bin);
+    free(xml);
+    return res;
+}
+
+static int check_depth(void)
+{
+    plist_t root = plist_new_array();
+    plist_t cur = root;
+    plist_t parsed = NULL;
+    plist_parse_limits_t limits;
+    char *bin = NULL;
+    char *xml = NULL;
+    uint32_t bin_size = 0;
+    uint32_t xml_size = 0;
+    int ret = 0;
+    int res = 0;
+    int i = 0;
+
+    for (i = 1; i < NESTING; i++) {
+        plist_t ch = plist_new_array();
+        plist_array_append_item(cur, ch);
+        cur = ch;
+    }
+    plist_to_bin(root, &bin, &bin_size);
+    plist_to_xml(root, &xml, &xml_size);
+    plist_free(root);
+
+    memset(&limits, 0, sizeof(limits));
+    limits.max_depth = NESTING - 50;
+    ret = plist_from_bin_limited(bin, bin_size, 0, &limits, &parsed);
+    if (ret != -2 || parsed) {
+        printf("binary: parsing %d nested arrays with a depth of %u must fail with -2, got %d\n", NESTING, limits.max_depth, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+    ret = plist_from_xml_limited(xml, xml_size, &limits, &parsed);
+    if (ret != -2 || parsed) {
+        printf("XML: parsing %d nested arrays with a depth of %u must fail with -2, got %d\n", NESTING, limits.max_depth, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    limits.max_depth = NESTING;
+    ret = plist_from_bin_limited(bin, bin_size, 0, &limits, &parsed);
+    if (ret != 0 || !parsed) {
+        printf("binary: parsing %d nested arrays with a depth of %u failed with %d\n", NESTING, limits.max_depth, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+    ret = plist_from_xml_limited(xml, xml_size, &limits, &parsed);
+    if (ret != 0 || !parsed) {
+        printf("XML: parsing %d nested arrays with a depth of %u failed with %d\n", NESTING, limits.max_depth, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+
+    free(bin);
+    free(xml);
+    return res;
+}
+
+static int check_expansion(void)
+{
+    plist_t level = plist_new_array();
+    plist_t parsed = NULL;
+    plist_parse_limits_t limits;
+    char *bin = NULL;
+    uint32_t size = 0;
+    int ret = 0;
+    int res = 0;
+    int i = 0;
+
+    /* a small binary plist that expands into 2^BOMB_LEVELS nodes */
+    plist_array_append_item(level, plist_new_uint(1));
+    for (i = 0; i < BOMB_LEVELS; i++) {
+        plist_t next = plist_new_array();
+        plist_array_append_item(next, plist_copy(level));
+        plist_array_append_item(next, level);
+        level = next;
+    }
+    plist_to_bin_ex(level, PLIST_WRITE_COMPACT, &bin, &size);
+    plist_free(level);
+    if (!bin) {
+        printf("Compact output of shared containers failed\n");
+        return 1;
+    }
+    if (size > 1024) {
+        printf("Compact output of shared containers takes %u bytes\n", size);
+        res = 1;
+    }
+
+    memset(&limits, 0, sizeof(limits));
+    limits.max_expansion = 50;
+    ret = plist_from_bin_limited(bin, size, 0, &limits, &parsed);
+    if (ret != -2 || parsed) {
+        printf("Parsing %u bytes that expand to 2^%d nodes must fail with -2, got %d\n", size, BOMB_LEVELS, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+    parsed = NULL;
+
+    /* lazy parsing would defer the limits, so it's ignored */
+    ret = plist_from_bin_limited(bin, size, PLIST_PARSE_LAZY, &limits, &parsed);
+    if (ret != -2 || parsed) {
+        printf("Lazily parsing %u bytes that expand to 2^%d nodes must fail with -2, got %d\n", size, BOMB_LEVELS, ret);
+        res = 1;
+    }
+    plist_free(parsed);
+
+    free(bin);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+
+    res |= check_mem_usage();
+    res |= check_parse_limits();
+    res |= check_exact_limits();
+    res |= check_depth();
+    res |= check_expansion();
+
+    if (res == 0) {
+        printf("Parse limits succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,166 @@
+/*
+ * plist_number_test.c
+ * checks parsing of integer and real values in XML plists
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <locale.h>
+
+#define NUM_RANDOM 20000
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static plist_t parse_value(const char *tag, const char *text)
+{
+    char xml[512];
+    plist_t root = NULL;
+    snprintf(xml, sizeof(xml), "<plist version=\"1.0\"><%s>%s</%s></plist>", tag, text, tag);
+    plist_from_xml(xml, strlen(xml), &root);
+    return root;
+}
+
+/* compares against strtod() in the "C" locale, bit for bit */
+static int check_real(const char *text, double expected)
+{
+    plist_t node = parse_value("real", text);
+    double val = 0;
+    int res = 0;
+
+    plist_get_real_val(node, &val);
+    if (plist_get_node_type(node) != PLIST_REAL || (memcmp(&val, &expected, sizeof(double)) != 0 && !(isnan(val) && isnan(expected)))) {
+        printf("<real>%s</real> is %.17g instead of %.17g\n", text, val, expected);
+        res = 1;
+    }
+    plist_free(node);
+    return res;
+}
+
+static int check_int(const char *text, uint64_t expected)
+{
+    plist_t node = parse_value("integer", text);
+    uint64_t val = 0;
+    int res = 0;
+
+    plist_get_uint_val(node, &val);
+    if (plist_get_node_type(node) != PLIST_UINT || val != expected) {
+        printf("<integer>%s</integer> is %llu instead of %llu\n", text, (unsigned long long)val, (unsigned long long)expected);
+        res = 1;
+    }
+    plist_free(node);
+    return res;
+}
+
+static int check_reals(void)
+{
+    static const char *values[] = {
+        "0", "-0", "1", "3.141593", "0.1", "0.10000000000000001", ".5", "5.", "-.5e-3",
+        "1e308", "1.7976931348623157e308", "2e308", "4.9e-324", "2.4703282292062327e-324",
+        "2.4703282292062328e-324", "1e-400", "9007199254740993", "1e23", "7.3177701707893310e+15",
+        "123456789012345678901234567890", "1.00000000000000011102230246251565404236316680908203125",
+        "2.2250738585072011e-308", " 12.5 ", "1e", "0x1p3", "abc",
+        "nan", "inf", "-infinity", "+Infinity", NULL
+    };
+    char buf[64];
+    int res = 0;
+    int i = 0;
+
+    for (i = 0; values[i]; i++) {
+        res |= check_real(values[i], strtod(values[i], NULL));
+    }
+    for (i = 0; i < NUM_RANDOM; i++) {
+        uint64_t bits = next_random();
+        double d = 0;
+        memcpy(&d, &bits, sizeof(d));
+        if (isnan(d) || isinf(d)) {
+            continue;
+        }
+        snprintf(buf, sizeof(buf), "%.*g", (int)(next_random() % 17) + 1, d);
+        res |= check_real(buf, strtod(buf, NULL));
+        snprintf(buf, sizeof(buf), "%.6f", (double)(next_random() % 100000000) / 997);
+        res |= check_real(buf, strtod(buf, NULL));
+    }
+    return res;
+}
+
+static int check_ints(void)
+{
+    char buf[32];
+    int res = 0;
+    int i = 0;
+
+    res |= check_int("0", 0);
+    res |= check_int("42", 42);
+    res |= check_int("-42", (uint64_t)-42);
+    res |= check_int("+42", 42);
+    res |= check_int(" 42 ", 42);
+    res |= check_int("0x1F", 31);
+    res |= check_int("-0x10", (uint64_t)-16);
+    res |= check_int("0755", 493);
+    res |= check_int("9223372036854775807", INT64_MAX);
+    res |= check_int("-9223372036854775808", (uint64_t)INT64_MIN);
+    res |= check_int("18446744073709551615", UINT64_MAX);
+    res |= check_int("99999999999999999999999", UINT64_MAX);
+    res |= check_int("0xFFFFFFFFFFFFFFFF", UINT64_MAX);
+    res |= check_int("12abc", 12);
+    res |= check_int("abc", 0);
+    for (i = 0; i < NUM_RANDOM; i++) {
+        uint64_t v = next_random() >> (next_random() % 64);
+        snprintf(buf, sizeof(buf), "%llu", (unsigned long long)v);
+        res |= check_int(buf, v);
+    }
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    static const char *locales[] = { "de_DE.UTF-8", "de_DE", "fr_FR.UTF-8", "fr_FR", NULL };
+    int res = 0;
+    int i = 0;
+
+    res |= check_reals();
+    res |= check_ints();
+
+    /* the decimal point of the locale does not matter */
+    for (i = 0; locales[i]; i++) {
+        if (setlocale(LC_NUMERIC, locales[i])) {
+            res |= check_real("1.5", 1.5);
+            res |= check_real("0.10000000000000000555", 0.1);
+            res |= check_real("0x1.8p1", 3.0);
+            setlocale(LC_NUMERIC, "C");
+            break;
+        }
+    }
+
+    if (res == 0) {
+        printf("Number parsing succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,218 @@
+/*
+ * plist_parallel_test.c
+ * checks that parsing and writing binary plists with multiple threads gives
+ * the same result as the regular parser and writer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define NUM_ENTRIES 20000
+
+/* a dict whose key object is also used for the value, as written by other
+ * binary plist writers that share equal strings */
+static const char shared_key_bplist[] = {
+    'b', 'p', 'l', 'i', 's', 't', '0', '0',
+    /* 0: dict with one entry, key and value reference object 1 */
+    (char)0xD1, 0x01, 0x01,
+    /* 1: "a" */
+    0x51, 'a',
+    /* offset table */
+    0x08, 0x0B,
+    /* trailer */
+    0, 0, 0, 0, 0, 0, 1, 1,
+    0, 0, 0, 0, 0, 0, 0, 2,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 13
+};
+
+static int check_bin(const char *bin, uint32_t size, const char *what)
+{
+    uint32_t threads[] = { 0, 1, 2, 3, 8 };
+    plist_t expected = NULL;
+    plist_t parsed = NULL;
+    char *out = NULL;
+    char *out2 = NULL;
+    uint32_t out_size = 0;
+    uint32_t out_size2 = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    plist_from_bin(bin, size, &expected);
+    if (expected) {
+        plist_to_bin(expected, &out, &out_size);
+    }
+
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        parsed = NULL;
+        plist_from_bin_parallel(bin, size, threads[i], &parsed);
+        if (!expected || !parsed) {
+            if (expected || parsed) {
+                printf("%s: parsing with %u threads %s\n", what, threads[i], parsed ? "must fail" : "failed");
+                res = 1;
+            }
+            plist_free(parsed);
+            continue;
+        }
+        plist_to_bin(parsed, &out2, &out_size2);
+        if (!out2 || out_size != out_size2 || memcmp(out, out2, out_size) != 0) {
+            printf("%s: result with %u threads differs\n", what, threads[i]);
+            res = 1;
+        }
+        free(out2);
+        out2 = NULL;
+        plist_free(parsed);
+    }
+
+    /* the parallel writer must produce the same output */
+    for (i = 0; expected && i < sizeof(threads) / sizeof(threads[0]); i++) {
+        plist_to_bin_parallel(expected, PLIST_WRITE_DEFAULT, threads[i], &out2, &out_size2);
+        if (!out2 || out_size != out_size2 || memcmp(out, out2, out_size) != 0) {
+            printf("%s: output with %u threads differs\n", what, threads[i]);
+            res = 1;
+        }
+        free(out2);
+        out2 = NULL;
+    }
+    if (expected) {
+        char *compact = NULL;
+        uint32_t compact_size = 0;
+        plist_to_bin_ex(expected, PLIST_WRITE_COMPACT, &compact, &compact_size);
+        plist_to_bin_parallel(expected, PLIST_WRITE_COMPACT, 4, &out2, &out_size2);
+        if (!out2 || compact_size != out_size2 || memcmp(compact, out2, compact_size) != 0) {
+            printf("%s: compact output with 4 threads differs\n", what);
+            res = 1;
+        }
+        free(compact);
+        free(out2);
+        out2 = NULL;
+    }
+
+    plist_free(expected);
+    free(out);
+    return res;
+}
+
+static int check_generated(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t items = plist_new_array();
+    char *bin = NULL;
+    uint32_t size = 0;
+    char buf[64];
+    uint32_t i = 0;
+    int res = 0;
+
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        plist_t entry = plist_new_dict();
+        snprintf(buf, sizeof(buf), "item %u", i);
+        plist_dict_set_item(entry, "name", plist_new_string(buf));
+        plist_dict_set_item(entry, "unicode", plist_new_string("\xc3\xa4\xc3\xb6\xc3\xbc"));
+        plist_dict_set_item(entry, "index", plist_new_uint(i));
+        plist_dict_set_item(entry, "ratio", plist_new_real(i / 7.0));
+        plist_dict_set_item(entry, "flag", plist_new_bool(i & 1));
+        plist_dict_set_item(entry, "data", plist_new_data(buf, strlen(buf)));
+        plist_dict_set_item(entry, "date", plist_new_date(i, 0));
+        plist_array_append_item(items, entry);
+    }
+    plist_dict_set_item(root, "items", items);
+    plist_to_bin(root, &bin, &size);
+    plist_free(root);
+
+    res = check_bin(bin, size, "generated");
+    free(bin);
+    return res;
+}
+
+static int check_file(const char *filename)
+{
+    plist_t root = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    FILE *f = NULL;
+    long len = 0;
+    int res = 0;
+
+    f = fopen(filename, "rb");
+    if (!f) {
+        printf("Could not open %s\n", filename);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    bin = (char*)malloc(len > 0 ? len : 1);
+    if (!bin || fread(bin, 1, len, f) != (size_t)len) {
+        printf("Could not read %s\n", filename);
+        fclose(f);
+        free(bin);
+        return 1;
+    }
+    fclose(f);
+    size = (uint32_t)len;
+
+    /* XML plists are checked in binary form */
+    if (!plist_is_binary(bin, size)) {
+        plist_from_xml(bin, size, &root);
+        free(bin);
+        bin = NULL;
+        if (!root) {
+            return 0;
+        }
+        plist_to_bin(root, &bin, &size);
+        plist_free(root);
+    }
+
+    res = check_bin(bin, size, filename);
+    free(bin);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_t parsed = NULL;
+    plist_t val = NULL;
+    int res = 0;
+    int i = 0;
+
+    res |= check_generated();
+    res |= check_bin(shared_key_bplist, sizeof(shared_key_bplist), "shared key");
+
+    plist_from_bin_parallel(shared_key_bplist, sizeof(shared_key_bplist), 2, &parsed);
+    val = plist_dict_get_item(parsed, "a");
+    if (!val || plist_get_node_type(val) != PLIST_STRING) {
+        printf("shared key: value must be a string\n");
+        res = 1;
+    }
+    plist_free(parsed);
+
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("Parallel parsing and writing succeeded\n");
+    }
+    return res;
+}
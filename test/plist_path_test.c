@@ -0,0 +1,203 @@
+/*
+ * plist_path_test.c
+ * checks compiled path queries on trees and binary plists
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_APPS 100
+
+struct matches {
+    char names[NUM_APPS * 2][64];
+    int count;
+    int stop_after;
+};
+
+static int collect(void *user_data, plist_t node)
+{
+    struct matches *m = (struct matches*)user_data;
+    const char *str = plist_get_string_ptr(node, NULL);
+    snprintf(m->names[m->count++], sizeof(m->names[0]), "%s", (str) ? str : "");
+    return (m->stop_after && m->count == m->stop_after);
+}
+
+static int collect_bin(void *user_data, plist_bin_reader_t reader, uint64_t obj)
+{
+    struct matches *m = (struct matches*)user_data;
+    char *str = NULL;
+    plist_bin_reader_get_string(reader, obj, &str);
+    snprintf(m->names[m->count++], sizeof(m->names[0]), "%s", (str) ? str : "");
+    plist_mem_free(str);
+    return (m->stop_after && m->count == m->stop_after);
+}
+
+static plist_t build_tree(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t apps = plist_new_array();
+    plist_t special = plist_new_dict();
+    char buf[64];
+    int i = 0;
+
+    for (i = 0; i < NUM_APPS; i++) {
+        plist_t app = plist_new_dict();
+        snprintf(buf, sizeof(buf), "com.example.app%d", i);
+        plist_dict_set_item(app, "CFBundleIdentifier", plist_new_string(buf));
+        plist_dict_set_item(app, "Version", plist_new_uint(i));
+        if (i % 10 == 0) {
+            plist_t plugins = plist_new_dict();
+            snprintf(buf, sizeof(buf), "plugin%d", i);
+            plist_dict_set_item(plugins, "first", plist_new_string(buf));
+            plist_dict_set_item(plugins, "second", plist_new_string(buf));
+            plist_dict_set_item(app, "Plugins", plugins);
+        }
+        plist_array_append_item(apps, app);
+    }
+    plist_dict_set_item(root, "Applications", apps);
+    plist_dict_set_item(special, "*", plist_new_string("star"));
+    plist_dict_set_item(special, "a/b", plist_new_string("slash"));
+    plist_dict_set_item(special, "7", plist_new_string("seven"));
+    plist_dict_set_item(special, "", plist_new_string("empty"));
+    plist_dict_set_item(root, "Special", special);
+    return root;
+}
+
+static const char *get_string(plist_t root, const char *path)
+{
+    plist_path_t p = plist_path_compile(path);
+    plist_t node = plist_path_get(p, root);
+    plist_path_free(p);
+    return plist_get_string_ptr(node, NULL);
+}
+
+/* checks a query against the tree and the binary form */
+static int check_query(plist_t root, plist_bin_reader_t reader, const char *path, int expected, const char *first)
+{
+    plist_path_t p = plist_path_compile(path);
+    struct matches m;
+    struct matches mb;
+    plist_t node = NULL;
+    uint64_t obj = 0;
+    char *str = NULL;
+    int n = 0;
+    int i = 0;
+    int res = 0;
+
+    memset(&m, 0, sizeof(m));
+    memset(&mb, 0, sizeof(mb));
+    n = plist_path_foreach(p, root, collect, &m);
+    if (n != expected || m.count != expected) {
+        printf("%s: %d matches instead of %d\n", path, n, expected);
+        res = 1;
+    }
+    n = plist_path_foreach_bin(p, reader, plist_bin_reader_root(reader), collect_bin, &mb);
+    if (n != expected || mb.count != expected) {
+        printf("%s: %d binary matches instead of %d\n", path, n, expected);
+        res = 1;
+    }
+    for (i = 0; i < m.count && i < mb.count; i++) {
+        if (strcmp(m.names[i], mb.names[i]) != 0) {
+            printf("%s: match %d differs: %s / %s\n", path, i, m.names[i], mb.names[i]);
+            res = 1;
+        }
+    }
+
+    node = plist_path_get(p, root);
+    if (first) {
+        if (!node || strcmp(plist_get_string_ptr(node, NULL), first) != 0) {
+            printf("%s: first match is not %s\n", path, first);
+            res = 1;
+        }
+        if (plist_path_get_bin(p, reader, plist_bin_reader_root(reader), &obj) < 0 || plist_bin_reader_get_string(reader, obj, &str) < 0 || strcmp(str, first) != 0) {
+            printf("%s: first binary match is not %s\n", path, first);
+            res = 1;
+        }
+        plist_mem_free(str);
+    } else if (expected == 0 && (node || plist_path_get_bin(p, reader, plist_bin_reader_root(reader), &obj) == 0)) {
+        printf("%s: must not match\n", path);
+        res = 1;
+    }
+
+    /* the callback can stop the search */
+    if (expected > 1) {
+        memset(&m, 0, sizeof(m));
+        m.stop_after = 2;
+        if (plist_path_foreach(p, root, collect, &m) != 2) {
+            printf("%s: search did not stop\n", path);
+            res = 1;
+        }
+    }
+    plist_path_free(p);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_t root = build_tree();
+    plist_bin_reader_t reader = NULL;
+    plist_path_t p = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    int res = 0;
+
+    plist_to_bin(root, &bin, &size);
+    reader = plist_bin_reader_open(bin, size);
+    if (!reader) {
+        printf("Could not open reader\n");
+        return 1;
+    }
+
+    res |= check_query(root, reader, "Applications/*/CFBundleIdentifier", NUM_APPS, "com.example.app0");
+    res |= check_query(root, reader, "Applications/42/CFBundleIdentifier", 1, "com.example.app42");
+    res |= check_query(root, reader, "Applications/*/Plugins/*", NUM_APPS / 10 * 2, "plugin0");
+    res |= check_query(root, reader, "Applications/*/Plugins/second", NUM_APPS / 10, "plugin0");
+    res |= check_query(root, reader, "Applications/1000/CFBundleIdentifier", 0, NULL);
+    res |= check_query(root, reader, "Applications/x/CFBundleIdentifier", 0, NULL);
+    res |= check_query(root, reader, "Applications/*/Missing", 0, NULL);
+    res |= check_query(root, reader, "Special/\\*", 1, "star");
+    res |= check_query(root, reader, "Special/a\\/b", 1, "slash");
+    res |= check_query(root, reader, "Special/7", 1, "seven");
+    res |= check_query(root, reader, "Special/", 1, "empty");
+    res |= check_query(root, reader, "Special/*", 4, "star");
+
+    /* the empty path is the node itself */
+    p = plist_path_compile("");
+    if (plist_path_get(p, root) != root) {
+        printf("Empty path must match the root\n");
+        res = 1;
+    }
+    plist_path_free(p);
+
+    /* one compiled path for many documents */
+    if (strcmp(get_string(plist_array_get_item(plist_dict_get_item(root, "Applications"), 3), "CFBundleIdentifier"), "com.example.app3") != 0) {
+        printf("Path on a subtree failed\n");
+        res = 1;
+    }
+
+    plist_bin_reader_free(reader);
+    free(bin);
+    plist_free(root);
+
+    if (res == 0) {
+        printf("Path queries succeeded\n");
+    }
+    return res;
+}
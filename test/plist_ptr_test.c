@@ -0,0 +1,114 @@
+/*
+ * plist_ptr_test.c
+ * checks that the borrowing getters match the copying ones
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <node.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+static int check_node(plist_t node)
+{
+    plist_type type = plist_get_node_type(node);
+    const char *ptr = NULL;
+    char *val = NULL;
+    uint64_t ptr_len = 0;
+    uint64_t val_len = 0;
+    int res = 0;
+
+    switch (type) {
+    case PLIST_KEY:
+        ptr = plist_get_key_ptr(node, &ptr_len);
+        plist_get_key_val(node, &val);
+        val_len = strlen(val);
+        break;
+    case PLIST_STRING:
+        ptr = plist_get_string_ptr(node, &ptr_len);
+        plist_get_string_val(node, &val);
+        val_len = strlen(val);
+        break;
+    case PLIST_DATA:
+        ptr = plist_get_data_ptr(node, &ptr_len);
+        plist_get_data_val(node, &val, &val_len);
+        break;
+    default:
+        /* no payload, the getters must refuse other types */
+        if (plist_get_key_ptr(node, NULL) || plist_get_string_ptr(node, NULL) || plist_get_data_ptr(node, NULL)) {
+            printf("Borrowing getter returned a value for type %d\n", type);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (ptr_len != val_len || (val_len > 0 && memcmp(ptr, val, val_len) != 0)) {
+        printf("Borrowed value of type %d differs from the copy\n", type);
+        res = 1;
+    }
+    if (type != PLIST_DATA && ptr[ptr_len] != '\0') {
+        printf("Borrowed string is not terminated\n");
+        res = 1;
+    }
+    free(val);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_t root = NULL;
+    plist_t node = NULL;
+    plist_t next = NULL;
+    int res = 0;
+
+    if (argc != 2) {
+        printf("Wrong input\n");
+        return 1;
+    }
+
+    if (plist_read_from_file(argv[1], &root, NULL) != 0 || !root) {
+        printf("PList parsing failed\n");
+        return 2;
+    }
+
+    /* visit all nodes in pre-order */
+    node = root;
+    while (node) {
+        res |= check_node(node);
+        next = (plist_t)node_first_child((node_t*)node);
+        if (next) {
+            node = next;
+            continue;
+        }
+        while (node != root && !node_next_sibling((node_t*)node)) {
+            node = plist_get_parent(node);
+        }
+        node = (node == root) ? NULL : (plist_t)node_next_sibling((node_t*)node);
+    }
+    plist_free(root);
+
+    if (res == 0) {
+        printf("Borrowing getters succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,199 @@
+/*
+ * plist_reader_test.c
+ * walks a binary plist with the cursor API and compares the result
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+static plist_t build_node(plist_bin_reader_t reader, uint64_t obj)
+{
+    plist_t node = NULL;
+    uint64_t size = plist_bin_reader_get_size(reader, obj);
+    uint64_t i, child, key;
+    uint64_t uval = 0;
+    uint8_t bval = 0;
+    double rval = 0;
+    char *sval = NULL;
+    const char *dval = NULL;
+
+    switch (plist_bin_reader_get_type(reader, obj)) {
+    case PLIST_BOOLEAN:
+        if (plist_bin_reader_get_bool(reader, obj, &bval) == 0)
+            node = plist_new_bool(bval);
+        break;
+    case PLIST_UINT:
+        if (plist_bin_reader_get_uint(reader, obj, &uval) == 0)
+            node = plist_new_uint(uval);
+        break;
+    case PLIST_UID:
+        if (plist_bin_reader_get_uint(reader, obj, &uval) == 0)
+            node = plist_new_uid(uval);
+        break;
+    case PLIST_REAL:
+        if (plist_bin_reader_get_real(reader, obj, &rval) == 0)
+            node = plist_new_real(rval);
+        break;
+    case PLIST_DATE:
+        if (plist_bin_reader_get_real(reader, obj, &rval) == 0) {
+            int32_t sec = (int32_t)rval;
+            if (rval < sec)
+                sec--;
+            node = plist_new_date(sec, (int32_t)((rval - sec) * 1000000 + 0.5));
+        }
+        break;
+    case PLIST_STRING:
+        if (plist_bin_reader_get_string(reader, obj, &sval) == 0) {
+            node = plist_new_string(sval);
+            free(sval);
+        }
+        break;
+    case PLIST_DATA:
+        if (plist_bin_reader_get_data(reader, obj, &dval, &uval) == 0)
+            node = plist_new_data(dval, uval);
+        break;
+    case PLIST_ARRAY:
+        node = plist_new_array();
+        for (i = 0; i < size; i++) {
+            plist_t item = NULL;
+            if (plist_bin_reader_child(reader, obj, i, &child) < 0 || !(item = build_node(reader, child))) {
+                plist_free(node);
+                return NULL;
+            }
+            plist_array_append_item(node, item);
+        }
+        break;
+    case PLIST_DICT:
+        node = plist_new_dict();
+        for (i = 0; i < size; i++) {
+            plist_t item = NULL;
+            uint64_t looked_up = 0;
+            if (plist_bin_reader_dict_key(reader, obj, i, &key) < 0
+             || plist_bin_reader_get_string(reader, key, &sval) < 0) {
+                plist_free(node);
+                return NULL;
+            }
+            if (plist_bin_reader_child(reader, obj, i, &child) < 0
+             || plist_bin_reader_dict_get(reader, obj, sval, &looked_up) < 0
+             || !(item = build_node(reader, looked_up))) {
+                free(sval);
+                plist_free(node);
+                return NULL;
+            }
+            plist_dict_set_item(node, sval, item);
+            free(sval);
+        }
+        break;
+    default:
+        break;
+    }
+    return node;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *iplist = NULL;
+    plist_t root_heap = NULL;
+    plist_t root_walk = NULL;
+    plist_t root_node = NULL;
+    plist_bin_reader_t reader = NULL;
+    char *plist_xml = NULL;
+    char *plist_bin = NULL;
+    char *xml_heap = NULL;
+    char *xml_walk = NULL;
+    char *xml_node = NULL;
+    uint32_t bin_size = 0;
+    uint32_t size_heap = 0;
+    uint32_t size_walk = 0;
+    uint32_t size_node = 0;
+    struct stat filestats;
+    int res = 0;
+
+    if (argc != 2) {
+        printf("Wrong input\n");
+        return 1;
+    }
+
+    iplist = fopen(argv[1], "rb");
+    if (!iplist) {
+        printf("File does not exists\n");
+        return 2;
+    }
+    stat(argv[1], &filestats);
+    plist_xml = (char*)malloc(filestats.st_size + 1);
+    fread(plist_xml, 1, filestats.st_size, iplist);
+    fclose(iplist);
+
+    plist_from_xml(plist_xml, filestats.st_size, &root_heap);
+    if (!root_heap) {
+        printf("PList XML parsing failed\n");
+        return 3;
+    }
+    plist_to_bin(root_heap, &plist_bin, &bin_size);
+    plist_to_xml(root_heap, &xml_heap, &size_heap);
+
+    reader = plist_bin_reader_open(plist_bin, bin_size);
+    if (!reader) {
+        printf("Could not open binary plist reader\n");
+        return 4;
+    }
+    if (plist_bin_reader_open(plist_xml, filestats.st_size)) {
+        printf("Reader accepted non-binary input\n");
+        return 5;
+    }
+
+    root_walk = build_node(reader, plist_bin_reader_root(reader));
+    root_node = plist_bin_reader_get_node(reader, plist_bin_reader_root(reader));
+    if (!root_walk || !root_node) {
+        printf("Walking the binary plist failed\n");
+        return 6;
+    }
+    plist_to_xml(root_walk, &xml_walk, &size_walk);
+    plist_to_xml(root_node, &xml_node, &size_node);
+
+    if (size_heap != size_walk || memcmp(xml_heap, xml_walk, size_heap) != 0) {
+        printf("XML output of walked tree differs\n");
+        res = 7;
+    }
+    if (size_heap != size_node || memcmp(xml_heap, xml_node, size_heap) != 0) {
+        printf("XML output of materialized tree differs\n");
+        res = 8;
+    }
+
+    plist_bin_reader_free(reader);
+    plist_free(root_heap);
+    plist_free(root_walk);
+    plist_free(root_node);
+    free(plist_xml);
+    free(plist_bin);
+    free(xml_heap);
+    free(xml_walk);
+    free(xml_node);
+
+    if (res == 0) {
+        printf("Binary plist reader walk succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,139 @@
+/*
+ * plist_refs_test.c
+ * checks reference and offset tables of all sizes in binary plists
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* an array with count distinct strings, and a dict with the same keys
+ * when with_dict is set */
+static plist_t build_tree(uint32_t count, int with_dict)
+{
+    plist_t root = plist_new_array();
+    plist_t items = plist_new_array();
+    plist_t dict = plist_new_dict();
+    char buf[32];
+    uint32_t i = 0;
+
+    for (i = 0; i < count; i++) {
+        snprintf(buf, sizeof(buf), "%u", i);
+        plist_array_append_item(items, plist_new_string(buf));
+        if (with_dict) {
+            plist_dict_set_item(dict, buf, plist_new_uint(i));
+        }
+    }
+    plist_array_append_item(root, items);
+    plist_array_append_item(root, dict);
+    return root;
+}
+
+/* reads the reference size from the trailer */
+static int get_ref_size(const char *bin, uint32_t size)
+{
+    return (unsigned char)bin[size - 26];
+}
+
+static int check_tree(plist_t root, const char *what)
+{
+    plist_t parsed = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    int res = 0;
+
+    plist_to_bin(root, &bin, &size);
+    if (!bin) {
+        printf("%s: could not write\n", what);
+        return 1;
+    }
+    plist_from_bin(bin, size, &parsed);
+    if (!parsed || !plist_equal_deep(root, parsed)) {
+        printf("%s: round trip with %d byte references failed\n", what, get_ref_size(bin, size));
+        res = 1;
+    }
+    plist_free(parsed);
+    free(bin);
+    return res;
+}
+
+/* a reference to a missing object anywhere in a container fails */
+static int check_bad_ref(void)
+{
+    plist_t root = plist_new_array();
+    plist_t parsed = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    uint32_t i = 0;
+    uint32_t pos = 0;
+    int res = 0;
+
+    for (i = 0; i < 100; i++) {
+        plist_array_append_item(root, plist_new_uint(i));
+    }
+    plist_to_bin(root, &bin, &size);
+    plist_free(root);
+
+    /* the root array is written first: the marker, its size as an int
+     * object and then the 100 references */
+    for (pos = 0; pos < 100; pos += 7) {
+        char saved = bin[11 + pos];
+        bin[11 + pos] = (char)0xff;
+        parsed = NULL;
+        plist_from_bin(bin, size, &parsed);
+        if (parsed) {
+            printf("Invalid reference %u was accepted\n", pos);
+            plist_free(parsed);
+            res = 1;
+        }
+        bin[11 + pos] = saved;
+    }
+    parsed = NULL;
+    plist_from_bin(bin, size, &parsed);
+    if (!parsed) {
+        printf("Restored plist is invalid\n");
+        res = 1;
+    }
+    plist_free(parsed);
+    free(bin);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    /* counts around the vector block sizes, and across the reference
+     * size limits */
+    static const uint32_t counts[] = { 0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 63, 64, 65, 100, 126, 300, 1000, 40000, 70000 };
+    char what[64];
+    unsigned int i = 0;
+    int res = 0;
+
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        plist_t root = build_tree(counts[i], counts[i] <= 1000);
+        snprintf(what, sizeof(what), "%u items", counts[i]);
+        res |= check_tree(root, what);
+        plist_free(root);
+    }
+    res |= check_bad_ref();
+
+    if (res == 0) {
+        printf("Reference tables succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,80 @@
+/*
+ * plist_roundtrip_test.c
+ * replays inputs that were slow to parse, write and access and checks
+ * that they stay within the per byte budget of the roundtrip fuzzers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "roundtrip.h"
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+static int check_file(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    char *buf = NULL;
+    long size = 0;
+    int res = 0;
+
+    if (!f) {
+        printf("Could not open %s\n", filename);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = (char*)malloc(size + 1);
+    if (!buf || fread(buf, 1, size, f) != (size_t)size) {
+        printf("Could not read %s\n", filename);
+        fclose(f);
+        free(buf);
+        return 1;
+    }
+    fclose(f);
+
+    /* the fuzzer an input came from is told by its contents, like
+     * plist_from_memory does */
+    if (size >= 6 && memcmp(buf, "bplist", 6) == 0) {
+        res = roundtrip_check(buf, size, ROUNDTRIP_BIN, filename);
+    } else {
+        res = roundtrip_check(buf, size, ROUNDTRIP_XML, filename);
+    }
+    free(buf);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("All %d inputs stayed within the round trip budget\n", argc - 1);
+    }
+    return res;
+}
@@ -0,0 +1,372 @@
+/*
+ * plist_schema_test.c
+ * checks decoding binary plists into structs and writing them back
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NUM_WIDE 70
+
+struct owner {
+    char *name;
+    uint32_t count;
+};
+
+struct app {
+    char *identifier;
+    char *title;
+    uint8_t enabled;
+    int32_t offset;
+    uint32_t version;
+    int64_t delta;
+    uint64_t size;
+    double ratio;
+    double date;
+    plist_field_data_t icon;
+    uint64_t uid;
+    struct owner owner;
+    plist_t extra;
+};
+
+static const plist_field_t owner_fields[] = {
+    PLIST_FIELD("Name", PLIST_FIELD_STRING, struct owner, name),
+    PLIST_FIELD("Count", PLIST_FIELD_UINT32, struct owner, count),
+    PLIST_FIELD_END
+};
+
+static const plist_field_t app_fields[] = {
+    { "CFBundleIdentifier", PLIST_FIELD_STRING, offsetof(struct app, identifier), PLIST_FIELD_REQUIRED, NULL },
+    PLIST_FIELD("T\xc3\xaftel", PLIST_FIELD_STRING, struct app, title),
+    PLIST_FIELD("Enabled", PLIST_FIELD_BOOL, struct app, enabled),
+    PLIST_FIELD("Offset", PLIST_FIELD_INT32, struct app, offset),
+    PLIST_FIELD("Version", PLIST_FIELD_UINT32, struct app, version),
+    PLIST_FIELD("Delta", PLIST_FIELD_INT64, struct app, delta),
+    PLIST_FIELD("Size", PLIST_FIELD_UINT64, struct app, size),
+    PLIST_FIELD("Ratio", PLIST_FIELD_REAL, struct app, ratio),
+    PLIST_FIELD("Date", PLIST_FIELD_DATE, struct app, date),
+    PLIST_FIELD("Icon", PLIST_FIELD_DATA, struct app, icon),
+    PLIST_FIELD("UID", PLIST_FIELD_UID, struct app, uid),
+    { "Owner", PLIST_FIELD_STRUCT, offsetof(struct app, owner), 0, owner_fields },
+    PLIST_FIELD("Extra", PLIST_FIELD_NODE, struct app, extra),
+    PLIST_FIELD_END
+};
+
+static plist_t make_app(void)
+{
+    plist_t dict = plist_new_dict();
+    plist_t owner = plist_new_dict();
+    plist_t unknown = plist_new_array();
+    plist_t extra = plist_new_array();
+
+    /* not in schema order, with keys the schema doesn't know */
+    plist_dict_set_item(dict, "Unknown", unknown);
+    plist_array_append_item(unknown, plist_new_string("skipped"));
+    plist_dict_set_item(dict, "Version", plist_new_uint(42));
+    plist_dict_set_item(dict, "CFBundleIdentifier", plist_new_string("com.example.app"));
+    plist_dict_set_item(dict, "T\xc3\xaftel", plist_new_string("Caf\xc3\xa9"));
+    plist_dict_set_item(dict, "Enabled", plist_new_bool(1));
+    plist_dict_set_item(dict, "Offset", plist_new_uint((uint64_t)-1234));
+    plist_dict_set_item(dict, "Delta", plist_new_uint((uint64_t)-5000000000LL));
+    plist_dict_set_item(dict, "Size", plist_new_uint(UINT64_MAX - 1));
+    plist_dict_set_item(dict, "Ratio", plist_new_real(0.125));
+    plist_dict_set_item(dict, "Date", plist_new_date(700000000, 500000));
+    plist_dict_set_item(dict, "Icon", plist_new_data("\x01\x02\x03", 3));
+    plist_dict_set_item(dict, "UID", plist_new_uid(9));
+    plist_dict_set_item(owner, "Name", plist_new_string("Owner"));
+    plist_dict_set_item(owner, "Count", plist_new_uint(3));
+    plist_dict_set_item(owner, "Other", plist_new_real(1.5));
+    plist_dict_set_item(dict, "Owner", owner);
+    plist_array_append_item(extra, plist_new_uint(1));
+    plist_array_append_item(extra, plist_new_string("two"));
+    plist_dict_set_item(dict, "Extra", extra);
+    return dict;
+}
+
+static int check_app(const struct app *a, const char *what)
+{
+    uint64_t n = 0;
+
+    if (!a->identifier || strcmp(a->identifier, "com.example.app") != 0
+        || !a->title || strcmp(a->title, "Caf\xc3\xa9") != 0
+        || a->enabled != 1 || a->offset != -1234 || a->version != 42
+        || a->delta != -5000000000LL || a->size != UINT64_MAX - 1
+        || a->ratio != 0.125 || a->date != 700000000.5
+        || a->icon.length != 3 || memcmp(a->icon.data, "\x01\x02\x03", 3) != 0
+        || a->uid != 9 || !a->owner.name || strcmp(a->owner.name, "Owner") != 0
+        || a->owner.count != 3) {
+        printf("%s: decoded values differ\n", what);
+        return 1;
+    }
+    if (!PLIST_IS_ARRAY(a->extra) || plist_array_get_size(a->extra) != 2) {
+        printf("%s: node member differs\n", what);
+        return 1;
+    }
+    plist_get_uint_val(plist_array_get_item(a->extra, 0), &n);
+    return (n == 1) ? 0 : 1;
+}
+
+static int check_round_trip(void)
+{
+    plist_t root = make_app();
+    plist_t parsed = NULL;
+    struct app a;
+    struct app b;
+    char *bin = NULL;
+    char *out = NULL;
+    uint32_t bin_size = 0;
+    uint64_t out_size = 0;
+    int res = 0;
+
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    plist_to_bin(root, &bin, &bin_size);
+    if (plist_from_bin_struct(bin, bin_size, app_fields, &a) < 0) {
+        printf("Could not decode struct\n");
+        res = 1;
+    }
+    res |= check_app(&a, "decoded");
+
+    /* written back, the struct decodes to the same values */
+    if (plist_to_bin_struct(app_fields, &a, &out, &out_size) < 0) {
+        printf("Could not write struct\n");
+        res = 1;
+    }
+    if (plist_from_bin_struct(out, out_size, app_fields, &b) < 0) {
+        printf("Could not decode written struct\n");
+        res = 1;
+    }
+    res |= check_app(&b, "written");
+    plist_struct_free(app_fields, &b);
+
+    /* and it is a normal binary plist */
+    plist_from_bin(out, (uint32_t)out_size, &parsed);
+    if (!PLIST_IS_DICT(parsed) || plist_dict_get_size(parsed) != 13 || !plist_dict_get_item(parsed, "Owner")) {
+        printf("Written struct does not parse\n");
+        res = 1;
+    }
+    plist_free(parsed);
+    free(out);
+
+    /* NULL strings and nodes are left out */
+    plist_struct_free(app_fields, &a);
+    if (a.identifier || a.extra || a.owner.name) {
+        printf("plist_struct_free did not clear the members\n");
+        res = 1;
+    }
+    plist_to_bin_struct(app_fields, &a, &out, &out_size);
+    plist_from_bin(out, (uint32_t)out_size, &parsed);
+    if (!PLIST_IS_DICT(parsed) || plist_dict_get_size(parsed) != 10) {
+        printf("NULL members were written\n");
+        res = 1;
+    }
+    plist_free(parsed);
+    free(out);
+
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+/* decodes root and expects it to fail */
+static int check_rejected(plist_t root, const char *what)
+{
+    struct app a;
+    char *bin = NULL;
+    uint32_t size = 0;
+    int res = 0;
+
+    memset(&a, 0, sizeof(a));
+    plist_to_bin(root, &bin, &size);
+    if (plist_from_bin_struct(bin, size, app_fields, &a) == 0) {
+        printf("%s was accepted\n", what);
+        res = 1;
+    }
+    plist_struct_free(app_fields, &a);
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+static int check_invalid(void)
+{
+    plist_t root = NULL;
+    int res = 0;
+
+    root = make_app();
+    plist_dict_set_item(root, "Version", plist_new_string("42"));
+    res |= check_rejected(root, "Wrong type");
+
+    root = make_app();
+    plist_dict_set_item(root, "Offset", plist_new_uint(0x80000000));
+    res |= check_rejected(root, "Out of range int32");
+
+    root = make_app();
+    plist_dict_set_item(root, "Version", plist_new_uint((uint64_t)-1));
+    res |= check_rejected(root, "Negative uint32");
+
+    root = make_app();
+    plist_dict_set_item(plist_dict_get_item(root, "Owner"), "Count", plist_new_bool(0));
+    res |= check_rejected(root, "Wrong type in nested struct");
+
+    root = make_app();
+    plist_dict_remove_item(root, "CFBundleIdentifier");
+    res |= check_rejected(root, "Missing required key");
+
+    res |= check_rejected(plist_new_array(), "Array");
+    return res;
+}
+
+struct buffer {
+    char *data;
+    size_t length;
+};
+
+static int write_buffer(void *user_data, const char *buf, size_t size)
+{
+    struct buffer *b = (struct buffer*)user_data;
+    char *data = (char*)realloc(b->data, b->length + size);
+    if (!data) {
+        return -1;
+    }
+    memcpy(data + b->length, buf, size);
+    b->data = data;
+    b->length += size;
+    return 0;
+}
+
+static int check_duplicate(void)
+{
+    struct buffer buf = { NULL, 0 };
+    plist_bin_writer_t writer = plist_bin_writer_new(write_buffer, &buf, PLIST_WRITE_DEFAULT);
+    struct app a;
+    int res = 0;
+
+    plist_bin_writer_begin_dict(writer);
+    plist_bin_writer_add_key(writer, "CFBundleIdentifier");
+    plist_bin_writer_add_string(writer, "first");
+    plist_bin_writer_add_key(writer, "CFBundleIdentifier");
+    plist_bin_writer_add_string(writer, "second");
+    plist_bin_writer_end(writer);
+    plist_bin_writer_finish(writer);
+    plist_bin_writer_free(writer);
+
+    memset(&a, 0, sizeof(a));
+    if (plist_from_bin_struct(buf.data, buf.length, app_fields, &a) == 0) {
+        printf("Duplicate key was accepted\n");
+        res = 1;
+    }
+    plist_struct_free(app_fields, &a);
+    free(buf.data);
+    return res;
+}
+
+/* a schema with more fields than are tracked on the stack */
+static int check_wide(void)
+{
+    plist_field_t fields[NUM_WIDE + 1];
+    char keys[NUM_WIDE][8];
+    uint64_t values[NUM_WIDE];
+    uint64_t decoded[NUM_WIDE];
+    plist_t root = plist_new_dict();
+    char *bin = NULL;
+    uint32_t size = 0;
+    int res = 0;
+    int i = 0;
+
+    for (i = 0; i < NUM_WIDE; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+        fields[i].key = keys[i];
+        fields[i].type = PLIST_FIELD_UINT64;
+        fields[i].offset = i * sizeof(uint64_t);
+        fields[i].flags = PLIST_FIELD_REQUIRED;
+        fields[i].fields = NULL;
+        values[i] = (uint64_t)i * 1000;
+    }
+    memset(&fields[NUM_WIDE], 0, sizeof(fields[NUM_WIDE]));
+    /* in reverse order */
+    for (i = NUM_WIDE - 1; i >= 0; i--) {
+        plist_dict_set_item(root, keys[i], plist_new_uint(values[i]));
+    }
+    plist_to_bin(root, &bin, &size);
+    memset(decoded, 0, sizeof(decoded));
+    if (plist_from_bin_struct(bin, size, fields, decoded) < 0 || memcmp(decoded, values, sizeof(values)) != 0) {
+        printf("Wide schema failed\n");
+        res = 1;
+    }
+    free(bin);
+    bin = NULL;
+
+    plist_dict_remove_item(root, "k69");
+    plist_to_bin(root, &bin, &size);
+    if (plist_from_bin_struct(bin, size, fields, decoded) == 0) {
+        printf("Missing key of wide schema was accepted\n");
+        res = 1;
+    }
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+static int check_file(const char *filename)
+{
+    static const plist_field_t any_fields[] = {
+        PLIST_FIELD("CFBundleIdentifier", PLIST_FIELD_NODE, struct app, extra),
+        PLIST_FIELD_END
+    };
+    plist_t root = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    struct app a;
+
+    /* must not crash on any input, real files mostly have other keys */
+    plist_read_from_file(filename, &root, NULL);
+    if (!root) {
+        return 0;
+    }
+    plist_to_bin(root, &bin, &size);
+    memset(&a, 0, sizeof(a));
+    plist_from_bin_struct(bin, size, app_fields, &a);
+    plist_struct_free(app_fields, &a);
+    plist_from_bin_struct(bin, size, any_fields, &a);
+    plist_struct_free(any_fields, &a);
+    free(bin);
+    plist_free(root);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    res |= check_round_trip();
+    res |= check_invalid();
+    res |= check_duplicate();
+    res |= check_wide();
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("Struct binding succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,248 @@
+/*
+ * plist_size64_test.c
+ * checks that the functions with 64 bit lengths and indexes agree with
+ * the 32 bit ones
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+static int same_plist(plist_t a, plist_t b)
+{
+    char *bin_a = NULL;
+    char *bin_b = NULL;
+    uint32_t size_a = 0;
+    uint32_t size_b = 0;
+    int res = 0;
+
+    if (!a || !b) {
+        return (a == b);
+    }
+    plist_to_bin(a, &bin_a, &size_a);
+    plist_to_bin(b, &bin_b, &size_b);
+    res = (bin_a && bin_b && size_a == size_b && memcmp(bin_a, bin_b, size_a) == 0);
+    free(bin_a);
+    free(bin_b);
+    return res;
+}
+
+static int same_output(const char *what, const char *a, uint64_t size_a, const char *b, uint32_t size_b)
+{
+    if (!a || !b || size_a != size_b || memcmp(a, b, size_b) != 0) {
+        printf("%s output differs\n", what);
+        return 0;
+    }
+    return 1;
+}
+
+/* compares the 64 bit accessors with the 32 bit ones on every container */
+static int check_accessors(plist_t node)
+{
+    plist_type type = plist_get_node_type(node);
+    uint64_t n = 0;
+
+    if (type == PLIST_ARRAY) {
+        if (plist_array_get_size64(node) != plist_array_get_size(node)) {
+            printf("Array sizes differ\n");
+            return 1;
+        }
+        for (n = 0; n < plist_array_get_size64(node); n++) {
+            if (plist_array_get_item64(node, n) != plist_array_get_item(node, (uint32_t)n) || check_accessors(plist_array_get_item64(node, n))) {
+                return 1;
+            }
+        }
+        /* the index does not wrap around at 2^32 */
+        if (plist_array_get_item64(node, ((uint64_t)1 << 32) + 0) || plist_array_get_item64(node, UINT64_MAX)) {
+            printf("Item beyond 2^32 was found\n");
+            return 1;
+        }
+    } else if (type == PLIST_DICT) {
+        plist_dict_iter it = NULL;
+        plist_t val = NULL;
+        if (plist_dict_get_size64(node) != plist_dict_get_size(node)) {
+            printf("Dictionary sizes differ\n");
+            return 1;
+        }
+        plist_dict_new_iter(node, &it);
+        do {
+            val = NULL;
+            plist_dict_next_item(node, it, NULL, &val);
+            if (val && check_accessors(val)) {
+                plist_mem_free(it);
+                return 1;
+            }
+        } while (val);
+        plist_mem_free(it);
+    } else if (plist_array_get_size64(node) != 0 || plist_dict_get_size64(node) != 0 || plist_array_get_item64(node, 0)) {
+        printf("Scalar has items\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int check_tree(plist_t root, const char *what)
+{
+    plist_t parsed = NULL;
+    char *out32 = NULL;
+    char *out64 = NULL;
+    uint32_t size32 = 0;
+    uint64_t size64 = 0;
+    int res = 0;
+
+    plist_to_bin(root, &out32, &size32);
+    if (plist_to_bin64(root, PLIST_WRITE_DEFAULT, &out64, &size64) < 0 || !same_output("Binary", out64, size64, out32, size32)) {
+        res = 1;
+    }
+    plist_from_bin64(out64, size64, PLIST_PARSE_DEFAULT, &parsed);
+    if (!same_plist(root, parsed)) {
+        printf("%s: plist_from_bin64 failed\n", what);
+        res = 1;
+    }
+    plist_free(parsed);
+    plist_from_memory64(out64, size64, &parsed);
+    if (!same_plist(root, parsed)) {
+        printf("%s: plist_from_memory64 failed for binary input\n", what);
+        res = 1;
+    }
+    plist_free(parsed);
+    free(out32);
+    free(out64);
+
+    out32 = NULL;
+    plist_to_xml_ex(root, PLIST_XML_COMPACT, &out32, &size32);
+    if (plist_to_xml64(root, PLIST_XML_COMPACT, &out64, &size64) < 0 || !same_output("XML", out64, size64, out32, size32)) {
+        res = 1;
+    }
+    plist_from_xml64(out64, size64, &parsed);
+    plist_free(parsed);
+    if (!parsed) {
+        printf("%s: plist_from_xml64 failed\n", what);
+        res = 1;
+    }
+    free(out32);
+    free(out64);
+
+    /* not every plist can be written as JSON */
+    if (plist_to_json(root, &out32, &size32, 1) == 0) {
+        if (plist_to_json64(root, &out64, &size64, 1) < 0 || !same_output("JSON", out64, size64, out32, size32)) {
+            res = 1;
+        }
+        plist_from_json64(out64, size64, &parsed);
+        plist_free(parsed);
+        if (!parsed) {
+            printf("%s: plist_from_json64 failed\n", what);
+            res = 1;
+        }
+        free(out32);
+        free(out64);
+    }
+
+    res |= check_accessors(root);
+    if (res) {
+        printf("%s failed\n", what);
+    }
+    return res;
+}
+
+static int check_file(const char *filename)
+{
+    plist_t root = NULL;
+    plist_t parsed = NULL;
+    FILE *f = NULL;
+    char *buf = NULL;
+    long size = 0;
+    int res = 0;
+
+    /* invalid files are checked elsewhere */
+    plist_read_from_file(filename, &root, NULL);
+    if (!root) {
+        return 0;
+    }
+    f = fopen(filename, "rb");
+    if (!f) {
+        printf("Could not open %s\n", filename);
+        plist_free(root);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = (char*)malloc(size);
+    if (fread(buf, 1, size, f) != (size_t)size) {
+        printf("Could not read %s\n", filename);
+        res = 1;
+    }
+    fclose(f);
+
+    plist_from_memory64(buf, size, &parsed);
+    if (!same_plist(root, parsed)) {
+        printf("%s: plist_from_memory64 differs from plist_read_from_file\n", filename);
+        res = 1;
+    }
+    plist_free(parsed);
+    free(buf);
+
+    res |= check_tree(root, filename);
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_t root = plist_new_dict();
+    plist_t items = plist_new_array();
+    plist_t out = NULL;
+    char *bin = NULL;
+    uint64_t size = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    for (i = 0; i < 100; i++) {
+        plist_array_append_item(items, plist_new_uint(i));
+    }
+    plist_dict_set_item(root, "items", items);
+    plist_dict_set_item(root, "name", plist_new_string("64 bit"));
+    res |= check_tree(root, "generated");
+
+    if (plist_to_bin64(NULL, PLIST_WRITE_DEFAULT, &bin, &size) == 0 || plist_to_xml64(root, PLIST_XML_DEFAULT, NULL, &size) == 0) {
+        printf("Invalid arguments were accepted\n");
+        res = 1;
+    }
+    plist_from_memory64("bplist00", 8, &out);
+    if (out) {
+        printf("Truncated binary plist was accepted\n");
+        plist_free(out);
+        res = 1;
+    }
+    plist_free(root);
+
+    for (i = 1; i < (uint32_t)argc; i++) {
+        res |= check_file(argv[i]);
+    }
+
+    if (res == 0) {
+        printf("64 bit functions succeeded\n");
+    }
+    return res;
+}
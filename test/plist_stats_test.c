@@ -0,0 +1,112 @@
+/*
+ * plist_stats_test.c
+ * checks the counters reported by plist_stats_get
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(cond) \
+    if (!(cond)) { \
+        printf("Check failed: %s\n", #cond); \
+        res = 1; \
+    }
+
+int main(int argc, char *argv[])
+{
+    plist_stats_t stats;
+    plist_t root = NULL;
+    plist_t parsed = NULL;
+    char *bin = NULL;
+    char *xml = NULL;
+    uint32_t bin_size = 0;
+    uint32_t xml_size = 0;
+    char key[32];
+    uint32_t i = 0;
+    int res = 0;
+
+    memset(&stats, 0xff, sizeof(stats));
+    if (plist_stats_get(&stats) < 0) {
+        /* built without --enable-stats */
+        plist_stats_t zero;
+        memset(&zero, 0, sizeof(zero));
+        if (memcmp(&stats, &zero, sizeof(stats)) != 0) {
+            printf("Statistics must be zeroed if not available\n");
+            return 1;
+        }
+        printf("Statistics not available\n");
+        return 0;
+    }
+
+    root = plist_new_dict();
+    for (i = 0; i < 1000; i++) {
+        snprintf(key, sizeof(key), "key%u", i);
+        plist_dict_set_item(root, key, plist_new_string("\xc3\xa4 same value"));
+    }
+    plist_dict_set_item(root, "data", plist_new_data("0123456789", 10));
+
+    plist_stats_reset();
+    plist_stats_get(&stats);
+    CHECK(stats.nodes_created == 0);
+
+    plist_to_bin(root, &bin, &bin_size);
+    plist_stats_get(&stats);
+    /* the 1000 equal strings are written once */
+    CHECK(stats.dedup_hits >= 999);
+    CHECK(stats.utf16_conversions == 1);
+    CHECK(stats.hash_lookups > 0);
+    CHECK(stats.hash_probes >= stats.hash_lookups);
+    CHECK(stats.hash_max_probes >= 1);
+    CHECK(stats.bin_serialize_time > 0 && stats.bin_write_time > 0);
+
+    plist_stats_reset();
+    plist_from_bin(bin, bin_size, &parsed);
+    plist_stats_get(&stats);
+    /* dict, 1001 keys and 1001 values */
+    CHECK(stats.nodes_created == 2003);
+    CHECK(stats.bytes_allocated > 0);
+    /* the shared string is decoded for every reference */
+    CHECK(stats.utf16_conversions == 1000);
+    plist_free(parsed);
+    parsed = NULL;
+
+    plist_stats_reset();
+    plist_to_xml(root, &xml, &xml_size);
+    plist_from_xml(xml, xml_size, &parsed);
+    plist_stats_get(&stats);
+    CHECK(stats.base64_encoded_bytes == 10);
+    CHECK(stats.base64_decoded_bytes == 10);
+    CHECK(stats.nodes_created >= 2003);
+    CHECK(stats.xml_parse_time > 0 && stats.xml_write_time > 0);
+    plist_free(parsed);
+
+    plist_stats_reset();
+    plist_stats_get(&stats);
+    CHECK(stats.nodes_created == 0 && stats.dedup_hits == 0 && stats.xml_parse_time == 0);
+
+    free(bin);
+    free(xml);
+    plist_free(root);
+
+    if (res == 0) {
+        printf("Statistics are correct\n");
+    }
+    return res;
+}
@@ -0,0 +1,261 @@
+/*
+ * plist_stream_test.c
+ * rebuilds a tree from the events of the streaming XML parser and checks
+ * the output of the streaming XML writer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+struct builder {
+    FILE *f;
+    size_t chunk;
+    plist_t root;
+    plist_t stack[256];
+    int depth;
+    char *key;
+};
+
+static size_t read_chunk(void *user_data, char *buf, size_t size)
+{
+    struct builder *b = (struct builder*)user_data;
+    /* hand out small odd-sized chunks so tokens get split */
+    return fread(buf, 1, (size < b->chunk) ? size : b->chunk, b->f);
+}
+
+static void add_node(struct builder *b, plist_t node)
+{
+    if (b->depth == 0) {
+        b->root = node;
+    } else if (plist_get_node_type(b->stack[b->depth-1]) == PLIST_DICT) {
+        plist_dict_set_item(b->stack[b->depth-1], b->key, node);
+        free(b->key);
+        b->key = NULL;
+    } else {
+        plist_array_append_item(b->stack[b->depth-1], node);
+    }
+}
+
+static int begin_container(struct builder *b, plist_t node)
+{
+    if (b->depth >= 256) {
+        return 1;
+    }
+    add_node(b, node);
+    b->stack[b->depth++] = node;
+    return 0;
+}
+
+static int on_begin_dict(void *user_data)
+{
+    return begin_container((struct builder*)user_data, plist_new_dict());
+}
+
+static int on_begin_array(void *user_data)
+{
+    return begin_container((struct builder*)user_data, plist_new_array());
+}
+
+static int on_end(void *user_data)
+{
+    ((struct builder*)user_data)->depth--;
+    return 0;
+}
+
+static int on_key(void *user_data, const char *key, size_t length)
+{
+    struct builder *b = (struct builder*)user_data;
+    b->key = strdup(key);
+    return (strlen(key) == length) ? 0 : 1;
+}
+
+static int on_value(void *user_data, plist_t node)
+{
+    add_node((struct builder*)user_data, plist_copy(node));
+    return 0;
+}
+
+struct collector {
+    char *buf;
+    size_t len;
+    size_t calls;
+};
+
+static int collect(void *user_data, const char *buf, size_t size)
+{
+    struct collector *c = (struct collector*)user_data;
+    char *nbuf = (char*)realloc(c->buf, c->len + size);
+    if (!nbuf) {
+        return -1;
+    }
+    c->buf = nbuf;
+    memcpy(c->buf + c->len, buf, size);
+    c->len += size;
+    c->calls++;
+    return 0;
+}
+
+static int fail_write(void *user_data, const char *buf, size_t size)
+{
+    (void)user_data;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+/* a malformed element must fail right away instead of reading on */
+static int check_malformed(size_t chunk)
+{
+    static const char head[] = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\">\n<array>\n<integer>12<!-- x --></integer>\n<integer>12</real>\n";
+    static const char tail[] = "</array>\n</plist>\n";
+    plist_xml_handler_t handler = { on_begin_dict, on_end, on_begin_array, on_end, on_key, on_value };
+    struct builder b;
+    long total;
+    int i;
+    int res;
+
+    memset(&b, '\0', sizeof(b));
+    b.chunk = chunk;
+    b.f = tmpfile();
+    if (!b.f) {
+        return 0;
+    }
+    fwrite(head, 1, sizeof(head) - 1, b.f);
+    for (i = 0; i < 65536; i++) {
+        fputs("<true/>\n", b.f);
+    }
+    fwrite(tail, 1, sizeof(tail) - 1, b.f);
+    total = ftell(b.f);
+    rewind(b.f);
+    res = plist_xml_parse_stream(read_chunk, &handler, &b);
+    res = (res == -1 && ftell(b.f) < total);
+    fclose(b.f);
+    plist_free(b.root);
+    free(b.key);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_xml_handler_t handler = { on_begin_dict, on_end, on_begin_array, on_end, on_key, on_value };
+    struct builder b;
+    plist_t root_dom = NULL;
+    char *plist_xml = NULL;
+    char *xml_dom = NULL;
+    char *xml_stream = NULL;
+    uint32_t size_dom = 0;
+    uint32_t size_stream = 0;
+    struct collector c;
+    FILE *tmp = NULL;
+    char *xml_file = NULL;
+    long size_file = 0;
+    struct stat filestats;
+    int res = 0;
+
+    if (argc != 3) {
+        printf("Wrong input\n");
+        return 1;
+    }
+
+    memset(&b, '\0', sizeof(b));
+    b.chunk = atoi(argv[2]);
+    b.f = fopen(argv[1], "rb");
+    if (!b.f || b.chunk == 0) {
+        printf("File does not exists\n");
+        return 2;
+    }
+    stat(argv[1], &filestats);
+    plist_xml = (char*)malloc(filestats.st_size + 1);
+    fread(plist_xml, 1, filestats.st_size, b.f);
+    rewind(b.f);
+
+    plist_from_xml(plist_xml, filestats.st_size, &root_dom);
+    if (!root_dom) {
+        printf("PList XML parsing failed\n");
+        return 3;
+    }
+    plist_to_xml(root_dom, &xml_dom, &size_dom);
+
+    if (plist_xml_parse_stream(read_chunk, &handler, &b) != 0 || !b.root) {
+        printf("PList XML stream parsing failed\n");
+        return 4;
+    }
+    fclose(b.f);
+    plist_to_xml(b.root, &xml_stream, &size_stream);
+
+    if (size_dom != size_stream || memcmp(xml_dom, xml_stream, size_dom) != 0) {
+        printf("Tree built from stream events differs\n");
+        res = 5;
+    }
+
+    memset(&c, '\0', sizeof(c));
+    if (plist_to_xml_stream(root_dom, collect, &c) != 0) {
+        printf("PList XML stream writing failed\n");
+        res = 6;
+    } else if (c.len != size_dom || memcmp(c.buf, xml_dom, size_dom) != 0) {
+        printf("Output of the streaming XML writer differs\n");
+        res = 7;
+    }
+    if (plist_to_xml_stream(root_dom, fail_write, NULL) != -1) {
+        printf("Write error was not reported\n");
+        res = 8;
+    }
+
+    tmp = tmpfile();
+    if (!tmp || plist_to_xml_file(root_dom, tmp) != 0) {
+        printf("PList XML writing to FILE failed\n");
+        res = 9;
+    } else {
+        size_file = ftell(tmp);
+        rewind(tmp);
+        xml_file = (char*)malloc(size_file + 1);
+        if (size_file != (long)size_dom || fread(xml_file, 1, size_file, tmp) != (size_t)size_file || memcmp(xml_file, xml_dom, size_dom) != 0) {
+            printf("Output written to FILE differs\n");
+            res = 10;
+        }
+    }
+    if (tmp)
+        fclose(tmp);
+
+    if (!check_malformed(b.chunk)) {
+        printf("Malformed element was not reported\n");
+        res = 11;
+    }
+
+    if (res == 0) {
+        printf("PList XML stream parsing and writing succeeded\n");
+    }
+
+    plist_free(root_dom);
+    plist_free(b.root);
+    free(b.key);
+    free(plist_xml);
+    free(xml_dom);
+    free(xml_stream);
+    free(xml_file);
+    free(c.buf);
+
+    return res;
+}
@@ -0,0 +1,202 @@
+/*
+ * plist_threads_test.c
+ * checks that a tree can be read by several threads at once while other
+ * threads parse and write trees of their own
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+
+int main(int argc, char *argv[])
+{
+    /* skipped */
+    return 77;
+}
+
+#else
+
+#include <pthread.h>
+
+#define NUM_THREADS 8
+#define NUM_ENTRIES 2000
+#define NUM_ROUNDS 5
+
+static plist_t shared = NULL;
+static char *expected_bin = NULL;
+static uint32_t expected_bin_size = 0;
+static char *expected_xml = NULL;
+static uint32_t expected_xml_size = 0;
+
+static int read_shared(void)
+{
+    char key[32];
+    char *bin = NULL;
+    char *xml = NULL;
+    uint32_t size = 0;
+    plist_t copy = NULL;
+    plist_dict_iter it = NULL;
+    const char *k = NULL;
+    plist_t val = NULL;
+    uint64_t uval = 0;
+    uint32_t count = 0;
+    uint32_t i = 0;
+    int res = 0;
+
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        snprintf(key, sizeof(key), "key%u", i);
+        val = plist_dict_get_item(shared, key);
+        plist_get_uint_val(plist_dict_get_item(val, "index"), &uval);
+        if (uval != i || !plist_get_string_ptr(plist_dict_get_item(val, "name"), NULL)) {
+            printf("Lookup of %s failed\n", key);
+            return 1;
+        }
+    }
+
+    plist_dict_new_iter(shared, &it);
+    do {
+        val = NULL;
+        plist_dict_next_item_ptr(shared, it, &k, &val);
+        if (val) {
+            count++;
+        }
+    } while (val);
+    free(it);
+    if (count != NUM_ENTRIES) {
+        printf("Iteration returned %u items\n", count);
+        res = 1;
+    }
+
+    plist_to_bin(shared, &bin, &size);
+    if (!bin || size != expected_bin_size || memcmp(bin, expected_bin, size) != 0) {
+        printf("Binary output differs\n");
+        res = 1;
+    }
+    free(bin);
+
+    plist_to_xml(shared, &xml, &size);
+    if (!xml || size != expected_xml_size || memcmp(xml, expected_xml, size) != 0) {
+        printf("XML output differs\n");
+        res = 1;
+    }
+    free(xml);
+
+    copy = plist_copy(shared);
+    if (!plist_compare_node_value(plist_access_path(copy, 2, "key7", "name"), plist_access_path(shared, 2, "key7", "name"))) {
+        printf("Copy differs\n");
+        res = 1;
+    }
+    plist_free(copy);
+    return res;
+}
+
+/* parses, modifies and writes a tree that only this thread uses */
+static int use_private(void)
+{
+    plist_t root = NULL;
+    plist_t root2 = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    int res = 0;
+
+    plist_from_bin(expected_bin, expected_bin_size, &root);
+    plist_from_xml(expected_xml, expected_xml_size, &root2);
+    if (!root || !root2) {
+        printf("Parsing failed\n");
+        res = 1;
+    } else {
+        plist_dict_set_item(root, "extra", plist_new_bool(1));
+        plist_dict_remove_item(root, "key1");
+        plist_to_bin(root, &bin, &size);
+        if (!bin || size == 0) {
+            printf("Writing a private tree failed\n");
+            res = 1;
+        }
+        free(bin);
+    }
+    plist_free(root);
+    plist_free(root2);
+    return res;
+}
+
+static void *worker(void *arg)
+{
+    int *res = (int*)arg;
+    int i = 0;
+
+    for (i = 0; i < NUM_ROUNDS; i++) {
+        *res |= read_shared();
+        *res |= use_private();
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t threads[NUM_THREADS];
+    int results[NUM_THREADS];
+    plist_t copy = NULL;
+    char key[32];
+    char name[64];
+    uint32_t i = 0;
+    int res = 0;
+
+    /* larger than the index threshold, so lookups use the key index */
+    shared = plist_new_dict();
+    for (i = 0; i < NUM_ENTRIES; i++) {
+        plist_t entry = plist_new_dict();
+        snprintf(key, sizeof(key), "key%u", i);
+        snprintf(name, sizeof(name), "entry number %u", i);
+        plist_dict_set_item(entry, "name", plist_new_string(name));
+        plist_dict_set_item(entry, "index", plist_new_uint(i));
+        plist_dict_set_item(entry, "data", plist_new_data(name, strlen(name)));
+        plist_dict_set_item(shared, key, entry);
+    }
+    /* the expected output is written from a copy, so the threads are the
+     * first to write the shared tree */
+    copy = plist_copy(shared);
+    plist_to_bin(copy, &expected_bin, &expected_bin_size);
+    plist_to_xml(copy, &expected_xml, &expected_xml_size);
+    plist_free(copy);
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        results[i] = 0;
+        if (pthread_create(&threads[i], NULL, worker, &results[i]) != 0) {
+            printf("Could not start thread %u\n", i);
+            return 1;
+        }
+    }
+    for (i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        res |= results[i];
+    }
+
+    plist_free(shared);
+    free(expected_bin);
+    free(expected_xml);
+
+    if (res == 0) {
+        printf("Concurrent access succeeded\n");
+    }
+    return res;
+}
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ * plist_validate_test.c
+ * checks that plist_bin_validate accepts exactly what plist_from_bin parses
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#pragma warning(disable:4996)
+#endif
+
+#define NUM_MUTATIONS 2000
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return (n > 0) ? ((rnd_state >> 8) % n) : 0;
+}
+
+/* validates the buffer and compares the result with the parser */
+static int check_buffer(const char *buf, uint32_t size, const char *what, int *valid)
+{
+    plist_t root = NULL;
+    plist_bin_error_t error = PLIST_BIN_VALID;
+    int res = plist_bin_validate(buf, size, &error);
+
+    plist_from_bin(buf, size, &root);
+    if ((res == 0) != (root != NULL) || (res == 0) != (error == PLIST_BIN_VALID)) {
+        printf("%s: validation %s (error %d), parsing %s\n", what, (res == 0) ? "passed" : "failed", error, (root) ? "succeeded" : "failed");
+        plist_free(root);
+        return 1;
+    }
+    plist_free(root);
+    if (valid) {
+        *valid = (res == 0);
+    }
+    return 0;
+}
+
+/* damages copies of the buffer in random ways */
+static int check_mutations(const char *buf, uint32_t size, const char *what)
+{
+    char *copy = (char*)malloc(size);
+    int i = 0;
+    int res = 0;
+
+    for (i = 0; i < NUM_MUTATIONS && res == 0; i++) {
+        uint32_t n = 1 + rnd(4);
+        uint32_t len = size;
+        memcpy(copy, buf, size);
+        while (n-- > 0) {
+            switch (rnd(3)) {
+            case 0:
+                copy[rnd(size)] = (char)rnd(256);
+                break;
+            case 1:
+                /* the trailer and offset table are at the end */
+                copy[size - 1 - rnd((size < 64) ? size : 64)] = (char)rnd(256);
+                break;
+            default:
+                copy[rnd(size)] ^= (char)(1 << rnd(8));
+                break;
+            }
+        }
+        if (rnd(10) == 0) {
+            len = rnd(size);
+        }
+        res |= check_buffer(copy, len, what, NULL);
+    }
+    free(copy);
+    return res;
+}
+
+static int check_error(const char *buf, uint32_t size, plist_bin_error_t expected, const char *what)
+{
+    plist_bin_error_t error = PLIST_BIN_VALID;
+    if (plist_bin_validate(buf, size, &error) == 0 || error != expected) {
+        printf("%s: error %d instead of %d\n", what, error, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_generated(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t items = plist_new_array();
+    plist_t shared = plist_new_dict();
+    plist_t nested = NULL;
+    plist_t inner = NULL;
+    char *bin = NULL;
+    uint32_t size = 0;
+    char buf[64];
+    int i = 0;
+    int valid = 0;
+    int res = 0;
+
+    plist_dict_set_item(shared, "name", plist_new_string("shared"));
+    for (i = 0; i < 20; i++) {
+        plist_t item = plist_new_dict();
+        snprintf(buf, sizeof(buf), "item %d", i);
+        plist_dict_set_item(item, "name", plist_new_string(buf));
+        plist_dict_set_item(item, "index", plist_new_uint(i));
+        plist_dict_set_item(item, "ratio", plist_new_real(i / 3.0));
+        plist_dict_set_item(item, "date", plist_new_date(i, 0));
+        plist_dict_set_item(item, "uid", plist_new_uid(i));
+        plist_dict_set_item(item, "flag", plist_new_bool(i & 1));
+        plist_dict_set_item(item, "data", plist_new_data(buf, strlen(buf)));
+        plist_dict_set_item(item, "unicode", plist_new_string("\xc3\xa4\xc3\xb6\xc3\xbc"));
+        plist_dict_set_item(item, "shared", plist_copy(shared));
+        plist_array_append_item(items, item);
+    }
+    plist_dict_set_item(root, "items", items);
+    plist_free(shared);
+
+    /* written compactly the shared dicts are referenced many times */
+    plist_to_bin_ex(root, PLIST_WRITE_COMPACT, &bin, &size);
+    res |= check_buffer(bin, size, "generated", &valid);
+    if (!valid) {
+        printf("Generated plist is not valid\n");
+        res = 1;
+    }
+    res |= check_mutations(bin, size, "generated");
+    res |= check_error(bin, 10, PLIST_BIN_INVALID_HEADER, "truncated");
+    res |= check_error(NULL, 0, PLIST_BIN_INVALID_HEADER, "NULL");
+    memcpy(buf, bin, 8);
+    buf[7] = '1';
+    res |= check_error(buf, 8, PLIST_BIN_INVALID_HEADER, "short version");
+    free(bin);
+    bin = NULL;
+    plist_free(root);
+
+    /* nesting beyond the maximum depth, with a shared subtree that is
+     * first reached at a smaller depth */
+    root = plist_new_array();
+    nested = plist_new_array();
+    inner = nested;
+    for (i = 0; i < 10; i++) {
+        plist_t child = plist_new_array();
+        plist_array_append_item(inner, child);
+        inner = child;
+    }
+    plist_array_append_item(root, plist_copy(nested));
+    inner = root;
+    for (i = 0; i < 5; i++) {
+        plist_t child = plist_new_array();
+        plist_array_append_item(inner, child);
+        inner = child;
+    }
+    plist_array_append_item(inner, nested);
+    plist_to_bin_ex(root, PLIST_WRITE_COMPACT, &bin, &size);
+    plist_set_max_depth(17);
+    res |= check_buffer(bin, size, "shared subtree within depth", &valid);
+    if (!valid) {
+        printf("Shared subtree within the depth limit is not valid\n");
+        res = 1;
+    }
+    plist_set_max_depth(16);
+    res |= check_buffer(bin, size, "shared subtree beyond depth", &valid);
+    if (valid) {
+        printf("Shared subtree beyond the depth limit is valid\n");
+        res = 1;
+    }
+    res |= check_error(bin, size, PLIST_BIN_INVALID_DEPTH, "depth");
+    plist_set_max_depth(0);
+    free(bin);
+    plist_free(root);
+    return res;
+}
+
+static int check_file(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    char *buf = NULL;
+    long size = 0;
+    int res = 0;
+
+    if (!f) {
+        printf("Could not open %s\n", filename);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = (char*)malloc(size > 0 ? size : 1);
+    if (fread(buf, 1, size, f) != (size_t)size) {
+        printf("Could not read %s\n", filename);
+        res = 1;
+    }
+    fclose(f);
+    if (res == 0) {
+        res |= check_buffer(buf, (uint32_t)size, filename, NULL);
+        res |= check_mutations(buf, (uint32_t)size, filename);
+    }
+    free(buf);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    res |= check_generated();
+    for (i = 1; i < argc; i++) {
+        res |= check_file(argv[i]);
+    }
+    if (check_error(NULL, 0, PLIST_BIN_INVALID_HEADER, "no data")) {
+        res = 1;
+    }
+
+    if (res == 0) {
+        printf("Binary plist validation succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,258 @@
+/*
+ * plist_view_test.cpp
+ * checks the non-owning views, the ownership taking insertion and the
+ * key lookups of the C++ binding
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <plist/plist++.h>
+#include <plist/View.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+
+using namespace PList;
+
+#define ITEMS 100
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static plist_t create_tree()
+{
+    plist_t root = plist_new_dict();
+    plist_t list = plist_new_array();
+    plist_t nested = plist_new_dict();
+    int i;
+
+    for (i = 0; i < ITEMS; i++)
+    {
+        plist_array_append_item(list, plist_new_uint(i));
+    }
+    plist_dict_set_item(nested, "flag", plist_new_bool(1));
+    plist_dict_set_item(nested, "items", plist_copy(list));
+    plist_dict_set_item(root, "name", plist_new_string("views"));
+    plist_dict_set_item(root, "list", list);
+    plist_dict_set_item(root, "nested", nested);
+    plist_dict_set_item(root, "empty", plist_new_array());
+    return root;
+}
+
+static uint64_t sum_items(const ArrayView& a)
+{
+    uint64_t sum = 0;
+    for (ArrayView::iterator it = a.begin(); it != a.end(); ++it)
+    {
+        sum += (*it).GetUInt();
+    }
+    return sum;
+}
+
+static void check_views(plist_t root)
+{
+    static const char* keys[] = { "name", "list", "nested", "empty" };
+    const uint64_t expected = (uint64_t)ITEMS * (ITEMS - 1) / 2;
+    DictView dict(root);
+    unsigned int count = 0;
+
+    CHECK(dict.IsValid() && dict.GetSize() == 4);
+    for (DictView::iterator it = dict.Begin(); it != dict.End(); ++it)
+    {
+        uint64_t length = 0;
+        const char* key = it.GetKey(&length);
+        CHECK(count < 4 && key && length == strlen(keys[count]) && strcmp(key, keys[count]) == 0);
+        CHECK(it.GetValue().GetParent().GetPlist() == root);
+        if (count == 1)
+        {
+            /* the children are first reached through the iterator */
+            CHECK(sum_items(it.GetValue().AsArray()) == expected);
+        }
+        count++;
+    }
+    CHECK(count == 4);
+
+    CHECK(dict["name"].GetString() == "views");
+    CHECK(!dict["missing"].IsValid());
+    CHECK(dict["list"].AsArray().GetSize() == ITEMS);
+    CHECK(dict["list"].AsArray()[ITEMS-1].GetUInt() == ITEMS-1);
+    CHECK(!dict["list"].AsArray()[ITEMS].IsValid());
+
+    DictView nested = dict["nested"].AsDict();
+    count = 0;
+    for (const DictView::iterator& item : nested)
+    {
+        if (strcmp(item.GetKey(), "flag") == 0)
+        {
+            CHECK(item.GetValue().GetBool());
+        }
+        else
+        {
+            CHECK(sum_items(item.GetValue().AsArray()) == expected);
+        }
+        count++;
+    }
+    CHECK(count == 2);
+
+    uint64_t sum = 0;
+    for (View item : dict["list"].AsArray())
+    {
+        sum += item.GetUInt();
+    }
+    CHECK(sum == expected);
+
+    ArrayView empty = dict["empty"].AsArray();
+    CHECK(empty.IsValid() && empty.GetSize() == 0 && empty.begin() == empty.end());
+
+    /* views of the wrong type are invalid and empty */
+    CHECK(!dict["name"].AsArray().IsValid());
+    CHECK(!ArrayView(root).IsValid() && ArrayView(root).begin() == ArrayView(root).end());
+    CHECK(!DictView(dict["list"].GetPlist()).IsValid());
+    CHECK(DictView().GetSize() == 0 && DictView().Begin() == DictView().End());
+}
+
+static void check_lazy()
+{
+    plist_t root = create_tree();
+    char* bin = NULL;
+    uint32_t length = 0;
+    plist_t lazy = NULL;
+
+    plist_to_bin(root, &bin, &length);
+    plist_from_bin_ex(bin, length, PLIST_PARSE_LAZY, &lazy);
+    CHECK(lazy != NULL);
+    if (lazy)
+    {
+        check_views(lazy);
+        CHECK(plist_equal_deep(root, lazy));
+        plist_free(lazy);
+    }
+
+    /* iterating first, before anything else loaded the children */
+    plist_from_bin_ex(bin, length, PLIST_PARSE_LAZY, &lazy);
+    if (lazy)
+    {
+        ArrayView list = DictView(lazy)["list"].AsArray();
+        CHECK(sum_items(list) == (uint64_t)ITEMS * (ITEMS - 1) / 2);
+        plist_free(lazy);
+    }
+
+    plist_mem_free(bin);
+    plist_free(root);
+}
+
+static void check_ownership()
+{
+    Integer a(5);
+    plist_t p = a.GetPlist();
+    Integer b(std::move(a));
+    CHECK(b.GetPlist() == p && a.GetPlist() == NULL);
+    Integer c;
+    c = std::move(b);
+    CHECK(c.GetPlist() == p && c.GetValue() == 5 && b.GetPlist() == NULL);
+
+    Dictionary d;
+    d.Set("int", c);
+    Node* child = d.Find("int")->second;
+    Dictionary e(std::move(d));
+    CHECK(e.GetSize() == 1 && e.Find("int")->second == child && child->GetParent() == &e);
+    CHECK(d.GetPlist() == NULL);
+
+    /* a wrapper owned by a structure is copied instead of moved */
+    Integer moved(std::move(*static_cast<Integer*>(child)));
+    CHECK(moved.GetPlist() != child->GetPlist() && moved.GetValue() == 5);
+    CHECK(plist_dict_get_item(e.GetPlist(), "int") == child->GetPlist());
+
+    /* the unique_ptr overloads insert the node itself */
+    std::unique_ptr<Node> s(new String("value"));
+    Node* raw = s.get();
+    plist_t sp = raw->GetPlist();
+    e.Set("str", std::move(s));
+    CHECK(!s && e.Find("str")->second == raw && raw->GetParent() == &e);
+    CHECK(plist_dict_get_item(e.GetPlist(), "str") == sp);
+
+    Array arr;
+    std::unique_ptr<Node> first(new Integer(1));
+    std::unique_ptr<Node> second(new Integer(2));
+    Node* rfirst = first.get();
+    Node* rsecond = second.get();
+    plist_t psecond = rsecond->GetPlist();
+    arr.Append(std::move(first));
+    arr.Insert(std::move(second), 0);
+    CHECK(arr.GetSize() == 2 && arr[0] == rsecond && arr[1] == rfirst);
+    CHECK(arr.GetNodeIndex(rfirst) == 1 && rsecond->GetParent() == &arr);
+    CHECK(plist_array_get_item(arr.GetPlist(), 0) == psecond);
+
+    plist_t ap = arr.GetPlist();
+    Array arr2;
+    arr2 = std::move(arr);
+    CHECK(arr2.GetPlist() == ap && arr2[1] == rfirst && rfirst->GetParent() == &arr2);
+}
+
+static void check_node_key()
+{
+    Dictionary d1;
+    Dictionary d2;
+    d1.Set("k", Integer(1));
+    d1.Set("other", Integer(2));
+    d2.Set("k", Integer(3));
+    Node* own = d1.Find("k")->second;
+    Node* foreign = d2.Find("k")->second;
+    Integer loose(4);
+
+    CHECK(d1.GetNodeKey(own) == "k");
+    CHECK(d1.GetNodeKey(foreign).empty());
+    CHECK(d1.GetNodeKey(&loose).empty());
+    CHECK(d1.GetNodeKey(&d2).empty());
+
+    /* nodes of other dictionaries are ignored */
+    d1.Remove(foreign);
+    d1.Remove(&loose);
+    CHECK(d1.GetSize() == 2 && d2.GetSize() == 1);
+    CHECK(d2.Find("k")->second == foreign && foreign->GetPlist() == plist_dict_get_item(d2.GetPlist(), "k"));
+
+    d1.Remove(own);
+    CHECK(d1.GetSize() == 1 && d1.Find("k") == d1.End());
+    CHECK(plist_dict_get_item(d1.GetPlist(), "k") == NULL);
+    CHECK(d1.GetNodeKey(d1.Find("other")->second) == "other");
+}
+
+int main(void)
+{
+    plist_t root = create_tree();
+    check_views(root);
+    plist_free(root);
+
+    check_lazy();
+    check_ownership();
+    check_node_key();
+
+    if (failures > 0)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("C++ view and ownership tests succeeded\n");
+    return 0;
+}
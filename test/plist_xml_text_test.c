@@ -0,0 +1,120 @@
+/*
+ * plist_xml_text_test.c
+ * checks element content split by comments, CDATA sections and entities
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLIST_HEAD "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<plist version=\"1.0\">\n"
+#define PLIST_TAIL "\n</plist>\n"
+
+static plist_t parse(const char *body)
+{
+    char xml[1024];
+    plist_t root = NULL;
+    snprintf(xml, sizeof(xml), PLIST_HEAD "%s" PLIST_TAIL, body);
+    plist_from_xml(xml, strlen(xml), &root);
+    return root;
+}
+
+static int check_string(const char *body, const char *expected)
+{
+    plist_t root = parse(body);
+    const char *str = plist_get_string_ptr(root, NULL);
+    int res = 0;
+
+    if (!str || strcmp(str, expected) != 0) {
+        printf("%s: got '%s' instead of '%s'\n", body, (str) ? str : "(null)", expected);
+        res = 1;
+    }
+    plist_free(root);
+    return res;
+}
+
+static int check_invalid(const char *body)
+{
+    plist_t root = parse(body);
+    if (root) {
+        printf("%s: must not parse\n", body);
+        plist_free(root);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_t root = NULL;
+    const char *data = NULL;
+    uint64_t len = 0;
+    uint64_t uval = 0;
+    uint8_t bval = 0;
+    int res = 0;
+
+    res |= check_string("<string>plain</string>", "plain");
+    res |= check_string("<string>a string that is too long to be inline</string>", "a string that is too long to be inline");
+    res |= check_string("<string></string>", "");
+    res |= check_string("<string/>", "");
+    res |= check_string("<string>&lt;tag&gt; &amp; more</string>", "<tag> & more");
+    res |= check_string("<string><![CDATA[<raw> &amp;]]></string>", "<raw> &amp;");
+    res |= check_string("<string>a<!-- comment -->b</string>", "ab");
+    res |= check_string("<string>a<![CDATA[<b>]]>c&amp;d</string>", "a<b>c&d");
+    res |= check_string("<string>1<!---->2<!---->3<!---->4<!---->5<!---->6<![CDATA[7]]>8</string>", "12345678");
+
+    /* keys with entities and split content */
+    root = parse("<dict><key>a&amp;b</key><true/><key>c<!-- x -->d</key><false /></dict>");
+    if (!root || plist_get_node_type(plist_dict_get_item(root, "a&b")) != PLIST_BOOLEAN || !plist_dict_get_item(root, "cd")) {
+        printf("Keys with entities or comments failed\n");
+        res = 1;
+    }
+    plist_get_bool_val(plist_dict_get_item(root, "cd"), &bval);
+    if (bval) {
+        printf("<false /> is true\n");
+        res = 1;
+    }
+    plist_free(root);
+
+    /* all parts of data and numbers are used */
+    root = parse("<array><data>SGVs<!-- x -->bG8=</data><integer>1<!-- x -->23</integer></array>");
+    data = plist_get_data_ptr(plist_array_get_item(root, 0), &len);
+    if (!data || len != 5 || memcmp(data, "Hello", 5) != 0) {
+        printf("Data split by a comment failed\n");
+        res = 1;
+    }
+    plist_get_uint_val(plist_array_get_item(root, 1), &uval);
+    if (uval != 123) {
+        printf("Integer split by a comment is %llu\n", (unsigned long long)uval);
+        res = 1;
+    }
+    plist_free(root);
+
+    res |= check_invalid("<string>a</strin>");
+    res |= check_invalid("<array><foo/></array>");
+    res |= check_invalid("<array><dict></array></dict>");
+    res |= check_invalid("<array>");
+    res |= check_invalid("<dict><key>&bogus;</key><true/></dict>");
+    res |= check_invalid("<string>a<!-- unterminated</string>");
+
+    if (res == 0) {
+        printf("XML text content succeeded\n");
+    }
+    return res;
+}
@@ -0,0 +1,152 @@
+/*
+ * plist_xml_write_test.c
+ * checks that all XML writer options produce documents that parse into
+ * the same tree
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "plist/plist.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t all_options[] = {
+    PLIST_XML_DEFAULT,
+    PLIST_XML_COMPACT,
+    PLIST_XML_NO_HEADER,
+    PLIST_XML_COMPACT | PLIST_XML_NO_HEADER,
+    PLIST_XML_INDENT_SPACES(2),
+    PLIST_XML_INDENT_SPACES(15) | PLIST_XML_NO_HEADER
+};
+#define NUM_OPTIONS (sizeof(all_options) / sizeof(all_options[0]))
+
+static int check_tree(plist_t root, const char *what)
+{
+    char *xml = NULL;
+    char *xml_default = NULL;
+    uint32_t len = 0;
+    uint32_t len_default = 0;
+    size_t i = 0;
+    int res = 0;
+
+    plist_to_xml(root, &xml_default, &len_default);
+    for (i = 0; i < NUM_OPTIONS; i++) {
+        uint32_t options = all_options[i];
+        plist_t parsed = NULL;
+
+        xml = NULL;
+        plist_to_xml_ex(root, options, &xml, &len);
+        if (!xml || strlen(xml) != len) {
+            printf("%s: no output with options 0x%x\n", what, options);
+            res = 1;
+            continue;
+        }
+        if (options == PLIST_XML_DEFAULT && (len != len_default || memcmp(xml, xml_default, len) != 0)) {
+            printf("%s: default options differ from plist_to_xml\n", what);
+            res = 1;
+        }
+        if ((options & PLIST_XML_COMPACT) && memchr(xml, '\n', len)) {
+            printf("%s: compact output has line breaks\n", what);
+            res = 1;
+        }
+        if ((options & PLIST_XML_COMPACT) && len > len_default) {
+            printf("%s: compact output is larger\n", what);
+            res = 1;
+        }
+        if ((options & PLIST_XML_NO_HEADER) && strncmp(xml, "<plist version=\"1.0\">", 21) != 0) {
+            printf("%s: output with options 0x%x has a header\n", what, options);
+            res = 1;
+        }
+        if (!(options & PLIST_XML_NO_HEADER) && strncmp(xml, "<?xml ", 6) != 0) {
+            printf("%s: output with options 0x%x has no header\n", what, options);
+            res = 1;
+        }
+        plist_from_xml(xml, len, &parsed);
+        if (!parsed || !plist_equal_deep(root, parsed)) {
+            printf("%s: output with options 0x%x does not parse into the same tree\n", what, options);
+            res = 1;
+        }
+        plist_free(parsed);
+        free(xml);
+    }
+    free(xml_default);
+    return res;
+}
+
+static int check_generated(void)
+{
+    plist_t root = plist_new_dict();
+    plist_t nested = plist_new_array();
+    plist_t inner = nested;
+    char data[1000];
+    char *xml = NULL;
+    uint32_t len = 0;
+    int res = 0;
+    int i = 0;
+
+    for (i = 0; i < (int)sizeof(data); i++) {
+        data[i] = (char)(i * 7);
+    }
+    /* deep enough for the indentation to exceed the wrapping width */
+    for (i = 0; i < 20; i++) {
+        plist_t a = plist_new_array();
+        plist_array_append_item(inner, a);
+        inner = a;
+    }
+    plist_array_append_item(inner, plist_new_data(data, sizeof(data)));
+    plist_dict_set_item(root, "nested", nested);
+    plist_dict_set_item(root, "data", plist_new_data(data, sizeof(data)));
+    plist_dict_set_item(root, "empty data", plist_new_data("", 0));
+    plist_dict_set_item(root, "string", plist_new_string("<&>"));
+    plist_dict_set_item(root, "empty", plist_new_dict());
+    res |= check_tree(root, "generated");
+
+    plist_to_xml_ex(root, PLIST_XML_INDENT_SPACES(3), &xml, &len);
+    if (!strstr(xml, "\n   <key>nested</key>\n") || strchr(xml, '\t')) {
+        printf("Indentation with spaces failed\n");
+        res = 1;
+    }
+    free(xml);
+    plist_free(root);
+
+    root = plist_new_string("scalar");
+    res |= check_tree(root, "scalar");
+    plist_free(root);
+    return res;
+}
+
+int main(int argc, char *argv[])
+{
+    int res = 0;
+    int i = 0;
+
+    res |= check_generated();
+    for (i = 1; i < argc; i++) {
+        plist_t root = NULL;
+        /* invalid files are checked elsewhere */
+        plist_read_from_file(argv[i], &root, NULL);
+        if (root) {
+            res |= check_tree(root, argv[i]);
+            plist_free(root);
+        }
+    }
+
+    if (res == 0) {
+        printf("XML writer options succeeded\n");
+    }
+    return res;
+}
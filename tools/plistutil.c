@@ -21,21 +21,42 @@
  */
 
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "plist/plist.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <pthread.h>
+#endif
 
 #ifdef _MSC_VER
 #pragma warning(disable:4996)
 #endif
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 typedef struct _options
 {
-    char *in_file, *out_file;
+    char *in_file, *out_file, *out_dir;
+    char **inputs;
+    int num_inputs;
+    int jobs;
     uint8_t debug, in_fmt, out_fmt;
 } options_t;
 
@@ -43,10 +64,18 @@ static void print_usage(int argc, char *argv[])
 {
     char *name = NULL;
     name = strrchr(argv[0], '/');
-    printf("Usage: %s -i|--infile FILE [-o|--outfile FILE] [-d|--debug]\n", (name ? name + 1: argv[0]));
-    printf("Convert a plist FILE from binary to XML format or vice-versa.\n\n");
+    printf("Usage: %s -i|--infile FILE [-o|--outfile FILE] [-f|--format FORMAT] [-d|--debug]\n", (name ? name + 1: argv[0]));
+    printf("       %s -O|--outdir DIR [-f|--format FORMAT] [-j|--jobs N] [-d|--debug] FILE|DIR...\n", (name ? name + 1: argv[0]));
+    printf("Convert a plist FILE from binary to XML format or vice-versa.\n");
+    printf("With --outdir, all given FILEs and the plists found in the given DIRs\n");
+    printf("(recursively) are converted into DIR, keeping their relative paths.\n\n");
     printf("  -i, --infile FILE\tThe FILE to convert from\n");
     printf("  -o, --outfile FILE\tOptional FILE to convert to or stdout if not used\n");
+    printf("  -O, --outdir DIR\tConvert many files into DIR (batch mode)\n");
+    printf("  -f, --format FORMAT\tOutput format, 'bin' or 'xml'. The default is the\n");
+    printf("\t\t\tformat the input is not in\n");
+    printf("  -j, --jobs N\t\tConvert N files in parallel in batch mode, defaults\n");
+    printf("\t\t\tto the number of CPUs\n");
     printf("  -d, --debug\t\tEnable extended debug output\n");
     printf("\n");
 }
@@ -57,6 +86,8 @@ static options_t *parse_arguments(int argc, char *argv[])
 
     options_t *options = (options_t *) malloc(sizeof(options_t));
     memset(options, 0, sizeof(options_t));
+    options->inputs = (char **) malloc(sizeof(char*) * (argc + 1));
+    options->jobs = -1;
 
     for (i = 1; i < argc; i++)
     {
@@ -64,8 +95,7 @@ static options_t *parse_arguments(int argc, char *argv[])
         {
             if ((i + 1) == argc)
             {
-                free(options);
-                return NULL;
+                goto error;
             }
             options->in_file = argv[i + 1];
             i++;
@@ -76,110 +106,547 @@ static options_t *parse_arguments(int argc, char *argv[])
         {
             if ((i + 1) == argc)
             {
-                free(options);
-                return NULL;
+                goto error;
             }
             options->out_file = argv[i + 1];
             i++;
             continue;
         }
 
+        if (!strcmp(argv[i], "--outdir") || !strcmp(argv[i], "-O"))
+        {
+            if ((i + 1) == argc)
+            {
+                goto error;
+            }
+            options->out_dir = argv[i + 1];
+            i++;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--format") || !strcmp(argv[i], "-f"))
+        {
+            if ((i + 1) == argc)
+            {
+                goto error;
+            }
+            if (!strcmp(argv[i + 1], "bin"))
+            {
+                options->out_fmt = PLIST_FORMAT_BINARY;
+            }
+            else if (!strcmp(argv[i + 1], "xml"))
+            {
+                options->out_fmt = PLIST_FORMAT_XML;
+            }
+            else
+            {
+                fprintf(stderr, "ERROR: Unknown output format '%s'\n", argv[i + 1]);
+                goto error;
+            }
+            i++;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j"))
+        {
+            if ((i + 1) == argc || atoi(argv[i + 1]) <= 0)
+            {
+                goto error;
+            }
+            options->jobs = atoi(argv[i + 1]);
+            i++;
+            continue;
+        }
+
         if (!strcmp(argv[i], "--debug") || !strcmp(argv[i], "-d"))
         {
             options->debug = 1;
+            continue;
         }
 
         if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h"))
         {
-            free(options);
-            return NULL;
+            goto error;
+        }
+
+        if (argv[i][0] != '-')
+        {
+            options->inputs[options->num_inputs++] = argv[i];
         }
     }
 
-    if (!options->in_file)
+    if (options->out_dir)
     {
-        free(options);
-        return NULL;
+        if (options->in_file)
+        {
+            options->inputs[options->num_inputs++] = options->in_file;
+        }
+        if (options->num_inputs == 0 || options->out_file)
+        {
+            goto error;
+        }
+    }
+    else if (!options->in_file || options->num_inputs > 0)
+    {
+        goto error;
     }
 
     return options;
+
+error:
+    free(options->inputs);
+    free(options);
+    return NULL;
 }
 
-int main(int argc, char *argv[])
+static int write_all(int fd, const char *buf, size_t size)
 {
-    FILE *iplist = NULL;
-    plist_t root_node = NULL;
-    char *plist_out = NULL;
-    uint32_t size = 0;
-    int read_size = 0;
-    char *plist_entire = NULL;
-    struct stat filestats;
-    options_t *options = parse_arguments(argc, argv);
-
-    if (!options)
+    while (size > 0)
     {
-        print_usage(argc, argv);
-        return 0;
+        ssize_t res = write(fd, buf, size);
+        if (res < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += res;
+        size -= res;
     }
+    return 0;
+}
 
-    // read input file
-    iplist = fopen(options->in_file, "rb");
-    if (!iplist) {
-        printf("ERROR: Could not open input file '%s': %s\n", options->in_file, strerror(errno));
-        free(options);
-        return 1;
+/* creates the directories leading to path */
+static int make_parent_dirs(const char *path)
+{
+    char *dir = strdup(path);
+    char *p = dir;
+    int res = 0;
+
+    if (!dir)
+        return -1;
+    while ((p = strchr(p + 1, '/')))
+    {
+        *p = '\0';
+#ifdef WIN32
+        if (mkdir(dir) != 0 && errno != EEXIST)
+#else
+        if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+#endif
+        {
+            res = -1;
+            break;
+        }
+        *p = '/';
     }
+    free(dir);
+    return res;
+}
 
-    memset(&filestats, '\0', sizeof(struct stat));
-    fstat(fileno(iplist), &filestats);
+/*
+ * Converts in_file to out_fmt, or to the other format if out_fmt is 0, and
+ * writes it to out_file or stdout if out_file is NULL. The input is mapped
+ * into memory, XML is written in chunks as it is generated and binary
+ * output comes from the buffer of ctx, which the caller reuses across
+ * files. The output file is only created once the input has been parsed.
+ *
+ * Returns 0 on success, -1 if the input could not be read, -2 if it is not
+ * a plist and -3 if the output could not be written.
+ */
+static int convert_file(const char *in_file, const char *out_file, uint8_t out_fmt, int make_dirs, plist_context_t ctx)
+{
+    plist_t root_node = NULL;
+    plist_mapping_t mapping = NULL;
+    plist_format_t format = PLIST_FORMAT_XML;
+    int fd = 1;
+    int err = 0;
+    int res = 0;
 
-    if (filestats.st_size < 8) {
-        printf("ERROR: Input file is too small to contain valid plist data.\n");
-        free(options);
-        fclose(iplist);
+    // read input file, data nodes reference the mapped file
+    res = plist_read_from_file_ex(in_file, PLIST_PARSE_BORROW, &root_node, &format, &mapping);
+    if (res == -1)
         return -1;
+    if (!root_node)
+    {
+        plist_mapping_free(mapping);
+        return -2;
     }
 
-    plist_entire = (char *) malloc(sizeof(char) * (filestats.st_size + 1));
-    read_size = fread(plist_entire, sizeof(char), filestats.st_size, iplist);
-    fclose(iplist);
+    if (!out_fmt)
+        out_fmt = (format == PLIST_FORMAT_BINARY) ? PLIST_FORMAT_XML : PLIST_FORMAT_BINARY;
+
+    if (out_file)
+    {
+        if (make_dirs)
+            make_parent_dirs(out_file);
+        fd = open(out_file, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    }
 
-    // convert from binary to xml or vice-versa
-    if (plist_is_binary(plist_entire, read_size))
+    if (fd < 0)
+    {
+        res = -3;
+    }
+    else if (out_fmt == PLIST_FORMAT_XML)
     {
-        plist_from_bin(plist_entire, read_size, &root_node);
-        plist_to_xml(root_node, &plist_out, &size);
+        res = (plist_to_xml_fd(root_node, fd) == 0) ? 0 : -3;
     }
     else
     {
-        plist_from_xml(plist_entire, read_size, &root_node);
-        plist_to_bin(root_node, &plist_out, &size);
+        const char *plist_out = NULL;
+        uint32_t size = 0;
+        plist_to_bin_ctx(ctx, root_node, PLIST_WRITE_DEFAULT, &plist_out, &size);
+        res = (plist_out && write_all(fd, plist_out, size) == 0) ? 0 : -3;
     }
+    err = errno;
+    if (out_file && fd >= 0 && close(fd) != 0 && res == 0)
+    {
+        err = errno;
+        res = -3;
+    }
+
     plist_free(root_node);
-    free(plist_entire);
+    plist_mapping_free(mapping);
+    /* for the error message of the caller */
+    errno = err;
+    return res;
+}
+
+/* files of the batch mode, handed from the thread walking the inputs to
+ * the conversion threads in a bounded queue */
+#define BATCH_QUEUE_SIZE 1024
+
+struct batch_job
+{
+    char *in_file;
+    char *out_file;
+    /* given on the command line, so not being a plist is an error */
+    int requested;
+};
+
+struct batch
+{
+    options_t *options;
+    struct batch_job queue[BATCH_QUEUE_SIZE];
+    unsigned int head;
+    unsigned int count;
+    int done;
+    int failed;
+    plist_context_t ctx;
+    /* output paths queued so far, mapped to their input */
+    plist_t outputs;
+#ifndef WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+#endif
+};
+
+static void batch_run_job(struct batch *b, struct batch_job *job, plist_context_t ctx)
+{
+    int res = convert_file(job->in_file, job->out_file, b->options->out_fmt, 1, ctx);
+    int failed = 1;
+
+    switch (res)
+    {
+    case 0:
+        failed = 0;
+        break;
+    case -1:
+        fprintf(stderr, "ERROR: Could not open input file '%s': %s\n", job->in_file, strerror(errno));
+        break;
+    case -2:
+        if (job->requested)
+            fprintf(stderr, "ERROR: Failed to convert input file '%s'\n", job->in_file);
+        else {
+            failed = 0;
+            if (b->options->debug)
+                fprintf(stderr, "Skipping '%s', not a plist\n", job->in_file);
+        }
+        break;
+    default:
+        fprintf(stderr, "ERROR: Could not write output file '%s': %s\n", job->out_file, strerror(errno));
+        break;
+    }
+    if (failed)
+    {
+#ifndef WIN32
+        pthread_mutex_lock(&b->lock);
+#endif
+        b->failed = 1;
+#ifndef WIN32
+        pthread_mutex_unlock(&b->lock);
+#endif
+    }
+    free(job->in_file);
+    free(job->out_file);
+}
 
-    if (plist_out)
+#ifndef WIN32
+static void *batch_worker(void *arg)
+{
+    struct batch *b = (struct batch*)arg;
+    plist_context_t ctx = plist_context_new();
+    struct batch_job job;
+
+    while (1)
     {
-        if (options->out_file != NULL)
+        pthread_mutex_lock(&b->lock);
+        while (b->count == 0 && !b->done)
+            pthread_cond_wait(&b->not_empty, &b->lock);
+        if (b->count == 0)
         {
-            FILE *oplist = fopen(options->out_file, "wb");
-            if (!oplist) {
-                printf("ERROR: Could not open output file '%s': %s\n", options->out_file, strerror(errno));
-                free(options);
-                return 1;
-            }
-            fwrite(plist_out, size, sizeof(char), oplist);
-            fclose(oplist);
+            pthread_mutex_unlock(&b->lock);
+            break;
         }
-        // if no output file specified, write to stdout
-        else
-            fwrite(plist_out, size, sizeof(char), stdout);
+        job = b->queue[b->head];
+        b->head = (b->head + 1) % BATCH_QUEUE_SIZE;
+        b->count--;
+        pthread_cond_signal(&b->not_full);
+        pthread_mutex_unlock(&b->lock);
 
-        free(plist_out);
+        batch_run_job(b, &job, ctx);
     }
-    else
+
+    plist_context_free(ctx);
+    return NULL;
+}
+#endif
+
+static void batch_add(struct batch *b, const char *in_file, const char *out_file, int requested)
+{
+    struct batch_job job;
+    plist_t other = plist_dict_get_item(b->outputs, out_file);
+
+    /* two inputs must not overwrite the same output file */
+    if (other)
+    {
+        fprintf(stderr, "ERROR: Input files '%s' and '%s' would both be written to '%s'\n", plist_get_string_ptr(other, NULL), in_file, out_file);
+        b->failed = 1;
+        return;
+    }
+    plist_dict_set_item(b->outputs, out_file, plist_new_string(in_file));
+
+    job.in_file = strdup(in_file);
+    job.out_file = strdup(out_file);
+    job.requested = requested;
+    if (!job.in_file || !job.out_file)
+    {
+        free(job.in_file);
+        free(job.out_file);
+        b->failed = 1;
+        return;
+    }
+
+    if (b->options->jobs <= 1)
+    {
+        batch_run_job(b, &job, b->ctx);
+        return;
+    }
+#ifndef WIN32
+    pthread_mutex_lock(&b->lock);
+    while (b->count == BATCH_QUEUE_SIZE)
+        pthread_cond_wait(&b->not_full, &b->lock);
+    b->queue[(b->head + b->count) % BATCH_QUEUE_SIZE] = job;
+    b->count++;
+    pthread_cond_signal(&b->not_empty);
+    pthread_mutex_unlock(&b->lock);
+#endif
+}
+
+static char *path_join(const char *dir, const char *name)
+{
+    size_t dlen = strlen(dir);
+    size_t nlen = strlen(name);
+    char *path = (char *) malloc(dlen + nlen + 2);
+
+    if (!path)
+        return NULL;
+    memcpy(path, dir, dlen);
+    if (dlen > 0 && dir[dlen - 1] != '/')
+        path[dlen++] = '/';
+    memcpy(path + dlen, name, nlen + 1);
+    return path;
+}
+
+/* queues all regular files below in_dir, converted into out_dir */
+static void batch_add_dir(struct batch *b, const char *in_dir, const char *out_dir)
+{
+    DIR *dir = opendir(in_dir);
+    struct dirent *ent = NULL;
+
+    if (!dir)
+    {
+        fprintf(stderr, "ERROR: Could not open directory '%s': %s\n", in_dir, strerror(errno));
+        b->failed = 1;
+        return;
+    }
+    while ((ent = readdir(dir)))
+    {
+        struct stat st;
+        char *in_path = NULL;
+        char *out_path = NULL;
+
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+        in_path = path_join(in_dir, ent->d_name);
+        out_path = path_join(out_dir, ent->d_name);
+        if (in_path && out_path && stat(in_path, &st) == 0)
+        {
+            if (S_ISDIR(st.st_mode))
+                batch_add_dir(b, in_path, out_path);
+            else if (S_ISREG(st.st_mode))
+                batch_add(b, in_path, out_path, 0);
+        }
+        free(in_path);
+        free(out_path);
+    }
+    closedir(dir);
+}
+
+static int run_batch(options_t *options)
+{
+    struct batch *b = (struct batch *) calloc(1, sizeof(struct batch));
+#ifndef WIN32
+    pthread_t *threads = NULL;
+    int started = 0;
+#endif
+    int failed = 0;
+    int i = 0;
+
+    if (!b)
+        return 1;
+    b->options = options;
+    b->ctx = plist_context_new();
+    b->outputs = plist_new_dict();
+
+#ifdef WIN32
+    options->jobs = 1;
+#else
+    if (options->jobs < 0)
+    {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        options->jobs = (ncpu > 0) ? (int)ncpu : 1;
+    }
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->not_empty, NULL);
+    pthread_cond_init(&b->not_full, NULL);
+    if (options->jobs > 1)
+    {
+        threads = (pthread_t *) malloc(sizeof(pthread_t) * options->jobs);
+        for (i = 0; threads && i < options->jobs; i++)
+        {
+            if (pthread_create(&threads[started], NULL, batch_worker, b) == 0)
+                started++;
+        }
+        if (started == 0)
+            options->jobs = 1;
+    }
+#endif
+
+    for (i = 0; i < options->num_inputs; i++)
+    {
+        const char *input = options->inputs[i];
+        const char *name = NULL;
+        char *base = NULL;
+        struct stat st;
+        size_t len = strlen(input);
+
+        /* the last path component without trailing slashes */
+        while (len > 1 && input[len - 1] == '/')
+            len--;
+        name = input + len;
+        while (name > input && name[-1] != '/')
+            name--;
+
+        if (stat(input, &st) != 0)
+        {
+            fprintf(stderr, "ERROR: Could not open input file '%s': %s\n", input, strerror(errno));
+            b->failed = 1;
+            continue;
+        }
+        if (S_ISDIR(st.st_mode))
+        {
+            /* the contents of a directory go directly into the output directory */
+            batch_add_dir(b, input, options->out_dir);
+            continue;
+        }
+        base = (char *) malloc(input + len - name + 1);
+        if (base)
+        {
+            char *output = NULL;
+            memcpy(base, name, input + len - name);
+            base[input + len - name] = '\0';
+            /* joined like the paths of directory contents, so the same
+             * output file always has the same path */
+            output = path_join(options->out_dir, base);
+            if (output)
+                batch_add(b, input, output, 1);
+            free(output);
+            free(base);
+        }
+    }
+
+#ifndef WIN32
+    pthread_mutex_lock(&b->lock);
+    b->done = 1;
+    pthread_cond_broadcast(&b->not_empty);
+    pthread_mutex_unlock(&b->lock);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    pthread_cond_destroy(&b->not_full);
+    pthread_cond_destroy(&b->not_empty);
+    pthread_mutex_destroy(&b->lock);
+#endif
+
+    failed = b->failed;
+    plist_context_free(b->ctx);
+    plist_free(b->outputs);
+    free(b);
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    plist_context_t ctx = NULL;
+    int res = 0;
+    options_t *options = parse_arguments(argc, argv);
+
+    if (!options)
+    {
+        print_usage(argc, argv);
+        return 0;
+    }
+
+    if (options->out_dir)
+    {
+        res = run_batch(options);
+        free(options->inputs);
+        free(options);
+        return res;
+    }
+
+    ctx = plist_context_new();
+    res = convert_file(options->in_file, options->out_file, options->out_fmt, 0, ctx);
+    plist_context_free(ctx);
+
+    if (res == -1)
+    {
+        printf("ERROR: Could not open input file '%s': %s\n", options->in_file, strerror(errno));
+        res = 1;
+    }
+    else if (res == -2)
+    {
         printf("ERROR: Failed to convert input file.\n");
+        res = 0;
+    }
+    else if (res == -3)
+    {
+        printf("ERROR: Could not write output file '%s': %s\n", options->out_file ? options->out_file : "<stdout>", strerror(errno));
+        res = 1;
+    }
 
+    free(options->inputs);
     free(options);
-    return 0;
+    return res;
 }